@@ -33,6 +33,7 @@
 static GSList *make_regex_exclude_list(GSList *exclude_list);
 static gboolean exclude_file(GSList *regex_exclude_list, gchar *filename);
 static main_struct_t *init_main_structure(options_t *opt);
+static gssize read_next_block(GFileInputStream *stream, guchar *buffer, gint64 blocksize, gboolean *zero, GError **error);
 static GList *calculate_hash_data_list_for_file(GFile *a_file, gint64 blocksize, gshort cmptype);
 static meta_data_t *get_meta_data_from_fileinfo(file_event_t *file_event, filter_file_t *filter, options_t *opt);
 static gchar *send_meta_data_to_server(main_struct_t *main_struct, meta_data_t *meta, gboolean data_sent);
@@ -47,6 +48,8 @@ static void free_filter_file_t(filter_file_t *filter);
 static void free_file_event_t(file_event_t *file_event);
 static gint insert_array_in_root_and_send(main_struct_t *main_struct, json_t *array);
 static void process_small_file_not_in_cache(main_struct_t *main_struct, meta_data_t *meta);
+static void refresh_bloom_filter(main_struct_t *main_struct);
+static gchar *ask_server_for_needed_hashs(main_struct_t *main_struct, GList *hash_data_list);
 static GList *lets_send_all_that_now(main_struct_t *main_struct, GList *hash_data_list, GList *saved_list, gsize read_bytes);
 static void process_big_file_not_in_cache(main_struct_t *main_struct, meta_data_t *meta);
 static gint64 calculate_file_blocksize(options_t *opt, gint64 size);
@@ -141,6 +144,12 @@ static main_struct_t *init_main_structure(options_t *opt)
             main_struct->comm = init_comm_struct(conn, opt->cmptype);
             main_struct->reconnected = init_comm_struct(conn, opt->cmptype);
             free_variable(conn);
+
+            /* zstd compresses small blocks far better with the server's latest dictionary */
+            if (opt->cmptype == COMPRESS_ZSTD_TYPE)
+                {
+                    use_compress_dictionary(get_dictionary_from_server(main_struct->comm, 0, NULL));
+                }
         }
     else
         {
@@ -155,6 +164,10 @@ static main_struct_t *init_main_structure(options_t *opt)
     main_struct->dir_queue = g_async_queue_new();
     main_struct->regex_exclude_list = make_regex_exclude_list(opt->exclude_list);
 
+    /* The filter is downloaded from the server on first use */
+    main_struct->bloom = NULL;
+    main_struct->bloom_refreshed = 0;
+
     /* Thread initialization */
     main_struct->save_one_file = g_thread_new("save_one_file", save_one_file_threaded, main_struct);
     main_struct->carve_all_directories = g_thread_new("carve_all_directories", carve_all_directories, main_struct);
@@ -170,6 +183,65 @@ static main_struct_t *init_main_structure(options_t *opt)
 }
 
 
+/**
+ * Reads the next block of a file. When the block lies in a hole of a
+ * sparse file (found with SEEK_DATA) nothing is read from the disk and
+ * the buffer is filled with zeros.
+ * @param stream is the stream of the file being read.
+ * @param buffer is where to put the block (at least blocksize bytes long).
+ * @param blocksize is the size of a block.
+ * @param[out] zero is set to TRUE when the block contains only zeros
+ *             and to FALSE otherwise.
+ * @param[out] error is set when an error occured while reading.
+ * @returns the number of bytes of the block (0 at the end of the file).
+ */
+static gssize read_next_block(GFileInputStream *stream, guchar *buffer, gint64 blocksize, gboolean *zero, GError **error)
+{
+    gssize size_read = -1;
+    gint fd = -1;
+    off_t offset = -1;
+    off_t data = -1;
+    off_t end = -1;
+    gboolean hole = FALSE;
+
+#ifdef SEEK_DATA
+    if (G_IS_FILE_DESCRIPTOR_BASED(stream))
+        {
+            fd = g_file_descriptor_based_get_fd(G_FILE_DESCRIPTOR_BASED(stream));
+            offset = lseek(fd, 0, SEEK_CUR);
+        }
+
+    if (offset >= 0)
+        {
+            data = lseek(fd, offset, SEEK_DATA);
+
+            /* ENXIO: no more data after offset (EINVAL means that holes are not supported) */
+            if ((data < 0 && errno == ENXIO) || data >= offset + blocksize)
+                {
+                    end = lseek(fd, 0, SEEK_END);
+                    size_read = CLAMP(end - offset, 0, blocksize);
+                    memset(buffer, 0, size_read);
+                    lseek(fd, offset + size_read, SEEK_SET);
+                    hole = TRUE;
+                }
+            else
+                {
+                    lseek(fd, offset, SEEK_SET);
+                }
+        }
+#endif
+
+    if (size_read < 0)
+        {
+            size_read = g_input_stream_read((GInputStream *) stream, buffer, blocksize, NULL, error);
+        }
+
+    *zero = (size_read > 0 && (hole == TRUE || is_zero_block(buffer, size_read)));
+
+    return size_read;
+}
+
+
 /**
  * Calculates hashs for each block of blocksize bytes long on the file
  * and returns a list of all hashs in correct order stored in a binary
@@ -194,7 +266,9 @@ static GList *calculate_hash_data_list_for_file(GFile *a_file, gint64 blocksize,
     guchar *buffer = NULL;
     GChecksum *checksum = NULL;
     guint8 *a_hash = NULL;
+    guint8 *zero_hash = NULL;
     gsize digest_len = HASH_LEN;
+    gboolean zero = FALSE;
 
     if (a_file != NULL)
         {
@@ -207,16 +281,24 @@ static GList *calculate_hash_data_list_for_file(GFile *a_file, gint64 blocksize,
                     buffer = (guchar *) g_malloc(blocksize);
                     a_hash = (guint8 *) g_malloc(digest_len);
 
-                    size_read = g_input_stream_read((GInputStream *) stream, buffer, blocksize, NULL, &error);
+                    size_read = read_next_block(stream, buffer, blocksize, &zero, &error);
 
-                    while (size_read != 0 && error == NULL)
+                    while (size_read > 0 && error == NULL)
                         {
-                            g_checksum_update(checksum, buffer, size_read);
-                            g_checksum_get_digest(checksum, a_hash, &digest_len);
+                            /* Zero blocks (holes of sparse files for instance) of a usual block size have a precomputed hash */
+                            if (zero == TRUE && (zero_hash = get_zero_block_hash(size_read)) != NULL)
+                                {
+                                    memcpy(a_hash, zero_hash, HASH_LEN);
+                                }
+                            else
+                                {
+                                    g_checksum_update(checksum, buffer, size_read);
+                                    g_checksum_get_digest(checksum, a_hash, &digest_len);
+                                }
 
                             /* Need to save data and read in hash_data_t structure */
                             hash_data = new_hash_data_t(buffer, size_read, a_hash, cmptype);
-                            if (cmptype != COMPRESS_NONE_TYPE)
+                            if (hash_data->data != buffer)
                                 {
                                     free_variable(buffer); /* buffer has been compressed and is no longer needed in the program */
                                 }
@@ -228,7 +310,7 @@ static GList *calculate_hash_data_list_for_file(GFile *a_file, gint64 blocksize,
                             buffer = (guchar *) g_malloc(blocksize);
                             a_hash = (guint8 *) g_malloc(digest_len);
 
-                            size_read = g_input_stream_read((GInputStream *) stream, buffer, blocksize, NULL, &error);
+                            size_read = read_next_block(stream, buffer, blocksize, &zero, &error);
                         }
 
                     if (error != NULL)
@@ -491,6 +573,9 @@ static gint insert_array_in_root_and_send(main_struct_t *main_struct, json_t *ar
 
 /**
  * Sends data as requested by the server 'cdpfglserver' in a buffered way.
+ * Hashs enter the filter of stored hashs only once the server got their
+ * data (or answered that it already had them) so that a failed upload is
+ * asked for again.
  * @param main_struct : main structure of the program.
  * @param hash_data_list : list of hash_data_t * pointers containing
  *                          all the data to be saved.
@@ -505,6 +590,7 @@ static GList *send_all_data_to_server(main_struct_t *main_struct, GList *hash_da
     GList *hash_list = NULL;      /** hash_list is local to this function and contains the needed hashs as answered by server */
     GList *head = NULL;
     GList *iter = NULL;
+    GList *batch = NULL;          /** hashs of the data in array (added to the filter once the server got them) */
     hash_data_t *found = NULL;
     hash_data_t *hash_data = NULL;
     gint bytes = 0;
@@ -542,6 +628,7 @@ static GList *send_all_data_to_server(main_struct_t *main_struct, GList *hash_da
                             json_array_append_new(array, to_insert);
 
                             bytes = bytes + found->read;
+                            batch = g_list_prepend(batch, copy_only_hash(found, NULL));
 
                             hash_data_list = g_list_remove_link(hash_data_list, iter);
                             /* iter is now a single element list and we can delete
@@ -553,7 +640,12 @@ static GList *send_all_data_to_server(main_struct_t *main_struct, GList *hash_da
                                 {
                                     /* when we've got opt->buffersize bytes of data send them ! */
                                     elapsed = new_clock_t();
-                                    insert_array_in_root_and_send(main_struct, array);
+                                    if (insert_array_in_root_and_send(main_struct, array) == CURLE_OK)
+                                        {
+                                            bloom_add_hash_list(main_struct->bloom, batch);
+                                        }
+                                    g_list_free_full(batch, free_hdt_struct);
+                                    batch = NULL;
                                     array = json_array();
                                     bytes = 0;
                                     end_clock(elapsed, "insert_array_in_root_and_send");
@@ -566,7 +658,10 @@ static GList *send_all_data_to_server(main_struct_t *main_struct, GList *hash_da
                         {
                             /* Send the rest of the data (less than opt->buffersize bytes) */
                             elapsed = new_clock_t();
-                            insert_array_in_root_and_send(main_struct, array);
+                            if (insert_array_in_root_and_send(main_struct, array) == CURLE_OK)
+                                {
+                                    bloom_add_hash_list(main_struct->bloom, batch);
+                                }
                             end_clock(elapsed, "insert_array_in_root_and_send");
                         }
                     else
@@ -574,6 +669,11 @@ static GList *send_all_data_to_server(main_struct_t *main_struct, GList *hash_da
                             json_decref(array);
                         }
 
+                    g_list_free_full(batch, free_hdt_struct);
+
+                    /* What is left is already stored by the server: no need to ask it again until next refresh */
+                    bloom_add_hash_list(main_struct->bloom, hash_data_list);
+
                     if (head != NULL)
                         {
                             g_list_free_full(head, free_hdt_struct);
@@ -938,6 +1038,95 @@ static gchar *send_hash_array_to_server(comm_t *comm, GList *hash_data_list)
 }
 
 
+/**
+ * Refreshes the filter of hashs stored by the server if the last refresh
+ * is older than CLIENT_BLOOM_REFRESH_TIME seconds. Only the hashs stored
+ * since our version of the filter are downloaded when possible.
+ * @param main_struct : main structure of the program
+ */
+static void refresh_bloom_filter(main_struct_t *main_struct)
+{
+    gint64 now = 0;
+
+    g_assert_nonnull(main_struct);
+
+    now = g_get_monotonic_time();
+
+    if (main_struct->comm != NULL && (main_struct->bloom_refreshed == 0 || now - main_struct->bloom_refreshed > CLIENT_BLOOM_REFRESH_TIME * G_USEC_PER_SEC))
+        {
+            main_struct->bloom = get_bloom_from_server(main_struct->comm, main_struct->bloom);
+            main_struct->bloom_refreshed = now;
+        }
+}
+
+
+/**
+ * Asks the server which hashs of the list it needs. Hashs that are
+ * certainly not stored by the server (they are not in the filter) are
+ * not sent to the server and are directly considered as needed.
+ * @param main_struct : main structure of the program
+ * @param hash_data_list : list of hash_data already processed that are
+ *        ready to be transmited to server (if needed)
+ * @returns a gchar * containing the JSON array of needed hashs (the same
+ *          format as the one returned by send_hash_array_to_server()).
+ */
+static gchar *ask_server_for_needed_hashs(main_struct_t *main_struct, GList *hash_data_list)
+{
+    GList *absent = NULL;
+    GList *probable = NULL;
+    gchar *answer = NULL;
+    json_t *root = NULL;
+    json_t *array = NULL;
+    json_t *absent_array = NULL;
+
+    g_assert_nonnull(main_struct);
+
+    refresh_bloom_filter(main_struct);
+
+    absent = bloom_split_hash_list(main_struct->bloom, hash_data_list, &probable);
+    print_debug(_("Hashs certainly not on server: %d, hashs to check: %d\n"), g_list_length(absent), g_list_length(probable));
+
+    if (probable != NULL)
+        {
+            answer = send_hash_array_to_server(main_struct->comm, probable);
+        }
+
+    if (absent != NULL)
+        {
+            if (answer != NULL)
+                {
+                    root = load_json(answer);
+                    free_variable(answer);
+                }
+
+            if (root == NULL)
+                {
+                    root = json_object();
+                }
+
+            array = json_object_get(root, "hash_list");
+
+            if (array == NULL || !json_is_array(array))
+                {
+                    array = json_array();
+                    insert_json_value_into_json_root(root, "hash_list", array);
+                }
+
+            absent_array = convert_hash_list_to_json(absent);
+            json_array_extend(array, absent_array);
+            json_decref(absent_array);
+
+            answer = json_dumps(root, 0);
+            json_decref(root);
+        }
+
+    g_list_free_full(absent, free_hdt_struct);
+    g_list_free_full(probable, free_hdt_struct);
+
+    return answer;
+}
+
+
 static GList *lets_send_all_that_now(main_struct_t *main_struct, GList *hash_data_list, GList *saved_list, gsize read_bytes)
 {
     GList *hdl_copy = NULL;
@@ -950,12 +1139,14 @@ static GList *lets_send_all_that_now(main_struct_t *main_struct, GList *hash_dat
     hdl_copy = g_list_copy_deep(hash_data_list, copy_only_hash, NULL);
     saved_list = g_list_concat(hdl_copy, saved_list);
 
-    /* 1. Send an array of hashs to Hash_Array.json server url */
-    answer = send_hash_array_to_server(main_struct->comm, hash_data_list);
+    /* 1. Send an array of hashs that the server may have to Hash_Array.json server url */
+    answer = ask_server_for_needed_hashs(main_struct, hash_data_list);
 
     /* 2. Keep only hashs that are needed (answer from the server) */
     hash_data_list = send_all_data_to_server(main_struct, hash_data_list, answer);
 
+    free_variable(answer);
+
     /* 3. free memory of this list if any is left */
     g_list_free_full(hash_data_list, free_hdt_struct);
 
@@ -984,10 +1175,12 @@ static void process_big_file_not_in_cache(main_struct_t *main_struct, meta_data_
     guchar *buffer = NULL;
     GChecksum *checksum = NULL;
     guint8 *a_hash = NULL;
+    guint8 *zero_hash = NULL;
     gsize digest_len = HASH_LEN;
     gsize read_bytes = 0;
     a_clock_t *elapsed = NULL;
     gshort cmptype = COMPRESS_NONE_TYPE;
+    gboolean zero = FALSE;
 
     g_assert_nonnull(main_struct);
 
@@ -1009,18 +1202,26 @@ static void process_big_file_not_in_cache(main_struct_t *main_struct, meta_data_
                             buffer = (guchar *) g_malloc(meta->blocksize);
                             a_hash = (guint8 *) g_malloc(digest_len);
 
-                            size_read = g_input_stream_read((GInputStream *) stream, buffer, meta->blocksize, NULL, &error);
-                            read_bytes = read_bytes + size_read;
+                            size_read = read_next_block(stream, buffer, meta->blocksize, &zero, &error);
+                            read_bytes = read_bytes + MAX(size_read, 0);
 
-                            while (size_read != 0 && error == NULL)
+                            while (size_read > 0 && error == NULL)
                                 {
-                                    g_checksum_update(checksum, buffer, size_read);
-                                    g_checksum_get_digest(checksum, a_hash, &digest_len);
+                                    /* Zero blocks (holes of sparse files for instance) of a usual block size have a precomputed hash */
+                                    if (zero == TRUE && (zero_hash = get_zero_block_hash(size_read)) != NULL)
+                                        {
+                                            memcpy(a_hash, zero_hash, HASH_LEN);
+                                        }
+                                    else
+                                        {
+                                            g_checksum_update(checksum, buffer, size_read);
+                                            g_checksum_get_digest(checksum, a_hash, &digest_len);
+                                        }
 
                                     /* Need to save 'data', 'read' and digest hash in an hash_data_t structure */
                                     hash_data = new_hash_data_t(buffer, size_read, a_hash, cmptype);
                                     hash_data_list = g_list_prepend(hash_data_list, hash_data);
-                                    if (cmptype != COMPRESS_NONE_TYPE)
+                                    if (hash_data->data != buffer)
                                         {
                                             free_variable(buffer); /* buffer has been compressed and is no longer needed in the program */
                                         }
@@ -1038,8 +1239,8 @@ static void process_big_file_not_in_cache(main_struct_t *main_struct, meta_data_
 
                                     buffer = (guchar *) g_malloc(meta->blocksize);
                                     a_hash = (guint8 *) g_malloc(digest_len);
-                                    size_read = g_input_stream_read((GInputStream *) stream, buffer, meta->blocksize, NULL, &error);
-                                    read_bytes = read_bytes + size_read;
+                                    size_read = read_next_block(stream, buffer, meta->blocksize, &zero, &error);
+                                    read_bytes = read_bytes + MAX(size_read, 0);
                                 }
 
                             if (error != NULL)
@@ -1411,6 +1612,11 @@ int main(int argc, char **argv)
     /* Global curl initialisation to avoid curl_easy_init() calls to call it. */
     curl_global_init(CURL_GLOBAL_ALL);
 
+    if (CLOCK_T_OUTPUT_TO_FILE == 1)
+        {
+            init_clock_t(CLOCK_T_CLIENT_PATH);
+        }
+
     opt = do_what_is_needed_from_command_line_options(argc, argv);
     g_assert_nonnull(opt);
 
@@ -1425,5 +1631,7 @@ int main(int argc, char **argv)
 
     g_main_loop_run(main_struct->loop);
 
+    terminate_clock_t();
+
     return 0;
 }
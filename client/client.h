@@ -36,6 +36,7 @@
 #include <unistd.h>
 #include <glib.h>
 #include <gio/gio.h>
+#include <gio/gfiledescriptorbased.h>
 #include <glib/gi18n-lib.h>
 #include <glib-unix.h>
 #include <errno.h>
@@ -115,6 +116,15 @@
 #define CLIENT_RECONNECT_SLEEP_TIME (5*60)  /* Sleeps for 5 minutes */
 
 
+/**
+ * @def CLIENT_BLOOM_REFRESH_TIME
+ *
+ * defines the minimum time (in seconds) between two refreshes of the
+ * filter of hashs stored by the server.
+ */
+#define CLIENT_BLOOM_REFRESH_TIME (60)
+
+
 /**
  * @struct file_event_t
  * @brief stores all the necessary things to manage an event on a file.
@@ -159,6 +169,8 @@ typedef struct
     GSList *regex_exclude_list;     /**< List of regular expressions used to exclude directories or files.                                */
     GMainLoop* loop;                /**< Main loop in glib                                                                                */
     GThread *fanotify_loop;         /**< thread used for the infinite loop checking fanotify envents.                                     */
+    bloom_t *bloom;                 /**< Filter of hashs stored by the server (NULL until first downloaded or if server has none)         */
+    gint64 bloom_refreshed;         /**< Monotonic time (in microseconds) of the last refresh of the filter                               */
 } main_struct_t;
 
 
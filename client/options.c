@@ -99,6 +99,8 @@ static void print_selected_options(options_t *opt)
                     fprintf(stdout, _("Server's port number: %d\n"), opt->srv_conf->port);
                 }
             fprintf(stdout, _("Buffersize: %d\n"), opt->buffersize);
+            fprintf(stdout, _("Compression type: %d\n"), opt->cmptype);
+            fprintf(stdout, _("Compression level: %d\n"), opt->cmplevel);
         }
 }
 
@@ -146,6 +148,9 @@ static void read_from_group_client(options_t *opt, GKeyFile *keyfile, gchar *fil
             /* Compression type if any */
             cmptype = read_int_from_file(keyfile, filename, GN_CLIENT, KN_COMPRESSION_TYPE, _("Compression type not defined in configuration file"), opt->cmptype);
             set_compression_type(opt, cmptype);
+
+            /* Compression level if any */
+            opt->cmplevel = read_int_from_file(keyfile, filename, GN_CLIENT, KN_COMPRESSION_LEVEL, _("Compression level not defined in configuration file"), opt->cmplevel);
         }
 
 }
@@ -200,7 +205,8 @@ static void set_compression_type(options_t *opt, gshort cmptype)
 {
     gchar *compress_type_string = NULL;
 
-    if (is_compress_type_allowed(cmptype))
+    /* Dictionary types are chosen from the server's dictionaries, not by the user */
+    if (is_compress_type_allowed(cmptype) && IS_COMPRESS_DICT_TYPE(cmptype) == FALSE)
         {
             opt->cmptype = cmptype;
         }
@@ -246,7 +252,8 @@ options_t *manage_command_line_options(int argc, char **argv)
     gchar *dbname = NULL;          /** Database filename where data and meta data are cached  */
     gchar *ip =  NULL;             /** IP address where is located server's program           */
     gint port = 0;                 /** Port number on which to send things to the server      */
-    gshort cmptype = -1;           /** compression type to be used when communicating         */
+    gint cmptype = -1;             /** compression type to be used when communicating         */
+    gint cmplevel = -1;            /** compression level to be used when compressing          */
     gboolean noscan = FALSE;       /** If set to TRUE then do not do the first directory scan */
     srv_conf_t *srv_conf = NULL;
 
@@ -264,7 +271,8 @@ options_t *manage_command_line_options(int argc, char **argv)
         { "port", 'p', 0, G_OPTION_ARG_INT, &port, N_("Port NUMBER on which to listen."), N_("NUMBER")},
         { "exclude", 'x', 0, G_OPTION_ARG_FILENAME_ARRAY, &exclude_array, N_("Exclude FILENAME from being saved."), N_("FILENAME")},
         { "no-scan", 'n', 0, G_OPTION_ARG_NONE, &noscan, N_("Does not do the first directory scan."), NULL},
-        { "compression", 'z', 0, G_OPTION_ARG_INT, &cmptype, N_("Compression type to use: 0 is NONE, 1 is ZLIB"), N_("NUMBER")},
+        { "compression", 'z', 0, G_OPTION_ARG_INT, &cmptype, N_("Compression type to use: 0 is NONE, 1 is ZLIB, 2 is ZSTD, 3 is LZ4"), N_("NUMBER")},
+        { "compression-level", 'l', 0, G_OPTION_ARG_INT, &cmplevel, N_("Compression LEVEL to use (0 is the default level of the compression type)."), N_("LEVEL")},
         { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &dirname_array, "", NULL},
         { NULL }
     };
@@ -287,6 +295,7 @@ options_t *manage_command_line_options(int argc, char **argv)
     opt->buffersize = -1;
     opt->adaptive = FALSE;
     opt->cmptype = 0;
+    opt->cmplevel = COMPRESS_DEFAULT_LEVEL;
     opt->srv_conf = NULL;
 
     srv_conf = new_srv_conf_t();
@@ -333,6 +342,13 @@ options_t *manage_command_line_options(int argc, char **argv)
             set_compression_type(opt, cmptype);
         }
 
+    if (cmplevel >= 0)
+        {
+            opt->cmplevel = cmplevel;
+        }
+
+    set_compression_level(opt->cmplevel);
+
     g_strfreev(dirname_array);
     g_strfreev(exclude_array);
 
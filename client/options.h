@@ -49,6 +49,7 @@ typedef struct
     gboolean adaptive;    /**< adaptive will make client compute hashs with an adaptive blocksize if TRUE             */
     gboolean noscan;      /**< noscan will avoid the first directory scan when set to TRUE. default = FALSE           */
     gshort cmptype;       /**< compression type to be used when communicating. See compress.h for available types     */
+    gint cmplevel;        /**< compression level (COMPRESS_DEFAULT_LEVEL is the default level of the compression type) */
 } options_t;
 
 
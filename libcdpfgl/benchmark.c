@@ -0,0 +1,521 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    benchmark.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file benchmark.c
+ * This file contains 'cdpfglbenchmark', a program that measures the
+ * time spent in the hot functions of the library (in ns per operation
+ * and MB per second) for block sizes from 512 bytes to 256 KB. Blocks
+ * are generated from a fixed seed so that two runs measure exactly the
+ * same thing. Figures are only comparable when the CPU frequency is
+ * fixed (for instance with 'cpupower frequency-set -g performance').
+ */
+
+#include "libcdpfgl.h"
+
+/**
+ * @def BENCHMARK_SEED
+ * Seed used to generate blocks.
+ */
+#define BENCHMARK_SEED (5468)
+
+/**
+ * @def BENCHMARK_MIN_BLOCKSIZE
+ * Smallest block size measured.
+ *
+ * @def BENCHMARK_MAX_BLOCKSIZE
+ * Biggest block size measured.
+ */
+#define BENCHMARK_MIN_BLOCKSIZE (512)
+#define BENCHMARK_MAX_BLOCKSIZE (262144)
+
+/**
+ * @def BENCHMARK_HASH_LIST_LEN
+ * Number of hashs in the list converted by convert_hash_list_to_json.
+ */
+#define BENCHMARK_HASH_LIST_LEN (1024)
+
+/**
+ * @def BENCHMARK_MIN_TIME
+ * Default minimum time (in milliseconds) of a measure.
+ */
+#define BENCHMARK_MIN_TIME (200)
+
+/**
+ * @def BENCHMARK_GOVERNOR
+ * File that tells the CPU frequency policy in use.
+ */
+#define BENCHMARK_GOVERNOR ("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor")
+
+
+/**
+ * @struct bench_t
+ * @brief Data used by the measured functions for one block size.
+ */
+typedef struct
+{
+    guchar *block;            /**< block of data (NUL terminated)                          */
+    gssize size;              /**< size of the block                                       */
+    guint8 *hash;             /**< SHA256 hash of the block                                */
+    gchar *hash_string;       /**< hexadecimal representation of the hash                  */
+    gshort cmptype;           /**< compression type used with new_hash_data_t              */
+    hash_data_t *hash_data;   /**< uncompressed hash_data_t of the block                   */
+    json_t *root;             /**< json representation of hash_data                        */
+    GList *hash_list;         /**< a list of BENCHMARK_HASH_LIST_LEN hash_data_t (no data) */
+} bench_t;
+
+
+/**
+ * @typedef bench_func_t
+ * A function that does one operation to be measured.
+ */
+typedef void (* bench_func_t)(bench_t *bench);
+
+
+static guchar *generate_block(GRand *rand, gssize size, gboolean random);
+static GList *generate_hash_list(guint8 *hash);
+static bench_t *new_bench_t(GRand *rand, gssize size, gboolean random);
+static void free_bench_t(bench_t *bench);
+static void bench_new_hash_data_t(bench_t *bench);
+static void bench_convert_hash_data_t_to_json(bench_t *bench);
+static void bench_convert_json_t_to_hash_data(bench_t *bench);
+static void bench_encode_to_base64(bench_t *bench);
+static void bench_hash_to_string(bench_t *bench);
+static void bench_string_to_hash(bench_t *bench);
+static void bench_make_path_from_hash(bench_t *bench);
+static void bench_convert_hash_list_to_json(bench_t *bench);
+static void run_bench(gchar *name, bench_func_t func, bench_t *bench, gsize bytes, gint64 min_time, gchar *kernel);
+static void run_block_benchs(bench_t *bench, gint64 min_time, gchar *kernel);
+static void run_hash_benchs(bench_t *bench, gint64 min_time, gchar *kernel);
+static void print_cpu_frequency_policy(void);
+
+
+/**
+ * Generates a block of data. Text like blocks are made of words picked
+ * in a small vocabulary (they compress roughly like source code does)
+ * while random ones are not compressible. The block never contains
+ * '\0' but is terminated by one (it is used as a string by
+ * encode_to_base64).
+ * @param rand is the pseudo random number generator to use.
+ * @param size is the size of the block to generate.
+ * @param random tells whether the block is random (TRUE) or text like.
+ * @returns a newly allocated block of size + 1 bytes.
+ */
+static guchar *generate_block(GRand *rand, gssize size, gboolean random)
+{
+    const gchar *words[] = {"sauvegarde", "backup", "the", "file", "block", "hash", "server", "client",
+                            "data", "of", "to", "is", "a", "{", "}", "0x2A", "1970", "return", "\n"};
+    const gchar *word = NULL;
+    guchar *block = NULL;
+    gssize i = 0;
+    gssize len = 0;
+
+    block = (guchar *) g_malloc(size + 1);
+    g_assert_nonnull(block);
+
+    while (i < size)
+        {
+            if (random == TRUE)
+                {
+                    block[i] = (guchar) g_rand_int_range(rand, 1, 256);
+                    i = i + 1;
+                }
+            else
+                {
+                    word = words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))];
+                    len = MIN((gssize) strlen(word), size - i);
+                    memcpy(block + i, word, len);
+                    i = i + len;
+
+                    if (i < size)
+                        {
+                            block[i] = ' ';
+                            i = i + 1;
+                        }
+                }
+        }
+
+    block[size] = '\0';
+
+    return block;
+}
+
+
+/**
+ * Generates a list of BENCHMARK_HASH_LIST_LEN distinct hashs derived
+ * from hash.
+ * @param hash is the hash to derive the others from.
+ * @returns a GList of hash_data_t without any data.
+ */
+static GList *generate_hash_list(guint8 *hash)
+{
+    GList *hash_list = NULL;
+    guint8 *a_hash = NULL;
+    guint32 i = 0;
+
+    for (i = 0; i < BENCHMARK_HASH_LIST_LEN; i++)
+        {
+            a_hash = (guint8 *) g_memdup(hash, HASH_LEN);
+            memcpy(a_hash, &i, sizeof(i));
+            hash_list = g_list_prepend(hash_list, new_hash_data_t_as_is(NULL, 0, a_hash, COMPRESS_NONE_TYPE, 0));
+        }
+
+    return g_list_reverse(hash_list);
+}
+
+
+/**
+ * Creates a new bench_t structure for a block of size bytes.
+ * @param rand is the pseudo random number generator to use.
+ * @param size is the size of the block.
+ * @param random tells whether the block is random (TRUE) or text like.
+ * @returns a newly allocated bench_t structure filled with everything
+ *          needed by the measured functions.
+ */
+static bench_t *new_bench_t(GRand *rand, gssize size, gboolean random)
+{
+    bench_t *bench = NULL;
+    GChecksum *checksum = NULL;
+    gsize digest_len = HASH_LEN;
+
+    bench = (bench_t *) g_malloc0(sizeof(bench_t));
+    g_assert_nonnull(bench);
+
+    bench->size = size;
+    bench->block = generate_block(rand, size, random);
+
+    checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(checksum, bench->block, size);
+    bench->hash = (guint8 *) g_malloc0(HASH_LEN);
+    g_checksum_get_digest(checksum, bench->hash, &digest_len);
+    g_checksum_free(checksum);
+
+    bench->hash_string = hash_to_string(bench->hash);
+    bench->cmptype = COMPRESS_NONE_TYPE;
+    bench->hash_data = new_hash_data_t_as_is(bench->block, size, bench->hash, COMPRESS_NONE_TYPE, size);
+    bench->root = convert_hash_data_t_to_json(bench->hash_data);
+    bench->hash_list = generate_hash_list(bench->hash);
+
+    return bench;
+}
+
+
+/**
+ * Frees a bench_t structure.
+ * @param bench is the structure to be freed.
+ */
+static void free_bench_t(bench_t *bench)
+{
+    if (bench != NULL)
+        {
+            g_list_free_full(bench->hash_list, free_hdt_struct);
+            json_decref(bench->root);
+            free_variable(bench->hash_data); /* block and hash are freed below */
+            free_variable(bench->hash_string);
+            free_variable(bench->hash);
+            free_variable(bench->block);
+            free_variable(bench);
+        }
+}
+
+
+/**
+ * Creates (and compresses if bench->cmptype says so) a hash_data_t
+ * structure from the block.
+ * @param bench is the bench_t structure of the block.
+ */
+static void bench_new_hash_data_t(bench_t *bench)
+{
+    hash_data_t *hash_data = NULL;
+
+    hash_data = new_hash_data_t(bench->block, bench->size, bench->hash, bench->cmptype);
+
+    if (hash_data->data != bench->block)
+        {
+            free_variable(hash_data->data);
+        }
+
+    free_variable(hash_data);
+}
+
+
+/**
+ * Converts the hash_data_t structure of the block into json.
+ * @param bench is the bench_t structure of the block.
+ */
+static void bench_convert_hash_data_t_to_json(bench_t *bench)
+{
+    json_decref(convert_hash_data_t_to_json(bench->hash_data));
+}
+
+
+/**
+ * Converts the json representation of the block into a hash_data_t.
+ * @param bench is the bench_t structure of the block.
+ */
+static void bench_convert_json_t_to_hash_data(bench_t *bench)
+{
+    free_hash_data_t(convert_json_t_to_hash_data(bench->root));
+}
+
+
+/**
+ * Encodes the block in base64.
+ * @param bench is the bench_t structure of the block.
+ */
+static void bench_encode_to_base64(bench_t *bench)
+{
+    free_variable(encode_to_base64((gchar *) bench->block));
+}
+
+
+/**
+ * Converts the hash of the block to its hexadecimal representation.
+ * @param bench is the bench_t structure of the block.
+ */
+static void bench_hash_to_string(bench_t *bench)
+{
+    free_variable(hash_to_string(bench->hash));
+}
+
+
+/**
+ * Converts the hexadecimal representation of the hash of the block back
+ * to binary.
+ * @param bench is the bench_t structure of the block.
+ */
+static void bench_string_to_hash(bench_t *bench)
+{
+    free_variable(string_to_hash(bench->hash_string));
+}
+
+
+/**
+ * Makes the path where the file backend stores the block.
+ * @param bench is the bench_t structure of the block.
+ */
+static void bench_make_path_from_hash(bench_t *bench)
+{
+    free_variable(make_path_from_hash("/var/tmp/cdpfgl/data", bench->hash, 2));
+}
+
+
+/**
+ * Converts a list of BENCHMARK_HASH_LIST_LEN hashs into a json array.
+ * @param bench is the bench_t structure of the block.
+ */
+static void bench_convert_hash_list_to_json(bench_t *bench)
+{
+    json_decref(convert_hash_list_to_json(bench->hash_list));
+}
+
+
+/**
+ * Measures func: the number of iterations is doubled until one measure
+ * lasts at least min_time. Prints the name, the bytes processed by one
+ * operation, the number of iterations, the time of one operation in ns
+ * and the throughput in MB/s.
+ * @param name is the name of the measure.
+ * @param func is the function to be measured.
+ * @param bench is the bench_t structure passed to func.
+ * @param bytes is the number of bytes processed by one call to func.
+ * @param min_time is the minimum time (in µs) of a measure.
+ * @param kernel when not NULL only measures whose name contains kernel
+ *        are done.
+ */
+static void run_bench(gchar *name, bench_func_t func, bench_t *bench, gsize bytes, gint64 min_time, gchar *kernel)
+{
+    guint64 iterations = 1;
+    guint64 i = 0;
+    gint64 begin = 0;
+    gint64 elapsed = 0;
+    gdouble ns_per_op = 0.0;
+
+    if (kernel == NULL || g_strstr_len(name, -1, kernel) != NULL)
+        {
+            func(bench); /* warms up caches and lazily allocated contexts */
+
+            do
+                {
+                    begin = g_get_monotonic_time();
+
+                    for (i = 0; i < iterations; i++)
+                        {
+                            func(bench);
+                        }
+
+                    elapsed = g_get_monotonic_time() - begin;
+
+                    if (elapsed < min_time)
+                        {
+                            iterations = iterations * 2;
+                        }
+                }
+            while (elapsed < min_time);
+
+            ns_per_op = (elapsed * 1000.0) / iterations;
+
+            fprintf(stdout, "%-36s %8" G_GSIZE_FORMAT " %12" G_GUINT64_FORMAT " %14.1f %12.2f\n", name, bytes, iterations, ns_per_op, (bytes * 1000000000.0) / (ns_per_op * 1048576.0));
+        }
+}
+
+
+/**
+ * Runs the measures that depend on the block size.
+ * @param bench is the bench_t structure of the block.
+ * @param min_time is the minimum time (in µs) of a measure.
+ * @param kernel when not NULL only measures whose name contains kernel
+ *        are done.
+ */
+static void run_block_benchs(bench_t *bench, gint64 min_time, gchar *kernel)
+{
+    gshort cmptypes[] = {COMPRESS_NONE_TYPE, COMPRESS_ZLIB_TYPE, COMPRESS_ZSTD_TYPE, COMPRESS_LZ4_TYPE};
+    gchar *names[] = {"none", "zlib", "zstd", "lz4"};
+    gchar *name = NULL;
+    guint i = 0;
+
+    for (i = 0; i < G_N_ELEMENTS(cmptypes); i++)
+        {
+            bench->cmptype = cmptypes[i];
+            name = g_strdup_printf("new_hash_data_t/%s", names[i]);
+            run_bench(name, bench_new_hash_data_t, bench, bench->size, min_time, kernel);
+            free_variable(name);
+        }
+
+    run_bench("convert_hash_data_t_to_json", bench_convert_hash_data_t_to_json, bench, bench->size, min_time, kernel);
+    run_bench("convert_json_t_to_hash_data", bench_convert_json_t_to_hash_data, bench, bench->size, min_time, kernel);
+    run_bench("encode_to_base64", bench_encode_to_base64, bench, bench->size, min_time, kernel);
+}
+
+
+/**
+ * Runs the measures that do not depend on the block size.
+ * @param bench is a bench_t structure.
+ * @param min_time is the minimum time (in µs) of a measure.
+ * @param kernel when not NULL only measures whose name contains kernel
+ *        are done.
+ */
+static void run_hash_benchs(bench_t *bench, gint64 min_time, gchar *kernel)
+{
+    run_bench("hash_to_string", bench_hash_to_string, bench, HASH_LEN, min_time, kernel);
+    run_bench("string_to_hash", bench_string_to_hash, bench, HASH_LEN * 2, min_time, kernel);
+    run_bench("make_path_from_hash", bench_make_path_from_hash, bench, HASH_LEN, min_time, kernel);
+    run_bench("convert_hash_list_to_json", bench_convert_hash_list_to_json, bench, HASH_LEN * BENCHMARK_HASH_LIST_LEN, min_time, kernel);
+}
+
+
+/**
+ * Prints the CPU frequency policy in use and warns if the frequency
+ * may change during the measures.
+ */
+static void print_cpu_frequency_policy(void)
+{
+    gchar *governor = NULL;
+
+    if (g_file_get_contents(BENCHMARK_GOVERNOR, &governor, NULL, NULL) == TRUE)
+        {
+            g_strstrip(governor);
+            fprintf(stdout, _("# CPU frequency governor: %s\n"), governor);
+
+            if (g_strcmp0(governor, "performance") != 0)
+                {
+                    fprintf(stderr, _("Warning: CPU frequency may change during measures. You may fix it first with 'cpupower frequency-set -g performance'.\n"));
+                }
+
+            free_variable(governor);
+        }
+    else
+        {
+            fprintf(stdout, _("# CPU frequency governor: unknown\n"));
+        }
+}
+
+
+/**
+ * Main function
+ * @param argc : number of arguments given on the command line.
+ * @param argv : an array of strings that contains command line arguments.
+ * @returns always 0
+ */
+int main(int argc, char **argv)
+{
+    GRand *rand = NULL;
+    bench_t *bench = NULL;
+    gint min_time = BENCHMARK_MIN_TIME;
+    gint64 blocksize = 0;
+    gboolean random = FALSE;
+    gchar *kernel = NULL;
+    gssize size = 0;
+    gchar *summary = NULL;
+
+    GOptionEntry entries[] =
+    {
+        { "blocksize", 'b', 0, G_OPTION_ARG_INT64, &blocksize, N_("Only measures blocks of SIZE bytes."), N_("SIZE")},
+        { "kernel", 'k', 0, G_OPTION_ARG_STRING, &kernel, N_("Only measures functions whose name contains NAME."), N_("NAME")},
+        { "min-time", 't', 0, G_OPTION_ARG_INT, &min_time, N_("Minimum duration of a measure in MILLISECONDS."), N_("MILLISECONDS")},
+        { "random", 'r', 0, G_OPTION_ARG_NONE, &random, N_("Uses random (incompressible) blocks instead of text like ones."), NULL},
+        { NULL }
+    };
+
+    #if !GLIB_CHECK_VERSION(2, 36, 0)
+        g_type_init();  /** g_type_init() is deprecated since glib 2.36 */
+    #endif
+
+    init_international_languages();
+
+    summary = g_strdup(_("This program measures the time spent in the hot functions of libcdpfgl."));
+    parse_command_line(argc, argv, entries, summary);
+    free_variable(summary);
+
+    print_cpu_frequency_policy();
+    fprintf(stdout, "# %-34s %8s %12s %14s %12s\n", "function", "bytes", "iterations", "ns/op", "MB/s");
+
+    rand = g_rand_new_with_seed(BENCHMARK_SEED);
+
+    if (blocksize > 0)
+        {
+            bench = new_bench_t(rand, blocksize, random);
+            run_hash_benchs(bench, min_time * 1000, kernel);
+            run_block_benchs(bench, min_time * 1000, kernel);
+            free_bench_t(bench);
+        }
+    else
+        {
+            for (size = BENCHMARK_MIN_BLOCKSIZE; size <= BENCHMARK_MAX_BLOCKSIZE; size = size * 2)
+                {
+                    bench = new_bench_t(rand, size, random);
+
+                    if (size == BENCHMARK_MIN_BLOCKSIZE)
+                        {
+                            run_hash_benchs(bench, min_time * 1000, kernel);
+                        }
+
+                    run_block_benchs(bench, min_time * 1000, kernel);
+                    free_bench_t(bench);
+                }
+        }
+
+    g_rand_free(rand);
+    free_variable(kernel);
+
+    return 0;
+}
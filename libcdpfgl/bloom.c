@@ -0,0 +1,442 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    bloom.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file bloom.c
+ * This file contains the functions to manage a Bloom filter of hashs.
+ * A Bloom filter never says that a hash is absent when it has been
+ * added: a client may thus safely consider that a hash that is not in
+ * the filter of the server is needed by the server.
+ */
+
+#include "libcdpfgl.h"
+
+static guint64 get_guint64_from_hash(guint8 *hash, guint offset);
+static guint64 get_bit_position(bloom_t *bloom, guint64 h1, guint64 h2, guint i);
+static bloom_t *make_bloom_from_json(json_t *root, guint32 id, guint64 version);
+static void add_delta_to_bloom(bloom_t *bloom, json_t *delta);
+
+
+/**
+ * Creates a new empty bloom_t filter
+ * @param nbits is the number of bits of the filter (rounded up to a
+ *        multiple of 8).
+ * @param nhashs is the number of bits set for each hash.
+ * @param id is the identifier of this filter.
+ * @returns a newly allocated bloom_t * structure that may be freed with
+ *          free_bloom_t() when no longer needed or NULL if nbits or
+ *          nhashs are 0.
+ */
+bloom_t *new_bloom_t(guint64 nbits, guint nhashs, guint32 id)
+{
+    bloom_t *bloom = NULL;
+
+    if (nbits > 0 && nhashs > 0)
+        {
+            bloom = (bloom_t *) g_malloc0(sizeof(bloom_t));
+
+            bloom->nbits = ((nbits + 7) / 8) * 8;
+            bloom->bits = (guint8 *) g_malloc0(bloom->nbits / 8);
+            bloom->nhashs = nhashs;
+            bloom->id = id;
+            bloom->version = 0;
+        }
+
+    return bloom;
+}
+
+
+/**
+ * Frees a bloom_t * structure
+ * @param bloom is the filter to be freed.
+ */
+void free_bloom_t(bloom_t *bloom)
+{
+    if (bloom != NULL)
+        {
+            free_variable(bloom->bits);
+            free_variable(bloom);
+        }
+}
+
+
+/**
+ * Reads 8 bytes of a hash as a little endian 64 bits number. This
+ * way the bit positions are the same on every architecture.
+ * @param hash is the binary hash (HASH_LEN bytes long).
+ * @param offset is the offset of the first byte to read.
+ * @returns a guint64 made of 8 bytes of the hash.
+ */
+static guint64 get_guint64_from_hash(guint8 *hash, guint offset)
+{
+    guint64 number = 0;
+    gint i = 0;
+
+    for (i = 7; i >= 0; i--)
+        {
+            number = (number << 8) | hash[offset + i];
+        }
+
+    return number;
+}
+
+
+/**
+ * Calculates the position of the ith bit for a hash (double hashing).
+ * @param bloom is the filter.
+ * @param h1 is the first 64 bits word of the hash.
+ * @param h2 is the second 64 bits word of the hash (must be odd).
+ * @param i is the number of the bit (from 0 to nhashs - 1).
+ * @returns the position of the bit in the filter.
+ */
+static guint64 get_bit_position(bloom_t *bloom, guint64 h1, guint64 h2, guint i)
+{
+    return (h1 + i * h2) % bloom->nbits;
+}
+
+
+/**
+ * Adds a hash into the filter. The version of the filter is not
+ * modified here: it is up to the owner of the filter to manage it.
+ * @param bloom is the filter where to add the hash
+ * @param hash is the binary hash (HASH_LEN bytes long) to add.
+ * @returns TRUE if at least one bit was changed (ie the hash was not
+ *          already probably in the filter) and FALSE otherwise.
+ */
+gboolean bloom_add_hash(bloom_t *bloom, guint8 *hash)
+{
+    guint64 h1 = 0;
+    guint64 h2 = 0;
+    guint64 pos = 0;
+    guint i = 0;
+    gboolean changed = FALSE;
+
+    if (bloom != NULL && hash != NULL)
+        {
+            h1 = get_guint64_from_hash(hash, 0);
+            h2 = get_guint64_from_hash(hash, 8) | 1;
+
+            for (i = 0; i < bloom->nhashs; i++)
+                {
+                    pos = get_bit_position(bloom, h1, h2, i);
+
+                    if ((bloom->bits[pos >> 3] & (1 << (pos & 7))) == 0)
+                        {
+                            bloom->bits[pos >> 3] |= (1 << (pos & 7));
+                            changed = TRUE;
+                        }
+                }
+        }
+
+    return changed;
+}
+
+
+/**
+ * Adds every hash of a list into the filter.
+ * @param bloom is the filter where to add the hashs
+ * @param hash_data_list is a GList of hash_data_t * structures.
+ */
+void bloom_add_hash_list(bloom_t *bloom, GList *hash_data_list)
+{
+    hash_data_t *hash_data = NULL;
+
+    if (bloom != NULL)
+        {
+            while (hash_data_list != NULL)
+                {
+                    hash_data = hash_data_list->data;
+                    bloom_add_hash(bloom, hash_data->hash);
+                    hash_data_list = g_list_next(hash_data_list);
+                }
+        }
+}
+
+
+/**
+ * Tells whether a hash may be in the filter or not.
+ * @param bloom is the filter to look into.
+ * @param hash is the binary hash (HASH_LEN bytes long) to look for.
+ * @returns FALSE if the hash is certainly not in the filter and TRUE if
+ *          it probably is (or if bloom is NULL).
+ */
+gboolean bloom_may_contain_hash(bloom_t *bloom, guint8 *hash)
+{
+    guint64 h1 = 0;
+    guint64 h2 = 0;
+    guint64 pos = 0;
+    guint i = 0;
+
+    if (bloom != NULL && hash != NULL)
+        {
+            h1 = get_guint64_from_hash(hash, 0);
+            h2 = get_guint64_from_hash(hash, 8) | 1;
+
+            for (i = 0; i < bloom->nhashs; i++)
+                {
+                    pos = get_bit_position(bloom, h1, h2, i);
+
+                    if ((bloom->bits[pos >> 3] & (1 << (pos & 7))) == 0)
+                        {
+                            return FALSE;
+                        }
+                }
+        }
+
+    return TRUE;
+}
+
+
+/**
+ * Splits a hash list in two lists: hashs that are certainly not in the
+ * filter and hashs that may be in it.
+ * @param bloom is the filter to test hashs against.
+ * @param hash_data_list is a GList of hash_data_t * structures.
+ * @param[out] probable is a GList of copies (hashs only) of hash_data_t
+ *             structures that may be in the filter.
+ * @returns a GList of copies (hashs only) of hash_data_t structures that
+ *          are certainly not in the filter.
+ */
+GList *bloom_split_hash_list(bloom_t *bloom, GList *hash_data_list, GList **probable)
+{
+    GList *absent = NULL;
+    GList *maybe = NULL;
+    hash_data_t *hash_data = NULL;
+
+    while (hash_data_list != NULL)
+        {
+            hash_data = hash_data_list->data;
+
+            if (bloom_may_contain_hash(bloom, hash_data->hash) == TRUE)
+                {
+                    maybe = g_list_prepend(maybe, copy_only_hash(hash_data, NULL));
+                }
+            else
+                {
+                    absent = g_list_prepend(absent, copy_only_hash(hash_data, NULL));
+                }
+
+            hash_data_list = g_list_next(hash_data_list);
+        }
+
+    if (probable != NULL)
+        {
+            *probable = g_list_reverse(maybe);
+        }
+    else
+        {
+            g_list_free_full(maybe, free_hdt_struct);
+        }
+
+    return g_list_reverse(absent);
+}
+
+
+/**
+ * Converts a whole filter into a json_t * structure.
+ * @param bloom is the filter to be converted.
+ * @returns a json_t * object with "id", "version", "nbits", "nhashs" and
+ *          "filter" (base64 encoded bits) keys.
+ */
+json_t *convert_bloom_t_to_json(bloom_t *bloom)
+{
+    json_t *root = NULL;
+    gchar *encoded = NULL;
+
+    if (bloom != NULL)
+        {
+            root = json_object();
+            encoded = g_base64_encode(bloom->bits, bloom->nbits / 8);
+
+            insert_integer_value_into_json_root(root, "id", bloom->id);
+            insert_integer_value_into_json_root(root, "version", bloom->version);
+            insert_integer_value_into_json_root(root, "nbits", bloom->nbits);
+            insert_integer_value_into_json_root(root, "nhashs", bloom->nhashs);
+            insert_string_into_json_root(root, "filter", encoded);
+
+            free_variable(encoded);
+        }
+
+    return root;
+}
+
+
+/**
+ * Makes a new filter from a json answer that contains a whole filter.
+ * @param root is the json answer with "nbits", "nhashs" and "filter" keys.
+ * @param id is the identifier of the filter.
+ * @param version is the version of the filter.
+ * @returns a newly allocated bloom_t * filter or NULL if the answer is
+ *          not consistent.
+ */
+static bloom_t *make_bloom_from_json(json_t *root, guint32 id, guint64 version)
+{
+    bloom_t *bloom = NULL;
+    guint8 *bits = NULL;
+    gsize len = 0;
+    guint64 nbits = 0;
+    guint nhashs = 0;
+
+    nbits = (guint64) json_integer_value(json_object_get(root, "nbits"));
+    nhashs = (guint) json_integer_value(json_object_get(root, "nhashs"));
+    bits = g_base64_decode(json_string_value(json_object_get(root, "filter")), &len);
+
+    if (nbits > 0 && nhashs > 0 && len * 8 == nbits)
+        {
+            bloom = (bloom_t *) g_malloc0(sizeof(bloom_t));
+            bloom->bits = bits;
+            bloom->nbits = nbits;
+            bloom->nhashs = nhashs;
+            bloom->id = id;
+            bloom->version = version;
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Inconsistent hash filter received (%zd bytes for %" G_GUINT64_FORMAT " bits)\n"), len, nbits);
+            free_variable(bits);
+        }
+
+    return bloom;
+}
+
+
+/**
+ * Adds every hash of a delta json array into the filter
+ * @param bloom is the filter to be updated.
+ * @param delta is a json array of base64 encoded hashs.
+ */
+static void add_delta_to_bloom(bloom_t *bloom, json_t *delta)
+{
+    size_t index = 0;
+    json_t *value = NULL;
+    guint8 *a_hash = NULL;
+    gsize hash_len = 0;
+
+    json_array_foreach(delta, index, value)
+        {
+            a_hash = g_base64_decode(json_string_value(value), &hash_len);
+
+            if (hash_len == HASH_LEN)
+                {
+                    bloom_add_hash(bloom, a_hash);
+                }
+
+            free_variable(a_hash);
+        }
+}
+
+
+/**
+ * Updates a filter with the json answer of the server. The answer may
+ * be a whole filter, a delta (a list of hashs added since our version)
+ * or nothing new.
+ * @param bloom is the filter to be updated (may be NULL).
+ * @param json_str is the json string answered by the server.
+ * @returns the updated filter. It may be a newly allocated one in which
+ *          case the old one has been freed. If the answer can not be
+ *          understood bloom is returned untouched.
+ */
+bloom_t *update_bloom_from_json_string(bloom_t *bloom, gchar *json_str)
+{
+    json_t *root = NULL;
+    json_t *delta = NULL;
+    bloom_t *new_bloom = NULL;
+    guint32 id = 0;
+    guint64 version = 0;
+
+    root = load_json(json_str);
+
+    /* An error answer (no filter on the server side) does not have any id */
+    if (root != NULL && json_is_integer(json_object_get(root, "id")) && json_is_integer(json_object_get(root, "version")))
+        {
+            id = (guint32) json_integer_value(json_object_get(root, "id"));
+            version = (guint64) json_integer_value(json_object_get(root, "version"));
+            delta = json_object_get(root, "delta");
+
+            if (json_is_string(json_object_get(root, "filter")))
+                {
+                    new_bloom = make_bloom_from_json(root, id, version);
+
+                    if (new_bloom != NULL)
+                        {
+                            free_bloom_t(bloom);
+                            bloom = new_bloom;
+                        }
+                }
+            else if (bloom != NULL && bloom->id == id)
+                {
+                    if (json_is_array(delta))
+                        {
+                            add_delta_to_bloom(bloom, delta);
+                        }
+
+                    bloom->version = version;
+                }
+        }
+
+    if (root != NULL)
+        {
+            json_decref(root);
+        }
+
+    return bloom;
+}
+
+
+/**
+ * Gets the filter of stored hashs from server. Only the hashs stored
+ * since our version are transmitted when possible.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL)
+ * @param bloom is the filter we already have (may be NULL).
+ * @returns the updated filter (see update_bloom_from_json_string()) or
+ *          bloom untouched if the server could not answer.
+ */
+bloom_t *get_bloom_from_server(comm_t *comm, bloom_t *bloom)
+{
+    gchar *url = NULL;
+    gint success = CURLE_FAILED_INIT;
+
+    if (comm != NULL)
+        {
+            if (bloom != NULL)
+                {
+                    url = g_strdup_printf("%s?id=%u&version=%" G_GUINT64_FORMAT, BLOOM_URL, bloom->id, bloom->version);
+                }
+            else
+                {
+                    url = g_strdup(BLOOM_URL);
+                }
+
+            success = get_url(comm, url, NULL);
+
+            if (success == CURLE_OK && comm->buffer != NULL)
+                {
+                    bloom = update_bloom_from_json_string(bloom, comm->buffer);
+                }
+
+            free_variable(comm->buffer);
+            free_variable(url);
+        }
+
+    return bloom;
+}
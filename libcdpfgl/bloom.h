@@ -0,0 +1,168 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    bloom.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file bloom.h
+ *
+ * This file contains all the definitions needed to manage a Bloom filter
+ * of hashs. The server keeps one filter of every hash it has stored and
+ * clients download it to avoid asking for hashs that are certainly not
+ * known by the server.
+ */
+#ifndef _BLOOM_H_
+#define _BLOOM_H_
+
+/**
+ * @def BLOOM_DEFAULT_BITS
+ * Default number of bits of a filter: 16777216 bits is 2 MB and keeps
+ * the false positive rate around 1% up to 1.7 million hashs (ie 27 GB
+ * of deduplicated data with 16384 bytes blocks).
+ */
+#define BLOOM_DEFAULT_BITS (16777216)
+
+/**
+ * @def BLOOM_DEFAULT_HASHS
+ * Default number of bits set into the filter for each hash.
+ */
+#define BLOOM_DEFAULT_HASHS (7)
+
+/**
+ * @def BLOOM_URL
+ * Url where the filter of stored hashs may be downloaded from server.
+ */
+#define BLOOM_URL ("/Hash_Filter.json")
+
+
+/**
+ * @struct bloom_t
+ * @brief Bloom filter of binary hashs.
+ *
+ * As hashs are SHA256 hashs, bit positions are directly derived from the
+ * hash itself (double hashing with its first two 64 bits words) and no
+ * other hash function is needed.
+ */
+typedef struct
+{
+    guint8 *bits;     /**< bit array of the filter (nbits / 8 bytes long)                       */
+    guint64 nbits;    /**< number of bits of the filter (always a multiple of 8)                */
+    guint nhashs;     /**< number of bits set for each hash                                     */
+    guint32 id;       /**< identifies the filter: changes each time server rebuilds its filter  */
+    guint64 version;  /**< version of the filter as known by server (used to ask for deltas)    */
+} bloom_t;
+
+
+/**
+ * Creates a new empty bloom_t filter
+ * @param nbits is the number of bits of the filter (rounded up to a
+ *        multiple of 8).
+ * @param nhashs is the number of bits set for each hash.
+ * @param id is the identifier of this filter.
+ * @returns a newly allocated bloom_t * structure that may be freed with
+ *          free_bloom_t() when no longer needed or NULL if nbits or
+ *          nhashs are 0.
+ */
+extern bloom_t *new_bloom_t(guint64 nbits, guint nhashs, guint32 id);
+
+
+/**
+ * Frees a bloom_t * structure
+ * @param bloom is the filter to be freed.
+ */
+extern void free_bloom_t(bloom_t *bloom);
+
+
+/**
+ * Adds a hash into the filter. The version of the filter is not
+ * modified here: it is up to the owner of the filter to manage it.
+ * @param bloom is the filter where to add the hash
+ * @param hash is the binary hash (HASH_LEN bytes long) to add.
+ * @returns TRUE if at least one bit was changed (ie the hash was not
+ *          already probably in the filter) and FALSE otherwise.
+ */
+extern gboolean bloom_add_hash(bloom_t *bloom, guint8 *hash);
+
+
+/**
+ * Adds every hash of a list into the filter.
+ * @param bloom is the filter where to add the hashs
+ * @param hash_data_list is a GList of hash_data_t * structures.
+ */
+extern void bloom_add_hash_list(bloom_t *bloom, GList *hash_data_list);
+
+
+/**
+ * Tells whether a hash may be in the filter or not.
+ * @param bloom is the filter to look into.
+ * @param hash is the binary hash (HASH_LEN bytes long) to look for.
+ * @returns FALSE if the hash is certainly not in the filter and TRUE if
+ *          it probably is (or if bloom is NULL).
+ */
+extern gboolean bloom_may_contain_hash(bloom_t *bloom, guint8 *hash);
+
+
+/**
+ * Splits a hash list in two lists: hashs that are certainly not in the
+ * filter and hashs that may be in it.
+ * @param bloom is the filter to test hashs against.
+ * @param hash_data_list is a GList of hash_data_t * structures.
+ * @param[out] probable is a GList of copies (hashs only) of hash_data_t
+ *             structures that may be in the filter.
+ * @returns a GList of copies (hashs only) of hash_data_t structures that
+ *          are certainly not in the filter.
+ */
+extern GList *bloom_split_hash_list(bloom_t *bloom, GList *hash_data_list, GList **probable);
+
+
+/**
+ * Converts a whole filter into a json_t * structure.
+ * @param bloom is the filter to be converted.
+ * @returns a json_t * object with "id", "version", "nbits", "nhashs" and
+ *          "filter" (base64 encoded bits) keys.
+ */
+extern json_t *convert_bloom_t_to_json(bloom_t *bloom);
+
+
+/**
+ * Updates a filter with the json answer of the server. The answer may
+ * be a whole filter, a delta (a list of hashs added since our version)
+ * or nothing new.
+ * @param bloom is the filter to be updated (may be NULL).
+ * @param json_str is the json string answered by the server.
+ * @returns the updated filter. It may be a newly allocated one in which
+ *          case the old one has been freed. If the answer can not be
+ *          understood bloom is returned untouched.
+ */
+extern bloom_t *update_bloom_from_json_string(bloom_t *bloom, gchar *json_str);
+
+
+/**
+ * Gets the filter of stored hashs from server. Only the hashs stored
+ * since our version are transmitted when possible.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL)
+ * @param bloom is the filter we already have (may be NULL).
+ * @returns the updated filter (see update_bloom_from_json_string()) or
+ *          bloom untouched if the server could not answer.
+ */
+extern bloom_t *get_bloom_from_server(comm_t *comm, bloom_t *bloom);
+
+
+#endif /* #ifndef _BLOOM_H_ */
@@ -31,18 +31,22 @@
 
 
 /**
- * Initializes a clock file to write output to
+ * Initializes a clock file to write output to. Tracing is started when
+ * filepath is not NULL.
+ * @param filepath is the file where the trace will be written.
  */
 void init_clock_t(char *filepath)
 {
-    if (filepath != NULL)
-    {
-        a_clock_out = g_file_new_for_path(filepath);
-        print_debug("Set clock output to %s\n", filepath);
-    } else
-    {
-        a_clock_out = NULL;
-    }
+    init_trace(filepath);
+}
+
+
+/**
+ * Writes every remaining clock output to the file and closes it.
+ */
+void terminate_clock_t(void)
+{
+    terminate_trace();
 }
 
 
@@ -51,6 +55,19 @@ void init_clock_t(char *filepath)
  * @returns a clock_t * structure with begin field set.
  */
 a_clock_t *new_clock_t(void)
+{
+    return new_clock_t_from_span(get_trace_current_span());
+}
+
+
+/**
+ * Creates a new a_clock_t structure whose span is a child of a span
+ * that may come from another program (for instance the span of the
+ * client's stage that sent a request).
+ * @param parent is the span id of the parent span (0 if none).
+ * @returns a a_clock_t * structure with begin field set.
+ */
+a_clock_t *new_clock_t_from_span(guint64 parent)
 {
     a_clock_t *my_clock = NULL;
 
@@ -58,8 +75,16 @@ a_clock_t *new_clock_t(void)
 
     if (my_clock != NULL)
     {
-        my_clock->end = NULL;
-        my_clock->begin = g_date_time_new_now_local();
+        if (is_trace_enabled() == TRUE)
+        {
+            /* Clocks created until this one ends are its children */
+            my_clock->previous = get_trace_current_span();
+            my_clock->parent = parent;
+            my_clock->span = new_trace_span_id();
+            set_trace_current_span(my_clock->span);
+        }
+
+        my_clock->begin = g_get_monotonic_time();
     }
 
     return my_clock;
@@ -74,46 +99,20 @@ a_clock_t *new_clock_t(void)
  */
 void end_clock(a_clock_t *my_clock, gchar *message)
 {
-    GTimeSpan difference = 0;
+    gint64 difference = 0;
 
-    if (my_clock != NULL && my_clock->begin != NULL)
+    if (my_clock != NULL)
     {
-        my_clock->end = g_date_time_new_now_local();
-        difference = g_date_time_difference(my_clock->end, my_clock->begin);
+        difference = g_get_monotonic_time() - my_clock->begin;
+        print_debug("Elapsed time (%s): %"G_GINT64_FORMAT" µs\n", message, difference);
 
-        g_date_time_unref(my_clock->begin);
-        g_date_time_unref(my_clock->end);
-        free_variable(my_clock);
-        print_debug("Elapsed time (%s): %ld µs\n", message, difference);
-
-        // write to file if specified
-        if (a_clock_out != NULL)
+        if (my_clock->span != 0)
         {
-            GFileOutputStream *stream = NULL;
-            GError *error = NULL;
-            gsize count = 0;
-            gsize written = 0;
-            gchar *buffer = NULL;
-
-            stream = g_file_append_to(a_clock_out, G_FILE_CREATE_NONE, NULL, &error);
-            if (stream != NULL)
-            {
-                buffer = g_strdup_printf("%s, %ld\n", message, difference);
-                count = strlen(buffer);
-                written = g_output_stream_write((GOutputStream *) stream, buffer, count, NULL, &error);
-
-                if (error != NULL)
-                {
-                    print_error(__FILE__, __LINE__, "Error: could not append clock timestamp to file!\n");
-                }
-
-                g_output_stream_close((GOutputStream *) stream, NULL, &error);
-                g_free(buffer);
-            }
+            /* Only copied into the ring of this thread: the flusher writes it later */
+            add_trace_event(message, my_clock->begin, difference, my_clock->span, my_clock->parent);
+            set_trace_current_span(my_clock->previous);
         }
 
+        free_variable(my_clock);
     }
 }
-
-
-
@@ -30,37 +30,57 @@
 /** Write clock output to file for tests */
 #define CLOCK_T_OUTPUT_TO_FILE (0)
 
-/** Filepath for clock output */
-#define CLOCK_T_PATH ("/usr/local/etc/cdpfgl/clockfile.txt")
+/** Filepath for clock output of the server (in Chrome's trace event format) */
+#define CLOCK_T_PATH ("/usr/local/etc/cdpfgl/server-trace.json")
+
+/** Filepath for clock output of the client (in Chrome's trace event format) */
+#define CLOCK_T_CLIENT_PATH ("/usr/local/etc/cdpfgl/client-trace.json")
 
 /**
  * @struct a_clock_t
  * @brief Structure to store clock information in order to measure
- *        elapsed time.
+ *        elapsed time. When tracing is enabled each clock is a span
+ *        whose parent is the span the thread was in when the clock was
+ *        created.
  */
 typedef struct
 {
-    GDateTime *begin;  /** begin is filled when initializing the structure */
-    GDateTime *end;    /** end is filled when freeing the structure */
+    gint64 begin;      /** begin is filled (monotonic time in µs) when initializing the structure */
+    guint64 span;      /** span id of this clock (0 when tracing is not enabled)                   */
+    guint64 parent;    /** span id of the parent span (0 if none)                                  */
+    guint64 previous;  /** span the thread was in before this clock                               */
 } a_clock_t;
 
 
 /**
- * Stores the file to write the output to
+ * Initializes a clock file to write output to. Tracing is started when
+ * filepath is not NULL.
+ * @param filepath is the file where the trace will be written.
  */
-static GFile *a_clock_out;
+extern void init_clock_t(char *filepath);
+
 
 /**
- * Initializes a clock file to write output to
+ * Writes every remaining clock output to the file and closes it.
  */
-void init_clock_t(char *filepath);
+extern void terminate_clock_t(void);
 
 
 /**
  * Creates a new a_clock_t structure filled accordingly
  * @returns a a_clock_t * structure with begin field set.
  */
-a_clock_t *new_clock_t(void);
+extern a_clock_t *new_clock_t(void);
+
+
+/**
+ * Creates a new a_clock_t structure whose span is a child of a span
+ * that may come from another program (for instance the span of the
+ * client's stage that sent a request).
+ * @param parent is the span id of the parent span (0 if none).
+ * @returns a a_clock_t * structure with begin field set.
+ */
+extern a_clock_t *new_clock_t_from_span(guint64 parent);
 
 
 /**
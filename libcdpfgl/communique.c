@@ -35,6 +35,7 @@ static size_t write_data(void *buffer, size_t size, size_t nmemb, void *userp);
 static size_t read_data(char *buffer, size_t size, size_t nitems, void *userp);
 static gboolean does_url_end_with_json(gchar *url);
 static struct curl_slist *append_content_type_to_header(struct curl_slist *chunk, gchar *url);
+static struct curl_slist *append_trace_span_to_header(struct curl_slist *chunk);
 
 /**
  * Gets the version for the communication library
@@ -166,7 +167,6 @@ guchar *concat_buffer(guchar *buffer, guint64 pos, guchar *buf1, size_t len)
 static size_t write_data(void *buffer, size_t size, size_t nmemb, void *userp)
 {
     comm_t *comm = (comm_t *) userp;
-    guchar *concat = NULL;
 
     if (comm != NULL)
         {
@@ -177,11 +177,11 @@ static size_t write_data(void *buffer, size_t size, size_t nmemb, void *userp)
                 }
             else
                 {
-                    concat = concat_buffer((guchar *) comm->buffer, comm->pos, buffer, size * nmemb);
+                    /* Growing the buffer in place avoids copying the whole answer at each part received */
+                    comm->buffer = (gchar *) g_realloc(comm->buffer, comm->pos + size * nmemb + 1);
+                    memcpy(comm->buffer + comm->pos, buffer, size * nmemb);
                     comm->pos = comm->pos + size * nmemb;
-
-                    free_variable(comm->buffer);
-                    comm->buffer = (gchar *) concat;
+                    comm->buffer[comm->pos] = '\0';
                 }
 
             comm->seq = comm->seq + 1;
@@ -294,6 +294,30 @@ static struct curl_slist *append_content_type_to_header(struct curl_slist *chunk
 }
 
 
+/**
+ * @param chunk is the list of chunk headers as defined by libcurl
+ * @returns the list with a TRACE_SPAN_HEADER header appended when the
+ *          calling thread is in a traced span so that the server can
+ *          link its own spans to it.
+ */
+static struct curl_slist *append_trace_span_to_header(struct curl_slist *chunk)
+{
+    gchar *header = NULL;
+    guint64 span = 0;
+
+    span = get_trace_current_span();
+
+    if (span != 0)
+        {
+            header = g_strdup_printf("%s: %016"G_GINT64_MODIFIER"x", TRACE_SPAN_HEADER, span);
+            chunk = curl_slist_append(chunk, header);
+            free_variable(header);
+        }
+
+    return chunk;
+}
+
+
 /**
  * Uses curl to send a GET command to the http url
  * @param comm a comm_t * structure that must contain an initialized
@@ -324,6 +348,8 @@ gint get_url(comm_t *comm, gchar *url, gchar *header)
             comm->pos = 0;
             real_url = g_strdup_printf("%s%s", comm->conn, url);
 
+            /* The handle may have been used for a POST request before */
+            curl_easy_setopt(comm->curl_handle, CURLOPT_HTTPGET, 1L);
             curl_easy_setopt(comm->curl_handle, CURLOPT_URL, real_url);
             curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEFUNCTION, write_data);
             curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEDATA, comm);
@@ -331,6 +357,7 @@ gint get_url(comm_t *comm, gchar *url, gchar *header)
 
             /* Setting header options */
             chunk = append_content_type_to_header(chunk, url);
+            chunk = append_trace_span_to_header(chunk);
             if (header != NULL)
                 {
                     chunk = curl_slist_append(chunk, header);
@@ -409,6 +436,7 @@ gint post_url(comm_t *comm, gchar *url)
             chunk = curl_slist_append(chunk, len);
 
             chunk = append_content_type_to_header(chunk, url);
+            chunk = append_trace_span_to_header(chunk);
             curl_easy_setopt(comm->curl_handle, CURLOPT_HTTPHEADER, chunk);
 
             success = curl_easy_perform(comm->curl_handle);
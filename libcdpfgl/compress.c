@@ -22,7 +22,7 @@
 
 /**
  * @file compress.c
- * This file is here to manage compression libraries (at least zlib)
+ * This file is here to manage compression libraries (zlib, zstd and lz4)
  */
 
 #include "libcdpfgl.h"
@@ -31,6 +31,27 @@
 static void zlib_print_error(char *filename, int lineno, int ret);
 static compress_t *zlib_compress_buffer(compress_t *comp, guchar *buffer, guint size);
 static compress_t *zlib_uncompress_buffer(compress_t *comp, guint64 len);
+static compress_t *zstd_compress_buffer(compress_t *comp, guchar *buffer, guint size);
+static compress_t *zstd_uncompress_buffer(compress_t *comp, guchar *buffer, guint64 cmplen, guint64 textlen);
+static compress_t *lz4_compress_buffer(compress_t *comp, guchar *buffer, guint size);
+static compress_t *lz4_uncompress_buffer(compress_t *comp, guchar *buffer, guint64 cmplen, guint64 textlen);
+static compress_dict_t *get_compress_dictionary(guint id);
+static compress_t *zstd_dict_compress_buffer(compress_t *comp, guchar *buffer, guint size, guint id);
+static compress_t *zstd_dict_uncompress_buffer(compress_t *comp, guchar *buffer, guint64 cmplen, guint64 textlen, guint id);
+
+
+/**
+ * Compression level used by compress_buffer() (see set_compression_level()).
+ */
+static gint compression_level = COMPRESS_DEFAULT_LEVEL;
+
+/**
+ * Registered zstd dictionaries (compress_dict_t *) by id (never freed)
+ * and id of the one used to compress (0 if none).
+ */
+static GHashTable *dictionaries = NULL;
+static guint compression_dictionary = 0;
+G_LOCK_DEFINE_STATIC(dictionaries);
 
 
 /**
@@ -71,11 +92,220 @@ void free_compress_t(compress_t *comp)
 }
 
 
+/**
+ * Sets the compression level used by compress_buffer() from now on.
+ * @param level is the level to use (COMPRESS_DEFAULT_LEVEL selects the
+ *        default level of each compression type). It is bounded to the
+ *        levels that each compression type allows.
+ */
+void set_compression_level(gint level)
+{
+    compression_level = MAX(level, COMPRESS_DEFAULT_LEVEL);
+}
+
+
+/**
+ * Guesses whether compressing a buffer may save some space: data that
+ * is already compressed (or encrypted) has its bytes evenly spread over
+ * the 256 possible values. Only a sample of the buffer is looked at.
+ * @param buffer is the buffer to be compressed.
+ * @param size is the size of the buffer.
+ * @returns FALSE if the buffer looks like random data and TRUE otherwise.
+ */
+gboolean is_worth_compressing(guchar *buffer, guint size)
+{
+    guint counts[256] = {0};
+    guint n = MIN(size, COMPRESS_ENTROPY_SAMPLE);
+    guint step = 0;
+    guint64 sum = 0;
+    guint i = 0;
+
+    /* Below 256 bytes the sample says nothing and compressing is cheap */
+    if (buffer == NULL || n < 256)
+        {
+            return TRUE;
+        }
+
+    step = size / n;
+
+    for (i = 0; i < n; i++)
+        {
+            counts[buffer[i * step]]++;
+        }
+
+    for (i = 0; i < 256; i++)
+        {
+            sum = sum + (guint64) counts[i] * counts[i];
+        }
+
+    /**
+     * For uniformly random bytes sum is close to n + n * (n - 1) / 256.
+     * Anything with redundancy (text, binaries, zeros) is well above.
+     */
+    return (sum * 4 > ((guint64) n + (guint64) n * (n - 1) / 256) * 5);
+}
+
+
+/**
+ * Registers a trained dictionary. Dictionaries are kept until the end of
+ * the program. Thread safe.
+ * @param id is the id (version) of the dictionary (1 to
+ *        COMPRESS_DICT_MAX_ID).
+ * @param data is the dictionary as made by train_compress_dictionary()
+ *        (it is copied).
+ * @param len is the length of data.
+ * @returns TRUE if the dictionary is registered (or already was) and
+ *          FALSE otherwise.
+ */
+gboolean add_compress_dictionary(guint id, guchar *data, gsize len)
+{
+    compress_dict_t *dict = NULL;
+    gint level = ZSTD_CLEVEL_DEFAULT;
+    gboolean ok = FALSE;
+
+    if (id > 0 && id <= COMPRESS_DICT_MAX_ID && data != NULL && len > 0)
+        {
+            if (compression_level != COMPRESS_DEFAULT_LEVEL)
+                {
+                    level = MIN(compression_level, ZSTD_maxCLevel());
+                }
+
+            G_LOCK(dictionaries);
+
+            if (dictionaries == NULL)
+                {
+                    dictionaries = g_hash_table_new(g_direct_hash, g_direct_equal);
+                }
+
+            if (g_hash_table_contains(dictionaries, GUINT_TO_POINTER(id)) == FALSE)
+                {
+                    dict = (compress_dict_t *) g_malloc0(sizeof(compress_dict_t));
+                    dict->cdict = ZSTD_createCDict(data, len, level);
+                    dict->ddict = ZSTD_createDDict(data, len);
+
+                    if (dict->cdict != NULL && dict->ddict != NULL)
+                        {
+                            g_hash_table_insert(dictionaries, GUINT_TO_POINTER(id), dict);
+                            ok = TRUE;
+                        }
+                    else
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: invalid dictionary %u.\n"), id);
+                            ZSTD_freeCDict(dict->cdict);
+                            ZSTD_freeDDict(dict->ddict);
+                            free_variable(dict);
+                        }
+                }
+            else
+                {
+                    ok = TRUE;
+                }
+
+            G_UNLOCK(dictionaries);
+        }
+
+    return ok;
+}
+
+
+/**
+ * @param id is the id of a dictionary.
+ * @returns the registered dictionary id or NULL.
+ */
+static compress_dict_t *get_compress_dictionary(guint id)
+{
+    compress_dict_t *dict = NULL;
+
+    G_LOCK(dictionaries);
+
+    if (dictionaries != NULL)
+        {
+            dict = g_hash_table_lookup(dictionaries, GUINT_TO_POINTER(id));
+        }
+
+    G_UNLOCK(dictionaries);
+
+    return dict;
+}
+
+
+/**
+ * @param id is the id of a dictionary.
+ * @returns TRUE if the dictionary id is registered.
+ */
+gboolean has_compress_dictionary(guint id)
+{
+    return (get_compress_dictionary(id) != NULL);
+}
+
+
+/**
+ * Selects the dictionary used when compressing with zstd from now on.
+ * @param id is the id of a registered dictionary or 0 to compress
+ *        without any dictionary.
+ */
+void use_compress_dictionary(guint id)
+{
+    if (id == 0 || has_compress_dictionary(id) == TRUE)
+        {
+            compression_dictionary = id;
+        }
+}
+
+
+/**
+ * @param cmptype is the compression type asked for.
+ * @returns the compression type to use for cmptype: zstd with the
+ *          selected dictionary (if any) instead of COMPRESS_ZSTD_TYPE.
+ */
+gshort get_compress_type_to_use(gshort cmptype)
+{
+    if (cmptype == COMPRESS_ZSTD_TYPE && compression_dictionary != 0)
+        {
+            cmptype = (gshort) (COMPRESS_ZSTD_DICT_TYPE + compression_dictionary);
+        }
+
+    return cmptype;
+}
+
+
+/**
+ * Trains a zstd dictionary from samples of blocks.
+ * @param samples is the concatenation of every sample.
+ * @param sizes is the size of each sample in samples.
+ * @param nb_samples is the number of samples.
+ * @param capacity is the maximum size of the dictionary.
+ * @param len is filled with the size of the dictionary.
+ * @returns a newly allocated dictionary or NULL if it could not be
+ *          trained (too few samples for instance).
+ */
+guchar *train_compress_dictionary(guchar *samples, gsize *sizes, guint nb_samples, gsize capacity, gsize *len)
+{
+    guchar *dict = NULL;
+    size_t dictlen = 0;
+
+    dict = (guchar *) g_malloc(capacity);
+    dictlen = ZDICT_trainFromBuffer(dict, capacity, samples, sizes, nb_samples);
+
+    if (ZDICT_isError(dictlen))
+        {
+            print_error(__FILE__, __LINE__, _("Error while training a dictionary: %s\n"), ZDICT_getErrorName(dictlen));
+            free_variable(dict);
+            dictlen = 0;
+        }
+
+    *len = dictlen;
+
+    return dict;
+}
+
+
 /**
  * Compress buffer and returns a compressed text
  * @param buffer is the plain buffer text to be compressed
  *        this buffer must be \0 terminated.
- * @param type is the compression type to use (COMPRESS_ZLIB_TYPE).
+ * @param type is the compression type to use (COMPRESS_ZLIB_TYPE,
+ *        COMPRESS_ZSTD_TYPE or COMPRESS_LZ4_TYPE).
  * @returns a compress_t structure containing a compressed text
  *          buffer.
  */
@@ -89,6 +319,18 @@ compress_t *compress_buffer(guchar *buffer, guint size, gint type)
         {
             comp = zlib_compress_buffer(comp, buffer, size);
         }
+    else if (type == COMPRESS_ZSTD_TYPE && comp != NULL)
+        {
+            comp = zstd_compress_buffer(comp, buffer, size);
+        }
+    else if (type == COMPRESS_LZ4_TYPE && comp != NULL)
+        {
+            comp = lz4_compress_buffer(comp, buffer, size);
+        }
+    else if (IS_COMPRESS_DICT_TYPE(type) && comp != NULL)
+        {
+            comp = zstd_dict_compress_buffer(comp, buffer, size, COMPRESS_DICT_ID(type));
+        }
 
     return comp;
 }
@@ -145,15 +387,21 @@ static compress_t *zlib_compress_buffer(compress_t *comp, guchar *buffer, guint
     glong srclen = 0;
     uLongf destlen = 0;
     Bytef *destbuffer = NULL;
+    gint level = 9;
 
     srclen = (glong) size;
     destlen = compressBound((uLong) srclen);
     destbuffer = (Bytef *) g_malloc(sizeof(Bytef)*(destlen + 2));
 
+    if (compression_level != COMPRESS_DEFAULT_LEVEL)
+        {
+            level = CLAMP(compression_level, Z_BEST_SPEED, Z_BEST_COMPRESSION);
+        }
+
     if (destbuffer != NULL)
         {
             /* Default zlib compression level is set to best (9) */
-            ret = compress2(destbuffer, &destlen, (const Bytef *) buffer, (uLong) srclen, 9);
+            ret = compress2(destbuffer, &destlen, (const Bytef *) buffer, (uLong) srclen, level);
 
             if (ret != Z_OK)
                 {
@@ -187,9 +435,10 @@ static compress_t *zlib_compress_buffer(compress_t *comp, guchar *buffer, guint
  * @param buffer is the compressed buffer to be uncompressed
  * @param cmplen is the len of the above compressed buffer
  * @param textlen is the len of the uncompressed data
- * @param type is the compression type to use (COMPRESS_ZLIB_TYPE).
- * @returns a compress_t structure containing a compressed text
- *          buffer.
+ * @param type is the compression type to use (COMPRESS_ZLIB_TYPE,
+ *        COMPRESS_ZSTD_TYPE or COMPRESS_LZ4_TYPE).
+ * @returns a compress_t structure containing the uncompressed text or
+ *          NULL on error (buffer is never freed).
  */
 compress_t *uncompress_buffer(guchar *buffer, guint64 cmplen, guint64 textlen, gint type)
 {
@@ -206,6 +455,24 @@ compress_t *uncompress_buffer(guchar *buffer, guint64 cmplen, guint64 textlen, g
             comp->comp = TRUE;
             comp = zlib_uncompress_buffer(comp, textlen);
         }
+    else if (type == COMPRESS_ZSTD_TYPE)
+        {
+            comp = zstd_uncompress_buffer(comp, buffer, cmplen, textlen);
+        }
+    else if (type == COMPRESS_LZ4_TYPE)
+        {
+            comp = lz4_uncompress_buffer(comp, buffer, cmplen, textlen);
+        }
+    else if (IS_COMPRESS_DICT_TYPE(type))
+        {
+            comp = zstd_dict_uncompress_buffer(comp, buffer, cmplen, textlen, COMPRESS_DICT_ID(type));
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: unknown compression type %d.\n"), type);
+            free_compress_t(comp);
+            comp = NULL;
+        }
 
     return comp;
 }
@@ -244,6 +511,8 @@ static compress_t *zlib_uncompress_buffer(compress_t *comp, guint64 len)
                     if (ret != Z_BUF_ERROR)
                         {
                             zlib_print_error(__FILE__, __LINE__, ret);
+                            g_free(destbuffer);
+                            comp->text = NULL; /* text is the caller's compressed buffer */
                             free_compress_t(comp);
                             comp = NULL;
                         }
@@ -268,6 +537,252 @@ static compress_t *zlib_uncompress_buffer(compress_t *comp, guint64 len)
 }
 
 
+/**
+ * Compress buffer using zstd at the selected compression level.
+ * @param comp is the compress_t structure that may contain
+ *        the compressed data
+ * @param buffer is the plain text buffer to be compressed
+ * @param size is the size of buffer.
+ * @returns a compress_t structure with compressed data in it
+ *          or NULL in case that something went wrong.
+ */
+static compress_t *zstd_compress_buffer(compress_t *comp, guchar *buffer, guint size)
+{
+    size_t destlen = 0;
+    guchar *destbuffer = NULL;
+    gint level = ZSTD_CLEVEL_DEFAULT;
+
+    if (compression_level != COMPRESS_DEFAULT_LEVEL)
+        {
+            level = MIN(compression_level, ZSTD_maxCLevel());
+        }
+
+    destbuffer = (guchar *) g_malloc(ZSTD_compressBound(size));
+    destlen = ZSTD_compress(destbuffer, ZSTD_compressBound(size), buffer, size, level);
+
+    if (ZSTD_isError(destlen))
+        {
+            print_error(__FILE__, __LINE__, _("Error while compressing with zstd: %s\n"), ZSTD_getErrorName(destlen));
+            g_free(destbuffer);
+            free_compress_t(comp);
+            comp = NULL;
+        }
+    else
+        {
+            comp->text = destbuffer;
+            comp->len = destlen;
+            comp->comp = TRUE;
+        }
+
+    return comp;
+}
+
+
+/**
+ * Uncompress buffer using zstd.
+ * @param comp is the compress_t structure that will contain the
+ *        uncompressed data.
+ * @param buffer is the compressed buffer.
+ * @param cmplen is the len of the compressed buffer.
+ * @param textlen is the len of the uncompressed data.
+ * @returns a compress_t structure with uncompressed data in it
+ *          or NULL in case that something went wrong.
+ */
+static compress_t *zstd_uncompress_buffer(compress_t *comp, guchar *buffer, guint64 cmplen, guint64 textlen)
+{
+    size_t destlen = 0;
+    guchar *destbuffer = NULL;
+
+    destbuffer = (guchar *) g_malloc0(textlen + 1);
+    destlen = ZSTD_decompress(destbuffer, textlen, buffer, cmplen);
+
+    if (ZSTD_isError(destlen) || destlen != textlen)
+        {
+            print_error(__FILE__, __LINE__, _("Error while uncompressing with zstd: %s\n"), ZSTD_isError(destlen) ? ZSTD_getErrorName(destlen) : _("wrong size"));
+            g_free(destbuffer);
+            free_compress_t(comp);
+            comp = NULL;
+        }
+    else
+        {
+            comp->text = destbuffer;
+            comp->text[destlen] = '\0';
+            comp->len = destlen;
+            comp->comp = FALSE;
+        }
+
+    return comp;
+}
+
+
+/**
+ * Compress buffer using lz4 (fast mode: lz4 has no compression level).
+ * @param comp is the compress_t structure that may contain
+ *        the compressed data
+ * @param buffer is the plain text buffer to be compressed
+ * @param size is the size of buffer.
+ * @returns a compress_t structure with compressed data in it
+ *          or NULL in case that something went wrong.
+ */
+static compress_t *lz4_compress_buffer(compress_t *comp, guchar *buffer, guint size)
+{
+    gint bound = 0;
+    gint destlen = 0;
+    guchar *destbuffer = NULL;
+
+    bound = LZ4_compressBound((gint) size);
+    destbuffer = (guchar *) g_malloc(bound);
+    destlen = LZ4_compress_default((const char *) buffer, (char *) destbuffer, (gint) size, bound);
+
+    if (destlen <= 0)
+        {
+            print_error(__FILE__, __LINE__, _("Error while compressing with lz4.\n"));
+            g_free(destbuffer);
+            free_compress_t(comp);
+            comp = NULL;
+        }
+    else
+        {
+            comp->text = destbuffer;
+            comp->len = destlen;
+            comp->comp = TRUE;
+        }
+
+    return comp;
+}
+
+
+/**
+ * Uncompress buffer using lz4.
+ * @param comp is the compress_t structure that will contain the
+ *        uncompressed data.
+ * @param buffer is the compressed buffer.
+ * @param cmplen is the len of the compressed buffer.
+ * @param textlen is the len of the uncompressed data.
+ * @returns a compress_t structure with uncompressed data in it
+ *          or NULL in case that something went wrong.
+ */
+static compress_t *lz4_uncompress_buffer(compress_t *comp, guchar *buffer, guint64 cmplen, guint64 textlen)
+{
+    gint destlen = 0;
+    guchar *destbuffer = NULL;
+
+    destbuffer = (guchar *) g_malloc0(textlen + 1);
+    destlen = LZ4_decompress_safe((const char *) buffer, (char *) destbuffer, (gint) cmplen, (gint) textlen);
+
+    if (destlen < 0 || (guint64) destlen != textlen)
+        {
+            print_error(__FILE__, __LINE__, _("Error while uncompressing with lz4.\n"));
+            g_free(destbuffer);
+            free_compress_t(comp);
+            comp = NULL;
+        }
+    else
+        {
+            comp->text = destbuffer;
+            comp->text[destlen] = '\0';
+            comp->len = destlen;
+            comp->comp = FALSE;
+        }
+
+    return comp;
+}
+
+
+/**
+ * Compress buffer using zstd and a registered dictionary (the
+ * compression level is the one of the dictionary).
+ * @param comp is the compress_t structure that may contain
+ *        the compressed data
+ * @param buffer is the plain text buffer to be compressed
+ * @param size is the size of buffer.
+ * @param id is the id of the dictionary.
+ * @returns a compress_t structure with compressed data in it
+ *          or NULL in case that something went wrong.
+ */
+static compress_t *zstd_dict_compress_buffer(compress_t *comp, guchar *buffer, guint size, guint id)
+{
+    compress_dict_t *dict = NULL;
+    ZSTD_CCtx *cctx = NULL;
+    size_t destlen = 0;
+    guchar *destbuffer = NULL;
+
+    dict = get_compress_dictionary(id);
+
+    if (dict != NULL)
+        {
+            cctx = ZSTD_createCCtx();
+            destbuffer = (guchar *) g_malloc(ZSTD_compressBound(size));
+            destlen = ZSTD_compress_usingCDict(cctx, destbuffer, ZSTD_compressBound(size), buffer, size, dict->cdict);
+            ZSTD_freeCCtx(cctx);
+        }
+
+    if (dict == NULL || ZSTD_isError(destlen))
+        {
+            print_error(__FILE__, __LINE__, _("Error while compressing with zstd dictionary %u.\n"), id);
+            free_variable(destbuffer);
+            free_compress_t(comp);
+            comp = NULL;
+        }
+    else
+        {
+            comp->text = destbuffer;
+            comp->len = destlen;
+            comp->comp = TRUE;
+        }
+
+    return comp;
+}
+
+
+/**
+ * Uncompress buffer using zstd and a registered dictionary.
+ * @param comp is the compress_t structure that will contain the
+ *        uncompressed data.
+ * @param buffer is the compressed buffer.
+ * @param cmplen is the len of the compressed buffer.
+ * @param textlen is the len of the uncompressed data.
+ * @param id is the id of the dictionary.
+ * @returns a compress_t structure with uncompressed data in it
+ *          or NULL in case that something went wrong (the dictionary
+ *          is not registered for instance).
+ */
+static compress_t *zstd_dict_uncompress_buffer(compress_t *comp, guchar *buffer, guint64 cmplen, guint64 textlen, guint id)
+{
+    compress_dict_t *dict = NULL;
+    ZSTD_DCtx *dctx = NULL;
+    size_t destlen = 0;
+    guchar *destbuffer = NULL;
+
+    dict = get_compress_dictionary(id);
+
+    if (dict != NULL)
+        {
+            dctx = ZSTD_createDCtx();
+            destbuffer = (guchar *) g_malloc0(textlen + 1);
+            destlen = ZSTD_decompress_usingDDict(dctx, destbuffer, textlen, buffer, cmplen, dict->ddict);
+            ZSTD_freeDCtx(dctx);
+        }
+
+    if (dict == NULL || ZSTD_isError(destlen) || destlen != textlen)
+        {
+            print_error(__FILE__, __LINE__, _("Error while uncompressing with zstd dictionary %u.\n"), id);
+            free_variable(destbuffer);
+            free_compress_t(comp);
+            comp = NULL;
+        }
+    else
+        {
+            comp->text = destbuffer;
+            comp->text[destlen] = '\0';
+            comp->len = destlen;
+            comp->comp = FALSE;
+        }
+
+    return comp;
+}
+
+
 /**
  * Verify if a compress type is allowed
  * @param cmptype is a gshort that should represents the compression type
@@ -275,7 +790,7 @@ static compress_t *zlib_uncompress_buffer(compress_t *comp, guint64 len)
  */
 gboolean is_compress_type_allowed(gshort cmptype)
 {
-    if (cmptype == COMPRESS_NONE_TYPE || cmptype == COMPRESS_ZLIB_TYPE)
+    if (cmptype == COMPRESS_NONE_TYPE || cmptype == COMPRESS_ZLIB_TYPE || cmptype == COMPRESS_ZSTD_TYPE || cmptype == COMPRESS_LZ4_TYPE || IS_COMPRESS_DICT_TYPE(cmptype))
         {
             return TRUE;
         }
@@ -293,7 +808,7 @@ gboolean is_compress_type_allowed(gshort cmptype)
 gchar *get_compress_type_string(void)
 {
 
-    return g_strdup_printf("%d, %d", COMPRESS_NONE_TYPE, COMPRESS_ZLIB_TYPE);
+    return g_strdup_printf("%d, %d, %d, %d", COMPRESS_NONE_TYPE, COMPRESS_ZLIB_TYPE, COMPRESS_ZSTD_TYPE, COMPRESS_LZ4_TYPE);
 
 }
 
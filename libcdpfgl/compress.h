@@ -41,6 +41,54 @@
  */
 #define COMPRESS_ZLIB_TYPE (1)
 
+/**
+ * @def COMPRESS_ZSTD_TYPE
+ * Defines that zstd is to be used to compress data
+ */
+#define COMPRESS_ZSTD_TYPE (2)
+
+/**
+ * @def COMPRESS_LZ4_TYPE
+ * Defines that lz4 is to be used to compress data
+ */
+#define COMPRESS_LZ4_TYPE (3)
+
+/**
+ * @def COMPRESS_ZSTD_DICT_TYPE
+ * Base of the compression types of zstd with a trained dictionary: the
+ * compression type of a block is COMPRESS_ZSTD_DICT_TYPE + id where id
+ * (1 to COMPRESS_DICT_MAX_ID) is the version of the dictionary used.
+ *
+ * @def COMPRESS_DICT_MAX_ID
+ * Greatest dictionary id that fits in a compression type (gshort).
+ */
+#define COMPRESS_ZSTD_DICT_TYPE (256)
+#define COMPRESS_DICT_MAX_ID (G_MAXINT16 - COMPRESS_ZSTD_DICT_TYPE)
+
+/**
+ * @def IS_COMPRESS_DICT_TYPE
+ * TRUE when cmptype is zstd compression with a dictionary.
+ *
+ * @def COMPRESS_DICT_ID
+ * Id of the dictionary used by a COMPRESS_ZSTD_DICT_TYPE compression type.
+ */
+#define IS_COMPRESS_DICT_TYPE(cmptype) ((cmptype) > COMPRESS_ZSTD_DICT_TYPE && (cmptype) <= G_MAXINT16)
+#define COMPRESS_DICT_ID(cmptype) ((guint) ((cmptype) - COMPRESS_ZSTD_DICT_TYPE))
+
+/**
+ * @def COMPRESS_DEFAULT_LEVEL
+ * Compression level that selects the default level of each compression
+ * type (9 for zlib and ZSTD_CLEVEL_DEFAULT for zstd). lz4 has no level.
+ */
+#define COMPRESS_DEFAULT_LEVEL (0)
+
+/**
+ * @def COMPRESS_ENTROPY_SAMPLE
+ * Maximum number of bytes of a buffer looked at to guess whether it is
+ * worth compressing it.
+ */
+#define COMPRESS_ENTROPY_SAMPLE (4096)
+
 
 /**
  * @struct compress_t
@@ -54,6 +102,17 @@ typedef struct
 } compress_t;
 
 
+/**
+ * @struct compress_dict_t
+ * @brief A trained zstd dictionary ready to compress and uncompress.
+ */
+typedef struct
+{
+    ZSTD_CDict *cdict;  /* Dictionary digested for compression   */
+    ZSTD_DDict *ddict;  /* Dictionary digested for decompression */
+} compress_dict_t;
+
+
 /**
  * Inits compress_t structure with default values.
  */
@@ -68,6 +127,76 @@ extern compress_t *init_compress_t(void);
 extern void free_compress_t(compress_t *comp);
 
 
+/**
+ * Sets the compression level used by compress_buffer() from now on.
+ * @param level is the level to use (COMPRESS_DEFAULT_LEVEL selects the
+ *        default level of each compression type). It is bounded to the
+ *        levels that each compression type allows.
+ */
+extern void set_compression_level(gint level);
+
+
+/**
+ * Guesses whether compressing a buffer may save some space: data that
+ * is already compressed (or encrypted) has its bytes evenly spread over
+ * the 256 possible values. Only a sample of the buffer is looked at.
+ * @param buffer is the buffer to be compressed.
+ * @param size is the size of the buffer.
+ * @returns FALSE if the buffer looks like random data and TRUE otherwise.
+ */
+extern gboolean is_worth_compressing(guchar *buffer, guint size);
+
+
+/**
+ * Registers a trained dictionary. Dictionaries are kept until the end of
+ * the program. Thread safe.
+ * @param id is the id (version) of the dictionary (1 to
+ *        COMPRESS_DICT_MAX_ID).
+ * @param data is the dictionary as made by train_compress_dictionary()
+ *        (it is copied).
+ * @param len is the length of data.
+ * @returns TRUE if the dictionary is registered (or already was) and
+ *          FALSE otherwise.
+ */
+extern gboolean add_compress_dictionary(guint id, guchar *data, gsize len);
+
+
+/**
+ * @param id is the id of a dictionary.
+ * @returns TRUE if the dictionary id is registered.
+ */
+extern gboolean has_compress_dictionary(guint id);
+
+
+/**
+ * Selects the dictionary used when compressing with zstd from now on.
+ * @param id is the id of a registered dictionary or 0 to compress
+ *        without any dictionary.
+ */
+extern void use_compress_dictionary(guint id);
+
+
+/**
+ * @param cmptype is the compression type asked for.
+ * @returns the compression type to use for cmptype: zstd with the
+ *          selected dictionary (if any) instead of COMPRESS_ZSTD_TYPE.
+ */
+extern gshort get_compress_type_to_use(gshort cmptype);
+
+
+/**
+ * Trains a zstd dictionary from samples of blocks.
+ * @param samples is the concatenation of every sample.
+ * @param sizes is the size of each sample in samples.
+ * @param nb_samples is the number of samples.
+ * @param capacity is the maximum size of the dictionary.
+ * @param len is filled with the size of the dictionary.
+ * @returns a newly allocated dictionary or NULL if it could not be
+ *          trained (too few samples for instance).
+ */
+extern guchar *train_compress_dictionary(guchar *samples, gsize *sizes, guint nb_samples, gsize capacity, gsize *len);
+
+
 /**
  * Compress buffer and returns a compressed text
  * @param buffer is the plain buffer text to be compressed
@@ -84,9 +213,11 @@ extern compress_t *compress_buffer(guchar *buffer, guint size, gint type);
  * @param buffer is the compressed buffer to be uncompressed
  * @param cmplen is the len of the above compressed buffer
  * @param textlen is the len of the uncompressed data
- * @param type is the compression type to use (COMPRESS_ZLIB_TYPE).
- * @returns a compress_t structure containing a compressed text
- *          buffer.
+ * @param type is the compression type to use (COMPRESS_ZLIB_TYPE,
+ *        COMPRESS_ZSTD_TYPE, COMPRESS_LZ4_TYPE or a zstd dictionary type
+ *        whose dictionary has to be registered).
+ * @returns a compress_t structure containing the uncompressed text or
+ *          NULL on error (buffer is never freed).
  */
 extern compress_t *uncompress_buffer(guchar *buffer, guint64 cmplen, guint64 textlen, gint type);
 
@@ -55,6 +55,10 @@
   * Defines the group name for all preferences related to server's
   * backend named file_backend that stores everything into flat files.
   *
+  * @def GN_MEMORY_BACKEND
+  * Defines the group name for all preferences related to server's
+  * backend named memory_backend that keeps everything in memory.
+  *
   * @def GN_VERSION
   * Defines the group name that will keep version information for
   * the database in the client's cache directory (for now).
@@ -64,6 +68,7 @@
 #define GN_ALL ("All")
 #define GN_FILE_BACKEND ("File_Backend")
 #define GN_MINIO_BACKEND ("Minio_Backend")
+#define GN_MEMORY_BACKEND ("Memory_Backend")
 #define GN_VERSION ("Version")
 
 
@@ -146,10 +151,20 @@
  * found in libcdpfgl/compress.h :
  * . 0  COMPRESS_NONE_TYPE (no compression at all
  * . 1  COMPRESS_ZLIB_TYPE (zlib compression)
+ * . 2  COMPRESS_ZSTD_TYPE (zstd compression)
+ * . 3  COMPRESS_LZ4_TYPE  (lz4 compression)
  */
 #define KN_COMPRESSION_TYPE ("compression-type")
 
 
+/**
+ * @def KN_COMPRESSION_LEVEL
+ * Defines the compression level to use (0 selects the default level of
+ * the compression type).
+ */
+#define KN_COMPRESSION_LEVEL ("compression-level")
+
+
 /**
  * @def KN_SERVER_IP
  * Defines server's IP address for the client.
@@ -170,6 +185,38 @@
 #define KN_SERVER_METABACKEND ("server-backend-meta")
 #define KN_SERVER_DATABACKEND ("server-backend-data")
 
+
+/**
+ * @def KN_HASH_FILTER_BITS
+ * Defines the size in bits of the filter of stored hashs that clients
+ * may download. 0 disables the filter.
+ */
+#define KN_HASH_FILTER_BITS ("hash-filter-bits")
+
+
+/**
+ * @def KN_BLOCK_CACHE_SIZE
+ * Defines the size in bytes of the cache of recently retrieved blocks of
+ * data. 0 disables the cache.
+ */
+#define KN_BLOCK_CACHE_SIZE ("block-cache-size")
+
+
+/**
+ * @def KN_DICTIONARY_SIZE
+ * Defines the maximum size in bytes of the zstd dictionaries trained by
+ * the server from the stored blocks. 0 disables dictionaries.
+ */
+#define KN_DICTIONARY_SIZE ("dictionary-size")
+
+
+/**
+ * @def KN_DICTIONARY_DIR
+ * Defines the directory where the server keeps every version of its
+ * dictionaries.
+ */
+#define KN_DICTIONARY_DIR ("dictionary-dir")
+
 /** Below you'll find some definitions for the server's backends */
 /**
  * @def KN_FILE_DIRECTORY
@@ -187,6 +234,22 @@
 #define KN_DIR_LEVEL ("dir-level")
 
 
+/**
+ * @def KN_MEMORY_MAX_SIZE
+ * Defines the maximum number of bytes used by blocks stored by
+ * memory_backend (0 means no limit).
+ */
+#define KN_MEMORY_MAX_SIZE ("max-size")
+
+
+/**
+ * @def KN_MEMORY_EVICT
+ * Tells whether memory_backend evicts its oldest blocks (true) or
+ * rejects new ones (false) when max-size is reached.
+ */
+#define KN_MEMORY_EVICT ("evict")
+
+
 
 /** MongoDB Backend */
 /** Settings for log level */
@@ -271,6 +334,60 @@
  */
 #define KN_MINIO_ADD_MISSING_BUCKET "add-missing-bucket"
 
+/**
+ * @def KN_MINIO_UPLOAD_CONTEXTS
+ * Number of threads uploading objects, each one with its own libs3
+ * request context
+ */
+#define KN_MINIO_UPLOAD_CONTEXTS "upload-contexts"
+
+/**
+ * @def KN_MINIO_MAX_IN_FLIGHT
+ * Maximum number of uploads queued or running at once. Storing a block
+ * waits when this number is reached
+ */
+#define KN_MINIO_MAX_IN_FLIGHT "max-in-flight"
+
+/**
+ * @def KN_MINIO_INDEX_FILE
+ * Local file where the index of the blocks stored in the data bucket is
+ * saved
+ */
+#define KN_MINIO_INDEX_FILE "index-file"
+
+/**
+ * @def KN_MINIO_PACK_SIZE
+ * Size (in megabytes) of the pack objects gathering small blocks. 0
+ * stores each block in its own object
+ */
+#define KN_MINIO_PACK_SIZE "pack-size"
+
+/**
+ * @def KN_MINIO_PACK_STAGING_DIR
+ * Local directory where packs are staged until they are uploaded
+ */
+#define KN_MINIO_PACK_STAGING_DIR "pack-staging-dir"
+
+/**
+ * @def KN_MINIO_PACK_INDEX_FILE
+ * Local file where the index of the blocks stored in packs is saved
+ */
+#define KN_MINIO_PACK_INDEX_FILE "pack-index-file"
+
+/**
+ * @def KN_MINIO_PACK_FLUSH_INTERVAL
+ * Number of seconds after which a pack that is not full is uploaded
+ * anyway
+ */
+#define KN_MINIO_PACK_FLUSH_INTERVAL "pack-flush-interval"
+
+/**
+ * @def KN_MINIO_SPOOL_DIR
+ * Local directory where blocks whose upload failed are kept until they
+ * are uploaded again
+ */
+#define KN_MINIO_SPOOL_DIR "spool-dir"
+
 
 /** Below you'll find some definitions for the version cache file */
 /**
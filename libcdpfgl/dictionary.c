@@ -0,0 +1,160 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    dictionary.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file dictionary.c
+ *
+ * This file contains the functions to exchange the zstd dictionaries
+ * trained by the server.
+ */
+
+#include "libcdpfgl.h"
+
+
+/**
+ * Makes the json answer that transports a dictionary.
+ * @param id is the id of the dictionary.
+ * @param latest is the id of the latest dictionary of the server.
+ * @param data is the dictionary itself.
+ * @param len is the length of data.
+ * @returns a newly allocated json string with "id", "latest" and
+ *          "dictionary" (base64 encoded) keys.
+ */
+gchar *convert_dictionary_to_json_string(guint id, guint latest, guchar *data, gsize len)
+{
+    json_t *root = NULL;
+    gchar *encoded = NULL;
+    gchar *json_str = NULL;
+
+    root = json_object();
+    encoded = g_base64_encode(data, len);
+
+    insert_integer_value_into_json_root(root, "id", id);
+    insert_integer_value_into_json_root(root, "latest", latest);
+    insert_string_into_json_root(root, "dictionary", encoded);
+
+    json_str = json_dumps(root, 0);
+
+    json_decref(root);
+    free_variable(encoded);
+
+    return json_str;
+}
+
+
+/**
+ * Gets a dictionary from the server and registers it (see
+ * add_compress_dictionary()).
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL)
+ * @param id is the id of the dictionary to get (0 for the latest one).
+ * @param latest is filled with the id of the latest dictionary of the
+ *        server (may be NULL).
+ * @returns the id of the registered dictionary or 0 if the server has
+ *          no such dictionary (or does not know about dictionaries).
+ */
+guint get_dictionary_from_server(comm_t *comm, guint id, guint *latest)
+{
+    gchar *url = NULL;
+    json_t *root = NULL;
+    guchar *data = NULL;
+    gsize len = 0;
+    guint got = 0;
+    gint success = CURLE_FAILED_INIT;
+
+    if (comm != NULL)
+        {
+            if (id > 0)
+                {
+                    url = g_strdup_printf("%s?id=%u", DICTIONARY_URL, id);
+                }
+            else
+                {
+                    url = g_strdup(DICTIONARY_URL);
+                }
+
+            success = get_url(comm, url, NULL);
+
+            if (success == CURLE_OK && comm->buffer != NULL)
+                {
+                    root = load_json(comm->buffer);
+                }
+
+            /* An error answer (no dictionary on the server side) does not have any id */
+            if (root != NULL && json_is_integer(json_object_get(root, "id")) && json_is_string(json_object_get(root, "dictionary")))
+                {
+                    got = (guint) json_integer_value(json_object_get(root, "id"));
+                    data = g_base64_decode(json_string_value(json_object_get(root, "dictionary")), &len);
+
+                    if ((id != 0 && got != id) || add_compress_dictionary(got, data, len) == FALSE)
+                        {
+                            got = 0;
+                        }
+
+                    if (latest != NULL)
+                        {
+                            *latest = (guint) json_integer_value(json_object_get(root, "latest"));
+                        }
+
+                    free_variable(data);
+                }
+
+            if (root != NULL)
+                {
+                    json_decref(root);
+                }
+
+            free_variable(comm->buffer);
+            comm->buffer = NULL;
+            free_variable(url);
+        }
+
+    return got;
+}
+
+
+/**
+ * Gets the dictionary a block was compressed with from the server when
+ * it is not registered yet. Only the dictionaries that are really needed
+ * are downloaded.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL). Its buffer is freed.
+ * @param cmptype is the compression type of the block.
+ * @returns TRUE if the block does not need any dictionary or if its
+ *          dictionary is registered and FALSE otherwise.
+ */
+gboolean get_block_dictionary_from_server(comm_t *comm, gshort cmptype)
+{
+    guint id = 0;
+    gboolean ok = TRUE;
+
+    if (IS_COMPRESS_DICT_TYPE(cmptype) == TRUE)
+        {
+            id = COMPRESS_DICT_ID(cmptype);
+
+            if (has_compress_dictionary(id) == FALSE)
+                {
+                    ok = (get_dictionary_from_server(comm, id, NULL) == id);
+                }
+        }
+
+    return ok;
+}
@@ -0,0 +1,80 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    dictionary.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file dictionary.h
+ *
+ * This file contains all the definitions needed to exchange the zstd
+ * dictionaries trained by the server. Each dictionary has an id (its
+ * version) that is part of the compression type of the blocks compressed
+ * with it (see COMPRESS_ZSTD_DICT_TYPE in compress.h).
+ */
+#ifndef _DICTIONARY_H_
+#define _DICTIONARY_H_
+
+/**
+ * @def DICTIONARY_URL
+ * Url where dictionaries may be downloaded from server. Argument "id"
+ * selects a version, the latest one being sent without it.
+ */
+#define DICTIONARY_URL ("/Dictionary.json")
+
+
+/**
+ * Makes the json answer that transports a dictionary.
+ * @param id is the id of the dictionary.
+ * @param latest is the id of the latest dictionary of the server.
+ * @param data is the dictionary itself.
+ * @param len is the length of data.
+ * @returns a newly allocated json string with "id", "latest" and
+ *          "dictionary" (base64 encoded) keys.
+ */
+extern gchar *convert_dictionary_to_json_string(guint id, guint latest, guchar *data, gsize len);
+
+
+/**
+ * Gets a dictionary from the server and registers it (see
+ * add_compress_dictionary()).
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL)
+ * @param id is the id of the dictionary to get (0 for the latest one).
+ * @param latest is filled with the id of the latest dictionary of the
+ *        server (may be NULL).
+ * @returns the id of the registered dictionary or 0 if the server has
+ *          no such dictionary (or does not know about dictionaries).
+ */
+extern guint get_dictionary_from_server(comm_t *comm, guint id, guint *latest);
+
+
+/**
+ * Gets the dictionary a block was compressed with from the server when
+ * it is not registered yet. Only the dictionaries that are really needed
+ * are downloaded.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL). Its buffer is freed.
+ * @param cmptype is the compression type of the block.
+ * @returns TRUE if the block does not need any dictionary or if its
+ *          dictionary is registered and FALSE otherwise.
+ */
+extern gboolean get_block_dictionary_from_server(comm_t *comm, gshort cmptype);
+
+
+#endif /* #ifndef _DICTIONARY_H_ */
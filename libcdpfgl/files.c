@@ -619,10 +619,12 @@ gboolean file_exists(gchar *filename)
  *        slightly modified
  * @param the_date is a string representing the last modification date
  *        of the file.
+ * @returns a newly allocated filename (in where) that does not exist.
  */
 gchar *get_unique_filename(gboolean all_versions, gchar *basename, gchar *where, gchar *newname, gchar *the_date)
 {
     gchar *filename = NULL;
+    gchar *name = NULL;       /** name tried (newname still belongs to the caller) */
     guint i = 0;
 
     i = 0;
@@ -631,21 +633,23 @@ gchar *get_unique_filename(gboolean all_versions, gchar *basename, gchar *where,
     while (file_exists(filename))
         {
             free_variable(filename);
-            free_variable(newname);
+            free_variable(name);
 
             if (all_versions == TRUE)
                 {
-                    newname = g_strdup_printf("%s-%d_%s", the_date, i, basename);
+                    name = g_strdup_printf("%s-%d_%s", the_date, i, basename);
                 }
             else
                 {
-                    newname = g_strdup_printf("%d-%s", i, basename);
+                    name = g_strdup_printf("%d-%s", i, basename);
                 }
 
-            filename = g_build_filename(where, newname, NULL);
+            filename = g_build_filename(where, name, NULL);
             i++;
         }
 
+    free_variable(name);
+
     return filename;
 }
 
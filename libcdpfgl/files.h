@@ -307,6 +307,7 @@ extern gboolean file_exists(gchar *filename);
  *        slightly modified
  * @param the_date is a string representing the last modification date
  *        of the file.
+ * @returns a newly allocated filename (in where) that does not exist.
  */
 extern gchar *get_unique_filename(gboolean all_versions, gchar *basename, gchar *where, gchar *newname, gchar *the_date);
 
@@ -28,6 +28,16 @@
 
 #include "libcdpfgl.h"
 
+/**
+ * Block sizes that cdpfglclient uses (adaptive mode and default one):
+ * the hashs of zero blocks of these sizes are calculated once (they are
+ * never freed).
+ */
+static const gsize zero_block_sizes[] = {512, 2048, 8192, 16384, 65536, 131072, 262144};
+static guint8 *zero_block_hashs[G_N_ELEMENTS(zero_block_sizes)];
+static gsize zero_block_hashs_ready = 0;
+
+
 /**
  * Comparison function used to compare two hashs (binary form) mainly
  * used to sort hashs properly.
@@ -236,7 +246,10 @@ void free_hdt_struct(gpointer data)
 
 
 /**
- * Inits and returns a newly hash_data_t structure.
+ * Inits and returns a newly hash_data_t structure. data is compressed
+ * with cmptype unless it looks already compressed or compressing it does
+ * not make it smaller: it is then kept as is with COMPRESS_NONE_TYPE.
+ * When hash_data->data is not data, data has to be freed by the caller.
  * @returns a newly hash_data_t structure.
  */
 hash_data_t *new_hash_data_t(guchar *data, gssize size_read, guint8 *hash, gshort cmptype)
@@ -247,9 +260,14 @@ hash_data_t *new_hash_data_t(guchar *data, gssize size_read, guint8 *hash, gshor
     hash_data = (hash_data_t *) g_malloc(sizeof(hash_data_t));
     g_assert_nonnull(hash_data);
 
-    if (cmptype != COMPRESS_NONE_TYPE && data != NULL)
+    if (cmptype != COMPRESS_NONE_TYPE && data != NULL && is_worth_compressing(data, size_read))
         {
+            cmptype = get_compress_type_to_use(cmptype);
             compress = compress_buffer(data, size_read, (gint) cmptype);
+        }
+
+    if (compress != NULL && compress->text != NULL && compress->len < (guint64) size_read)
+        {
             hash_data->data = compress->text;
             hash_data->read = compress->len;
             hash_data->uncmplen = size_read;
@@ -258,9 +276,11 @@ hash_data_t *new_hash_data_t(guchar *data, gssize size_read, guint8 *hash, gshor
         }
     else
         {
+            free_compress_t(compress);
             hash_data->data = data;
             hash_data->read = size_read;
             hash_data->uncmplen = size_read;
+            cmptype = COMPRESS_NONE_TYPE;
         }
 
     hash_data->hash = hash;
@@ -578,3 +598,93 @@ guint8 *calculate_hash_for_string(guchar *buffer, guint size)
 
     return a_hash;
 }
+
+
+/**
+ * Tells whether a buffer contains only zeros. The first bytes are
+ * checked one by one to stop early on usual data and the buffer is then
+ * compared with itself shifted by one byte (memcmp() is vectorized by
+ * the C library).
+ * @param buffer is the buffer to be checked.
+ * @param len is the number of bytes of buffer.
+ * @returns TRUE if every byte of buffer is 0 and FALSE otherwise.
+ */
+gboolean is_zero_block(guchar *buffer, gsize len)
+{
+    gsize i = 0;
+
+    if (buffer == NULL || len == 0)
+        {
+            return FALSE;
+        }
+
+    while (i < len && i < 16)
+        {
+            if (buffer[i] != 0)
+                {
+                    return FALSE;
+                }
+
+            i = i + 1;
+        }
+
+    return (len <= 16 || memcmp(buffer, buffer + 1, len - 1) == 0);
+}
+
+
+/**
+ * Gets the hash of a block of len bytes that are all zeros when len is
+ * one of the block sizes of cdpfglclient. The hashs of every such size
+ * are calculated at the first call and then only read.
+ * @param len is the length of the zero block.
+ * @returns the hash (guint8 *) of a block of len zeros that MUST NOT be
+ *          freed or NULL when len is not a block size of cdpfglclient
+ *          (the tail of a file for instance).
+ */
+guint8 *get_zero_block_hash(gsize len)
+{
+    guchar *zeros = NULL;
+    guint i = 0;
+
+    if (g_once_init_enter(&zero_block_hashs_ready))
+        {
+            zeros = (guchar *) g_malloc0(zero_block_sizes[G_N_ELEMENTS(zero_block_sizes) - 1]);
+
+            for (i = 0; i < G_N_ELEMENTS(zero_block_sizes); i++)
+                {
+                    zero_block_hashs[i] = calculate_hash_for_string(zeros, zero_block_sizes[i]);
+                }
+
+            free_variable(zeros);
+            g_once_init_leave(&zero_block_hashs_ready, 1);
+        }
+
+    for (i = 0; i < G_N_ELEMENTS(zero_block_sizes); i++)
+        {
+            if (zero_block_sizes[i] == len)
+                {
+                    return zero_block_hashs[i];
+                }
+        }
+
+    return NULL;
+}
+
+
+/**
+ * Tells whether a hash is the one of a block of len bytes that are all
+ * zeros, len being one of the block sizes of cdpfglclient (see
+ * get_zero_block_hash()).
+ * @param a_hash is the hash to be checked.
+ * @param len is the length of the block whose hash is a_hash.
+ * @returns TRUE if a_hash is the hash of len zeros and FALSE otherwise
+ *          (always when len is not a block size of cdpfglclient).
+ */
+gboolean is_zero_block_hash(guint8 *a_hash, gsize len)
+{
+    guint8 *zero_hash = NULL;
+
+    zero_hash = get_zero_block_hash(len);
+
+    return (a_hash != NULL && zero_hash != NULL && memcmp(a_hash, zero_hash, HASH_LEN) == 0);
+}
@@ -106,7 +106,9 @@ extern void free_hdt_struct(gpointer data);
 
 /**
  * Inits and returns a newly hash_data_t structure. (and compresses data if cmptype is
- * a compression type such as COMPRESS_ZLIB_TYPE.
+ * a compression type such as COMPRESS_ZLIB_TYPE and if it makes data smaller, data
+ * being kept as is with COMPRESS_NONE_TYPE otherwise).
+ * When hash_data->data is not data, data has to be freed by the caller.
  * @returns a newly created hash_data_t structure.
  */
 extern hash_data_t *new_hash_data_t(guchar * data, gssize read, guint8 *hash, gshort cmptype);
@@ -211,4 +213,40 @@ extern gchar *convert_max_hashs_from_hash_list_to_gchar(hash_extract_t *hash_ext
  */
 extern guint8 *calculate_hash_for_string(guchar *buffer, guint size);
 
+
+/**
+ * Tells whether a buffer contains only zeros. The first bytes are
+ * checked one by one to stop early on usual data and the buffer is then
+ * compared with itself shifted by one byte (memcmp() is vectorized by
+ * the C library).
+ * @param buffer is the buffer to be checked.
+ * @param len is the number of bytes of buffer.
+ * @returns TRUE if every byte of buffer is 0 and FALSE otherwise.
+ */
+extern gboolean is_zero_block(guchar *buffer, gsize len);
+
+
+/**
+ * Gets the hash of a block of len bytes that are all zeros when len is
+ * one of the block sizes of cdpfglclient. The hashs of every such size
+ * are calculated at the first call and then only read.
+ * @param len is the length of the zero block.
+ * @returns the hash (guint8 *) of a block of len zeros that MUST NOT be
+ *          freed or NULL when len is not a block size of cdpfglclient
+ *          (the tail of a file for instance).
+ */
+extern guint8 *get_zero_block_hash(gsize len);
+
+
+/**
+ * Tells whether a hash is the one of a block of len bytes that are all
+ * zeros, len being one of the block sizes of cdpfglclient (see
+ * get_zero_block_hash()).
+ * @param a_hash is the hash to be checked.
+ * @param len is the length of the block whose hash is a_hash.
+ * @returns TRUE if a_hash is the hash of len zeros and FALSE otherwise
+ *          (always when len is not a block size of cdpfglclient).
+ */
+extern gboolean is_zero_block_hash(guint8 *a_hash, gsize len);
+
 #endif /* #ifndef _HASHS_H_ */
@@ -164,7 +164,7 @@ gchar *buffer_libraries_versions(gchar *name)
                     free_variable(buffer);
                 }
 
-            buffer = g_strdup_printf(_("%s\t. %s version: %s\n\t. JANSSON version: %d.%d.%d\n\t. ZLIB version: %s"), buf1, DATABASE_NAME, db_version(), JANSSON_MAJOR_VERSION, JANSSON_MINOR_VERSION, JANSSON_MICRO_VERSION, ZLIB_VERSION);
+            buffer = g_strdup_printf(_("%s\t. %s version: %s\n\t. JANSSON version: %d.%d.%d\n\t. ZLIB version: %s\n\t. ZSTD version: %s\n\t. LZ4 version: %s"), buf1, DATABASE_NAME, db_version(), JANSSON_MAJOR_VERSION, JANSSON_MINOR_VERSION, JANSSON_MICRO_VERSION, ZLIB_VERSION, ZSTD_versionString(), LZ4_versionString());
             free_variable(buf1);
         }
 
@@ -53,6 +53,9 @@
 #include <curl/curl.h>
 #include <ctype.h>
 #include <zlib.h>
+#include <zstd.h>
+#include <zdict.h>
+#include <lz4.h>
 
 #include "configuration.h"
 #include "files.h"
@@ -61,8 +64,11 @@
 #include "database.h"
 #include "packing.h"
 #include "query.h"
+#include "trace.h"
 #include "clock.h"
 #include "compress.h"
+#include "bloom.h"
+#include "dictionary.h"
 #include "options.h"
 
 /**
@@ -532,6 +532,16 @@ gchar *convert_version_to_json(gchar *name, gchar *date, gchar *version, gchar *
     json_array_append_new(libs, objs);
     free_variable(buffer);
 
+    /* zstd */
+    objs = json_object();
+    json_object_set_new(objs, "zstd", json_string(ZSTD_versionString()));
+    json_array_append_new(libs, objs);
+
+    /* lz4 */
+    objs = json_object();
+    json_object_set_new(objs, "lz4", json_string(LZ4_versionString()));
+    json_array_append_new(libs, objs);
+
     insert_json_value_into_json_root(root, "librairies", libs);
 
     json_str = json_dumps(root, 0);
@@ -59,7 +59,11 @@ query_t *init_query_t(gchar *hostname, gchar *uid, gchar *gid, gchar *owner, gch
     query->date = date;
     query->afterdate = afterdate;
     query->beforedate = beforedate;
+    query->asof = NULL;
     query->latest = latest;
+    query->cursor = NULL;
+    query->limit = 0;
+    query->without_hashs = FALSE;
 
     return query;
 }
@@ -83,6 +87,8 @@ void free_query_t(query_t *query)
             free_variable(query->date);
             free_variable(query->afterdate);
             free_variable(query->beforedate);
+            free_variable(query->asof);
+            free_variable(query->cursor);
             free_variable(query);
         }
 }
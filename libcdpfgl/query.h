@@ -43,7 +43,11 @@ typedef struct
     gchar *date;
     gchar *afterdate;
     gchar *beforedate;
+    gchar *asof;        /**< asof: date at which we want to see the tree of files as it was (versions valid at that time) */
     gboolean latest;    /**< latest: True if we only want to get the latest entries found */
+    gchar *cursor;      /**< cursor: opaque position (given by the server) after which the listing goes on */
+    guint64 limit;      /**< limit: maximum number of entries wanted (0 means no limit) */
+    gboolean without_hashs; /**< without_hashs: True if hash lists are not wanted (names only) */
 } query_t;
 
 
@@ -0,0 +1,395 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    trace.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file trace.c
+ * This file contains the functions to trace the time spent in each stage
+ * of the programs. Each thread records its events into its own ring
+ * (trace_ring_t) without taking any lock. A background thread (the
+ * flusher) periodically moves events from every ring to the trace file.
+ * Tracing should never make the programs fail: errors only stop it.
+ */
+
+#include "libcdpfgl.h"
+
+static void release_trace_ring(gpointer data);
+static trace_ring_t *get_trace_ring(void);
+static void append_json_string(GString *buffer, const gchar *string);
+static void append_trace_event(GString *buffer, trace_event_t *event, guint tid);
+static void drain_trace_rings(GString *buffer);
+static gpointer trace_flusher_thread(gpointer data);
+
+static GMutex trace_mutex;                  /** Protects everything below except rings' content  */
+static GCond trace_cond;                    /** Wakes the flusher up when tracing is terminated  */
+static GPtrArray *trace_rings = NULL;       /** Every ring (trace_ring_t *) ever used            */
+static GFileOutputStream *trace_stream = NULL;
+static GThread *trace_flusher = NULL;
+static gboolean trace_running = FALSE;
+static gint trace_enabled = FALSE;
+static guint64 trace_prefix = 0;            /** Random upper bits of span ids of this program    */
+static gint trace_next_span = 0;
+static guint trace_next_tid = 0;
+static GPrivate trace_ring_key = G_PRIVATE_INIT(release_trace_ring);
+
+
+/**
+ * Called when a thread ends: its ring may be given to another thread once
+ * the flusher has written its remaining events.
+ * @param data is the trace_ring_t * ring of the thread.
+ */
+static void release_trace_ring(gpointer data)
+{
+    trace_ring_t *ring = (trace_ring_t *) data;
+
+    if (ring != NULL)
+        {
+            ring->current = 0;
+            g_atomic_int_set(&ring->in_use, FALSE);
+        }
+}
+
+
+/**
+ * Gets the ring of the calling thread. The first time, a ring that is no
+ * longer used is reused or a new one is allocated.
+ * @returns the trace_ring_t * ring of the calling thread.
+ */
+static trace_ring_t *get_trace_ring(void)
+{
+    trace_ring_t *ring = NULL;
+    trace_ring_t *unused = NULL;
+    guint i = 0;
+
+    ring = (trace_ring_t *) g_private_get(&trace_ring_key);
+
+    if (ring == NULL)
+        {
+            g_mutex_lock(&trace_mutex);
+
+            for (i = 0; ring == NULL && i < trace_rings->len; i++)
+                {
+                    unused = g_ptr_array_index(trace_rings, i);
+
+                    if (g_atomic_int_get(&unused->in_use) == FALSE && __atomic_load_n(&unused->head, __ATOMIC_ACQUIRE) == unused->tail)
+                        {
+                            ring = unused;
+                        }
+                }
+
+            if (ring == NULL)
+                {
+                    ring = (trace_ring_t *) g_malloc0(sizeof(trace_ring_t));
+                    g_ptr_array_add(trace_rings, ring);
+                }
+
+            trace_next_tid = trace_next_tid + 1;
+            ring->tid = trace_next_tid;
+            ring->current = 0;
+            g_atomic_int_set(&ring->in_use, TRUE);
+
+            g_mutex_unlock(&trace_mutex);
+
+            g_private_set(&trace_ring_key, ring);
+        }
+
+    return ring;
+}
+
+
+/**
+ * Starts tracing: events are written by a background thread to filename
+ * in Chrome's trace event format (a json array that can be loaded into
+ * chrome://tracing or Perfetto).
+ * @param filename is the name of the file where to write events. If NULL
+ *        tracing is not started.
+ */
+void init_trace(gchar *filename)
+{
+    GFile *file = NULL;
+    GError *error = NULL;
+
+    if (filename != NULL && is_trace_enabled() == FALSE)
+        {
+            file = g_file_new_for_path(filename);
+            trace_stream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+
+            /* The closing ']' is optional in Chrome's trace event format */
+            if (trace_stream != NULL && g_output_stream_write_all((GOutputStream *) trace_stream, "[\n", 2, NULL, NULL, &error) == TRUE)
+                {
+                    trace_prefix = ((guint64) g_random_int_range(1, G_MAXINT32)) << 32;
+                    trace_rings = g_ptr_array_new();
+                    trace_running = TRUE;
+                    trace_flusher = g_thread_new("trace", trace_flusher_thread, NULL);
+                    g_atomic_int_set(&trace_enabled, TRUE);
+                    print_debug(_("Tracing to %s\n"), filename);
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unable to open trace file %s: %s\n"), filename, error != NULL ? error->message : "");
+                    free_error(error);
+                    free_object(trace_stream);
+                    trace_stream = NULL;
+                }
+
+            free_object(file);
+        }
+}
+
+
+/**
+ * Stops tracing: stops the flusher thread once it has written every
+ * remaining event and closes the file.
+ */
+void terminate_trace(void)
+{
+    if (is_trace_enabled() == TRUE)
+        {
+            g_mutex_lock(&trace_mutex);
+            trace_running = FALSE;
+            g_cond_signal(&trace_cond);
+            g_mutex_unlock(&trace_mutex);
+
+            g_thread_join(trace_flusher);
+            trace_flusher = NULL;
+
+            g_atomic_int_set(&trace_enabled, FALSE);
+            g_output_stream_close((GOutputStream *) trace_stream, NULL, NULL);
+            free_object(trace_stream);
+            trace_stream = NULL;
+        }
+}
+
+
+/**
+ * @returns TRUE if tracing has been started, FALSE otherwise.
+ */
+gboolean is_trace_enabled(void)
+{
+    return g_atomic_int_get(&trace_enabled);
+}
+
+
+/**
+ * Gets a new span id. Ids are made unique between programs with a random
+ * prefix so that client's and server's spans can be linked.
+ * @returns a new span id that is never 0.
+ */
+guint64 new_trace_span_id(void)
+{
+    return trace_prefix | ((guint) g_atomic_int_add(&trace_next_span, 1) + 1);
+}
+
+
+/**
+ * @returns the span the calling thread is in or 0 if none or if tracing
+ *          is not enabled.
+ */
+guint64 get_trace_current_span(void)
+{
+    if (is_trace_enabled() == TRUE)
+        {
+            return get_trace_ring()->current;
+        }
+    else
+        {
+            return 0;
+        }
+}
+
+
+/**
+ * Sets the span the calling thread is in.
+ * @param span is the span id (0 for none).
+ */
+void set_trace_current_span(guint64 span)
+{
+    if (is_trace_enabled() == TRUE)
+        {
+            get_trace_ring()->current = span;
+        }
+}
+
+
+/**
+ * Records one event into the ring of the calling thread. This does not
+ * take any lock nor does any allocation (except the first time a thread
+ * records an event). The event is dropped if the ring is full.
+ * @param name is the name of the event.
+ * @param begin is the monotonic time (µs) at which the span began.
+ * @param duration is the duration of the span in µs.
+ * @param span is the id of the span.
+ * @param parent is the id of the parent span (0 if none).
+ */
+void add_trace_event(const gchar *name, gint64 begin, gint64 duration, guint64 span, guint64 parent)
+{
+    trace_ring_t *ring = NULL;
+    trace_event_t *event = NULL;
+    guint head = 0;
+
+    if (is_trace_enabled() == TRUE)
+        {
+            ring = get_trace_ring();
+            head = ring->head;
+
+            if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= TRACE_RING_SIZE)
+                {
+                    __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+                }
+            else
+                {
+                    event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+                    event->begin = begin;
+                    event->duration = duration;
+                    event->span = span;
+                    event->parent = parent;
+                    g_strlcpy(event->name, name != NULL ? name : "", TRACE_NAME_LEN);
+
+                    /* Publishes the event to the flusher */
+                    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+                }
+        }
+}
+
+
+/**
+ * Appends a string to buffer as a json string (with its quotes).
+ * @param buffer is the GString where to append the string.
+ * @param string is the string to be appended.
+ */
+static void append_json_string(GString *buffer, const gchar *string)
+{
+    const gchar *c = NULL;
+
+    g_string_append_c(buffer, '"');
+
+    for (c = string; *c != '\0'; c++)
+        {
+            if (*c == '"' || *c == '\\')
+                {
+                    g_string_append_c(buffer, '\\');
+                    g_string_append_c(buffer, *c);
+                }
+            else if ((guchar) *c < 0x20)
+                {
+                    g_string_append_printf(buffer, "\\u%04x", (guchar) *c);
+                }
+            else
+                {
+                    g_string_append_c(buffer, *c);
+                }
+        }
+
+    g_string_append_c(buffer, '"');
+}
+
+
+/**
+ * Appends one event to buffer as a Chrome's trace "complete" event.
+ * @param buffer is the GString where to append the event.
+ * @param event is the event to be appended.
+ * @param tid is the thread number of the event.
+ */
+static void append_trace_event(GString *buffer, trace_event_t *event, guint tid)
+{
+    g_string_append(buffer, "{\"name\":");
+    append_json_string(buffer, event->name);
+    g_string_append_printf(buffer, ",\"ph\":\"X\",\"ts\":%"G_GINT64_FORMAT",\"dur\":%"G_GINT64_FORMAT",\"pid\":%d,\"tid\":%u,", event->begin, event->duration, getpid(), tid);
+    g_string_append_printf(buffer, "\"args\":{\"span\":\"%016"G_GINT64_MODIFIER"x\",\"parent\":\"%016"G_GINT64_MODIFIER"x\"}},\n", event->span, event->parent);
+}
+
+
+/**
+ * Moves every event from the rings to buffer. Must be called with
+ * trace_mutex locked.
+ * @param buffer is the GString where to append the events.
+ */
+static void drain_trace_rings(GString *buffer)
+{
+    trace_ring_t *ring = NULL;
+    guint head = 0;
+    guint tail = 0;
+    guint dropped = 0;
+    guint i = 0;
+
+    for (i = 0; i < trace_rings->len; i++)
+        {
+            ring = g_ptr_array_index(trace_rings, i);
+            head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+            for (tail = ring->tail; tail != head; tail++)
+                {
+                    append_trace_event(buffer, &ring->events[tail & (TRACE_RING_SIZE - 1)], ring->tid);
+                }
+
+            /* Gives the slots back to the thread */
+            __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+            dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+
+            if (dropped > 0)
+                {
+                    g_string_append_printf(buffer, "{\"name\":\"dropped events\",\"ph\":\"C\",\"ts\":%"G_GINT64_FORMAT",\"pid\":%d,\"tid\":%u,\"args\":{\"dropped\":%u}},\n", g_get_monotonic_time(), getpid(), ring->tid, dropped);
+                }
+        }
+}
+
+
+/**
+ * Thread that writes the events of every ring to the trace file each
+ * TRACE_FLUSH_INTERVAL µs and a last time when tracing is terminated.
+ * @param data is not used.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer trace_flusher_thread(gpointer data)
+{
+    GString *buffer = NULL;
+    GError *error = NULL;
+    gboolean running = TRUE;
+
+    buffer = g_string_sized_new(TRACE_RING_SIZE * 128);
+
+    while (running == TRUE)
+        {
+            g_mutex_lock(&trace_mutex);
+
+            if (trace_running == TRUE)
+                {
+                    g_cond_wait_until(&trace_cond, &trace_mutex, g_get_monotonic_time() + TRACE_FLUSH_INTERVAL);
+                }
+
+            running = trace_running;
+            drain_trace_rings(buffer);
+            g_mutex_unlock(&trace_mutex);
+
+            /* Writing without the lock so that new threads are never slowed down by the disk */
+            if (buffer->len > 0 && g_output_stream_write_all((GOutputStream *) trace_stream, buffer->str, buffer->len, NULL, NULL, &error) == FALSE)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unable to write to trace file: %s\n"), error->message);
+                    free_error(error);
+                }
+
+            g_string_truncate(buffer, 0);
+        }
+
+    g_string_free(buffer, TRUE);
+
+    return NULL;
+}
@@ -0,0 +1,153 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    trace.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file trace.h
+ *
+ * This file contains all the definitions needed to trace the time spent
+ * in each stage of the programs.
+ */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+
+/**
+ * @def TRACE_RING_SIZE
+ * Number of events that each thread may keep before the flusher writes
+ * them. Must be a power of two. Events are dropped when the ring is full.
+ */
+#define TRACE_RING_SIZE (1024)
+
+
+/**
+ * @def TRACE_NAME_LEN
+ * Maximum length (with the final '\0') of the name of an event. Longer
+ * names are truncated.
+ */
+#define TRACE_NAME_LEN (64)
+
+
+/**
+ * @def TRACE_FLUSH_INTERVAL
+ * Time (in µs) between two wakes of the flusher thread.
+ */
+#define TRACE_FLUSH_INTERVAL (G_USEC_PER_SEC)
+
+
+/**
+ * @def TRACE_SPAN_HEADER
+ * HTTP header used by the client to tell the server the span of the stage
+ * that sends a request.
+ */
+#define TRACE_SPAN_HEADER ("X-Trace-Span")
+
+
+/**
+ * @struct trace_event_t
+ * @brief One measured span.
+ */
+typedef struct
+{
+    gint64 begin;                /**< monotonic time (µs) at which the span began */
+    gint64 duration;             /**< duration of the span in µs                  */
+    guint64 span;                /**< id of the span                              */
+    guint64 parent;              /**< id of the parent span (0 if none)           */
+    gchar name[TRACE_NAME_LEN];  /**< name of the span (may be truncated)         */
+} trace_event_t;
+
+
+/**
+ * @struct trace_ring_t
+ * @brief Ring of events of one thread. Only the thread writes events and
+ *        moves head, only the flusher reads events and moves tail: no
+ *        lock is needed.
+ */
+typedef struct
+{
+    trace_event_t events[TRACE_RING_SIZE];  /**< events waiting to be written                  */
+    guint head;                             /**< number of events written by the thread        */
+    guint tail;                             /**< number of events read by the flusher          */
+    guint dropped;                          /**< events dropped because the ring was full      */
+    guint tid;                              /**< thread number used in the trace file          */
+    gint in_use;                            /**< FALSE when the thread has ended               */
+    guint64 current;                        /**< span the thread is in (0 if none)             */
+} trace_ring_t;
+
+
+/**
+ * Starts tracing: events are written by a background thread to filename
+ * in Chrome's trace event format (a json array that can be loaded into
+ * chrome://tracing or Perfetto).
+ * @param filename is the name of the file where to write events. If NULL
+ *        tracing is not started.
+ */
+extern void init_trace(gchar *filename);
+
+
+/**
+ * Stops tracing: stops the flusher thread once it has written every
+ * remaining event and closes the file.
+ */
+extern void terminate_trace(void);
+
+
+/**
+ * @returns TRUE if tracing has been started, FALSE otherwise.
+ */
+extern gboolean is_trace_enabled(void);
+
+
+/**
+ * Gets a new span id. Ids are made unique between programs with a random
+ * prefix so that client's and server's spans can be linked.
+ * @returns a new span id that is never 0.
+ */
+extern guint64 new_trace_span_id(void);
+
+
+/**
+ * @returns the span the calling thread is in or 0 if none or if tracing
+ *          is not enabled.
+ */
+extern guint64 get_trace_current_span(void);
+
+
+/**
+ * Sets the span the calling thread is in.
+ * @param span is the span id (0 for none).
+ */
+extern void set_trace_current_span(guint64 span);
+
+
+/**
+ * Records one event into the ring of the calling thread. This does not
+ * take any lock nor does any allocation (except the first time a thread
+ * records an event). The event is dropped if the ring is full.
+ * @param name is the name of the event.
+ * @param begin is the monotonic time (µs) at which the span began.
+ * @param duration is the duration of the span in µs.
+ * @param span is the id of the span.
+ * @param parent is the id of the parent span (0 if none).
+ */
+extern void add_trace_event(const gchar *name, gint64 begin, gint64 duration, guint64 span, guint64 parent);
+
+
+#endif /* #ifndef _TRACE_H_ */
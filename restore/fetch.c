@@ -0,0 +1,704 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    fetch.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file restore/fetch.c
+ *
+ * This file contains the functions that get the blocks of a file from
+ * cdpfglserver. Big batches of hashs are sent in POST bodies (the
+ * X-Get-Hash-Array header is size limited), several of them at the same
+ * time over different connections, and received blocks are written with
+ * pwrite() at their offset in the file.
+ */
+
+#include "restore.h"
+
+static gchar *make_batch_request_body(GList *hash_list, guint nb_hashs, guint *nb_asked);
+static gboolean uncompress_block(comm_t *comm, hash_data_t *hash_data);
+static guint64 get_batch_size(GList *blocks);
+static gboolean write_batch_at_offset(gint fd, GList *blocks, guint64 offset);
+static gboolean write_batch_at_offsets(gint fd, GList *blocks, GArray *offsets, guint first);
+static gboolean take_next_batch(fetch_t *fetch, guint *index);
+static gboolean reserve_place(fetch_t *fetch, guint index, GList *blocks, guint64 *offset);
+static void set_failed(fetch_t *fetch);
+static gpointer fetch_worker(gpointer data);
+static gboolean fetch_hash_list_in_parallel(comm_t *comm, gint fd, GList *hash_list, GArray *offsets);
+static void write_hash_data_to_stream(comm_t *comm, GFileOutputStream *stream, hash_data_t *hash_data);
+static void write_answer_to_stream(comm_t *comm, GFileOutputStream *stream, gchar *buffer);
+static void get_hash_list_one_batch_at_a_time(comm_t *comm, GFileOutputStream *stream, GList *hash_list, gint max);
+
+
+/**
+ * Makes the json body of a POST /Data/Hash_Array.json request:
+ * {"hash_list":[...]} with nb_hashs base64 encoded hashs.
+ * @param hash_list is the link of the first hash of the batch.
+ * @param nb_hashs is the maximum number of hashs to put in the body.
+ * @param[out] nb_asked is the number of hashs put in the body (less than
+ *             nb_hashs for the last batch of a file).
+ * @returns a newly allocated json string that may be freed with
+ *          free_variable() when no longer needed.
+ */
+static gchar *make_batch_request_body(GList *hash_list, guint nb_hashs, guint *nb_asked)
+{
+    json_t *root = NULL;
+    json_t *array = NULL;
+    hash_data_t *hash_data = NULL;
+    gchar *encoded_hash = NULL;
+    gchar *body = NULL;
+    guint i = 0;
+
+    array = json_array();
+
+    while (hash_list != NULL && i < nb_hashs)
+        {
+            hash_data = hash_list->data;
+            encoded_hash = g_base64_encode(hash_data->hash, HASH_LEN);
+            append_string_to_array(array, encoded_hash);
+            free_variable(encoded_hash);
+
+            hash_list = g_list_next(hash_list);
+            i = i + 1;
+        }
+
+    *nb_asked = i;
+
+    root = json_object();
+    insert_json_value_into_json_root(root, "hash_list", array);
+    body = json_dumps(root, 0);
+    json_decref(root);
+
+    return body;
+}
+
+
+/**
+ * Uncompresses the data of a block (if needed) in place. The dictionary
+ * it was compressed with is asked to the server if it is not known yet.
+ * @param comm is the communication structure used to get the dictionary.
+ * @param hash_data is the block as sent by the server. When it is
+ *        compressed its data is replaced by the uncompressed one.
+ * @returns TRUE if the data of the block is now uncompressed and FALSE
+ *          on error.
+ */
+static gboolean uncompress_block(comm_t *comm, hash_data_t *hash_data)
+{
+    compress_t *compress = NULL;
+    gboolean ok = TRUE;
+
+    if (hash_data->cmptype != COMPRESS_NONE_TYPE)
+        {
+            get_block_dictionary_from_server(comm, hash_data->cmptype);
+            compress = uncompress_buffer(hash_data->data, hash_data->read, hash_data->uncmplen, hash_data->cmptype);
+
+            if (compress != NULL)
+                {
+                    free_variable(hash_data->data);
+                    hash_data->data = compress->text;
+                    hash_data->read = compress->len;
+                    hash_data->cmptype = COMPRESS_NONE_TYPE;
+
+                    /* text now belongs to hash_data */
+                    compress->text = NULL;
+                    free_compress_t(compress);
+                }
+            else
+                {
+                    ok = FALSE;
+                }
+        }
+
+    return ok;
+}
+
+
+/**
+ * Gets one batch of blocks from the server. Every block is checked
+ * against the hash that was asked for and uncompressed.
+ * @param comm is the communication structure of the calling thread.
+ * @param hash_list is the link of the first hash of the batch.
+ * @param nb_hashs is the maximum number of hashs of the batch.
+ * @returns the list of uncompressed blocks (hash_data_t *) in the order
+ *          of hash_list or NULL if any of them is missing or invalid.
+ */
+GList *fetch_batch_from_server(comm_t *comm, GList *hash_list, guint nb_hashs)
+{
+    json_t *root = NULL;
+    json_t *blocks = NULL;
+    json_t *value = NULL;
+    size_t index = 0;
+    hash_data_t *hash_data = NULL;
+    hash_data_t *asked = NULL;
+    GList *batch = NULL;
+    guint nb_asked = 0;
+    gboolean ok = FALSE;
+    gint res = CURLE_FAILED_INIT;
+
+    free_variable(comm->readbuffer);
+    comm->readbuffer = make_batch_request_body(hash_list, nb_hashs, &nb_asked);
+
+    res = post_url(comm, "/Data/Hash_Array.json?compressed=True");
+
+    if (res == CURLE_OK && comm->buffer != NULL)
+        {
+            root = load_json(comm->buffer);
+            free_variable(comm->buffer);
+            comm->buffer = NULL; /* This is a way to know that this variable has been freed */
+
+            blocks = get_json_value_from_json_root(root, "blocks");
+            ok = (blocks != NULL && json_array_size(blocks) == nb_asked);
+
+            json_array_foreach(blocks, index, value)
+                {
+                    if (ok == TRUE)
+                        {
+                            asked = hash_list->data;
+                            hash_data = convert_json_t_to_hash_data(value);
+
+                            ok = (hash_data != NULL && memcmp(hash_data->hash, asked->hash, HASH_LEN) == 0 && uncompress_block(comm, hash_data) == TRUE);
+
+                            if (hash_data != NULL)
+                                {
+                                    batch = g_list_prepend(batch, hash_data);
+                                }
+
+                            hash_list = g_list_next(hash_list);
+                        }
+                }
+
+            json_decref(root);
+        }
+
+    if (ok == FALSE)
+        {
+            g_list_free_full(batch, free_hdt_struct);
+            batch = NULL;
+        }
+
+    return g_list_reverse(batch);
+}
+
+
+/**
+ * @param blocks is a list of uncompressed blocks (hash_data_t *).
+ * @returns the number of bytes of all the blocks of the list.
+ */
+static guint64 get_batch_size(GList *blocks)
+{
+    hash_data_t *hash_data = NULL;
+    guint64 size = 0;
+
+    while (blocks != NULL)
+        {
+            hash_data = blocks->data;
+            size = size + hash_data->read;
+            blocks = g_list_next(blocks);
+        }
+
+    return size;
+}
+
+
+/**
+ * Writes len bytes of data in a file at offset with pwrite().
+ * @param fd is the file descriptor of the file being restored.
+ * @param data is the data to be written.
+ * @param len is the number of bytes of data.
+ * @param offset is the offset in the file where data goes.
+ * @returns TRUE if everything has been written and FALSE otherwise.
+ */
+gboolean fetch_write_at_offset(gint fd, guchar *data, gsize len, guint64 offset)
+{
+    ssize_t written = 0;
+    gboolean ok = TRUE;
+
+    while (len > 0 && ok == TRUE)
+        {
+            written = pwrite(fd, data, len, (off_t) offset);
+
+            if (written > 0)
+                {
+                    data = data + written;
+                    len = len - written;
+                    offset = offset + written;
+                }
+            else if (written == 0)
+                {
+                    /* nothing written without any error: retrying would loop forever */
+                    print_error(__FILE__, __LINE__, _("Error while writing restored data: no byte written\n"));
+                    ok = FALSE;
+                }
+            else if (errno != EINTR)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while writing restored data: %s\n"), g_strerror(errno));
+                    ok = FALSE;
+                }
+        }
+
+    return ok;
+}
+
+
+/**
+ * Writes a batch of blocks in the file, the first one at offset and the
+ * others right after it.
+ * @param fd is the file descriptor of the file being restored.
+ * @param blocks is the list of uncompressed blocks (hash_data_t *).
+ * @param offset is the offset in the file where the first block goes.
+ * @returns TRUE if everything has been written and FALSE otherwise.
+ */
+static gboolean write_batch_at_offset(gint fd, GList *blocks, guint64 offset)
+{
+    hash_data_t *hash_data = NULL;
+    gboolean ok = TRUE;
+
+    while (blocks != NULL && ok == TRUE)
+        {
+            hash_data = blocks->data;
+            ok = fetch_write_at_offset(fd, hash_data->data, hash_data->read, offset);
+            offset = offset + hash_data->read;
+            blocks = g_list_next(blocks);
+        }
+
+    return ok;
+}
+
+
+/**
+ * Writes a batch of blocks in the file, each one at its own offset.
+ * @param fd is the file descriptor of the file being restored.
+ * @param blocks is the list of uncompressed blocks (hash_data_t *).
+ * @param offsets is the array of the offsets (guint64) of every block
+ *        that is restored.
+ * @param first is the index in offsets of the first block of the batch.
+ * @returns TRUE if everything has been written and FALSE otherwise.
+ */
+static gboolean write_batch_at_offsets(gint fd, GList *blocks, GArray *offsets, guint first)
+{
+    hash_data_t *hash_data = NULL;
+    gboolean ok = TRUE;
+    guint i = first;
+
+    while (blocks != NULL && ok == TRUE)
+        {
+            hash_data = blocks->data;
+            ok = fetch_write_at_offset(fd, hash_data->data, hash_data->read, g_array_index(offsets, guint64, i));
+            i = i + 1;
+            blocks = g_list_next(blocks);
+        }
+
+    return ok;
+}
+
+
+/**
+ * Gives the next batch to be asked to the server to a worker.
+ * @param fetch is the state of the restoration.
+ * @param[out] index is the index of the batch to be asked.
+ * @returns FALSE when there is nothing more to do (every batch has been
+ *          taken or an error occurred) and TRUE otherwise.
+ */
+static gboolean take_next_batch(fetch_t *fetch, guint *index)
+{
+    gboolean taken = FALSE;
+
+    g_mutex_lock(&fetch->mutex);
+
+    if (fetch->failed == FALSE && fetch->next_batch < fetch->batches->len)
+        {
+            *index = fetch->next_batch;
+            fetch->next_batch = fetch->next_batch + 1;
+            taken = TRUE;
+        }
+
+    g_mutex_unlock(&fetch->mutex);
+
+    return taken;
+}
+
+
+/**
+ * Waits until every previous batch has reserved its place in the file
+ * and then reserves the place of this one. Batches are taken in order so
+ * the previous ones are all held by other workers and this wait ends.
+ * A batch that could not be received fails the restoration at once.
+ * @param fetch is the state of the restoration.
+ * @param index is the index of the batch.
+ * @param blocks is the batch received (NULL if it could not be received
+ *        in which case the whole restoration fails).
+ * @param[out] offset is the offset in the file where the batch begins.
+ * @returns TRUE if the batch has to be written and FALSE otherwise.
+ */
+static gboolean reserve_place(fetch_t *fetch, guint index, GList *blocks, guint64 *offset)
+{
+    gboolean reserved = FALSE;
+
+    g_mutex_lock(&fetch->mutex);
+
+    while (fetch->failed == FALSE && blocks != NULL && fetch->next_placed != index)
+        {
+            g_cond_wait(&fetch->cond, &fetch->mutex);
+        }
+
+    if (fetch->failed == FALSE && blocks != NULL)
+        {
+            *offset = fetch->offset;
+            fetch->offset = fetch->offset + get_batch_size(blocks);
+            fetch->next_placed = fetch->next_placed + 1;
+            reserved = TRUE;
+        }
+    else
+        {
+            fetch->failed = TRUE;
+        }
+
+    g_cond_broadcast(&fetch->cond);
+    g_mutex_unlock(&fetch->mutex);
+
+    return reserved;
+}
+
+
+/**
+ * Marks the restoration as failed and wakes up waiting workers.
+ * @param fetch is the state of the restoration.
+ */
+static void set_failed(fetch_t *fetch)
+{
+    g_mutex_lock(&fetch->mutex);
+    fetch->failed = TRUE;
+    g_cond_broadcast(&fetch->cond);
+    g_mutex_unlock(&fetch->mutex);
+}
+
+
+/**
+ * Worker thread: asks batches to the server with its own connection and
+ * writes them until there is no batch left.
+ * @param data is the fetch_t * state of the restoration.
+ * @returns NULL.
+ */
+static gpointer fetch_worker(gpointer data)
+{
+    fetch_t *fetch = (fetch_t *) data;
+    comm_t *comm = NULL;
+    GList *blocks = NULL;
+    guint index = 0;
+    guint64 offset = 0;
+
+    comm = init_comm_struct(fetch->conn, fetch->cmptype);
+
+    while (take_next_batch(fetch, &index) == TRUE)
+        {
+            blocks = fetch_batch_from_server(comm, g_ptr_array_index(fetch->batches, index), FETCH_BATCH_SIZE);
+
+            if (fetch->offsets != NULL)
+                {
+                    /* Offsets are already known: no need to wait for previous batches */
+                    if (blocks == NULL || write_batch_at_offsets(fetch->fd, blocks, fetch->offsets, index * FETCH_BATCH_SIZE) == FALSE)
+                        {
+                            set_failed(fetch);
+                        }
+                }
+            else if (reserve_place(fetch, index, blocks, &offset) == TRUE && write_batch_at_offset(fetch->fd, blocks, offset) == FALSE)
+                {
+                    set_failed(fetch);
+                }
+
+            g_list_free_full(blocks, free_hdt_struct);
+        }
+
+    free_comm_t(comm);
+
+    return NULL;
+}
+
+
+/**
+ * Writes the data of one block to the stream, uncompressing it first if
+ * needed.
+ * @param comm is the communication structure used to get the dictionary
+ *        the block was compressed with (if it is not known yet).
+ * @param stream is the stream where we are writing data (MUST be opened
+ *        and not NULL)
+ * @param hash_data is the block as sent by the server. It is freed here.
+ */
+static void write_hash_data_to_stream(comm_t *comm, GFileOutputStream *stream, hash_data_t *hash_data)
+{
+    compress_t *compress = NULL;
+    GError *error = NULL;
+
+    if (hash_data->cmptype == COMPRESS_NONE_TYPE)
+        {
+            g_output_stream_write((GOutputStream *) stream, hash_data->data, hash_data->read, NULL, &error);
+        }
+    else
+        {
+            get_block_dictionary_from_server(comm, hash_data->cmptype);
+            compress = uncompress_buffer(hash_data->data, hash_data->read, hash_data->uncmplen, hash_data->cmptype);
+
+            if (compress != NULL)
+                {
+                    g_output_stream_write((GOutputStream *) stream, compress->text, compress->len, NULL, &error);
+                    free_compress_t(compress);
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error while uncompressing one block.\n"));
+                }
+        }
+
+    free_error(error);
+    free_hash_data_t(hash_data);
+}
+
+
+/**
+ * Writes the data of an answer of /Data/Hash_Array.json url to the
+ * stream. The answer is either a "blocks" array with each block as
+ * stored by the server (compressed or not) or, with older servers, one
+ * uncompressed buffer.
+ * @param comm is the communication structure used to get dictionaries.
+ * @param stream is the stream where we are writing data (MUST be opened
+ *        and not NULL)
+ * @param buffer is the json answer of the server (not comm->buffer).
+ */
+static void write_answer_to_stream(comm_t *comm, GFileOutputStream *stream, gchar *buffer)
+{
+    json_t *root = NULL;
+    json_t *blocks = NULL;
+    json_t *value = NULL;
+    size_t index = 0;
+    hash_data_t *hash_data = NULL;
+
+    root = load_json(buffer);
+
+    if (root != NULL)
+        {
+            blocks = get_json_value_from_json_root(root, "blocks");
+
+            if (blocks != NULL)
+                {
+                    json_array_foreach(blocks, index, value)
+                        {
+                            hash_data = convert_json_t_to_hash_data(value);
+
+                            if (hash_data != NULL)
+                                {
+                                    write_hash_data_to_stream(comm, stream, hash_data);
+                                }
+                            else
+                                {
+                                    print_error(__FILE__, __LINE__, _("Error while trying to restore one block\n"));
+                                }
+                        }
+                }
+            else
+                {
+                    hash_data = convert_json_t_to_hash_data(root);
+
+                    if (hash_data != NULL)
+                        {
+                            write_hash_data_to_stream(comm, stream, hash_data);
+                        }
+                    else
+                        {
+                            print_error(__FILE__, __LINE__, _("Error while trying to restore blocks\n"));
+                        }
+                }
+
+            json_decref(root);
+        }
+}
+
+
+/**
+ * Writes data obtained from the server with the hash_list hashs
+ * to the stream. Blocks are asked as stored on the server and
+ * uncompressed here. Hashs are sent in the X-Get-Hash-Array header of
+ * GET requests, one after the other: this is what older servers know.
+ * @param comm is the communication structure to use.
+ * @param stream is the stream where we are writing data (MUST be opened
+ *        and not NULL)
+ * @param hash_list list of hashs of the file to be restored
+ * @param max is the maximum number of hashs to include into the header
+ * @todo error management.
+ */
+static void get_hash_list_one_batch_at_a_time(comm_t *comm, GFileOutputStream *stream, GList *hash_list, gint max)
+{
+    gchar *hash = NULL;
+    hash_extract_t *hash_extract = NULL;
+    gchar *request = NULL;
+    gchar *header = NULL;
+    gchar *buffer = NULL;
+    gint res = CURLE_FAILED_INIT;
+
+    if (stream != NULL)
+        {
+            hash_extract = new_hash_extract_t();
+            hash_extract->hash_list = hash_list;
+
+            while (hash_extract->hash_list != NULL)
+                {
+
+                    header = create_x_get_hash_array_http_header(hash_extract, max);
+                    request = g_strdup_printf("/Data/Hash_Array.json?compressed=True");
+                    print_debug(_("Query is: %s with header %s\n"), request, header);
+                    res = get_url(comm, request, header);
+
+                    if (res == CURLE_OK)
+                        {
+                            /** We need to save the retrieved buffer (comm may be used to get dictionaries meanwhile) */
+                            if (comm->buffer != NULL)
+                                {
+                                    buffer = comm->buffer;
+                                    comm->buffer = NULL; /* This is a way to know that this variable has been freed */
+                                    write_answer_to_stream(comm, stream, buffer);
+                                    free_variable(buffer);
+                                }
+                        }
+                    else
+                        {
+                            print_error(__FILE__, __LINE__, _("Error while getting hash %s"), hash);
+                        }
+
+                    free_variable(request);
+                    free_variable(header);
+                }
+        }
+}
+
+
+/**
+ * Gets every block of hash_list from the server and writes them in the
+ * file at their offset. Batches of FETCH_BATCH_SIZE hashs are sent in
+ * POST bodies to /Data/Hash_Array.json by up to FETCH_WORKERS threads,
+ * each one with its own connection.
+ * @param comm is the communication structure (its connexion string and
+ *        compression type are used to open the workers' connections).
+ * @param fd is the file descriptor of the file to be restored.
+ * @param hash_list is the list of hashs to be restored.
+ * @param offsets is NULL when hash_list is the whole file (blocks are
+ *        then written one after the other from the beginning of the
+ *        file) or the array of the offsets (guint64) of each block of
+ *        hash_list.
+ * @returns TRUE if every block has been written and FALSE otherwise (for
+ *          instance when the server does not know this request).
+ */
+static gboolean fetch_hash_list_in_parallel(comm_t *comm, gint fd, GList *hash_list, GArray *offsets)
+{
+    fetch_t fetch;
+    GThread *workers[FETCH_WORKERS];
+    guint nb_workers = 0;
+    guint i = 0;
+
+    fetch.conn = comm->conn;
+    fetch.cmptype = comm->cmptype;
+    fetch.fd = fd;
+    fetch.offsets = offsets;
+    fetch.batches = g_ptr_array_new();
+    fetch.next_batch = 0;
+    fetch.next_placed = 0;
+    fetch.offset = 0;
+    fetch.failed = FALSE;
+    g_mutex_init(&fetch.mutex);
+    g_cond_init(&fetch.cond);
+
+    for (i = 0; hash_list != NULL; i++, hash_list = g_list_next(hash_list))
+        {
+            if (i % FETCH_BATCH_SIZE == 0)
+                {
+                    g_ptr_array_add(fetch.batches, hash_list);
+                }
+        }
+
+    nb_workers = MIN(FETCH_WORKERS, fetch.batches->len);
+
+    if (nb_workers == 1)
+        {
+            /* Small files: no need for another thread */
+            fetch_worker(&fetch);
+        }
+    else
+        {
+            for (i = 0; i < nb_workers; i++)
+                {
+                    workers[i] = g_thread_new("fetch", fetch_worker, &fetch);
+                }
+
+            for (i = 0; i < nb_workers; i++)
+                {
+                    g_thread_join(workers[i]);
+                }
+        }
+
+    g_ptr_array_free(fetch.batches, TRUE);
+    g_mutex_clear(&fetch.mutex);
+    g_cond_clear(&fetch.cond);
+
+    return (fetch.failed == FALSE);
+}
+
+
+/**
+ * Gets every block of hash_list from the server and writes them in the
+ * file of the stream. Blocks are fetched in parallel (see
+ * fetch_hash_list_in_parallel) and, if that fails (older servers do not
+ * know POST /Data/Hash_Array.json), the file is emptied and restored
+ * again one batch after the other with GET requests.
+ * @param comm is the communication structure to use (only its connexion
+ *        string and compression type are used when fetching in parallel).
+ * @param stream is the stream of the file to be restored (MUST be opened,
+ *        empty and not NULL).
+ * @param hash_list is the list of hashs of the file to be restored.
+ * @param size is the size of the file to be restored.
+ */
+void fetch_hash_list_to_stream(comm_t *comm, GFileOutputStream *stream, GList *hash_list, guint64 size)
+{
+    gint max = 0;
+    gint fd = g_file_descriptor_based_get_fd(G_FILE_DESCRIPTOR_BASED(stream));
+
+    if (fetch_hash_list_in_parallel(comm, fd, hash_list, NULL) == FALSE)
+        {
+            print_debug(_("Unable to get blocks in parallel, getting them one batch after the other\n"));
+            g_seekable_truncate(G_SEEKABLE(stream), 0, NULL, NULL);
+            max = calculate_max_number_of_hashs(size);
+            get_hash_list_one_batch_at_a_time(comm, stream, hash_list, max);
+        }
+}
+
+
+/**
+ * Gets the blocks of hash_list from the server and writes each one at
+ * its own offset in the file of the stream (used when only some blocks
+ * of a file are missing).
+ * @param comm is the communication structure to use.
+ * @param stream is the stream of the file being restored.
+ * @param hash_list is the list of hashs of the blocks to be restored.
+ * @param offsets is the array of the offsets (guint64) of each block of
+ *        hash_list in the file.
+ * @returns TRUE if every block has been written and FALSE otherwise.
+ */
+gboolean fetch_hash_list_at_offsets(comm_t *comm, GFileOutputStream *stream, GList *hash_list, GArray *offsets)
+{
+    gint fd = g_file_descriptor_based_get_fd(G_FILE_DESCRIPTOR_BASED(stream));
+
+    return fetch_hash_list_in_parallel(comm, fd, hash_list, offsets);
+}
@@ -0,0 +1,125 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    fetch.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file restore/fetch.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * used by 'cdpfglrestore' to get the blocks of a file from cdpfglserver
+ * with several requests in flight and to write them where they belong in
+ * the restored file.
+ */
+#ifndef _RESTORE_FETCH_H_
+#define _RESTORE_FETCH_H_
+
+/**
+ * @def FETCH_BATCH_SIZE
+ * Number of hashs asked at once to the server in the body of one POST
+ * /Data/Hash_Array.json request.
+ *
+ * @def FETCH_WORKERS
+ * Number of connections (each one in its own thread) used to get the
+ * batches of one file. It is also the maximum number of batches held in
+ * memory at the same time.
+ */
+#define FETCH_BATCH_SIZE (256)
+#define FETCH_WORKERS (4)
+
+
+/**
+ * @struct fetch_t
+ * @brief State of the restoration of one file shared by the workers.
+ *
+ * Batches are taken in order by the workers. The offset of a batch in
+ * the file is only known when every previous batch has been received
+ * (blocks do not all have the same size) so workers take their turn to
+ * reserve their place in the file and then write concurrently.
+ */
+typedef struct
+{
+    gchar *conn;             /**< Connexion string to cdpfglserver (http://ip:port)          */
+    gshort cmptype;          /**< Compression type used by the connections                   */
+    gint fd;                 /**< File descriptor of the file being restored                 */
+    GArray *offsets;         /**< guint64 offset of each block when known in advance or NULL */
+    GPtrArray *batches;      /**< GList * link of the first hash of each batch               */
+    guint next_batch;        /**< Index of the next batch to be asked to the server          */
+    guint next_placed;       /**< Index of the next batch that has to reserve its place      */
+    guint64 offset;          /**< Offset in the file where next_placed batch begins          */
+    gboolean failed;         /**< TRUE as soon as one batch could not be restored            */
+    GMutex mutex;            /**< Protects next_batch, next_placed, offset and failed        */
+    GCond cond;              /**< Signaled when next_placed or failed change                 */
+} fetch_t;
+
+
+/**
+ * Gets one batch of blocks from the server. Every block is checked
+ * against the hash that was asked for and uncompressed.
+ * @param comm is the communication structure of the calling thread.
+ * @param hash_list is the link of the first hash of the batch.
+ * @param nb_hashs is the maximum number of hashs of the batch.
+ * @returns the list of uncompressed blocks (hash_data_t *) in the order
+ *          of hash_list or NULL if any of them is missing or invalid.
+ */
+extern GList *fetch_batch_from_server(comm_t *comm, GList *hash_list, guint nb_hashs);
+
+
+/**
+ * Writes len bytes of data in a file at offset with pwrite().
+ * @param fd is the file descriptor of the file being restored.
+ * @param data is the data to be written.
+ * @param len is the number of bytes of data.
+ * @param offset is the offset in the file where data goes.
+ * @returns TRUE if everything has been written and FALSE otherwise.
+ */
+extern gboolean fetch_write_at_offset(gint fd, guchar *data, gsize len, guint64 offset);
+
+
+/**
+ * Gets every block of hash_list from the server and writes them in the
+ * file of the stream. Blocks are fetched in parallel (see
+ * fetch_hash_list_in_parallel) and, if that fails (older servers do not
+ * know POST /Data/Hash_Array.json), the file is emptied and restored
+ * again one batch after the other with GET requests.
+ * @param comm is the communication structure to use (only its connexion
+ *        string and compression type are used when fetching in parallel).
+ * @param stream is the stream of the file to be restored (MUST be opened,
+ *        empty and not NULL).
+ * @param hash_list is the list of hashs of the file to be restored.
+ * @param size is the size of the file to be restored.
+ */
+extern void fetch_hash_list_to_stream(comm_t *comm, GFileOutputStream *stream, GList *hash_list, guint64 size);
+
+
+/**
+ * Gets the blocks of hash_list from the server and writes each one at
+ * its own offset in the file of the stream (used when only some blocks
+ * of a file are missing).
+ * @param comm is the communication structure to use.
+ * @param stream is the stream of the file being restored.
+ * @param hash_list is the list of hashs of the blocks to be restored.
+ * @param offsets is the array of the offsets (guint64) of each block of
+ *        hash_list in the file.
+ * @returns TRUE if every block has been written and FALSE otherwise.
+ */
+extern gboolean fetch_hash_list_at_offsets(comm_t *comm, GFileOutputStream *stream, GList *hash_list, GArray *offsets);
+
+
+#endif /* #ifndef _RESTORE_FETCH_H_ */
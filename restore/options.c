@@ -118,14 +118,18 @@ static options_t *manage_command_line_options(int argc, char **argv)
     gchar *list = NULL;            /** Should contain a filename or a directory to filter out                            */
     gchar *r_hostname = NULL;      /** r_hostname is the name fo the host where the file to be restored belung.          */
     gchar *restore = NULL;         /** Must contain a filename or a directory name to be restored                        */
+    gchar *verify = NULL;          /** Should contain a filename or a directory name to be compared with local files      */
     gchar *date = NULL;            /** date at which we want to restore a file or directory                              */
     gchar *where = NULL;           /** Contains the directory where to restore a file / directory                        */
     gchar *afterdate = NULL;       /** afterdate: we want to restore a file that has its mtime after this date           */
     gchar *beforedate = NULL;      /** beforedate:  we want to restore a file that has its mtime before this date        */
+    gchar *asof = NULL;            /** asof: we want to restore files as they were at this date                          */
     gboolean all_versions = FALSE; /** all_version: True if we want to restore all version FALSE otherwise (default)     */
     gboolean all_files = FALSE;    /** all_files: True if we want to restore all files found by REGEX (-r or -l options) */
     gboolean latest = FALSE;       /** latest: True if we only want to get the latest version of a file                  */
     gboolean parents = FALSE;      /** parents: True if restore has to create / restore files with the whole path        */
+    gboolean reuse = FALSE;        /** reuse: True if blocks of an existing file at the restore path may be reused       */
+    gchar *seed = NULL;            /** seed: directory where to look for local copies of the files to be restored        */
     srv_conf_t *srv_conf = NULL;
     GOptionEntry entries[] =
     {
@@ -134,14 +138,18 @@ static options_t *manage_command_line_options(int argc, char **argv)
         { "configuration", 'c', 0, G_OPTION_ARG_STRING, &configfile, N_("Specify an alternative configuration file."), N_("FILENAME")},
         { "list", 'l', 0, G_OPTION_ARG_FILENAME, &list, N_("Lists saved files that correspond to the given REGEX."), "REGEX"},
         { "restore", 'r', 0, G_OPTION_ARG_FILENAME, &restore, N_("Restores requested filename (REGEX) (by default latest version)."), "REGEX"},
+        { "verify", 'V', 0, G_OPTION_ARG_FILENAME, &verify, N_("Compares saved files (REGEX) with local ones without getting their data."), "REGEX"},
         { "hostname", 'n', 0, G_OPTION_ARG_STRING, &r_hostname, N_("Specifies a hostname (HOSTNAME) that owned the file to be restored."), "HOSTNAME"},
         { "date", 't', 0, G_OPTION_ARG_STRING, &date, N_("Selects file with that specific DATE (YYYY-MM-DD HH:MM:SS format)."), "DATE"},
         { "after", 'a', 0, G_OPTION_ARG_STRING, &afterdate, N_("Selects file with mtime after DATE (YYYY-MM-DD HH:MM:SS format)."), "DATE"},
         { "before", 'b', 0, G_OPTION_ARG_STRING, &beforedate, N_("Selects file with mtime before DATE (YYYY-MM-DD HH:MM:SS format)."), "DATE"},
+        { "as-of", 's', 0, G_OPTION_ARG_STRING, &asof, N_("Selects files as they were at DATE (YYYY-MM-DD HH:MM:SS format)."), "DATE"},
         { "all-versions", 'e', 0, G_OPTION_ARG_NONE, &all_versions, N_("Selects all versions of a file."), NULL},
         { "all-files", 'f', 0, G_OPTION_ARG_NONE, &all_files, N_("Forces -r to restore all files found (not the latest one)"), NULL},
         { "latest", 'g', 0, G_OPTION_ARG_NONE, &latest, N_("Selects only latest version of each file."), NULL},
         { "parents", 'P', 0, G_OPTION_ARG_NONE, &parents, N_("Creates directories if needed: ie restore with the whole path"), NULL},
+        { "reuse", 'u', 0, G_OPTION_ARG_NONE, &reuse, N_("Reuses blocks of an existing copy of a file and only fetches missing ones."), NULL},
+        { "seed", 'S', 0, G_OPTION_ARG_FILENAME, &seed, N_("Reuses blocks of local copies of files found in DIRECTORY."), N_("DIRECTORY")},
         { "where", 'w', 0, G_OPTION_ARG_STRING, &where, N_("Specify a DIRECTORY where to restore a file."), N_("DIRECTORY")},
         { "ip", 'i', 0, G_OPTION_ARG_STRING, &ip, N_("IP address where server program is."), "IP"},
         { "port", 'p', 0, G_OPTION_ARG_INT, &port, N_("Port NUMBER on which server program is listening."), N_("NUMBER")},
@@ -160,7 +168,9 @@ static options_t *manage_command_line_options(int argc, char **argv)
     opt->configfile = NULL;
     opt->list = NULL;
     opt->restore = NULL;
+    opt->verify = NULL;
     opt->where = NULL;
+    opt->seed = NULL;
     opt->r_hostname = NULL;
     opt->srv_conf = NULL;
 
@@ -204,13 +214,17 @@ static options_t *manage_command_line_options(int argc, char **argv)
     opt->all_files = all_files;       /* only TRUE if -f or --all-files was invoked    */
     opt->latest = latest;             /* only TRUE if -r or --latest was invoked       */
     opt->parents = parents;           /* only TRUE if -p or --parents was invoked      */
+    opt->reuse = reuse;               /* only TRUE if -u or --reuse was invoked        */
 
     opt->date = set_option_str(date, opt->date);
     opt->afterdate = set_option_str(afterdate, opt->afterdate);
     opt->beforedate = set_option_str(beforedate, opt->beforedate);
+    opt->asof = set_option_str(asof, opt->asof);
     opt->list = set_option_str(list, opt->list);
     opt->restore = set_option_str(restore, opt->restore);
+    opt->verify = set_option_str(verify, opt->verify);
     opt->where = set_option_str(where, opt->where);
+    opt->seed = set_option_str(seed, opt->seed);
     opt->r_hostname = set_option_str(r_hostname, opt->r_hostname);
 
     if (opt->srv_conf != NULL)
@@ -227,9 +241,12 @@ static options_t *manage_command_line_options(int argc, char **argv)
     free_variable(ip);
     free_variable(list);
     free_variable(restore);
+    free_variable(verify);
     free_variable(date);
     free_variable(afterdate);
     free_variable(beforedate);
+    free_variable(seed);
+    free_variable(asof);
     free_variable(where);
 
     return opt;
@@ -272,15 +289,18 @@ void free_options_t(options_t *opt)
 {
     if (opt != NULL)
         {
-            /* list, restore, date, ip, configfile, afterdate, beforedate and where are 'gchar *' strings */
+            /* list, restore, verify, date, ip, configfile, afterdate, beforedate, asof, where and seed are 'gchar *' strings */
             free_variable(opt->list);
             free_variable(opt->restore);
+            free_variable(opt->verify);
             free_variable(opt->date);
             free_variable(opt->configfile);
             free_srv_conf_t(opt->srv_conf);
             free_variable(opt->afterdate);
             free_variable(opt->beforedate);
+            free_variable(opt->asof);
             free_variable(opt->where);
+            free_variable(opt->seed);
             free_variable(opt->r_hostname);
             free_variable(opt);
         }
@@ -45,9 +45,11 @@ typedef struct
     gboolean version;       /**< TRUE if we have to display program's version                                                 */
     gchar *list;            /**< Should contain a filename to be searched into saved files filename's list                    */
     gchar *restore;         /**< Must contain a filename or a directory name to be restored (latest version by default        */
+    gchar *verify;          /**< Should contain a filename or a directory name to be compared with the local files            */
     gchar *date;            /**< Should contain a date in the correct format to filter only files at that specific date       */
     gchar *afterdate;       /**< Should contain a date in the correct format to filter only files after that specific date    */
     gchar *beforedate;      /**< Should contain a date in the correct format to filter only files before that specific date   */
+    gchar *asof;            /**< Should contain a date in the correct format to get files as they were at that specific date  */
     gchar *configfile;      /**< Filename for the configuration file specified on the command line                            */
     gchar *r_hostname;      /**< A string containing the hostname where the file to be restored was located.                  */
     gchar *where;           /**< where is a string that should contain a directory where to restore a file / dirtectory       */
@@ -56,6 +58,8 @@ typedef struct
     gboolean all_files;     /**< all_files is true if we want to restore all files found by REGEX with -r or -l options       */
     gboolean latest;        /**< latest is true if we want ot get only the latest version of a file. Defaults is false        */
     gboolean parents;       /**< when parents is true restore will create (if needed) and restore files with their whole path */
+    gboolean reuse;         /**< when reuse is true blocks of an existing copy of a file at the restore path are reused       */
+    gchar *seed;            /**< seed is a directory where local copies of files are looked for to reuse their blocks         */
 } options_t;
 
 
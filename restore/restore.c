@@ -30,17 +30,17 @@
 static void set_res_struct_hostname(res_struct_t *res_struct, gchar *r_hostname);
 static res_struct_t *init_res_struct(int argc, char **argv);
 static query_t *prepare_query(gchar *hostname);
-static query_t *finish_query(query_t *query, gchar *encoded_filename, gchar *encoded_date, gchar *encoded_afterdate,gchar *encoded_beforedate, gboolean latest);
+static query_t *finish_query(query_t *query, gchar *encoded_filename, gchar *encoded_date, gchar *encoded_afterdate,gchar *encoded_beforedate, gchar *encoded_asof, gboolean latest);
 static query_t *get_user_infos(gchar *hostname, gchar *filename, options_t *opt);
 static query_t *new_query_from_filename(gchar *hostname, gchar *filename);
 static gchar *add_on_field_to_request(gchar *request, gchar *field, gchar *value);
 static gchar *add_on_boolean_field_to_request(gchar *request, gchar *field, gboolean value);
 static gchar *make_base_request(query_t *query);
+static GSList *get_page_of_files_from_server(res_struct_t *res_struct, query_t *query);
 static GSList *get_files_from_server(res_struct_t *res_struct, query_t *query);
 static void print_list_of_smeta(GSList *list);
 static void print_all_files(res_struct_t *res_struct, query_t *query);
 static void print_all_versions(res_struct_t *res_struct, query_t *query);
-static void restore_data_to_stream(res_struct_t *res_struct, GFileOutputStream *stream, GList *hash_list, gint max);
 static void create_file(res_struct_t *res_struct, meta_data_t *meta);
 static void print_debug_file_info(meta_data_t *meta);
 static void restore_one_file(res_struct_t *res_struct, GSList *elem);
@@ -51,6 +51,7 @@ static void free_res_struct_t(res_struct_t *res_struct);
 static void list_files(res_struct_t *res_struct);
 static void restore_files(res_struct_t *res_struct);
 static void restore_all_files(res_struct_t *res_struct, query_t *query);
+static gboolean verify_files(res_struct_t *res_struct);
 
 /**
  * Sets the hostname of which we want to restore files from
@@ -150,15 +151,17 @@ static query_t *prepare_query(gchar *hostname)
 
 
 /**
- * Ends the query by adding filename, date, beforedate and afterdate to the query
+ * Ends the query by adding filename, date, beforedate, afterdate and asof to the query
  * @param query an already prepared query to be filled with dates and filename
  * @param encoded_filename is the filename we may want to restore
  * @param encoded_date may be the specific date at which we want to restore a file
  * @param encoded_afterdate is the minimal date of the file to be restored
  * @param encoded_beforedate is the maximal date of the file to be restored
+ * @param encoded_asof is the date at which we want the files as they were
+ * @param latest is TRUE if we only want the latest version of each file
  * @returns a completely filled query_t structure
  */
-static query_t *finish_query(query_t *query, gchar *encoded_filename, gchar *encoded_date, gchar *encoded_afterdate, gchar *encoded_beforedate, gboolean latest)
+static query_t *finish_query(query_t *query, gchar *encoded_filename, gchar *encoded_date, gchar *encoded_afterdate, gchar *encoded_beforedate, gchar *encoded_asof, gboolean latest)
 {
     if (query != NULL)
         {
@@ -166,6 +169,7 @@ static query_t *finish_query(query_t *query, gchar *encoded_filename, gchar *enc
             query->date = encoded_date;
             query->afterdate = encoded_afterdate;
             query->beforedate = encoded_beforedate;
+            query->asof = encoded_asof;
             query->latest = latest;
         }
 
@@ -187,6 +191,7 @@ static query_t *get_user_infos(gchar *hostname, gchar *filename, options_t *opt)
     gchar *encoded_filename = NULL;
     gchar *encoded_afterdate = NULL;
     gchar *encoded_beforedate = NULL;
+    gchar *encoded_asof = NULL;
     query_t *query = NULL;
 
     query = prepare_query(hostname);
@@ -197,8 +202,9 @@ static query_t *get_user_infos(gchar *hostname, gchar *filename, options_t *opt)
             encoded_date = encode_to_base64(opt->date);
             encoded_afterdate = encode_to_base64(opt->afterdate);
             encoded_beforedate = encode_to_base64(opt->beforedate);
+            encoded_asof = encode_to_base64(opt->asof);
 
-            query = finish_query(query, encoded_filename, encoded_date, encoded_afterdate, encoded_beforedate, opt->latest);
+            query = finish_query(query, encoded_filename, encoded_date, encoded_afterdate, encoded_beforedate, encoded_asof, opt->latest);
         }
 
     return query;
@@ -223,7 +229,7 @@ static query_t *new_query_from_filename(gchar *hostname, gchar *filename)
     if (query != NULL && filename != NULL)
         {
             encoded_filename = encode_to_base64(filename);
-            query = finish_query(query, encoded_filename, NULL, NULL, NULL, FALSE);
+            query = finish_query(query, encoded_filename, NULL, NULL, NULL, NULL, FALSE);
         }
 
     return query;
@@ -310,26 +316,44 @@ static gchar *make_base_request(query_t *query)
 
 
 /**
- * Gets the file the server_meta_data_t * file list if any
+ * Gets one page of the server_meta_data_t * file list if any. The page
+ * begins at query->cursor (at the beginning when NULL) and query->cursor
+ * is set to the beginning of the next page (or NULL when this page is
+ * the last one).
  * @param res_struct is the main structure for cdpfglrestore program.
  * @param query is the structure that contains everything needed to
  *        query the server (and filter a bit). It must not be NULL.
- * @returns a GSList * of server_meta_data_t *
+ * @returns a GSList * of server_meta_data_t * in the order of the server
+ *          (filenames and then modification times).
  */
-static GSList *get_files_from_server(res_struct_t *res_struct, query_t *query)
+static GSList *get_page_of_files_from_server(res_struct_t *res_struct, query_t *query)
 {
     gchar *request = NULL;
+    gchar *limit = NULL;
     json_t *root = NULL;
     GSList *list = NULL;    /** List of server_meta_data_t * returned by this function */
     gint res = CURLE_FAILED_INIT;
 
     if (res_struct != NULL && query != NULL)
         {
+            limit = g_strdup_printf("%d", RESTORE_LIST_PAGE_SIZE);
+
             request = make_base_request(query);
             request = add_on_field_to_request(request, "date", query->date);
             request = add_on_field_to_request(request, "afterdate", query->afterdate);
             request = add_on_field_to_request(request, "beforedate", query->beforedate);
+            request = add_on_field_to_request(request, "asof", query->asof);
             request = add_on_boolean_field_to_request(request, "latest",  query->latest);
+            request = add_on_field_to_request(request, "limit", limit);
+            request = add_on_field_to_request(request, "cursor", query->cursor);
+
+            if (query->without_hashs == TRUE)
+                {
+                    request = add_on_boolean_field_to_request(request, "without_hashs", TRUE);
+                }
+
+            free_variable(query->cursor);
+            query->cursor = NULL;
 
             print_debug(_("Query is: %s\n"), request);
             res = get_url(res_struct->comm, request, NULL);
@@ -339,7 +363,7 @@ static GSList *get_files_from_server(res_struct_t *res_struct, query_t *query)
                     root = load_json(res_struct->comm->buffer);
 
                     list = extract_smeta_gslist_from_json_array(root);
-                    list = g_slist_sort(list, compare_filenames);
+                    query->cursor = get_string_from_json_root(root, "cursor");
 
                     json_decref(root);
                     free_variable(res_struct->comm->buffer);
@@ -347,6 +371,39 @@ static GSList *get_files_from_server(res_struct_t *res_struct, query_t *query)
                 }
 
             free_variable(request);
+            free_variable(limit);
+        }
+
+    return list;
+}
+
+
+/**
+ * Gets the file the server_meta_data_t * file list if any. The list is
+ * retrieved page after page.
+ * @param res_struct is the main structure for cdpfglrestore program.
+ * @param query is the structure that contains everything needed to
+ *        query the server (and filter a bit). It must not be NULL.
+ * @returns a GSList * of server_meta_data_t *
+ */
+static GSList *get_files_from_server(res_struct_t *res_struct, query_t *query)
+{
+    GSList *list = NULL;    /** List of server_meta_data_t * returned by this function */
+    GSList *page = NULL;
+
+    if (res_struct != NULL && query != NULL)
+        {
+            free_variable(query->cursor);
+            query->cursor = NULL;
+
+            do
+                {
+                    page = get_page_of_files_from_server(res_struct, query);
+                    list = g_slist_concat(page, list);
+                }
+            while (query->cursor != NULL);
+
+            list = g_slist_sort(list, compare_filenames);
         }
 
     return list;
@@ -386,11 +443,19 @@ static void print_all_files(res_struct_t *res_struct, query_t *query)
 
     if (res_struct != NULL && query != NULL)
         {
-            list = get_files_from_server(res_struct, query);
+            /* Printed page after page: only one page is in memory at a time */
+            free_variable(query->cursor);
+            query->cursor = NULL;
+
+            do
+                {
+                    list = get_page_of_files_from_server(res_struct, query);
 
-            print_list_of_smeta(list);
+                    print_list_of_smeta(list);
 
-            g_slist_free_full(list, free_gslist_smeta);
+                    g_slist_free_full(list, free_gslist_smeta);
+                }
+            while (query->cursor != NULL);
         }
 }
 
@@ -448,6 +513,7 @@ static void print_all_versions(res_struct_t *res_struct, query_t *query)
                 {
                     filename = g_strdup_printf("^%s$", meta->name);
                     query_last = new_query_from_filename(res_struct->hostname, filename);
+                    query_last->without_hashs = TRUE;
 
                     new_list = get_files_from_server(res_struct, query_last);
                     print_list_of_smeta(new_list);
@@ -462,70 +528,6 @@ static void print_all_versions(res_struct_t *res_struct, query_t *query)
 }
 
 
-/**
- * Writes data obtained from the server with the hash_list hashs
- * to the stream.
- * @param stream is the stream where we are writing data (MUST be opened
- *        and not NULL)
- * @param hash_list list of hashs of the file to be restored
- * @param max is the maximum number of hashs to include into the header
- * @todo error management.
- */
-static void restore_data_to_stream(res_struct_t *res_struct, GFileOutputStream *stream, GList *hash_list, gint max)
-{
-    gchar *hash = NULL;
-    hash_data_t *hash_data = NULL;
-    hash_extract_t *hash_extract = NULL;
-    GError *error = NULL;
-    gchar *request = NULL;
-    gchar *header = NULL;
-    gint res = CURLE_FAILED_INIT;
-
-    if (stream != NULL)
-        {
-            hash_extract = new_hash_extract_t();
-            hash_extract->hash_list = hash_list;
-
-            while (hash_extract->hash_list != NULL)
-                {
-
-                    header = create_x_get_hash_array_http_header(hash_extract, max);
-                    request = g_strdup_printf("/Data/Hash_Array.json");
-                    print_debug(_("Query is: %s with header %s\n"), request, header);
-                    res = get_url(res_struct->comm, request, header);
-
-                    if (res == CURLE_OK)
-                        {
-                            /** We need to save the retrieved buffer */
-                            if (res_struct->comm->buffer != NULL)
-                                {
-                                    hash_data = convert_string_to_hash_data(res_struct->comm->buffer);
-                                    free_variable(res_struct->comm->buffer);
-                                    res_struct->comm->buffer = NULL; /* This is a way to know that this variable has been freed */
-
-                                    if (hash_data != NULL)
-                                        {
-                                            g_output_stream_write((GOutputStream *) stream, hash_data->data, hash_data->read, NULL, &error);
-                                            free_hash_data_t(hash_data);
-                                        }
-                                    else
-                                        {
-                                            print_error(__FILE__, __LINE__, _("Error while trying to restore %s hash\n"), hash);
-                                        }
-                                }
-                        }
-                    else
-                        {
-                            print_error(__FILE__, __LINE__, _("Error while getting hash %s"), hash);
-                        }
-
-                    free_variable(request);
-                    free_variable(header);
-                }
-        }
-}
-
-
 /**
  * Creates the file to be restored.
  * @param res_struct is the main structure for cdpfglrestore program (used here
@@ -536,72 +538,37 @@ static void restore_data_to_stream(res_struct_t *res_struct, GFileOutputStream *
 static void create_file(res_struct_t *res_struct, meta_data_t *meta)
 {
     GFile *file = NULL;
-    gchar *basename = NULL;    /** basename for the file to be restored       */
-    gchar *newname = NULL;     /** Effective name that the file will have     */
-    gchar *where = NULL;       /** directory where to restore the file        */
     gchar *filename = NULL;    /** filename of the restored file              */
+    gchar *seed = NULL;        /** local copy whose blocks may be reused      */
+    gboolean replace = FALSE;  /** TRUE when the restored file replaces seed  */
     GFileOutputStream *stream =  NULL;
     GError *error = NULL;
-    options_t *opt = NULL;
-    gint max = 0;
-    gchar *the_date = NULL;    /** String containing file's last modified date */
 
     if (res_struct != NULL && meta != NULL && res_struct->opt != NULL)
         {
-
-            opt = res_struct->opt;
-
-            if (opt->where != NULL && g_file_test(opt->where, G_FILE_TEST_IS_DIR))
-                {
-                    where = g_strdup(opt->where);
-                }
-
-            if (where == NULL)
-                {
-                    /* Fall back to get the current directory to make the file to be restored in it */
-                    where = g_get_current_dir();
-                }
-
-            /* get the basename of the file to be restored */
-            if (opt->parents == FALSE)
-                {
-                    basename = g_path_get_basename(meta->name);
-                }
-            else
-                {
-                    basename = g_strdup(meta->name);
-                }
-
-
-            if (opt->all_versions == TRUE)
-                {
-                    the_date = transform_date_to_string(meta->mtime, TRUE);
-                    newname = g_strdup_printf("%s_%s", the_date, basename);
-                }
-            else
-                {
-                    newname = g_strdup(basename);
-                }
-
-            filename = get_unique_filename(opt->all_versions, basename, where, newname, the_date);
-
-            print_debug(_("filename to restore: %s\n"), filename);
+            seed = get_seed_filename(res_struct->opt, meta, &replace);
+            filename = get_filename_to_restore(res_struct->opt, meta);
             file = g_file_new_for_path(filename);
 
             if (g_strcmp0("", meta->link) == 0)
                 {
-                    if (opt->parents == TRUE)
-                        {
-                            create_directory(g_path_get_dirname(filename));
-                        }
                     stream = g_file_replace(file, NULL, TRUE, G_FILE_CREATE_NONE, NULL, &error);
 
                     if (stream != NULL)
                         {
-                            max = calculate_max_number_of_hashs(meta->size);
-                            restore_data_to_stream(res_struct, stream, meta->hash_data_list, max);
+                            if (fetch_reusing_local_blocks(res_struct->comm, stream, meta, seed) == FALSE)
+                                {
+                                    replace = FALSE;
+                                }
+
                             g_output_stream_close((GOutputStream *) stream, NULL, &error);
                             free_object(stream);
+
+                            if (replace == TRUE && replace_seed_with_restored_file(filename, seed) == TRUE)
+                                {
+                                    free_object(file);
+                                    file = g_file_new_for_path(seed);
+                                }
                         }
                     else if (error != NULL)
                         {
@@ -618,11 +585,8 @@ static void create_file(res_struct_t *res_struct, meta_data_t *meta)
                 }
 
             free_object(file);
-            free_variable(where);
-            free_variable(basename);
             free_variable(filename);
-            free_variable(newname);
-            free_variable(the_date);
+            free_variable(seed);
         }
 }
 
@@ -705,20 +669,24 @@ static void restore_last_file(res_struct_t *res_struct, query_t *query)
 
 
 /**
- * Retores each file of the list
+ * Retores each file of the list all at once (see restore_tree()): blocks
+ * of small files are asked together and files are written in parallel.
  * @param res_struct is the main structure for cdpfglrestore program. It
- *         is needed by create_file function called here in order to know
- *         what to do upon command line's options
+ *         is needed to know what to do upon command line's options
  * @param list is a GSList of smeta structures representing files to be
  *        restored
  */
 static void restore_list_of_smeta(res_struct_t *res_struct, GSList *list)
 {
+    GSList *head = list;
+
     while (list != NULL)
         {
-            restore_one_file(res_struct, list);
+            print_debug_file_info(get_meta_data_from_smeta_list(list));
             list = g_slist_next(list);
         }
+
+    restore_tree(res_struct->comm, res_struct->opt, head);
 }
 
 
@@ -807,6 +775,7 @@ static void list_files(res_struct_t *res_struct)
     query_t *query =  NULL;
 
     query = get_user_infos(res_struct->hostname, res_struct->opt->list, res_struct->opt);
+    query->without_hashs = TRUE; /* Listing files does not need their hashs */
 
     if (res_struct->opt->all_versions == TRUE)
         {
@@ -851,15 +820,47 @@ static void restore_files(res_struct_t *res_struct)
 }
 
 
+/**
+ * Compares local files to saved ones as requested. Only meta data and
+ * hashs of the files are asked to the server.
+ * @param res_struct res_struct is the main structure for this program
+ * @returns TRUE if every local file matches the saved one and FALSE
+ *          otherwise.
+ */
+static gboolean verify_files(res_struct_t *res_struct)
+{
+    query_t *query =  NULL;
+    GSList *list = NULL;      /** List of server_meta_data_t *        */
+    gboolean ok = FALSE;
+
+    query = get_user_infos(res_struct->hostname, res_struct->opt->verify, res_struct->opt);
+
+    if (query != NULL)
+        {
+            list = get_files_from_server(res_struct, query);
+
+            ok = verify_tree(res_struct->opt, list);
+
+            g_slist_free_full(list, free_gslist_smeta);
+        }
+
+    free_query_t(query);
+
+    return ok;
+}
+
+
 /**
  * Main function
  * @param argc : number of arguments given on the command line.
  * @param argv : an array of strings that contains command line arguments.
- * @returns
+ * @returns EXIT_SUCCESS or EXIT_FAILURE when options are wrong or when
+ *          --verify found local files that are not the saved ones.
  */
 int main(int argc, char **argv)
 {
     res_struct_t *res_struct = NULL;
+    gint status = EXIT_SUCCESS;
 
     #if !GLIB_CHECK_VERSION(2, 36, 0)
         g_type_init();  /** g_type_init() is deprecated since glib 2.36 */
@@ -879,10 +880,14 @@ int main(int argc, char **argv)
                 {
                     restore_files(res_struct);
                 }
+            else if (res_struct->opt->verify != NULL && verify_files(res_struct) == FALSE)
+                {
+                    status = EXIT_FAILURE;
+                }
 
             free_res_struct_t(res_struct);
 
-            return EXIT_SUCCESS;
+            return status;
         }
     else
         {
@@ -41,10 +41,18 @@
 #include <sys/types.h>
 #include <pwd.h>
 #include <grp.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+#include <gio/gfiledescriptorbased.h>
 
 #include "libcdpfgl.h"
 
 #include "options.h"
+#include "fetch.h"
+#include "tree.h"
+#include "reuse.h"
+#include "verify.h"
 
 /**
  * @struct res_struct_t
@@ -83,5 +91,13 @@ typedef struct
 #define PROGRAM_NAME ("cdpfglrestore")
 
 
+/**
+ * @def RESTORE_LIST_PAGE_SIZE
+ * Maximum number of versions of files asked at once to the server when
+ * listing files.
+ */
+#define RESTORE_LIST_PAGE_SIZE (1024)
+
+
 
 #endif /* #ifndef _RESTORE_OPTIONS_H_ */
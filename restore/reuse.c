@@ -0,0 +1,523 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    reuse.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file restore/reuse.c
+ *
+ * This file contains the functions that reuse the blocks of a local copy
+ * of a file when restoring it. The block size used to save a file is not
+ * stored on the server so it is found out by comparing some blocks of
+ * the local copy with the hashs of the file for each block size that
+ * cdpfglclient may use. Blocks are then compared at the same offset: the
+ * ones that did not change are copied and the other ones are fetched.
+ * Full blocks full of zeros are never fetched: they are left as holes in
+ * the restored file.
+ */
+
+#include "restore.h"
+
+static gboolean read_block_at_offset(gint fd, guchar *buffer, gsize len, guint64 offset);
+static gboolean block_matches(gint fd, guchar *buffer, hash_data_t *hash_data, gsize len, guint64 offset);
+static guint64 find_blocksize(gint fd, meta_data_t *meta, guint nb_hashs, guchar *buffer);
+static guint64 find_zero_blocksize(meta_data_t *meta, guint nb_hashs);
+static gboolean reuse_local_blocks(comm_t *comm, GFileOutputStream *stream, meta_data_t *meta, gchar *seed);
+static gboolean every_block_matches(gint fd, meta_data_t *meta, guint64 blocksize, guchar *buffer);
+
+
+/**
+ * Block sizes that cdpfglclient uses (adaptive mode and default one).
+ */
+static const guint64 blocksizes[] = {512, 2048, 8192, 16384, 65536, 131072, 262144};
+
+
+/**
+ * Finds a local copy of the file of meta whose blocks may be reused:
+ * with --reuse the file that is at the place where meta is to be
+ * restored and with --seed the file of the seed directory that has the
+ * same path or else the same name.
+ * @param opt is the options of the program.
+ * @param meta is the meta data of the file to be restored.
+ * @param[out] replace is set to TRUE when the local copy is the file at
+ *             the place where meta is to be restored (it is then to be
+ *             replaced by the restored file) and to FALSE otherwise.
+ * @returns a newly allocated filename of a local copy or NULL if there
+ *          is none.
+ */
+gchar *get_seed_filename(options_t *opt, meta_data_t *meta, gboolean *replace)
+{
+    gchar *seed = NULL;
+    gchar *basename = NULL;
+
+    *replace = FALSE;
+
+    if (opt->reuse == TRUE)
+        {
+            seed = get_wanted_filename(opt, meta);
+            *replace = g_file_test(seed, G_FILE_TEST_IS_REGULAR);
+        }
+
+    if ((seed == NULL || g_file_test(seed, G_FILE_TEST_IS_REGULAR) == FALSE) && opt->seed != NULL)
+        {
+            free_variable(seed);
+            seed = g_build_filename(opt->seed, meta->name, NULL);
+
+            if (g_file_test(seed, G_FILE_TEST_IS_REGULAR) == FALSE)
+                {
+                    free_variable(seed);
+                    basename = g_path_get_basename(meta->name);
+                    seed = g_build_filename(opt->seed, basename, NULL);
+                    free_variable(basename);
+                }
+        }
+
+    if (seed != NULL && g_file_test(seed, G_FILE_TEST_IS_REGULAR) == FALSE)
+        {
+            free_variable(seed);
+            seed = NULL;
+        }
+
+    return seed;
+}
+
+
+/**
+ * Reads len bytes at offset in a file.
+ * @param fd is the file descriptor of the file to read from.
+ * @param buffer is where to put the bytes (at least len bytes long).
+ * @param len is the number of bytes to be read.
+ * @param offset is the offset in the file of the first byte to read.
+ * @returns TRUE if len bytes have been read and FALSE otherwise (for
+ *          instance when the file is shorter).
+ */
+static gboolean read_block_at_offset(gint fd, guchar *buffer, gsize len, guint64 offset)
+{
+    ssize_t nb_read = 0;
+    gboolean ok = TRUE;
+
+    while (len > 0 && ok == TRUE)
+        {
+            nb_read = pread(fd, buffer, len, (off_t) offset);
+
+            if (nb_read > 0)
+                {
+                    buffer = buffer + nb_read;
+                    len = len - nb_read;
+                    offset = offset + nb_read;
+                }
+            else if (nb_read == 0 || errno != EINTR)
+                {
+                    ok = FALSE;
+                }
+        }
+
+    return ok;
+}
+
+
+/**
+ * Reads a block of a local copy and compares its hash with hash_data.
+ * @param fd is the file descriptor of the local copy.
+ * @param buffer is where to read the block (at least len bytes long).
+ * @param hash_data is the hash of the block in the saved file.
+ * @param len is the length of the block.
+ * @param offset is the offset of the block in the file.
+ * @returns TRUE if the local block is the saved one and FALSE otherwise.
+ */
+static gboolean block_matches(gint fd, guchar *buffer, hash_data_t *hash_data, gsize len, guint64 offset)
+{
+    guint8 *a_hash = NULL;
+    gboolean match = FALSE;
+
+    if (read_block_at_offset(fd, buffer, len, offset) == TRUE)
+        {
+            a_hash = calculate_hash_for_string(buffer, len);
+            match = (memcmp(a_hash, hash_data->hash, HASH_LEN) == 0);
+            free_variable(a_hash);
+        }
+
+    return match;
+}
+
+
+/**
+ * Finds out the block size that was used to save the file of meta: only
+ * block sizes that give nb_hashs blocks for the size of the file are
+ * tried and, for each one, up to REUSE_SAMPLES blocks spread over the
+ * local copy are compared to the saved ones.
+ * @param fd is the file descriptor of the local copy.
+ * @param meta is the meta data of the file to be restored.
+ * @param nb_hashs is the number of hashs of the file (at least 1).
+ * @param buffer is a buffer of at least the biggest block size.
+ * @returns the block size for which at least one block matches or 0.
+ */
+static guint64 find_blocksize(gint fd, meta_data_t *meta, guint nb_hashs, guchar *buffer)
+{
+    GList *hash_list = NULL;
+    guint64 blocksize = 0;
+    guint64 offset = 0;
+    guint step = MAX(1, nb_hashs / REUSE_SAMPLES);
+    guint i = 0;
+    guint j = 0;
+
+    for (i = 0; i < G_N_ELEMENTS(blocksizes) && blocksize == 0; i++)
+        {
+            if ((meta->size + blocksizes[i] - 1) / blocksizes[i] == nb_hashs)
+                {
+                    hash_list = meta->hash_data_list;
+
+                    for (j = 0; hash_list != NULL && blocksize == 0; j++, hash_list = g_list_next(hash_list))
+                        {
+                            offset = j * blocksizes[i];
+
+                            if (j % step == 0 && block_matches(fd, buffer, hash_list->data, MIN(blocksizes[i], meta->size - offset), offset) == TRUE)
+                                {
+                                    blocksize = blocksizes[i];
+                                }
+                        }
+                }
+        }
+
+    return blocksize;
+}
+
+
+/**
+ * Finds out the block size that was used to save the file of meta with
+ * the hashs of its zero blocks: the hash of a block full of zeros only
+ * depends on its length. Only full blocks are compared to the hash of a
+ * zero block of each block size (the last block of a file is usually
+ * shorter). Nothing is read.
+ * @param meta is the meta data of the file to be restored.
+ * @param nb_hashs is the number of hashs of the file (at least 1).
+ * @returns the block size for which at least one block is a zero block
+ *          or 0 if the file has no zero block.
+ */
+static guint64 find_zero_blocksize(meta_data_t *meta, guint nb_hashs)
+{
+    GList *hash_list = NULL;
+    hash_data_t *hash_data = NULL;
+    guint8 *zero_hash = NULL;
+    guint64 blocksize = 0;
+    guint nb_full = 0;
+    guint i = 0;
+    guint j = 0;
+
+    for (i = 0; i < G_N_ELEMENTS(blocksizes) && blocksize == 0; i++)
+        {
+            if ((meta->size + blocksizes[i] - 1) / blocksizes[i] == nb_hashs)
+                {
+                    zero_hash = get_zero_block_hash(blocksizes[i]);
+                    nb_full = meta->size / blocksizes[i];
+                    hash_list = meta->hash_data_list;
+
+                    for (j = 0; j < nb_full && hash_list != NULL && blocksize == 0; j++, hash_list = g_list_next(hash_list))
+                        {
+                            hash_data = hash_list->data;
+
+                            if (memcmp(hash_data->hash, zero_hash, HASH_LEN) == 0)
+                                {
+                                    blocksize = blocksizes[i];
+                                }
+                        }
+                }
+        }
+
+    return blocksize;
+}
+
+
+/**
+ * Tells whether the saved file of meta has blocks full of zeros (that
+ * are left as holes when it is restored on its own).
+ * @param meta is the meta data of the file to be restored.
+ * @returns TRUE if at least one block of the file is full of zeros.
+ */
+gboolean has_zero_blocks(meta_data_t *meta)
+{
+    guint nb_hashs = g_list_length(meta->hash_data_list);
+
+    return (nb_hashs > 0 && find_zero_blocksize(meta, nb_hashs) > 0);
+}
+
+
+/**
+ * Compares every block of a local copy to the saved ones.
+ * @param fd is the file descriptor of the local copy.
+ * @param meta is the meta data of the saved file.
+ * @param blocksize is the block size to cut the local copy with.
+ * @param buffer is a buffer of at least blocksize bytes.
+ * @returns TRUE if every block matches and FALSE as soon as one differs.
+ */
+static gboolean every_block_matches(gint fd, meta_data_t *meta, guint64 blocksize, guchar *buffer)
+{
+    GList *hash_list = NULL;
+    guint64 offset = 0;
+    gsize len = 0;
+    gboolean match = TRUE;
+
+    for (hash_list = meta->hash_data_list; hash_list != NULL && match == TRUE; hash_list = g_list_next(hash_list))
+        {
+            len = MIN(blocksize, meta->size - offset);
+            match = block_matches(fd, buffer, hash_list->data, len, offset);
+            offset = offset + len;
+        }
+
+    return match;
+}
+
+
+/**
+ * Tells whether a local file is the same as the saved file of meta
+ * without getting any block from the server: the local file is cut with
+ * each block size that cdpfglclient may have used and its blocks are
+ * compared to the hashs of meta. The block size is not saved in the meta
+ * data: a file saved with a custom block size (-b option) can not be
+ * compared and no block of it matches whatever its content is.
+ * @param filename is the name of the local file (a regular file of the
+ *        same size as the saved one).
+ * @param meta is the meta data of the saved file with its hashs.
+ * @returns REUSE_IDENTICAL if the local file has the same content,
+ *          REUSE_DIFFERENT if it differs and REUSE_UNKNOWN_BLOCKSIZE if
+ *          no known block size fits the saved file (nothing can be told
+ *          then).
+ */
+reuse_compare_t compare_local_copy(gchar *filename, meta_data_t *meta)
+{
+    guchar *buffer = NULL;
+    guint nb_hashs = 0;
+    guint i = 0;
+    gint fd = -1;
+    gboolean identical = FALSE;
+    reuse_compare_t result = REUSE_DIFFERENT;
+
+    nb_hashs = g_list_length(meta->hash_data_list);
+
+    if (nb_hashs == 0)
+        {
+            identical = (meta->size == 0);
+        }
+    else
+        {
+            fd = g_open(filename, O_RDONLY, 0);
+
+            if (fd >= 0)
+                {
+                    buffer = (guchar *) g_malloc(blocksizes[G_N_ELEMENTS(blocksizes) - 1]);
+
+                    for (i = 0; i < G_N_ELEMENTS(blocksizes) && identical == FALSE; i++)
+                        {
+                            if ((meta->size + blocksizes[i] - 1) / blocksizes[i] == nb_hashs)
+                                {
+                                    identical = every_block_matches(fd, meta, blocksizes[i], buffer);
+                                }
+                        }
+
+                    /**
+                     * Some block has to match (or to be a zero block) to
+                     * be sure that the file was cut with a known block
+                     * size and that its content really changed.
+                     */
+                    if (identical == FALSE && find_zero_blocksize(meta, nb_hashs) == 0 && find_blocksize(fd, meta, nb_hashs, buffer) == 0)
+                        {
+                            result = REUSE_UNKNOWN_BLOCKSIZE;
+                        }
+
+                    free_variable(buffer);
+                    close(fd);
+                }
+        }
+
+    if (identical == TRUE)
+        {
+            result = REUSE_IDENTICAL;
+        }
+
+    return result;
+}
+
+
+/**
+ * Restores the file of meta without fetching its zero blocks (they are
+ * left as holes) nor the blocks of seed that did not change. Only the
+ * other blocks are fetched from the server.
+ * @param comm is the communication structure to use.
+ * @param stream is the stream of the file to be restored (MUST be opened,
+ *        empty and not NULL).
+ * @param meta is the meta data of the file to be restored.
+ * @param seed is the filename of a local copy of this file or NULL.
+ * @returns TRUE if the file has been entirely restored and FALSE
+ *          otherwise (when the block size can not be found out or when
+ *          some block could not be fetched). The file has then to be
+ *          emptied and restored as usual.
+ */
+static gboolean reuse_local_blocks(comm_t *comm, GFileOutputStream *stream, meta_data_t *meta, gchar *seed)
+{
+    GList *hash_list = NULL;
+    GList *missing = NULL;     /** hashs of the blocks to be fetched (they belong to meta) */
+    GArray *offsets = NULL;    /** offset in the file of each block of missing            */
+    hash_data_t *hash_data = NULL;
+    guchar *buffer = NULL;
+    guint8 *zero_hash = NULL;
+    guint64 blocksize = 0;
+    guint64 offset = 0;
+    gsize len = 0;
+    guint nb_hashs = 0;
+    guint reused = 0;
+    guint holes = 0;
+    gint in = -1;
+    gint out = -1;
+    gboolean ok = FALSE;
+
+    nb_hashs = g_list_length(meta->hash_data_list);
+    buffer = (guchar *) g_malloc(blocksizes[G_N_ELEMENTS(blocksizes) - 1]);
+
+    if (seed != NULL)
+        {
+            in = g_open(seed, O_RDONLY, 0);
+        }
+
+    if (nb_hashs > 0)
+        {
+            blocksize = find_zero_blocksize(meta, nb_hashs);
+
+            if (blocksize == 0 && in >= 0)
+                {
+                    blocksize = find_blocksize(in, meta, nb_hashs, buffer);
+                }
+        }
+
+    if (blocksize > 0)
+        {
+            zero_hash = get_zero_block_hash(blocksize);
+            out = g_file_descriptor_based_get_fd(G_FILE_DESCRIPTOR_BASED(stream));
+            offsets = g_array_new(FALSE, FALSE, sizeof(guint64));
+            ok = TRUE;
+
+            for (hash_list = meta->hash_data_list; hash_list != NULL && ok == TRUE; hash_list = g_list_next(hash_list))
+                {
+                    hash_data = hash_list->data;
+                    len = MIN(blocksize, meta->size - offset);
+
+                    if (len == blocksize && memcmp(hash_data->hash, zero_hash, HASH_LEN) == 0)
+                        {
+                            /* Nothing written: this block is a hole once the file has its size */
+                            holes = holes + 1;
+                        }
+                    else if (in >= 0 && block_matches(in, buffer, hash_data, len, offset) == TRUE)
+                        {
+                            ok = fetch_write_at_offset(out, buffer, len, offset);
+                            reused = reused + 1;
+                        }
+                    else
+                        {
+                            missing = g_list_prepend(missing, hash_data);
+                            g_array_append_val(offsets, offset);
+                        }
+
+                    offset = offset + len;
+                }
+
+            missing = g_list_reverse(missing);
+            print_debug(_("%s: %d blocks of %d reused and %d left as holes\n"), meta->name, reused, nb_hashs, holes);
+
+            if (ok == TRUE && missing != NULL)
+                {
+                    ok = fetch_hash_list_at_offsets(comm, stream, missing, offsets);
+                }
+
+            if (ok == TRUE && ftruncate(out, (off_t) meta->size) != 0)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while setting the size of %s: %s\n"), meta->name, g_strerror(errno));
+                    ok = FALSE;
+                }
+
+            g_list_free(missing);
+            g_array_free(offsets, TRUE);
+        }
+
+    if (in >= 0)
+        {
+            close(in);
+        }
+
+    free_variable(buffer);
+
+    return ok;
+}
+
+
+/**
+ * Restores the data of the file of meta leaving its zero blocks as holes
+ * and reusing the blocks of seed that did not change. When this is not
+ * possible the file is emptied and every block is fetched (see
+ * fetch_hash_list_to_stream()).
+ * @param comm is the communication structure to use.
+ * @param stream is the stream of the file to be restored (MUST be opened,
+ *        empty and not NULL).
+ * @param meta is the meta data of the file to be restored.
+ * @param seed is the filename of a local copy of this file or NULL.
+ * @returns TRUE if the file has been restored without fetching every
+ *          block and FALSE otherwise.
+ */
+gboolean fetch_reusing_local_blocks(comm_t *comm, GFileOutputStream *stream, meta_data_t *meta, gchar *seed)
+{
+    gboolean reused = FALSE;
+
+    reused = reuse_local_blocks(comm, stream, meta, seed);
+
+    if (reused == FALSE && seed != NULL)
+        {
+            print_debug(_("Unable to reuse blocks of %s, getting every block of %s\n"), seed, meta->name);
+        }
+
+    if (reused == FALSE)
+        {
+            g_seekable_truncate(G_SEEKABLE(stream), 0, NULL, NULL);
+            fetch_hash_list_to_stream(comm, stream, meta->hash_data_list, meta->size);
+        }
+
+    return reused;
+}
+
+
+/**
+ * Replaces the local copy whose blocks were reused by the restored file
+ * (only when restoring with --reuse at the place of the local copy).
+ * @param filename is the name of the restored (and closed) file.
+ * @param seed is the name of the local copy that is replaced.
+ * @returns TRUE if the restored file is now named seed and FALSE
+ *          otherwise (it is then left beside the local copy).
+ */
+gboolean replace_seed_with_restored_file(gchar *filename, gchar *seed)
+{
+    gboolean replaced = FALSE;
+
+    if (g_rename(filename, seed) == 0)
+        {
+            replaced = TRUE;
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to replace %s with %s (%s).\n"), seed, filename, g_strerror(errno));
+        }
+
+    return replaced;
+}
@@ -0,0 +1,125 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    reuse.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file restore/reuse.h
+ *
+ * This file contains all the definitions of the functions used by
+ * 'cdpfglrestore' to reuse the blocks of a local copy of a file (an
+ * older version at the same place or a file in a seed directory) so
+ * that only missing blocks are fetched from cdpfglserver. Blocks full of
+ * zeros are not fetched either: they are left as holes.
+ */
+#ifndef _RESTORE_REUSE_H_
+#define _RESTORE_REUSE_H_
+
+
+/**
+ * @def REUSE_SAMPLES
+ * Maximum number of blocks of a local copy that are compared to the
+ * hashs of a file to find out the block size that was used to save it.
+ */
+#define REUSE_SAMPLES (16)
+
+
+/**
+ * Finds a local copy of the file of meta whose blocks may be reused:
+ * with --reuse the file that is at the place where meta is to be
+ * restored and with --seed the file of the seed directory that has the
+ * same path or else the same name.
+ * @param opt is the options of the program.
+ * @param meta is the meta data of the file to be restored.
+ * @param[out] replace is set to TRUE when the local copy is the file at
+ *             the place where meta is to be restored (it is then to be
+ *             replaced by the restored file) and to FALSE otherwise.
+ * @returns a newly allocated filename of a local copy or NULL if there
+ *          is none.
+ */
+extern gchar *get_seed_filename(options_t *opt, meta_data_t *meta, gboolean *replace);
+
+
+/**
+ * @enum reuse_compare_t
+ * @brief Result of the comparison of a local copy with a saved file.
+ */
+typedef enum
+{
+    REUSE_IDENTICAL,          /**< local copy has the same content                        */
+    REUSE_DIFFERENT,          /**< local copy differs from the saved file                  */
+    REUSE_UNKNOWN_BLOCKSIZE,  /**< saved with a block size that is not a known one (-b)    */
+} reuse_compare_t;
+
+
+/**
+ * Tells whether a local file is the same as the saved file of meta
+ * without getting any block from the server: the local file is cut with
+ * each block size that cdpfglclient may have used and its blocks are
+ * compared to the hashs of meta. The block size is not saved in the meta
+ * data: a file saved with a custom block size (-b option) can not be
+ * compared and no block of it matches whatever its content is.
+ * @param filename is the name of the local file (a regular file of the
+ *        same size as the saved one).
+ * @param meta is the meta data of the saved file with its hashs.
+ * @returns REUSE_IDENTICAL if the local file has the same content,
+ *          REUSE_DIFFERENT if it differs and REUSE_UNKNOWN_BLOCKSIZE if
+ *          no known block size fits the saved file (nothing can be told
+ *          then).
+ */
+extern reuse_compare_t compare_local_copy(gchar *filename, meta_data_t *meta);
+
+
+/**
+ * Tells whether the saved file of meta has blocks full of zeros (that
+ * are left as holes when it is restored on its own).
+ * @param meta is the meta data of the file to be restored.
+ * @returns TRUE if at least one block of the file is full of zeros.
+ */
+extern gboolean has_zero_blocks(meta_data_t *meta);
+
+
+/**
+ * Restores the data of the file of meta leaving its zero blocks as holes
+ * and reusing the blocks of seed that did not change. When this is not
+ * possible the file is emptied and every block is fetched (see
+ * fetch_hash_list_to_stream()).
+ * @param comm is the communication structure to use.
+ * @param stream is the stream of the file to be restored (MUST be opened,
+ *        empty and not NULL).
+ * @param meta is the meta data of the file to be restored.
+ * @param seed is the filename of a local copy of this file or NULL.
+ * @returns TRUE if the file has been restored without fetching every
+ *          block and FALSE otherwise.
+ */
+extern gboolean fetch_reusing_local_blocks(comm_t *comm, GFileOutputStream *stream, meta_data_t *meta, gchar *seed);
+
+
+/**
+ * Replaces the local copy whose blocks were reused by the restored file
+ * (only when restoring with --reuse at the place of the local copy).
+ * @param filename is the name of the restored (and closed) file.
+ * @param seed is the name of the local copy that is replaced.
+ * @returns TRUE if the restored file is now named seed and FALSE
+ *          otherwise (it is then left beside the local copy).
+ */
+extern gboolean replace_seed_with_restored_file(gchar *filename, gchar *seed);
+
+
+#endif /* #ifndef _RESTORE_REUSE_H_ */
@@ -0,0 +1,648 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    tree.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file restore/tree.c
+ *
+ * This file contains the functions that restore many files at once.
+ * Restoring a directory of small files one file after the other costs
+ * at least one round trip to the server per file: here the blocks of
+ * many files are asked in the same request and several requests are in
+ * flight at the same time.
+ */
+
+#include "restore.h"
+
+static gchar *get_basename_to_restore(options_t *opt, meta_data_t *meta);
+static void free_tree_file_t(gpointer data);
+static void free_tree_batch_t(gpointer data);
+static void create_placeholder(tree_file_t *tree_file);
+static void add_file_to_batches(tree_t *tree, tree_file_t *tree_file);
+static void prepare_entry(tree_t *tree, options_t *opt, meta_data_t *meta);
+static GFileOutputStream *open_restored_file(tree_file_t *tree_file);
+static void close_restored_file(tree_file_t *tree_file, GFileOutputStream *stream);
+static GList *write_blocks_to_file(tree_file_t *tree_file, GList *blocks);
+static void restore_file_alone(comm_t *comm, tree_file_t *tree_file);
+static tree_batch_t *take_next_batch(tree_t *tree);
+static gpointer tree_worker(gpointer data);
+static void set_attributes_of_every_entry(tree_t *tree);
+
+
+/**
+ * @param opt is the options of the program.
+ * @returns a newly allocated string with the directory where files are
+ *          restored: --where option if it is a directory or the current
+ *          directory.
+ */
+gchar *get_where_to_restore(options_t *opt)
+{
+    gchar *where = NULL;
+
+    if (opt->where != NULL && g_file_test(opt->where, G_FILE_TEST_IS_DIR))
+        {
+            where = g_strdup(opt->where);
+        }
+    else
+        {
+            /* Fall back to get the current directory to make the file to be restored in it */
+            where = g_get_current_dir();
+        }
+
+    return where;
+}
+
+
+/**
+ * @param opt is the options of the program.
+ * @param meta is the meta data of the file to be restored.
+ * @returns a newly allocated string with the name of the file relative to
+ *          the directory where it is restored: its whole path with
+ *          --parents and its basename otherwise.
+ */
+static gchar *get_basename_to_restore(options_t *opt, meta_data_t *meta)
+{
+    if (opt->parents == FALSE)
+        {
+            return g_path_get_basename(meta->name);
+        }
+    else
+        {
+            return g_strdup(meta->name);
+        }
+}
+
+
+/**
+ * Makes the name that the file of meta would have once restored
+ * according to the options (--where, --parents and --all-versions)
+ * whether a file with that name already exists or not.
+ * @param opt is the options of the program.
+ * @param meta is the meta data of the file to be restored.
+ * @returns a newly allocated filename that may be freed with
+ *          free_variable() when no longer needed.
+ */
+gchar *get_wanted_filename(options_t *opt, meta_data_t *meta)
+{
+    gchar *basename = NULL;
+    gchar *newname = NULL;
+    gchar *where = NULL;
+    gchar *filename = NULL;
+    gchar *the_date = NULL;
+
+    where = get_where_to_restore(opt);
+    basename = get_basename_to_restore(opt, meta);
+
+    if (opt->all_versions == TRUE)
+        {
+            the_date = transform_date_to_string(meta->mtime, TRUE);
+            newname = g_strdup_printf("%s_%s", the_date, basename);
+        }
+    else
+        {
+            newname = g_strdup(basename);
+        }
+
+    filename = g_build_filename(where, newname, NULL);
+
+    free_variable(where);
+    free_variable(basename);
+    free_variable(newname);
+    free_variable(the_date);
+
+    return filename;
+}
+
+
+/**
+ * Makes the name of the file where meta is to be restored according to
+ * the options (--where, --parents and --all-versions) and creates its
+ * directories if needed. The name is one that does not exist yet.
+ * @param opt is the options of the program.
+ * @param meta is the meta data of the file to be restored.
+ * @returns a newly allocated filename that may be freed with
+ *          free_variable() when no longer needed.
+ */
+gchar *get_filename_to_restore(options_t *opt, meta_data_t *meta)
+{
+    gchar *basename = NULL;    /** basename for the file to be restored        */
+    gchar *newname = NULL;     /** Effective name that the file will have      */
+    gchar *where = NULL;       /** directory where to restore the file         */
+    gchar *filename = NULL;    /** filename of the restored file               */
+    gchar *dirname = NULL;
+    gchar *the_date = NULL;    /** String containing file's last modified date */
+
+    where = get_where_to_restore(opt);
+    basename = get_basename_to_restore(opt, meta);
+
+    if (opt->all_versions == TRUE)
+        {
+            the_date = transform_date_to_string(meta->mtime, TRUE);
+            newname = g_strdup_printf("%s_%s", the_date, basename);
+        }
+    else
+        {
+            newname = g_strdup(basename);
+        }
+
+    filename = get_unique_filename(opt->all_versions, basename, where, newname, the_date);
+
+    if (opt->parents == TRUE)
+        {
+            dirname = g_path_get_dirname(filename);
+            create_directory(dirname);
+            free_variable(dirname);
+        }
+
+    print_debug(_("filename to restore: %s\n"), filename);
+
+    free_variable(where);
+    free_variable(basename);
+    free_variable(newname);
+    free_variable(the_date);
+
+    return filename;
+}
+
+
+/**
+ * Frees a tree_file_t * structure (handler for g_ptr_array_new_with_free_func).
+ * @param data must be a tree_file_t * structure.
+ */
+static void free_tree_file_t(gpointer data)
+{
+    tree_file_t *tree_file = (tree_file_t *) data;
+
+    if (tree_file != NULL)
+        {
+            free_variable(tree_file->filename);
+            free_variable(tree_file->seed);
+            free_variable(tree_file);
+        }
+}
+
+
+/**
+ * Frees a tree_batch_t * structure but not its files nor its hashs
+ * (handler for g_ptr_array_new_with_free_func).
+ * @param data must be a tree_batch_t * structure.
+ */
+static void free_tree_batch_t(gpointer data)
+{
+    tree_batch_t *batch = (tree_batch_t *) data;
+
+    if (batch != NULL)
+        {
+            g_ptr_array_free(batch->files, TRUE);
+            g_list_free(batch->hash_list);
+            free_variable(batch);
+        }
+}
+
+
+/**
+ * Creates the (empty) file where data will be written so that the name
+ * is taken. Empty files are restored once this is done.
+ * @param tree_file is the file to be restored.
+ */
+static void create_placeholder(tree_file_t *tree_file)
+{
+    GFile *file = NULL;
+    GFileOutputStream *stream = NULL;
+    GError *error = NULL;
+
+    file = g_file_new_for_path(tree_file->filename);
+    stream = g_file_create(file, G_FILE_CREATE_NONE, NULL, &error);
+
+    if (stream != NULL)
+        {
+            g_output_stream_close((GOutputStream *) stream, NULL, NULL);
+            free_object(stream);
+        }
+    else if (error != NULL)
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to create file %s (%s).\n"), tree_file->filename, error->message);
+            free_error(error);
+        }
+
+    free_object(file);
+}
+
+
+/**
+ * Adds a file to the last batch or to a new one when the last batch is
+ * full. A file with more blocks than a batch, with a local copy to
+ * reuse or with zero blocks (to be left as holes) is restored on its own.
+ * @param tree is the state of the restoration.
+ * @param tree_file is the file to be restored (with at least one block).
+ */
+static void add_file_to_batches(tree_t *tree, tree_file_t *tree_file)
+{
+    tree_batch_t *batch = NULL;
+    GList *hash_list = NULL;
+
+    if (tree_file->nb_hashs > FETCH_BATCH_SIZE || tree_file->seed != NULL || (tree_file->nb_hashs > 1 && has_zero_blocks(tree_file->meta) == TRUE))
+        {
+            g_ptr_array_add(tree->big_files, tree_file);
+        }
+    else
+        {
+            if (tree->batches->len > 0)
+                {
+                    batch = g_ptr_array_index(tree->batches, tree->batches->len - 1);
+                }
+
+            if (batch == NULL || batch->nb_hashs + tree_file->nb_hashs > FETCH_BATCH_SIZE)
+                {
+                    batch = (tree_batch_t *) g_malloc0(sizeof(tree_batch_t));
+                    batch->files = g_ptr_array_new();
+                    batch->hash_list = NULL;
+                    batch->nb_hashs = 0;
+                    g_ptr_array_add(tree->batches, batch);
+                }
+
+            /* Hashs are prepended to keep this linear and the list is reversed before use */
+            for (hash_list = tree_file->meta->hash_data_list; hash_list != NULL; hash_list = g_list_next(hash_list))
+                {
+                    batch->hash_list = g_list_prepend(batch->hash_list, hash_list->data);
+                }
+
+            batch->nb_hashs = batch->nb_hashs + tree_file->nb_hashs;
+            g_ptr_array_add(batch->files, tree_file);
+        }
+}
+
+
+/**
+ * Chooses the name of an entry of the list and creates it: directories
+ * (with --parents only, otherwise the tree is flattened), symbolic links
+ * and empty files that are then added to the batches.
+ * @param tree is the state of the restoration.
+ * @param opt is the options of the program.
+ * @param meta is the meta data of the entry to be restored.
+ */
+static void prepare_entry(tree_t *tree, options_t *opt, meta_data_t *meta)
+{
+    tree_file_t *tree_file = NULL;
+    GFile *file = NULL;
+    gchar *where = NULL;
+
+    if (meta->file_type == G_FILE_TYPE_DIRECTORY)
+        {
+            if (opt->parents == TRUE)
+                {
+                    tree_file = (tree_file_t *) g_malloc0(sizeof(tree_file_t));
+                    tree_file->meta = meta;
+                    where = get_where_to_restore(opt);
+                    tree_file->filename = g_build_filename(where, meta->name, NULL);
+                    tree_file->nb_hashs = 0;
+                    free_variable(where);
+
+                    create_directory(tree_file->filename);
+                }
+        }
+    else
+        {
+            tree_file = (tree_file_t *) g_malloc0(sizeof(tree_file_t));
+            tree_file->meta = meta;
+            tree_file->filename = get_filename_to_restore(opt, meta);
+            tree_file->nb_hashs = g_list_length(meta->hash_data_list);
+
+            if (g_strcmp0("", meta->link) == 0)
+                {
+                    if (tree_file->nb_hashs > 0)
+                        {
+                            /* Before the placeholder that may take the wanted name */
+                            tree_file->seed = get_seed_filename(opt, meta, &tree_file->replace);
+                        }
+
+                    create_placeholder(tree_file);
+
+                    if (tree_file->nb_hashs > 0)
+                        {
+                            add_file_to_batches(tree, tree_file);
+                        }
+                }
+            else
+                {
+                    file = g_file_new_for_path(tree_file->filename);
+                    make_symbolic_link(file, meta->link);
+                    free_object(file);
+                }
+        }
+
+    if (tree_file != NULL)
+        {
+            g_ptr_array_add(tree->files, tree_file);
+        }
+}
+
+
+/**
+ * Opens a file created by create_placeholder() to write its data.
+ * @param tree_file is the file to be restored.
+ * @returns a GFileOutputStream * or NULL on error.
+ */
+static GFileOutputStream *open_restored_file(tree_file_t *tree_file)
+{
+    GFile *file = NULL;
+    GFileOutputStream *stream = NULL;
+    GError *error = NULL;
+
+    file = g_file_new_for_path(tree_file->filename);
+    stream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+
+    if (stream == NULL && error != NULL)
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to open file %s to write data in it (%s).\n"), tree_file->filename, error->message);
+            free_error(error);
+        }
+
+    free_object(file);
+
+    return stream;
+}
+
+
+/**
+ * Closes a restored file.
+ * @param tree_file is the file that has been restored.
+ * @param stream is the stream opened by open_restored_file() (may be NULL).
+ */
+static void close_restored_file(tree_file_t *tree_file, GFileOutputStream *stream)
+{
+    GError *error = NULL;
+
+    if (stream != NULL)
+        {
+            if (g_output_stream_close((GOutputStream *) stream, NULL, &error) == FALSE && error != NULL)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while closing file %s (%s).\n"), tree_file->filename, error->message);
+                    free_error(error);
+                }
+
+            free_object(stream);
+        }
+}
+
+
+/**
+ * Writes the blocks of one file of a batch.
+ * @param tree_file is the file to be restored.
+ * @param blocks is the link of the first uncompressed block (hash_data_t *)
+ *        of this file in the list received for its batch.
+ * @returns the link of the first block of the next file of the batch.
+ */
+static GList *write_blocks_to_file(tree_file_t *tree_file, GList *blocks)
+{
+    GFileOutputStream *stream = NULL;
+    hash_data_t *hash_data = NULL;
+    GError *error = NULL;
+    guint i = 0;
+
+    stream = open_restored_file(tree_file);
+
+    for (i = 0; i < tree_file->nb_hashs && blocks != NULL; i++)
+        {
+            hash_data = blocks->data;
+
+            if (stream != NULL && error == NULL)
+                {
+                    g_output_stream_write_all((GOutputStream *) stream, hash_data->data, hash_data->read, NULL, NULL, &error);
+                }
+
+            blocks = g_list_next(blocks);
+        }
+
+    if (error != NULL)
+        {
+            print_error(__FILE__, __LINE__, _("Error while writing data to file %s (%s).\n"), tree_file->filename, error->message);
+            free_error(error);
+        }
+
+    close_restored_file(tree_file, stream);
+
+    return blocks;
+}
+
+
+/**
+ * Restores one file with its own requests reusing the blocks of its local
+ * copy if any (see fetch_reusing_local_blocks()). With --reuse the local
+ * copy is then replaced by the restored file.
+ * @param comm is the communication structure to use.
+ * @param tree_file is the file to be restored.
+ */
+static void restore_file_alone(comm_t *comm, tree_file_t *tree_file)
+{
+    GFileOutputStream *stream = NULL;
+    gboolean reused = FALSE;
+
+    stream = open_restored_file(tree_file);
+
+    if (stream != NULL)
+        {
+            reused = fetch_reusing_local_blocks(comm, stream, tree_file->meta, tree_file->seed);
+            close_restored_file(tree_file, stream);
+
+            if (reused == TRUE && tree_file->replace == TRUE && replace_seed_with_restored_file(tree_file->filename, tree_file->seed) == TRUE)
+                {
+                    free_variable(tree_file->filename);
+                    tree_file->filename = tree_file->seed;
+                    tree_file->seed = NULL;
+                }
+        }
+}
+
+
+/**
+ * Gives the next batch to a worker.
+ * @param tree is the state of the restoration.
+ * @returns the next batch or NULL when every batch has been taken.
+ */
+static tree_batch_t *take_next_batch(tree_t *tree)
+{
+    tree_batch_t *batch = NULL;
+
+    g_mutex_lock(&tree->mutex);
+
+    if (tree->next_batch < tree->batches->len)
+        {
+            batch = g_ptr_array_index(tree->batches, tree->next_batch);
+            tree->next_batch = tree->next_batch + 1;
+        }
+
+    g_mutex_unlock(&tree->mutex);
+
+    return batch;
+}
+
+
+/**
+ * Worker thread: gets batches from the server with its own connection
+ * and writes the files of each batch. When a batch can not be received
+ * at once its files are restored one by one.
+ * @param data is the tree_t * state of the restoration.
+ * @returns NULL.
+ */
+static gpointer tree_worker(gpointer data)
+{
+    tree_t *tree = (tree_t *) data;
+    tree_batch_t *batch = NULL;
+    comm_t *comm = NULL;
+    GList *blocks = NULL;
+    GList *head = NULL;
+    guint i = 0;
+
+    comm = init_comm_struct(tree->comm->conn, tree->comm->cmptype);
+
+    while ((batch = take_next_batch(tree)) != NULL)
+        {
+            head = fetch_batch_from_server(comm, batch->hash_list, batch->nb_hashs);
+            blocks = head;
+
+            for (i = 0; i < batch->files->len; i++)
+                {
+                    if (head != NULL)
+                        {
+                            blocks = write_blocks_to_file(g_ptr_array_index(batch->files, i), blocks);
+                        }
+                    else
+                        {
+                            restore_file_alone(comm, g_ptr_array_index(batch->files, i));
+                        }
+                }
+
+            g_list_free_full(head, free_hdt_struct);
+        }
+
+    free_comm_t(comm);
+
+    return NULL;
+}
+
+
+/**
+ * Sets attributes and dates of every restored entry except links. Last
+ * entries of the list (the deepest ones) come first so that a directory
+ * gets its dates after everything in it has been restored.
+ * @param tree is the state of the restoration.
+ */
+static void set_attributes_of_every_entry(tree_t *tree)
+{
+    tree_file_t *tree_file = NULL;
+    GFile *file = NULL;
+    guint i = 0;
+
+    for (i = tree->files->len; i > 0; i--)
+        {
+            tree_file = g_ptr_array_index(tree->files, i - 1);
+
+            if (g_strcmp0("", tree_file->meta->link) == 0)
+                {
+                    file = g_file_new_for_path(tree_file->filename);
+                    set_file_attributes(file, tree_file->meta);
+                    free_object(file);
+                }
+        }
+}
+
+
+/**
+ * Restores every file of the list. Names are chosen and files,
+ * directories and links are created in the order of the list. Then the
+ * data of files are fetched and written by a pool of workers, the blocks
+ * of many small files being asked in the same request. Attributes and
+ * dates are set in a final pass (deepest entries first) so that writing
+ * in a directory does not change its modification time afterwards.
+ * @param comm is the communication structure of the program.
+ * @param opt is the options of the program.
+ * @param list is a GSList of server_meta_data_t * to be restored sorted
+ *        by filename.
+ */
+void restore_tree(comm_t *comm, options_t *opt, GSList *list)
+{
+    tree_t tree;
+    tree_batch_t *batch = NULL;
+    server_meta_data_t *smeta = NULL;
+    GThread *workers[FETCH_WORKERS];
+    guint nb_workers = 0;
+    guint i = 0;
+
+    tree.comm = comm;
+    tree.files = g_ptr_array_new_with_free_func(free_tree_file_t);
+    tree.batches = g_ptr_array_new_with_free_func(free_tree_batch_t);
+    tree.big_files = g_ptr_array_new();
+    tree.next_batch = 0;
+    g_mutex_init(&tree.mutex);
+
+    /* Names have to be chosen in order: two versions may go to the same name */
+    while (list != NULL)
+        {
+            smeta = (server_meta_data_t *) list->data;
+
+            if (smeta != NULL && smeta->meta != NULL)
+                {
+                    prepare_entry(&tree, opt, smeta->meta);
+                }
+
+            list = g_slist_next(list);
+        }
+
+    for (i = 0; i < tree.batches->len; i++)
+        {
+            batch = g_ptr_array_index(tree.batches, i);
+            batch->hash_list = g_list_reverse(batch->hash_list);
+        }
+
+    print_debug(_("%d entries to restore, %d batches of small files and %d files restored one by one\n"), tree.files->len, tree.batches->len, tree.big_files->len);
+
+    nb_workers = MIN(FETCH_WORKERS, tree.batches->len);
+
+    if (nb_workers == 1)
+        {
+            tree_worker(&tree);
+        }
+    else
+        {
+            for (i = 0; i < nb_workers; i++)
+                {
+                    workers[i] = g_thread_new("tree", tree_worker, &tree);
+                }
+
+            for (i = 0; i < nb_workers; i++)
+                {
+                    g_thread_join(workers[i]);
+                }
+        }
+
+    /* Each of these files is already asked with several requests in flight */
+    for (i = 0; i < tree.big_files->len; i++)
+        {
+            restore_file_alone(comm, g_ptr_array_index(tree.big_files, i));
+        }
+
+    set_attributes_of_every_entry(&tree);
+
+    g_ptr_array_free(tree.big_files, TRUE);
+    g_ptr_array_free(tree.batches, TRUE);
+    g_ptr_array_free(tree.files, TRUE);
+    g_mutex_clear(&tree.mutex);
+}
@@ -0,0 +1,127 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    tree.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file restore/tree.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * used by 'cdpfglrestore' to restore many files at once: blocks of small
+ * files are asked together and files are written by a pool of workers.
+ */
+#ifndef _RESTORE_TREE_H_
+#define _RESTORE_TREE_H_
+
+
+/**
+ * @struct tree_file_t
+ * @brief One file (or directory or link) to be restored.
+ */
+typedef struct
+{
+    meta_data_t *meta;   /**< meta data of the file (belongs to the list of files) */
+    gchar *filename;     /**< name of the restored file                            */
+    guint nb_hashs;      /**< number of blocks of the file                         */
+    gchar *seed;         /**< local copy whose blocks may be reused or NULL        */
+    gboolean replace;    /**< TRUE when the restored file has to replace seed      */
+} tree_file_t;
+
+
+/**
+ * @struct tree_batch_t
+ * @brief Files whose blocks are all asked in one request.
+ */
+typedef struct
+{
+    GPtrArray *files;    /**< tree_file_t * files of the batch in order               */
+    GList *hash_list;    /**< hash_data_t * of those files (data belong to the files) */
+    guint nb_hashs;      /**< number of hashs in hash_list                            */
+} tree_batch_t;
+
+
+/**
+ * @struct tree_t
+ * @brief State of the restoration of a list of files.
+ *
+ * Files with no more than FETCH_BATCH_SIZE blocks are gathered into
+ * batches that FETCH_WORKERS workers get from the server and write.
+ * Bigger files, files with a local copy to reuse and sparse files are
+ * restored afterwards, each one with parallel requests.
+ */
+typedef struct
+{
+    comm_t *comm;           /**< Communication structure of the program                 */
+    GPtrArray *files;       /**< tree_file_t * every entry to be restored in list order */
+    GPtrArray *batches;     /**< tree_batch_t * batches of small files                  */
+    GPtrArray *big_files;   /**< tree_file_t * files restored one by one                */
+    guint next_batch;       /**< Index of the next batch to be taken by a worker        */
+    GMutex mutex;           /**< Protects next_batch                                    */
+} tree_t;
+
+
+/**
+ * @param opt is the options of the program.
+ * @returns a newly allocated string with the directory where files are
+ *          restored: --where option if it is a directory or the current
+ *          directory.
+ */
+extern gchar *get_where_to_restore(options_t *opt);
+
+
+/**
+ * Makes the name that the file of meta would have once restored
+ * according to the options (--where, --parents and --all-versions)
+ * whether a file with that name already exists or not.
+ * @param opt is the options of the program.
+ * @param meta is the meta data of the file to be restored.
+ * @returns a newly allocated filename that may be freed with
+ *          free_variable() when no longer needed.
+ */
+extern gchar *get_wanted_filename(options_t *opt, meta_data_t *meta);
+
+
+/**
+ * Makes the name of the file where meta is to be restored according to
+ * the options (--where, --parents and --all-versions) and creates its
+ * directories if needed. The name is one that does not exist yet.
+ * @param opt is the options of the program.
+ * @param meta is the meta data of the file to be restored.
+ * @returns a newly allocated filename that may be freed with
+ *          free_variable() when no longer needed.
+ */
+extern gchar *get_filename_to_restore(options_t *opt, meta_data_t *meta);
+
+
+/**
+ * Restores every file of the list. Names are chosen and files,
+ * directories and links are created in the order of the list. Then the
+ * data of files are fetched and written by a pool of workers, the blocks
+ * of many small files being asked in the same request. Attributes and
+ * dates are set in a final pass (deepest entries first) so that writing
+ * in a directory does not change its modification time afterwards.
+ * @param comm is the communication structure of the program.
+ * @param opt is the options of the program.
+ * @param list is a GSList of server_meta_data_t * to be restored sorted
+ *        by filename.
+ */
+extern void restore_tree(comm_t *comm, options_t *opt, GSList *list);
+
+
+#endif /* #ifndef _RESTORE_TREE_H_ */
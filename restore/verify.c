@@ -0,0 +1,300 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    verify.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file restore/verify.c
+ *
+ * This file contains the functions that compare local files to saved
+ * ones. Only meta data and hashs are known from the server: local files
+ * are cut into blocks and hashed (see compare_local_copy()) so no
+ * data is transfered.
+ */
+
+#include "restore.h"
+
+static gchar *get_local_filename(options_t *opt, meta_data_t *meta);
+static void free_verify_file_t(gpointer data);
+static verify_status_t compare_local_file(verify_file_t *verify_file);
+static verify_file_t *take_next_file(verify_t *verify);
+static gpointer verify_worker(gpointer data);
+static gboolean print_verify_report(verify_t *verify);
+
+
+/**
+ * @param opt is the options of the program.
+ * @param meta is the meta data of the saved file.
+ * @returns a newly allocated string with the name of the local file to
+ *          compare with the saved one: its own name or, with --where,
+ *          its whole path in that directory.
+ */
+static gchar *get_local_filename(options_t *opt, meta_data_t *meta)
+{
+    if (opt->where != NULL)
+        {
+            return g_build_filename(opt->where, meta->name, NULL);
+        }
+    else
+        {
+            return g_strdup(meta->name);
+        }
+}
+
+
+/**
+ * Frees a verify_file_t * structure (handler for g_ptr_array_new_with_free_func).
+ * @param data must be a verify_file_t * structure.
+ */
+static void free_verify_file_t(gpointer data)
+{
+    verify_file_t *verify_file = (verify_file_t *) data;
+
+    if (verify_file != NULL)
+        {
+            free_variable(verify_file->filename);
+            free_variable(verify_file);
+        }
+}
+
+
+/**
+ * Compares one local file with the saved one: directories only have to
+ * exist, links have to point to the same target and regular files have
+ * to have the same size and the same blocks.
+ * @param verify_file is the file to be compared.
+ * @returns the status of the local file.
+ */
+static verify_status_t compare_local_file(verify_file_t *verify_file)
+{
+    meta_data_t *meta = verify_file->meta;
+    verify_status_t status = VERIFY_CHANGED;
+    reuse_compare_t compare = REUSE_DIFFERENT;
+    GStatBuf stat_buf;
+    gchar *target = NULL;
+
+    if (g_lstat(verify_file->filename, &stat_buf) != 0)
+        {
+            status = VERIFY_MISSING;
+        }
+    else if (meta->file_type == G_FILE_TYPE_DIRECTORY)
+        {
+            if (S_ISDIR(stat_buf.st_mode))
+                {
+                    status = VERIFY_MATCHING;
+                }
+        }
+    else if (g_strcmp0("", meta->link) != 0)
+        {
+            if (S_ISLNK(stat_buf.st_mode))
+                {
+                    target = g_file_read_link(verify_file->filename, NULL);
+
+                    if (g_strcmp0(target, meta->link) == 0)
+                        {
+                            status = VERIFY_MATCHING;
+                        }
+
+                    free_variable(target);
+                }
+        }
+    else if (S_ISREG(stat_buf.st_mode) && (guint64) stat_buf.st_size == meta->size)
+        {
+            compare = compare_local_copy(verify_file->filename, meta);
+
+            if (compare == REUSE_IDENTICAL)
+                {
+                    status = VERIFY_MATCHING;
+                }
+            else if (compare == REUSE_UNKNOWN_BLOCKSIZE)
+                {
+                    status = VERIFY_UNKNOWN;
+                }
+        }
+
+    return status;
+}
+
+
+/**
+ * Gives the next file to be compared to a worker.
+ * @param verify is the state of the comparison.
+ * @returns the next file or NULL when every file has been taken.
+ */
+static verify_file_t *take_next_file(verify_t *verify)
+{
+    verify_file_t *verify_file = NULL;
+
+    g_mutex_lock(&verify->mutex);
+
+    if (verify->next_file < verify->files->len)
+        {
+            verify_file = g_ptr_array_index(verify->files, verify->next_file);
+            verify->next_file = verify->next_file + 1;
+        }
+
+    g_mutex_unlock(&verify->mutex);
+
+    return verify_file;
+}
+
+
+/**
+ * Worker thread: compares files until every file has been taken.
+ * @param data is the verify_t * state of the comparison.
+ * @returns NULL.
+ */
+static gpointer verify_worker(gpointer data)
+{
+    verify_t *verify = (verify_t *) data;
+    verify_file_t *verify_file = NULL;
+
+    while ((verify_file = take_next_file(verify)) != NULL)
+        {
+            verify_file->status = compare_local_file(verify_file);
+        }
+
+    return NULL;
+}
+
+
+/**
+ * Prints the status of each file in list order and then how many files
+ * are matching, changed and missing.
+ * @param verify is the state of the comparison (every file compared).
+ * @returns TRUE if every local file matches and FALSE otherwise.
+ */
+static gboolean print_verify_report(verify_t *verify)
+{
+    verify_file_t *verify_file = NULL;
+    guint nb_matching = 0;
+    guint nb_changed = 0;
+    guint nb_missing = 0;
+    guint nb_unknown = 0;
+    guint i = 0;
+
+    for (i = 0; i < verify->files->len; i++)
+        {
+            verify_file = g_ptr_array_index(verify->files, i);
+
+            if (verify_file->status == VERIFY_MATCHING)
+                {
+                    fprintf(stdout, _("matching: %s\n"), verify_file->filename);
+                    nb_matching = nb_matching + 1;
+                }
+            else if (verify_file->status == VERIFY_CHANGED)
+                {
+                    fprintf(stdout, _("changed: %s\n"), verify_file->filename);
+                    nb_changed = nb_changed + 1;
+                }
+            else if (verify_file->status == VERIFY_UNKNOWN)
+                {
+                    fprintf(stdout, _("unknown blocksize: %s\n"), verify_file->filename);
+                    nb_unknown = nb_unknown + 1;
+                }
+            else
+                {
+                    fprintf(stdout, _("missing: %s\n"), verify_file->filename);
+                    nb_missing = nb_missing + 1;
+                }
+        }
+
+    fprintf(stdout, _("%d files matching, %d changed, %d missing and %d of unknown blocksize.\n"), nb_matching, nb_changed, nb_missing, nb_unknown);
+
+    return (nb_changed == 0 && nb_missing == 0 && nb_unknown == 0);
+}
+
+
+/**
+ * Compares the latest version of each file of the list with the local
+ * file that has the same name (under --where directory if any). Local
+ * files are hashed by several workers and compared to the hashs of the
+ * list: nothing but meta data is needed from the server. Each file is
+ * reported as matching, changed, missing or of unknown block size (it
+ * can not be compared) followed by a summary.
+ * @param opt is the options of the program.
+ * @param list is a GSList of server_meta_data_t * with their hashs sorted
+ *        by filename and then by modification time.
+ * @returns TRUE if every local file matches and FALSE otherwise.
+ */
+gboolean verify_tree(options_t *opt, GSList *list)
+{
+    verify_t verify;
+    verify_file_t *verify_file = NULL;
+    server_meta_data_t *smeta = NULL;
+    server_meta_data_t *next = NULL;
+    GThread **workers = NULL;
+    guint nb_workers = 0;
+    guint i = 0;
+    gboolean ok = TRUE;
+
+    verify.files = g_ptr_array_new_with_free_func(free_verify_file_t);
+    verify.next_file = 0;
+    g_mutex_init(&verify.mutex);
+
+    while (list != NULL)
+        {
+            smeta = (server_meta_data_t *) list->data;
+            next = (list->next != NULL) ? (server_meta_data_t *) list->next->data : NULL;
+
+            /* Only the latest version of a file is compared */
+            if (smeta != NULL && smeta->meta != NULL && (next == NULL || next->meta == NULL || g_strcmp0(smeta->meta->name, next->meta->name) != 0))
+                {
+                    verify_file = (verify_file_t *) g_malloc0(sizeof(verify_file_t));
+                    verify_file->meta = smeta->meta;
+                    verify_file->filename = get_local_filename(opt, smeta->meta);
+                    verify_file->status = VERIFY_MISSING;
+                    g_ptr_array_add(verify.files, verify_file);
+                }
+
+            list = g_slist_next(list);
+        }
+
+    /* Hashing local files is CPU bound: one worker per processor */
+    nb_workers = MIN(g_get_num_processors(), verify.files->len);
+    print_debug(_("%d files to verify with %d workers\n"), verify.files->len, nb_workers);
+
+    if (nb_workers == 1)
+        {
+            verify_worker(&verify);
+        }
+    else if (nb_workers > 1)
+        {
+            workers = (GThread **) g_malloc0(nb_workers * sizeof(GThread *));
+
+            for (i = 0; i < nb_workers; i++)
+                {
+                    workers[i] = g_thread_new("verify", verify_worker, &verify);
+                }
+
+            for (i = 0; i < nb_workers; i++)
+                {
+                    g_thread_join(workers[i]);
+                }
+
+            free_variable(workers);
+        }
+
+    ok = print_verify_report(&verify);
+
+    g_ptr_array_free(verify.files, TRUE);
+    g_mutex_clear(&verify.mutex);
+
+    return ok;
+}
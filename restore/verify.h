@@ -0,0 +1,85 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    verify.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file restore/verify.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * used by 'cdpfglrestore' to compare local files to saved ones with their
+ * hashs only (no block is fetched from cdpfglserver).
+ */
+#ifndef _RESTORE_VERIFY_H_
+#define _RESTORE_VERIFY_H_
+
+
+/**
+ * @enum verify_status_t
+ * @brief Result of the comparison of a local file with the saved one.
+ */
+typedef enum
+{
+    VERIFY_MATCHING,    /**< local file is the same as the saved one      */
+    VERIFY_CHANGED,     /**< local file exists but differs from saved one */
+    VERIFY_MISSING,     /**< there is no local file                       */
+    VERIFY_UNKNOWN,     /**< saved with an unknown block size (-b option) */
+} verify_status_t;
+
+
+/**
+ * @struct verify_file_t
+ * @brief One saved file to be compared with its local copy.
+ */
+typedef struct
+{
+    meta_data_t *meta;       /**< meta data of the saved file (belongs to the list of files) */
+    gchar *filename;         /**< name of the local file                                     */
+    verify_status_t status;  /**< result of the comparison                                   */
+} verify_file_t;
+
+
+/**
+ * @struct verify_t
+ * @brief State of the comparison of a list of files shared by workers.
+ */
+typedef struct
+{
+    GPtrArray *files;   /**< verify_file_t * files to be compared in list order   */
+    guint next_file;    /**< Index of the next file to be taken by a worker        */
+    GMutex mutex;       /**< Protects next_file                                   */
+} verify_t;
+
+
+/**
+ * Compares the latest version of each file of the list with the local
+ * file that has the same name (under --where directory if any). Local
+ * files are hashed by several workers and compared to the hashs of the
+ * list: nothing but meta data is needed from the server. Each file is
+ * reported as matching, changed, missing or of unknown block size (it
+ * can not be compared) followed by a summary.
+ * @param opt is the options of the program.
+ * @param list is a GSList of server_meta_data_t * with their hashs sorted
+ *        by filename and then by modification time.
+ * @returns TRUE if every local file matches and FALSE otherwise.
+ */
+extern gboolean verify_tree(options_t *opt, GSList *list);
+
+
+#endif /* #ifndef _RESTORE_VERIFY_H_ */
@@ -36,12 +36,14 @@
  * @param store_data a function to store data
  * @param init_backend a function to init the backend
  * @param build_needed_hash_list a function that must build a GSList * needed hash list
- * @param get_list_of_files gets the list of saved files
+ * @param get_list_of_files gets a page of the list of saved files
  * @param retrieve_data retrieves data from a specified hash.
+ * @param foreach_stored_hash iterates over every stored hash (may be NULL).
  * @returns a newly created backend_t structure initialized to nothing !
  */
 backend_t *init_backend_structure(void *store_smeta, void *store_data, void *init_backend, void *terminate_backend,
-                                  void *build_needed_hash_list, void *get_list_of_files, void *retrieve_data)
+                                  void *build_needed_hash_list, void *get_list_of_files, void *retrieve_data,
+                                  void *foreach_stored_hash)
 {
     backend_t *backend = NULL;
 
@@ -55,6 +57,7 @@ backend_t *init_backend_structure(void *store_smeta, void *store_data, void *ini
     backend->build_needed_hash_list = build_needed_hash_list;
     backend->get_list_of_files = get_list_of_files;
     backend->retrieve_data = retrieve_data;
+    backend->foreach_stored_hash = foreach_stored_hash;
 
     return backend;
 }
@@ -139,6 +142,9 @@ gint get_backend_number_from_label(char *label)
     } else if (g_strcmp0(label, BACKEND_MINIO_LABEL) == 0)
     {
         return BACKEND_MINIO_NUM;
+    } else if (g_strcmp0(label, BACKEND_MEMORY_LABEL) == 0)
+    {
+        return BACKEND_MEMORY_NUM;
     } else
     {
         // invalid
@@ -158,4 +164,19 @@ void free_backend(backend_t *backend)
         g_free(backend->user_data);
         g_free(backend);
     }
-}
\ No newline at end of file
+}
+
+
+/**
+ * Tells whether the latest versions asked by a query are the versions
+ * still valid (valid_to is BACKEND_VALID_FOREVER). This is only true
+ * when no date restricts the versions to look at: otherwise the latest
+ * versions are the latest among the ones matching those dates.
+ * @param query is the query to be examined.
+ * @returns TRUE if the valid versions answer the query's latest request.
+ */
+gboolean latest_are_valid_versions(query_t *query)
+{
+    return (query != NULL && query->latest == TRUE && query->asof == NULL && query->date == NULL &&
+            query->afterdate == NULL && query->beforedate == NULL);
+}
@@ -35,6 +35,7 @@
 #define BACKEND_FILE_LABEL ("FILE")
 #define BACKEND_MONGODB_LABEL ("MONGODB")
 #define BACKEND_MINIO_LABEL ("MINIO")
+#define BACKEND_MEMORY_LABEL ("MEMORY")
 
 /** Numbers */
 #define BACKEND_INVALID_NUM (-1)
@@ -42,6 +43,15 @@
 #define BACKEND_FILE_NUM (1)
 #define BACKEND_MONGODB_NUM (2)
 #define BACKEND_MINIO_NUM (3)
+#define BACKEND_MEMORY_NUM (4)
+
+/**
+ * @def BACKEND_VALID_FOREVER
+ * valid_to value of the latest version of a file: meta backends keep for
+ * each version of a file the interval [valid_from, valid_to[ of time during
+ * which it was the current version of that file.
+ */
+#define BACKEND_VALID_FOREVER (G_MAXINT64)
 
 
 
@@ -56,13 +66,15 @@
  *       to the command line.
  */
 typedef void (* store_smeta_func) (void *, server_meta_data_t *);   /**< Stores a server_meta_data_t structure according to the backend                            */
-typedef void (* store_data_func) (void *, hash_data_t *);            /**< Stores a hash_data_t structure according to the backend                                    */
+typedef gboolean (* store_data_func) (void *, hash_data_t *);        /**< Stores a hash_data_t structure according to the backend and returns TRUE on success      */
 typedef GList * (* build_needed_hash_list_func) (void *, GList *);   /**< A function that will check if a hash is already known and build a list
                                                                       *   of needed hashs that the client may send                                                   */
 typedef void (* init_backend_func) (void *);                         /**< A function that will initialize the backend if needed                                      */
 typedef void (* terminate_backend_func) (void *);                         /**< A function that will terminate the backend if needed                                      */
-typedef gchar * (* get_list_of_files_func) (void *, query_t *);      /**< A function that returns a JSON formatted string of saved files corresponding to the query  */
+typedef GList * (* get_list_of_files_func) (void *, query_t *, guint64); /**< A function that returns a page of at most guint64 meta_data_t * corresponding to the query,
+                                                                          *   sorted by filename and mtime, that follows query->cursor and that updates query->cursor */
 typedef hash_data_t * (* retrieve_data_func) (void *, gchar *);      /**< A function that returns the buffer associated to a specific hash                           */
+typedef void (* foreach_stored_hash_func) (void *, GFunc, gpointer); /**< A function that calls GFunc with each stored hash (guint8 *) and the gpointer user data  */
 
 
 /**
@@ -80,6 +92,7 @@ typedef struct
     terminate_backend_func terminate_backend;
     get_list_of_files_func get_list_of_files;
     retrieve_data_func retrieve_data;
+    foreach_stored_hash_func foreach_stored_hash;
     void *user_data;                                     /**< user_data should be used by backends to store their own internal structure */
 } backend_t;
 
@@ -91,11 +104,12 @@ typedef struct
  * @param store_data a function to store data
  * @param init_backend a function to init the backend
  * @param build_needed_hash_list a function that must build a GSList * needed hash list
- * @param get_list_of_files gets the list of saved files
+ * @param get_list_of_files gets a page of the list of saved files
  * @param retrieve_data retrieves data from a specified hash.
+ * @param foreach_stored_hash iterates over every stored hash (may be NULL).
  * @returns a newly created backend_t structure initialized to nothing !
  */
-extern backend_t *init_backend_structure(void *store_smeta, void *store_data, void *init_backend, void *terminate_backend, void *build_needed_hash_list, void *get_list_of_files, void * retrieve_data);
+extern backend_t *init_backend_structure(void *store_smeta, void *store_data, void *init_backend, void *terminate_backend, void *build_needed_hash_list, void *get_list_of_files, void * retrieve_data, void *foreach_stored_hash);
 
 
 /**
@@ -123,4 +137,15 @@ extern gboolean check_backends_valid(backend_t *backend_meta, backend_t *backend
 extern void free_backend(backend_t *backend);
 
 
+/**
+ * Tells whether the latest versions asked by a query are the versions
+ * still valid (valid_to is BACKEND_VALID_FOREVER). This is only true
+ * when no date restricts the versions to look at: otherwise the latest
+ * versions are the latest among the ones matching those dates.
+ * @param query is the query to be examined.
+ * @returns TRUE if the valid versions answer the query's latest request.
+ */
+extern gboolean latest_are_valid_versions(query_t *query);
+
+
 #endif /* #ifndef _SERVER_BACKEND_H_ */
@@ -0,0 +1,324 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    block_cache.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/block_cache.c
+ *
+ * This file contains the functions of the cache of recently retrieved
+ * blocks. Restoring many versions of the same files reads the same blocks
+ * again and again: they are kept (as stored, compressed or not) in memory
+ * instead of being read again from the data backend.
+ */
+
+#include "server.h"
+
+static hash_data_t *copy_hash_data_t(hash_data_t *hash_data);
+static void free_block_cache_entry_t(gpointer data);
+static block_cache_shard_t *get_shard(block_cache_t *block_cache, gchar *hex_hash);
+static void evict_blocks(block_cache_shard_t *shard, guint64 max_size);
+
+
+/**
+ * Creates a new empty block cache.
+ * @param max_size is the maximum size in bytes of the data of the blocks
+ *        kept in the cache.
+ * @returns a newly allocated block_cache_t * structure that may be freed
+ *          with free_block_cache_t() or NULL if max_size is 0 (cache
+ *          disabled).
+ */
+block_cache_t *new_block_cache_t(guint64 max_size)
+{
+    block_cache_t *block_cache = NULL;
+    block_cache_shard_t *shard = NULL;
+    guint i = 0;
+
+    if (max_size > 0)
+        {
+            block_cache = (block_cache_t *) g_malloc0(sizeof(block_cache_t));
+            block_cache->shard_max_size = max_size / BLOCK_CACHE_SHARDS;
+
+            for (i = 0; i < BLOCK_CACHE_SHARDS; i++)
+                {
+                    shard = &block_cache->shards[i];
+                    shard->blocks = g_hash_table_new(g_str_hash, g_str_equal);
+                    shard->lru = g_queue_new();
+                    shard->size = 0;
+                    shard->hits = 0;
+                    shard->misses = 0;
+                    g_mutex_init(&shard->mutex);
+                }
+        }
+
+    return block_cache;
+}
+
+
+/**
+ * Frees a block_cache_t * structure and every block in it.
+ * @param block_cache is the structure to be freed.
+ */
+void free_block_cache_t(block_cache_t *block_cache)
+{
+    block_cache_shard_t *shard = NULL;
+    guint i = 0;
+
+    if (block_cache != NULL)
+        {
+            for (i = 0; i < BLOCK_CACHE_SHARDS; i++)
+                {
+                    shard = &block_cache->shards[i];
+                    g_hash_table_destroy(shard->blocks);
+                    g_queue_free_full(shard->lru, free_block_cache_entry_t);
+                    g_mutex_clear(&shard->mutex);
+                }
+
+            free_variable(block_cache);
+        }
+}
+
+
+/**
+ * Makes a copy of a block.
+ * @param hash_data is the block to be copied.
+ * @returns a newly allocated hash_data_t * that may be freed with
+ *          free_hash_data_t().
+ */
+static hash_data_t *copy_hash_data_t(hash_data_t *hash_data)
+{
+    guchar *data = NULL;
+    guint8 *hash = NULL;
+
+    if (hash_data->data != NULL)
+        {
+            data = (guchar *) g_malloc(hash_data->read);
+            memcpy(data, hash_data->data, hash_data->read);
+        }
+
+    if (hash_data->hash != NULL)
+        {
+            hash = (guint8 *) g_malloc(HASH_LEN);
+            memcpy(hash, hash_data->hash, HASH_LEN);
+        }
+
+    return new_hash_data_t_as_is(data, hash_data->read, hash, hash_data->cmptype, hash_data->uncmplen);
+}
+
+
+/**
+ * Frees one entry of the cache (handler for g_queue_free_full).
+ * @param data must be a block_cache_entry_t * structure.
+ */
+static void free_block_cache_entry_t(gpointer data)
+{
+    block_cache_entry_t *entry = (block_cache_entry_t *) data;
+
+    if (entry != NULL)
+        {
+            free_hash_data_t(entry->hash_data);
+            free_variable(entry->hex_hash);
+            free_variable(entry);
+        }
+}
+
+
+/**
+ * Selects the shard where a block is.
+ * @param block_cache is the cache.
+ * @param hex_hash is the hash of the block in hexadecimal form.
+ * @returns the shard of that block.
+ */
+static block_cache_shard_t *get_shard(block_cache_t *block_cache, gchar *hex_hash)
+{
+    return &block_cache->shards[g_str_hash(hex_hash) % BLOCK_CACHE_SHARDS];
+}
+
+
+/**
+ * Evicts least recently used blocks until the shard is not bigger than
+ * max_size. Must be called with the mutex of the shard locked.
+ * @param shard is the shard where to evict blocks.
+ * @param max_size is the maximum size in bytes of that shard.
+ */
+static void evict_blocks(block_cache_shard_t *shard, guint64 max_size)
+{
+    block_cache_entry_t *entry = NULL;
+
+    while (shard->size > max_size && g_queue_is_empty(shard->lru) == FALSE)
+        {
+            entry = (block_cache_entry_t *) g_queue_pop_tail(shard->lru);
+
+            g_hash_table_remove(shard->blocks, entry->hex_hash);
+            shard->size = shard->size - entry->hash_data->read;
+
+            free_block_cache_entry_t(entry);
+        }
+}
+
+
+/**
+ * Looks for a block in the cache. Thread safe.
+ * @param block_cache is the cache (may be NULL).
+ * @param hex_hash is the hash of the block in hexadecimal form.
+ * @returns a newly allocated copy of the block that may be freed with
+ *          free_hash_data_t() or NULL if the block is not in the cache.
+ */
+hash_data_t *block_cache_get(block_cache_t *block_cache, gchar *hex_hash)
+{
+    block_cache_shard_t *shard = NULL;
+    hash_data_t *hash_data = NULL;
+    GList *link = NULL;
+
+    if (block_cache != NULL && hex_hash != NULL)
+        {
+            shard = get_shard(block_cache, hex_hash);
+
+            g_mutex_lock(&shard->mutex);
+
+            link = g_hash_table_lookup(shard->blocks, hex_hash);
+
+            if (link != NULL)
+                {
+                    /* This block becomes the most recently used one */
+                    g_queue_unlink(shard->lru, link);
+                    g_queue_push_head_link(shard->lru, link);
+
+                    hash_data = copy_hash_data_t(((block_cache_entry_t *) link->data)->hash_data);
+                    shard->hits = shard->hits + 1;
+                }
+            else
+                {
+                    shard->misses = shard->misses + 1;
+                }
+
+            g_mutex_unlock(&shard->mutex);
+        }
+
+    return hash_data;
+}
+
+
+/**
+ * Inserts a copy of a block into the cache evicting the least recently
+ * used blocks of its shard if needed. Thread safe.
+ * @param block_cache is the cache (may be NULL in which case nothing is
+ *        done).
+ * @param hex_hash is the hash of the block in hexadecimal form.
+ * @param hash_data is the block as retrieved from the data backend. It is
+ *        not modified and still belongs to the caller.
+ */
+void block_cache_put(block_cache_t *block_cache, gchar *hex_hash, hash_data_t *hash_data)
+{
+    block_cache_shard_t *shard = NULL;
+    block_cache_entry_t *entry = NULL;
+
+    /* A block bigger than a shard would evict everything and then itself */
+    if (block_cache != NULL && hex_hash != NULL && hash_data != NULL && hash_data->read > 0 && (guint64) hash_data->read <= block_cache->shard_max_size)
+        {
+            shard = get_shard(block_cache, hex_hash);
+
+            g_mutex_lock(&shard->mutex);
+
+            /* Another thread may have inserted it in the meantime */
+            if (g_hash_table_contains(shard->blocks, hex_hash) == FALSE)
+                {
+                    entry = (block_cache_entry_t *) g_malloc(sizeof(block_cache_entry_t));
+                    entry->hex_hash = g_strdup(hex_hash);
+                    entry->hash_data = copy_hash_data_t(hash_data);
+
+                    g_queue_push_head(shard->lru, entry);
+                    g_hash_table_insert(shard->blocks, entry->hex_hash, g_queue_peek_head_link(shard->lru));
+                    shard->size = shard->size + entry->hash_data->read;
+
+                    evict_blocks(shard, block_cache->shard_max_size);
+                }
+
+            g_mutex_unlock(&shard->mutex);
+        }
+}
+
+
+/**
+ * Retrieves the data of a hash from the cache of blocks or, when it is
+ * not there, from the data backend (and then keeps it in the cache).
+ * @param block_cache is the cache (may be NULL).
+ * @param backend is the data backend. It must have a retrieve_data
+ *        function.
+ * @param server_struct is the main structure for the server (passed to
+ *        retrieve_data).
+ * @param hex_hash is the hash of the data in hexadecimal form.
+ * @returns a newly allocated hash_data_t * structure that may be freed
+ *          with free_hash_data_t() or NULL if the data was not found.
+ */
+hash_data_t *block_cache_retrieve_data(block_cache_t *block_cache, backend_t *backend, void *server_struct, gchar *hex_hash)
+{
+    hash_data_t *hash_data = NULL;
+    gint64 start = 0;
+
+    hash_data = block_cache_get(block_cache, hex_hash);
+
+    if (hash_data == NULL)
+        {
+            start = g_get_monotonic_time();
+            hash_data = backend->retrieve_data(server_struct, hex_hash);
+            add_latency_to_stats(((server_struct_t *) server_struct)->stats, STATS_LATENCY_RETRIEVE_DATA, start);
+            block_cache_put(block_cache, hex_hash, hash_data);
+        }
+
+    return hash_data;
+}
+
+
+/**
+ * Inserts statistics about the cache into a json object: number of hits,
+ * misses, blocks and bytes in the cache.
+ * @param root is the json object where to insert statistics.
+ * @param block_cache is the cache (may be NULL in which case everything
+ *        is 0).
+ */
+void insert_block_cache_stats_into_json_root(json_t *root, block_cache_t *block_cache)
+{
+    block_cache_shard_t *shard = NULL;
+    guint64 hits = 0;
+    guint64 misses = 0;
+    guint64 blocks = 0;
+    guint64 size = 0;
+    guint i = 0;
+
+    if (block_cache != NULL)
+        {
+            for (i = 0; i < BLOCK_CACHE_SHARDS; i++)
+                {
+                    shard = &block_cache->shards[i];
+
+                    g_mutex_lock(&shard->mutex);
+                    hits = hits + shard->hits;
+                    misses = misses + shard->misses;
+                    blocks = blocks + g_queue_get_length(shard->lru);
+                    size = size + shard->size;
+                    g_mutex_unlock(&shard->mutex);
+                }
+        }
+
+    insert_integer_value_into_json_root(root, "hits", hits);
+    insert_integer_value_into_json_root(root, "misses", misses);
+    insert_integer_value_into_json_root(root, "blocks", blocks);
+    insert_integer_value_into_json_root(root, "size", size);
+}
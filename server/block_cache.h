@@ -0,0 +1,148 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    block_cache.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/block_cache.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * used by 'cdpfglserver' to keep recently retrieved blocks of data in
+ * memory (least recently used ones are evicted first).
+ */
+#ifndef _SERVER_BLOCK_CACHE_H_
+#define _SERVER_BLOCK_CACHE_H_
+
+/**
+ * @def BLOCK_CACHE_SHARDS
+ * Number of shards of the cache. Each shard has its own lock so that
+ * MHD connexion threads rarely wait for each other.
+ *
+ * @def BLOCK_CACHE_DEFAULT_SIZE
+ * Default maximum size in bytes of the blocks kept in the cache (64 MB).
+ */
+#define BLOCK_CACHE_SHARDS (16)
+#define BLOCK_CACHE_DEFAULT_SIZE (67108864)
+
+
+/**
+ * @struct block_cache_entry_t
+ * @brief One block in the cache.
+ */
+typedef struct
+{
+    gchar *hex_hash;         /**< hash of the block in hexadecimal form (key of the hash table) */
+    hash_data_t *hash_data;  /**< the block as retrieved from the data backend                  */
+} block_cache_entry_t;
+
+
+/**
+ * @struct block_cache_shard_t
+ * @brief One shard of the cache: a hash table of blocks and their LRU
+ *        order.
+ */
+typedef struct
+{
+    GHashTable *blocks;    /**< hexadecimal hash -> GList * link of lru                        */
+    GQueue *lru;           /**< block_cache_entry_t * blocks, most recently used first         */
+    guint64 size;          /**< number of bytes of data of the blocks in this shard            */
+    guint64 hits;          /**< number of blocks found in this shard                           */
+    guint64 misses;        /**< number of blocks looked for and not found in this shard        */
+    GMutex mutex;          /**< Protects everything above (MHD connexion threads)              */
+} block_cache_shard_t;
+
+
+/**
+ * @struct block_cache_t
+ * @brief Size bounded cache of blocks of data as returned by the
+ *        retrieve_data function of the data backend.
+ */
+typedef struct
+{
+    block_cache_shard_t shards[BLOCK_CACHE_SHARDS]; /**< shards selected by the hash of a block */
+    guint64 shard_max_size;                         /**< maximum size in bytes of one shard     */
+} block_cache_t;
+
+
+/**
+ * Creates a new empty block cache.
+ * @param max_size is the maximum size in bytes of the data of the blocks
+ *        kept in the cache.
+ * @returns a newly allocated block_cache_t * structure that may be freed
+ *          with free_block_cache_t() or NULL if max_size is 0 (cache
+ *          disabled).
+ */
+extern block_cache_t *new_block_cache_t(guint64 max_size);
+
+
+/**
+ * Frees a block_cache_t * structure and every block in it.
+ * @param block_cache is the structure to be freed.
+ */
+extern void free_block_cache_t(block_cache_t *block_cache);
+
+
+/**
+ * Looks for a block in the cache. Thread safe.
+ * @param block_cache is the cache (may be NULL).
+ * @param hex_hash is the hash of the block in hexadecimal form.
+ * @returns a newly allocated copy of the block that may be freed with
+ *          free_hash_data_t() or NULL if the block is not in the cache.
+ */
+extern hash_data_t *block_cache_get(block_cache_t *block_cache, gchar *hex_hash);
+
+
+/**
+ * Inserts a copy of a block into the cache evicting the least recently
+ * used blocks of its shard if needed. Thread safe.
+ * @param block_cache is the cache (may be NULL in which case nothing is
+ *        done).
+ * @param hex_hash is the hash of the block in hexadecimal form.
+ * @param hash_data is the block as retrieved from the data backend. It is
+ *        not modified and still belongs to the caller.
+ */
+extern void block_cache_put(block_cache_t *block_cache, gchar *hex_hash, hash_data_t *hash_data);
+
+
+/**
+ * Retrieves the data of a hash from the cache of blocks or, when it is
+ * not there, from the data backend (and then keeps it in the cache).
+ * @param block_cache is the cache (may be NULL).
+ * @param backend is the data backend. It must have a retrieve_data
+ *        function.
+ * @param server_struct is the main structure for the server (passed to
+ *        retrieve_data).
+ * @param hex_hash is the hash of the data in hexadecimal form.
+ * @returns a newly allocated hash_data_t * structure that may be freed
+ *          with free_hash_data_t() or NULL if the data was not found.
+ */
+extern hash_data_t *block_cache_retrieve_data(block_cache_t *block_cache, backend_t *backend, void *server_struct, gchar *hex_hash);
+
+
+/**
+ * Inserts statistics about the cache into a json object: number of hits,
+ * misses, blocks and bytes in the cache.
+ * @param root is the json object where to insert statistics.
+ * @param block_cache is the cache (may be NULL in which case everything
+ *        is 0).
+ */
+extern void insert_block_cache_stats_into_json_root(json_t *root, block_cache_t *block_cache);
+
+
+#endif /* #ifndef _SERVER_BLOCK_CACHE_H_ */
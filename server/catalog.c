@@ -0,0 +1,984 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    catalog.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/catalog.c
+ *
+ * This file contains the functions that manage the indexed catalog of
+ * file versions of one host. Each version of a file is a row of the
+ * versions table. Queries on filenames use the index on names through
+ * the literal prefix of the requested regular expression and queries on
+ * dates use the index on modification times. Each version also carries
+ * the interval [valid_from, valid_to[ during which it was the current
+ * version of its file: latest and point in time (as of) queries use the
+ * index on those intervals instead of reading the whole history.
+ */
+
+#include "server.h"
+
+static void print_on_catalog_error(sqlite3 *db, int result, const gchar *infos);
+static int exec_catalog_cmd(catalog_t *catalog, gchar *sql_cmd, gchar *format_message);
+static void create_catalog_schema(catalog_t *catalog);
+static void upgrade_catalog_schema(catalog_t *catalog);
+static void prepare_catalog_statements(catalog_t *catalog);
+static void regexp_func(sqlite3_context *context, int argc, sqlite3_value **argv);
+static void date_prefix_func(sqlite3_context *context, int argc, sqlite3_value **argv);
+static void bind_guint64_value(sqlite3 *db, sqlite3_stmt *stmt, const gchar *name, guint64 value);
+static void bind_text_value(sqlite3 *db, sqlite3_stmt *stmt, const gchar *name, gchar *value);
+static void bind_hash_list_value(sqlite3 *db, sqlite3_stmt *stmt, const gchar *name, GList *hash_data_list);
+static gint64 get_valid_to(catalog_t *catalog, meta_data_t *meta);
+static void close_previous_version(catalog_t *catalog, meta_data_t *meta);
+static gchar *get_like_pattern_from_regex(gchar *regex);
+static gint64 get_unix_time_from_date(gchar *date);
+static gboolean get_date_range(gchar *date, gint64 *from, gint64 *to);
+static gchar *make_list_request(query_t *query, gchar *like, gboolean has_range, guint64 count);
+static GList *get_hash_list_from_column(sqlite3_stmt *stmt, int column);
+static meta_data_t *get_meta_data_from_row(sqlite3_stmt *stmt);
+
+
+/**
+ * Prints out an error message if an sqlite function just made one.
+ * @param db is the concerned sqlite database
+ * @param result is the result of the sqlite function
+ * @param infos is a gchar * containing some context to help understanding
+ *        the error.
+ */
+static void print_on_catalog_error(sqlite3 *db, int result, const gchar *infos)
+{
+    if (result != SQLITE_OK && result != SQLITE_ROW && result != SQLITE_DONE && db != NULL)
+        {
+            print_error(__FILE__, __LINE__, _("sqlite error (%d - %d) on %s: %s\n"), result, sqlite3_extended_errcode(db), infos, sqlite3_errmsg(db));
+        }
+}
+
+
+/**
+ * Executes the SQL command onto the catalog without any callback
+ * @param catalog : the catalog_t * structure that contains the database connexion
+ * @param sql_cmd : a gchar * SQL command to be executed onto the database
+ * @param format_message : a gchar * format message to be used in case of an error
+ * @returns the sqlite result code.
+ */
+static int exec_catalog_cmd(catalog_t *catalog, gchar *sql_cmd, gchar *format_message)
+{
+    char *error_message = NULL;
+    int result = 0;
+
+    if (catalog != NULL && catalog->db != NULL)
+        {
+            result = sqlite3_exec(catalog->db, sql_cmd, NULL, 0, &error_message);
+
+            if (result != SQLITE_OK)
+                {
+                    print_error(__FILE__, __LINE__, format_message, result, sqlite3_extended_errcode(catalog->db), error_message);
+                    sqlite3_free(error_message);
+                }
+        }
+
+    return result;
+}
+
+
+/**
+ * Creates the table and the indexes of the catalog if they do not
+ * already exist.
+ * @param catalog is the catalog to be verified.
+ */
+static void create_catalog_schema(catalog_t *catalog)
+{
+    print_debug(_("Checking tables and index in the catalog:\n"));
+
+    /* Writes are done one at a time by the meta-data thread: the write ahead log lets reads go on meanwhile */
+    exec_catalog_cmd(catalog, "PRAGMA journal_mode=WAL;", _("(%d - %d) Error while setting catalog's journal mode: %s\n"));
+    exec_catalog_cmd(catalog, "PRAGMA synchronous=NORMAL;", _("(%d - %d) Error while setting catalog's synchronous mode: %s\n"));
+
+    print_debug(_("\ttable versions\n"));
+    exec_catalog_cmd(catalog, "CREATE TABLE IF NOT EXISTS versions (version_id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT, type INTEGER, inode INTEGER, mode INTEGER, atime INTEGER, ctime INTEGER, mtime INTEGER, size INTEGER, owner TEXT, file_group TEXT, uid INTEGER, gid INTEGER, link TEXT, hash_list BLOB, valid_from INTEGER, valid_to INTEGER);", _("(%d - %d) Error while creating catalog table 'versions': %s\n"));
+
+    upgrade_catalog_schema(catalog);
+
+    /* Filenames are requested with case insensitive regular expressions */
+    print_debug(_("\tindex versions_name\n"));
+    exec_catalog_cmd(catalog, "CREATE INDEX IF NOT EXISTS versions_name ON versions (name COLLATE NOCASE, mtime);", _("(%d - %d) Error while creating index 'versions_name': %s\n"));
+
+    print_debug(_("\tindex versions_mtime\n"));
+    exec_catalog_cmd(catalog, "CREATE INDEX IF NOT EXISTS versions_mtime ON versions (mtime);", _("(%d - %d) Error while creating index 'versions_mtime': %s\n"));
+
+    /* Exact (case sensitive) lookups of the versions of one file when inserting a new one */
+    print_debug(_("\tindex versions_path\n"));
+    exec_catalog_cmd(catalog, "CREATE INDEX IF NOT EXISTS versions_path ON versions (name, valid_from);", _("(%d - %d) Error while creating index 'versions_path': %s\n"));
+
+    /* Latest versions are the ones with valid_to = BACKEND_VALID_FOREVER */
+    print_debug(_("\tindex versions_validity\n"));
+    exec_catalog_cmd(catalog, "CREATE INDEX IF NOT EXISTS versions_validity ON versions (valid_to, valid_from);", _("(%d - %d) Error while creating index 'versions_validity': %s\n"));
+}
+
+
+/**
+ * Adds the validity interval columns to a catalog created before they
+ * existed and computes them from the modification times of the versions
+ * already stored.
+ * @param catalog is the catalog to be upgraded if needed.
+ */
+static void upgrade_catalog_schema(catalog_t *catalog)
+{
+    sqlite3_stmt *stmt = NULL;
+    gchar *sql_cmd = NULL;
+    int result = 0;
+
+    result = sqlite3_prepare_v2(catalog->db, "SELECT valid_from FROM versions LIMIT 0;", -1, &stmt, NULL);
+    sqlite3_finalize(stmt);
+
+    if (result != SQLITE_OK)
+        {
+            print_debug(_("\tadding validity intervals to table versions\n"));
+
+            exec_catalog_cmd(catalog, "BEGIN;", _("(%d - %d) Error opening the transaction: %s\n"));
+            exec_catalog_cmd(catalog, "ALTER TABLE versions ADD COLUMN valid_from INTEGER;", _("(%d - %d) Error while adding column 'valid_from': %s\n"));
+            exec_catalog_cmd(catalog, "ALTER TABLE versions ADD COLUMN valid_to INTEGER;", _("(%d - %d) Error while adding column 'valid_to': %s\n"));
+            exec_catalog_cmd(catalog, "UPDATE versions SET valid_from = mtime;", _("(%d - %d) Error while filling column 'valid_from': %s\n"));
+            exec_catalog_cmd(catalog, "CREATE INDEX IF NOT EXISTS versions_path ON versions (name, valid_from);", _("(%d - %d) Error while creating index 'versions_path': %s\n"));
+
+            /* A version is valid until the next one of the same file. Among versions with the same mtime the last inserted wins */
+            sql_cmd = g_strdup_printf("UPDATE versions SET valid_to = COALESCE((SELECT MIN(later.valid_from) FROM versions AS later WHERE later.name = versions.name AND (later.valid_from > versions.valid_from OR (later.valid_from = versions.valid_from AND later.version_id > versions.version_id))), %" G_GINT64_FORMAT ");", BACKEND_VALID_FOREVER);
+            exec_catalog_cmd(catalog, sql_cmd, _("(%d - %d) Error while filling column 'valid_to': %s\n"));
+            free_variable(sql_cmd);
+
+            exec_catalog_cmd(catalog, "COMMIT;", _("(%d - %d) Error commiting to the catalog: %s\n"));
+        }
+}
+
+
+/**
+ * Prepares the statements used to insert a version of a file.
+ * @param catalog is the catalog whose statements are prepared.
+ */
+static void prepare_catalog_statements(catalog_t *catalog)
+{
+    int result = 0;
+
+    result = sqlite3_prepare_v2(catalog->db, "INSERT INTO versions (name, type, inode, mode, atime, ctime, mtime, size, owner, file_group, uid, gid, link, hash_list, valid_from, valid_to) VALUES (:name, :type, :inode, :mode, :atime, :ctime, :mtime, :size, :owner, :file_group, :uid, :gid, :link, :hash_list, :mtime, :valid_to);", -1, &catalog->insert_stmt, NULL);
+    print_on_catalog_error(catalog->db, result, "insert_stmt");
+
+    result = sqlite3_prepare_v2(catalog->db, "UPDATE versions SET valid_to = :mtime WHERE name = :name AND valid_from <= :mtime AND valid_to > :mtime;", -1, &catalog->close_stmt, NULL);
+    print_on_catalog_error(catalog->db, result, "close_stmt");
+
+    result = sqlite3_prepare_v2(catalog->db, "SELECT MIN(valid_from) FROM versions WHERE name = :name AND valid_from > :mtime;", -1, &catalog->next_stmt, NULL);
+    print_on_catalog_error(catalog->db, result, "next_stmt");
+}
+
+
+/**
+ * regexp(pattern, name) sql function. Matches name against the case
+ * insensitive regular expression pattern. The compiled regular
+ * expression is kept by sqlite for the whole statement.
+ * @param context is the sqlite context of the function call.
+ * @param argc is the number of arguments (2).
+ * @param argv contains the pattern and the name.
+ */
+static void regexp_func(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    GRegex *a_regex = NULL;
+    GError *error = NULL;
+    const gchar *pattern = NULL;
+    const gchar *name = NULL;
+    gboolean compiled = FALSE;
+
+    a_regex = sqlite3_get_auxdata(context, 0);
+
+    if (a_regex == NULL)
+        {
+            pattern = (const gchar *) sqlite3_value_text(argv[0]);
+
+            if (pattern != NULL)
+                {
+                    a_regex = g_regex_new(pattern, G_REGEX_CASELESS, 0, &error);
+                    compiled = TRUE;
+                }
+        }
+
+    if (a_regex != NULL)
+        {
+            name = (const gchar *) sqlite3_value_text(argv[1]);
+            sqlite3_result_int(context, name != NULL && g_regex_match(a_regex, name, 0, NULL));
+
+            if (compiled == TRUE)
+                {
+                    /* sqlite now owns a_regex and may free it at any time */
+                    sqlite3_set_auxdata(context, 0, a_regex, (void (*)(void *)) g_regex_unref);
+                }
+        }
+    else if (error != NULL)
+        {
+            sqlite3_result_error(context, error->message, -1);
+            free_error(error);
+        }
+    else
+        {
+            sqlite3_result_int(context, 0);
+        }
+}
+
+
+/**
+ * date_prefix(mtime, date) sql function. See compare_mtime_to_date().
+ * @param context is the sqlite context of the function call.
+ * @param argc is the number of arguments (2).
+ * @param argv contains the modification time and the date.
+ */
+static void date_prefix_func(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    guint64 mtime = 0;
+    gchar *date = NULL;
+
+    mtime = (guint64) sqlite3_value_int64(argv[0]);
+    date = (gchar *) sqlite3_value_text(argv[1]);
+
+    sqlite3_result_int(context, compare_mtime_to_date(mtime, date));
+}
+
+
+/**
+ * Opens (and creates if needed) a catalog.
+ * @param filename is the filename of the sqlite database of the catalog.
+ * @returns a newly allocated catalog_t * structure that may be closed
+ *          with close_catalog() or NULL if the database could not be
+ *          opened.
+ */
+catalog_t *open_catalog(gchar *filename)
+{
+    catalog_t *catalog = NULL;
+    sqlite3 *db = NULL;
+    gboolean created = FALSE;
+    int result = 0;
+
+    if (filename != NULL)
+        {
+            created = !file_exists(filename);
+            result = sqlite3_open(filename, &db);
+
+            if (result != SQLITE_OK)
+                {
+                    print_error(__FILE__, __LINE__, _("(%d) Error while trying to open %s catalog: %s\n"), result, filename, sqlite3_errmsg(db));
+                    sqlite3_close(db);
+                }
+            else
+                {
+                    catalog = (catalog_t *) g_malloc0(sizeof(catalog_t));
+
+                    catalog->db = db;
+                    catalog->created = created;
+                    g_rec_mutex_init(&catalog->mutex);
+
+                    sqlite3_extended_result_codes(db, 1);
+                    sqlite3_busy_timeout(db, 5000);
+
+                    result = sqlite3_create_function(db, "regexp", 2, SQLITE_UTF8, NULL, regexp_func, NULL, NULL);
+                    print_on_catalog_error(db, result, "regexp");
+                    result = sqlite3_create_function(db, "date_prefix", 2, SQLITE_UTF8, NULL, date_prefix_func, NULL, NULL);
+                    print_on_catalog_error(db, result, "date_prefix");
+
+                    create_catalog_schema(catalog);
+                    prepare_catalog_statements(catalog);
+                }
+        }
+
+    return catalog;
+}
+
+
+/**
+ * Closes a catalog and frees its structure.
+ * @param catalog is the catalog to be closed (may be NULL).
+ */
+void close_catalog(catalog_t *catalog)
+{
+    if (catalog != NULL)
+        {
+            sqlite3_finalize(catalog->insert_stmt);
+            sqlite3_finalize(catalog->close_stmt);
+            sqlite3_finalize(catalog->next_stmt);
+            sqlite3_close(catalog->db);
+            g_rec_mutex_clear(&catalog->mutex);
+            free_variable(catalog);
+        }
+}
+
+
+/**
+ * Begins a transaction. Useful to insert a lot of versions at once.
+ * The catalog stays locked until catalog_commit() ends the transaction
+ * so that other threads can neither insert into nor read from a half
+ * filled catalog. Only the thread that began the transaction may use
+ * the catalog meanwhile.
+ * @param catalog is the catalog where the transaction begins.
+ */
+void catalog_begin(catalog_t *catalog)
+{
+    if (catalog != NULL)
+        {
+            g_rec_mutex_lock(&catalog->mutex);
+            exec_catalog_cmd(catalog, "BEGIN;", _("(%d - %d) Error opening the transaction: %s\n"));
+        }
+}
+
+
+/**
+ * Commits the transaction begun with catalog_begin() and unlocks the
+ * catalog.
+ * @param catalog is the catalog where the transaction ends.
+ */
+void catalog_commit(catalog_t *catalog)
+{
+    if (catalog != NULL)
+        {
+            exec_catalog_cmd(catalog, "COMMIT;", _("(%d - %d) Error commiting to the catalog: %s\n"));
+            g_rec_mutex_unlock(&catalog->mutex);
+        }
+}
+
+
+/**
+ * Rolls back the transaction begun with catalog_begin(): every version
+ * inserted since then is forgotten. The catalog is unlocked.
+ * @param catalog is the catalog where the transaction ends.
+ */
+void catalog_rollback(catalog_t *catalog)
+{
+    if (catalog != NULL)
+        {
+            exec_catalog_cmd(catalog, "ROLLBACK;", _("(%d - %d) Error rolling back the catalog: %s\n"));
+            g_rec_mutex_unlock(&catalog->mutex);
+        }
+}
+
+
+/**
+ * Binds a guint64 value into the prepared statement.
+ * @param db is the database concerned by stmt statement. It is only used
+ *        here to print an error if any.
+ * @param stmt is the prepared statement in which we want to bind the
+ *        guint64 'value' in 'name' parameter
+ * @param name represents the name of the parameter in the prepared statement.
+ *        Nothing is done if the statement has no such parameter.
+ * @param value is a guint64 integer to be filled in 'name' parameter.
+ */
+static void bind_guint64_value(sqlite3 *db, sqlite3_stmt *stmt, const gchar *name, guint64 value)
+{
+    int index = 0;
+    int result = 0;
+
+    if (stmt != NULL && name != NULL)
+        {
+            index = sqlite3_bind_parameter_index(stmt, name);
+
+            if (index > 0)
+                {
+                    result = sqlite3_bind_int64(stmt, index, value);
+                    print_on_catalog_error(db, result, name);
+                }
+        }
+}
+
+
+/**
+ * Binds a gchar *value into the prepared statement.
+ * @param db is the database concerned by stmt statement. It is only used
+ *        here to print an error if any.
+ * @param stmt is the prepared statement in which we want to bind the
+ *        string 'value' in 'name' parameter
+ * @param name represents the name of the parameter in the prepared statement.
+ *        Nothing is done if the statement has no such parameter.
+ * @param value is a gchar * string to be filled in 'name' parameter.
+ */
+static void bind_text_value(sqlite3 *db, sqlite3_stmt *stmt, const gchar *name, gchar *value)
+{
+    int index = 0;
+    int result = 0;
+
+    if (stmt != NULL && name != NULL)
+        {
+            index = sqlite3_bind_parameter_index(stmt, name);
+
+            if (index > 0)
+                {
+                    result = sqlite3_bind_text(stmt, index, value, -1, SQLITE_TRANSIENT);
+                    print_on_catalog_error(db, result, name);
+                }
+        }
+}
+
+
+/**
+ * Binds a list of hashs into the prepared statement. Hashs are stored
+ * in their binary form one after the other.
+ * @param db is the database concerned by stmt statement. It is only used
+ *        here to print an error if any.
+ * @param stmt is the prepared statement in which we want to bind the
+ *        hashs in 'name' parameter
+ * @param name represents the name of the parameter in the prepared statement
+ * @param hash_data_list is a GList * of hash_data_t * (may be NULL).
+ */
+static void bind_hash_list_value(sqlite3 *db, sqlite3_stmt *stmt, const gchar *name, GList *hash_data_list)
+{
+    GByteArray *blob = NULL;
+    hash_data_t *hash_data = NULL;
+    int result = 0;
+
+    if (stmt != NULL && name != NULL)
+        {
+            blob = g_byte_array_new();
+
+            while (hash_data_list != NULL)
+                {
+                    hash_data = hash_data_list->data;
+                    g_byte_array_append(blob, hash_data->hash, HASH_LEN);
+                    hash_data_list = g_list_next(hash_data_list);
+                }
+
+            result = sqlite3_bind_blob(stmt, sqlite3_bind_parameter_index(stmt, name), blob->data, blob->len, SQLITE_TRANSIENT);
+            print_on_catalog_error(db, result, name);
+
+            g_byte_array_free(blob, TRUE);
+        }
+}
+
+
+/**
+ * Finds when the version of a file that is being inserted stops being
+ * valid. Versions are usually inserted in order but a client may send
+ * an older version after a newer one.
+ * Must be called with the mutex locked.
+ * @param catalog is the catalog where the version is inserted.
+ * @param meta is the meta data of that version of the file.
+ * @returns the modification time of the following version of the file
+ *          or BACKEND_VALID_FOREVER if there is none.
+ */
+static gint64 get_valid_to(catalog_t *catalog, meta_data_t *meta)
+{
+    sqlite3_stmt *stmt = catalog->next_stmt;
+    gint64 valid_to = BACKEND_VALID_FOREVER;
+    int result = 0;
+
+    if (stmt != NULL)
+        {
+            bind_text_value(catalog->db, stmt, ":name", meta->name);
+            bind_guint64_value(catalog->db, stmt, ":mtime", meta->mtime);
+
+            result = sqlite3_step(stmt);
+            print_on_catalog_error(catalog->db, result, "get_valid_to");
+
+            if (result == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+                {
+                    valid_to = sqlite3_column_int64(stmt, 0);
+                }
+
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+
+    return valid_to;
+}
+
+
+/**
+ * Ends the validity of the version of the file that was valid at the
+ * modification time of the version being inserted.
+ * Must be called with the mutex locked.
+ * @param catalog is the catalog where the version is inserted.
+ * @param meta is the meta data of that version of the file.
+ */
+static void close_previous_version(catalog_t *catalog, meta_data_t *meta)
+{
+    sqlite3_stmt *stmt = catalog->close_stmt;
+    int result = 0;
+
+    if (stmt != NULL)
+        {
+            bind_text_value(catalog->db, stmt, ":name", meta->name);
+            bind_guint64_value(catalog->db, stmt, ":mtime", meta->mtime);
+
+            result = sqlite3_step(stmt);
+            print_on_catalog_error(catalog->db, result, "close_previous_version");
+
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+}
+
+
+/**
+ * Inserts one version of a file into the catalog. The version becomes
+ * valid from its modification time until the modification time of the
+ * following version of the same file (if any) and the version that was
+ * valid at that time is closed.
+ * @param catalog is the catalog where to insert the version.
+ * @param meta is the meta data of that version of the file.
+ * @returns TRUE if the version has been inserted, FALSE otherwise (the
+ *          catalog is left as it was).
+ */
+gboolean catalog_insert_meta_data(catalog_t *catalog, meta_data_t *meta)
+{
+    sqlite3_stmt *stmt = NULL;
+    gint64 valid_to = 0;
+    int result = 0;
+    gboolean inserted = FALSE;
+
+    if (catalog != NULL && catalog->insert_stmt != NULL && meta != NULL)
+        {
+            g_rec_mutex_lock(&catalog->mutex);
+
+            /* The intervals of the versions of a file must change all together */
+            exec_catalog_cmd(catalog, "SAVEPOINT insert_version;", _("(%d - %d) Error opening the savepoint: %s\n"));
+
+            valid_to = get_valid_to(catalog, meta);
+            close_previous_version(catalog, meta);
+
+            stmt = catalog->insert_stmt;
+
+            bind_text_value(catalog->db, stmt, ":name", meta->name);
+            bind_guint64_value(catalog->db, stmt, ":type", meta->file_type);
+            bind_guint64_value(catalog->db, stmt, ":inode", meta->inode);
+            bind_guint64_value(catalog->db, stmt, ":mode", meta->mode);
+            bind_guint64_value(catalog->db, stmt, ":atime", meta->atime);
+            bind_guint64_value(catalog->db, stmt, ":ctime", meta->ctime);
+            bind_guint64_value(catalog->db, stmt, ":mtime", meta->mtime);
+            bind_guint64_value(catalog->db, stmt, ":size", meta->size);
+            bind_text_value(catalog->db, stmt, ":owner", meta->owner);
+            bind_text_value(catalog->db, stmt, ":file_group", meta->group);
+            bind_guint64_value(catalog->db, stmt, ":uid", meta->uid);
+            bind_guint64_value(catalog->db, stmt, ":gid", meta->gid);
+            bind_text_value(catalog->db, stmt, ":link", meta->link);
+            bind_hash_list_value(catalog->db, stmt, ":hash_list", meta->hash_data_list);
+            bind_guint64_value(catalog->db, stmt, ":valid_to", valid_to);
+
+            result = sqlite3_step(stmt);
+            print_on_catalog_error(catalog->db, result, "catalog_insert_meta_data");
+            inserted = (result == SQLITE_DONE);
+
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+
+            if (inserted == FALSE)
+                {
+                    /* The previous version must not stay closed without this one */
+                    exec_catalog_cmd(catalog, "ROLLBACK TO insert_version;", _("(%d - %d) Error rolling back to the savepoint: %s\n"));
+                }
+
+            exec_catalog_cmd(catalog, "RELEASE insert_version;", _("(%d - %d) Error releasing the savepoint: %s\n"));
+
+            g_rec_mutex_unlock(&catalog->mutex);
+        }
+
+    return inserted;
+}
+
+
+/**
+ * Extracts the literal prefix of an anchored regular expression in order
+ * to use the index on filenames. Only ascii characters are kept as the
+ * index is case insensitive for them only.
+ * @param regex is the regular expression (ie: "^/home/user/.*").
+ * @returns a newly allocated LIKE pattern (ie: "/home/user/%") or NULL
+ *          if the regular expression has no usable prefix.
+ */
+static gchar *get_like_pattern_from_regex(gchar *regex)
+{
+    GString *prefix = NULL;
+    gchar *like = NULL;
+    gsize i = 1;
+
+    /* An alternation anywhere may match things outside of the prefix */
+    if (regex != NULL && regex[0] == '^' && strchr(regex, '|') == NULL)
+        {
+            prefix = g_string_new("");
+
+            while (regex[i] != '\0' && (regex[i] & 0x80) == 0 && strchr("\\.^$?*+()[]{}%_", regex[i]) == NULL)
+                {
+                    g_string_append_c(prefix, regex[i]);
+                    i++;
+                }
+
+            /* The last character is optional when followed by one of these quantifiers */
+            if (prefix->len > 0 && (regex[i] == '?' || regex[i] == '*' || regex[i] == '{'))
+                {
+                    g_string_truncate(prefix, prefix->len - 1);
+                }
+
+            if (prefix->len > 0)
+                {
+                    g_string_append_c(prefix, '%');
+                    like = g_string_free(prefix, FALSE);
+                }
+            else
+                {
+                    g_string_free(prefix, TRUE);
+                }
+        }
+
+    return like;
+}
+
+
+/**
+ * Converts a YYYY-MM-DD HH:MM:SS date into unix time.
+ * @param date the date in YYYY-MM-DD HH:MM:SS format (local time).
+ * @returns the unix time of that date or 0 if the date is invalid.
+ */
+static gint64 get_unix_time_from_date(gchar *date)
+{
+    GDateTime *la_date = NULL;
+    gint64 unix_time = 0;
+
+    la_date = convert_gchar_date_to_gdatetime(date);
+
+    if (la_date != NULL)
+        {
+            unix_time = g_date_time_to_unix(la_date);
+            g_date_time_unref(la_date);
+        }
+
+    return unix_time;
+}
+
+
+/**
+ * Computes the range of modification times that a date prefix (as used
+ * by compare_mtime_to_date()) may match. The range is a bit larger than
+ * needed (one hour on each side) to stay right over daylight saving time
+ * changes: rows are exactly filtered afterwards.
+ * @param date is the date prefix (ie "2019-10-03" or "2019-10-03 12").
+ * @param[out] from is the lower bound (included) of the range.
+ * @param[out] to is the upper bound (excluded) of the range.
+ * @returns TRUE if a range could be computed and FALSE otherwise.
+ */
+static gboolean get_date_range(gchar *date, gint64 *from, gint64 *to)
+{
+    gchar *whole_date = NULL;
+    GDateTime *start = NULL;
+    GDateTime *end = NULL;
+    gsize len = 0;
+    gboolean ok = FALSE;
+
+    if (date != NULL)
+        {
+            len = strlen(date);
+
+            if (len == 4 || len == 7 || len == 10 || len == 13 || len == 16 || len == 19)
+                {
+                    whole_date = g_strdup("0000-01-01 00:00:00");
+                    memcpy(whole_date, date, len);
+                    start = convert_gchar_date_to_gdatetime(whole_date);
+
+                    if (start != NULL)
+                        {
+                            switch (len)
+                                {
+                                    case 4:
+                                        end = g_date_time_add_years(start, 1);
+                                        break;
+                                    case 7:
+                                        end = g_date_time_add_months(start, 1);
+                                        break;
+                                    case 10:
+                                        end = g_date_time_add_days(start, 1);
+                                        break;
+                                    case 13:
+                                        end = g_date_time_add_hours(start, 1);
+                                        break;
+                                    case 16:
+                                        end = g_date_time_add_minutes(start, 1);
+                                        break;
+                                    default:
+                                        end = g_date_time_add_seconds(start, 1);
+                                        break;
+                                }
+
+                            *from = g_date_time_to_unix(start) - 3600;
+                            *to = g_date_time_to_unix(end) + 3600;
+                            ok = TRUE;
+
+                            g_date_time_unref(end);
+                            g_date_time_unref(start);
+                        }
+
+                    free_variable(whole_date);
+                }
+        }
+
+    return ok;
+}
+
+
+/**
+ * Makes the SQL request corresponding to the query.
+ * @param query is the structure that contains everything about the
+ *        requested query.
+ * @param like is the LIKE pattern derived from the filename regular
+ *        expression (may be NULL).
+ * @param has_range is TRUE if the date of the query has a range of
+ *        modification times.
+ * @param count is the maximum number of rows (0 means no limit).
+ * @returns a newly allocated gchar * SQL request.
+ */
+static gchar *make_list_request(query_t *query, gchar *like, gboolean has_range, guint64 count)
+{
+    GString *request = NULL;
+    gboolean group_by_name = FALSE;
+
+    /* An as of query already gets at most one version per file */
+    group_by_name = (query->latest == TRUE && query->asof == NULL && latest_are_valid_versions(query) == FALSE);
+
+    request = g_string_new("SELECT name, type, inode, mode, atime, ctime, mtime, size, owner, file_group, uid, gid, link");
+
+    if (query->without_hashs == TRUE)
+        {
+            g_string_append(request, ", NULL");
+        }
+    else
+        {
+            g_string_append(request, ", hash_list");
+        }
+
+    g_string_append(request, ", version_id");
+
+    if (group_by_name == TRUE)
+        {
+            /* With a MAX() aggregate sqlite returns the other columns from the row holding the maximum */
+            g_string_append(request, ", MAX(mtime)");
+        }
+
+    g_string_append(request, " FROM versions WHERE owner = :owner AND file_group = :group AND uid = :uid AND gid = :gid");
+
+    if (like != NULL)
+        {
+            g_string_append(request, " AND name LIKE :like");
+        }
+
+    if (query->filename != NULL)
+        {
+            g_string_append(request, " AND regexp(:filename, name)");
+        }
+
+    if (has_range == TRUE)
+        {
+            g_string_append(request, " AND mtime >= :date_from AND mtime < :date_to");
+        }
+
+    if (query->date != NULL)
+        {
+            g_string_append(request, " AND date_prefix(mtime, :date)");
+        }
+
+    if (query->afterdate != NULL)
+        {
+            g_string_append(request, " AND mtime >= :afterdate");
+        }
+
+    if (query->beforedate != NULL)
+        {
+            g_string_append(request, " AND mtime < :beforedate");
+        }
+
+    if (query->asof != NULL)
+        {
+            g_string_append(request, " AND valid_from <= :asof AND valid_to > :asof");
+        }
+
+    if (latest_are_valid_versions(query) == TRUE)
+        {
+            g_string_append(request, " AND valid_to = :forever");
+        }
+
+    /* valid_from is the mtime: versions_path (name, valid_from) index gives the rows in the right order */
+    if (query->cursor != NULL && group_by_name == TRUE)
+        {
+            g_string_append(request, " AND name > (SELECT name FROM versions WHERE version_id = :cursor)");
+        }
+    else if (query->cursor != NULL)
+        {
+            g_string_append(request, " AND (name, valid_from, version_id) > (SELECT name, valid_from, version_id FROM versions WHERE version_id = :cursor)");
+        }
+
+    if (group_by_name == TRUE)
+        {
+            g_string_append(request, " GROUP BY name");
+        }
+
+    g_string_append(request, " ORDER BY name, valid_from, version_id");
+
+    if (count > 0)
+        {
+            g_string_append(request, " LIMIT :count");
+        }
+
+    g_string_append(request, ";");
+
+    return g_string_free(request, FALSE);
+}
+
+
+/**
+ * Gets the list of hashs stored into a column of the current row.
+ * @param stmt is the statement whose current row is read.
+ * @param column is the column that contains the hashs.
+ * @returns a GList * of hash_data_t * containing only hashs.
+ */
+static GList *get_hash_list_from_column(sqlite3_stmt *stmt, int column)
+{
+    const guint8 *blob = NULL;
+    guint8 *hash = NULL;
+    GList *hash_list = NULL;
+    int len = 0;
+    int i = 0;
+
+    blob = sqlite3_column_blob(stmt, column);
+    len = sqlite3_column_bytes(stmt, column);
+
+    if (blob != NULL)
+        {
+            for (i = len - HASH_LEN; i >= 0; i = i - HASH_LEN)
+                {
+                    hash = (guint8 *) g_malloc(HASH_LEN);
+                    memcpy(hash, blob + i, HASH_LEN);
+                    hash_list = g_list_prepend(hash_list, new_hash_data_t_as_is(NULL, 0, hash, COMPRESS_NONE_TYPE, 0));
+                }
+        }
+
+    return hash_list;
+}
+
+
+/**
+ * Makes a meta_data_t * structure from the current row.
+ * @param stmt is the statement whose current row is read.
+ * @returns a newly allocated meta_data_t * structure.
+ */
+static meta_data_t *get_meta_data_from_row(sqlite3_stmt *stmt)
+{
+    meta_data_t *meta = NULL;
+
+    meta = new_meta_data_t();
+
+    meta->name = g_strdup((gchar *) sqlite3_column_text(stmt, 0));
+    meta->file_type = sqlite3_column_int(stmt, 1);
+    meta->inode = sqlite3_column_int64(stmt, 2);
+    meta->mode = sqlite3_column_int(stmt, 3);
+    meta->atime = sqlite3_column_int64(stmt, 4);
+    meta->ctime = sqlite3_column_int64(stmt, 5);
+    meta->mtime = sqlite3_column_int64(stmt, 6);
+    meta->size = sqlite3_column_int64(stmt, 7);
+    meta->owner = g_strdup((gchar *) sqlite3_column_text(stmt, 8));
+    meta->group = g_strdup((gchar *) sqlite3_column_text(stmt, 9));
+    meta->uid = sqlite3_column_int64(stmt, 10);
+    meta->gid = sqlite3_column_int64(stmt, 11);
+    meta->link = g_strdup((gchar *) sqlite3_column_text(stmt, 12));
+    meta->hash_data_list = get_hash_list_from_column(stmt, 13);
+
+    return meta;
+}
+
+
+/**
+ * Gets a page of the list of versions of files that matches the query.
+ * Filenames, dates and ownership are filtered with the indexes of the
+ * catalog. The page begins after query->cursor (if any) and
+ * query->cursor is updated to the last version returned so the next
+ * call gets the next page.
+ * @param catalog is the catalog where to look for files.
+ * @param query is the structure that contains everything about the
+ *        requested query.
+ * @param count is the maximum number of versions to be returned (0 means
+ *        no limit).
+ * @returns a GList * of meta_data_t * sorted by filename and then by
+ *          modification time. It may be freed with
+ *          g_list_free_full(list, free_glist_meta_data_t).
+ */
+GList *catalog_get_file_list(catalog_t *catalog, query_t *query, guint64 count)
+{
+    sqlite3_stmt *stmt = NULL;
+    GList *file_list = NULL;
+    gchar *request = NULL;
+    gchar *like = NULL;
+    gint64 date_from = 0;
+    gint64 date_to = 0;
+    gboolean has_range = FALSE;
+    gint64 last_id = 0;
+    int result = 0;
+
+    if (catalog != NULL && query != NULL)
+        {
+            like = get_like_pattern_from_regex(query->filename);
+            has_range = get_date_range(query->date, &date_from, &date_to);
+            request = make_list_request(query, like, has_range, count);
+
+            print_debug(_("catalog: %s\n"), request);
+
+            g_rec_mutex_lock(&catalog->mutex);
+
+            result = sqlite3_prepare_v2(catalog->db, request, -1, &stmt, NULL);
+            print_on_catalog_error(catalog->db, result, "catalog_get_file_list");
+
+            if (result == SQLITE_OK)
+                {
+                    bind_text_value(catalog->db, stmt, ":owner", query->owner);
+                    bind_text_value(catalog->db, stmt, ":group", query->group);
+                    bind_guint64_value(catalog->db, stmt, ":uid", get_uint_from_string(query->uid));
+                    bind_guint64_value(catalog->db, stmt, ":gid", get_uint_from_string(query->gid));
+                    bind_text_value(catalog->db, stmt, ":like", like);
+                    bind_text_value(catalog->db, stmt, ":filename", query->filename);
+                    bind_guint64_value(catalog->db, stmt, ":date_from", date_from);
+                    bind_guint64_value(catalog->db, stmt, ":date_to", date_to);
+                    bind_text_value(catalog->db, stmt, ":date", query->date);
+                    bind_guint64_value(catalog->db, stmt, ":afterdate", get_unix_time_from_date(query->afterdate));
+                    bind_guint64_value(catalog->db, stmt, ":beforedate", get_unix_time_from_date(query->beforedate));
+                    bind_guint64_value(catalog->db, stmt, ":asof", get_unix_time_from_date(query->asof));
+                    bind_guint64_value(catalog->db, stmt, ":forever", BACKEND_VALID_FOREVER);
+                    bind_guint64_value(catalog->db, stmt, ":cursor", get_guint64_from_string(query->cursor));
+                    bind_guint64_value(catalog->db, stmt, ":count", count);
+
+                    while ((result = sqlite3_step(stmt)) == SQLITE_ROW)
+                        {
+                            file_list = g_list_prepend(file_list, get_meta_data_from_row(stmt));
+                            last_id = sqlite3_column_int64(stmt, 14);
+                        }
+
+                    print_on_catalog_error(catalog->db, result, "catalog_get_file_list");
+                }
+
+            sqlite3_finalize(stmt);
+
+            g_rec_mutex_unlock(&catalog->mutex);
+
+            file_list = g_list_reverse(file_list);
+
+            if (file_list != NULL)
+                {
+                    free_variable(query->cursor);
+                    query->cursor = g_strdup_printf("%" G_GINT64_FORMAT, last_id);
+                }
+
+            free_variable(request);
+            free_variable(like);
+        }
+
+    return file_list;
+}
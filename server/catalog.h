@@ -0,0 +1,147 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    catalog.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/catalog.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * used to manage the indexed catalog of file versions of one host. The
+ * catalog is an sqlite database with an index on filenames, an index
+ * on modification times and an index on the interval of time during which
+ * each version was the current one (point in time queries).
+ */
+#ifndef _SERVER_CATALOG_H_
+#define _SERVER_CATALOG_H_
+
+/**
+ * @def CATALOG_SUFFIX
+ * Suffix of catalog filenames. The catalog of a host is named after it
+ * in the meta directory of the file backend.
+ */
+#define CATALOG_SUFFIX (".db")
+
+
+/**
+ * @def FLAT_IMPORTED_SUFFIX
+ * Suffix appended to the name of a flat meta data file once it has been
+ * imported into the catalog of its host.
+ */
+#define FLAT_IMPORTED_SUFFIX (".imported")
+
+
+/**
+ * @def CATALOG_IN_MEMORY
+ * Filename of a catalog that is kept in memory (used by memory backend).
+ */
+#define CATALOG_IN_MEMORY (":memory:")
+
+
+/**
+ * @struct catalog_t
+ * @brief Indexed catalog of every version of every file saved for a host.
+ */
+typedef struct
+{
+    sqlite3 *db;                /**< database connexion                                                  */
+    sqlite3_stmt *insert_stmt;  /**< prepared statement used to insert one version of a file             */
+    sqlite3_stmt *close_stmt;   /**< prepared statement that ends the validity of the previous version    */
+    sqlite3_stmt *next_stmt;    /**< prepared statement that finds the version following a new one        */
+    gboolean created;           /**< TRUE if the catalog did not exist before being opened               */
+    GRecMutex mutex;            /**< serializes accesses (meta-data thread and MHD connexion threads)    */
+} catalog_t;
+
+
+/**
+ * Opens (and creates if needed) a catalog.
+ * @param filename is the filename of the sqlite database of the catalog.
+ * @returns a newly allocated catalog_t * structure that may be closed
+ *          with close_catalog() or NULL if the database could not be
+ *          opened.
+ */
+extern catalog_t *open_catalog(gchar *filename);
+
+
+/**
+ * Closes a catalog and frees its structure.
+ * @param catalog is the catalog to be closed (may be NULL).
+ */
+extern void close_catalog(catalog_t *catalog);
+
+
+/**
+ * Begins a transaction. Useful to insert a lot of versions at once.
+ * The catalog stays locked until catalog_commit() ends the transaction
+ * so that other threads can neither insert into nor read from a half
+ * filled catalog. Only the thread that began the transaction may use
+ * the catalog meanwhile.
+ * @param catalog is the catalog where the transaction begins.
+ */
+extern void catalog_begin(catalog_t *catalog);
+
+
+/**
+ * Commits the transaction begun with catalog_begin() and unlocks the
+ * catalog.
+ * @param catalog is the catalog where the transaction ends.
+ */
+extern void catalog_commit(catalog_t *catalog);
+
+
+/**
+ * Rolls back the transaction begun with catalog_begin(): every version
+ * inserted since then is forgotten. The catalog is unlocked.
+ * @param catalog is the catalog where the transaction ends.
+ */
+extern void catalog_rollback(catalog_t *catalog);
+
+
+/**
+ * Inserts one version of a file into the catalog. The version becomes
+ * valid from its modification time until the modification time of the
+ * following version of the same file (if any) and the version that was
+ * valid at that time is closed.
+ * @param catalog is the catalog where to insert the version.
+ * @param meta is the meta data of that version of the file.
+ * @returns TRUE if the version has been inserted, FALSE otherwise (the
+ *          catalog is left as it was).
+ */
+extern gboolean catalog_insert_meta_data(catalog_t *catalog, meta_data_t *meta);
+
+
+/**
+ * Gets a page of the list of versions of files that matches the query.
+ * Filenames, dates and ownership are filtered with the indexes of the
+ * catalog. The page begins after query->cursor (if any) and
+ * query->cursor is updated to the last version returned so the next
+ * call gets the next page.
+ * @param catalog is the catalog where to look for files.
+ * @param query is the structure that contains everything about the
+ *        requested query.
+ * @param count is the maximum number of versions to be returned (0 means
+ *        no limit).
+ * @returns a GList * of meta_data_t * sorted by filename and then by
+ *          modification time. It may be freed with
+ *          g_list_free_full(list, free_glist_meta_data_t).
+ */
+extern GList *catalog_get_file_list(catalog_t *catalog, query_t *query, guint64 count);
+
+
+#endif /* #ifndef _SERVER_CATALOG_H_ */
@@ -0,0 +1,398 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    dictionary_store.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/dictionary_store.c
+ *
+ * This file contains the functions used by 'cdpfglserver' to train zstd
+ * dictionaries from a sample of the stored blocks and to keep every
+ * version of them. Blocks compressed with a dictionary reference it by
+ * its id in their compression type so dictionaries are never removed.
+ */
+
+#include "server.h"
+
+static gchar *get_dictionary_filename(dictionary_store_t *store, guint id);
+static void load_dictionaries(dictionary_store_t *store);
+
+
+/**
+ * @param store is the store of dictionaries.
+ * @param id is the id of a dictionary.
+ * @returns a newly allocated filename of the file of dictionary id.
+ */
+static gchar *get_dictionary_filename(dictionary_store_t *store, guint id)
+{
+    gchar *basename = NULL;
+    gchar *filename = NULL;
+
+    basename = g_strdup_printf("%u%s", id, DICTIONARY_STORE_EXTENSION);
+    filename = g_build_filename(store->dirname, basename, NULL);
+    free_variable(basename);
+
+    return filename;
+}
+
+
+/**
+ * Registers every dictionary kept in the directory of the store. The
+ * latest one is the highest id that could be loaded while new ids go
+ * after every file found so that no file is ever overwritten (even one
+ * that could not be loaded).
+ * @param store is the store of dictionaries.
+ */
+static void load_dictionaries(dictionary_store_t *store)
+{
+    GDir *dir = NULL;
+    const gchar *name = NULL;
+    gchar *filename = NULL;
+    gchar *data = NULL;
+    gchar *end = NULL;
+    gsize len = 0;
+    guint64 id = 0;
+
+    dir = g_dir_open(store->dirname, 0, NULL);
+
+    if (dir != NULL)
+        {
+            while ((name = g_dir_read_name(dir)) != NULL)
+                {
+                    id = g_ascii_strtoull(name, &end, 10);
+
+                    if (id > 0 && id <= COMPRESS_DICT_MAX_ID && g_strcmp0(end, DICTIONARY_STORE_EXTENSION) == 0)
+                        {
+                            store->next_id = MAX(store->next_id, (guint) id + 1);
+                            filename = g_build_filename(store->dirname, name, NULL);
+
+                            if (g_file_get_contents(filename, &data, &len, NULL) == TRUE && add_compress_dictionary(id, (guchar *) data, len) == TRUE)
+                                {
+                                    store->latest = MAX(store->latest, (guint) id);
+                                }
+
+                            free_variable(data);
+                            free_variable(filename);
+                        }
+                }
+
+            g_dir_close(dir);
+        }
+}
+
+
+/**
+ * Creates the store and registers every dictionary already kept in
+ * dirname.
+ * @param dirname is the directory where dictionaries are kept (created
+ *        if needed).
+ * @returns a newly allocated dictionary_store_t * structure that may be
+ *          freed with free_dictionary_store_t().
+ */
+dictionary_store_t *new_dictionary_store_t(gchar *dirname)
+{
+    dictionary_store_t *store = NULL;
+
+    store = (dictionary_store_t *) g_malloc0(sizeof(dictionary_store_t));
+
+    store->dirname = g_strdup(dirname);
+    store->latest = 0;
+    store->next_id = 1;
+    store->new_blocks = 0;
+    store->stopping = FALSE;
+    g_mutex_init(&store->mutex);
+    g_cond_init(&store->cond);
+
+    if (g_mkdir_with_parents(store->dirname, 0700) != 0)
+        {
+            print_error(__FILE__, __LINE__, _("Error while creating directory %s: %s\n"), store->dirname, g_strerror(errno));
+        }
+
+    load_dictionaries(store);
+
+    return store;
+}
+
+
+/**
+ * Frees a dictionary_store_t * structure (registered dictionaries are
+ * kept).
+ * @param store is the structure to be freed.
+ */
+void free_dictionary_store_t(dictionary_store_t *store)
+{
+    if (store != NULL)
+        {
+            free_variable(store->dirname);
+            g_cond_clear(&store->cond);
+            g_mutex_clear(&store->mutex);
+            free_variable(store);
+        }
+}
+
+
+/**
+ * Makes the json answer to a /Dictionary.json request.
+ * @param store is the store of dictionaries (may be NULL).
+ * @param id is the id of the wanted dictionary (0 for the latest one).
+ * @returns a newly allocated json string or NULL if there is no such
+ *          dictionary.
+ */
+gchar *dictionary_store_answer(dictionary_store_t *store, guint id)
+{
+    gchar *answer = NULL;
+    gchar *filename = NULL;
+    gchar *data = NULL;
+    gsize len = 0;
+    guint latest = 0;
+
+    if (store != NULL)
+        {
+            g_mutex_lock(&store->mutex);
+
+            latest = store->latest;
+
+            if (id == 0)
+                {
+                    id = latest;
+                }
+
+            if (id > 0 && id <= latest)
+                {
+                    filename = get_dictionary_filename(store, id);
+
+                    if (g_file_get_contents(filename, &data, &len, NULL) == TRUE)
+                        {
+                            answer = convert_dictionary_to_json_string(id, latest, (guchar *) data, len);
+                        }
+
+                    free_variable(data);
+                    free_variable(filename);
+                }
+
+            g_mutex_unlock(&store->mutex);
+        }
+
+    return answer;
+}
+
+
+/**
+ * Creates a new empty sample.
+ * @returns a newly allocated dictionary_sample_t * structure that may be
+ *          freed with free_dictionary_sample_t().
+ */
+dictionary_sample_t *new_dictionary_sample_t(void)
+{
+    dictionary_sample_t *sample = NULL;
+
+    sample = (dictionary_sample_t *) g_malloc0(sizeof(dictionary_sample_t));
+
+    sample->hashs = g_ptr_array_new_with_free_func(free_variable);
+    sample->seen = 0;
+    sample->samples = g_byte_array_new();
+    sample->sizes = g_array_new(FALSE, FALSE, sizeof(gsize));
+
+    return sample;
+}
+
+
+/**
+ * Frees a dictionary_sample_t * structure.
+ * @param sample is the structure to be freed.
+ */
+void free_dictionary_sample_t(dictionary_sample_t *sample)
+{
+    if (sample != NULL)
+        {
+            g_ptr_array_free(sample->hashs, TRUE);
+            g_byte_array_free(sample->samples, TRUE);
+            g_array_free(sample->sizes, TRUE);
+            free_variable(sample);
+        }
+}
+
+
+/**
+ * Keeps a stored hash in the sample with a probability that gives each
+ * stored hash the same chance to be in the sample (reservoir sampling).
+ * Used as a GFunc by the backend's foreach_stored_hash function.
+ * @param data is the binary hash (guint8 *).
+ * @param user_data is the dictionary_sample_t * sample.
+ */
+void dictionary_sample_hash(gpointer data, gpointer user_data)
+{
+    dictionary_sample_t *sample = (dictionary_sample_t *) user_data;
+    guint64 position = 0;
+
+    if (sample->hashs->len < DICTIONARY_STORE_SAMPLES)
+        {
+            g_ptr_array_add(sample->hashs, g_memdup(data, HASH_LEN));
+        }
+    else
+        {
+            position = (guint64) (g_random_double() * (sample->seen + 1));
+
+            if (position < DICTIONARY_STORE_SAMPLES)
+                {
+                    free_variable(g_ptr_array_index(sample->hashs, position));
+                    g_ptr_array_index(sample->hashs, position) = g_memdup(data, HASH_LEN);
+                }
+        }
+
+    sample->seen = sample->seen + 1;
+}
+
+
+/**
+ * Adds the beginning of a chosen block to the samples.
+ * @param sample is the sample.
+ * @param data is the uncompressed data of the block.
+ * @param len is the length of data.
+ */
+void dictionary_sample_add_block(dictionary_sample_t *sample, guchar *data, gsize len)
+{
+    len = MIN(len, DICTIONARY_STORE_SAMPLE_SIZE);
+
+    if (data != NULL && len > 0)
+        {
+            g_byte_array_append(sample->samples, data, len);
+            g_array_append_val(sample->sizes, len);
+        }
+}
+
+
+/**
+ * Counts a newly stored block and wakes the training thread up when
+ * enough blocks have been stored while there is no dictionary.
+ * @param store is the store of dictionaries (may be NULL).
+ */
+void dictionary_store_block_stored(dictionary_store_t *store)
+{
+    if (store != NULL)
+        {
+            g_mutex_lock(&store->mutex);
+
+            store->new_blocks = store->new_blocks + 1;
+
+            if (store->latest == 0 && store->new_blocks == DICTIONARY_STORE_TRAIN_BLOCKS)
+                {
+                    g_cond_signal(&store->cond);
+                }
+
+            g_mutex_unlock(&store->mutex);
+        }
+}
+
+
+/**
+ * Waits until a new dictionary has to be trained: when there is still
+ * no dictionary and DICTIONARY_STORE_TRAIN_BLOCKS blocks have been
+ * stored since the last training.
+ * @param store is the store of dictionaries.
+ * @returns TRUE when a dictionary has to be trained and FALSE when the
+ *          store is stopping (dictionary_store_stop() has been called).
+ */
+gboolean dictionary_store_wait_for_training(dictionary_store_t *store)
+{
+    gboolean train = FALSE;
+
+    g_mutex_lock(&store->mutex);
+
+    while (store->stopping == FALSE && (store->latest > 0 || store->new_blocks < DICTIONARY_STORE_TRAIN_BLOCKS))
+        {
+            g_cond_wait(&store->cond, &store->mutex);
+        }
+
+    train = (store->stopping == FALSE);
+    store->new_blocks = 0;
+
+    g_mutex_unlock(&store->mutex);
+
+    return train;
+}
+
+
+/**
+ * Tells the training thread to end (it has then to be joined).
+ * @param store is the store of dictionaries (may be NULL).
+ */
+void dictionary_store_stop(dictionary_store_t *store)
+{
+    if (store != NULL)
+        {
+            g_mutex_lock(&store->mutex);
+            store->stopping = TRUE;
+            g_cond_signal(&store->cond);
+            g_mutex_unlock(&store->mutex);
+        }
+}
+
+
+/**
+ * Trains a new dictionary from the samples and keeps it as the latest
+ * version.
+ * @param store is the store of dictionaries.
+ * @param sample is the sample of stored blocks.
+ * @param capacity is the maximum size of the dictionary.
+ * @returns the id of the new dictionary or 0 if none could be trained.
+ */
+guint dictionary_store_train(dictionary_store_t *store, dictionary_sample_t *sample, gsize capacity)
+{
+    guchar *dict = NULL;
+    gsize len = 0;
+    gchar *filename = NULL;
+    GError *error = NULL;
+    guint id = 0;
+
+    if (store != NULL && sample != NULL && sample->sizes->len > 0)
+        {
+            dict = train_compress_dictionary(sample->samples->data, (gsize *) sample->sizes->data, sample->sizes->len, capacity, &len);
+        }
+
+    if (dict != NULL)
+        {
+            g_mutex_lock(&store->mutex);
+
+            if (store->next_id <= COMPRESS_DICT_MAX_ID)
+                {
+                    filename = get_dictionary_filename(store, store->next_id);
+
+                    /* The file is written before the dictionary may be used by anyone */
+                    if (g_file_set_contents(filename, (gchar *) dict, len, &error) == TRUE && add_compress_dictionary(store->next_id, dict, len) == TRUE)
+                        {
+                            id = store->next_id;
+                            store->latest = id;
+                            store->next_id = id + 1;
+                        }
+                    else if (error != NULL)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error while saving dictionary %s: %s\n"), filename, error->message);
+                            free_error(error);
+                        }
+
+                    free_variable(filename);
+                }
+
+            g_mutex_unlock(&store->mutex);
+            free_variable(dict);
+        }
+
+    return id;
+}
@@ -0,0 +1,193 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    dictionary_store.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/dictionary_store.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * used by 'cdpfglserver' to train zstd dictionaries from a sample of the
+ * stored blocks, to keep every version of them and to send them to
+ * clients from /Dictionary.json url.
+ */
+#ifndef _SERVER_DICTIONARY_STORE_H_
+#define _SERVER_DICTIONARY_STORE_H_
+
+/**
+ * @def DICTIONARY_STORE_DEFAULT_SIZE
+ * Default maximum size in bytes of a trained dictionary (110 KB as zstd's
+ * own trainer).
+ *
+ * @def DICTIONARY_STORE_SAMPLES
+ * Number of stored blocks randomly chosen to train a dictionary.
+ *
+ * @def DICTIONARY_STORE_SAMPLE_SIZE
+ * Maximum number of bytes of a block used to train a dictionary.
+ * Dictionaries matter for the small blocks of small files and only help
+ * at the beginning of bigger ones.
+ *
+ * @def DICTIONARY_STORE_EXTENSION
+ * Extension of the files where dictionaries are kept (named after their
+ * id).
+ *
+ * @def DICTIONARY_STORE_TRAIN_BLOCKS
+ * Number of blocks to be stored before a new training is tried while
+ * there is no dictionary at all (a fresh server has nothing to train
+ * from when it starts).
+ */
+#define DICTIONARY_STORE_DEFAULT_SIZE (112640)
+#define DICTIONARY_STORE_SAMPLES (8192)
+#define DICTIONARY_STORE_SAMPLE_SIZE (4096)
+#define DICTIONARY_STORE_EXTENSION (".zdict")
+#define DICTIONARY_STORE_TRAIN_BLOCKS (DICTIONARY_STORE_SAMPLES)
+
+
+/**
+ * @struct dictionary_store_t
+ * @brief Every version of the trained dictionaries. Each one is kept in
+ *        its own file in dirname and is registered to be able to
+ *        uncompress blocks compressed with it.
+ */
+typedef struct
+{
+    gchar *dirname;      /**< Directory where dictionaries are kept                        */
+    guint latest;        /**< id of the latest loaded or trained dictionary (0 if none)     */
+    guint next_id;       /**< id of the next trained dictionary (ids are never reused)      */
+    guint64 new_blocks;  /**< Number of blocks stored since the last training               */
+    gboolean stopping;   /**< TRUE when the training thread has to end                      */
+    GMutex mutex;        /**< Protects the fields above and the files of dirname            */
+    GCond cond;          /**< Wakes the training thread up                                  */
+} dictionary_store_t;
+
+
+/**
+ * @struct dictionary_sample_t
+ * @brief Random sample of the stored blocks used to train a dictionary.
+ */
+typedef struct
+{
+    GPtrArray *hashs;     /**< guint8 * hashs randomly chosen among the stored ones */
+    guint64 seen;         /**< Number of stored hashs seen so far                   */
+    GByteArray *samples;  /**< Beginning of each chosen block, one after the other  */
+    GArray *sizes;        /**< gsize size of each sample in samples                 */
+} dictionary_sample_t;
+
+
+/**
+ * Creates the store and registers every dictionary already kept in
+ * dirname.
+ * @param dirname is the directory where dictionaries are kept (created
+ *        if needed).
+ * @returns a newly allocated dictionary_store_t * structure that may be
+ *          freed with free_dictionary_store_t().
+ */
+extern dictionary_store_t *new_dictionary_store_t(gchar *dirname);
+
+
+/**
+ * Frees a dictionary_store_t * structure (registered dictionaries are
+ * kept).
+ * @param store is the structure to be freed.
+ */
+extern void free_dictionary_store_t(dictionary_store_t *store);
+
+
+/**
+ * Makes the json answer to a /Dictionary.json request.
+ * @param store is the store of dictionaries (may be NULL).
+ * @param id is the id of the wanted dictionary (0 for the latest one).
+ * @returns a newly allocated json string or NULL if there is no such
+ *          dictionary.
+ */
+extern gchar *dictionary_store_answer(dictionary_store_t *store, guint id);
+
+
+/**
+ * Creates a new empty sample.
+ * @returns a newly allocated dictionary_sample_t * structure that may be
+ *          freed with free_dictionary_sample_t().
+ */
+extern dictionary_sample_t *new_dictionary_sample_t(void);
+
+
+/**
+ * Frees a dictionary_sample_t * structure.
+ * @param sample is the structure to be freed.
+ */
+extern void free_dictionary_sample_t(dictionary_sample_t *sample);
+
+
+/**
+ * Keeps a stored hash in the sample with a probability that gives each
+ * stored hash the same chance to be in the sample (reservoir sampling).
+ * Used as a GFunc by the backend's foreach_stored_hash function.
+ * @param data is the binary hash (guint8 *).
+ * @param user_data is the dictionary_sample_t * sample.
+ */
+extern void dictionary_sample_hash(gpointer data, gpointer user_data);
+
+
+/**
+ * Adds the beginning of a chosen block to the samples.
+ * @param sample is the sample.
+ * @param data is the uncompressed data of the block.
+ * @param len is the length of data.
+ */
+extern void dictionary_sample_add_block(dictionary_sample_t *sample, guchar *data, gsize len);
+
+
+/**
+ * Counts a newly stored block and wakes the training thread up when
+ * enough blocks have been stored while there is no dictionary.
+ * @param store is the store of dictionaries (may be NULL).
+ */
+extern void dictionary_store_block_stored(dictionary_store_t *store);
+
+
+/**
+ * Waits until a new dictionary has to be trained: when there is still
+ * no dictionary and DICTIONARY_STORE_TRAIN_BLOCKS blocks have been
+ * stored since the last training.
+ * @param store is the store of dictionaries.
+ * @returns TRUE when a dictionary has to be trained and FALSE when the
+ *          store is stopping (dictionary_store_stop() has been called).
+ */
+extern gboolean dictionary_store_wait_for_training(dictionary_store_t *store);
+
+
+/**
+ * Tells the training thread to end (it has then to be joined).
+ * @param store is the store of dictionaries (may be NULL).
+ */
+extern void dictionary_store_stop(dictionary_store_t *store);
+
+
+/**
+ * Trains a new dictionary from the samples and keeps it as the latest
+ * version.
+ * @param store is the store of dictionaries.
+ * @param sample is the sample of stored blocks.
+ * @param capacity is the maximum size of the dictionary.
+ * @returns the id of the new dictionary or 0 if none could be trained.
+ */
+extern guint dictionary_store_train(dictionary_store_t *store, dictionary_sample_t *sample, gsize capacity);
+
+
+#endif /* #ifndef _SERVER_DICTIONARY_STORE_H_ */
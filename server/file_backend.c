@@ -38,113 +38,57 @@ static buffer_t *init_buffer_structure(GFileInputStream *stream);
 static void free_buffer_t(buffer_t *a_buffer);
 static void read_one_buffer(buffer_t *a_buffer);
 static gchar *extract_one_line_from_buffer(buffer_t *a_buffer);
-static meta_data_t *extract_from_line(gchar *line, GRegex *a_regex, query_t *query);
-static GList *get_file_list_from_regex_and_query(GFileInputStream *stream, GRegex *a_regex, query_t *query);
+static meta_data_t *extract_from_line(gchar *line);
+static gboolean import_flat_meta_file(catalog_t *catalog, gchar *filename);
+static void rename_imported_flat_meta_file(gchar *filename);
+static void remove_catalog_files(gchar *catalog_filename);
+static catalog_t *get_host_catalog(file_backend_t *file_backend, gchar *hostname, gboolean create);
+static void close_catalog_from_table(gpointer data);
+static void read_metadata_from_file_meta(gchar *filename_meta, gshort *cmptype, gssize *uncmplen);
 static gshort get_cmptype_from_file_meta(gchar *filename);
-static gssize get_uncmplen_from_file_meta(gchar *filename);
-static void set_metadata_to_file_meta(gchar *filename, gssize uncmplen, gshort cmptype);
+static gboolean set_metadata_to_file_meta(gchar *filename_meta, gssize uncmplen, gshort cmptype);
+static void get_block_metadata(gchar *filename, guint64 filesize, gshort *cmptype, gssize *uncmplen);
+static GRWLock *get_block_lock(file_backend_t *file_backend, gchar *filename);
+static void compress_stored_block(gpointer data, gpointer user_data);
+static gboolean is_hex_name(const gchar *name, gsize len);
+static void walk_data_directory(gchar *path, gchar *hex_prefix, guint depth, guint level, GFunc func, gpointer user_data);
 
 /**
- * Stores meta data into a flat file. A file is created for each host that
- * sends meta data. This code is not thread safe (it means that this is
- * not safe to call it from different threads unless some mechanism
- * garantees that a write will never occur in the same file at the same
- * time.
+ * Stores meta data into the catalog of the host that sent it. A catalog
+ * is created for each host that sends meta data.
  * @param server_struct is the server main structure where all
  *        informations needed by the program are stored.
  * @param smeta the server's structure for file meta data. It contains the
- *        hostname that sent it. This structure IS FREED by this
- *        function.
- * @todo prefix should be set as a configuration's option.
+ *        hostname that sent it.
  */
 void file_store_smeta(server_struct_t *server_struct, server_meta_data_t *smeta)
 {
-    GFile *meta_file = NULL;
-    gchar *filename = NULL;
-    GFileOutputStream *stream = NULL;
-    GError *error = NULL;
-    gsize count = 0;
-    gssize written = 0;
-    gchar *string_written = NULL;
-    gchar *buffer = NULL;
-    gchar *hash_list = NULL;
     meta_data_t *meta = NULL;
-    gchar *prefix = NULL;
     file_backend_t *file_backend = NULL;
-    gchar *name64 = NULL;
-    gchar *link64 = NULL;
-
+    catalog_t *catalog = NULL;
 
     if (server_struct != NULL && server_struct->backend_data != NULL && server_struct->backend_data->user_data != NULL && smeta != NULL)
         {
             meta = smeta->meta;
             file_backend = server_struct->backend_data->user_data;
-            prefix = g_build_filename((gchar *) file_backend->prefix, "meta", NULL);
 
             if (smeta->hostname != NULL && meta != NULL)
                 {
-                    filename = g_build_filename(prefix, smeta->hostname, NULL);
-
-                    meta_file = g_file_new_for_path(filename);
-
-                    stream = g_file_append_to(meta_file, G_FILE_CREATE_NONE, NULL, &error);
+                    catalog = get_host_catalog(file_backend, smeta->hostname, TRUE);
 
-                    if (stream != NULL)
+                    if (catalog != NULL)
                         {
-                            hash_list = convert_hash_data_list_to_gchar(meta->hash_data_list);
-
-                            name64 = encode_to_base64(meta->name);
-                            link64 = encode_to_base64(meta->link);
-
-                            if (name64 == NULL)
-                                {
-                                    name64 = g_strdup("");
-                                }
-
-                            if (link64 == NULL)
-                                {
-                                    link64 = g_strdup("");
-                                }
-
-                            if (hash_list != NULL)
-                                {
-                                    buffer = g_strdup_printf("%d, %" G_GUINT64_FORMAT ", %d, %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", \"%s\", \"%s\", %d, %d, \"%s\", \"%s\", %s\n", meta->file_type, meta->inode, meta->mode, meta->atime, meta->ctime, meta->mtime, meta->size, meta->owner, meta->group, meta->uid, meta->gid, name64, link64, hash_list);
-                                    free_variable(hash_list);
-                                }
-                            else
-                                {
-                                    buffer = g_strdup_printf("%d, %" G_GUINT64_FORMAT ", %d, %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", \"%s\", \"%s\", %d, %d, \"%s\", \"%s\"\n", meta->file_type, meta->inode, meta->mode, meta->atime, meta->ctime, meta->mtime, meta->size, meta->owner, meta->group, meta->uid, meta->gid, name64, link64);
-                                }
-
-                            free_variable(name64);
-                            free_variable(link64);
-
-                            count = strlen(buffer);
-                            written = g_output_stream_write((GOutputStream *) stream, buffer, count, NULL, &error);
-
-                            if (error != NULL)
-                                {
-                                    string_written = g_strdup_printf("%"G_GSSIZE_FORMAT, written);
-                                    print_error(__FILE__, __LINE__, _("Error: unable to write to file %s (%s bytes written).\n"), filename, string_written);
-                                }
-
-                            g_output_stream_close((GOutputStream *) stream, NULL, &error);
-                            free_variable(buffer);
+                            catalog_insert_meta_data(catalog, meta);
                         }
                     else
                         {
-                            print_error(__FILE__, __LINE__, _("Error: unable to open file %s to append meta-data in it.\n"), filename);
+                            print_error(__FILE__, __LINE__, _("Error: unable to open catalog of %s to store meta-data in it.\n"), smeta->hostname);
                         }
-
-                    free_object(meta_file);
-                    free_variable(filename);
                 }
             else
                 {
                     print_error(__FILE__, __LINE__, _("Error: no server_meta_data_t structure or missing hostname or missing meta_data_t * structure.\n"));
                 }
-
-            free_variable(prefix);
         }
 }
 
@@ -172,77 +116,75 @@ static gchar *build_filename_from_hash(gchar *path, gchar *hex_hash, guint level
 
 
 /**
- * Gets cmptype from meta hash file.
- * @param filename is the filename of the hash. The meta file has the
- *        same name but ends with .meta
- * @returns cmptype if possible or COMPRESS_NONE_TYPE.
+ * Reads cmptype and uncmplen from a meta hash file.
+ * @param filename_meta is the filename of the meta file.
+ * @param[out] cmptype is filled with the compression type of the block
+ *             or COMPRESS_NONE_TYPE.
+ * @param[out] uncmplen is filled with the uncompressed len of the block
+ *             or 0.
  */
-static gshort get_cmptype_from_file_meta(gchar *filename)
+static void read_metadata_from_file_meta(gchar *filename_meta, gshort *cmptype, gssize *uncmplen)
 {
-    gchar *filename_meta = NULL;
     GKeyFile *keyfile = NULL;
     GError *error = NULL;
-    gshort cmptype = COMPRESS_NONE_TYPE;
 
-    filename_meta = g_strdup_printf("%s.meta", filename);
+    *cmptype = COMPRESS_NONE_TYPE;
+    *uncmplen = 0;
     keyfile = g_key_file_new();
 
     if (g_key_file_load_from_file(keyfile, filename_meta, G_KEY_FILE_KEEP_COMMENTS, &error))
         {
-            cmptype = (gshort) read_int_from_file(keyfile, filename_meta, GN_META, KN_CMPTYPE, _("Error while reading cmptype value"), COMPRESS_NONE_TYPE);
+            *cmptype = (gshort) read_int_from_file(keyfile, filename_meta, GN_META, KN_CMPTYPE, _("Error while reading cmptype value"), COMPRESS_NONE_TYPE);
+            *uncmplen = read_int64_from_file(keyfile, filename_meta, GN_META, KN_UNCMPLEN, _("Error while reading uncmplen value"), 0);
+        }
+    else
+        {
+            free_error(error);
         }
 
     g_key_file_free(keyfile);
 
-    if (is_compress_type_allowed(cmptype) == FALSE)
+    if (is_compress_type_allowed(*cmptype) == FALSE)
         {
-            cmptype = COMPRESS_NONE_TYPE;
+            *cmptype = COMPRESS_NONE_TYPE;
         }
-
-    return cmptype;
 }
 
 
 /**
- * Gets uncmplen: The uncompressed len of hash file from meta hash file.
+ * Gets cmptype from meta hash file.
  * @param filename is the filename of the hash. The meta file has the
  *        same name but ends with .meta
- * @returns the len of the uncompressed hash file or 0.
+ * @returns cmptype if possible or COMPRESS_NONE_TYPE.
  */
-static gssize get_uncmplen_from_file_meta(gchar *filename)
+static gshort get_cmptype_from_file_meta(gchar *filename)
 {
     gchar *filename_meta = NULL;
-    GKeyFile *keyfile = NULL;
-    GError *error = NULL;
+    gshort cmptype = COMPRESS_NONE_TYPE;
     gssize uncmplen = 0;
 
     filename_meta = g_strdup_printf("%s.meta", filename);
-    keyfile = g_key_file_new();
-
-    if (g_key_file_load_from_file(keyfile, filename_meta, G_KEY_FILE_KEEP_COMMENTS, &error))
-        {
-            uncmplen = read_int64_from_file(keyfile, filename_meta, GN_META, KN_UNCMPLEN, _("Error while reading uncmplen value"), 0);
-        }
-
-    g_key_file_free(keyfile);
+    read_metadata_from_file_meta(filename_meta, &cmptype, &uncmplen);
+    free_variable(filename_meta);
 
-    return uncmplen;
+    return cmptype;
 }
 
+
 /**
- * Sets cmptype and uncmplen in meta hash file.
- * @param filename is the filename of the hash. The meta file has the
- *        same name but ends with .meta
+ * Sets cmptype and uncmplen in a meta hash file.
+ * @param filename_meta is the filename of the meta file (the filename of
+ *        the hash followed by .meta or by .meta.tmp).
  * @param uncmplen the len of the uncompressed hash file.
  * @param cmptype the compression type used to store this hash file.
+ * @returns TRUE if the meta file has been written, FALSE otherwise.
  */
-static void set_metadata_to_file_meta(gchar *filename, gssize uncmplen, gshort cmptype)
+static gboolean set_metadata_to_file_meta(gchar *filename_meta, gssize uncmplen, gshort cmptype)
 {
-    gchar *filename_meta = NULL;
     GKeyFile *keyfile = NULL;
     GError *error = NULL;
+    gboolean written = FALSE;
 
-    filename_meta = g_strdup_printf("%s.meta", filename);
     keyfile = g_key_file_new();
 
     if (is_compress_type_allowed(cmptype) == FALSE)
@@ -253,10 +195,73 @@ static void set_metadata_to_file_meta(gchar *filename, gssize uncmplen, gshort c
     g_key_file_set_int64(keyfile, GN_META, KN_UNCMPLEN, uncmplen);
     g_key_file_set_integer(keyfile, GN_META, KN_CMPTYPE, cmptype);
 
-    g_key_file_save_to_file(keyfile, filename_meta, &error);
+    written = g_key_file_save_to_file(keyfile, filename_meta, &error);
+
+    if (error != NULL)
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to write meta file %s: %s\n"), filename_meta, error->message);
+            free_error(error);
+        }
 
     g_key_file_free(keyfile);
+
+    return written;
+}
+
+
+/**
+ * Gets the meta data of a stored block. compress_stored_block() renames
+ * the compressed block and then its .meta file, and a compressed block
+ * is always smaller than the uncompressed one: the size of the block
+ * tells whether its .meta file is up to date when a crash happened
+ * between the two renames (whatever their order).
+ * @param filename is the filename of the block.
+ * @param filesize is the size of the block.
+ * @param[out] cmptype is filled with the compression type of the block.
+ * @param[out] uncmplen is filled with the uncompressed len of the block.
+ */
+static void get_block_metadata(gchar *filename, guint64 filesize, gshort *cmptype, gssize *uncmplen)
+{
+    gchar *filename_meta = NULL;
+    gshort tmp_cmptype = COMPRESS_NONE_TYPE;
+    gssize tmp_uncmplen = 0;
+
+    filename_meta = g_strdup_printf("%s.meta", filename);
+    read_metadata_from_file_meta(filename_meta, cmptype, uncmplen);
     free_variable(filename_meta);
+
+    if (*cmptype == COMPRESS_NONE_TYPE && *uncmplen > 0 && (guint64) *uncmplen != filesize)
+        {
+            /* The block has been compressed but its .meta file not renamed yet */
+            filename_meta = g_strdup_printf("%s.meta.tmp", filename);
+            read_metadata_from_file_meta(filename_meta, &tmp_cmptype, &tmp_uncmplen);
+            free_variable(filename_meta);
+
+            if (tmp_cmptype != COMPRESS_NONE_TYPE)
+                {
+                    *cmptype = tmp_cmptype;
+                    *uncmplen = tmp_uncmplen;
+                }
+        }
+    else if (*cmptype != COMPRESS_NONE_TYPE && *uncmplen > 0 && (guint64) *uncmplen == filesize)
+        {
+            /* The .meta file has been renamed but the block is still the uncompressed one */
+            *cmptype = COMPRESS_NONE_TYPE;
+        }
+}
+
+
+/**
+ * Gets the lock that protects a block and its .meta file. Locks are
+ * striped on the filename of the block, that is on its hash, so that
+ * only blocks sharing a stripe wait for each other.
+ * @param file_backend is the file backend.
+ * @param filename is the filename of the block.
+ * @returns the lock of the block.
+ */
+static GRWLock *get_block_lock(file_backend_t *file_backend, gchar *filename)
+{
+    return &file_backend->blocks_locks[g_str_hash(filename) % FILE_BACKEND_BLOCK_LOCKS];
 }
 
 
@@ -268,10 +273,10 @@ static void set_metadata_to_file_meta(gchar *filename, gssize uncmplen, gshort c
  *        informations needed by the program are stored.
  * @param hash_data is a hash_data_t * structure that contains the hash and
  *        the corresponding data in a binary form and a 'read' field that
- *        contains the number of bytes in 'data' field.
- * @todo return errors when they occurs
+ *        contains the number of bytes in 'data' field. It is freed here.
+ * @returns TRUE if the block has been written, FALSE otherwise.
  */
-void file_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
+gboolean file_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
 {
     GFile *data_file = NULL;
     gchar *filename = NULL;
@@ -282,7 +287,11 @@ void file_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
     gchar *hex_hash = NULL;
     gchar *path = NULL;
     gchar *prefix = NULL;
+    gchar *filename_meta = NULL;
     file_backend_t *file_backend = NULL;
+    GRWLock *lock = NULL;
+    gshort cmptype = COMPRESS_NONE_TYPE;
+    gboolean stored = FALSE;
 
     if (server_struct != NULL && server_struct->backend_data != NULL && server_struct->backend_data->user_data != NULL)
         {
@@ -295,10 +304,19 @@ void file_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
                     hex_hash = hash_to_string(hash_data->hash);
 
                     filename = build_filename_from_hash(path, hex_hash, file_backend->level);
-                    set_metadata_to_file_meta(filename, hash_data->uncmplen, hash_data->cmptype);
+                    cmptype = hash_data->cmptype;
 
-                    data_file = g_file_new_for_path(filename);
-                    stream = g_file_replace(data_file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+                    filename_meta = g_strdup_printf("%s.meta", filename);
+
+                    /* Only the blocks of this stripe wait while this one is written */
+                    lock = get_block_lock(file_backend, filename);
+                    g_rw_lock_writer_lock(lock);
+
+                    if (set_metadata_to_file_meta(filename_meta, hash_data->uncmplen, hash_data->cmptype) == TRUE)
+                        {
+                            data_file = g_file_new_for_path(filename);
+                            stream = g_file_replace(data_file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+                        }
 
                     if (stream != NULL)
                         {
@@ -309,21 +327,36 @@ void file_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
                                     string_written = g_strdup_printf("%"G_GSSIZE_FORMAT, written);
                                     print_error(__FILE__, __LINE__, _("Error: unable to write to file %s (%s bytes written).\n"), filename, string_written);
                                     free_variable(string_written);
+                                    free_error(error);
+                                    g_output_stream_close((GOutputStream *) stream, NULL, NULL);
+                                }
+                            else if (g_output_stream_close((GOutputStream *) stream, NULL, &error) == FALSE)
+                                {
+                                    print_error(__FILE__, __LINE__, _("Error: unable to close file %s: %s\n"), filename, error->message);
+                                    free_error(error);
                                 }
+                            else
+                                {
+                                    stored = TRUE;
 
-                            g_output_stream_close((GOutputStream *) stream, NULL, &error);
+                                    if (cmptype == COMPRESS_NONE_TYPE && file_backend->compressors != NULL)
+                                        {
+                                            /* The block will be compressed at rest by a background thread */
+                                            g_thread_pool_push(file_backend->compressors, g_strdup(filename), NULL);
+                                        }
+                                }
 
                             g_object_unref(stream);
-                            free_variable(hash_data->data);
-                            free_variable(hash_data->hash);
-                            free_variable(hash_data);
                         }
                     else
                         {
                             print_error(__FILE__, __LINE__, _("Error: unable to open file %s to write data in it.\n"), filename);
+                            free_error(error);
                         }
+                    g_rw_lock_writer_unlock(lock);
 
                     free_object(data_file);
+                    free_variable(filename_meta);
                     free_variable(filename);
                     free_variable(hex_hash);
                     free_variable(path);
@@ -335,6 +368,10 @@ void file_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
 
             free_variable(prefix);
         }
+
+    free_hash_data_t(hash_data);
+
+    return stored;
 }
 
 
@@ -472,6 +509,93 @@ static void make_all_subdirectories(file_backend_t *file_backend)
 }
 
 
+/**
+ * Compresses at rest one block that has been stored uncompressed. This
+ * is the function of the compressors thread pool. The block is left as
+ * is if it is not worth compressing or if it has already been
+ * compressed. Otherwise the compressed block is written to a temporary
+ * file and its meta data to a .meta.tmp file. The block is renamed first
+ * and its .meta file then: file_retrieve_data() reads the .meta.tmp file
+ * of a block whose size tells that it is compressed while its .meta file
+ * says it is not (a crash between the two renames).
+ * @param data is the filename of the block to be compressed. It is
+ *        freed here.
+ * @param user_data is the file_backend_t * structure of the backend.
+ */
+static void compress_stored_block(gpointer data, gpointer user_data)
+{
+    gchar *filename = (gchar *) data;
+    file_backend_t *file_backend = (file_backend_t *) user_data;
+    gchar *filename_tmp = NULL;
+    gchar *filename_meta = NULL;
+    gchar *filename_meta_tmp = NULL;
+    gchar *contents = NULL;
+    gsize len = 0;
+    compress_t *compress = NULL;
+    GError *error = NULL;
+    GRWLock *lock = NULL;
+    gboolean written = FALSE;
+
+    lock = get_block_lock(file_backend, filename);
+
+    g_rw_lock_reader_lock(lock);
+    if (get_cmptype_from_file_meta(filename) == COMPRESS_NONE_TYPE)
+        {
+            g_file_get_contents(filename, &contents, &len, &error);
+        }
+    g_rw_lock_reader_unlock(lock);
+
+    if (error != NULL)
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to read file %s to compress it: %s\n"), filename, error->message);
+            free_error(error);
+        }
+    else if (contents != NULL && is_worth_compressing((guchar *) contents, len) == TRUE)
+        {
+            compress = compress_buffer((guchar *) contents, len, file_backend->cmptype);
+
+            if (compress != NULL && compress->len < len)
+                {
+                    filename_tmp = g_strdup_printf("%s.tmp", filename);
+                    filename_meta = g_strdup_printf("%s.meta", filename);
+                    filename_meta_tmp = g_strdup_printf("%s.meta.tmp", filename);
+                    written = g_file_set_contents(filename_tmp, (gchar *) compress->text, compress->len, &error);
+
+                    if (error != NULL)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to write compressed block %s: %s\n"), filename_tmp, error->message);
+                            free_error(error);
+                        }
+                    else
+                        {
+                            written = set_metadata_to_file_meta(filename_meta_tmp, len, file_backend->cmptype);
+                        }
+
+                    g_rw_lock_writer_lock(lock);
+                    if (written == TRUE && get_cmptype_from_file_meta(filename) == COMPRESS_NONE_TYPE && g_rename(filename_tmp, filename) == 0)
+                        {
+                            g_rename(filename_meta_tmp, filename_meta);
+                        }
+                    else
+                        {
+                            g_unlink(filename_tmp);
+                            g_unlink(filename_meta_tmp);
+                        }
+                    g_rw_lock_writer_unlock(lock);
+
+                    free_variable(filename_meta_tmp);
+                    free_variable(filename_meta);
+                    free_variable(filename_tmp);
+                }
+
+            free_compress_t(compress);
+        }
+
+    free_variable(contents);
+    free_variable(filename);
+}
+
+
 /**
  * Reads keys in keyfile if groupname is in that keyfile and fills
  * file_backend structure accordingly.
@@ -485,6 +609,7 @@ static void read_from_group_file_backend(file_backend_t *file_backend, gchar *fi
     GError *error = NULL;          /** Glib error handling       */
     gchar *prefix = NULL;
     guint level = 0;
+    gint cmptype = COMPRESS_NONE_TYPE;
 
     keyfile = g_key_file_new();
 
@@ -494,6 +619,7 @@ static void read_from_group_file_backend(file_backend_t *file_backend, gchar *fi
                 {
                     prefix = read_string_from_file(keyfile, filename, GN_FILE_BACKEND, KN_FILE_DIRECTORY, _("Could not load [file_backend] file-directory from file."));
                     level = read_int_from_file(keyfile, filename, GN_FILE_BACKEND, KN_DIR_LEVEL, _("Could not load [file_backend] dir-level from file."), FILE_BACKEND_LEVEL);
+                    cmptype = read_int_from_file(keyfile, filename, GN_FILE_BACKEND, KN_COMPRESSION_TYPE, _("Could not load [file_backend] compression-type from file."), COMPRESS_NONE_TYPE);
                 }
         }
     else if (error != NULL)
@@ -518,6 +644,16 @@ static void read_from_group_file_backend(file_backend_t *file_backend, gchar *fi
             file_backend->level = level;
         }
 
+    if (cmptype >= 0 && cmptype <= G_MAXINT16 && is_compress_type_allowed(cmptype) == TRUE && IS_COMPRESS_DICT_TYPE(cmptype) == FALSE)
+        {
+            /* A dictionary type names one version that may not be trained yet when the backend starts */
+            file_backend->cmptype = (gshort) cmptype;
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: compression type %d is not allowed for [file_backend].\n"), cmptype);
+        }
+
     g_key_file_free(keyfile);
 }
 
@@ -534,6 +670,7 @@ void file_init_backend(server_struct_t *server_struct)
 {
     file_backend_t *file_backend = NULL;
     gchar *path = NULL;
+    guint i = 0;
 
     if (server_struct != NULL && server_struct->backend_data != NULL)
         {
@@ -542,6 +679,7 @@ void file_init_backend(server_struct_t *server_struct)
             /* default values */
             file_backend->prefix = g_strdup("/var/tmp/cdpfgl/server");
             file_backend->level = FILE_BACKEND_LEVEL;
+            file_backend->cmptype = COMPRESS_NONE_TYPE;
 
             if (server_struct->opt != NULL && server_struct->opt->configfile != NULL)
                 {
@@ -549,6 +687,20 @@ void file_init_backend(server_struct_t *server_struct)
                     read_from_group_file_backend(file_backend, server_struct->opt->configfile);
                 }
 
+            file_backend->catalogs = g_hash_table_new_full(g_str_hash, g_str_equal, free_variable, close_catalog_from_table);
+            file_backend->importing = g_hash_table_new_full(g_str_hash, g_str_equal, free_variable, NULL);
+            g_mutex_init(&file_backend->catalogs_mutex);
+            g_cond_init(&file_backend->importing_cond);
+            for (i = 0; i < FILE_BACKEND_BLOCK_LOCKS; i++)
+                {
+                    g_rw_lock_init(&file_backend->blocks_locks[i]);
+                }
+
+            if (file_backend->cmptype != COMPRESS_NONE_TYPE)
+                {
+                    file_backend->compressors = g_thread_pool_new(compress_stored_block, file_backend, FILE_BACKEND_COMPRESSORS, FALSE, NULL);
+                }
+
             server_struct->backend_data->user_data = file_backend;
 
             file_create_directory(file_backend->prefix, "meta");
@@ -571,6 +723,45 @@ void file_init_backend(server_struct_t *server_struct)
 }
 
 
+/**
+ * Terminates the backend : closes every opened catalog.
+ * @param backend is the backend_t * structure whose user_data is the
+ *        file_backend_t * structure of this backend.
+ */
+void file_terminate_backend(backend_t *backend)
+{
+    file_backend_t *file_backend = NULL;
+    guint i = 0;
+
+    if (backend != NULL && backend->user_data != NULL)
+        {
+            file_backend = (file_backend_t *) backend->user_data;
+
+            if (file_backend->compressors != NULL)
+                {
+                    /* The data thread has ended (nothing is pushed anymore): waits for blocks already queued to be compressed */
+                    g_thread_pool_free(file_backend->compressors, FALSE, TRUE);
+                    file_backend->compressors = NULL;
+                }
+
+            g_mutex_lock(&file_backend->catalogs_mutex);
+            g_hash_table_destroy(file_backend->catalogs);
+            file_backend->catalogs = NULL;
+            g_hash_table_destroy(file_backend->importing);
+            file_backend->importing = NULL;
+            g_mutex_unlock(&file_backend->catalogs_mutex);
+
+            g_cond_clear(&file_backend->importing_cond);
+            g_mutex_clear(&file_backend->catalogs_mutex);
+            for (i = 0; i < FILE_BACKEND_BLOCK_LOCKS; i++)
+                {
+                    g_rw_lock_clear(&file_backend->blocks_locks[i]);
+                }
+            free_variable(file_backend->prefix);
+        }
+}
+
+
 /**
  * Allocates a newly buffer_t structure and fills it with the corresponding
  * values.
@@ -590,6 +781,7 @@ static buffer_t *init_buffer_structure(GFileInputStream *stream)
     a_buffer->size = 0;
     a_buffer->pos = 0;
     a_buffer->stream = stream;
+    a_buffer->failed = FALSE;
 
     return a_buffer;
 }
@@ -612,6 +804,8 @@ static void free_buffer_t(buffer_t *a_buffer)
  *                needed to read a buffer and to know where we are in it
  *                when parsing it. It fills the structure with the bytes
  *                read, the number of bytes read and puts pos at 0.
+ *                On error size is 0 (as at the end of the file) and
+ *                failed is TRUE.
  */
 static void read_one_buffer(buffer_t *a_buffer)
 {
@@ -626,6 +820,8 @@ static void read_one_buffer(buffer_t *a_buffer)
                 {
                     print_error(__FILE__, __LINE__, _("Error while reading the file: %s\n"), error->message);
                     free_error(error);
+                    a_buffer->size = 0;
+                    a_buffer->failed = TRUE;
                 }
         }
 }
@@ -723,22 +919,16 @@ static gchar *extract_one_line_from_buffer(buffer_t *a_buffer)
 
 
 /**
- * Extracts all meta data from one line.
+ * Extracts all meta data from one line of a flat meta data file (as
+ * written by former versions of the file backend).
  * @param line is the line that has been read.
- * @param a_regex is the regular expression to filter upon the filename
- * @param query is the structure that contains everything about the
- *        requested filename.
- * @returns a newly allocated gchar * string containing the filename that
- *          may be freed when no longer needed
+ * @returns a newly allocated meta_data_t * structure filled with the
+ *          values of the line or NULL if the line is too short.
  */
-static meta_data_t *extract_from_line(gchar *line, GRegex *a_regex, query_t *query)
+static meta_data_t *extract_from_line(gchar *line)
 {
     gchar **params = NULL;
-    gchar *filename = NULL;
     meta_data_t *meta = NULL;
-    guint32 q_uid = 0;
-    guint32 q_gid = 0;
-    gboolean res = FALSE;
 
     if (line != NULL && strlen(line) > 16)
         {
@@ -749,207 +939,316 @@ static meta_data_t *extract_from_line(gchar *line, GRegex *a_regex, query_t *que
 
             params = g_strsplit(line, ",", 14);
 
-            filename = get_substring_from_string(params[11], TRUE);
-
-            if (g_regex_match(a_regex, filename, 0, NULL))
+            if (g_strv_length(params) >= 13)
                 {
                     meta = new_meta_data_t();
 
-                    meta->name = filename;
-
+                    meta->name = get_substring_from_string(params[11], TRUE);
                     meta->file_type = get_uint_from_string(params[0]);
                     meta->inode = get_guint64_from_string(params[1]);
-
                     meta->mode = get_uint_from_string(params[2]);
-
                     meta->atime = get_guint64_from_string(params[3]);
                     meta->ctime = get_guint64_from_string(params[4]);
                     meta->mtime = get_guint64_from_string(params[5]);
+                    meta->size = get_guint64_from_string(params[6]);
+                    meta->owner = get_substring_from_string(params[7], FALSE);
+                    meta->group = get_substring_from_string(params[8], FALSE);
+                    meta->uid = get_uint_from_string(params[9]);
+                    meta->gid = get_uint_from_string(params[10]);
+                    meta->link =  get_substring_from_string(params[12], TRUE);
+                    meta->hash_data_list = make_hash_data_list_from_string(params[13]);
+                }
 
-                    res = compare_mtime_to_date(meta->mtime, query->date);
+            g_strfreev(params);
+        }
 
-                    /** @todo gain speed in comparison by transforming query->afterdate and query->beforedate only once
-                     *        in the calling function
-                     */
-                    if (query->afterdate != NULL)
-                        {
-                            res = res && compare_after_before_date(meta->mtime, query->afterdate, TRUE);
-                        }
+    return meta;
+}
 
-                    if (query->beforedate != NULL)
-                        {
-                            res = res && compare_after_before_date(meta->mtime, query->beforedate, FALSE);
-                        }
 
-                    if (res == TRUE)
-                        {
-                            meta->size = get_guint64_from_string(params[6]);
+/**
+ * Imports every line of a flat meta data file into a catalog. This is
+ * done only once when the catalog of a host that already has a flat meta
+ * data file is created. The transaction must have been begun with
+ * catalog_begin() by the caller. The import stops at the first version
+ * that can not be inserted.
+ * @param catalog is the newly created catalog.
+ * @param filename is the filename of the flat meta data file.
+ * @returns TRUE if the whole file has been read and imported, FALSE
+ *          otherwise.
+ */
+static gboolean import_flat_meta_file(catalog_t *catalog, gchar *filename)
+{
+    GFile *the_file = NULL;
+    GFileInputStream *stream = NULL;
+    GError *error = NULL;
+    buffer_t *a_buffer = NULL;
+    gchar *line = NULL;
+    meta_data_t *meta = NULL;
+    guint64 count = 0;
+    gboolean inserted = TRUE;
+    gboolean imported = FALSE;
 
-                            meta->owner = get_substring_from_string(params[7], FALSE);
-                            meta->group = get_substring_from_string(params[8], FALSE);
-                            meta->link =  get_substring_from_string(params[12], TRUE);
+    the_file = g_file_new_for_path(filename);
+    stream = g_file_read(the_file, NULL, &error);
 
-                            meta->uid = get_uint_from_string(params[9]);
-                            meta->gid = get_uint_from_string(params[10]);
-                            q_uid = get_uint_from_string(query->uid);
-                            q_gid = get_uint_from_string(query->gid);
+    if (stream != NULL)
+        {
+            fprintf(stdout, _("Please wait while importing %s into its catalog\n"), filename);
 
-                            if (strcmp(meta->owner, query->owner) == 0 && strcmp(meta->group, query->group) == 0 && (meta->uid == q_uid) && (meta->gid == q_gid))
-                                {
-                                    meta->hash_data_list = make_hash_data_list_from_string(params[13]);
+            a_buffer = init_buffer_structure(stream);
+            read_one_buffer(a_buffer);
 
-                                    /* This debug message has no text to be translated */
-                                    print_debug("file_backend: --> type %d, inode: %"G_GUINT64_FORMAT", mode: %d, atime: %"G_GUINT64_FORMAT", ctime: %"G_GUINT64_FORMAT", mtime: %"G_GUINT64_FORMAT", size: %"G_GUINT64_FORMAT", filename: %s, owner: %s, group: %s, uid: %d, gid: %d, link: %s\n", meta->file_type, meta->inode, meta->mode, meta->atime, meta->ctime, meta->mtime, meta->size, meta->name, meta->owner, meta->group, meta->uid, meta->gid, meta->link);
-                                 }
-                            else
+            do
+                {
+                    line = extract_one_line_from_buffer(a_buffer);
+
+                    if (a_buffer->size != 0)
+                        {
+                            meta = extract_from_line(line);
+
+                            if (meta != NULL)
                                 {
+                                    inserted = catalog_insert_meta_data(catalog, meta);
                                     free_meta_data_t(meta, TRUE);
-                                    meta = NULL;
+
+                                    if (inserted == TRUE)
+                                        {
+                                            count++;
+                                        }
                                 }
                         }
-                    else
-                        {
-                             free_meta_data_t(meta, TRUE);
-                             meta = NULL;
-                        }
+
+                    free_variable(line);
+                }
+            while (a_buffer->size != 0 && inserted == TRUE);
+
+            imported = (inserted == TRUE && a_buffer->failed == FALSE);
+
+            free_buffer_t(a_buffer);
+            g_input_stream_close((GInputStream *) stream, NULL, NULL);
+            free_object(stream);
+
+            if (imported == TRUE)
+                {
+                    fprintf(stdout, _("Finished ! (%" G_GUINT64_FORMAT " versions imported)\n"), count);
                 }
             else
                 {
-                    free_variable(filename);
+                    print_error(__FILE__, __LINE__, _("Error: import of %s failed after %" G_GUINT64_FORMAT " versions.\n"), filename, count);
                 }
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to open file %s to import it (%s).\n"), filename, error->message);
+            free_error(error);
+        }
 
-            g_strfreev(params);
+    free_object(the_file);
+
+    return imported;
+}
+
+
+/**
+ * Renames a flat meta data file that has been imported into its catalog
+ * so that it is neither imported again nor mistaken for a live file.
+ * @param filename is the filename of the flat meta data file.
+ */
+static void rename_imported_flat_meta_file(gchar *filename)
+{
+    gchar *imported_filename = NULL;
+
+    imported_filename = g_strconcat(filename, FLAT_IMPORTED_SUFFIX, NULL);
+
+    if (g_rename(filename, imported_filename) != 0)
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to rename imported file %s to %s: %s\n"), filename, imported_filename, g_strerror(errno));
         }
 
-    return meta;
+    free_variable(imported_filename);
 }
 
 
 /**
- * @param stream is an opened file stream of a plain meta data flat file.
- * @param a_regex is a GRegex * regular expression.
- * @param query is the structure that contains everything about the user
- *        requested query.
- * @returns the list of files from the flat file containing all meta data.
+ * Removes the files of a catalog whose import failed (the catalog must
+ * have been closed) so that the import is done again the next time.
+ * @param catalog_filename is the filename of the catalog.
  */
-static GList *get_file_list_from_regex_and_query(GFileInputStream *stream, GRegex *a_regex, query_t *query)
+static void remove_catalog_files(gchar *catalog_filename)
 {
-    buffer_t *a_buffer = NULL;
-    gchar *line = NULL;
-    meta_data_t *meta = NULL;
-    GList *file_list = NULL;
+    gchar *filename = NULL;
 
-    a_buffer = init_buffer_structure(stream);
-    read_one_buffer(a_buffer);
+    if (g_unlink(catalog_filename) != 0 && errno != ENOENT)
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to remove catalog %s: %s\n"), catalog_filename, g_strerror(errno));
+        }
 
-    do
+    /* write ahead log files are normally removed when the catalog is closed */
+    filename = g_strconcat(catalog_filename, "-wal", NULL);
+    g_unlink(filename);
+    free_variable(filename);
+
+    filename = g_strconcat(catalog_filename, "-shm", NULL);
+    g_unlink(filename);
+    free_variable(filename);
+}
+
+
+/**
+ * Gets the catalog of a host. Catalogs are opened once and kept opened
+ * until the backend is terminated. A catalog created for a host that
+ * already has a flat meta data file is filled with it. The import is
+ * done outside of catalogs_mutex so that the other hosts are not blocked
+ * meanwhile: the catalog is published only once the import is committed
+ * and threads wanting it wait until then. When the import fails it is
+ * rolled back, the catalog is removed and the flat file kept so that
+ * the import is done again at the next use of the catalog.
+ * @param file_backend is the file backend structure.
+ * @param hostname is the name of the host whose catalog is wanted.
+ * @param create is TRUE if the catalog has to be created when the host
+ *        is not known at all.
+ * @returns the catalog_t * of that host (that must not be freed) or NULL.
+ */
+static catalog_t *get_host_catalog(file_backend_t *file_backend, gchar *hostname, gboolean create)
+{
+    catalog_t *catalog = NULL;
+    gchar *flat_filename = NULL;
+    gchar *catalog_filename = NULL;
+    gchar *basename = NULL;
+    gboolean import = FALSE;
+
+    if (file_backend != NULL && hostname != NULL)
         {
-            line = extract_one_line_from_buffer(a_buffer);
+            g_mutex_lock(&file_backend->catalogs_mutex);
+
+            while (file_backend->catalogs != NULL && g_hash_table_contains(file_backend->importing, hostname) == TRUE)
+                {
+                    g_cond_wait(&file_backend->importing_cond, &file_backend->catalogs_mutex);
+                }
 
-            if (a_buffer->size != 0)
+            if (file_backend->catalogs != NULL)
                 {
-                    meta = extract_from_line(line, a_regex, query);
+                    catalog = g_hash_table_lookup(file_backend->catalogs, hostname);
+                }
+
+            /* catalogs is NULL when the backend has been terminated */
+            if (catalog == NULL && file_backend->catalogs != NULL)
+                {
+                    flat_filename = g_build_filename(file_backend->prefix, "meta", hostname, NULL);
+                    basename = g_strconcat(hostname, CATALOG_SUFFIX, NULL);
+                    catalog_filename = g_build_filename(file_backend->prefix, "meta", basename, NULL);
 
-                    if (meta != NULL)
+                    if (create == TRUE || file_exists(catalog_filename) == TRUE || file_exists(flat_filename) == TRUE)
                         {
-                            file_list = g_list_prepend(file_list, meta);
+                            catalog = open_catalog(catalog_filename);
+
+                            if (catalog != NULL && catalog->created == TRUE && file_exists(flat_filename) == TRUE)
+                                {
+                                    g_hash_table_add(file_backend->importing, g_strdup(hostname));
+                                    import = TRUE;
+                                }
+                            else if (catalog != NULL)
+                                {
+                                    g_hash_table_insert(file_backend->catalogs, g_strdup(hostname), catalog);
+                                }
                         }
+
+                    free_variable(basename);
                 }
 
-            free_variable(line);
+            g_mutex_unlock(&file_backend->catalogs_mutex);
+
+            if (import == TRUE)
+                {
+                    catalog_begin(catalog);
+
+                    if (import_flat_meta_file(catalog, flat_filename) == TRUE)
+                        {
+                            catalog_commit(catalog);
+                            rename_imported_flat_meta_file(flat_filename);
+                        }
+                    else
+                        {
+                            catalog_rollback(catalog);
+                            close_catalog(catalog);
+                            catalog = NULL;
+                            remove_catalog_files(catalog_filename);
+                        }
+
+                    g_mutex_lock(&file_backend->catalogs_mutex);
+
+                    if (catalog != NULL)
+                        {
+                            g_hash_table_insert(file_backend->catalogs, g_strdup(hostname), catalog);
+                        }
+
+                    g_hash_table_remove(file_backend->importing, hostname);
+                    g_cond_broadcast(&file_backend->importing_cond);
+                    g_mutex_unlock(&file_backend->catalogs_mutex);
+                }
+
+            free_variable(catalog_filename);
+            free_variable(flat_filename);
         }
-    while (a_buffer->size != 0);
 
-    free_buffer_t(a_buffer);
+    return catalog;
+}
 
-    return file_list;
+
+/**
+ * Closes a catalog when it is removed from the table of catalogs.
+ * @param data is the catalog_t * to be closed.
+ */
+static void close_catalog_from_table(gpointer data)
+{
+    close_catalog((catalog_t *) data);
 }
 
 
 /**
- * Gets the list of all saved files.
+ * Gets a page of the list of saved files.
  * @param server_struct is the structure that contains all data for the
  *        server.
  * @param query is the structure that contains everything about the
- *        requested query.
- * @returns a JSON string containing all filenames requested
- * @note g_str_match_string is only available since glib 2.40 and
- *       travis-ci.org has an older version of it!
+ *        requested query. query->cursor is updated to the position of
+ *        the last returned version.
+ * @param count is the maximum number of versions to be returned (0 means
+ *        no limit).
+ * @returns a GList * of meta_data_t * sorted by filename and then by
+ *          modification time that may be freed with
+ *          g_list_free_full(list, free_glist_meta_data_t).
  */
-gchar *file_get_list_of_files(server_struct_t *server_struct, query_t *query)
+GList *file_get_list_of_files(server_struct_t *server_struct, query_t *query, guint64 count)
 {
-    gchar *filename = NULL;
     file_backend_t *file_backend = NULL;
-    GFile *the_file = NULL;
-    GFileInputStream *stream = NULL;
-    GError *error = NULL;
-    json_t *array = NULL;
-    json_t *root = NULL;
-    gchar *json_string = NULL;
-    GRegex *a_regex = NULL;
+    catalog_t *catalog = NULL;
     GList *file_list = NULL;
 
 
     if (server_struct != NULL && server_struct->backend_data != NULL && server_struct->backend_data->user_data != NULL && query != NULL)
         {
-            print_debug(_("file_backend: filter is: %s && %s && %s && %s\n"), query->filename, query->date, query->afterdate, query->beforedate);
-
-            a_regex = g_regex_new(query->filename, G_REGEX_CASELESS, 0, &error);
+            print_debug(_("file_backend: filter is: %s && %s && %s && %s, cursor: %s\n"), query->filename, query->date, query->afterdate, query->beforedate, query->cursor);
 
             file_backend = server_struct->backend_data->user_data;
-            filename =  g_build_filename(file_backend->prefix, "meta", query->hostname, NULL);
-            the_file = g_file_new_for_path(filename);
-
-            print_debug(_("file_backend: Reading in %s\n"), filename);
-
-            stream = g_file_read(the_file, NULL, &error);
+            catalog = get_host_catalog(file_backend, query->hostname, FALSE);
 
-            if (stream != NULL)
+            if (catalog != NULL)
                 {
-                    /* Requesting a list of files corresponding to a_regex and query */
-                    file_list = get_file_list_from_regex_and_query(stream, a_regex, query);
-
-                    /* Closing file input stream */
-                    g_input_stream_close((GInputStream *) stream, NULL, &error);
-
-                    /* Sorting the list. As explained in Glib doc, it may be
-                     * quicker to add elements to the list by prepending them
-                     * and then sorting the list once. */
-                    file_list = g_list_sort(file_list, compare_meta_data_t);
-
-                    /* Filtering  */
-                    if (query->latest == TRUE)
-                        {
-                            file_list = keep_latests_meta_data_t_in_list(file_list);
-                        }
-
-                    /* Converting list into JSON array */
-                    array = convert_meta_data_list_to_json_array(file_list, query->hostname, FALSE);
-
-                    /* Freeing memory */
-                    g_list_free_full(file_list, free_glist_meta_data_t);
+                    /* The catalog filters, keeps latest versions (if requested) and sorts the page */
+                    file_list = catalog_get_file_list(catalog, query, count);
                 }
             else
                 {
-                     print_error(__FILE__, __LINE__, _("Error: unable to open file %s to read data from it.\n"), filename);
+                     print_error(__FILE__, __LINE__, _("Error: no catalog for host %s.\n"), query->hostname);
                 }
-
-            free_variable(filename);
-            g_regex_unref(a_regex);
         }
     else
         {
             print_debug(_("file_backend: Something is wrong with backend initialization!\n"));
         }
 
-    root = json_object();
-    insert_json_value_into_json_root(root, "file_list", array);
-    json_string = json_dumps(root, 0);
-
-    json_decref(array);
-    json_decref(root);
-
-    return json_string;
+    return file_list;
 }
 
 
@@ -979,6 +1278,7 @@ hash_data_t *file_retrieve_data(server_struct_t *server_struct, gchar *hex_hash)
     guint64 filesize = 0;
     gshort cmptype = 0;
     gssize uncmplen = 0;
+    GRWLock *lock = NULL;
 
 
     if (server_struct != NULL && server_struct->backend_data != NULL && server_struct->backend_data->user_data != NULL)
@@ -988,13 +1288,17 @@ hash_data_t *file_retrieve_data(server_struct_t *server_struct, gchar *hex_hash)
             hash = string_to_hash(hex_hash);
             path = make_path_from_hash(prefix, hash, file_backend->level);
             filename = build_filename_from_hash(path, hex_hash, file_backend->level);
-            cmptype = get_cmptype_from_file_meta(filename);
+
+            /* The block may be being compressed at rest */
+            lock = get_block_lock(file_backend, filename);
+            g_rw_lock_reader_lock(lock);
             data_file = g_file_new_for_path(filename);
             stream = g_file_read(data_file, NULL, &error);
 
             if (stream != NULL)
                 {
                     filesize = get_file_size(data_file);
+                    get_block_metadata(filename, filesize, &cmptype, &uncmplen);
                     /* we can do this because files here are blocks and
                      * may not be too big: as large as the biggest CLIENT_BUFFER_SIZE. */
                     data = (guchar *) g_malloc(filesize + 1);   /* No need to do g_malloc0  because data is binary data */
@@ -1010,9 +1314,6 @@ hash_data_t *file_retrieve_data(server_struct_t *server_struct, gchar *hex_hash)
                         }
                     else
                         {
-                            /* We need to know the compression type directly from the stored filename */
-                            uncmplen = get_uncmplen_from_file_meta(filename);
-
                             /* see retreive_data() in server.c */
                             hash_data = new_hash_data_t_as_is(data, size_read, hash, cmptype, uncmplen);
                         }
@@ -1024,6 +1325,7 @@ hash_data_t *file_retrieve_data(server_struct_t *server_struct, gchar *hex_hash)
                 {
                      print_error(__FILE__, __LINE__, _("Error: unable to open file %s to read data from it.\n"), filename);
                 }
+            g_rw_lock_reader_unlock(lock);
 
             free_object(data_file);
             free_variable(filename);
@@ -1033,3 +1335,95 @@ hash_data_t *file_retrieve_data(server_struct_t *server_struct, gchar *hex_hash)
 
     return hash_data;
 }
+
+
+/**
+ * Tells whether a directory entry name is made of len hexadecimal
+ * characters (as written by file_store_data).
+ * @param name is the name of the directory entry.
+ * @param len is the expected length of the name.
+ * @returns TRUE if name is len lowercase hexadecimal characters long.
+ */
+static gboolean is_hex_name(const gchar *name, gsize len)
+{
+    return (strlen(name) == len && strspn(name, "0123456789abcdef") == len);
+}
+
+
+/**
+ * Walks recursively into a directory of the data directory and calls
+ * func with each hash found in the leafs.
+ * @param path is the directory to walk into.
+ * @param hex_prefix is the beginning of the hexadecimal representation
+ *        of every hash stored under path (made of parent's names).
+ * @param depth is the depth of path (0 is prefix/data itself).
+ * @param level is the level of directories of the file backend.
+ * @param func is the function to be called with each binary hash.
+ * @param user_data is passed as is to func.
+ */
+static void walk_data_directory(gchar *path, gchar *hex_prefix, guint depth, guint level, GFunc func, gpointer user_data)
+{
+    GDir *dir = NULL;
+    const gchar *name = NULL;
+    gchar *subpath = NULL;
+    gchar *hex_hash = NULL;
+    guint8 *hash = NULL;
+
+    dir = g_dir_open(path, 0, NULL);
+
+    if (dir != NULL)
+        {
+            while ((name = g_dir_read_name(dir)) != NULL)
+                {
+                    if (depth < level && is_hex_name(name, 2) == TRUE)
+                        {
+                            subpath = g_build_filename(path, name, NULL);
+                            hex_hash = g_strconcat(hex_prefix, name, NULL);
+
+                            walk_data_directory(subpath, hex_hash, depth + 1, level, func, user_data);
+
+                            free_variable(hex_hash);
+                            free_variable(subpath);
+                        }
+                    else if (depth == level && is_hex_name(name, (HASH_LEN - level) * 2) == TRUE)
+                        {
+                            /* .meta files are not matched here */
+                            hex_hash = g_strconcat(hex_prefix, name, NULL);
+                            hash = string_to_hash(hex_hash);
+
+                            func(hash, user_data);
+
+                            free_variable(hash);
+                            free_variable(hex_hash);
+                        }
+                }
+
+            g_dir_close(dir);
+        }
+}
+
+
+/**
+ * Calls func with each hash stored into the data directory. This may
+ * take some time as it walks through every directory.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param func is the function to be called. Its first argument is the
+ *        binary hash (guint8 *) that must not be freed by func.
+ * @param user_data is passed as is to func as its second argument.
+ */
+void file_foreach_stored_hash(server_struct_t *server_struct, GFunc func, gpointer user_data)
+{
+    file_backend_t *file_backend = NULL;
+    gchar *prefix = NULL;
+
+    if (server_struct != NULL && server_struct->backend_data != NULL && server_struct->backend_data->user_data != NULL && func != NULL)
+        {
+            file_backend = server_struct->backend_data->user_data;
+            prefix = g_build_filename((gchar *) file_backend->prefix, "data", NULL);
+
+            walk_data_directory(prefix, "", 0, file_backend->level, func, user_data);
+
+            free_variable(prefix);
+        }
+}
@@ -44,6 +44,23 @@
  */
 #define FILE_BACKEND_LEVEL (2)
 
+
+/**
+ * @def FILE_BACKEND_COMPRESSORS
+ * Defines the number of background threads that compress stored blocks
+ * at rest when a compression type is set in [File_Backend] group.
+ */
+#define FILE_BACKEND_COMPRESSORS (2)
+
+
+/**
+ * @def FILE_BACKEND_BLOCK_LOCKS
+ * Number of locks that protect blocks being written or compressed. A
+ * block uses the lock selected by the hash of its filename so that
+ * blocks are stored, compressed and retrieved concurrently.
+ */
+#define FILE_BACKEND_BLOCK_LOCKS (64)
+
 /**
  * To store meta data of the hash file.
  */
@@ -62,11 +79,20 @@
  * to store up to 512 Gbytes of deduplicated data. A level of 3 should be
  * ok up to 256 tera bytes of deduplicated data. A level of 4 should be ok
  * for up to 65536 tera bytes !
+ * When cmptype is not COMPRESS_NONE_TYPE, blocks stored uncompressed are
+ * compressed afterwards by the compressors thread pool.
  */
 typedef struct
 {
-    gchar *prefix; /**< Prefix for the path where data are located */
-    guint level;   /**< level of directories defaults to 3 */
+    gchar *prefix;            /**< Prefix for the path where data are located                   */
+    guint level;              /**< level of directories defaults to 3                           */
+    GHashTable *catalogs;     /**< Opened catalogs (catalog_t *) of each host indexed by hostname */
+    GMutex catalogs_mutex;    /**< Protects catalogs and importing hash tables                  */
+    GHashTable *importing;    /**< Hostnames whose catalog is being imported from a flat file   */
+    GCond importing_cond;     /**< Signaled with catalogs_mutex when an import ends             */
+    gshort cmptype;           /**< Compression type used at rest (COMPRESS_NONE_TYPE disables it) */
+    GThreadPool *compressors; /**< Background threads that compress raw stored blocks (or NULL) */
+    GRWLock blocks_locks[FILE_BACKEND_BLOCK_LOCKS]; /**< Protect a block and its .meta file while being rewritten (see get_block_lock()) */
 } file_backend_t;
 
 
@@ -82,21 +108,18 @@ typedef struct
     gssize pos;                 /**< Position into the buffer                 */
     gssize size;                /**< number of bytes read into the buffer     */
     gchar *buf;                 /**< buffer read                              */
+    gboolean failed;            /**< TRUE when reading the stream failed      */
 } buffer_t;
 
 
 
 /**
- * Stores meta data into a flat file. A file is created for each host that
- * sends meta data. This code is not thread safe (it means that this is
- * not safe to call it from different threads unless some mechanism
- * garantees that a write will never occur in the same file at the same
- * time.
- * @param server_struct is the server's main structure where all
+ * Stores meta data into the catalog of the host that sent it. A catalog
+ * is created for each host that sends meta data.
+ * @param server_struct is the server main structure where all
  *        informations needed by the program are stored.
  * @param smeta the server's structure for file meta data. It contains the
- *        hostname that sent it. This structure MUST be freed by this
- *        function.
+ *        hostname that sent it.
  */
 extern void file_store_smeta(server_struct_t *server_struct, server_meta_data_t *smeta);
 
@@ -111,6 +134,14 @@ extern void file_store_smeta(server_struct_t *server_struct, server_meta_data_t
 extern void file_init_backend(server_struct_t *server_struct);
 
 
+/**
+ * Terminates the backend : closes every opened catalog.
+ * @param backend is the backend_t * structure whose user_data is the
+ *        file_backend_t * structure of this backend.
+ */
+extern void file_terminate_backend(backend_t *backend);
+
+
 /**
  * Stores data into a flat file. The file is named by its hash in hex
  * representation (one should easily check that the sha256sum of such a
@@ -119,9 +150,10 @@ extern void file_init_backend(server_struct_t *server_struct);
  *        informations needed by the program are stored.
  * @param hash_data is a hash_data_t * structure that contains the hash and
  *        the corresponding data in a binary form and a 'read' field that
- *        contains the number of bytes in 'data' field.
+ *        contains the number of bytes in 'data' field. It is freed here.
+ * @returns TRUE if the block has been written, FALSE otherwise.
  */
-extern void file_store_data(server_struct_t *server_struct, hash_data_t *hash_data);
+extern gboolean file_store_data(server_struct_t *server_struct, hash_data_t *hash_data);
 
 
 /**
@@ -134,14 +166,19 @@ extern GList *file_build_needed_hash_list(server_struct_t *server_struct, GList
 
 
 /**
- * Gets the list of all saved files
+ * Gets a page of the list of saved files.
  * @param server_struct is the structure that contains all data for the
  *        server.
  * @param query is the structure that contains everything about the
- *        requested query.
- * @returns a JSON string containing all filenames requested
+ *        requested query. query->cursor is updated to the position of
+ *        the last returned version.
+ * @param count is the maximum number of versions to be returned (0 means
+ *        no limit).
+ * @returns a GList * of meta_data_t * sorted by filename and then by
+ *          modification time that may be freed with
+ *          g_list_free_full(list, free_glist_meta_data_t).
  */
-extern gchar *file_get_list_of_files(server_struct_t *server_struct, query_t *query);
+extern GList *file_get_list_of_files(server_struct_t *server_struct, query_t *query, guint64 count);
 
 
 /**
@@ -155,4 +192,16 @@ extern gchar *file_get_list_of_files(server_struct_t *server_struct, query_t *qu
  */
 extern hash_data_t *file_retrieve_data(server_struct_t *server_struct, gchar *hex_hash);
 
+
+/**
+ * Calls func with each hash stored into the data directory. This may
+ * take some time as it walks through every directory.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param func is the function to be called. Its first argument is the
+ *        binary hash (guint8 *) that must not be freed by func.
+ * @param user_data is passed as is to func as its second argument.
+ */
+extern void file_foreach_stored_hash(server_struct_t *server_struct, GFunc func, gpointer user_data);
+
 #endif /* #ifndef _SERVER_FILE_BACKEND_H_ */
@@ -0,0 +1,228 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    file_list.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/file_list.c
+ *
+ * This file contains the functions that stream the answer of
+ * /File/List.json requests. The answer is produced page after page from
+ * the meta data backend while MHD sends it to the client so the memory
+ * used does not depend on the number of files listed.
+ */
+
+#include "server.h"
+
+static gboolean limit_reached(file_list_stream_t *stream);
+static void get_next_page(file_list_stream_t *stream);
+static void fill_pending(file_list_stream_t *stream);
+
+
+/**
+ * Creates a new stream to answer a /File/List.json request.
+ * @param server_struct is the main structure for the server.
+ * @param backend is the meta data backend to list files from.
+ * @param query is the query of the request. It is owned by the stream
+ *        and freed with it.
+ * @returns a newly allocated file_list_stream_t * structure that may be
+ *          freed with free_file_list_stream().
+ */
+file_list_stream_t *new_file_list_stream(server_struct_t *server_struct, backend_t *backend, query_t *query)
+{
+    file_list_stream_t *stream = NULL;
+
+    stream = (file_list_stream_t *) g_malloc0(sizeof(file_list_stream_t));
+
+    stream->server_struct = server_struct;
+    stream->backend = backend;
+    stream->query = query;
+    stream->page = NULL;
+    stream->entry = NULL;
+    stream->pending = g_string_sized_new(4096);
+    stream->offset = 0;
+    stream->count = 0;
+    stream->state = FILE_LIST_HEADER;
+    stream->more = TRUE;
+
+    return stream;
+}
+
+
+/**
+ * Frees a file_list_stream_t * structure and its query. Also used as
+ * MHD content reader free callback.
+ * @param cls is the file_list_stream_t * structure to be freed.
+ */
+void free_file_list_stream(void *cls)
+{
+    file_list_stream_t *stream = (file_list_stream_t *) cls;
+
+    if (stream != NULL)
+        {
+            g_list_free_full(stream->page, free_glist_meta_data_t);
+            g_string_free(stream->pending, TRUE);
+            free_query_t(stream->query);
+            free_variable(stream);
+        }
+}
+
+
+/**
+ * Tells whether the number of versions requested by the client (if
+ * any) has been sent.
+ * @param stream is the stream of the answer.
+ * @returns TRUE if query->limit versions have been sent, FALSE otherwise.
+ */
+static gboolean limit_reached(file_list_stream_t *stream)
+{
+    return (stream->query->limit > 0 && stream->count >= stream->query->limit);
+}
+
+
+/**
+ * Frees the page that has been sent and gets the next one from the
+ * backend. A page never goes past the limit requested by the client.
+ * There are no more pages when the cursor of the query did not move.
+ * @param stream is the stream of the answer.
+ */
+static void get_next_page(file_list_stream_t *stream)
+{
+    query_t *query = stream->query;
+    guint64 size = FILE_LIST_PAGE_SIZE;
+    gchar *previous = NULL;
+    gint64 start = 0;
+
+    g_list_free_full(stream->page, free_glist_meta_data_t);
+    stream->page = NULL;
+    stream->entry = NULL;
+
+    if (query->limit > 0 && query->limit - stream->count < size)
+        {
+            size = query->limit - stream->count;
+        }
+
+    previous = g_strdup(query->cursor);
+    start = g_get_monotonic_time();
+    stream->page = stream->backend->get_list_of_files(stream->server_struct, query, size);
+    add_latency_to_stats(stream->server_struct->stats, STATS_LATENCY_GET_LIST_OF_FILES, start);
+    stream->entry = stream->page;
+    stream->more = (g_strcmp0(previous, query->cursor) != 0);
+    free_variable(previous);
+}
+
+
+/**
+ * Appends the next part of the json answer to the pending buffer.
+ * @param stream is the stream of the answer.
+ */
+static void fill_pending(file_list_stream_t *stream)
+{
+    gchar *json_str = NULL;
+
+    switch (stream->state)
+        {
+            case FILE_LIST_HEADER:
+                g_string_append(stream->pending, "{\"file_list\":[");
+                stream->state = FILE_LIST_ENTRIES;
+            break;
+
+            case FILE_LIST_ENTRIES:
+                if (stream->entry != NULL)
+                    {
+                        json_str = convert_meta_data_to_json_string(stream->entry->data, stream->query->hostname, FALSE);
+
+                        if (stream->count > 0)
+                            {
+                                g_string_append_c(stream->pending, ',');
+                            }
+
+                        g_string_append(stream->pending, json_str);
+                        free_variable(json_str);
+
+                        stream->count = stream->count + 1;
+                        stream->entry = g_list_next(stream->entry);
+                    }
+                else if (stream->more == TRUE && limit_reached(stream) == FALSE)
+                    {
+                        get_next_page(stream);
+                    }
+                else
+                    {
+                        stream->state = FILE_LIST_FOOTER;
+                    }
+            break;
+
+            case FILE_LIST_FOOTER:
+                g_string_append_c(stream->pending, ']');
+
+                /* The client has to ask for the next page only when it did not get everything */
+                if (stream->more == TRUE && limit_reached(stream) == TRUE && stream->query->cursor != NULL)
+                    {
+                        g_string_append_printf(stream->pending, ",\"cursor\":\"%s\"", stream->query->cursor);
+                    }
+
+                g_string_append_c(stream->pending, '}');
+                stream->state = FILE_LIST_DONE;
+            break;
+
+            default:
+            break;
+        }
+}
+
+
+/**
+ * MHD content reader callback that sends the answer of a /File/List.json
+ * request. Pages of meta data are asked to the backend only when the
+ * previous one has been sent.
+ * @param cls is the file_list_stream_t * structure of the answer.
+ * @param pos is the position in the answer (unused: MHD reads it in order).
+ * @param buf is the buffer to be filled.
+ * @param max is the maximum number of bytes that may be written in buf.
+ * @returns the number of bytes written in buf or
+ *          MHD_CONTENT_READER_END_OF_STREAM when everything has been sent.
+ */
+ssize_t file_list_stream_reader(void *cls, uint64_t pos, char *buf, size_t max)
+{
+    file_list_stream_t *stream = (file_list_stream_t *) cls;
+    gsize size = 0;
+
+    if (stream->offset >= stream->pending->len)
+        {
+            g_string_truncate(stream->pending, 0);
+            stream->offset = 0;
+
+            while (stream->pending->len == 0 && stream->state != FILE_LIST_DONE)
+                {
+                    fill_pending(stream);
+                }
+        }
+
+    if (stream->pending->len == 0)
+        {
+            return MHD_CONTENT_READER_END_OF_STREAM;
+        }
+
+    size = MIN(max, stream->pending->len - stream->offset);
+    memcpy(buf, stream->pending->str + stream->offset, size);
+    stream->offset = stream->offset + size;
+
+    return (ssize_t) size;
+}
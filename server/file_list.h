@@ -0,0 +1,109 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    file_list.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/file_list.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * used by 'cdpfglserver' to stream the answer of /File/List.json requests
+ * page after page instead of building it at once in memory.
+ */
+#ifndef _SERVER_FILE_LIST_H_
+#define _SERVER_FILE_LIST_H_
+
+/**
+ * @def FILE_LIST_PAGE_SIZE
+ * Number of versions of files asked at once to the meta data backend
+ * while streaming an answer.
+ */
+#define FILE_LIST_PAGE_SIZE (256)
+
+
+/**
+ * @enum file_list_state_t
+ * @brief Part of the json answer that is being produced.
+ */
+typedef enum
+{
+    FILE_LIST_HEADER,   /**< '{"file_list":[' has to be sent                       */
+    FILE_LIST_ENTRIES,  /**< versions of files are being sent                      */
+    FILE_LIST_FOOTER,   /**< closing ']', the cursor (if any) and '}' have to be sent */
+    FILE_LIST_DONE,     /**< everything has been sent                              */
+} file_list_state_t;
+
+
+/**
+ * @struct file_list_stream_t
+ * @brief State of a /File/List.json answer that is being streamed.
+ *
+ * Only one page of meta data and the json text not yet sent to the client
+ * are kept in memory.
+ */
+typedef struct
+{
+    server_struct_t *server_struct; /**< main structure of the server                          */
+    backend_t *backend;             /**< meta data backend where files are listed              */
+    query_t *query;                 /**< query of the request (its cursor moves page by page)  */
+    GList *page;                    /**< current page of meta_data_t *                         */
+    GList *entry;                   /**< next entry of page to be sent                         */
+    GString *pending;               /**< json text not yet (completely) sent                   */
+    gsize offset;                   /**< number of bytes of pending already sent               */
+    guint64 count;                  /**< number of versions of files already sent              */
+    file_list_state_t state;        /**< part of the answer being produced                     */
+    gboolean more;                  /**< TRUE while the backend may have more versions         */
+} file_list_stream_t;
+
+
+/**
+ * Creates a new stream to answer a /File/List.json request.
+ * @param server_struct is the main structure for the server.
+ * @param backend is the meta data backend to list files from.
+ * @param query is the query of the request. It is owned by the stream
+ *        and freed with it.
+ * @returns a newly allocated file_list_stream_t * structure that may be
+ *          freed with free_file_list_stream().
+ */
+extern file_list_stream_t *new_file_list_stream(server_struct_t *server_struct, backend_t *backend, query_t *query);
+
+
+/**
+ * MHD content reader callback that sends the answer of a /File/List.json
+ * request. Pages of meta data are asked to the backend only when the
+ * previous one has been sent.
+ * @param cls is the file_list_stream_t * structure of the answer.
+ * @param pos is the position in the answer (unused: MHD reads it in order).
+ * @param buf is the buffer to be filled.
+ * @param max is the maximum number of bytes that may be written in buf.
+ * @returns the number of bytes written in buf or
+ *          MHD_CONTENT_READER_END_OF_STREAM when everything has been sent.
+ */
+extern ssize_t file_list_stream_reader(void *cls, uint64_t pos, char *buf, size_t max);
+
+
+/**
+ * Frees a file_list_stream_t * structure and its query. Also used as
+ * MHD content reader free callback.
+ * @param cls is the file_list_stream_t * structure to be freed.
+ */
+extern void free_file_list_stream(void *cls);
+
+
+#endif /* #ifndef _SERVER_FILE_LIST_H_ */
@@ -0,0 +1,450 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    hash_array.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/hash_array.c
+ *
+ * This file contains the functions that stream the answer of
+ * /Data/Hash_Array.json requests. Each block is read once from the data
+ * backend (or the block cache), uncompressed, base64 encoded into a small
+ * buffer and sent: the whole data is never assembled in memory.
+ */
+
+#include "server.h"
+
+static hash_data_t *get_block(hash_array_stream_t *stream, hash_data_t *header_hd);
+static gpointer prefetch_thread(gpointer user_data);
+static hash_data_t *pop_block(hash_array_stream_t *stream);
+static void append_base64(hash_array_stream_t *stream, guchar *data, gsize len);
+static void append_base64_close(hash_array_stream_t *stream);
+static void append_framed_block(hash_array_stream_t *stream, hash_data_t *block);
+static void append_block(hash_array_stream_t *stream, hash_data_t *block);
+static void append_footer(hash_array_stream_t *stream);
+static void fill_pending(hash_array_stream_t *stream);
+
+
+/**
+ * Creates a new stream to answer a /Data/Hash_Array.json request and
+ * starts retrieving blocks.
+ * @param server_struct is the main structure for the server.
+ * @param hash_list is the hash_data_t * list of requested hashs (in the
+ *        order they have to be sent). It is owned by the stream and freed
+ *        with it.
+ * @param compressed is TRUE when blocks have to be sent as stored (each
+ *        one with its own compression type) and FALSE when they have to
+ *        be sent uncompressed and concatenated.
+ * @returns a newly allocated hash_array_stream_t * structure that may be
+ *          freed with free_hash_array_stream().
+ */
+hash_array_stream_t *new_hash_array_stream(server_struct_t *server_struct, GList *hash_list, gboolean compressed)
+{
+    hash_array_stream_t *stream = NULL;
+
+    stream = (hash_array_stream_t *) g_malloc0(sizeof(hash_array_stream_t));
+
+    stream->server_struct = server_struct;
+    stream->hash_list = hash_list;
+    stream->compressed = compressed;
+    stream->blocks = g_queue_new();
+    stream->prefetched = FALSE;
+    stream->cancelled = FALSE;
+    g_mutex_init(&stream->mutex);
+    g_cond_init(&stream->cond);
+    stream->pending = g_string_sized_new(65536);
+    stream->offset = 0;
+    stream->base64_state = 0;
+    stream->base64_save = 0;
+    stream->checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    stream->size = 0;
+    stream->nb_blocks = 0;
+    stream->state = HASH_ARRAY_HEADER;
+
+    stream->thread = g_thread_new("hash-array", prefetch_thread, stream);
+
+    return stream;
+}
+
+
+/**
+ * Stops the prefetch thread and frees a hash_array_stream_t * structure.
+ * Also used as MHD content reader free callback.
+ * @param cls is the hash_array_stream_t * structure to be freed.
+ */
+void free_hash_array_stream(void *cls)
+{
+    hash_array_stream_t *stream = (hash_array_stream_t *) cls;
+
+    if (stream != NULL)
+        {
+            /* The client may have gone away before everything was sent */
+            g_mutex_lock(&stream->mutex);
+            stream->cancelled = TRUE;
+            g_cond_broadcast(&stream->cond);
+            g_mutex_unlock(&stream->mutex);
+
+            g_thread_join(stream->thread);
+
+            g_queue_free_full(stream->blocks, free_hdt_struct);
+            g_list_free_full(stream->hash_list, free_hdt_struct);
+            g_mutex_clear(&stream->mutex);
+            g_cond_clear(&stream->cond);
+            g_string_free(stream->pending, TRUE);
+            g_checksum_free(stream->checksum);
+            free_variable(stream);
+        }
+}
+
+
+/**
+ * Retrieves one block (through the block cache) and uncompresses it if
+ * the client did not ask for compressed blocks.
+ * @param stream is the stream of the answer.
+ * @param header_hd is the requested hash (binary form in hash field).
+ * @returns a hash_data_t * structure containing the data of the block
+ *          (as stored when stream->compressed is TRUE, uncompressed
+ *          otherwise) or NULL on error (the block is then skipped as
+ *          before).
+ */
+static hash_data_t *get_block(hash_array_stream_t *stream, hash_data_t *header_hd)
+{
+    gchar *hash = NULL;
+    hash_data_t *hash_data = NULL;
+    hash_data_t *block = NULL;
+    compress_t *compress = NULL;
+    server_struct_t *server_struct = stream->server_struct;
+
+    hash = hash_to_string(header_hd->hash);
+    hash_data = block_cache_retrieve_data(server_struct->block_cache, server_struct->backend_data, server_struct, hash);
+    free_variable(hash);
+
+    if (hash_data != NULL)
+        {
+            if (stream->compressed == TRUE || hash_data->cmptype == COMPRESS_NONE_TYPE)
+                {
+                    /* Sent as is: no copy */
+                    block = hash_data;
+                }
+            else
+                {
+                    compress = uncompress_buffer(hash_data->data, hash_data->read, hash_data->uncmplen, hash_data->cmptype);
+
+                    if (compress != NULL)
+                        {
+                            block = new_hash_data_t_as_is(compress->text, compress->len, hash_data->hash, COMPRESS_NONE_TYPE, compress->len);
+                            compress->text = NULL;
+                            hash_data->hash = NULL;
+                            free_compress_t(compress);
+                        }
+                    else
+                        {
+                            print_error(__FILE__, __LINE__, _("Error while uncompressing one block.\n"));
+                        }
+
+                    free_hash_data_t(hash_data);
+                }
+        }
+
+    return block;
+}
+
+
+/**
+ * Thread that retrieves blocks ahead. It waits when
+ * HASH_ARRAY_PREFETCH blocks are already waiting to be sent and stops
+ * when the stream is cancelled.
+ * @param user_data is the hash_array_stream_t * structure of the answer.
+ * @returns NULL
+ */
+static gpointer prefetch_thread(gpointer user_data)
+{
+    hash_array_stream_t *stream = (hash_array_stream_t *) user_data;
+    GList *head = stream->hash_list;
+    hash_data_t *block = NULL;
+    gboolean cancelled = FALSE;
+
+    while (head != NULL && cancelled == FALSE)
+        {
+            block = get_block(stream, head->data);
+
+            g_mutex_lock(&stream->mutex);
+
+            while (g_queue_get_length(stream->blocks) >= HASH_ARRAY_PREFETCH && stream->cancelled == FALSE)
+                {
+                    g_cond_wait(&stream->cond, &stream->mutex);
+                }
+
+            cancelled = stream->cancelled;
+
+            if (block != NULL && cancelled == FALSE)
+                {
+                    g_queue_push_tail(stream->blocks, block);
+                    g_cond_broadcast(&stream->cond);
+                }
+            else
+                {
+                    free_hash_data_t(block);
+                }
+
+            g_mutex_unlock(&stream->mutex);
+
+            head = g_list_next(head);
+        }
+
+    g_mutex_lock(&stream->mutex);
+    stream->prefetched = TRUE;
+    g_cond_broadcast(&stream->cond);
+    g_mutex_unlock(&stream->mutex);
+
+    return NULL;
+}
+
+
+/**
+ * Waits for the next block retrieved by the prefetch thread.
+ * @param stream is the stream of the answer.
+ * @returns the next hash_data_t * block or NULL when every block has
+ *          been sent.
+ */
+static hash_data_t *pop_block(hash_array_stream_t *stream)
+{
+    hash_data_t *block = NULL;
+
+    g_mutex_lock(&stream->mutex);
+
+    while (g_queue_is_empty(stream->blocks) == TRUE && stream->prefetched == FALSE)
+        {
+            g_cond_wait(&stream->cond, &stream->mutex);
+        }
+
+    block = (hash_data_t *) g_queue_pop_head(stream->blocks);
+    g_cond_broadcast(&stream->cond);
+
+    g_mutex_unlock(&stream->mutex);
+
+    return block;
+}
+
+
+/**
+ * Base64 encodes some data at the end of the pending buffer. The
+ * encoding may be continued by another call and must be ended with
+ * append_base64_close().
+ * @param stream is the stream of the answer.
+ * @param data is the data to be encoded.
+ * @param len is the length of data.
+ */
+static void append_base64(hash_array_stream_t *stream, guchar *data, gsize len)
+{
+    gsize pos = stream->pending->len;
+    gsize written = 0;
+
+    /* g_base64_encode_step needs at most (len / 3 + 1) * 4 + 4 bytes */
+    g_string_set_size(stream->pending, pos + (len / 3 + 1) * 4 + 4);
+    written = g_base64_encode_step(data, len, FALSE, stream->pending->str + pos, &stream->base64_state, &stream->base64_save);
+    g_string_truncate(stream->pending, pos + written);
+}
+
+
+/**
+ * Ends the base64 encoding begun with append_base64().
+ * @param stream is the stream of the answer.
+ */
+static void append_base64_close(hash_array_stream_t *stream)
+{
+    gsize pos = stream->pending->len;
+    gsize written = 0;
+
+    g_string_set_size(stream->pending, pos + 4);
+    written = g_base64_encode_close(FALSE, stream->pending->str + pos, &stream->base64_state, &stream->base64_save);
+    g_string_truncate(stream->pending, pos + written);
+
+    stream->base64_state = 0;
+    stream->base64_save = 0;
+}
+
+
+/**
+ * Appends one block, as stored, with its own framing: a json object with
+ * "data", "size", "cmptype", "uncmpsize" and "hash" keys.
+ * @param stream is the stream of the answer.
+ * @param block is the block to be sent. It is freed here.
+ */
+static void append_framed_block(hash_array_stream_t *stream, hash_data_t *block)
+{
+    gchar *encoded_hash = NULL;
+
+    if (stream->nb_blocks > 0)
+        {
+            g_string_append_c(stream->pending, ',');
+        }
+
+    g_string_append(stream->pending, "{\"data\":\"");
+    append_base64(stream, block->data, block->read);
+    append_base64_close(stream);
+
+    encoded_hash = g_base64_encode(block->hash, HASH_LEN);
+    g_string_append_printf(stream->pending, "\",\"size\":%" G_GSSIZE_FORMAT ",\"cmptype\":%d,\"uncmpsize\":%" G_GSSIZE_FORMAT ",\"hash\":\"%s\"}",
+                           block->read, block->cmptype, block->uncmplen, encoded_hash);
+    free_variable(encoded_hash);
+
+    stream->nb_blocks = stream->nb_blocks + 1;
+    free_hash_data_t(block);
+}
+
+
+/**
+ * Appends one uncompressed block to the data being sent.
+ * @param stream is the stream of the answer.
+ * @param block is the uncompressed block to be sent. It is freed here.
+ */
+static void append_block(hash_array_stream_t *stream, hash_data_t *block)
+{
+    append_base64(stream, block->data, block->read);
+
+    g_checksum_update(stream->checksum, block->data, block->read);
+    stream->size = stream->size + block->read;
+    stream->nb_blocks = stream->nb_blocks + 1;
+
+    free_hash_data_t(block);
+}
+
+
+/**
+ * Ends base64 encoding and appends the end of the json answer to the
+ * pending buffer.
+ * @param stream is the stream of the answer.
+ */
+static void append_footer(hash_array_stream_t *stream)
+{
+    guint8 a_hash[HASH_LEN];
+    gsize digest_len = HASH_LEN;
+    gchar *encoded_hash = NULL;
+
+    if (stream->compressed == TRUE)
+        {
+            g_string_append(stream->pending, "]}");
+        }
+    else
+        {
+            append_base64_close(stream);
+
+            g_checksum_get_digest(stream->checksum, a_hash, &digest_len);
+            encoded_hash = g_base64_encode(a_hash, HASH_LEN);
+
+            g_string_append_printf(stream->pending, "\",\"size\":%" G_GUINT64_FORMAT ",\"cmptype\":%d,\"uncmpsize\":%" G_GUINT64_FORMAT ",\"hash\":\"%s\"}",
+                                   stream->size, COMPRESS_NONE_TYPE, stream->size, encoded_hash);
+
+            free_variable(encoded_hash);
+        }
+}
+
+
+/**
+ * Appends the next part of the json answer to the pending buffer.
+ * @param stream is the stream of the answer.
+ */
+static void fill_pending(hash_array_stream_t *stream)
+{
+    hash_data_t *block = NULL;
+
+    switch (stream->state)
+        {
+            case HASH_ARRAY_HEADER:
+                if (stream->compressed == TRUE)
+                    {
+                        g_string_append(stream->pending, "{\"blocks\":[");
+                    }
+                else
+                    {
+                        g_string_append(stream->pending, "{\"data\":\"");
+                    }
+                stream->state = HASH_ARRAY_DATA;
+            break;
+
+            case HASH_ARRAY_DATA:
+                block = pop_block(stream);
+
+                if (block == NULL)
+                    {
+                        stream->state = HASH_ARRAY_FOOTER;
+                    }
+                else if (stream->compressed == TRUE)
+                    {
+                        append_framed_block(stream, block);
+                    }
+                else
+                    {
+                        append_block(stream, block);
+                    }
+            break;
+
+            case HASH_ARRAY_FOOTER:
+                append_footer(stream);
+                stream->state = HASH_ARRAY_DONE;
+            break;
+
+            default:
+            break;
+        }
+}
+
+
+/**
+ * MHD content reader callback that sends the answer of a
+ * /Data/Hash_Array.json request. The answer is the same json string as
+ * before: "data" (base64 of every block concatenated), "size",
+ * "cmptype", "uncmpsize" and "hash" (SHA256 of the data). When blocks
+ * are sent compressed the answer is a "blocks" array of such json
+ * objects, one per block as stored.
+ * @param cls is the hash_array_stream_t * structure of the answer.
+ * @param pos is the position in the answer (unused: MHD reads it in order).
+ * @param buf is the buffer to be filled.
+ * @param max is the maximum number of bytes that may be written in buf.
+ * @returns the number of bytes written in buf or
+ *          MHD_CONTENT_READER_END_OF_STREAM when everything has been sent.
+ */
+ssize_t hash_array_stream_reader(void *cls, uint64_t pos, char *buf, size_t max)
+{
+    hash_array_stream_t *stream = (hash_array_stream_t *) cls;
+    gsize size = 0;
+
+    if (stream->offset >= stream->pending->len)
+        {
+            g_string_truncate(stream->pending, 0);
+            stream->offset = 0;
+
+            while (stream->pending->len == 0 && stream->state != HASH_ARRAY_DONE)
+                {
+                    fill_pending(stream);
+                }
+        }
+
+    if (stream->pending->len == 0)
+        {
+            return MHD_CONTENT_READER_END_OF_STREAM;
+        }
+
+    size = MIN(max, stream->pending->len - stream->offset);
+    memcpy(buf, stream->pending->str + stream->offset, size);
+    stream->offset = stream->offset + size;
+
+    return (ssize_t) size;
+}
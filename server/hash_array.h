@@ -0,0 +1,124 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    hash_array.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/hash_array.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * used by 'cdpfglserver' to stream the answer of /Data/Hash_Array.json
+ * requests: blocks are retrieved ahead by a thread while the previous ones
+ * are encoded and sent to the client.
+ */
+#ifndef _SERVER_HASH_ARRAY_H_
+#define _SERVER_HASH_ARRAY_H_
+
+/**
+ * @def HASH_ARRAY_PREFETCH
+ * Maximum number of blocks retrieved ahead and waiting to be sent. It bounds the memory used by one answer.
+ */
+#define HASH_ARRAY_PREFETCH (8)
+
+
+/**
+ * @enum hash_array_state_t
+ * @brief Part of the json answer that is being produced.
+ */
+typedef enum
+{
+    HASH_ARRAY_HEADER,  /**< '{"data":"' (or '{"blocks":[') has to be sent            */
+    HASH_ARRAY_DATA,    /**< base64 encoded blocks are being sent                     */
+    HASH_ARRAY_FOOTER,  /**< end of data, "size", "cmptype", "uncmpsize" and "hash"   */
+    HASH_ARRAY_DONE,    /**< everything has been sent                                 */
+} hash_array_state_t;
+
+
+/**
+ * @struct hash_array_stream_t
+ * @brief State of a /Data/Hash_Array.json answer that is being streamed.
+ *
+ * The prefetch thread retrieves (and uncompresses if needed) blocks into
+ * the blocks queue. MHD's thread takes them from there, encodes them into
+ * pending and sends pending to the client.
+ */
+typedef struct
+{
+    server_struct_t *server_struct; /**< main structure of the server                             */
+    GList *hash_list;               /**< hash_data_t * list of requested hashs                    */
+    gboolean compressed;            /**< TRUE to send blocks as stored, one json object each      */
+    GThread *thread;                /**< prefetch thread                                          */
+    GQueue *blocks;                 /**< hash_data_t * blocks waiting to be sent                  */
+    gboolean prefetched;            /**< TRUE when the prefetch thread has retrieved every block  */
+    gboolean cancelled;             /**< TRUE when the prefetch thread has to stop                */
+    GMutex mutex;                   /**< protects blocks, prefetched and cancelled                */
+    GCond cond;                     /**< signaled when blocks, prefetched or cancelled change     */
+    GString *pending;               /**< json text not yet (completely) sent                      */
+    gsize offset;                   /**< number of bytes of pending already sent                  */
+    gint base64_state;              /**< state of the incremental base64 encoder                  */
+    gint base64_save;               /**< saved bits of the incremental base64 encoder             */
+    GChecksum *checksum;            /**< SHA256 of all the data sent                              */
+    guint64 size;                   /**< number of bytes of data sent (before encoding)           */
+    guint64 nb_blocks;              /**< number of blocks sent                                    */
+    hash_array_state_t state;       /**< part of the answer being produced                        */
+} hash_array_stream_t;
+
+
+/**
+ * Creates a new stream to answer a /Data/Hash_Array.json request and
+ * starts retrieving blocks.
+ * @param server_struct is the main structure for the server.
+ * @param hash_list is the hash_data_t * list of requested hashs (in the
+ *        order they have to be sent). It is owned by the stream and freed
+ *        with it.
+ * @param compressed is TRUE when blocks have to be sent as stored (each
+ *        one with its own compression type) and FALSE when they have to
+ *        be sent uncompressed and concatenated.
+ * @returns a newly allocated hash_array_stream_t * structure that may be
+ *          freed with free_hash_array_stream().
+ */
+extern hash_array_stream_t *new_hash_array_stream(server_struct_t *server_struct, GList *hash_list, gboolean compressed);
+
+
+/**
+ * MHD content reader callback that sends the answer of a
+ * /Data/Hash_Array.json request. The answer is the same json string as
+ * before: "data" (base64 of every block concatenated), "size",
+ * "cmptype", "uncmpsize" and "hash" (SHA256 of the data). When blocks
+ * are sent compressed the answer is a "blocks" array of such json
+ * objects, one per block as stored.
+ * @param cls is the hash_array_stream_t * structure of the answer.
+ * @param pos is the position in the answer (unused: MHD reads it in order).
+ * @param buf is the buffer to be filled.
+ * @param max is the maximum number of bytes that may be written in buf.
+ * @returns the number of bytes written in buf or
+ *          MHD_CONTENT_READER_END_OF_STREAM when everything has been sent.
+ */
+extern ssize_t hash_array_stream_reader(void *cls, uint64_t pos, char *buf, size_t max);
+
+
+/**
+ * Stops the prefetch thread and frees a hash_array_stream_t * structure.
+ * Also used as MHD content reader free callback.
+ * @param cls is the hash_array_stream_t * structure to be freed.
+ */
+extern void free_hash_array_stream(void *cls);
+
+
+#endif /* #ifndef _SERVER_HASH_ARRAY_H_ */
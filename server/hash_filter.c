@@ -0,0 +1,204 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    hash_filter.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/hash_filter.c
+ *
+ * This file contains the functions that maintain the Bloom filter of
+ * stored hashs. The filter is filled at startup with the hashs already
+ * stored by the data backend and then with each stored hash.
+ */
+
+#include "server.h"
+
+static json_t *make_delta_json(hash_filter_t *hash_filter, guint64 version);
+
+
+/**
+ * Creates a new empty hash filter.
+ * @param nbits is the size of the filter in bits.
+ * @returns a newly allocated hash_filter_t * structure that may be freed
+ *          with free_hash_filter_t() or NULL if nbits is 0 (filter
+ *          disabled).
+ */
+hash_filter_t *new_hash_filter_t(guint64 nbits)
+{
+    hash_filter_t *hash_filter = NULL;
+
+    if (nbits > 0)
+        {
+            hash_filter = (hash_filter_t *) g_malloc0(sizeof(hash_filter_t));
+
+            /* A new id each time the server starts: clients will get the whole new filter */
+            hash_filter->bloom = new_bloom_t(nbits, BLOOM_DEFAULT_HASHS, (guint32) g_random_int_range(1, G_MAXINT32));
+            hash_filter->delta = g_byte_array_new();
+            hash_filter->delta_base = 0;
+            hash_filter->ready = FALSE;
+            g_mutex_init(&hash_filter->mutex);
+        }
+
+    return hash_filter;
+}
+
+
+/**
+ * Frees a hash_filter_t * structure.
+ * @param hash_filter is the structure to be freed.
+ */
+void free_hash_filter_t(hash_filter_t *hash_filter)
+{
+    if (hash_filter != NULL)
+        {
+            free_bloom_t(hash_filter->bloom);
+            g_byte_array_free(hash_filter->delta, TRUE);
+            g_mutex_clear(&hash_filter->mutex);
+            free_variable(hash_filter);
+        }
+}
+
+
+/**
+ * Adds a hash to the filter. Thread safe.
+ * @param hash_filter is the filter (may be NULL in which case nothing
+ *        is done).
+ * @param hash is the binary hash to be added.
+ */
+void hash_filter_add_hash(hash_filter_t *hash_filter, guint8 *hash)
+{
+    guint half = 0;
+
+    if (hash_filter != NULL && hash != NULL)
+        {
+            g_mutex_lock(&hash_filter->mutex);
+
+            if (bloom_add_hash(hash_filter->bloom, hash) == TRUE)
+                {
+                    hash_filter->bloom->version = hash_filter->bloom->version + 1;
+                    g_byte_array_append(hash_filter->delta, hash, HASH_LEN);
+
+                    if (hash_filter->delta->len > HASH_FILTER_MAX_DELTA * HASH_LEN)
+                        {
+                            /* Forgets the oldest half of the delta at once */
+                            half = HASH_FILTER_MAX_DELTA / 2;
+                            g_byte_array_remove_range(hash_filter->delta, 0, half * HASH_LEN);
+                            hash_filter->delta_base = hash_filter->delta_base + half;
+                        }
+                }
+
+            g_mutex_unlock(&hash_filter->mutex);
+        }
+}
+
+
+/**
+ * Tells that every hash already stored by the backend has been loaded
+ * into the filter that may now be sent to clients.
+ * @param hash_filter is the filter.
+ */
+void hash_filter_set_ready(hash_filter_t *hash_filter)
+{
+    if (hash_filter != NULL)
+        {
+            g_mutex_lock(&hash_filter->mutex);
+            hash_filter->ready = TRUE;
+            g_mutex_unlock(&hash_filter->mutex);
+        }
+}
+
+
+/**
+ * Makes a json answer that contains only the hashs added since version.
+ * Must be called with the mutex locked.
+ * @param hash_filter is the filter.
+ * @param version is the version of the filter the client has. It must be
+ *        between delta_base and the version of the filter.
+ * @returns a json_t * object with "id", "version" and "delta" keys.
+ */
+static json_t *make_delta_json(hash_filter_t *hash_filter, guint64 version)
+{
+    json_t *root = NULL;
+    json_t *array = NULL;
+    gchar *encoded_hash = NULL;
+    guint64 i = 0;
+    guint64 last = 0;
+
+    root = json_object();
+    array = json_array();
+
+    last = hash_filter->bloom->version - hash_filter->delta_base;
+
+    for (i = version - hash_filter->delta_base; i < last; i++)
+        {
+            encoded_hash = g_base64_encode(hash_filter->delta->data + i * HASH_LEN, HASH_LEN);
+            append_string_to_array(array, encoded_hash);
+            free_variable(encoded_hash);
+        }
+
+    insert_integer_value_into_json_root(root, "id", hash_filter->bloom->id);
+    insert_integer_value_into_json_root(root, "version", hash_filter->bloom->version);
+    insert_json_value_into_json_root(root, "delta", array);
+
+    return root;
+}
+
+
+/**
+ * Makes the json answer to a /Hash_Filter.json request. If the client
+ * already has this filter (same id) and is not too old it only gets the
+ * hashs added since its version. Otherwise it gets the whole filter.
+ * @param hash_filter is the filter.
+ * @param id is the id of the filter the client has (0 if none).
+ * @param version is the version of the filter the client has.
+ * @returns a newly allocated json string or NULL if the filter is not
+ *          ready (or disabled).
+ */
+gchar *hash_filter_answer(hash_filter_t *hash_filter, guint32 id, guint64 version)
+{
+    json_t *root = NULL;
+    gchar *answer = NULL;
+    bloom_t *bloom = NULL;
+
+    if (hash_filter != NULL)
+        {
+            g_mutex_lock(&hash_filter->mutex);
+
+            bloom = hash_filter->bloom;
+
+            if (hash_filter->ready == TRUE)
+                {
+                    if (id == bloom->id && version >= hash_filter->delta_base && version <= bloom->version)
+                        {
+                            root = make_delta_json(hash_filter, version);
+                        }
+                    else
+                        {
+                            root = convert_bloom_t_to_json(bloom);
+                        }
+
+                    answer = json_dumps(root, 0);
+                    json_decref(root);
+                }
+
+            g_mutex_unlock(&hash_filter->mutex);
+        }
+
+    return answer;
+}
@@ -0,0 +1,105 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    hash_filter.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/hash_filter.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * used by 'cdpfglserver' to maintain the Bloom filter of stored hashs that
+ * clients may download from /Hash_Filter.json url.
+ */
+#ifndef _SERVER_HASH_FILTER_H_
+#define _SERVER_HASH_FILTER_H_
+
+/**
+ * @def HASH_FILTER_MAX_DELTA
+ * Maximum number of recently added hashs kept to answer delta requests.
+ * A client that is older than this gets the whole filter again.
+ */
+#define HASH_FILTER_MAX_DELTA (131072)
+
+
+/**
+ * @struct hash_filter_t
+ * @brief Thread safe Bloom filter of every hash stored by the data backend.
+ *
+ * The version of the filter is incremented each time a hash changes the
+ * filter. The last added hashs are kept in delta in order to send to
+ * clients only what changed since their own version.
+ */
+typedef struct
+{
+    bloom_t *bloom;        /**< The filter itself                                                  */
+    GByteArray *delta;     /**< Last added hashs (HASH_LEN bytes each) in insertion order          */
+    guint64 delta_base;    /**< Version of the filter before the first hash of delta was added     */
+    gboolean ready;        /**< TRUE when every hash already stored has been added to the filter   */
+    GMutex mutex;          /**< Protects everything above (MHD threads, data thread, loader)       */
+} hash_filter_t;
+
+
+/**
+ * Creates a new empty hash filter.
+ * @param nbits is the size of the filter in bits.
+ * @returns a newly allocated hash_filter_t * structure that may be freed
+ *          with free_hash_filter_t() or NULL if nbits is 0 (filter
+ *          disabled).
+ */
+extern hash_filter_t *new_hash_filter_t(guint64 nbits);
+
+
+/**
+ * Frees a hash_filter_t * structure.
+ * @param hash_filter is the structure to be freed.
+ */
+extern void free_hash_filter_t(hash_filter_t *hash_filter);
+
+
+/**
+ * Adds a hash to the filter. Thread safe.
+ * @param hash_filter is the filter (may be NULL in which case nothing
+ *        is done).
+ * @param hash is the binary hash to be added.
+ */
+extern void hash_filter_add_hash(hash_filter_t *hash_filter, guint8 *hash);
+
+
+/**
+ * Tells that every hash already stored by the backend has been loaded
+ * into the filter that may now be sent to clients.
+ * @param hash_filter is the filter.
+ */
+extern void hash_filter_set_ready(hash_filter_t *hash_filter);
+
+
+/**
+ * Makes the json answer to a /Hash_Filter.json request. If the client
+ * already has this filter (same id) and is not too old it only gets the
+ * hashs added since its version. Otherwise it gets the whole filter.
+ * @param hash_filter is the filter.
+ * @param id is the id of the filter the client has (0 if none).
+ * @param version is the version of the filter the client has.
+ * @returns a newly allocated json string or NULL if the filter is not
+ *          ready (or disabled).
+ */
+extern gchar *hash_filter_answer(hash_filter_t *hash_filter, guint32 id, guint64 version);
+
+
+#endif /* #ifndef _SERVER_HASH_FILTER_H_ */
@@ -0,0 +1,623 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    memory_backend.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/memory_backend.c
+ *
+ * This file contains the functions of the memory backend. Blocks are kept
+ * in sharded hash tables and meta data in in memory catalogs: nothing
+ * touches the disk nor the network, which gives the ceiling of what the
+ * HTTP and json layers of the server can do.
+ */
+
+#include "server.h"
+
+static memory_backend_t *get_memory_backend(server_struct_t *server_struct, gboolean meta);
+static guint memory_hash_func(gconstpointer key);
+static gboolean memory_hash_equal(gconstpointer a, gconstpointer b);
+static memory_shard_t *get_shard(memory_backend_t *memory_backend, guint8 *hash);
+static guint64 get_block_size(hash_data_t *hash_data);
+static void evict_oldest_block(memory_backend_t *memory_backend);
+static catalog_t *get_host_catalog(memory_backend_t *memory_backend, gchar *hostname, gboolean create);
+static void close_catalog_from_table(gpointer data);
+static void read_from_group_memory_backend(memory_backend_t *memory_backend, gchar *filename);
+
+
+/**
+ * Gets the memory_backend_t structure of the meta or data backend.
+ * @param server_struct is the server's main structure.
+ * @param meta is TRUE to get the one of the meta backend and FALSE to
+ *        get the one of the data backend.
+ * @returns the memory_backend_t * structure or NULL if that backend is
+ *          not a memory one or is not initialized.
+ */
+static memory_backend_t *get_memory_backend(server_struct_t *server_struct, gboolean meta)
+{
+    backend_t *backend = NULL;
+
+    if (server_struct != NULL)
+        {
+            backend = (meta == TRUE) ? server_struct->backend_meta : server_struct->backend_data;
+        }
+
+    if (backend != NULL && backend->init_backend == (init_backend_func) memory_init_backend)
+        {
+            return (memory_backend_t *) backend->user_data;
+        }
+    else
+        {
+            return NULL;
+        }
+}
+
+
+/**
+ * Hash function of binary hashs: they are SHA256 hashs and thus already
+ * evenly distributed.
+ * @param key is a binary hash (HASH_LEN bytes).
+ * @returns a guint made of some bytes of the hash.
+ */
+static guint memory_hash_func(gconstpointer key)
+{
+    guint h = 0;
+
+    /* The first byte is the same for every hash of a shard */
+    memcpy(&h, (const guint8 *) key + 1, sizeof(h));
+
+    return h;
+}
+
+
+/**
+ * Tells whether two binary hashs are equal.
+ * @param a is a binary hash (HASH_LEN bytes).
+ * @param b is a binary hash (HASH_LEN bytes).
+ * @returns TRUE if a and b are equal.
+ */
+static gboolean memory_hash_equal(gconstpointer a, gconstpointer b)
+{
+    return (memcmp(a, b, HASH_LEN) == 0);
+}
+
+
+/**
+ * Gets the shard where a block is stored.
+ * @param memory_backend is the structure of the memory backend.
+ * @param hash is the binary hash of the block.
+ * @returns the memory_shard_t * of that hash.
+ */
+static memory_shard_t *get_shard(memory_backend_t *memory_backend, guint8 *hash)
+{
+    return &memory_backend->shards[hash[0] % MEMORY_BACKEND_SHARDS];
+}
+
+
+/**
+ * Gets the number of bytes used by a stored block.
+ * @param hash_data is the stored block.
+ * @returns the size of its data, hash and structure.
+ */
+static guint64 get_block_size(hash_data_t *hash_data)
+{
+    return (guint64) hash_data->read + HASH_LEN + sizeof(hash_data_t);
+}
+
+
+/**
+ * Evicts the oldest stored block. fifo_mutex must be held by the caller.
+ * @param memory_backend is the structure of the memory backend.
+ */
+static void evict_oldest_block(memory_backend_t *memory_backend)
+{
+    memory_shard_t *shard = NULL;
+    hash_data_t *hash_data = NULL;
+    guint8 *hash = NULL;
+
+    hash = g_queue_pop_head(memory_backend->fifo);
+
+    if (hash != NULL)
+        {
+            shard = get_shard(memory_backend, hash);
+
+            g_rw_lock_writer_lock(&shard->lock);
+            hash_data = g_hash_table_lookup(shard->blocks, hash);
+
+            if (hash_data != NULL)
+                {
+                    memory_backend->size = memory_backend->size - get_block_size(hash_data);
+                    /* frees hash_data and thus hash */
+                    g_hash_table_remove(shard->blocks, hash);
+                }
+
+            g_rw_lock_writer_unlock(&shard->lock);
+        }
+}
+
+
+/**
+ * Gets (and creates if needed) the in memory catalog of a host.
+ * @param memory_backend is the structure of the memory backend.
+ * @param hostname is the name of the host.
+ * @param create is TRUE if the catalog has to be created when the host
+ *        is not known.
+ * @returns the catalog_t * of that host (that must not be freed) or NULL.
+ */
+static catalog_t *get_host_catalog(memory_backend_t *memory_backend, gchar *hostname, gboolean create)
+{
+    catalog_t *catalog = NULL;
+
+    if (memory_backend != NULL && hostname != NULL)
+        {
+            g_mutex_lock(&memory_backend->catalogs_mutex);
+
+            if (memory_backend->catalogs != NULL)
+                {
+                    catalog = g_hash_table_lookup(memory_backend->catalogs, hostname);
+
+                    if (catalog == NULL && create == TRUE)
+                        {
+                            catalog = open_catalog(CATALOG_IN_MEMORY);
+
+                            if (catalog != NULL)
+                                {
+                                    g_hash_table_insert(memory_backend->catalogs, g_strdup(hostname), catalog);
+                                }
+                        }
+                }
+
+            g_mutex_unlock(&memory_backend->catalogs_mutex);
+        }
+
+    return catalog;
+}
+
+
+/**
+ * Closes a catalog when it is removed from the table of catalogs.
+ * @param data is the catalog_t * to be closed.
+ */
+static void close_catalog_from_table(gpointer data)
+{
+    close_catalog((catalog_t *) data);
+}
+
+
+/**
+ * Reads keys in keyfile if groupname is in that keyfile and fills
+ * memory_backend structure accordingly.
+ * @param[in,out] memory_backend: memory_backend_t * structure to store
+ *                options read from the configuration file "filename".
+ * @param filename : the filename of the configuration file to read from
+ */
+static void read_from_group_memory_backend(memory_backend_t *memory_backend, gchar *filename)
+{
+    GKeyFile *keyfile = NULL;      /** Configuration file parser */
+    GError *error = NULL;          /** Glib error handling       */
+    gint64 max_size = 0;
+
+    keyfile = g_key_file_new();
+
+    if (g_key_file_load_from_file(keyfile, filename, G_KEY_FILE_KEEP_COMMENTS, &error))
+        {
+            if (g_key_file_has_group(keyfile, GN_MEMORY_BACKEND) == TRUE)
+                {
+                    max_size = read_int64_from_file(keyfile, filename, GN_MEMORY_BACKEND, KN_MEMORY_MAX_SIZE, _("Could not load [memory_backend] max-size from file."), 0);
+                    memory_backend->max_size = (guint64) MAX(max_size, 0);
+
+                    if (g_key_file_has_key(keyfile, GN_MEMORY_BACKEND, KN_MEMORY_EVICT, NULL) == TRUE)
+                        {
+                            memory_backend->evict = read_boolean_from_file(keyfile, filename, GN_MEMORY_BACKEND, KN_MEMORY_EVICT, _("Could not load [memory_backend] evict from file."));
+                        }
+                }
+        }
+    else if (error != NULL)
+        {
+            print_error(__FILE__, __LINE__,  _("Failed to open %s configuration file: %s\n"), filename, error->message);
+            free_error(error);
+        }
+
+    g_key_file_free(keyfile);
+}
+
+
+/**
+ * Inits the backend: reads its [Memory_Backend] configuration and sets
+ * user_data of the meta and/or data backend(s) that are memory ones.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+void memory_init_backend(server_struct_t *server_struct)
+{
+    memory_backend_t *memory_backend = NULL;
+    guint i = 0;
+
+    if (server_struct != NULL && server_struct->backend_meta != NULL && server_struct->backend_data != NULL)
+        {
+            memory_backend = (memory_backend_t *) g_malloc0(sizeof(memory_backend_t));
+
+            for (i = 0; i < MEMORY_BACKEND_SHARDS; i++)
+                {
+                    /* keys are the hashs of the blocks (values) and are freed with them */
+                    memory_backend->shards[i].blocks = g_hash_table_new_full(memory_hash_func, memory_hash_equal, NULL, free_hdt_struct);
+                    g_rw_lock_init(&memory_backend->shards[i].lock);
+                }
+
+            memory_backend->fifo = g_queue_new();
+            memory_backend->size = 0;
+            memory_backend->max_size = 0;
+            memory_backend->evict = FALSE;
+            memory_backend->rejected = 0;
+            g_mutex_init(&memory_backend->fifo_mutex);
+
+            memory_backend->catalogs = g_hash_table_new_full(g_str_hash, g_str_equal, free_variable, close_catalog_from_table);
+            g_mutex_init(&memory_backend->catalogs_mutex);
+
+            if (server_struct->opt != NULL && server_struct->opt->configfile != NULL)
+                {
+                    read_from_group_memory_backend(memory_backend, server_struct->opt->configfile);
+                }
+
+            if (memory_backend->max_size > 0)
+                {
+                    print_error(__FILE__, __LINE__, _("Warning: [Memory_Backend] max-size is set: blocks over it are %s and lost (the hash filter still reports them as stored).\n"), (memory_backend->evict == TRUE) ? _("evicted") : _("rejected"));
+                }
+
+            /* The same structure serves both backends when both are memory ones */
+            if (server_struct->backend_meta->init_backend == (init_backend_func) memory_init_backend)
+                {
+                    server_struct->backend_meta->user_data = memory_backend;
+                }
+
+            if (server_struct->backend_data->init_backend == (init_backend_func) memory_init_backend)
+                {
+                    server_struct->backend_data->user_data = memory_backend;
+                }
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: no server structure or no backend structure.\n"));
+        }
+}
+
+
+/**
+ * Terminates the backend: frees every stored block and catalog. The
+ * memory_backend_t structure itself is freed with the backend.
+ * @param backend is the backend_t * structure whose user_data is the
+ *        memory_backend_t * structure of this backend.
+ */
+void memory_terminate_backend(backend_t *backend)
+{
+    memory_backend_t *memory_backend = NULL;
+    guint i = 0;
+
+    if (backend != NULL && backend->user_data != NULL)
+        {
+            memory_backend = (memory_backend_t *) backend->user_data;
+
+            if (memory_backend->rejected > 0)
+                {
+                    print_debug(_("memory_backend: %" G_GUINT64_FORMAT " blocks rejected because max-size was reached.\n"), memory_backend->rejected);
+                }
+
+            g_mutex_lock(&memory_backend->catalogs_mutex);
+            g_hash_table_destroy(memory_backend->catalogs);
+            memory_backend->catalogs = NULL;
+            g_mutex_unlock(&memory_backend->catalogs_mutex);
+            g_mutex_clear(&memory_backend->catalogs_mutex);
+
+            g_mutex_lock(&memory_backend->fifo_mutex);
+            g_queue_free(memory_backend->fifo);
+            memory_backend->fifo = NULL;
+
+            for (i = 0; i < MEMORY_BACKEND_SHARDS; i++)
+                {
+                    g_rw_lock_writer_lock(&memory_backend->shards[i].lock);
+                    g_hash_table_destroy(memory_backend->shards[i].blocks);
+                    memory_backend->shards[i].blocks = NULL;
+                    g_rw_lock_writer_unlock(&memory_backend->shards[i].lock);
+                    g_rw_lock_clear(&memory_backend->shards[i].lock);
+                }
+
+            g_mutex_unlock(&memory_backend->fifo_mutex);
+            g_mutex_clear(&memory_backend->fifo_mutex);
+        }
+}
+
+
+/**
+ * Stores meta data into the in memory catalog of the host that sent it.
+ * @param server_struct is the server main structure where all
+ *        informations needed by the program are stored.
+ * @param smeta the server's structure for file meta data. It contains the
+ *        hostname that sent it.
+ */
+void memory_store_smeta(server_struct_t *server_struct, server_meta_data_t *smeta)
+{
+    memory_backend_t *memory_backend = NULL;
+    catalog_t *catalog = NULL;
+
+    memory_backend = get_memory_backend(server_struct, TRUE);
+
+    if (memory_backend != NULL && smeta != NULL)
+        {
+            if (smeta->hostname != NULL && smeta->meta != NULL)
+                {
+                    catalog = get_host_catalog(memory_backend, smeta->hostname, TRUE);
+
+                    if (catalog != NULL)
+                        {
+                            catalog_insert_meta_data(catalog, smeta->meta);
+                        }
+                    else
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to open catalog of %s to store meta-data in it.\n"), smeta->hostname);
+                        }
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error: no server_meta_data_t structure or missing hostname or missing meta_data_t * structure.\n"));
+                }
+        }
+}
+
+
+/**
+ * Stores a block in memory. hash_data is kept as is (or freed if the
+ * block is already stored or rejected).
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hash_data is a hash_data_t * structure that contains the hash and
+ *        the corresponding data in a binary form.
+ * @returns TRUE if the block is stored (now or before), FALSE if it has
+ *          been rejected.
+ */
+gboolean memory_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
+{
+    memory_backend_t *memory_backend = NULL;
+    memory_shard_t *shard = NULL;
+    guint64 size = 0;
+    gboolean stored = FALSE;
+    gboolean rejected = TRUE;
+
+    memory_backend = get_memory_backend(server_struct, FALSE);
+
+    if (memory_backend != NULL)
+        {
+            if (hash_data != NULL && hash_data->hash != NULL && hash_data->data != NULL)
+                {
+                    size = get_block_size(hash_data);
+                    shard = get_shard(memory_backend, hash_data->hash);
+
+                    g_mutex_lock(&memory_backend->fifo_mutex);
+
+                    if (memory_backend->max_size > 0 && memory_backend->evict == FALSE && memory_backend->size + size > memory_backend->max_size)
+                        {
+                            memory_backend->rejected = memory_backend->rejected + 1;
+                        }
+                    else
+                        {
+                            rejected = FALSE;
+                            g_rw_lock_writer_lock(&shard->lock);
+                            stored = !g_hash_table_contains(shard->blocks, hash_data->hash);
+
+                            if (stored == TRUE)
+                                {
+                                    g_hash_table_insert(shard->blocks, hash_data->hash, hash_data);
+                                }
+
+                            g_rw_lock_writer_unlock(&shard->lock);
+
+                            if (stored == TRUE)
+                                {
+                                    g_queue_push_tail(memory_backend->fifo, hash_data->hash);
+                                    memory_backend->size = memory_backend->size + size;
+
+                                    while (memory_backend->max_size > 0 && memory_backend->size > memory_backend->max_size && g_queue_is_empty(memory_backend->fifo) == FALSE)
+                                        {
+                                            evict_oldest_block(memory_backend);
+                                        }
+                                }
+                        }
+
+                    g_mutex_unlock(&memory_backend->fifo_mutex);
+
+                    if (stored == FALSE)
+                        {
+                            free_hash_data_t(hash_data);
+                        }
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error: no hash_data_t structure or hash in it or missing data in it.\n"));
+                    free_hash_data_t(hash_data);
+                }
+        }
+    else
+        {
+            free_hash_data_t(hash_data);
+        }
+
+    return !rejected;
+}
+
+
+/**
+ * Builds a list of hashs that the server needs.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hash_data_list is the list of hashs that we have to check for.
+ * @returns to the client a list of hashs in no specific order for which
+ *          the server needs the data.
+ */
+GList *memory_build_needed_hash_list(server_struct_t *server_struct, GList *hash_data_list)
+{
+    memory_backend_t *memory_backend = NULL;
+    memory_shard_t *shard = NULL;
+    hash_data_t *hash_data = NULL;
+    GList *head = hash_data_list;
+    GList *needed = NULL;
+    gboolean present = FALSE;
+
+    memory_backend = get_memory_backend(server_struct, FALSE);
+
+    if (memory_backend != NULL)
+        {
+            while (head != NULL)
+                {
+                    hash_data = head->data;
+                    shard = get_shard(memory_backend, hash_data->hash);
+
+                    g_rw_lock_reader_lock(&shard->lock);
+                    present = g_hash_table_contains(shard->blocks, hash_data->hash);
+                    g_rw_lock_reader_unlock(&shard->lock);
+
+                    if (present == FALSE && hash_data_is_in_list(hash_data, needed) == FALSE)
+                        {
+                            needed = g_list_prepend(needed, copy_only_hash(hash_data, NULL));
+                        }
+
+                    head = g_list_next(head);
+                }
+
+            needed = g_list_reverse(needed);
+        }
+
+    return needed;
+}
+
+
+/**
+ * Gets a page of the list of saved files.
+ * @param server_struct is the structure that contains all data for the
+ *        server.
+ * @param query is the structure that contains everything about the
+ *        requested query. query->cursor is updated to the position of
+ *        the last returned version.
+ * @param count is the maximum number of versions to be returned (0 means
+ *        no limit).
+ * @returns a GList * of meta_data_t * sorted by filename and then by
+ *          modification time that may be freed with
+ *          g_list_free_full(list, free_glist_meta_data_t).
+ */
+GList *memory_get_list_of_files(server_struct_t *server_struct, query_t *query, guint64 count)
+{
+    memory_backend_t *memory_backend = NULL;
+    catalog_t *catalog = NULL;
+    GList *file_list = NULL;
+
+    memory_backend = get_memory_backend(server_struct, TRUE);
+
+    if (memory_backend != NULL && query != NULL)
+        {
+            catalog = get_host_catalog(memory_backend, query->hostname, FALSE);
+
+            if (catalog != NULL)
+                {
+                    file_list = catalog_get_file_list(catalog, query, count);
+                }
+            else
+                {
+                     print_error(__FILE__, __LINE__, _("Error: no catalog for host %s.\n"), query->hostname);
+                }
+        }
+
+    return file_list;
+}
+
+
+/**
+ * Retrieves a copy of a stored block.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hex_hash is a gchar * hash in hexadecimal format as retrieved
+ *        from the url.
+ * @returns a newly allocated hash_data_t * structure or NULL if the
+ *          block is not stored.
+ */
+hash_data_t *memory_retrieve_data(server_struct_t *server_struct, gchar *hex_hash)
+{
+    memory_backend_t *memory_backend = NULL;
+    memory_shard_t *shard = NULL;
+    hash_data_t *stored = NULL;
+    hash_data_t *hash_data = NULL;
+    guint8 *hash = NULL;
+
+    memory_backend = get_memory_backend(server_struct, FALSE);
+
+    if (memory_backend != NULL && hex_hash != NULL)
+        {
+            hash = string_to_hash(hex_hash);
+            shard = get_shard(memory_backend, hash);
+
+            g_rw_lock_reader_lock(&shard->lock);
+            stored = g_hash_table_lookup(shard->blocks, hash);
+
+            if (stored != NULL)
+                {
+                    hash_data = new_hash_data_t_as_is(g_memdup(stored->data, stored->read), stored->read, hash, stored->cmptype, stored->uncmplen);
+                }
+
+            g_rw_lock_reader_unlock(&shard->lock);
+
+            if (hash_data == NULL)
+                {
+                    free_variable(hash);
+                }
+        }
+
+    return hash_data;
+}
+
+
+/**
+ * Calls func with each stored hash.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param func is the function to be called. Its first argument is the
+ *        binary hash (guint8 *) that must not be freed by func.
+ * @param user_data is passed as is to func as its second argument.
+ */
+void memory_foreach_stored_hash(server_struct_t *server_struct, GFunc func, gpointer user_data)
+{
+    memory_backend_t *memory_backend = NULL;
+    GHashTableIter iter;
+    gpointer key = NULL;
+    guint i = 0;
+
+    memory_backend = get_memory_backend(server_struct, FALSE);
+
+    if (memory_backend != NULL && func != NULL)
+        {
+            for (i = 0; i < MEMORY_BACKEND_SHARDS; i++)
+                {
+                    g_rw_lock_reader_lock(&memory_backend->shards[i].lock);
+                    g_hash_table_iter_init(&iter, memory_backend->shards[i].blocks);
+
+                    while (g_hash_table_iter_next(&iter, &key, NULL) == TRUE)
+                        {
+                            func(key, user_data);
+                        }
+
+                    g_rw_lock_reader_unlock(&memory_backend->shards[i].lock);
+                }
+        }
+}
@@ -0,0 +1,169 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    memory_backend.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/memory_backend.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the memory backend that keeps everything in memory. It is meant to
+ * measure the server without any storage cost and to be a fast backend
+ * for tests: everything is lost when the server stops.
+ */
+#ifndef _SERVER_MEMORY_BACKEND_H_
+#define _SERVER_MEMORY_BACKEND_H_
+
+/**
+ * @def MEMORY_BACKEND_SHARDS
+ * Number of shards of the table of blocks. Each shard has its own lock
+ * so that blocks are looked for and retrieved concurrently.
+ */
+#define MEMORY_BACKEND_SHARDS (16)
+
+
+/**
+ * @struct memory_shard_t
+ * @brief A part of the blocks stored by the memory backend.
+ */
+typedef struct
+{
+    GHashTable *blocks;   /**< hash_data_t * blocks indexed by their binary hash */
+    GRWLock lock;         /**< Protects blocks                                   */
+} memory_shard_t;
+
+
+/**
+ * @struct memory_backend_t
+ * @brief Structure that contains everything needed by memory backend.
+ *
+ * Blocks are spread in shards by the first byte of their hash. When
+ * max_size is not 0 the blocks may not use more than max_size bytes:
+ * the oldest ones are then evicted if evict is TRUE and new ones are
+ * rejected otherwise (default). Either way those blocks are lost while
+ * meta data still refer to them and the hash filter (a Bloom filter
+ * that can not forget) still tells clients that they are stored: this
+ * is only meant for benchmarks. Meta data of each host goes to an in
+ * memory catalog.
+ */
+typedef struct
+{
+    memory_shard_t shards[MEMORY_BACKEND_SHARDS]; /**< Stored blocks                                          */
+    GQueue *fifo;               /**< Binary hashs of stored blocks from the oldest to the newest              */
+    guint64 size;               /**< Bytes used by stored blocks                                              */
+    guint64 max_size;           /**< Maximum bytes used by stored blocks (0 means no limit)                   */
+    gboolean evict;             /**< TRUE evicts oldest blocks when max_size is reached, FALSE rejects blocks */
+    guint64 rejected;           /**< Number of blocks rejected because max_size was reached                   */
+    GMutex fifo_mutex;          /**< Protects fifo, size and rejected                                         */
+    GHashTable *catalogs;       /**< In memory catalogs (catalog_t *) of each host indexed by hostname        */
+    GMutex catalogs_mutex;      /**< Protects catalogs hash table                                             */
+} memory_backend_t;
+
+
+/**
+ * Inits the backend: reads its [Memory_Backend] configuration and sets
+ * user_data of the meta and/or data backend(s) that are memory ones.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+extern void memory_init_backend(server_struct_t *server_struct);
+
+
+/**
+ * Terminates the backend: frees every stored block and catalog.
+ * @param backend is the backend_t * structure whose user_data is the
+ *        memory_backend_t * structure of this backend.
+ */
+extern void memory_terminate_backend(backend_t *backend);
+
+
+/**
+ * Stores meta data into the in memory catalog of the host that sent it.
+ * @param server_struct is the server main structure where all
+ *        informations needed by the program are stored.
+ * @param smeta the server's structure for file meta data. It contains the
+ *        hostname that sent it.
+ */
+extern void memory_store_smeta(server_struct_t *server_struct, server_meta_data_t *smeta);
+
+
+/**
+ * Stores a block in memory. hash_data is kept as is (or freed if the
+ * block is already stored or rejected).
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hash_data is a hash_data_t * structure that contains the hash and
+ *        the corresponding data in a binary form.
+ * @returns TRUE if the block is stored (now or before), FALSE if it has
+ *          been rejected.
+ */
+extern gboolean memory_store_data(server_struct_t *server_struct, hash_data_t *hash_data);
+
+
+/**
+ * Builds a list of hashs that the server needs.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hash_data_list is the list of hashs that we have to check for.
+ * @returns to the client a list of hashs in no specific order for which
+ *          the server needs the data.
+ */
+extern GList *memory_build_needed_hash_list(server_struct_t *server_struct, GList *hash_data_list);
+
+
+/**
+ * Gets a page of the list of saved files.
+ * @param server_struct is the structure that contains all data for the
+ *        server.
+ * @param query is the structure that contains everything about the
+ *        requested query. query->cursor is updated to the position of
+ *        the last returned version.
+ * @param count is the maximum number of versions to be returned (0 means
+ *        no limit).
+ * @returns a GList * of meta_data_t * sorted by filename and then by
+ *          modification time that may be freed with
+ *          g_list_free_full(list, free_glist_meta_data_t).
+ */
+extern GList *memory_get_list_of_files(server_struct_t *server_struct, query_t *query, guint64 count);
+
+
+/**
+ * Retrieves a copy of a stored block.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hex_hash is a gchar * hash in hexadecimal format as retrieved
+ *        from the url.
+ * @returns a newly allocated hash_data_t * structure or NULL if the
+ *          block is not stored.
+ */
+extern hash_data_t *memory_retrieve_data(server_struct_t *server_struct, gchar *hex_hash);
+
+
+/**
+ * Calls func with each stored hash.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param func is the function to be called. Its first argument is the
+ *        binary hash (guint8 *) that must not be freed by func.
+ * @param user_data is passed as is to func as its second argument.
+ */
+extern void memory_foreach_stored_hash(server_struct_t *server_struct, GFunc func, gpointer user_data);
+
+
+#endif /* #ifndef _SERVER_MEMORY_BACKEND_H_ */
@@ -130,6 +130,14 @@ bool get_params_from_keyfile(minio_backend_t *backend, char **secret_key, char *
     char *bucketname_data = NULL;
     char *bucketname_filemeta = NULL;
     gboolean add_missing_bucket = 0;
+    gint upload_contexts = MINIO_DEFAULT_UPLOAD_CONTEXTS;
+    gint max_in_flight = MINIO_DEFAULT_MAX_IN_FLIGHT;
+    char *index_file = NULL;
+    gint pack_size = 0;
+    char *pack_staging_dir = NULL;
+    char *pack_index_file = NULL;
+    gint pack_flush_interval = MINIO_DEFAULT_PACK_FLUSH_INTERVAL;
+    char *spool_dir = NULL;
 
     if (backend == NULL)
     {
@@ -155,6 +163,25 @@ bool get_params_from_keyfile(minio_backend_t *backend, char **secret_key, char *
                                                     "Filemeta bucket not found in config!");
         add_missing_bucket = read_boolean_from_file(keyfile, filepath, GN_MINIO_BACKEND, KN_MINIO_ADD_MISSING_BUCKET,
                                                     "'Add missing bucket' not found in config!");
+        upload_contexts = read_int_from_file(keyfile, filepath, GN_MINIO_BACKEND, KN_MINIO_UPLOAD_CONTEXTS,
+                                             "Could not load upload contexts from file",
+                                             MINIO_DEFAULT_UPLOAD_CONTEXTS);
+        max_in_flight = read_int_from_file(keyfile, filepath, GN_MINIO_BACKEND, KN_MINIO_MAX_IN_FLIGHT,
+                                           "Could not load max in flight from file",
+                                           MINIO_DEFAULT_MAX_IN_FLIGHT);
+        index_file = read_string_from_file(keyfile, filepath, GN_MINIO_BACKEND, KN_MINIO_INDEX_FILE,
+                                           "Index file not found in config!");
+        pack_size = read_int_from_file(keyfile, filepath, GN_MINIO_BACKEND, KN_MINIO_PACK_SIZE,
+                                       "Could not load pack size from file", 0);
+        pack_staging_dir = read_string_from_file(keyfile, filepath, GN_MINIO_BACKEND, KN_MINIO_PACK_STAGING_DIR,
+                                                 "Pack staging directory not found in config!");
+        pack_index_file = read_string_from_file(keyfile, filepath, GN_MINIO_BACKEND, KN_MINIO_PACK_INDEX_FILE,
+                                                "Pack index file not found in config!");
+        pack_flush_interval = read_int_from_file(keyfile, filepath, GN_MINIO_BACKEND, KN_MINIO_PACK_FLUSH_INTERVAL,
+                                                 "Could not load pack flush interval from file",
+                                                 MINIO_DEFAULT_PACK_FLUSH_INTERVAL);
+        spool_dir = read_string_from_file(keyfile, filepath, GN_MINIO_BACKEND, KN_MINIO_SPOOL_DIR,
+                                          "Spool directory not found in config!");
 
     } else if (error != NULL)
     {
@@ -223,12 +250,66 @@ bool get_params_from_keyfile(minio_backend_t *backend, char **secret_key, char *
     }
 
 
+    if (!index_file)
+    {
+        minio_print_debug("[%s] Set key value [%-12s] with default:\t'%s'\n",
+                          LOGGING_METHOD_PREFIX_MINIO_CONFIG,
+                          KN_MINIO_INDEX_FILE,
+                          MINIO_DEFAULT_INDEX_FILE);
+        index_file = MINIO_DEFAULT_INDEX_FILE;
+    }
+
+    if (!pack_staging_dir)
+    {
+        pack_staging_dir = MINIO_DEFAULT_PACK_STAGING_DIR;
+    }
+
+    if (!pack_index_file)
+    {
+        pack_index_file = MINIO_DEFAULT_PACK_INDEX_FILE;
+    }
+
+    if (!spool_dir)
+    {
+        spool_dir = MINIO_DEFAULT_SPOOL_DIR;
+    }
+
+    if (pack_size < 0)
+    {
+        pack_size = 0;
+    }
+
+    if (pack_flush_interval <= 0)
+    {
+        pack_flush_interval = MINIO_DEFAULT_PACK_FLUSH_INTERVAL;
+    }
+
+    if (upload_contexts <= 0)
+    {
+        upload_contexts = MINIO_DEFAULT_UPLOAD_CONTEXTS;
+    }
+
+    // at least one upload per context
+    if (max_in_flight < upload_contexts)
+    {
+        max_in_flight = upload_contexts;
+    }
+
+
     // 2. set the values in backend
     backend->hostname = hostname;
     backend->access_key = access_key;
     backend->bucketname_data = bucketname_data;
     backend->bucketname_filemeta = bucketname_filemeta;
     backend->add_missing_bucket = add_missing_bucket;
+    backend->upload_contexts = upload_contexts;
+    backend->max_in_flight = max_in_flight;
+    backend->index_file = index_file;
+    backend->pack_size = (guint64) pack_size * 1024 * 1024;
+    backend->pack_staging_dir = pack_staging_dir;
+    backend->pack_index_file = pack_index_file;
+    backend->pack_flush_interval = pack_flush_interval;
+    backend->spool_dir = spool_dir;
 
     return true;
 }
@@ -323,6 +404,735 @@ static bool checkKeyExistInBucket(const char *bucket, const char *key)
 
 
 
+/** Prefix for logging in bucket cache methods */
+#define LOGGING_METHOD_PREFIX_MINIO_BUCKETCACHE ("BucketCache")
+
+
+/**
+ * Returns the bucket to use instead of @param bucketname. The bucket is
+ * checked only when it has not been validated yet or has been invalidated
+ * by an error (Order: {Configured Bucket} -> {Fallback bucket} -> NULL).
+ * @param backend is the backend structure.
+ * @param bucketname is the configured bucket name (may be NULL).
+ * @param active points to the cached bucket (active_bucket_data field of
+ *        backend).
+ * @param what is the kind of bucket for error messages.
+ * @return the bucket to use or NULL if no bucket can be accessed.
+ */
+static const char *get_active_bucket(minio_backend_t *backend, const char *bucketname, const char **active,
+                                     const char *what)
+{
+    const char *bucket = NULL;
+
+    g_mutex_lock(&backend->buckets_mutex);
+
+    if (*active == NULL)
+    {
+        if (bucketname != NULL && checkBucketAccess(bucketname, CREATE_BUCKET_IF_MISSING))
+        {
+            // bucket available
+            *active = bucketname;
+        } else
+        {
+            // show error message
+            if (bucketname != NULL)
+            {
+                minio_print_error("[%s] %s bucket could not be accessed! (%s)\n",
+                                  LOGGING_METHOD_PREFIX_MINIO_BUCKETCACHE,
+                                  what,
+                                  bucketname);
+            } else
+            {
+                minio_print_error("[%s] No %s bucket configured!\n",
+                                  LOGGING_METHOD_PREFIX_MINIO_BUCKETCACHE,
+                                  what);
+            }
+
+            // try fallback bucket
+            if (checkBucketAccess(MINIO_FALLBACK_BUCKET, TRUE))
+            {
+                *active = MINIO_FALLBACK_BUCKET;
+                minio_print_error("[%s] Using fallback bucket (%s)\n",
+                                  LOGGING_METHOD_PREFIX_MINIO_BUCKETCACHE,
+                                  MINIO_FALLBACK_BUCKET);
+            } else
+            {
+                minio_print_critical("[%s] FALLBACK BUCKET COULD NOT BE ACCESSED!\n",
+                                     LOGGING_METHOD_PREFIX_MINIO_BUCKETCACHE);
+            }
+        }
+    }
+
+    bucket = *active;
+
+    g_mutex_unlock(&backend->buckets_mutex);
+
+    return bucket;
+}
+
+
+/**
+ * Invalidates the cached bucket @param bucket after an error so that it is
+ * checked again the next time it is needed.
+ * @param backend is the backend structure.
+ * @param bucket is the bucket as returned by get_active_bucket().
+ */
+static void invalidate_active_bucket(minio_backend_t *backend, const char *bucket)
+{
+    g_mutex_lock(&backend->buckets_mutex);
+
+    if (backend->active_bucket_data == bucket)
+    {
+        backend->active_bucket_data = NULL;
+    }
+
+    g_mutex_unlock(&backend->buckets_mutex);
+}
+
+
+
+/** Prefix for logging in upload methods */
+#define LOGGING_METHOD_PREFIX_MINIO_UPLOAD ("Upload")
+
+
+/**
+ * Frees an upload and everything it owns
+ * @param upload the upload to be freed
+ */
+static void free_minio_upload(minio_upload_t *upload)
+{
+    int i = 0;
+
+    if (upload != NULL)
+    {
+        for (i = 0; i < upload->meta_count; i++)
+        {
+            g_free((gchar *) upload->meta[i].value);
+        }
+
+        free_variable(upload->key);
+        free_variable(upload->pending_key);
+        free_variable(upload->buffer);
+        free_hash_data_t(upload->hash_data);
+        g_free(upload);
+    }
+}
+
+
+/**
+ * Tells whether an object of @param hash_string is being uploaded
+ * @param pool is the upload pool.
+ * @param hash_string is the hash in hexadecimal format.
+ * @return TRUE if at least one upload for this hash is queued or running
+ */
+static gboolean is_hash_being_uploaded(minio_upload_pool_t *pool, const gchar *hash_string)
+{
+    gboolean uploading = FALSE;
+
+    g_mutex_lock(&pool->mutex);
+    uploading = g_hash_table_contains(pool->pending_keys, hash_string);
+    g_mutex_unlock(&pool->mutex);
+
+    return uploading;
+}
+
+
+/**
+ * Waits until no object of @param hash_string is being uploaded, so that
+ * a block stored a moment ago can be retrieved.
+ * @param pool is the upload pool.
+ * @param hash_string is the hash in hexadecimal format.
+ */
+static void wait_for_hash_upload(minio_upload_pool_t *pool, const gchar *hash_string)
+{
+    g_mutex_lock(&pool->mutex);
+
+    while (g_hash_table_contains(pool->pending_keys, hash_string))
+    {
+        g_cond_wait(&pool->cond, &pool->mutex);
+    }
+
+    g_mutex_unlock(&pool->mutex);
+}
+
+
+/**
+ * Waits until every queued or running upload has completed.
+ * @param pool is the upload pool.
+ */
+static void wait_for_uploads(minio_upload_pool_t *pool)
+{
+    g_mutex_lock(&pool->mutex);
+
+    while (pool->pending > 0)
+    {
+        g_cond_wait(&pool->cond, &pool->mutex);
+    }
+
+    g_mutex_unlock(&pool->mutex);
+}
+
+
+/**
+ * Puts a failed upload in the delayed uploads of @param pool so that it
+ * is retried once its retry_at time has come.
+ * @param pool is the upload pool.
+ * @param upload is the upload to be retried (its retry_at field must be
+ *        set).
+ */
+static void delay_upload(minio_upload_pool_t *pool, minio_upload_t *upload)
+{
+    GList *iter = NULL;
+
+    g_mutex_lock(&pool->mutex);
+
+    // the head of delayed is always the first upload to retry
+    iter = pool->delayed->head;
+    while (iter != NULL && ((minio_upload_t *) iter->data)->retry_at <= upload->retry_at)
+    {
+        iter = iter->next;
+    }
+
+    if (iter != NULL)
+    {
+        g_queue_insert_before(pool->delayed, iter, upload);
+    } else
+    {
+        g_queue_push_tail(pool->delayed, upload);
+    }
+
+    g_mutex_unlock(&pool->mutex);
+}
+
+
+/**
+ * Gets the next upload to issue: a delayed upload whose retry time has
+ * come first, then a queued one.
+ * @param pool is the upload pool.
+ * @param wait tells whether to wait (at most MINIO_UPLOAD_RUN_WAIT_MS)
+ *        for an upload to be queued.
+ * @return the upload to issue or NULL if there is none.
+ */
+static minio_upload_t *next_upload(minio_upload_pool_t *pool, gboolean wait)
+{
+    minio_upload_t *upload = NULL;
+
+    g_mutex_lock(&pool->mutex);
+
+    upload = g_queue_peek_head(pool->delayed);
+
+    if (upload != NULL && upload->retry_at <= g_get_monotonic_time())
+    {
+        g_queue_pop_head(pool->delayed);
+    } else
+    {
+        upload = NULL;
+    }
+
+    g_mutex_unlock(&pool->mutex);
+
+    if (upload == NULL && wait == TRUE)
+    {
+        upload = g_async_queue_timeout_pop(pool->queue, MINIO_UPLOAD_RUN_WAIT_MS * 1000);
+    } else if (upload == NULL)
+    {
+        upload = g_async_queue_try_pop(pool->queue);
+    }
+
+    return upload;
+}
+
+
+/**
+ * Builds the filename of the spool file of a block
+ * @param backend is the backend structure.
+ * @param hash_string is the hash of the block in hexadecimal format.
+ * @return a newly allocated filename
+ */
+static gchar *get_spool_filename(minio_backend_t *backend, const gchar *hash_string)
+{
+    return g_build_filename(backend->spool_dir, hash_string, NULL);
+}
+
+
+/**
+ * Spools the block of an upload that finally failed: a line with its
+ * compression type and uncompressed length followed by its data is
+ * written into the spool directory, from where the spooler uploads it
+ * again. A block read from its spool file is already there.
+ * @param upload is the upload of the block (hash_data and meta must be
+ *        set).
+ * @return TRUE if the block is in the spool directory
+ */
+static gboolean spool_upload(minio_upload_t *upload)
+{
+    gchar *filename = NULL;
+    gchar *header = NULL;
+    GByteArray *contents = NULL;
+    GError *error = NULL;
+    gboolean spooled = upload->spooled;
+
+    if (spooled == FALSE)
+    {
+        filename = get_spool_filename(upload->backend, upload->key);
+        header = g_strdup_printf("%s %s\n", upload->meta[0].value, upload->meta[1].value);
+
+        contents = g_byte_array_sized_new(strlen(header) + upload->length);
+        g_byte_array_append(contents, (guint8 *) header, strlen(header));
+        g_byte_array_append(contents, (guint8 *) upload->data, upload->length);
+
+        // written in a temporary file first: a spool file is always complete
+        spooled = g_file_set_contents(filename, (gchar *) contents->data, contents->len, &error);
+
+        if (spooled == FALSE)
+        {
+            minio_print_critical("[%s] Could not spool '%s': %s\n",
+                                 LOGGING_METHOD_PREFIX_MINIO_UPLOAD,
+                                 filename,
+                                 error->message);
+            free_error(error);
+        }
+
+        g_byte_array_free(contents, TRUE);
+        free_variable(header);
+        free_variable(filename);
+    }
+
+    return spooled;
+}
+
+
+/**
+ * Reads a block from its spool file (see spool_upload()).
+ * @param backend is the backend structure.
+ * @param hash_string is the hash of the block in hexadecimal format.
+ * @return the block or NULL if it is not spooled.
+ */
+static hash_data_t *read_spooled_block(minio_backend_t *backend, const gchar *hash_string)
+{
+    hash_data_t *hash_data = NULL;
+    gchar *filename = NULL;
+    gchar *contents = NULL;
+    gchar *end = NULL;
+    gsize len = 0;
+    gsize header_len = 0;
+    gshort cmptype = 0;
+    gssize uncmplen = 0;
+
+    filename = get_spool_filename(backend, hash_string);
+
+    if (g_file_get_contents(filename, &contents, &len, NULL) == TRUE)
+    {
+        end = memchr(contents, '\n', len);
+
+        if (end != NULL)
+        {
+            header_len = end - contents + 1;
+            cmptype = (gshort) g_ascii_strtoll(contents, &end, 10);
+            uncmplen = (gssize) g_ascii_strtoll(end, NULL, 10);
+
+            // the data of the block replaces the content of the file
+            memmove(contents, contents + header_len, len - header_len);
+            hash_data = new_hash_data_t_as_is((guchar *) contents, len - header_len, string_to_hash((gchar *) hash_string),
+                                              cmptype, uncmplen);
+            contents = NULL;
+        } else
+        {
+            minio_print_error("[%s] Spool file '%s' is corrupted\n", LOGGING_METHOD_PREFIX_MINIO_UPLOAD, filename);
+        }
+    }
+
+    free_variable(contents);
+    free_variable(filename);
+
+    return hash_data;
+}
+
+
+/**
+ * Called by libs3 (from an upload thread) when an upload has completed.
+ * Retries it later when its status is retryable (each retry waits twice
+ * as long as the previous one, until MINIO_UPLOAD_RETRY_TIMEOUT_MS have
+ * passed since the first try) and invalidates its bucket when it finally
+ * failed. A block that finally failed is spooled and a spooled block
+ * that has been stored leaves the spool directory.
+ * @param status is the final status of the request.
+ * @param user_data is the minio_upload_t * upload.
+ */
+static void upload_done(S3Status status, void *user_data)
+{
+    minio_upload_t *upload = user_data;
+    minio_upload_pool_t *pool = NULL;
+    gchar *filename = NULL;
+    guint count = 0;
+    gint64 delay = 0;
+
+    (*upload->in_flight)--;
+    pool = upload->backend->upload_pool;
+
+    if (status != S3StatusOK)
+    {
+        delay = ((gint64) MINIO_UPLOAD_RETRY_DELAY_MS << upload->retries) * 1000;
+        upload->retry_at = g_get_monotonic_time() + delay;
+
+        if (S3_status_is_retryable(status) && upload->retries < MINIO_UPLOAD_RETRIES
+            && upload->retry_at - upload->started < (gint64) MINIO_UPLOAD_RETRY_TIMEOUT_MS * 1000)
+        {
+            upload->retries++;
+            minio_print_debug("[%s] Retrying upload of '%s' in %" G_GINT64_FORMAT " ms (%s)\n",
+                              LOGGING_METHOD_PREFIX_MINIO_UPLOAD,
+                              upload->key,
+                              delay / 1000,
+                              S3_get_status_name(status));
+            delay_upload(pool, upload);
+            return;
+        }
+
+        minio_print_critical("[%s] Could not store '%s' to bucket '%s': %s\n",
+                             LOGGING_METHOD_PREFIX_MINIO_UPLOAD,
+                             upload->key,
+                             upload->bucket,
+                             S3_get_status_name(status));
+        invalidate_active_bucket(upload->backend, upload->bucket);
+
+        // the pack stays staged and is uploaded again later
+        if (upload->pack != NULL)
+        {
+            minio_packer_uploaded(upload->backend->packer, upload->pack, FALSE);
+        } else if (upload->hash_data != NULL && spool_upload(upload) == TRUE)
+        {
+            minio_print_critical("[%s] '%s' stays spooled in '%s' and is uploaded again in %d seconds\n",
+                                 LOGGING_METHOD_PREFIX_MINIO_UPLOAD,
+                                 upload->key,
+                                 upload->backend->spool_dir,
+                                 MINIO_SPOOL_RETRY_DELAY);
+        }
+    } else
+    {
+        minio_print_verbose("[%s] Stored '%s'\n", LOGGING_METHOD_PREFIX_MINIO_UPLOAD, upload->key);
+
+        // the index only knows the configured data bucket (not the fallback one)
+        if (upload->hash_data != NULL && upload->bucket == upload->backend->bucketname_data)
+        {
+            minio_index_add(upload->backend->index, upload->hash_data->hash);
+        }
+
+        // blocks of the pack are read from the bucket once its index is stored too
+        if (upload->pack != NULL)
+        {
+            minio_packer_uploaded(upload->backend->packer, upload->pack, TRUE);
+        }
+
+        if (upload->spooled == TRUE)
+        {
+            filename = get_spool_filename(upload->backend, upload->key);
+            g_unlink(filename);
+            free_variable(filename);
+        }
+    }
+
+    g_mutex_lock(&pool->mutex);
+
+    if (upload->pending_key != NULL)
+    {
+        count = GPOINTER_TO_UINT(g_hash_table_lookup(pool->pending_keys, upload->pending_key));
+
+        if (count > 1)
+        {
+            g_hash_table_insert(pool->pending_keys, g_strdup(upload->pending_key), GUINT_TO_POINTER(count - 1));
+        } else
+        {
+            g_hash_table_remove(pool->pending_keys, upload->pending_key);
+        }
+    }
+
+    pool->pending--;
+    g_cond_broadcast(&pool->cond);
+
+    g_mutex_unlock(&pool->mutex);
+
+    free_minio_upload(upload);
+}
+
+
+/**
+ * Sends a pack bigger than MINIO_PACK_PART_SIZE with a multipart upload
+ * whose parts run concurrently in their own request context, so that the
+ * upload thread that issued it goes on with the other uploads.
+ * @param user_data is the minio_upload_t * upload of the pack.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer multipart_upload_thread(gpointer user_data)
+{
+    minio_upload_t *upload = user_data;
+    minio_upload_pool_t *pool = upload->backend->upload_pool;
+    guint in_flight = 1;
+
+    upload->in_flight = &in_flight;
+
+    upload_done(put_object_multipart(upload->bucket, upload->key, upload->data, upload->length,
+                                     MINIO_PACK_PART_SIZE, MAX(1, pool->max_in_flight / pool->nb_threads)), upload);
+
+    return NULL;
+}
+
+
+/**
+ * Upload thread: issues the queued uploads into its own libs3 request
+ * context and runs it until the pool is stopped and nothing remains to
+ * be uploaded. Packs bigger than MINIO_PACK_PART_SIZE are handed to a
+ * thread of their own (multipart_upload_thread).
+ * @param user_data is the minio_backend_t * backend structure. Each
+ *        thread uses the context stored at its own index in the pool.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer upload_thread(gpointer user_data)
+{
+    minio_backend_t *backend = user_data;
+    minio_upload_pool_t *pool = backend->upload_pool;
+    minio_upload_t *upload = NULL;
+    S3RequestContext *context = NULL;
+    guint in_flight = 0;
+    guint max_in_flight = 0;
+    guint i = 0;
+    gboolean stop = FALSE;
+
+    /* each thread finds its own context */
+    g_mutex_lock(&pool->mutex);
+    while (i < pool->nb_threads && pool->threads[i] != g_thread_self())
+    {
+        i++;
+    }
+    g_mutex_unlock(&pool->mutex);
+
+    context = pool->contexts[i];
+    max_in_flight = MAX(1, pool->max_in_flight / pool->nb_threads);
+
+    while (stop == FALSE || in_flight > 0)
+    {
+        // issue new uploads while this context has room for them
+        while (in_flight < max_in_flight)
+        {
+            upload = next_upload(pool, (in_flight == 0));
+
+            if (upload == NULL)
+            {
+                break;
+            }
+
+            if (upload->pack != NULL && upload->length > MINIO_PACK_PART_SIZE)
+            {
+                g_thread_unref(g_thread_new("minio-multipart", multipart_upload_thread, upload));
+            } else
+            {
+                upload->in_flight = &in_flight;
+                in_flight++;
+
+                put_object_in_context(context, upload->bucket, upload->key, upload->data, upload->length,
+                                      upload->meta_count, upload->meta, upload_done, upload);
+            }
+        }
+
+        if (in_flight > 0)
+        {
+            run_request_context(context, MINIO_UPLOAD_RUN_WAIT_MS);
+        }
+
+        g_mutex_lock(&pool->mutex);
+        stop = pool->stop;
+        g_mutex_unlock(&pool->mutex);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Creates the upload pool of @param backend and starts its threads
+ * @param backend is the backend structure (upload_contexts and
+ *        max_in_flight fields must be set).
+ * @return TRUE if at least one upload thread has been started
+ */
+static gboolean new_upload_pool(minio_backend_t *backend)
+{
+    minio_upload_pool_t *pool = NULL;
+    S3RequestContext *context = NULL;
+    guint i = 0;
+
+    pool = (minio_upload_pool_t *) g_malloc0(sizeof(minio_upload_pool_t));
+
+    pool->queue = g_async_queue_new();
+    pool->delayed = g_queue_new();
+    pool->threads = (GThread **) g_malloc0(backend->upload_contexts * sizeof(GThread *));
+    pool->contexts = (S3RequestContext **) g_malloc0(backend->upload_contexts * sizeof(S3RequestContext *));
+    pool->max_in_flight = backend->max_in_flight;
+    pool->pending_keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_mutex_init(&pool->mutex);
+    g_cond_init(&pool->cond);
+
+    backend->upload_pool = pool;
+
+    g_mutex_lock(&pool->mutex);
+
+    for (i = 0; i < backend->upload_contexts; i++)
+    {
+        context = new_request_context();
+
+        if (context == NULL)
+        {
+            break;
+        }
+
+        pool->contexts[i] = context;
+        pool->threads[i] = g_thread_new("minio-upload", upload_thread, backend);
+        pool->nb_threads++;
+    }
+
+    g_mutex_unlock(&pool->mutex);
+
+    minio_print_debug("[%s] %u upload threads, at most %u uploads in flight\n",
+                      LOGGING_METHOD_PREFIX_MINIO_UPLOAD,
+                      pool->nb_threads,
+                      pool->max_in_flight);
+
+    return (pool->nb_threads > 0);
+}
+
+
+/**
+ * Waits for every upload, stops the upload threads and frees the upload
+ * pool of @param backend.
+ * @param backend is the backend structure.
+ */
+static void free_upload_pool(minio_backend_t *backend)
+{
+    minio_upload_pool_t *pool = backend->upload_pool;
+    guint i = 0;
+
+    if (pool != NULL)
+    {
+        if (pool->nb_threads > 0)
+        {
+            wait_for_uploads(pool);
+        }
+
+        g_mutex_lock(&pool->mutex);
+        pool->stop = TRUE;
+        g_mutex_unlock(&pool->mutex);
+
+        for (i = 0; i < pool->nb_threads; i++)
+        {
+            g_thread_join(pool->threads[i]);
+            free_request_context(pool->contexts[i]);
+        }
+
+        g_async_queue_unref(pool->queue);
+        g_queue_free(pool->delayed);
+        g_hash_table_destroy(pool->pending_keys);
+        g_mutex_clear(&pool->mutex);
+        g_cond_clear(&pool->cond);
+        g_free(pool->threads);
+        g_free(pool->contexts);
+        g_free(pool);
+
+        backend->upload_pool = NULL;
+    }
+}
+
+
+/**
+ * Queues an upload. Waits while max_in_flight uploads are already queued
+ * or running. The pool owns the upload from now on.
+ * @param backend is the backend structure.
+ * @param upload is the upload to be queued.
+ */
+static void enqueue_upload(minio_backend_t *backend, minio_upload_t *upload)
+{
+    minio_upload_pool_t *pool = backend->upload_pool;
+    guint count = 0;
+
+    upload->backend = backend;
+    upload->started = g_get_monotonic_time();
+
+    g_mutex_lock(&pool->mutex);
+
+    while (pool->pending >= pool->max_in_flight)
+    {
+        g_cond_wait(&pool->cond, &pool->mutex);
+    }
+
+    pool->pending++;
+
+    if (upload->pending_key != NULL)
+    {
+        count = GPOINTER_TO_UINT(g_hash_table_lookup(pool->pending_keys, upload->pending_key));
+        g_hash_table_insert(pool->pending_keys, g_strdup(upload->pending_key), GUINT_TO_POINTER(count + 1));
+    }
+
+    g_mutex_unlock(&pool->mutex);
+
+    g_async_queue_push(pool->queue, upload);
+}
+
+
+/**
+ * Queues the upload of a sealed pack and of its index object. The pack is
+ * uploaded only once both objects are stored: otherwise its staging file
+ * is kept and it is uploaded again later. An index object whose pack is
+ * missing (interrupted upload) is ignored when the pack index is rebuilt.
+ * When no bucket can be accessed the pack stays staged.
+ * @param backend is the backend structure.
+ * @param pack is the sealed pack (owned by the packer).
+ */
+static void save_pack_to_bucket(minio_backend_t *backend, minio_pack_t *pack)
+{
+    minio_upload_t *upload = NULL;
+    minio_upload_t *index_upload = NULL;
+    const char *bucket = NULL;
+    gsize len = 0;
+
+    bucket = get_active_bucket(backend, backend->bucketname_data, &backend->active_bucket_data, "Data");
+
+    if (bucket == NULL)
+    {
+        minio_print_critical("[%s] No bucket could be accessed: pack '%s' stays staged\n",
+                             LOGGING_METHOD_PREFIX_MINIO_UPLOAD,
+                             pack->key);
+        minio_packer_uploading(backend->packer, pack, 1);
+        minio_packer_uploaded(backend->packer, pack, FALSE);
+        return;
+    }
+
+    minio_print_verbose("[%s] Save pack '%s' (%u blocks, %u bytes)\n",
+                        LOGGING_METHOD_PREFIX_MINIO_UPLOAD,
+                        pack->key,
+                        pack->entries->len,
+                        pack->data->len);
+
+    // the pack is freed once both its objects are uploaded
+    minio_packer_uploading(backend->packer, pack, 2);
+
+    index_upload = (minio_upload_t *) g_malloc0(sizeof(minio_upload_t));
+    index_upload->bucket = bucket;
+    index_upload->key = g_strdup_printf("%s%s", pack->key, MINIO_PACK_INDEX_SUFFIX);
+    index_upload->pack = pack;
+    index_upload->buffer = minio_pack_index_content(pack, &len);
+    index_upload->data = index_upload->buffer;
+    index_upload->length = len;
+
+    upload = (minio_upload_t *) g_malloc0(sizeof(minio_upload_t));
+    upload->bucket = bucket;
+    upload->key = g_strdup(pack->key);
+    upload->pack = pack;
+    upload->data = (const char *) pack->data->data;
+    upload->length = pack->data->len;
+
+    enqueue_upload(backend, upload);
+    enqueue_upload(backend, index_upload);
+}
+
+
+
 /** Prefix for logging in initialization methods */
 #define LOGGING_METHOD_PREFIX_MINIO_INIT ("Init")
 
@@ -395,14 +1205,258 @@ static bool initBuckets(minio_backend_t *backend)
             return false;
         }
 
-        // passed till here means every bucket already existed or has been created
-        minio_print_info("[%s] Initialized buckets.\n", LOGGING_METHOD_PREFIX_MINIO_INIT);
-        return true;
-    } else
+        // passed till here means every bucket already existed or has been created
+        minio_print_info("[%s] Initialized buckets.\n", LOGGING_METHOD_PREFIX_MINIO_INIT);
+        return true;
+    } else
+    {
+        minio_print_error("[%s] No initialized backend passed!\n", LOGGING_METHOD_PREFIX_MINIO_INIT);
+        return false;
+    }
+}
+
+
+/**
+ * Thread uploading the pack being filled once it is older than
+ * pack_flush_interval seconds, so that blocks do not stay only on the
+ * server when few of them are stored. It also uploads again the packs
+ * whose upload failed MINIO_PACK_RETRY_DELAY seconds ago.
+ * @param user_data is the minio_backend_t * backend structure.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer pack_flusher_thread(gpointer user_data)
+{
+    minio_backend_t *backend = user_data;
+    minio_pack_t *pack = NULL;
+    gint64 end_time = 0;
+
+    g_mutex_lock(&backend->flusher_mutex);
+
+    while (backend->flusher_stop == FALSE)
+    {
+        end_time = g_get_monotonic_time() + G_TIME_SPAN_SECOND;
+
+        if (g_cond_wait_until(&backend->flusher_cond, &backend->flusher_mutex, end_time) == FALSE)
+        {
+            g_mutex_unlock(&backend->flusher_mutex);
+
+            pack = minio_packer_seal(backend->packer, backend->pack_flush_interval * G_TIME_SPAN_SECOND);
+
+            if (pack != NULL)
+            {
+                save_pack_to_bucket(backend, pack);
+            }
+
+            while ((pack = minio_packer_retry(backend->packer)) != NULL)
+            {
+                save_pack_to_bucket(backend, pack);
+            }
+
+            g_mutex_lock(&backend->flusher_mutex);
+        }
+    }
+
+    g_mutex_unlock(&backend->flusher_mutex);
+
+    return NULL;
+}
+
+
+/**
+ * Starts the packing mode when pack_size is set: loads (or rebuilds from
+ * the bucket) the pack index, uploads the packs staged by a previous run
+ * and starts the pack flusher thread.
+ * @param backend is the backend structure (its upload pool must exist).
+ */
+static void init_packing(minio_backend_t *backend)
+{
+    GList *packs = NULL;
+    GList *head = NULL;
+
+    if (backend->pack_size > 0)
+    {
+        backend->packer = new_minio_packer_t(backend->pack_size, backend->pack_staging_dir, backend->pack_index_file);
+
+        if (backend->packer == NULL)
+        {
+            minio_print_error("[%s] Packing disabled: staging directory '%s' unusable\n",
+                              LOGGING_METHOD_PREFIX_MINIO_INIT,
+                              backend->pack_staging_dir);
+            return;
+        }
+
+        if (minio_packer_has_index_file(backend->packer) == FALSE)
+        {
+            minio_packer_rebuild_index(backend->packer, backend->bucketname_data);
+        }
+
+        packs = minio_packer_recover(backend->packer);
+
+        for (head = packs; head != NULL; head = g_list_next(head))
+        {
+            save_pack_to_bucket(backend, head->data);
+        }
+
+        g_list_free(packs);
+
+        g_mutex_init(&backend->flusher_mutex);
+        g_cond_init(&backend->flusher_cond);
+        backend->flusher_stop = FALSE;
+        backend->pack_flusher = g_thread_new("minio-pack-flusher", pack_flusher_thread, backend);
+
+        minio_print_info("[%s] Packing blocks into %" G_GUINT64_FORMAT " bytes packs\n",
+                         LOGGING_METHOD_PREFIX_MINIO_INIT,
+                         backend->pack_size);
+    }
+}
+
+
+/**
+ * Stops the pack flusher thread and queues the upload of the pack being
+ * filled. The packer itself is freed once every upload has completed.
+ * @param backend is the backend structure.
+ */
+static void terminate_packing(minio_backend_t *backend)
+{
+    minio_pack_t *pack = NULL;
+
+    if (backend->packer != NULL)
+    {
+        g_mutex_lock(&backend->flusher_mutex);
+        backend->flusher_stop = TRUE;
+        g_cond_signal(&backend->flusher_cond);
+        g_mutex_unlock(&backend->flusher_mutex);
+
+        g_thread_join(backend->pack_flusher);
+        g_mutex_clear(&backend->flusher_mutex);
+        g_cond_clear(&backend->flusher_cond);
+
+        pack = minio_packer_seal(backend->packer, 0);
+
+        if (pack != NULL)
+        {
+            save_pack_to_bucket(backend, pack);
+        }
+    }
+}
+
+
+static bool save_data_to_bucket(minio_backend_t *backend, const gchar *bucketname, const gchar *hash_string,
+                                hash_data_t *hash_data, gboolean spooled);
+
+/**
+ * Queues the upload of every spooled block that is not being uploaded.
+ * Stops when no bucket can be accessed (the blocks stay spooled).
+ * @param backend is the backend structure.
+ */
+static void upload_spooled_blocks(minio_backend_t *backend)
+{
+    GDir *dir = NULL;
+    const gchar *name = NULL;
+    const char *bucket = NULL;
+    hash_data_t *hash_data = NULL;
+    gboolean stop = FALSE;
+
+    dir = g_dir_open(backend->spool_dir, 0, NULL);
+
+    if (dir != NULL)
+    {
+        while (stop == FALSE && (name = g_dir_read_name(dir)) != NULL)
+        {
+            // temporary files of g_file_set_contents() are not hashs
+            if (minio_is_hash_key(name) == TRUE && is_hash_being_uploaded(backend->upload_pool, name) == FALSE)
+            {
+                bucket = get_active_bucket(backend, backend->bucketname_data, &backend->active_bucket_data, "Data");
+                hash_data = (bucket != NULL) ? read_spooled_block(backend, name) : NULL;
+
+                if (hash_data != NULL)
+                {
+                    minio_print_verbose("[%s] Upload spooled block '%s' again\n", LOGGING_METHOD_PREFIX_MINIO_UPLOAD, name);
+                    save_data_to_bucket(backend, bucket, name, hash_data, TRUE);
+                }
+
+                stop = (bucket == NULL);
+            }
+
+            g_mutex_lock(&backend->spooler_mutex);
+            stop = stop || backend->spooler_stop;
+            g_mutex_unlock(&backend->spooler_mutex);
+        }
+
+        g_dir_close(dir);
+    }
+}
+
+
+/**
+ * Spooler thread: uploads the blocks spooled by a previous run at once
+ * and then, every MINIO_SPOOL_RETRY_DELAY seconds, the blocks whose
+ * upload failed meanwhile.
+ * @param user_data is the minio_backend_t * backend structure.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer spooler_thread(gpointer user_data)
+{
+    minio_backend_t *backend = user_data;
+    gint64 end_time = 0;
+
+    g_mutex_lock(&backend->spooler_mutex);
+
+    while (backend->spooler_stop == FALSE)
+    {
+        g_mutex_unlock(&backend->spooler_mutex);
+        upload_spooled_blocks(backend);
+        g_mutex_lock(&backend->spooler_mutex);
+
+        end_time = g_get_monotonic_time() + MINIO_SPOOL_RETRY_DELAY * G_TIME_SPAN_SECOND;
+
+        while (backend->spooler_stop == FALSE && g_get_monotonic_time() < end_time)
+        {
+            g_cond_wait_until(&backend->spooler_cond, &backend->spooler_mutex, end_time);
+        }
+    }
+
+    g_mutex_unlock(&backend->spooler_mutex);
+
+    return NULL;
+}
+
+
+/**
+ * Creates the spool directory and starts the spooler thread.
+ * @param backend is the backend structure (its upload pool must exist).
+ */
+static void init_spool(minio_backend_t *backend)
+{
+    if (g_mkdir_with_parents(backend->spool_dir, 0700) != 0)
     {
-        minio_print_error("[%s] No initialized backend passed!\n", LOGGING_METHOD_PREFIX_MINIO_INIT);
-        return false;
+        minio_print_error("[%s] Spool directory '%s' unusable: blocks whose upload fails are lost\n",
+                          LOGGING_METHOD_PREFIX_MINIO_INIT,
+                          backend->spool_dir);
     }
+
+    g_mutex_init(&backend->spooler_mutex);
+    g_cond_init(&backend->spooler_cond);
+    backend->spooler_stop = FALSE;
+    backend->spooler = g_thread_new("minio-spooler", spooler_thread, backend);
+}
+
+
+/**
+ * Stops the spooler thread. Blocks still spooled are uploaded at next
+ * start.
+ * @param backend is the backend structure.
+ */
+static void terminate_spool(minio_backend_t *backend)
+{
+    g_mutex_lock(&backend->spooler_mutex);
+    backend->spooler_stop = TRUE;
+    g_cond_signal(&backend->spooler_cond);
+    g_mutex_unlock(&backend->spooler_mutex);
+
+    g_thread_join(backend->spooler);
+    g_mutex_clear(&backend->spooler_mutex);
+    g_cond_clear(&backend->spooler_cond);
 }
 
 
@@ -437,8 +1491,26 @@ void minio_init_backend(server_struct_t *server_struct)
                 // test buckets (or add them if configured)
                 if (initBuckets(minio_backend))
                 {
-                    server_struct->backend_data->user_data = minio_backend;
-                    minio_print_info("Backend initialized.\n");
+                    // buckets have just been validated
+                    g_mutex_init(&minio_backend->buckets_mutex);
+                    minio_backend->active_bucket_data = minio_backend->bucketname_data;
+
+                    if (new_upload_pool(minio_backend))
+                    {
+                        // loaded from its file or rebuilt in the background
+                        minio_backend->index = new_minio_index_t(minio_backend->index_file,
+                                                                 minio_backend->bucketname_data);
+                        init_packing(minio_backend);
+                        init_spool(minio_backend);
+                        server_struct->backend_data->user_data = minio_backend;
+                        minio_print_info("Backend initialized.\n");
+                    } else
+                    {
+                        free_upload_pool(minio_backend);
+                        g_mutex_clear(&minio_backend->buckets_mutex);
+                        g_free(minio_backend);
+                        minio_print_error("No request context could be created for uploads!\n");
+                    }
                 } else
                 {
                     g_free(minio_backend);
@@ -466,11 +1538,27 @@ void minio_init_backend(server_struct_t *server_struct)
 
 
 /**
- * Terminates the MinIO backend
- * @param server_struct
+ * Terminates the MinIO backend: every queued upload ends before.
+ * @param backend is the backend_t * structure whose user_data is the
+ *        minio_backend_t * structure of this backend.
  */
-void minio_terminate_backend(server_struct_t *server_struct)
+void minio_terminate_backend(backend_t *backend)
 {
+    minio_backend_t *minio_backend = NULL;
+
+    if (backend != NULL && backend->user_data != NULL)
+    {
+        minio_backend = backend->user_data;
+
+        // every queued block (and the pack being filled) is stored and indexed (or spooled) before leaving
+        terminate_spool(minio_backend);
+        terminate_packing(minio_backend);
+        free_upload_pool(minio_backend);
+        free_minio_packer_t(minio_backend->packer);
+        free_minio_index_t(minio_backend->index);
+        g_mutex_clear(&minio_backend->buckets_mutex);
+    }
+
     S3_deinitialize();
     minio_print_debug("Backend deinitialized!\n");
 }
@@ -494,77 +1582,56 @@ static gchar *generate_filemeta_objectkey(const gchar *hash_string)
 }
 
 /**
- * Sets cmptype and uncmplen in meta hash file and stores it to the passed MinIO bucket
- * @param hash_string is the hash_string of the hash. The meta file has the
- *        same name but ends with .meta
- * @param uncmplen the len of the uncompressed hash file.
- * @param cmptype the compression type used to store this hash file.
- * @TODO IMPORTANT: make return success bool, when put_object(..) is modified to return its actual success bool
+ * Queues the upload of the data of @param hash_data to an object (named by
+ * @param hash_string). Its compression type and uncompressed length are
+ * stored in the x-amz-meta-cmptype and x-amz-meta-uncmplen headers of
+ * the object.
+ * @param backend is the backend structure.
+ * @param bucketname is the bucket to store the data in.
+ * @param hash_string is the hash in hexadecimal format.
+ * @param hash_data is the block to store. It is owned by the upload that
+ *        frees it once completed.
+ * @param spooled is TRUE when the block has been read from its spool file
+ *        (which is removed once the block is stored).
+ * @return TRUE if the upload has been queued. Its actual success is only
+ *         known when it completes (see upload_done()).
  */
-static bool save_filemeta_to_bucket(const gchar *bucketname, const gchar *hash_string, gssize uncmplen, gshort cmptype)
+static bool save_data_to_bucket(minio_backend_t *backend, const gchar *bucketname, const gchar *hash_string,
+                                hash_data_t *hash_data, gboolean spooled)
 {
-    a_clock_t *clock = new_clock_t();
-    minio_print_debug("[%s] Saving filemeta...\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
+    minio_upload_t *upload = NULL;
+    gshort cmptype = 0;
+
+    minio_print_debug("[%s] Saving data...\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
 
-    if (bucketname != NULL && hash_string != NULL)
+    if (bucketname != NULL && hash_string != NULL && hash_data != NULL && hash_data->data != NULL)
     {
-        gchar *objectkey = NULL;
-        GKeyFile *keyfile = NULL;
-        GError *error = NULL;
-        gchar *keyfile_content;
+        minio_print_verbose("[%s] Save data (%s)\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA, hash_string);
 
-        objectkey = generate_filemeta_objectkey(hash_string);
-        minio_print_verbose("Save file meta (%s)\n", objectkey);
-        keyfile = g_key_file_new();
+        upload = (minio_upload_t *) g_malloc0(sizeof(minio_upload_t));
+        upload->bucket = bucketname;
+        upload->key = g_strdup(hash_string);
+        upload->pending_key = g_strdup(hash_string);
+        upload->hash_data = hash_data;
+        upload->data = (const char *) hash_data->data;
+        upload->length = hash_data->read;
+        upload->spooled = spooled;
 
+        cmptype = hash_data->cmptype;
         if (is_compress_type_allowed(cmptype) == FALSE)
         {
             cmptype = COMPRESS_NONE_TYPE;
         }
 
-        g_key_file_set_int64(keyfile, GN_META, KN_UNCMPLEN, uncmplen);
-        g_key_file_set_integer(keyfile, GN_META, KN_CMPTYPE, cmptype);
-
-        keyfile_content = g_key_file_to_data(keyfile, NULL, &error);
-
-        // PUT the object
-        put_object(bucketname, objectkey, keyfile_content);
+        upload->meta[0].name = KN_CMPTYPE;
+        upload->meta[0].value = g_strdup_printf("%d", cmptype);
+        upload->meta[1].name = KN_UNCMPLEN;
+        upload->meta[1].value = g_strdup_printf("%" G_GSSIZE_FORMAT, hash_data->uncmplen);
+        upload->meta_count = MINIO_META_COUNT;
 
-        g_key_file_free(keyfile);
-        free_variable(objectkey);
-        end_clock(clock, "save filemeta");
-
-        return true;
-    } else
-    {
-        minio_print_error("[%s] Bucketname or Hashstring NULL!\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
-        end_clock(clock, "save filemeta");
-        return false;
-    }
-}
-
-
-/**
- * Stores the passed @param data to an object (named by @param hash_string)
- * @param bucketname
- * @param hash_string
- * @param data
- * @return
- * @todo: make return success bool, when put_object(..) is modified to return its actual success bool
- */
-static bool save_data_to_bucket(const gchar *bucketname, const gchar *hash_string, const gchar *data)
-{
-    minio_print_debug("[%s] Saving data...\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
+        enqueue_upload(backend, upload);
 
-    a_clock_t *clock;
-    if (bucketname != NULL && hash_string != NULL && data != NULL)
-    {
-        clock = new_clock_t();
-        minio_print_verbose("[%s] Save data (%s)\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA, hash_string);
-        put_object(bucketname, hash_string, data);
-        end_clock(clock, "save data");
-
-        minio_print_debug("[%s] Data saved.\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
+        minio_print_debug("[%s] Data queued.\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
         return true;
     } else
     {
@@ -572,7 +1639,7 @@ static bool save_data_to_bucket(const gchar *bucketname, const gchar *hash_strin
                           LOGGING_METHOD_PREFIX_MINIO_SAVEDATA,
                           (bucketname ? "Bucketname OK" : "Bucketname missing"),
                           (hash_string ? "Hashstring OK" : "Hashstring missing"),
-                          (data ? "Data OK" : "Data missing")
+                          (hash_data && hash_data->data ? "Data OK" : "Data missing")
         );
         return false;
     }
@@ -582,137 +1649,79 @@ static bool save_data_to_bucket(const gchar *bucketname, const gchar *hash_strin
 /**
  * Stores data into a flat file. The file is named by its hash in hex
  * representation (one should easily check that the sha256sum of such a
- * file gives its name !).
+ * file gives its name !). Buckets are checked only when they have not
+ * been validated yet or after an error and objects are uploaded
+ * concurrently by the upload pool. In packing mode the block is copied
+ * into the pack being filled instead, which is uploaded once full.
  * @param server_struct is the server's main structure where all
  *        informations needed by the program are stored.
  * @param hash_data is a hash_data_t * structure that contains the hash and
  *        the corresponding data in a binary form and a 'read' field that
- *        contains the number of bytes in 'data' field.
+ *        contains the number of bytes in 'data' field. It is freed here or
+ *        once uploaded.
+ * @returns TRUE if the block has been packed or queued for upload,
+ *          FALSE otherwise.
  */
-void minio_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
+gboolean minio_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
 {
     minio_backend_t *backend;
     const char *bucket_data;    /* no free */
-    const char *bucket_filemeta;    /* no free */
-    a_clock_t *clock;
+    minio_pack_t *pack = NULL;  /* no free: owned by the packer */
+    gboolean stored = FALSE;
 
     gchar *hash_string;
 
     minio_print_debug("[%s] MinIO Store Data\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
 
 
-    if (server_struct != NULL && server_struct->backend_data != NULL)
+    if (server_struct != NULL && server_struct->backend_data != NULL && server_struct->backend_data->user_data != NULL)
     {
         backend = server_struct->backend_data->user_data;
 
-        minio_print_debug("[%s] Check buckets.\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
-
-        // Get the working buckets for data and filemeta (Order for data and filemeta: {Configured Bucket} -> {Fallback bucket} -> Error and return)
+        // Get the working bucket for data (Order: {Configured Bucket} -> {Fallback bucket} -> Error and return)
+        bucket_data = get_active_bucket(backend, backend->bucketname_data, &backend->active_bucket_data, "Data");
 
-        // Data bucket
-        if (backend->bucketname_data != NULL && checkBucketAccess(backend->bucketname_data, CREATE_BUCKET_IF_MISSING))
+        if (bucket_data == NULL)
         {
-            // bucket available
-            bucket_data = backend->bucketname_data;
-        } else
-        {
-            // show error message
-            if (backend->bucketname_data != NULL)
-            {
-                minio_print_error("[%s] Data bucket could not be accessed! (%s)\n",
-                                  LOGGING_METHOD_PREFIX_MINIO_SAVEDATA,
-                                  backend->bucketname_data);
-            } else
-            {
-                minio_print_error("[%s] No data bucket configured!\n",
-                                  LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
-            }
-
-
-            // try fallback bucket
-            if (checkBucketAccess(MINIO_FALLBACK_BUCKET, TRUE))
-            {
-                bucket_data = MINIO_FALLBACK_BUCKET;
-                minio_print_error("[%s] Using fallback bucket (%s)\n",
-                                  LOGGING_METHOD_PREFIX_MINIO_SAVEDATA,
-                                  MINIO_FALLBACK_BUCKET);
-            } else
-            {
-                // If no possible saving method found, return from method
-                minio_print_error("[%s] FALLBACK BUCKET COULD NOT BE ACCESSED, SO DATA COULD NOT BE STORED!\n",
-                                  LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
-                return;
-            }
+            // If no possible saving method found, return from method
+            minio_print_critical("[%s] NO BUCKET COULD BE ACCESSED, SO DATA COULD NOT BE STORED!\n",
+                                 LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
+            free_hash_data_t(hash_data);
+            return FALSE;
         }
 
-        // Filemeta bucket
-        if (backend->bucketname_filemeta != NULL &&
-            checkBucketAccess(backend->bucketname_filemeta, CREATE_BUCKET_IF_MISSING))
-        {
-            bucket_filemeta = backend->bucketname_filemeta;
 
-        } else
+        /** generate and save DATA */
+        if (backend->packer != NULL && hash_data != NULL && hash_data->hash != NULL && hash_data->data != NULL)
         {
-            // show error message
-            if (backend->bucketname_filemeta != NULL)
-            {
-                minio_print_error("[%s] File meta bucket could not be accessed! (%s)\n",
-                                  LOGGING_METHOD_PREFIX_MINIO_SAVEDATA,
-                                  backend->bucketname_filemeta);
-            } else
-            {
-                minio_print_error("[%s] No filemeta bucket configured!\n",
-                                  LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
-            }
+            pack = minio_packer_add(backend->packer, hash_data);
+            free_hash_data_t(hash_data);
+            stored = TRUE;
 
-            // try fallback bucket
-            if (checkBucketAccess(MINIO_FALLBACK_BUCKET, TRUE))
-            {
-                bucket_filemeta = MINIO_FALLBACK_BUCKET;
-                minio_print_error("[%s] Using fallback bucket (%s)\n",
-                                  LOGGING_METHOD_PREFIX_MINIO_SAVEDATA,
-                                  MINIO_FALLBACK_BUCKET);
-            } else
+            if (pack != NULL)
             {
-                // If no possible saving method found, return from method
-                minio_print_critical("[%s] FALLBACK BUCKET COULD NOT BE ACCESSED, SO DATA COULD NOT BE STORED!\n",
-                                     LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
-                return;
+                save_pack_to_bucket(backend, pack);
             }
-        }
-
 
-
-        /** generate and save DATA */
-        if (hash_data != NULL && hash_data->hash != NULL && hash_data->data != NULL)
+            minio_print_debug("[%s] Packed data\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
+        } else if (hash_data != NULL && hash_data->hash != NULL && hash_data->data != NULL)
         {
             // get the hash as string
             hash_string = hash_to_string(hash_data->hash);
             if (hash_string != NULL)
             {
-
-                // try save meta data
-                if (save_filemeta_to_bucket(bucket_filemeta, hash_string, hash_data->uncmplen, hash_data->cmptype))
-                {
-                    minio_print_debug("[%s] Stored filemeta\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
-                } else
-                {
-                    minio_print_critical("[%s] Could not store file meta for hash '%s' to bucket '%s'!\n",
-                                         LOGGING_METHOD_PREFIX_MINIO_SAVEDATA,
-                                         hash_string,
-                                         bucket_filemeta);
-                }
-
-                // save data
-                if (save_data_to_bucket(bucket_data, hash_string, (const gchar *) hash_data->data))
+                // save data and its meta data (the upload owns hash_data from now on)
+                if (save_data_to_bucket(backend, bucket_data, hash_string, hash_data, FALSE))
                 {
-                    minio_print_debug("[%s] Stored data\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
+                    minio_print_debug("[%s] Queued data\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
+                    stored = TRUE;
                 } else
                 {
                     minio_print_critical("[%s] Could not store data for hash '%s' to bucket '%s'!\n",
                                          LOGGING_METHOD_PREFIX_MINIO_SAVEDATA,
                                          hash_string,
                                          bucket_data);
+                    free_hash_data_t(hash_data);
                 }
 
                 free_variable(hash_string);
@@ -722,6 +1731,7 @@ void minio_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
                                      LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
                 minio_print_critical("[%s] DATA COULD NOT BE STORED!\n",
                                      LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
+                free_hash_data_t(hash_data);
             }
         } else
         {
@@ -734,6 +1744,7 @@ void minio_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
                                      (hash_data->data ? "Data OK" : "Data missing"));
                 minio_print_critical("[%s] DATA COULD NOT BE STORED!\n",
                                      LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
+                free_hash_data_t(hash_data);
             } else
             {
                 minio_print_error("[%s] Hash_data missing!\n",
@@ -746,9 +1757,12 @@ void minio_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
                           LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
         minio_print_critical("[%s] DATA COULD NOT BE STORED!\n",
                              LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
+        free_hash_data_t(hash_data);
     }
 
     minio_print_debug("[%s] Store Data done.\n\n", LOGGING_METHOD_PREFIX_MINIO_SAVEDATA);
+
+    return stored;
 }
 
 
@@ -759,7 +1773,105 @@ void minio_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
 
 
 /**
- * Builds a list of hashs that server's server needs.
+ * Called by libs3 when the HEAD request of a check has completed.
+ * Used as a request_done_callback.
+ * @param status is the final status of the request (S3StatusOK when the
+ *        object exists).
+ * @param user_data is the minio_head_check_t * check.
+ */
+static void head_check_done(S3Status status, void *user_data)
+{
+    minio_head_check_t *check = user_data;
+
+    check->exists = (status == S3StatusOK);
+    (*check->in_flight)--;
+}
+
+
+/**
+ * Looks for the objects of @param checks in @param bucket with concurrent
+ * HEAD requests (at most max_in_flight at once). Found hashs are added to
+ * the index.
+ * @param backend is the backend structure.
+ * @param bucket is the data bucket.
+ * @param checks is an array of minio_head_check_t * whose exists field is
+ *        set.
+ */
+static void check_keys_exist(minio_backend_t *backend, const char *bucket, GPtrArray *checks)
+{
+    S3RequestContext *context = NULL;
+    minio_head_check_t *check = NULL;
+    guint in_flight = 0;
+    guint i = 0;
+
+    if (checks->len > 0)
+    {
+        context = new_request_context();
+
+        if (context != NULL)
+        {
+            while (i < checks->len || in_flight > 0)
+            {
+                while (i < checks->len && in_flight < backend->max_in_flight)
+                {
+                    check = g_ptr_array_index(checks, i);
+                    check->in_flight = &in_flight;
+                    in_flight++;
+                    head_object_in_context(context, bucket, check->hash_string, head_check_done, check);
+                    i++;
+                }
+
+                if (in_flight > 0)
+                {
+                    run_request_context(context, MINIO_UPLOAD_RUN_WAIT_MS);
+                }
+            }
+
+            free_request_context(context);
+        } else
+        {
+            // no context: one request after the other
+            for (i = 0; i < checks->len; i++)
+            {
+                check = g_ptr_array_index(checks, i);
+                check->exists = checkKeyExistInBucket(bucket, check->hash_string);
+            }
+        }
+
+        for (i = 0; i < checks->len; i++)
+        {
+            check = g_ptr_array_index(checks, i);
+
+            if (check->exists && bucket == backend->bucketname_data)
+            {
+                minio_index_add(backend->index, check->hash_data->hash);
+            }
+        }
+    }
+}
+
+
+/**
+ * Frees a check. Used as the free function of the array of checks.
+ * @param data is the minio_head_check_t * check to be freed.
+ */
+static void free_head_check(gpointer data)
+{
+    minio_head_check_t *check = data;
+
+    if (check != NULL)
+    {
+        free_variable(check->hash_string);
+        g_free(check);
+    }
+}
+
+
+/**
+ * Builds a list of hashs that server's server needs. Hashs are first
+ * looked for in the pack index, in the local index and in the uploads in
+ * progress. While the index is incomplete (it is being rebuilt) the other
+ * hashs are looked for in the bucket with concurrent HEAD requests.
  * @param server_struct is the server's main structure where all
  *        informations needed by the program are stored.
  * @param hash_list is the list of hashs that we have to check for.
@@ -773,6 +1885,13 @@ GList *minio_build_needed_hash_list(server_struct_t *server_struct, GList *hash_
     GList *needed = NULL;
     hash_data_t *hash_data = NULL;
     hash_data_t *needed_hash_data = NULL;
+    minio_head_check_t *check = NULL;
+    GPtrArray *proposed = NULL;     /* every distinct proposed hash, in order */
+    GPtrArray *unknown = NULL;      /* hashs to be looked for in the bucket   */
+    GHashTable *seen = NULL;        /* hash strings already in proposed       */
+    gboolean use_index = FALSE;
+    gboolean complete = FALSE;
+    guint i = 0;
 
     gchar *hash_string;
     head = hash_list;
@@ -782,43 +1901,88 @@ GList *minio_build_needed_hash_list(server_struct_t *server_struct, GList *hash_
     if (server_struct != NULL && server_struct->backend_data != NULL && server_struct->backend_data->user_data != NULL)
     {
         backend = server_struct->backend_data->user_data;
-        bucket = backend->bucketname_data;
+        bucket = get_active_bucket(backend, backend->bucketname_data, &backend->active_bucket_data, "Data");
 
         // check if bucket available
-        if (!checkBucketAccess(bucket, false))
+        if (bucket == NULL)
         {
             minio_print_error("[%s] Bucket not found to build needed hash list:\t%s\n",
                               LOGGING_METHOD_PREFIX_MINIO_BUILDHASHLIST,
-                              (bucket != NULL ? bucket : "NULL"));
+                              (backend->bucketname_data != NULL ? backend->bucketname_data : "NULL"));
         } else
         {
+            proposed = g_ptr_array_new_with_free_func(free_head_check);
+            unknown = g_ptr_array_new();
+            seen = g_hash_table_new(g_str_hash, g_str_equal);
+            // the index only knows the configured data bucket (not the fallback one)
+            use_index = (bucket == backend->bucketname_data);
+            complete = use_index && minio_index_is_complete(backend->index);
+
             // iterate over list
             while (head != NULL)
             {
                 hash_data = head->data;
                 hash_string = hash_to_string(hash_data->hash);
 
-                if (checkKeyExistInBucket(bucket, hash_string) == FALSE &&
-                    hash_data_is_in_list(hash_data, needed) == FALSE)
+                if (g_hash_table_contains(seen, hash_string) == FALSE)
+                {
+                    check = (minio_head_check_t *) g_malloc0(sizeof(minio_head_check_t));
+                    check->hash_data = hash_data;
+                    check->hash_string = hash_string;
+                    g_hash_table_add(seen, hash_string);
+                    g_ptr_array_add(proposed, check);
+
+                    if (minio_packer_contains(backend->packer, hash_data->hash) ||
+                        (use_index && minio_index_contains(backend->index, hash_data->hash)) ||
+                        is_hash_being_uploaded(backend->upload_pool, hash_string))
+                    {
+                        check->exists = TRUE;
+                    } else if (complete == FALSE)
+                    {
+                        // the index may not know it yet
+                        g_ptr_array_add(unknown, check);
+                    }
+                } else
+                {
+                    free_variable(hash_string);
+                }
+
+                // next element
+                head = g_list_next(head);
+            }
+
+            minio_print_debug("[%s] %u hashs proposed, %u looked for in bucket\n",
+                              LOGGING_METHOD_PREFIX_MINIO_BUILDHASHLIST,
+                              proposed->len,
+                              unknown->len);
+
+            check_keys_exist(backend, bucket, unknown);
+
+            for (i = 0; i < proposed->len; i++)
+            {
+                check = g_ptr_array_index(proposed, i);
+
+                if (check->exists == FALSE)
                 {
                     /*
                      * hash is neither name of an existing file in data bucket, nor is it already in needed list
                      * -> add it to needed list
                      */
-                    minio_print_verbose("[%s] Adding hash to needed:\t'%s'\n", hash_string);
+                    minio_print_verbose("[%s] Adding hash to needed:\t'%s'\n",
+                                        LOGGING_METHOD_PREFIX_MINIO_BUILDHASHLIST,
+                                        check->hash_string);
 
-                    needed_hash_data = copy_only_hash(hash_data, NULL);
+                    needed_hash_data = copy_only_hash(check->hash_data, NULL);
                     needed = g_list_prepend(needed, needed_hash_data);
                 }
-
-                free_variable(hash_string);
-
-                // next element
-                head = g_list_next(head);
             }
 
             // reverse order to "undo" the pre prepending of elements
             needed = g_list_reverse(needed);
+
+            g_hash_table_destroy(seen);
+            g_ptr_array_free(unknown, TRUE);
+            g_ptr_array_free(proposed, TRUE);
         }
     } else
     {
@@ -895,10 +2059,92 @@ static bool get_filemeta_values(const char *bucket, const char *hash_string, sho
 #define LOGGING_METHOD_PREFIX_MINIO_RETRIEVEDATA ("RetrieveData")
 
 
+/**
+ * Reads the compression type and uncompressed length of a block from the
+ * x-amz-meta-* headers of its data object. Used as an object_meta_callback.
+ * @param name is the name of the header without its x-amz-meta- prefix.
+ * @param value is the value of the header.
+ * @param user_data is the minio_block_meta_t * structure to fill.
+ */
+static void read_block_meta(const char *name, const char *value, void *user_data)
+{
+    minio_block_meta_t *block_meta = user_data;
+
+    if (name != NULL && value != NULL)
+    {
+        if (g_ascii_strcasecmp(name, KN_CMPTYPE) == 0)
+        {
+            block_meta->cmptype = (short) g_ascii_strtoll(value, NULL, 10);
+            block_meta->found++;
+        } else if (g_ascii_strcasecmp(name, KN_UNCMPLEN) == 0)
+        {
+            block_meta->uncmplen = (gssize) g_ascii_strtoll(value, NULL, 10);
+            block_meta->found++;
+        }
+    }
+}
+
+
+/**
+ * Builds the hash_data of a packed block. Its data is read with a ranged
+ * GET of its pack unless it has been copied from its staged pack.
+ * @param backend is the backend structure.
+ * @param hash_string is the hash in hexadecimal format.
+ * @param hash is the binary hash (owned by the returned hash_data or freed).
+ * @param entry tells where the block is.
+ * @param data is the data copied from the staged pack or NULL.
+ * @return the block or NULL if it could not be read.
+ */
+static hash_data_t *retrieve_packed_data(minio_backend_t *backend, const gchar *hash_string, guint8 *hash,
+                                         minio_pack_entry_t *entry, guchar *data)
+{
+    hash_data_t *hash_data = NULL;
+    gchar *pack_key = NULL;
+    size_t read = 0;
+
+    pack_key = minio_pack_key(entry->pack);
+
+    if (data == NULL)
+    {
+        data = (guchar *) get_object_range(backend->bucketname_data, pack_key, entry->offset, entry->length, &read);
+
+        // a short read is not the block
+        if (data != NULL && read != entry->length)
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    if (data != NULL)
+    {
+        hash_data = new_hash_data_t_as_is(data, entry->length, hash, entry->cmptype, entry->uncmplen);
+        minio_print_debug("[%s] Retrieving packed data finished.\n", LOGGING_METHOD_PREFIX_MINIO_RETRIEVEDATA);
+    } else
+    {
+        minio_print_error("[%s] Packed data not found! (Key: %s, Pack: %s, Bucket: %s)\n",
+                          LOGGING_METHOD_PREFIX_MINIO_RETRIEVEDATA,
+                          hash_string,
+                          pack_key,
+                          backend->bucketname_data);
+        free_variable(hash);
+    }
+
+    free_variable(pack_key);
+
+    return hash_data;
+}
+
+
 /**
  * Retrieves data from a file in MinIO. The file is named by its hash in hex
  * representation (one should easily check that the sha256sum of such a
- * file gives its name !).
+ * file gives its name !). Compression type and uncompressed length come
+ * with the data in the x-amz-meta-* headers of the object. Objects stored
+ * by older versions have no such headers: their filemeta object is read
+ * instead. Packed blocks are read with a ranged GET of their pack (or
+ * from memory while their pack is staged) and blocks whose upload failed
+ * from their spool file.
  * @param server_struct is the server's main structure where all
  *        informations needed by the program are stored.
  * @param hash_string is a gchar * hash in hexadecimal format as retrieved
@@ -911,55 +2157,142 @@ hash_data_t *minio_retrieve_data(server_struct_t *server_struct, gchar *hash_str
 
     minio_backend_t *backend = NULL;
     hash_data_t *hash_data = NULL;
+    minio_block_meta_t block_meta;
+    minio_pack_entry_t entry;
 
     guchar *data = NULL;
-    size_t *read;
-    guint8 *hash;
-
-    short *cmptype = g_malloc0(sizeof(short));
-    gssize *uncmplen = g_malloc0(sizeof(gssize));
+    size_t read = 0;
+    guint8 *hash = NULL;
 
     minio_print_debug("[%s] Start retrieving data...\n", LOGGING_METHOD_PREFIX_MINIO_RETRIEVEDATA);
 
     if (server_struct != NULL && server_struct->backend_data != NULL && server_struct->backend_data->user_data != NULL)
     {
         backend = (minio_backend_t *) server_struct->backend_data->user_data;
+        hash = string_to_hash(hash_string);
+
+        if (minio_packer_lookup(backend->packer, hash, &entry, &data) == TRUE)
+        {
+            hash_data = retrieve_packed_data(backend, hash_string, hash, &entry, data);
+            end_clock(clock, "Retrieve data");
+            return hash_data;
+        }
+
+        // a block stored a moment ago may still be uploading
+        wait_for_hash_upload(backend->upload_pool, hash_string);
+
+        // a block whose upload failed is kept in its spool file
+        hash_data = read_spooled_block(backend, hash_string);
+
+        if (hash_data != NULL)
+        {
+            free_variable(hash);
+            end_clock(clock, "Retrieve data");
+            return hash_data;
+        }
+
+        // get data and its meta data with one request
+        block_meta.cmptype = COMPRESS_NONE_TYPE;
+        block_meta.uncmplen = -1;
+        block_meta.found = 0;
+        data = (guchar *) get_object_with_meta(backend->bucketname_data, hash_string, &read, read_block_meta,
+                                               &block_meta);
 
-        // get filemeta
-        if (get_filemeta_values(backend->bucketname_filemeta, hash_string, cmptype, uncmplen))
+        if (data != NULL)
         {
-            read = g_malloc0(sizeof(size_t));
-            data = (guchar *) get_object(backend->bucketname_data, hash_string, read);
-            if (data != NULL)
+            // fallback for objects stored with a separate filemeta object
+            if (block_meta.found < MINIO_META_COUNT &&
+                get_filemeta_values(backend->bucketname_filemeta, hash_string, &block_meta.cmptype,
+                                    &block_meta.uncmplen))
+            {
+                block_meta.found = MINIO_META_COUNT;
+            }
+
+            if (block_meta.found >= MINIO_META_COUNT)
             {
-                hash = string_to_hash(hash_string);
-                hash_data = new_hash_data_t_as_is(data, *read, hash, *cmptype, *uncmplen);
+                hash_data = new_hash_data_t_as_is(data, read, hash, block_meta.cmptype, block_meta.uncmplen);
+                hash = NULL;
                 minio_print_debug("[%s] Retrieving data finished.\n",
                                   LOGGING_METHOD_PREFIX_MINIO_RETRIEVEDATA);
             } else
             {
-                minio_print_error("[%s] No data found in object! (Key: %s, Bucket: %s)\n",
+                minio_print_error("[%s] No Filemeta found for hash '%s' (Bucket: %s)\n",
                                   LOGGING_METHOD_PREFIX_MINIO_RETRIEVEDATA,
                                   hash_string,
-                                  backend->bucketname_data);
+                                  backend->bucketname_filemeta);
+                free(data);
             }
-
-            g_free(read);
         } else
         {
-            minio_print_error("[%s] No Filemeta found for hash '%s' (Bucket: %s)\n",
+            minio_print_error("[%s] No data found in object! (Key: %s, Bucket: %s)\n",
                               LOGGING_METHOD_PREFIX_MINIO_RETRIEVEDATA,
                               hash_string,
-                              backend->bucketname_filemeta);
+                              backend->bucketname_data);
         }
     } else
     {
         minio_print_error("[%s] Server structure incomplete!\n", LOGGING_METHOD_PREFIX_MINIO_RETRIEVEDATA);
     }
 
-    g_free(cmptype);
-    g_free(uncmplen);
-
+    free_variable(hash);
     end_clock(clock, "Retrieve data");
     return hash_data;
-}
\ No newline at end of file
+}
+
+
+/**
+ * Calls the function of a minio_foreach_t with the hash of a listed key.
+ * Used as a list_key_callback.
+ * @param key is the listed key.
+ * @param size is the size of the object (unused).
+ * @param user_data is the minio_foreach_t * function to call.
+ * @return true to go on with the listing.
+ */
+static bool call_with_listed_hash(const char *key, uint64_t size, void *user_data)
+{
+    minio_foreach_t *foreach = user_data;
+    guint8 *hash = NULL;
+
+    (void) size;
+
+    if (minio_is_hash_key(key) == TRUE)
+    {
+        hash = string_to_hash((gchar *) key);
+        foreach->func(hash, foreach->user_data);
+        free_variable(hash);
+    }
+
+    return true;
+}
+
+
+/**
+ * Calls func with each hash stored into the data bucket (listed) and
+ * into packs. This may take some time on big buckets.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param func is the function to be called. Its first argument is the
+ *        binary hash (guint8 *) that must not be freed by func.
+ * @param user_data is passed as is to func as its second argument.
+ */
+void minio_foreach_stored_hash(server_struct_t *server_struct, GFunc func, gpointer user_data)
+{
+    minio_backend_t *backend = NULL;
+    minio_foreach_t foreach;
+
+    if (server_struct != NULL && server_struct->backend_data != NULL && server_struct->backend_data->user_data != NULL && func != NULL)
+    {
+        backend = server_struct->backend_data->user_data;
+        foreach.func = func;
+        foreach.user_data = user_data;
+
+        if (!list_bucket_keys(backend->bucketname_data, NULL, call_with_listed_hash, &foreach))
+        {
+            minio_print_error("[%s] Bucket '%s' could not be fully listed\n",
+                              LOGGING_METHOD_PREFIX_MINIO_RETRIEVEDATA,
+                              backend->bucketname_data);
+        }
+
+        minio_packer_foreach(backend->packer, func, user_data);
+    }
+}
@@ -20,12 +20,20 @@
 #define LOGGING_PREFIX_TAG_CRITICAL ("CRITICAL")
 
 /**
- * To store meta data of the hash file into a GKeyFile structure.
+ * To store meta data of the hash file into a GKeyFile structure (filemeta
+ * objects written by older versions). The key names are also the names of
+ * the x-amz-meta-* headers of data objects.
  */
 #define GN_META ("Meta")
 #define KN_UNCMPLEN ("uncmplen")
 #define KN_CMPTYPE ("cmptype")
 
+/**
+ * Number of x-amz-meta-* headers stored with each data object
+ * (KN_CMPTYPE and KN_UNCMPLEN)
+ */
+#define MINIO_META_COUNT (2)
+
 
 /**
  * Object prefixes and suffixes
@@ -33,6 +41,129 @@
 #define MINIO_FILEMETA_SUFFIX "meta"
 
 
+/**
+ * Default number of upload threads (each one runs its own libs3 request
+ * context) and default maximum number of uploads queued or running at once
+ */
+#define MINIO_DEFAULT_UPLOAD_CONTEXTS (4)
+#define MINIO_DEFAULT_MAX_IN_FLIGHT (64)
+
+/**
+ * Number of times a failed upload is retried when libs3 tells that its
+ * status is retryable. The first retry waits MINIO_UPLOAD_RETRY_DELAY_MS
+ * and each following one twice as long as the previous one. No retry is
+ * made once MINIO_UPLOAD_RETRY_TIMEOUT_MS have passed since the first try.
+ */
+#define MINIO_UPLOAD_RETRIES (6)
+#define MINIO_UPLOAD_RETRY_DELAY_MS (250)
+#define MINIO_UPLOAD_RETRY_TIMEOUT_MS (30000)
+
+/**
+ * Maximum time (in milliseconds) an upload thread waits for the network
+ * before looking for new uploads to issue
+ */
+#define MINIO_UPLOAD_RUN_WAIT_MS (50)
+
+/**
+ * Default file where the index of the data bucket is saved
+ */
+#define MINIO_DEFAULT_INDEX_FILE "/var/tmp/cdpfgl/server/minio-index"
+
+/**
+ * Defaults of the packing mode: directory of the staging files, file
+ * where the pack index is saved and number of seconds after which a pack
+ * that is not full is uploaded anyway
+ */
+#define MINIO_DEFAULT_PACK_STAGING_DIR "/var/tmp/cdpfgl/server/minio-packs"
+#define MINIO_DEFAULT_PACK_INDEX_FILE "/var/tmp/cdpfgl/server/minio-pack-index"
+#define MINIO_DEFAULT_PACK_FLUSH_INTERVAL (60)
+
+/**
+ * Default directory where blocks whose upload failed are spooled and
+ * number of seconds after which they are uploaded again
+ */
+#define MINIO_DEFAULT_SPOOL_DIR "/var/tmp/cdpfgl/server/minio-spool"
+#define MINIO_SPOOL_RETRY_DELAY (60)
+
+
+/**
+ * Pool of threads uploading objects concurrently, each one through its
+ * own libs3 request context.
+ */
+typedef struct minio_upload_pool_t
+{
+    GAsyncQueue *queue;        /**< minio_upload_t * waiting to be issued                     */
+    GQueue *delayed;           /**< minio_upload_t * waiting to be retried, by retry_at order */
+    GThread **threads;         /**< the upload threads                                        */
+    S3RequestContext **contexts; /**< one request context per upload thread                 */
+    guint nb_threads;          /**< number of upload threads                                  */
+    guint max_in_flight;       /**< maximum number of uploads queued or running at once       */
+    guint pending;             /**< number of uploads queued or running                       */
+    GHashTable *pending_keys;  /**< hash strings whose blocks are being uploaded -> count     */
+    GMutex mutex;              /**< protects delayed, pending, pending_keys and stop          */
+    GCond cond;                /**< signaled each time an upload completes                    */
+    gboolean stop;             /**< tells the upload threads to end                           */
+} minio_upload_pool_t;
+
+
+/**
+ * One object to upload
+ */
+typedef struct minio_upload_t
+{
+    const char *bucket;        /**< bucket to upload into (no free)                           */
+    gchar *key;                /**< key of the object                                         */
+    gchar *pending_key;        /**< hash string registered in pending_keys (may be NULL)      */
+    gchar *buffer;             /**< owned content of the object or NULL                       */
+    hash_data_t *hash_data;    /**< owned block whose data is the content of the object or NULL */
+    minio_pack_t *pack;        /**< sealed pack of the object (the pack or its index) or NULL */
+    const char *data;          /**< content of the object (buffer or hash_data->data)         */
+    guint64 length;            /**< length of data                                            */
+    S3NameValue meta[MINIO_META_COUNT]; /**< x-amz-meta-* headers of the object (owned values) */
+    int meta_count;            /**< number of headers in meta                                 */
+    gboolean spooled;          /**< TRUE when the block has been read from its spool file     */
+    guint retries;             /**< number of times the upload has been retried               */
+    gint64 started;            /**< monotonic time of the first try                           */
+    gint64 retry_at;           /**< monotonic time from which the upload may be retried       */
+    guint *in_flight;          /**< in flight counter of the thread running the upload        */
+    struct minio_backend_t *backend; /**< backend the upload belongs to                       */
+} minio_upload_t;
+
+
+/**
+ * Existence check of a proposed hash in the data bucket
+ */
+typedef struct minio_head_check_t
+{
+    hash_data_t *hash_data;    /**< proposed hash (no free)                                   */
+    gchar *hash_string;        /**< key of the object to look for                             */
+    gboolean exists;           /**< TRUE when the block is in the bucket                      */
+    guint *in_flight;          /**< in flight counter of the checking loop                    */
+} minio_head_check_t;
+
+
+/**
+ * Compression type and uncompressed length of a block as read from the
+ * x-amz-meta-* headers of its data object
+ */
+typedef struct minio_block_meta_t
+{
+    short cmptype;             /**< compression type of the block                             */
+    gssize uncmplen;           /**< uncompressed length of the block                          */
+    guint found;               /**< number of headers found (MINIO_META_COUNT when complete)  */
+} minio_block_meta_t;
+
+
+/**
+ * Function to call with each hash listed by minio_foreach_stored_hash()
+ */
+typedef struct minio_foreach_t
+{
+    GFunc func;                /**< called with each binary hash                              */
+    gpointer user_data;        /**< second argument of func                                   */
+} minio_foreach_t;
+
+
 /**
  * Stores the properties of the data backend
  * @todo: ggf. die Möglichkeit zum speichern einer externen FileMeta-Speichermethode (READ & WRITE)?
@@ -45,6 +176,27 @@ typedef struct minio_backend_t
     const char *bucketname_data;
     const char *bucketname_filemeta;
     bool add_missing_bucket;
+    guint upload_contexts;                /**< number of upload threads and request contexts            */
+    guint max_in_flight;                  /**< maximum number of uploads queued or running at once      */
+    GMutex buckets_mutex;                 /**< protects active_bucket_data                              */
+    const char *active_bucket_data;       /**< validated bucket used for data, NULL to validate again   */
+    minio_upload_pool_t *upload_pool;     /**< uploads data objects concurrently                        */
+    const char *index_file;               /**< file where the index of the data bucket is saved         */
+    minio_index_t *index;                 /**< hashs known to be in the data bucket                     */
+    guint64 pack_size;                    /**< size of the packs in bytes, 0 when blocks are not packed */
+    const char *pack_staging_dir;         /**< directory where packs are staged until uploaded          */
+    const char *pack_index_file;          /**< file where the pack index is saved                       */
+    guint pack_flush_interval;            /**< seconds after which a pack that is not full is uploaded  */
+    minio_packer_t *packer;               /**< gathers blocks into packs or NULL                        */
+    GThread *pack_flusher;                /**< uploads packs that are not full after a while            */
+    GMutex flusher_mutex;                 /**< protects flusher_stop                                    */
+    GCond flusher_cond;                   /**< signaled to stop pack_flusher                            */
+    gboolean flusher_stop;                /**< tells pack_flusher to end                                */
+    const char *spool_dir;                /**< directory where blocks whose upload failed are spooled   */
+    GThread *spooler;                     /**< uploads spooled blocks again                             */
+    GMutex spooler_mutex;                 /**< protects spooler_stop                                    */
+    GCond spooler_cond;                   /**< signaled to stop spooler                                 */
+    gboolean spooler_stop;                /**< tells spooler to end                                     */
 //    bool initialized;
 //    bool corrupted;
 } minio_backend_t;
@@ -57,10 +209,11 @@ void minio_init_backend(server_struct_t *server_struct);
 
 
 /**
- * Terminates the MinIO backend
- * @param server_struct
+ * Terminates the MinIO backend: every queued upload ends before.
+ * @param backend is the backend_t * structure whose user_data is the
+ *        minio_backend_t * structure of this backend.
  */
-void minio_terminate_backend(server_struct_t *server_struct);
+void minio_terminate_backend(backend_t *backend);
 
 
 /**
@@ -82,10 +235,12 @@ extern GList *minio_build_needed_hash_list(server_struct_t *server_struct, GList
  * @param hash_data is a hash_data_t * structure that contains the hash and
  *        the corresponding data in a binary form and a 'read' field that
  *        contains the number of bytes in 'data' field.
+ * @returns TRUE if the block has been packed or queued for upload,
+ *          FALSE otherwise.
  *
  * @TODO: falls bucket für client nicht verfügbar, bucket erstellen!
  */
-extern void minio_store_data(server_struct_t *server_struct, hash_data_t *hash_data);
+extern gboolean minio_store_data(server_struct_t *server_struct, hash_data_t *hash_data);
 
 
 /**
@@ -100,6 +255,18 @@ extern void minio_store_data(server_struct_t *server_struct, hash_data_t *hash_d
 extern hash_data_t *minio_retrieve_data(server_struct_t *server_struct, gchar *hash_string);
 
 
+/**
+ * Calls func with each hash stored into the data bucket (listed) and
+ * into packs. This may take some time on big buckets.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param func is the function to be called. Its first argument is the
+ *        binary hash (guint8 *) that must not be freed by func.
+ * @param user_data is passed as is to func as its second argument.
+ */
+extern void minio_foreach_stored_hash(server_struct_t *server_struct, GFunc func, gpointer user_data);
+
+
 
 // TODO DELETE
 void putTest();
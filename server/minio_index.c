@@ -0,0 +1,467 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    minio_index.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/minio_index.c
+ *
+ * This file contains the functions of the local index of the blocks
+ * stored in the data bucket of the MinIO backend. It is rebuilt with
+ * MINIO_INDEX_PARTITIONS listings of the bucket running in parallel.
+ */
+
+#include "server.h"
+
+static guint index_hash_func(gconstpointer key);
+static gboolean index_hash_equal(gconstpointer a, gconstpointer b);
+static void insert_hash(minio_index_t *index, guint8 *hash, gboolean copy);
+static bool add_listed_key(const char *key, uint64_t size, void *user_data);
+static gpointer list_partition(gpointer user_data);
+static gpointer rebuild_index(gpointer user_data);
+static gboolean load_index_file(minio_index_t *index);
+static void write_index_file(minio_index_t *index);
+
+
+/**
+ * Hash function of binary hashs: they are SHA256 hashs and thus already
+ * evenly distributed.
+ * @param key is a binary hash (HASH_LEN bytes).
+ * @returns a guint made of the first bytes of the hash.
+ */
+static guint index_hash_func(gconstpointer key)
+{
+    guint h = 0;
+
+    memcpy(&h, key, sizeof(h));
+
+    return h;
+}
+
+
+/**
+ * Tells whether two binary hashs are equal.
+ * @param a is a binary hash (HASH_LEN bytes).
+ * @param b is a binary hash (HASH_LEN bytes).
+ * @returns TRUE if a and b are equal.
+ */
+static gboolean index_hash_equal(gconstpointer a, gconstpointer b)
+{
+    return (memcmp(a, b, HASH_LEN) == 0);
+}
+
+
+/**
+ * Inserts a hash in the keys of the index. The mutex of the index must be
+ * held.
+ * @param index is the index.
+ * @param hash is a binary hash (HASH_LEN bytes).
+ * @param copy tells whether hash has to be copied (FALSE: the index owns
+ *        hash from now on).
+ */
+static void insert_hash(minio_index_t *index, guint8 *hash, gboolean copy)
+{
+    if (g_hash_table_contains(index->keys, hash) == FALSE)
+        {
+            if (copy == TRUE)
+                {
+                    hash = g_memdup(hash, HASH_LEN);
+                }
+
+            g_hash_table_add(index->keys, hash);
+        }
+    else if (copy == FALSE)
+        {
+            g_free(hash);
+        }
+}
+
+
+/**
+ * Tells whether a key of the data bucket is the key of a block: keys of
+ * blocks are their hashs in hexadecimal format.
+ * @param key is the key to test.
+ * @returns TRUE if key is the key of a block.
+ */
+gboolean minio_is_hash_key(const char *key)
+{
+    gsize i = 0;
+
+    if (key == NULL || strlen(key) != HASH_LEN * 2)
+        {
+            return FALSE;
+        }
+
+    for (i = 0; i < HASH_LEN * 2; i++)
+        {
+            if (g_ascii_isxdigit(key[i]) == FALSE)
+                {
+                    return FALSE;
+                }
+        }
+
+    return TRUE;
+}
+
+
+/**
+ * Keeps the hash of a listed key. Used as a list_key_callback.
+ * @param key is the listed key.
+ * @param size is the size of the object (unused).
+ * @param user_data is the minio_index_partition_t * partition being listed.
+ * @returns false to abort the listing when the index is being freed.
+ */
+static bool add_listed_key(const char *key, uint64_t size, void *user_data)
+{
+    minio_index_partition_t *partition = user_data;
+    gboolean stop = FALSE;
+
+    (void) size;
+
+    if (minio_is_hash_key(key) == TRUE)
+        {
+            g_ptr_array_add(partition->hashs, string_to_hash((gchar *) key));
+        }
+
+    g_mutex_lock(&partition->index->mutex);
+    stop = partition->index->stop;
+    g_mutex_unlock(&partition->index->mutex);
+
+    return (stop == FALSE);
+}
+
+
+/**
+ * Thread listing the keys of the bucket that begin with the prefix of its
+ * partition.
+ * @param user_data is the minio_index_partition_t * partition to list.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer list_partition(gpointer user_data)
+{
+    minio_index_partition_t *partition = user_data;
+
+    partition->success = list_bucket_keys(partition->index->bucket, partition->prefix, add_listed_key, partition);
+
+    return NULL;
+}
+
+
+/**
+ * Thread rebuilding the index: lists the bucket with MINIO_INDEX_PARTITIONS
+ * threads, one per first hexadecimal digit of the keys, and saves the
+ * index when every listing succeeded.
+ * @param user_data is the minio_index_t * index to rebuild.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer rebuild_index(gpointer user_data)
+{
+    minio_index_t *index = user_data;
+    minio_index_partition_t partitions[MINIO_INDEX_PARTITIONS];
+    GThread *threads[MINIO_INDEX_PARTITIONS];
+    gboolean success = TRUE;
+    guint count = 0;
+    guint i = 0;
+    guint j = 0;
+    gint64 start = g_get_monotonic_time();
+
+    for (i = 0; i < MINIO_INDEX_PARTITIONS; i++)
+        {
+            partitions[i].index = index;
+            partitions[i].prefix[0] = "0123456789abcdef"[i];
+            partitions[i].prefix[1] = '\0';
+            partitions[i].hashs = g_ptr_array_new();
+            partitions[i].success = FALSE;
+            threads[i] = g_thread_new("minio-index", list_partition, &partitions[i]);
+        }
+
+    for (i = 0; i < MINIO_INDEX_PARTITIONS; i++)
+        {
+            g_thread_join(threads[i]);
+            success = success && partitions[i].success;
+        }
+
+    g_mutex_lock(&index->mutex);
+
+    /* What has been listed is in the bucket even if the listing is incomplete */
+    for (i = 0; i < MINIO_INDEX_PARTITIONS; i++)
+        {
+            for (j = 0; j < partitions[i].hashs->len; j++)
+                {
+                    insert_hash(index, g_ptr_array_index(partitions[i].hashs, j), FALSE);
+                }
+            count = count + partitions[i].hashs->len;
+            g_ptr_array_free(partitions[i].hashs, TRUE);
+        }
+
+    if (success == TRUE && index->stop == FALSE)
+        {
+            write_index_file(index);
+            index->complete = TRUE;
+        }
+
+    g_mutex_unlock(&index->mutex);
+
+    if (success == TRUE)
+        {
+            print_debug(_("MinIO index of bucket %s rebuilt: %u blocks listed in %" G_GINT64_FORMAT " ms\n"), index->bucket, count, (g_get_monotonic_time() - start) / 1000);
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: MinIO index of bucket %s could not be rebuilt: blocks will be looked for in the bucket\n"), index->bucket);
+        }
+
+    return NULL;
+}
+
+
+/**
+ * Loads the index file in the keys of the index. A truncated last hash
+ * (crash while appending) is ignored and removed from the file so that
+ * new hashs are appended at their place.
+ * @param index is the index (its filename must be set).
+ * @returns TRUE if the file has been read (and can be appended to).
+ */
+static gboolean load_index_file(minio_index_t *index)
+{
+    gchar *contents = NULL;
+    gsize len = 0;
+    gsize i = 0;
+    gboolean loaded = FALSE;
+
+    if (g_file_get_contents(index->filename, &contents, &len, NULL) == TRUE)
+        {
+            for (i = 0; i + HASH_LEN <= len; i = i + HASH_LEN)
+                {
+                    insert_hash(index, (guint8 *) contents + i, TRUE);
+                }
+
+            free_variable(contents);
+
+            loaded = (len % HASH_LEN == 0 || truncate(index->filename, len - len % HASH_LEN) == 0);
+
+            if (loaded == FALSE)
+                {
+                    /* the index is rebuilt and its file written again */
+                    print_error(__FILE__, __LINE__, _("Error: unable to remove the truncated last hash of MinIO index %s: %s\n"), index->filename, g_strerror(errno));
+                    g_hash_table_remove_all(index->keys);
+                }
+        }
+
+    return loaded;
+}
+
+
+/**
+ * Writes every key of the index in a temporary file that then replaces the
+ * index file and opens it to append new hashs. The mutex of the index must
+ * be held.
+ * @param index is the index.
+ */
+static void write_index_file(minio_index_t *index)
+{
+    gchar *dirname = NULL;
+    gchar *filename_tmp = NULL;
+    FILE *file = NULL;
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gboolean written = TRUE;
+
+    if (index->filename != NULL)
+        {
+            dirname = g_path_get_dirname(index->filename);
+            filename_tmp = g_strdup_printf("%s.tmp", index->filename);
+
+            if (g_mkdir_with_parents(dirname, 0700) != 0)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while creating directory %s: %s\n"), dirname, g_strerror(errno));
+                }
+
+            file = fopen(filename_tmp, "wb");
+
+            if (file != NULL)
+                {
+                    g_hash_table_iter_init(&iter, index->keys);
+
+                    while (written == TRUE && g_hash_table_iter_next(&iter, &key, NULL) == TRUE)
+                        {
+                            written = (fwrite(key, HASH_LEN, 1, file) == 1);
+                        }
+
+                    written = (fclose(file) == 0) && written;
+
+                    if (written == TRUE && g_rename(filename_tmp, index->filename) == 0)
+                        {
+                            index->file = fopen(index->filename, "ab");
+                        }
+                    else
+                        {
+                            g_unlink(filename_tmp);
+                        }
+                }
+
+            if (index->file == NULL)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unable to save MinIO index in %s: %s\n"), index->filename, g_strerror(errno));
+                }
+
+            free_variable(filename_tmp);
+            free_variable(dirname);
+        }
+}
+
+
+/**
+ * Creates the index of @param bucket. Loads it from @param filename when
+ * this file exists and starts rebuilding it in the background otherwise.
+ * @param filename is the file where the index is saved (may be NULL: the
+ *        index is then rebuilt at each start).
+ * @param bucket is the data bucket to index.
+ * @returns a newly allocated minio_index_t * structure that may be freed
+ *          with free_minio_index_t().
+ */
+minio_index_t *new_minio_index_t(const gchar *filename, const gchar *bucket)
+{
+    minio_index_t *index = NULL;
+
+    index = (minio_index_t *) g_malloc0(sizeof(minio_index_t));
+
+    index->keys = g_hash_table_new_full(index_hash_func, index_hash_equal, g_free, NULL);
+    g_mutex_init(&index->mutex);
+    index->complete = FALSE;
+    index->filename = g_strdup(filename);
+    index->file = NULL;
+    index->bucket = g_strdup(bucket);
+    index->rebuild = NULL;
+    index->stop = FALSE;
+
+    if (index->filename != NULL && load_index_file(index) == TRUE)
+        {
+            index->file = fopen(index->filename, "ab");
+            index->complete = TRUE;
+            print_debug(_("MinIO index loaded from %s: %u blocks\n"), index->filename, g_hash_table_size(index->keys));
+        }
+    else
+        {
+            index->rebuild = g_thread_new("minio-index-rebuild", rebuild_index, index);
+        }
+
+    return index;
+}
+
+
+/**
+ * Stops the rebuild if any, closes the index file and frees the index.
+ * @param index is the index to be freed.
+ */
+void free_minio_index_t(minio_index_t *index)
+{
+    if (index != NULL)
+        {
+            if (index->rebuild != NULL)
+                {
+                    g_mutex_lock(&index->mutex);
+                    index->stop = TRUE;
+                    g_mutex_unlock(&index->mutex);
+
+                    g_thread_join(index->rebuild);
+                }
+
+            if (index->file != NULL)
+                {
+                    fclose(index->file);
+                }
+
+            g_hash_table_destroy(index->keys);
+            g_mutex_clear(&index->mutex);
+            free_variable(index->filename);
+            free_variable(index->bucket);
+            g_free(index);
+        }
+}
+
+
+/**
+ * Tells whether @param hash is known to be in the bucket.
+ * @param index is the index.
+ * @param hash is a binary hash (HASH_LEN bytes).
+ * @returns TRUE if the hash is in the index.
+ */
+gboolean minio_index_contains(minio_index_t *index, guint8 *hash)
+{
+    gboolean found = FALSE;
+
+    if (index != NULL && hash != NULL)
+        {
+            g_mutex_lock(&index->mutex);
+            found = g_hash_table_contains(index->keys, hash);
+            g_mutex_unlock(&index->mutex);
+        }
+
+    return found;
+}
+
+
+/**
+ * Tells whether the index contains every block of the bucket. When it
+ * does, a hash that is not in the index is not in the bucket.
+ * @param index is the index.
+ * @returns TRUE if the index is complete.
+ */
+gboolean minio_index_is_complete(minio_index_t *index)
+{
+    gboolean complete = FALSE;
+
+    if (index != NULL)
+        {
+            g_mutex_lock(&index->mutex);
+            complete = index->complete;
+            g_mutex_unlock(&index->mutex);
+        }
+
+    return complete;
+}
+
+
+/**
+ * Adds @param hash to the index and appends it to the index file.
+ * @param index is the index.
+ * @param hash is a binary hash (HASH_LEN bytes) of a block that is now in
+ *        the bucket. It is copied.
+ */
+void minio_index_add(minio_index_t *index, guint8 *hash)
+{
+    if (index != NULL && hash != NULL)
+        {
+            g_mutex_lock(&index->mutex);
+
+            if (g_hash_table_contains(index->keys, hash) == FALSE)
+                {
+                    insert_hash(index, hash, TRUE);
+
+                    /* While rebuilding there is no file yet: the hash is saved with the whole index */
+                    if (index->file != NULL && (fwrite(hash, HASH_LEN, 1, index->file) != 1 || fflush(index->file) != 0))
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to append to MinIO index %s: %s\n"), index->filename, g_strerror(errno));
+                        }
+                }
+
+            g_mutex_unlock(&index->mutex);
+        }
+}
@@ -0,0 +1,134 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    minio_index.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/minio_index.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the local index of the blocks stored in the data bucket of the MinIO
+ * backend. It answers needed hash lists without asking MinIO for each
+ * hash.
+ */
+#ifndef _SERVER_MINIO_INDEX_H_
+#define _SERVER_MINIO_INDEX_H_
+
+/**
+ * @def MINIO_INDEX_PARTITIONS
+ * Number of parallel listings used to rebuild the index: one per first
+ * hexadecimal digit of the keys.
+ */
+#define MINIO_INDEX_PARTITIONS (16)
+
+
+/**
+ * @struct minio_index_t
+ * @brief Set of the hashs known to be stored in the data bucket.
+ *
+ * The index is saved in a local file made of binary hashs (HASH_LEN bytes
+ * each). Hashs of newly stored blocks are appended to it. When the file
+ * does not exist the index is rebuilt in the background by listing the
+ * bucket. Until then (complete is FALSE) hashs that are not in the index
+ * still have to be looked for in the bucket. Removing the file forces a
+ * rebuild at the next start (needed if blocks were removed from the
+ * bucket by something else than the server).
+ */
+typedef struct
+{
+    GHashTable *keys;   /**< binary hashs (guint8 *) known to be in the bucket   */
+    GMutex mutex;       /**< protects keys, complete, file and stop               */
+    gboolean complete;  /**< TRUE when keys contains every block of the bucket    */
+    gchar *filename;    /**< file where the index is saved (may be NULL)          */
+    FILE *file;         /**< filename opened to append new hashs or NULL          */
+    gchar *bucket;      /**< the indexed data bucket                              */
+    GThread *rebuild;   /**< thread rebuilding the index or NULL                  */
+    gboolean stop;      /**< tells the rebuilding thread to give up               */
+} minio_index_t;
+
+
+/**
+ * @struct minio_index_partition_t
+ * @brief One of the parallel listings of a rebuild.
+ */
+typedef struct
+{
+    minio_index_t *index;  /**< the index being rebuilt                           */
+    gchar prefix[2];       /**< first hexadecimal digit of the listed keys         */
+    GPtrArray *hashs;      /**< binary hashs (guint8 *) listed in this partition   */
+    gboolean success;      /**< TRUE when the whole partition has been listed      */
+} minio_index_partition_t;
+
+
+/**
+ * Creates the index of @param bucket. Loads it from @param filename when
+ * this file exists and starts rebuilding it in the background otherwise.
+ * @param filename is the file where the index is saved (may be NULL: the
+ *        index is then rebuilt at each start).
+ * @param bucket is the data bucket to index.
+ * @returns a newly allocated minio_index_t * structure that may be freed
+ *          with free_minio_index_t().
+ */
+extern minio_index_t *new_minio_index_t(const gchar *filename, const gchar *bucket);
+
+
+/**
+ * Stops the rebuild if any, closes the index file and frees the index.
+ * @param index is the index to be freed.
+ */
+extern void free_minio_index_t(minio_index_t *index);
+
+
+/**
+ * Tells whether @param hash is known to be in the bucket.
+ * @param index is the index.
+ * @param hash is a binary hash (HASH_LEN bytes).
+ * @returns TRUE if the hash is in the index.
+ */
+extern gboolean minio_index_contains(minio_index_t *index, guint8 *hash);
+
+
+/**
+ * Tells whether the index contains every block of the bucket. When it
+ * does, a hash that is not in the index is not in the bucket.
+ * @param index is the index.
+ * @returns TRUE if the index is complete.
+ */
+extern gboolean minio_index_is_complete(minio_index_t *index);
+
+
+/**
+ * Adds @param hash to the index and appends it to the index file.
+ * @param index is the index.
+ * @param hash is a binary hash (HASH_LEN bytes) of a block that is now in
+ *        the bucket. It is copied.
+ */
+extern void minio_index_add(minio_index_t *index, guint8 *hash);
+
+
+/**
+ * Tells whether a key of the data bucket is the key of a block: keys of
+ * blocks are their hashs in hexadecimal format.
+ * @param key is the key to test.
+ * @returns TRUE if key is the key of a block.
+ */
+extern gboolean minio_is_hash_key(const char *key);
+
+
+#endif /* #ifndef _SERVER_MINIO_INDEX_H_ */
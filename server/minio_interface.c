@@ -1447,6 +1447,132 @@ static void list_bucket(const char *bucketName, const char *prefix,
 }
 
 
+// list bucket keys ----------------------------------------------------------
+
+typedef struct list_bucket_keys_data
+{
+    int isTruncated;
+    char nextMarker[1024];
+    S3Status status;
+    list_key_callback *callback;
+    void *userData;
+} list_bucket_keys_data;
+
+
+static S3Status listBucketKeysCallback(int isTruncated, const char *nextMarker,
+                                       int contentsCount,
+                                       const S3ListBucketContent *contents,
+                                       int commonPrefixesCount,
+                                       const char **commonPrefixes,
+                                       void *callbackData)
+{
+    list_bucket_keys_data *data = (list_bucket_keys_data *) callbackData;
+    int i;
+
+    (void) commonPrefixesCount;
+    (void) commonPrefixes;
+
+    data->isTruncated = isTruncated;
+    // S3 doesn't return the NextMarker if there is no delimiter (see
+    // listBucketCallback)
+    if ((!nextMarker || !nextMarker[0]) && contentsCount)
+    {
+        nextMarker = contents[contentsCount - 1].key;
+    }
+    if (nextMarker)
+    {
+        snprintf(data->nextMarker, sizeof(data->nextMarker), "%s",
+                 nextMarker);
+    } else
+    {
+        data->nextMarker[0] = 0;
+    }
+
+    for (i = 0; i < contentsCount; i++)
+    {
+        if (!data->callback(contents[i].key, contents[i].size, data->userData))
+        {
+            return S3StatusAbortedByCallback;
+        }
+    }
+
+    return S3StatusOK;
+}
+
+
+static void listBucketKeysCompleteCallback(S3Status status,
+                                           const S3ErrorDetails *error,
+                                           void *callbackData)
+{
+    list_bucket_keys_data *data = (list_bucket_keys_data *) callbackData;
+
+    (void) error;
+
+    data->status = status;
+}
+
+
+/**
+ * Lists every key of @param bucketName that begins with @param prefix,
+ * page after page. The status is kept per call so that several listings
+ * (of different prefixes for instance) can run in parallel threads.
+ * @param callback is called for each key with the key, the size of the
+ *        object and @param userData. The listing stops when it returns
+ *        false.
+ * @return true if the whole listing succeeded
+ */
+bool list_bucket_keys(const char *bucketName, const char *prefix,
+                      list_key_callback *callback, void *userData)
+{
+    int retries;
+
+    S3BucketContext bucketContext =
+            {
+                    0,
+                    bucketName,
+                    protocolG,
+                    uriStyleG,
+                    accessKeyIdG,
+                    secretAccessKeyG,
+                    0,
+                    awsRegionG
+            };
+
+    S3ListBucketHandler listBucketHandler =
+            {
+                    {&responsePropertiesCallback, &listBucketKeysCompleteCallback},
+                    &listBucketKeysCallback
+            };
+
+    list_bucket_keys_data data;
+
+    data.nextMarker[0] = 0;
+    data.callback = callback;
+    data.userData = userData;
+
+    do
+    {
+        data.isTruncated = 0;
+        retries = retriesG;
+        do
+        {
+            data.status = S3StatusOK;
+            S3_list_bucket(&bucketContext, prefix, data.nextMarker,
+                           0, 0, 0, timeoutMsG, &listBucketHandler, &data);
+        } while (S3_status_is_retryable(data.status) && retries-- > 0);
+        if (data.status != S3StatusOK)
+        {
+            fprintf(stderr, "Failed to list bucket %s (prefix %s): %s\n",
+                    bucketName, prefix ? prefix : "",
+                    S3_get_status_name(data.status));
+            return false;
+        }
+    } while (data.isTruncated);
+
+    return true;
+}
+
+
 static void list(int argc, char **argv, int optindex)
 {
     if (optindex == argc)
@@ -2710,6 +2836,202 @@ void put_object(const char *targetBucket, const char *targetKey, const char *dat
 }
 
 
+// put object in a request context -------------------------------------------
+
+typedef struct put_object_context_data
+{
+    const char *data;
+    uint64_t remaining;
+    request_done_callback *done;
+    void *userData;
+} put_object_context_data;
+
+
+static int putObjectContextDataCallback(int bufferSize, char *buffer,
+                                        void *callbackData)
+{
+    put_object_context_data *data = (put_object_context_data *) callbackData;
+    int toCopy = 0;
+
+    if (data->remaining)
+    {
+        toCopy = ((data->remaining > (unsigned) bufferSize) ?
+                  bufferSize : (int) data->remaining);
+        memcpy(buffer, data->data, toCopy);
+        data->data += toCopy;
+        data->remaining -= toCopy;
+    }
+
+    return toCopy;
+}
+
+
+static void putObjectContextCompleteCallback(S3Status status,
+                                             const S3ErrorDetails *error,
+                                             void *callbackData)
+{
+    put_object_context_data *data = (put_object_context_data *) callbackData;
+
+    (void) error;
+
+    if (status == S3StatusOK && data->remaining)
+    {
+        status = S3StatusAbortedByCallback;
+    }
+
+    data->done(status, data->userData);
+    free(data);
+}
+
+
+/**
+ * Creates a new request context in which requests run concurrently.
+ * A request context must only be used by one thread at a time.
+ * @return the new context or NULL on error
+ */
+S3RequestContext *new_request_context(void)
+{
+    S3RequestContext *context = NULL;
+    S3Status status;
+
+    if ((status = S3_create_request_context(&context)) != S3StatusOK)
+    {
+        fprintf(stderr, "Failed to create request context: %s\n",
+                S3_get_status_name(status));
+        return NULL;
+    }
+
+    return context;
+}
+
+
+/**
+ * Destroys a request context created by new_request_context(). Requests
+ * still running in it are aborted.
+ * @param context the context to destroy (may be NULL)
+ */
+void free_request_context(S3RequestContext *context)
+{
+    if (context != NULL)
+    {
+        S3_destroy_request_context(context);
+    }
+}
+
+
+/**
+ * Adds to @param context the upload of @param length bytes of
+ * @param dataToWrite (which may contain '\0' bytes) as object
+ * @param targetKey in @param targetBucket. Nothing is sent before
+ * run_request_context() is called. dataToWrite, targetBucket and
+ * targetKey must stay allocated until @param done has been called with
+ * the final status of the request and @param userData.
+ * @param metaCount is the number of x-amz-meta-* headers in @param meta
+ *        (0 and NULL when no meta data is needed).
+ */
+void put_object_in_context(S3RequestContext *context, const char *targetBucket,
+                           const char *targetKey, const char *dataToWrite,
+                           uint64_t length, int metaCount,
+                           const S3NameValue *meta,
+                           request_done_callback *done, void *userData)
+{
+    put_object_context_data *data;
+
+    S3BucketContext bucketContext =
+            {
+                    0,
+                    targetBucket,
+                    protocolG,
+                    uriStyleG,
+                    accessKeyIdG,
+                    secretAccessKeyG,
+                    0,
+                    awsRegionG
+            };
+
+    S3PutProperties putProperties =
+            {
+                    0,
+                    0,
+                    0,
+                    0,
+                    0,
+                    -1,
+                    S3CannedAclPrivate,
+                    metaCount,
+                    meta,
+                    0
+            };
+
+    S3PutObjectHandler putObjectHandler =
+            {
+                    {&responsePropertiesCallback, &putObjectContextCompleteCallback},
+                    &putObjectContextDataCallback
+            };
+
+    data = (put_object_context_data *) malloc(sizeof(put_object_context_data));
+    data->data = dataToWrite;
+    data->remaining = length;
+    data->done = done;
+    data->userData = userData;
+
+    S3_put_object(&bucketContext, targetKey, length, &putProperties, context,
+                  timeoutMsG, &putObjectHandler, data);
+}
+
+
+/**
+ * Runs the requests of @param context: sends and receives what can be
+ * without blocking, calls the callbacks of the requests that completed and
+ * waits at most @param maxWaitMs milliseconds for the network.
+ * @return the number of requests still running in the context
+ */
+int run_request_context(S3RequestContext *context, int maxWaitMs)
+{
+    int remaining = 0;
+    int maxFd = -1;
+    int64_t timeout;
+    fd_set readFds, writeFds, exceptFds;
+    struct timeval tv;
+
+    if (S3_runonce_request_context(context, &remaining) != S3StatusOK)
+    {
+        return remaining;
+    }
+
+    if (remaining > 0)
+    {
+        FD_ZERO(&readFds);
+        FD_ZERO(&writeFds);
+        FD_ZERO(&exceptFds);
+
+        if (S3_get_request_context_fdsets(context, &readFds, &writeFds,
+                                          &exceptFds, &maxFd) == S3StatusOK)
+        {
+            timeout = S3_get_request_context_timeout(context);
+            if (timeout < 0 || timeout > maxWaitMs)
+            {
+                timeout = maxWaitMs;
+            }
+
+            tv.tv_sec = timeout / 1000;
+            tv.tv_usec = (timeout % 1000) * 1000;
+
+            if (maxFd >= 0)
+            {
+                select(maxFd + 1, &readFds, &writeFds, &exceptFds, &tv);
+            } else if (timeout > 0)
+            {
+                // curl has nothing to wait for yet: do not spin
+                select(0, NULL, NULL, NULL, &tv);
+            }
+        }
+    }
+
+    return remaining;
+}
+
+
 // copy object ---------------------------------------------------------------
 static S3Status copyListKeyCallback(int isTruncated, const char *nextMarker,
                                     int contentsCount,
@@ -3084,6 +3406,453 @@ char *get_object(const char *targetBucket, const char *sourceKey, size_t *read_s
 }
 
 
+// get object with its meta data ---------------------------------------------
+
+typedef struct get_object_meta_data
+{
+    FILE *outfile;
+    S3Status status;
+    object_meta_callback *meta;
+    void *userData;
+} get_object_meta_data;
+
+
+static S3Status getObjectMetaPropertiesCallback
+        (const S3ResponseProperties *properties, void *callbackData)
+{
+    get_object_meta_data *data = (get_object_meta_data *) callbackData;
+    int i;
+
+    for (i = 0; i < properties->metaDataCount; i++)
+    {
+        data->meta(properties->metaData[i].name,
+                   properties->metaData[i].value, data->userData);
+    }
+
+    return responsePropertiesCallback(properties, 0);
+}
+
+
+static S3Status getObjectMetaDataCallback(int bufferSize, const char *buffer,
+                                          void *callbackData)
+{
+    get_object_meta_data *data = (get_object_meta_data *) callbackData;
+
+    return getObjectDataCallback(bufferSize, buffer, data->outfile);
+}
+
+
+static void getObjectMetaCompleteCallback(S3Status status,
+                                          const S3ErrorDetails *error,
+                                          void *callbackData)
+{
+    get_object_meta_data *data = (get_object_meta_data *) callbackData;
+
+    (void) error;
+
+    data->status = status;
+}
+
+
+static S3Status getObjectNoMetaPropertiesCallback
+        (const S3ResponseProperties *properties, void *callbackData)
+{
+    (void) callbackData;
+
+    return responsePropertiesCallback(properties, 0);
+}
+
+
+/**
+ * Gets @param byteCount bytes from @param startByte of the object
+ * @param sourceKey of @param targetBucket (the whole object when both are
+ * 0) and calls @param meta for its x-amz-meta-* headers when not NULL.
+ * The status is kept per request so it can be called from several
+ * threads.
+ * @return the bytes read (to be freed) or NULL on error.
+ */
+static char *get_object_part(const char *targetBucket, const char *sourceKey,
+                             uint64_t startByte, uint64_t byteCount,
+                             size_t *read_size, object_meta_callback *meta,
+                             void *userData)
+{
+    char *buf = NULL;
+    get_object_meta_data data;
+    int retries = retriesG;
+
+    S3BucketContext bucketContext =
+            {
+                    0,
+                    targetBucket,
+                    protocolG,
+                    uriStyleG,
+                    accessKeyIdG,
+                    secretAccessKeyG,
+                    0,
+                    awsRegionG
+            };
+
+    S3GetObjectHandler getObjectHandler =
+            {
+                    {meta ? &getObjectMetaPropertiesCallback : &getObjectNoMetaPropertiesCallback,
+                     &getObjectMetaCompleteCallback},
+                    &getObjectMetaDataCallback
+            };
+
+    data.meta = meta;
+    data.userData = userData;
+
+    do
+    {
+        free(buf);
+        buf = NULL;
+        data.outfile = open_memstream(&buf, read_size);
+        data.status = S3StatusOK;
+
+        S3_get_object(&bucketContext, sourceKey, 0, startByte, byteCount, 0,
+                      timeoutMsG, &getObjectHandler, &data);
+
+        fclose(data.outfile);
+    } while (S3_status_is_retryable(data.status) && retries-- > 0);
+
+    if (data.status != S3StatusOK)
+    {
+        free(buf);
+        buf = NULL;
+        *read_size = 0;
+    }
+
+    return buf;
+}
+
+
+/**
+ * Gets the object @param sourceKey of @param targetBucket and its
+ * x-amz-meta-* headers with a single request. Unlike get_object() the
+ * status is kept per request so it can be called from several threads.
+ * @param read_size is filled with the number of bytes read.
+ * @param meta is called for each x-amz-meta-* header of the object with
+ *        its name (without the x-amz-meta- prefix), its value and
+ *        @param userData.
+ * @return the content of the object (to be freed) or NULL on error.
+ */
+char *get_object_with_meta(const char *targetBucket, const char *sourceKey,
+                           size_t *read_size, object_meta_callback *meta,
+                           void *userData)
+{
+    return get_object_part(targetBucket, sourceKey, 0, 0, read_size, meta,
+                           userData);
+}
+
+
+/**
+ * Gets @param byteCount bytes from @param startByte of the object
+ * @param sourceKey of @param targetBucket with a ranged GET. Can be called
+ * from several threads.
+ * @param read_size is filled with the number of bytes read.
+ * @return the bytes read (to be freed) or NULL on error.
+ */
+char *get_object_range(const char *targetBucket, const char *sourceKey,
+                       uint64_t startByte, uint64_t byteCount,
+                       size_t *read_size)
+{
+    return get_object_part(targetBucket, sourceKey, startByte, byteCount,
+                           read_size, 0, 0);
+}
+
+
+// put object with concurrent multipart upload -------------------------------
+
+#define MULTIPART_PART_XML_SIZE 256
+
+typedef struct multipart_request_data
+{
+    S3Status status;
+    char *uploadId;
+    const char *xml;
+    int remaining;
+} multipart_request_data;
+
+
+typedef struct multipart_part_context_data
+{
+    const char *data;
+    uint64_t remaining;
+    char *etag;
+    S3Status status;
+    int *inFlight;
+} multipart_part_context_data;
+
+
+static S3Status multipartInitialContextCallback(const char *upload_id,
+                                                void *callbackData)
+{
+    multipart_request_data *data = (multipart_request_data *) callbackData;
+
+    data->uploadId = strdup(upload_id);
+
+    return S3StatusOK;
+}
+
+
+static void multipartRequestCompleteCallback(S3Status status,
+                                             const S3ErrorDetails *error,
+                                             void *callbackData)
+{
+    multipart_request_data *data = (multipart_request_data *) callbackData;
+
+    (void) error;
+
+    data->status = status;
+}
+
+
+static int multipartCommitXmlCallback(int bufferSize, char *buffer,
+                                      void *callbackData)
+{
+    multipart_request_data *data = (multipart_request_data *) callbackData;
+    int toCopy = 0;
+
+    if (data->remaining)
+    {
+        toCopy = ((data->remaining > bufferSize) ?
+                  bufferSize : data->remaining);
+        memcpy(buffer, data->xml, toCopy);
+        data->xml += toCopy;
+        data->remaining -= toCopy;
+    }
+
+    return toCopy;
+}
+
+
+static S3Status multipartPartPropertiesCallback
+        (const S3ResponseProperties *properties, void *callbackData)
+{
+    multipart_part_context_data *part =
+            (multipart_part_context_data *) callbackData;
+
+    if (properties->eTag)
+    {
+        free(part->etag);
+        part->etag = strdup(properties->eTag);
+    }
+
+    return responsePropertiesCallback(properties, 0);
+}
+
+
+static int multipartPartDataCallback(int bufferSize, char *buffer,
+                                     void *callbackData)
+{
+    multipart_part_context_data *part =
+            (multipart_part_context_data *) callbackData;
+    int toCopy = 0;
+
+    if (part->remaining)
+    {
+        toCopy = ((part->remaining > (unsigned) bufferSize) ?
+                  bufferSize : (int) part->remaining);
+        memcpy(buffer, part->data, toCopy);
+        part->data += toCopy;
+        part->remaining -= toCopy;
+    }
+
+    return toCopy;
+}
+
+
+static void multipartPartCompleteCallback(S3Status status,
+                                          const S3ErrorDetails *error,
+                                          void *callbackData)
+{
+    multipart_part_context_data *part =
+            (multipart_part_context_data *) callbackData;
+
+    (void) error;
+
+    part->status = status;
+    (*part->inFlight)--;
+}
+
+
+static void multipartAbortCompleteCallback(S3Status status,
+                                           const S3ErrorDetails *error,
+                                           void *callbackData)
+{
+    (void) status;
+    (void) error;
+    (void) callbackData;
+}
+
+
+/**
+ * Puts @param length bytes of @param dataToWrite as object @param targetKey
+ * of @param targetBucket with a multipart upload: parts of @param partSize
+ * bytes (at least 5 MB for S3) are uploaded concurrently, at most
+ * @param maxInFlight at once, in a request context of their own. The
+ * upload is aborted if a part fails. Blocks until the upload is complete
+ * and can be called from several threads.
+ * @return the status of the upload (S3StatusOK on success)
+ */
+S3Status put_object_multipart(const char *targetBucket, const char *targetKey,
+                              const char *dataToWrite, uint64_t length,
+                              uint64_t partSize, int maxInFlight)
+{
+    S3RequestContext *context = NULL;
+    multipart_request_data request;
+    multipart_part_context_data *parts = NULL;
+    S3Status status = S3StatusOK;
+    char *xml = NULL;
+    int totalSeq = (int) ((length + partSize - 1) / partSize);
+    int inFlight = 0;
+    int size = 0;
+    int seq = 0;
+    int i;
+
+    S3BucketContext bucketContext =
+            {
+                    0,
+                    targetBucket,
+                    protocolG,
+                    uriStyleG,
+                    accessKeyIdG,
+                    secretAccessKeyG,
+                    0,
+                    awsRegionG
+            };
+
+    S3PutProperties putProperties =
+            {
+                    0, 0, 0, 0, 0, -1, S3CannedAclPrivate, 0, 0, 0
+            };
+
+    S3MultipartInitialHandler initialHandler =
+            {
+                    {&responsePropertiesCallback, &multipartRequestCompleteCallback},
+                    &multipartInitialContextCallback
+            };
+
+    S3PutObjectHandler partHandler =
+            {
+                    {&multipartPartPropertiesCallback, &multipartPartCompleteCallback},
+                    &multipartPartDataCallback
+            };
+
+    S3MultipartCommitHandler commitHandler =
+            {
+                    {&responsePropertiesCallback, &multipartRequestCompleteCallback},
+                    &multipartCommitXmlCallback,
+                    0
+            };
+
+    S3AbortMultipartUploadHandler abortHandler =
+            {
+                    {&responsePropertiesCallback, &multipartAbortCompleteCallback},
+            };
+
+    memset(&request, 0, sizeof(multipart_request_data));
+
+    S3_initiate_multipart(&bucketContext, targetKey, &putProperties,
+                          &initialHandler, 0, timeoutMsG, &request);
+
+    if (request.status != S3StatusOK || !request.uploadId)
+    {
+        free(request.uploadId);
+        return (request.status != S3StatusOK) ? request.status
+                                              : S3StatusInternalError;
+    }
+
+    if (!(context = new_request_context()))
+    {
+        status = S3StatusInternalError;
+    } else
+    {
+        parts = (multipart_part_context_data *)
+                calloc(totalSeq, sizeof(multipart_part_context_data));
+
+        while ((seq < totalSeq || inFlight > 0) && status == S3StatusOK)
+        {
+            while (seq < totalSeq && inFlight < maxInFlight)
+            {
+                parts[seq].data = dataToWrite + (uint64_t) seq * partSize;
+                parts[seq].remaining = ((length - (uint64_t) seq * partSize) > partSize) ?
+                                       partSize : (length - (uint64_t) seq * partSize);
+                parts[seq].status = S3StatusOK;
+                parts[seq].inFlight = &inFlight;
+                inFlight++;
+                S3_upload_part(&bucketContext, targetKey, &putProperties,
+                               &partHandler, seq + 1, request.uploadId,
+                               (int) parts[seq].remaining, context,
+                               timeoutMsG, &parts[seq]);
+                seq++;
+            }
+
+            if (inFlight > 0)
+            {
+                run_request_context(context, 50);
+            }
+
+            for (i = 0; i < seq && status == S3StatusOK; i++)
+            {
+                status = parts[i].status;
+            }
+        }
+
+        // a failed part aborts the others
+        free_request_context(context);
+
+        for (i = 0; i < totalSeq && status == S3StatusOK; i++)
+        {
+            if (!parts[i].etag)
+            {
+                status = S3StatusInternalError;
+            }
+        }
+    }
+
+    if (status == S3StatusOK)
+    {
+        // each <Part> element fits in MULTIPART_PART_XML_SIZE bytes
+        xml = (char *) malloc(64 + totalSeq * MULTIPART_PART_XML_SIZE);
+        size = sprintf(xml, "<CompleteMultipartUpload>");
+        for (i = 0; i < totalSeq; i++)
+        {
+            size += snprintf(xml + size, MULTIPART_PART_XML_SIZE,
+                             "<Part><PartNumber>%d</PartNumber>"
+                             "<ETag>%s</ETag></Part>", i + 1, parts[i].etag);
+        }
+        size += sprintf(xml + size, "</CompleteMultipartUpload>");
+
+        request.xml = xml;
+        request.remaining = size;
+        S3_complete_multipart_upload(&bucketContext, targetKey,
+                                     &commitHandler, request.uploadId,
+                                     size, 0, timeoutMsG, &request);
+        free(xml);
+        status = request.status;
+    }
+
+    if (status != S3StatusOK)
+    {
+        S3_abort_multipart_upload(&bucketContext, targetKey, request.uploadId,
+                                  timeoutMsG, &abortHandler);
+    }
+
+    if (parts)
+    {
+        for (i = 0; i < totalSeq; i++)
+        {
+            free(parts[i].etag);
+        }
+        free(parts);
+    }
+    free(request.uploadId);
+
+    return status;
+}
+
+
 // head object ---------------------------------------------------------------
 
 /**
@@ -3133,6 +3902,68 @@ bool head_object(const char *bucket, const char *key)
 }
 
 
+// head object in a request context ------------------------------------------
+
+typedef struct head_object_context_data
+{
+    request_done_callback *done;
+    void *userData;
+} head_object_context_data;
+
+
+static void headObjectContextCompleteCallback(S3Status status,
+                                              const S3ErrorDetails *error,
+                                              void *callbackData)
+{
+    head_object_context_data *data = (head_object_context_data *) callbackData;
+
+    (void) error;
+
+    data->done(status, data->userData);
+    free(data);
+}
+
+
+/**
+ * Adds to @param context a HEAD request of @param key in @param bucket.
+ * Nothing is sent before run_request_context() is called. bucket and key
+ * must stay allocated until @param done has been called with
+ * @param userData and the final status of the request (S3StatusOK when
+ * the object exists).
+ */
+void head_object_in_context(S3RequestContext *context, const char *bucket,
+                            const char *key, request_done_callback *done,
+                            void *userData)
+{
+    head_object_context_data *data;
+
+    S3BucketContext bucketContext =
+            {
+                    0,
+                    bucket,
+                    protocolG,
+                    uriStyleG,
+                    accessKeyIdG,
+                    secretAccessKeyG,
+                    0,
+                    awsRegionG
+            };
+
+    S3ResponseHandler responseHandler =
+            {
+                    &responsePropertiesCallback,
+                    &headObjectContextCompleteCallback
+            };
+
+    data = (head_object_context_data *) malloc(sizeof(head_object_context_data));
+    data->done = done;
+    data->userData = userData;
+
+    S3_head_object(&bucketContext, key, context, timeoutMsG, &responseHandler,
+                   data);
+}
+
+
 // generate query string ------------------------------------------------------
 
 static void generate_query_string(int argc, char **argv, int optindex)
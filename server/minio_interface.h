@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
@@ -29,4 +30,54 @@ extern bool head_object(const char *bucket, const char *key);
 extern void put_object(const char *targetBucket, const char *targetKey, const char *dataToWrite);
 extern char *get_object(const char *targetBucket, const char *sourceKey, size_t *read_size);
 
+/**
+ * Called once a request added to a request context has completed
+ * @param status is the final status of the request
+ * @param userData is the pointer given when adding the request
+ */
+typedef void (request_done_callback)(S3Status status, void *userData);
+
+/**
+ * Called for each key listed by list_bucket_keys()
+ * @param key is the key of the object
+ * @param size is the size of the object
+ * @param userData is the pointer given to list_bucket_keys()
+ * @return false to abort the listing
+ */
+typedef bool (list_key_callback)(const char *key, uint64_t size, void *userData);
+
+extern bool list_bucket_keys(const char *bucketName, const char *prefix,
+                             list_key_callback *callback, void *userData);
+
+/**
+ * Called for each x-amz-meta-* header of an object read by
+ * get_object_with_meta()
+ * @param name is the name of the header without its x-amz-meta- prefix
+ * @param value is the value of the header
+ * @param userData is the pointer given to get_object_with_meta()
+ */
+typedef void (object_meta_callback)(const char *name, const char *value, void *userData);
+
+extern char *get_object_with_meta(const char *targetBucket, const char *sourceKey,
+                                  size_t *read_size, object_meta_callback *meta,
+                                  void *userData);
+extern char *get_object_range(const char *targetBucket, const char *sourceKey,
+                              uint64_t startByte, uint64_t byteCount,
+                              size_t *read_size);
+extern S3Status put_object_multipart(const char *targetBucket, const char *targetKey,
+                                     const char *dataToWrite, uint64_t length,
+                                     uint64_t partSize, int maxInFlight);
+
+extern S3RequestContext *new_request_context(void);
+extern void free_request_context(S3RequestContext *context);
+extern void put_object_in_context(S3RequestContext *context, const char *targetBucket,
+                                  const char *targetKey, const char *dataToWrite,
+                                  uint64_t length, int metaCount,
+                                  const S3NameValue *meta,
+                                  request_done_callback *done, void *userData);
+extern void head_object_in_context(S3RequestContext *context, const char *bucket,
+                                   const char *key, request_done_callback *done,
+                                   void *userData);
+extern int run_request_context(S3RequestContext *context, int maxWaitMs);
+
 #endif //MINIOTEST_MINIO_INTERFACE_H
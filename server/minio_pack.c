@@ -0,0 +1,1192 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    minio_pack.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/minio_pack.c
+ *
+ * This file contains the functions of the packing mode of the MinIO
+ * backend. Blocks are appended to a pack that is staged in memory and in a
+ * staging file until it reaches the configured size. It is then sealed and
+ * uploaded as one object along with an index object listing its blocks.
+ * The local pack index maps each hash to its pack, offset and length so
+ * that a block is retrieved with a single ranged GET.
+ */
+
+#include "server.h"
+
+static guint pack_hash_func(gconstpointer key);
+static gboolean pack_hash_equal(gconstpointer a, gconstpointer b);
+static void write_entry(guint8 *buffer, minio_pack_entry_t *entry);
+static void read_entry(const guint8 *buffer, minio_pack_entry_t *entry);
+static gboolean insert_entry(minio_packer_t *packer, minio_pack_entry_t *entry);
+static minio_pack_t *new_pack(minio_packer_t *packer, guint64 id);
+static void free_pack(minio_pack_t *pack);
+static void read_pack_records(minio_pack_t *pack, GPtrArray *entries);
+static void read_entries(const gchar *contents, gsize len, GPtrArray *entries);
+static gboolean load_index_file(minio_packer_t *packer);
+static void write_index_file(minio_packer_t *packer);
+static bool add_listed_pack_key(const char *key, uint64_t size, void *user_data);
+static gpointer read_partition(gpointer user_data);
+static minio_pack_t *seal_current_pack(minio_packer_t *packer);
+static void release_pack_data(minio_pack_t *pack);
+static gboolean reload_pack_data(minio_pack_t *pack);
+static guchar *read_staged_block(minio_pack_t *pack, minio_pack_entry_t *entry);
+
+
+/**
+ * Hash function of binary hashs: they are SHA256 hashs and thus already
+ * evenly distributed.
+ * @param key is a binary hash (HASH_LEN bytes).
+ * @returns a guint made of the first bytes of the hash.
+ */
+static guint pack_hash_func(gconstpointer key)
+{
+    guint h = 0;
+
+    memcpy(&h, key, sizeof(h));
+
+    return h;
+}
+
+
+/**
+ * Tells whether two binary hashs are equal.
+ * @param a is a binary hash (HASH_LEN bytes).
+ * @param b is a binary hash (HASH_LEN bytes).
+ * @returns TRUE if a and b are equal.
+ */
+static gboolean pack_hash_equal(gconstpointer a, gconstpointer b)
+{
+    return (memcmp(a, b, HASH_LEN) == 0);
+}
+
+
+/**
+ * Serializes an entry.
+ * @param buffer is where to write the entry (MINIO_PACK_ENTRY_LEN bytes).
+ * @param entry is the entry to serialize.
+ */
+static void write_entry(guint8 *buffer, minio_pack_entry_t *entry)
+{
+    guint64 u64 = 0;
+    guint16 u16 = 0;
+
+    memcpy(buffer, entry->hash, HASH_LEN);
+    buffer = buffer + HASH_LEN;
+
+    u64 = GUINT64_TO_LE(entry->pack);
+    memcpy(buffer, &u64, 8);
+    u64 = GUINT64_TO_LE(entry->offset);
+    memcpy(buffer + 8, &u64, 8);
+    u64 = GUINT64_TO_LE(entry->length);
+    memcpy(buffer + 16, &u64, 8);
+    u64 = GUINT64_TO_LE((guint64) entry->uncmplen);
+    memcpy(buffer + 24, &u64, 8);
+    u16 = GUINT16_TO_LE((guint16) entry->cmptype);
+    memcpy(buffer + 32, &u16, 2);
+}
+
+
+/**
+ * Reads a serialized entry.
+ * @param buffer is the serialized entry (MINIO_PACK_ENTRY_LEN bytes).
+ * @param entry is filled with the entry.
+ */
+static void read_entry(const guint8 *buffer, minio_pack_entry_t *entry)
+{
+    guint64 u64 = 0;
+    guint16 u16 = 0;
+
+    memcpy(entry->hash, buffer, HASH_LEN);
+    buffer = buffer + HASH_LEN;
+
+    memcpy(&u64, buffer, 8);
+    entry->pack = GUINT64_FROM_LE(u64);
+    memcpy(&u64, buffer + 8, 8);
+    entry->offset = GUINT64_FROM_LE(u64);
+    memcpy(&u64, buffer + 16, 8);
+    entry->length = GUINT64_FROM_LE(u64);
+    memcpy(&u64, buffer + 24, 8);
+    entry->uncmplen = (gint64) GUINT64_FROM_LE(u64);
+    memcpy(&u16, buffer + 32, 2);
+    entry->cmptype = (gint16) GUINT16_FROM_LE(u16);
+}
+
+
+/**
+ * Inserts an entry in the pack index. The mutex of the packer must be held.
+ * @param packer is the packer.
+ * @param entry is the entry to insert: the packer owns it from now on.
+ * @returns TRUE if the entry has been inserted and FALSE if the block was
+ *          already packed (entry is then freed).
+ */
+static gboolean insert_entry(minio_packer_t *packer, minio_pack_entry_t *entry)
+{
+    if (g_hash_table_contains(packer->entries, entry->hash) == FALSE)
+        {
+            g_hash_table_insert(packer->entries, entry->hash, entry);
+
+            return TRUE;
+        }
+    else
+        {
+            g_free(entry);
+
+            return FALSE;
+        }
+}
+
+
+/**
+ * Creates an empty pack.
+ * @param packer is the packer (for its staging directory).
+ * @param id is the id of the pack.
+ * @returns a newly allocated minio_pack_t * structure that may be freed
+ *          with free_pack().
+ */
+static minio_pack_t *new_pack(minio_packer_t *packer, guint64 id)
+{
+    minio_pack_t *pack = NULL;
+    gchar *basename = NULL;
+
+    pack = (minio_pack_t *) g_malloc0(sizeof(minio_pack_t));
+
+    basename = g_strdup_printf("%016" G_GINT64_MODIFIER "x" MINIO_PACK_STAGING_SUFFIX, id);
+
+    pack->id = id;
+    pack->key = minio_pack_key(id);
+    pack->filename = g_build_filename(packer->staging_dir, basename, NULL);
+    pack->file = NULL;
+    pack->data = g_byte_array_new();
+    pack->entries = g_ptr_array_new();
+    pack->created = g_get_monotonic_time();
+
+    free_variable(basename);
+
+    return pack;
+}
+
+
+/**
+ * Frees a pack (its entries belong to the packer and are not freed).
+ * @param pack is the pack to be freed.
+ */
+static void free_pack(minio_pack_t *pack)
+{
+    if (pack != NULL)
+        {
+            if (pack->file != NULL)
+                {
+                    fclose(pack->file);
+                }
+
+            free_variable(pack->key);
+            free_variable(pack->filename);
+            g_byte_array_free(pack->data, TRUE);
+            g_ptr_array_free(pack->entries, TRUE);
+            g_free(pack);
+        }
+}
+
+
+/**
+ * Reads the records (serialized entry followed by the data of the block)
+ * of the data of a pack read from its staging file. A truncated last
+ * record (crash while appending) is removed from the data.
+ * @param pack is the pack whose data has been read.
+ * @param entries is filled with the newly allocated entries of the records.
+ */
+static void read_pack_records(minio_pack_t *pack, GPtrArray *entries)
+{
+    minio_pack_entry_t *entry = NULL;
+    guint64 offset = 0;
+
+    while (offset + MINIO_PACK_ENTRY_LEN <= pack->data->len)
+        {
+            entry = (minio_pack_entry_t *) g_malloc0(sizeof(minio_pack_entry_t));
+            read_entry(pack->data->data + offset, entry);
+
+            if (entry->pack != pack->id || entry->offset != offset + MINIO_PACK_ENTRY_LEN || entry->length > pack->data->len - entry->offset)
+                {
+                    g_free(entry);
+                    break;
+                }
+
+            g_ptr_array_add(entries, entry);
+            offset = entry->offset + entry->length;
+        }
+
+    g_byte_array_set_size(pack->data, offset);
+}
+
+
+/**
+ * Reads serialized entries. A truncated last entry is ignored.
+ * @param contents is the serialized entries.
+ * @param len is the length of contents.
+ * @param entries is filled with the newly allocated entries.
+ */
+static void read_entries(const gchar *contents, gsize len, GPtrArray *entries)
+{
+    minio_pack_entry_t *entry = NULL;
+    gsize i = 0;
+
+    for (i = 0; i + MINIO_PACK_ENTRY_LEN <= len; i = i + MINIO_PACK_ENTRY_LEN)
+        {
+            entry = (minio_pack_entry_t *) g_malloc0(sizeof(minio_pack_entry_t));
+            read_entry((const guint8 *) contents + i, entry);
+            g_ptr_array_add(entries, entry);
+        }
+}
+
+
+/**
+ * Loads the local pack index file in the entries of the packer. A
+ * truncated last entry (crash while appending) is ignored and removed
+ * from the file so that new entries are appended at their place.
+ * @param packer is the packer.
+ * @returns TRUE if the file has been read (and can be appended to).
+ */
+static gboolean load_index_file(minio_packer_t *packer)
+{
+    GPtrArray *entries = NULL;
+    gchar *contents = NULL;
+    gsize len = 0;
+    guint i = 0;
+    gboolean loaded = FALSE;
+
+    if (g_file_get_contents(packer->index_filename, &contents, &len, NULL) == TRUE)
+        {
+            entries = g_ptr_array_new();
+            read_entries(contents, len, entries);
+
+            for (i = 0; i < entries->len; i++)
+                {
+                    insert_entry(packer, g_ptr_array_index(entries, i));
+                }
+
+            g_ptr_array_free(entries, TRUE);
+            free_variable(contents);
+
+            loaded = (len % MINIO_PACK_ENTRY_LEN == 0 || truncate(packer->index_filename, len - len % MINIO_PACK_ENTRY_LEN) == 0);
+
+            if (loaded == FALSE)
+                {
+                    /* the pack index is rebuilt and its file written again */
+                    print_error(__FILE__, __LINE__, _("Error: unable to remove the truncated last entry of MinIO pack index %s: %s\n"), packer->index_filename, g_strerror(errno));
+                    g_hash_table_remove_all(packer->entries);
+                }
+        }
+
+    return loaded;
+}
+
+
+/**
+ * Writes every entry of packs already uploaded in a temporary file that
+ * then replaces the local pack index file and opens it to append new
+ * entries. The mutex of the packer must be held.
+ * @param packer is the packer.
+ */
+static void write_index_file(minio_packer_t *packer)
+{
+    gchar *dirname = NULL;
+    gchar *filename_tmp = NULL;
+    FILE *file = NULL;
+    GHashTableIter iter;
+    gpointer value = NULL;
+    minio_pack_entry_t *entry = NULL;
+    guint8 buffer[MINIO_PACK_ENTRY_LEN];
+    gboolean written = TRUE;
+
+    if (packer->index_file != NULL)
+        {
+            fclose(packer->index_file);
+            packer->index_file = NULL;
+        }
+
+    dirname = g_path_get_dirname(packer->index_filename);
+    filename_tmp = g_strdup_printf("%s.tmp", packer->index_filename);
+
+    if (g_mkdir_with_parents(dirname, 0700) != 0)
+        {
+            print_error(__FILE__, __LINE__, _("Error while creating directory %s: %s\n"), dirname, g_strerror(errno));
+        }
+
+    file = fopen(filename_tmp, "wb");
+
+    if (file != NULL)
+        {
+            g_hash_table_iter_init(&iter, packer->entries);
+
+            while (written == TRUE && g_hash_table_iter_next(&iter, NULL, &value) == TRUE)
+                {
+                    entry = value;
+
+                    /* staged blocks are saved when their pack is uploaded */
+                    if (g_hash_table_contains(packer->staged, &entry->pack) == FALSE)
+                        {
+                            write_entry(buffer, entry);
+                            written = (fwrite(buffer, MINIO_PACK_ENTRY_LEN, 1, file) == 1);
+                        }
+                }
+
+            written = (fclose(file) == 0) && written;
+
+            if (written == TRUE && g_rename(filename_tmp, packer->index_filename) == 0)
+                {
+                    packer->index_file = fopen(packer->index_filename, "ab");
+                }
+            else
+                {
+                    g_unlink(filename_tmp);
+                }
+        }
+
+    if (packer->index_file == NULL)
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to save MinIO pack index in %s: %s\n"), packer->index_filename, g_strerror(errno));
+        }
+
+    free_variable(filename_tmp);
+    free_variable(dirname);
+}
+
+
+/**
+ * Keeps a listed key of the pack prefix. Used as a list_key_callback.
+ * @param key is the listed key.
+ * @param size is the size of the object (unused).
+ * @param user_data is the minio_pack_partition_t * partition being listed.
+ * @returns true to go on with the listing.
+ */
+static bool add_listed_pack_key(const char *key, uint64_t size, void *user_data)
+{
+    minio_pack_partition_t *partition = user_data;
+
+    (void) size;
+
+    g_hash_table_add(partition->keys, g_strdup(key));
+
+    return true;
+}
+
+
+/**
+ * Thread listing the pack objects whose id begins with the digit of its
+ * partition and reading the index objects of the packs that are in the
+ * bucket (an index object without its pack is from an interrupted
+ * upload).
+ * @param user_data is the minio_pack_partition_t * partition to read.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer read_partition(gpointer user_data)
+{
+    minio_pack_partition_t *partition = user_data;
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gchar *packname = NULL;
+    gchar *contents = NULL;
+    size_t len = 0;
+
+    partition->success = list_bucket_keys(partition->bucket, partition->prefix, add_listed_pack_key, partition);
+
+    g_hash_table_iter_init(&iter, partition->keys);
+
+    while (partition->success == TRUE && g_hash_table_iter_next(&iter, &key, NULL) == TRUE)
+        {
+            if (g_str_has_suffix(key, MINIO_PACK_INDEX_SUFFIX) == TRUE)
+                {
+                    packname = g_strndup(key, strlen(key) - strlen(MINIO_PACK_INDEX_SUFFIX));
+
+                    if (g_hash_table_contains(partition->keys, packname) == TRUE)
+                        {
+                            contents = get_object_range(partition->bucket, key, 0, 0, &len);
+
+                            if (contents != NULL)
+                                {
+                                    read_entries(contents, len, partition->entries);
+                                    free(contents);
+                                }
+                            else
+                                {
+                                    partition->success = FALSE;
+                                }
+                        }
+
+                    free_variable(packname);
+                }
+        }
+
+    return NULL;
+}
+
+
+/**
+ * Seals the pack being filled: closes its staging file and counts it as
+ * waiting to be uploaded. The mutex of the packer must be held.
+ * @param packer is the packer.
+ * @returns the sealed pack or NULL if there is none.
+ */
+static minio_pack_t *seal_current_pack(minio_packer_t *packer)
+{
+    minio_pack_t *pack = packer->current;
+
+    if (pack != NULL)
+        {
+            if (pack->file != NULL)
+                {
+                    fclose(pack->file);
+                    pack->file = NULL;
+                }
+
+            pack->length = pack->data->len;
+            packer->current = NULL;
+            packer->uploading = packer->uploading + 1;
+        }
+
+    return pack;
+}
+
+
+/**
+ * Drops the content of a pack whose upload failed from memory when its
+ * staging file holds all of it (it is kept in memory otherwise).
+ * @param pack is the sealed pack.
+ */
+static void release_pack_data(minio_pack_t *pack)
+{
+    GStatBuf stat_buf;
+
+    if (g_stat(pack->filename, &stat_buf) == 0 && (guint64) stat_buf.st_size >= pack->length)
+        {
+            g_byte_array_free(pack->data, TRUE);
+            pack->data = g_byte_array_new();
+        }
+}
+
+
+/**
+ * Reads back the content of a pack from its staging file when it has been
+ * dropped from memory.
+ * @param pack is the sealed pack.
+ * @returns TRUE if the content of the pack is in memory.
+ */
+static gboolean reload_pack_data(minio_pack_t *pack)
+{
+    gchar *contents = NULL;
+    gsize len = 0;
+
+    if (pack->data->len == pack->length)
+        {
+            return TRUE;
+        }
+
+    if (g_file_get_contents(pack->filename, &contents, &len, NULL) == FALSE || len < pack->length)
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to read MinIO pack staging file %s\n"), pack->filename);
+            free_variable(contents);
+
+            return FALSE;
+        }
+
+    g_byte_array_append(pack->data, (guint8 *) contents, pack->length);
+    free_variable(contents);
+
+    return TRUE;
+}
+
+
+/**
+ * Reads the data of a block from the staging file of its pack.
+ * @param pack is the pack whose content has been dropped from memory.
+ * @param entry is the entry of the block.
+ * @returns the newly allocated data of the block or NULL on error.
+ */
+static guchar *read_staged_block(minio_pack_t *pack, minio_pack_entry_t *entry)
+{
+    guchar *data = NULL;
+    FILE *file = NULL;
+
+    file = fopen(pack->filename, "rb");
+    data = (guchar *) g_malloc(entry->length + 1);
+
+    if (file == NULL || fseek(file, entry->offset, SEEK_SET) != 0 || fread(data, 1, entry->length, file) != entry->length)
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to read MinIO pack staging file %s\n"), pack->filename);
+            free_variable(data);
+        }
+
+    if (file != NULL)
+        {
+            fclose(file);
+        }
+
+    return data;
+}
+
+
+/**
+ * Creates a packer and loads the local pack index file if it exists.
+ * @param pack_size is the size from which a pack is sealed.
+ * @param staging_dir is the directory of the staging files (created if
+ *        needed).
+ * @param index_filename is the local pack index file.
+ * @returns a newly allocated minio_packer_t * structure that may be
+ *          freed with free_minio_packer_t() or NULL if the staging
+ *          directory can not be created.
+ */
+minio_packer_t *new_minio_packer_t(guint64 pack_size, const gchar *staging_dir, const gchar *index_filename)
+{
+    minio_packer_t *packer = NULL;
+
+    if (staging_dir == NULL || index_filename == NULL || g_mkdir_with_parents(staging_dir, 0700) != 0)
+        {
+            print_error(__FILE__, __LINE__, _("Error while creating directory %s: %s\n"), staging_dir, g_strerror(errno));
+
+            return NULL;
+        }
+
+    packer = (minio_packer_t *) g_malloc0(sizeof(minio_packer_t));
+
+    packer->entries = g_hash_table_new_full(pack_hash_func, pack_hash_equal, NULL, g_free);
+    packer->staged = g_hash_table_new(g_int64_hash, g_int64_equal);
+    g_mutex_init(&packer->mutex);
+    g_cond_init(&packer->cond);
+    packer->pack_size = pack_size;
+    packer->staging_dir = g_strdup(staging_dir);
+    packer->index_filename = g_strdup(index_filename);
+    packer->index_file = NULL;
+    packer->current = NULL;
+    packer->uploading = 0;
+
+    if (load_index_file(packer) == TRUE)
+        {
+            packer->index_file = fopen(packer->index_filename, "ab");
+            print_debug(_("MinIO pack index loaded from %s: %u blocks\n"), packer->index_filename, g_hash_table_size(packer->entries));
+        }
+
+    return packer;
+}
+
+
+/**
+ * Frees the packer. Staging files of packs not uploaded are kept: they
+ * are uploaded at next start.
+ * @param packer is the packer to be freed.
+ */
+void free_minio_packer_t(minio_packer_t *packer)
+{
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    if (packer != NULL)
+        {
+            /* the pack being filled is staged too */
+            g_hash_table_iter_init(&iter, packer->staged);
+
+            while (g_hash_table_iter_next(&iter, NULL, &value) == TRUE)
+                {
+                    free_pack(value);
+                }
+
+            if (packer->index_file != NULL)
+                {
+                    fclose(packer->index_file);
+                }
+
+            g_hash_table_destroy(packer->staged);
+            g_hash_table_destroy(packer->entries);
+            g_mutex_clear(&packer->mutex);
+            g_cond_clear(&packer->cond);
+            free_variable(packer->staging_dir);
+            free_variable(packer->index_filename);
+            g_free(packer);
+        }
+}
+
+
+/**
+ * @param id is the id of a pack.
+ * @returns the newly allocated key of the pack object.
+ */
+gchar *minio_pack_key(guint64 id)
+{
+    return g_strdup_printf(MINIO_PACK_PREFIX "%016" G_GINT64_MODIFIER "x", id);
+}
+
+
+/**
+ * Tells whether the local pack index file has been loaded.
+ * @param packer is the packer.
+ * @returns TRUE if the pack index is loaded.
+ */
+gboolean minio_packer_has_index_file(minio_packer_t *packer)
+{
+    gboolean loaded = FALSE;
+
+    if (packer != NULL)
+        {
+            g_mutex_lock(&packer->mutex);
+            loaded = (packer->index_file != NULL);
+            g_mutex_unlock(&packer->mutex);
+        }
+
+    return loaded;
+}
+
+
+/**
+ * Rebuilds the pack index from the index objects of the data bucket
+ * (listed by MINIO_PACK_PREFIX followed by each hexadecimal digit in
+ * parallel) and saves it in the local pack index file.
+ * @param packer is the packer.
+ * @param bucket is the data bucket.
+ * @returns TRUE if the whole bucket has been read.
+ */
+gboolean minio_packer_rebuild_index(minio_packer_t *packer, const gchar *bucket)
+{
+    minio_pack_partition_t partitions[MINIO_INDEX_PARTITIONS];
+    GThread *threads[MINIO_INDEX_PARTITIONS];
+    gboolean success = TRUE;
+    guint count = 0;
+    guint i = 0;
+    guint j = 0;
+    gint64 start = g_get_monotonic_time();
+
+    if (packer == NULL || bucket == NULL)
+        {
+            return FALSE;
+        }
+
+    for (i = 0; i < MINIO_INDEX_PARTITIONS; i++)
+        {
+            partitions[i].bucket = bucket;
+            g_snprintf(partitions[i].prefix, sizeof(partitions[i].prefix), MINIO_PACK_PREFIX "%x", i);
+            partitions[i].keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+            partitions[i].entries = g_ptr_array_new();
+            partitions[i].success = FALSE;
+            threads[i] = g_thread_new("minio-pack-index", read_partition, &partitions[i]);
+        }
+
+    for (i = 0; i < MINIO_INDEX_PARTITIONS; i++)
+        {
+            g_thread_join(threads[i]);
+            success = success && partitions[i].success;
+        }
+
+    g_mutex_lock(&packer->mutex);
+
+    for (i = 0; i < MINIO_INDEX_PARTITIONS; i++)
+        {
+            for (j = 0; j < partitions[i].entries->len; j++)
+                {
+                    if (insert_entry(packer, g_ptr_array_index(partitions[i].entries, j)) == TRUE)
+                        {
+                            count = count + 1;
+                        }
+                }
+
+            g_ptr_array_free(partitions[i].entries, TRUE);
+            g_hash_table_destroy(partitions[i].keys);
+        }
+
+    /* An incomplete index is not saved: it will be rebuilt at next start */
+    if (success == TRUE)
+        {
+            write_index_file(packer);
+        }
+
+    g_mutex_unlock(&packer->mutex);
+
+    if (success == TRUE)
+        {
+            print_debug(_("MinIO pack index of bucket %s rebuilt: %u blocks read in %" G_GINT64_FORMAT " ms\n"), bucket, count, (g_get_monotonic_time() - start) / 1000);
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: MinIO pack index of bucket %s could not be fully rebuilt\n"), bucket);
+        }
+
+    return success;
+}
+
+
+/**
+ * Reads the staging files left by a previous run. Their blocks are
+ * indexed again and their packs have to be uploaded.
+ * @param packer is the packer.
+ * @returns a list of sealed minio_pack_t * packs to be uploaded (the
+ *          list has to be freed, not the packs).
+ */
+GList *minio_packer_recover(minio_packer_t *packer)
+{
+    GList *packs = NULL;
+    GDir *dir = NULL;
+    const gchar *name = NULL;
+    gchar *end = NULL;
+    gchar *contents = NULL;
+    gsize len = 0;
+    guint64 id = 0;
+    minio_pack_t *pack = NULL;
+    minio_pack_entry_t *entry = NULL;
+    minio_pack_entry_t *known = NULL;
+    GPtrArray *entries = NULL;
+    guint i = 0;
+
+    if (packer == NULL || (dir = g_dir_open(packer->staging_dir, 0, NULL)) == NULL)
+        {
+            return NULL;
+        }
+
+    g_mutex_lock(&packer->mutex);
+
+    while ((name = g_dir_read_name(dir)) != NULL)
+        {
+            id = g_ascii_strtoull(name, &end, 16);
+
+            if (end == name || g_strcmp0(end, MINIO_PACK_STAGING_SUFFIX) != 0 || g_hash_table_contains(packer->staged, &id) == TRUE)
+                {
+                    continue;
+                }
+
+            pack = new_pack(packer, id);
+
+            if (g_file_get_contents(pack->filename, &contents, &len, NULL) == FALSE)
+                {
+                    free_pack(pack);
+                    continue;
+                }
+
+            g_byte_array_append(pack->data, (guint8 *) contents, len);
+            free_variable(contents);
+
+            entries = g_ptr_array_new();
+            read_pack_records(pack, entries);
+
+            /* The pack has been uploaded if the index already knows its first block is in it */
+            known = (entries->len > 0) ? g_hash_table_lookup(packer->entries, ((minio_pack_entry_t *) g_ptr_array_index(entries, 0))->hash) : NULL;
+
+            if (entries->len == 0 || (known != NULL && known->pack == id))
+                {
+                    g_ptr_array_foreach(entries, (GFunc) g_free, NULL);
+                    g_unlink(pack->filename);
+                    free_pack(pack);
+                }
+            else
+                {
+                    for (i = 0; i < entries->len; i++)
+                        {
+                            entry = g_ptr_array_index(entries, i);
+
+                            if (insert_entry(packer, entry) == TRUE)
+                                {
+                                    g_ptr_array_add(pack->entries, entry);
+                                }
+                        }
+
+                    pack->length = pack->data->len;
+                    g_hash_table_insert(packer->staged, &pack->id, pack);
+                    packer->uploading = packer->uploading + 1;
+                    packs = g_list_prepend(packs, pack);
+
+                    print_debug(_("MinIO pack %s recovered from %s: %u blocks\n"), pack->key, pack->filename, pack->entries->len);
+                }
+
+            g_ptr_array_free(entries, TRUE);
+        }
+
+    g_mutex_unlock(&packer->mutex);
+
+    g_dir_close(dir);
+
+    return packs;
+}
+
+
+/**
+ * Tells whether a block is packed (staged or uploaded).
+ * @param packer is the packer.
+ * @param hash is a binary hash (HASH_LEN bytes).
+ * @returns TRUE if the block is in a pack.
+ */
+gboolean minio_packer_contains(minio_packer_t *packer, guint8 *hash)
+{
+    gboolean found = FALSE;
+
+    if (packer != NULL && hash != NULL)
+        {
+            g_mutex_lock(&packer->mutex);
+            found = g_hash_table_contains(packer->entries, hash);
+            g_mutex_unlock(&packer->mutex);
+        }
+
+    return found;
+}
+
+
+/**
+ * Adds a block to the pack being filled (a new pack is created when
+ * needed, waiting while MINIO_PACK_MAX_IN_FLIGHT packs are waiting to be
+ * uploaded) and writes it to its staging file.
+ * @param packer is the packer.
+ * @param hash_data is the block to add (it is copied).
+ * @returns the sealed pack to upload when it reached pack_size or NULL.
+ */
+minio_pack_t *minio_packer_add(minio_packer_t *packer, hash_data_t *hash_data)
+{
+    minio_pack_t *pack = NULL;
+    minio_pack_entry_t *entry = NULL;
+    guint8 buffer[MINIO_PACK_ENTRY_LEN];
+
+    if (packer == NULL || hash_data == NULL || hash_data->hash == NULL)
+        {
+            return NULL;
+        }
+
+    g_mutex_lock(&packer->mutex);
+
+    if (g_hash_table_contains(packer->entries, hash_data->hash) == FALSE)
+        {
+            if (packer->current == NULL)
+                {
+                    while (packer->uploading >= MINIO_PACK_MAX_IN_FLIGHT)
+                        {
+                            g_cond_wait(&packer->cond, &packer->mutex);
+                        }
+
+                    packer->current = new_pack(packer, ((guint64) g_random_int() << 32) | g_random_int());
+                    packer->current->file = fopen(packer->current->filename, "wb");
+
+                    if (packer->current->file == NULL)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to create MinIO pack staging file %s: %s\n"), packer->current->filename, g_strerror(errno));
+                        }
+
+                    g_hash_table_insert(packer->staged, &packer->current->id, packer->current);
+                }
+
+            pack = packer->current;
+
+            entry = (minio_pack_entry_t *) g_malloc0(sizeof(minio_pack_entry_t));
+            memcpy(entry->hash, hash_data->hash, HASH_LEN);
+            entry->pack = pack->id;
+            entry->offset = pack->data->len + MINIO_PACK_ENTRY_LEN;
+            entry->length = hash_data->read;
+            entry->uncmplen = hash_data->uncmplen;
+            entry->cmptype = hash_data->cmptype;
+
+            write_entry(buffer, entry);
+            g_byte_array_append(pack->data, buffer, MINIO_PACK_ENTRY_LEN);
+            g_byte_array_append(pack->data, hash_data->data, hash_data->read);
+
+            if (pack->file != NULL && (fwrite(buffer, MINIO_PACK_ENTRY_LEN, 1, pack->file) != 1 || fwrite(hash_data->data, 1, hash_data->read, pack->file) != hash_data->read || fflush(pack->file) != 0))
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unable to append to MinIO pack staging file %s: %s\n"), pack->filename, g_strerror(errno));
+                }
+
+            insert_entry(packer, entry);
+            g_ptr_array_add(pack->entries, entry);
+
+            if (pack->data->len >= packer->pack_size)
+                {
+                    pack = seal_current_pack(packer);
+                }
+            else
+                {
+                    pack = NULL;
+                }
+        }
+
+    g_mutex_unlock(&packer->mutex);
+
+    return pack;
+}
+
+
+/**
+ * Seals the pack being filled if it contains blocks added at least
+ * @param age microseconds ago (0 seals it whatever its age).
+ * @param packer is the packer.
+ * @returns the sealed pack to upload or NULL.
+ */
+minio_pack_t *minio_packer_seal(minio_packer_t *packer, gint64 age)
+{
+    minio_pack_t *pack = NULL;
+
+    if (packer != NULL)
+        {
+            g_mutex_lock(&packer->mutex);
+
+            if (packer->current != NULL && g_get_monotonic_time() - packer->current->created >= age)
+                {
+                    pack = seal_current_pack(packer);
+                }
+
+            g_mutex_unlock(&packer->mutex);
+        }
+
+    return pack;
+}
+
+
+/**
+ * Tells where a packed block is. A block whose pack is not uploaded yet
+ * is copied from the pack in memory (or from its staging file when its
+ * upload failed).
+ * @param packer is the packer.
+ * @param hash is a binary hash (HASH_LEN bytes).
+ * @param entry is filled with the entry of the block.
+ * @param data is filled with a copy of the data of the block when its pack
+ *        is not uploaded yet (NULL otherwise).
+ * @returns TRUE if the block is in a pack.
+ */
+gboolean minio_packer_lookup(minio_packer_t *packer, guint8 *hash, minio_pack_entry_t *entry, guchar **data)
+{
+    minio_pack_entry_t *found = NULL;
+    minio_pack_t *pack = NULL;
+
+    *data = NULL;
+
+    if (packer == NULL || hash == NULL)
+        {
+            return FALSE;
+        }
+
+    g_mutex_lock(&packer->mutex);
+
+    found = g_hash_table_lookup(packer->entries, hash);
+
+    if (found != NULL)
+        {
+            *entry = *found;
+            pack = g_hash_table_lookup(packer->staged, &found->pack);
+
+            if (pack != NULL && pack->data->len == 0 && pack->length > 0)
+                {
+                    *data = read_staged_block(pack, found);
+                }
+            else if (pack != NULL)
+                {
+                    *data = g_memdup(pack->data->data + found->offset, found->length);
+                }
+        }
+
+    g_mutex_unlock(&packer->mutex);
+
+    return (found != NULL);
+}
+
+
+/**
+ * Calls @param func with the binary hash of each packed block (staged or
+ * uploaded). Hashs are copied first so that func runs without the lock.
+ * @param packer is the packer.
+ * @param func is called with the binary hash (that must not be freed)
+ *        and @param user_data.
+ */
+void minio_packer_foreach(minio_packer_t *packer, GFunc func, gpointer user_data)
+{
+    GByteArray *hashs = NULL;
+    GHashTableIter iter;
+    gpointer key = NULL;
+    guint i = 0;
+
+    if (packer != NULL && func != NULL)
+        {
+            hashs = g_byte_array_new();
+
+            g_mutex_lock(&packer->mutex);
+            g_hash_table_iter_init(&iter, packer->entries);
+
+            while (g_hash_table_iter_next(&iter, &key, NULL) == TRUE)
+                {
+                    g_byte_array_append(hashs, key, HASH_LEN);
+                }
+
+            g_mutex_unlock(&packer->mutex);
+
+            for (i = 0; i + HASH_LEN <= hashs->len; i = i + HASH_LEN)
+                {
+                    func(hashs->data + i, user_data);
+                }
+
+            g_byte_array_free(hashs, TRUE);
+        }
+}
+
+
+/**
+ * Serializes the entries of a sealed pack into the content of its index
+ * object.
+ * @param pack is the sealed pack.
+ * @param len is filled with the length of the content.
+ * @returns the newly allocated content.
+ */
+gchar *minio_pack_index_content(minio_pack_t *pack, gsize *len)
+{
+    gchar *content = NULL;
+    guint i = 0;
+
+    *len = pack->entries->len * MINIO_PACK_ENTRY_LEN;
+    content = (gchar *) g_malloc(*len + 1);
+
+    for (i = 0; i < pack->entries->len; i++)
+        {
+            write_entry((guint8 *) content + i * MINIO_PACK_ENTRY_LEN, g_ptr_array_index(pack->entries, i));
+        }
+
+    return content;
+}
+
+
+/**
+ * Starts the upload of a sealed pack.
+ * @param packer is the packer.
+ * @param pack is the sealed pack.
+ * @param objects is the number of objects of the pack to upload (the pack
+ *        and its index): minio_packer_uploaded() is called once for each.
+ */
+void minio_packer_uploading(minio_packer_t *packer, minio_pack_t *pack, guint objects)
+{
+    if (packer != NULL && pack != NULL)
+        {
+            g_mutex_lock(&packer->mutex);
+
+            pack->uploads = objects;
+            pack->failed = FALSE;
+            pack->retry_at = 0;
+
+            g_mutex_unlock(&packer->mutex);
+        }
+}
+
+
+/**
+ * Ends the upload of one object of a sealed pack. Once every object is
+ * uploaded the entries of the pack are appended to the local pack index
+ * file, its staging file is removed and the pack is freed. When one of
+ * them failed the content of the pack is dropped from memory (its blocks
+ * are read from the staging file) and the pack is returned by
+ * minio_packer_retry() after MINIO_PACK_RETRY_DELAY seconds.
+ * @param packer is the packer.
+ * @param pack is the sealed pack.
+ * @param success tells whether the upload of the object succeeded.
+ */
+void minio_packer_uploaded(minio_packer_t *packer, minio_pack_t *pack, gboolean success)
+{
+    guint8 buffer[MINIO_PACK_ENTRY_LEN];
+    gboolean written = TRUE;
+    guint i = 0;
+
+    if (packer != NULL && pack != NULL)
+        {
+            g_mutex_lock(&packer->mutex);
+
+            if (success == FALSE)
+                {
+                    pack->failed = TRUE;
+                }
+
+            if (pack->uploads > 0)
+                {
+                    pack->uploads = pack->uploads - 1;
+                }
+
+            if (pack->uploads == 0 && pack->failed == FALSE)
+                {
+                    for (i = 0; written == TRUE && packer->index_file != NULL && i < pack->entries->len; i++)
+                        {
+                            write_entry(buffer, g_ptr_array_index(pack->entries, i));
+                            written = (fwrite(buffer, MINIO_PACK_ENTRY_LEN, 1, packer->index_file) == 1);
+                        }
+
+                    if (packer->index_file != NULL && (written == FALSE || fflush(packer->index_file) != 0))
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to append to MinIO pack index %s: %s\n"), packer->index_filename, g_strerror(errno));
+                        }
+
+                    g_hash_table_remove(packer->staged, &pack->id);
+                    g_unlink(pack->filename);
+                    free_pack(pack);
+                }
+            else if (pack->uploads == 0)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: MinIO pack %s not uploaded: it stays in %s and is uploaded again in %d seconds\n"), pack->key, pack->filename, MINIO_PACK_RETRY_DELAY);
+                    release_pack_data(pack);
+                    pack->retry_at = g_get_monotonic_time() + MINIO_PACK_RETRY_DELAY * G_TIME_SPAN_SECOND;
+                }
+
+            if (pack->uploads == 0)
+                {
+                    packer->uploading = packer->uploading - 1;
+                    g_cond_broadcast(&packer->cond);
+                }
+
+            g_mutex_unlock(&packer->mutex);
+        }
+}
+
+
+/**
+ * Gets a pack whose upload failed MINIO_PACK_RETRY_DELAY seconds ago or
+ * more. Its content is read back from its staging file and it is counted
+ * again as waiting to be uploaded.
+ * @param packer is the packer.
+ * @returns the sealed pack to upload again or NULL if there is none.
+ */
+minio_pack_t *minio_packer_retry(minio_packer_t *packer)
+{
+    GHashTableIter iter;
+    gpointer value = NULL;
+    minio_pack_t *pack = NULL;
+    minio_pack_t *found = NULL;
+    gint64 now = g_get_monotonic_time();
+
+    if (packer != NULL)
+        {
+            g_mutex_lock(&packer->mutex);
+            g_hash_table_iter_init(&iter, packer->staged);
+
+            while (found == NULL && g_hash_table_iter_next(&iter, NULL, &value) == TRUE)
+                {
+                    pack = value;
+
+                    if (pack->retry_at != 0 && pack->retry_at <= now)
+                        {
+                            if (reload_pack_data(pack) == TRUE)
+                                {
+                                    pack->retry_at = 0;
+                                    packer->uploading = packer->uploading + 1;
+                                    found = pack;
+                                }
+                            else
+                                {
+                                    pack->retry_at = now + MINIO_PACK_RETRY_DELAY * G_TIME_SPAN_SECOND;
+                                }
+                        }
+                }
+
+            g_mutex_unlock(&packer->mutex);
+        }
+
+    return found;
+}
@@ -0,0 +1,311 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    minio_pack.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/minio_pack.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the packing mode of the MinIO backend: small blocks are gathered into
+ * large pack objects and an index tells where each block is.
+ */
+#ifndef _SERVER_MINIO_PACK_H_
+#define _SERVER_MINIO_PACK_H_
+
+/**
+ * @def MINIO_PACK_PREFIX
+ * Prefix of the keys of pack objects (and of their index objects) in the
+ * data bucket. The prefix is followed by the id of the pack in 16
+ * hexadecimal digits.
+ */
+#define MINIO_PACK_PREFIX "pack/"
+
+/**
+ * @def MINIO_PACK_INDEX_SUFFIX
+ * Suffix of the key of the index object uploaded with each pack. Index
+ * objects are used to rebuild the local pack index.
+ */
+#define MINIO_PACK_INDEX_SUFFIX ".idx"
+
+/**
+ * @def MINIO_PACK_STAGING_SUFFIX
+ * Suffix of the staging files of packs not uploaded yet.
+ */
+#define MINIO_PACK_STAGING_SUFFIX ".pack"
+
+/**
+ * @def MINIO_PACK_PART_SIZE
+ * Packs bigger than this are uploaded with a multipart upload whose parts
+ * (of this size) are sent concurrently.
+ */
+#define MINIO_PACK_PART_SIZE (8 * 1024 * 1024)
+
+/**
+ * @def MINIO_PACK_MAX_IN_FLIGHT
+ * Maximum number of sealed packs waiting to be uploaded: storing blocks
+ * waits when it is reached.
+ */
+#define MINIO_PACK_MAX_IN_FLIGHT (4)
+
+/**
+ * @def MINIO_PACK_RETRY_DELAY
+ * Number of seconds after which a pack whose upload failed is uploaded
+ * again. Meanwhile its blocks are read from its staging file.
+ */
+#define MINIO_PACK_RETRY_DELAY (60)
+
+/**
+ * @def MINIO_PACK_ENTRY_LEN
+ * Length of a serialized entry: hash, pack id, offset, length,
+ * uncompressed length (64 bits little endian) and compression type (16
+ * bits little endian).
+ */
+#define MINIO_PACK_ENTRY_LEN (HASH_LEN + 8 + 8 + 8 + 8 + 2)
+
+
+/**
+ * @struct minio_pack_entry_t
+ * @brief Where a block is: the pack index maps each hash to one entry.
+ *
+ * Serialized entries (MINIO_PACK_ENTRY_LEN bytes each) make the local
+ * pack index file and the index objects. In a pack each block is
+ * preceded by its serialized entry so that staging files can be read
+ * back after a crash.
+ */
+typedef struct
+{
+    guint8 hash[HASH_LEN]; /**< binary hash of the block                       */
+    guint64 pack;          /**< id of the pack that contains the block          */
+    guint64 offset;        /**< offset of the data of the block in the pack     */
+    guint64 length;        /**< length of the data of the block                 */
+    gint64 uncmplen;       /**< uncompressed length of the block                */
+    gint16 cmptype;        /**< compression type of the block                   */
+} minio_pack_entry_t;
+
+
+/**
+ * @struct minio_pack_t
+ * @brief A pack being filled or waiting to be uploaded.
+ */
+typedef struct
+{
+    guint64 id;            /**< random id of the pack                                   */
+    gchar *key;            /**< key of the pack object                                  */
+    gchar *filename;       /**< staging file of the pack                                */
+    FILE *file;            /**< staging file opened for appends while the pack is filled */
+    GByteArray *data;      /**< content of the pack (empty while a failed pack waits)    */
+    guint64 length;        /**< length of the content of the pack once it is sealed      */
+    GPtrArray *entries;    /**< minio_pack_entry_t * of the blocks of the pack (no free) */
+    gint64 created;        /**< monotonic time when the first block was added            */
+    guint uploads;         /**< objects (pack and index) whose upload has not ended      */
+    gboolean failed;       /**< tells whether the upload of one of these objects failed  */
+    gint64 retry_at;       /**< monotonic time from which a failed pack is uploaded again
+                                (0 when its upload did not fail)                         */
+} minio_pack_t;
+
+
+/**
+ * @struct minio_packer_t
+ * @brief Gathers blocks into packs and knows where every packed block is.
+ */
+typedef struct
+{
+    GHashTable *entries;      /**< binary hash -> minio_pack_entry_t * of every packed block */
+    GHashTable *staged;       /**< pack id (guint64 *) -> minio_pack_t * not uploaded yet     */
+    GMutex mutex;             /**< protects every field of the structure                     */
+    GCond cond;               /**< signaled each time an upload of a pack ends               */
+    guint64 pack_size;        /**< size from which a pack is sealed and uploaded             */
+    gchar *staging_dir;       /**< directory of the staging files                            */
+    gchar *index_filename;    /**< local pack index file                                     */
+    FILE *index_file;         /**< index_filename opened for appends or NULL                 */
+    minio_pack_t *current;    /**< pack being filled or NULL                                 */
+    guint uploading;          /**< number of sealed packs whose upload has not ended         */
+} minio_packer_t;
+
+
+/**
+ * @struct minio_pack_partition_t
+ * @brief One of the parallel listings of a rebuild of the pack index.
+ */
+typedef struct
+{
+    const gchar *bucket;   /**< the data bucket                                         */
+    gchar prefix[8];       /**< MINIO_PACK_PREFIX followed by one hexadecimal digit      */
+    GHashTable *keys;      /**< keys listed with this prefix                            */
+    GPtrArray *entries;    /**< minio_pack_entry_t * read from the index objects         */
+    gboolean success;      /**< TRUE when the partition has been listed and read         */
+} minio_pack_partition_t;
+
+
+/**
+ * Creates a packer and loads the local pack index file if it exists.
+ * @param pack_size is the size from which a pack is sealed.
+ * @param staging_dir is the directory of the staging files (created if
+ *        needed).
+ * @param index_filename is the local pack index file.
+ * @returns a newly allocated minio_packer_t * structure that may be
+ *          freed with free_minio_packer_t() or NULL if the staging
+ *          directory can not be created.
+ */
+extern minio_packer_t *new_minio_packer_t(guint64 pack_size, const gchar *staging_dir, const gchar *index_filename);
+
+
+/**
+ * Frees the packer. Staging files of packs not uploaded are kept: they
+ * are uploaded at next start.
+ * @param packer is the packer to be freed.
+ */
+extern void free_minio_packer_t(minio_packer_t *packer);
+
+
+/**
+ * @param id is the id of a pack.
+ * @returns the newly allocated key of the pack object.
+ */
+extern gchar *minio_pack_key(guint64 id);
+
+
+/**
+ * Tells whether the local pack index file has been loaded.
+ * @param packer is the packer.
+ * @returns TRUE if the pack index is loaded.
+ */
+extern gboolean minio_packer_has_index_file(minio_packer_t *packer);
+
+
+/**
+ * Rebuilds the pack index from the index objects of the data bucket
+ * (listed by MINIO_PACK_PREFIX followed by each hexadecimal digit in
+ * parallel) and saves it in the local pack index file.
+ * @param packer is the packer.
+ * @param bucket is the data bucket.
+ * @returns TRUE if the whole bucket has been read.
+ */
+extern gboolean minio_packer_rebuild_index(minio_packer_t *packer, const gchar *bucket);
+
+
+/**
+ * Reads the staging files left by a previous run. Their blocks are
+ * indexed again and their packs have to be uploaded.
+ * @param packer is the packer.
+ * @returns a list of sealed minio_pack_t * packs to be uploaded (the
+ *          list has to be freed, not the packs).
+ */
+extern GList *minio_packer_recover(minio_packer_t *packer);
+
+
+/**
+ * Tells whether a block is packed (staged or uploaded).
+ * @param packer is the packer.
+ * @param hash is a binary hash (HASH_LEN bytes).
+ * @returns TRUE if the block is in a pack.
+ */
+extern gboolean minio_packer_contains(minio_packer_t *packer, guint8 *hash);
+
+
+/**
+ * Adds a block to the pack being filled (a new pack is created when
+ * needed, waiting while MINIO_PACK_MAX_IN_FLIGHT packs are waiting to be
+ * uploaded) and writes it to its staging file.
+ * @param packer is the packer.
+ * @param hash_data is the block to add (it is copied).
+ * @returns the sealed pack to upload when it reached pack_size or NULL.
+ */
+extern minio_pack_t *minio_packer_add(minio_packer_t *packer, hash_data_t *hash_data);
+
+
+/**
+ * Seals the pack being filled if it contains blocks added at least
+ * @param age microseconds ago (0 seals it whatever its age).
+ * @param packer is the packer.
+ * @returns the sealed pack to upload or NULL.
+ */
+extern minio_pack_t *minio_packer_seal(minio_packer_t *packer, gint64 age);
+
+
+/**
+ * Tells where a packed block is. A block whose pack is not uploaded yet
+ * is copied from the pack in memory (or from its staging file when its
+ * upload failed).
+ * @param packer is the packer.
+ * @param hash is a binary hash (HASH_LEN bytes).
+ * @param entry is filled with the entry of the block.
+ * @param data is filled with a copy of the data of the block when its pack
+ *        is not uploaded yet (NULL otherwise).
+ * @returns TRUE if the block is in a pack.
+ */
+extern gboolean minio_packer_lookup(minio_packer_t *packer, guint8 *hash, minio_pack_entry_t *entry, guchar **data);
+
+
+/**
+ * Calls @param func with the binary hash of each packed block (staged or
+ * uploaded).
+ * @param packer is the packer.
+ * @param func is called with the binary hash (that must not be freed)
+ *        and @param user_data.
+ */
+extern void minio_packer_foreach(minio_packer_t *packer, GFunc func, gpointer user_data);
+
+
+/**
+ * Serializes the entries of a sealed pack into the content of its index
+ * object.
+ * @param pack is the sealed pack.
+ * @param len is filled with the length of the content.
+ * @returns the newly allocated content.
+ */
+extern gchar *minio_pack_index_content(minio_pack_t *pack, gsize *len);
+
+
+/**
+ * Starts the upload of a sealed pack.
+ * @param packer is the packer.
+ * @param pack is the sealed pack.
+ * @param objects is the number of objects of the pack to upload (the pack
+ *        and its index): minio_packer_uploaded() is called once for each.
+ */
+extern void minio_packer_uploading(minio_packer_t *packer, minio_pack_t *pack, guint objects);
+
+
+/**
+ * Ends the upload of one object of a sealed pack. Once every object is
+ * uploaded the entries of the pack are appended to the local pack index
+ * file, its staging file is removed and the pack is freed. When one of
+ * them failed the content of the pack is dropped from memory (its blocks
+ * are read from the staging file) and the pack is returned by
+ * minio_packer_retry() after MINIO_PACK_RETRY_DELAY seconds.
+ * @param packer is the packer.
+ * @param pack is the sealed pack.
+ * @param success tells whether the upload of the object succeeded.
+ */
+extern void minio_packer_uploaded(minio_packer_t *packer, minio_pack_t *pack, gboolean success);
+
+
+/**
+ * Gets a pack whose upload failed MINIO_PACK_RETRY_DELAY seconds ago or
+ * more. Its content is read back from its staging file and it is counted
+ * again as waiting to be uploaded.
+ * @param packer is the packer.
+ * @returns the sealed pack to upload again or NULL if there is none.
+ */
+extern minio_pack_t *minio_packer_retry(minio_packer_t *packer);
+
+
+#endif /* #ifndef _SERVER_MINIO_PACK_H_ */
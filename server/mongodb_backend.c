@@ -203,6 +203,7 @@ void mongodb_init_backend(server_struct_t *server_struct)
             mongoc_init();
             mongodb_backend->client = mongoc_client_new(mongodb_backend->connection_string);
             mongoc_client_set_appname(mongodb_backend->client, MONGODB_CLIENT_APPNAME);
+            mongodb_backend->indexed_collections = g_hash_table_new_full(g_str_hash, g_str_equal, free_variable, NULL);
 
             mongodb_print_info("Backend initialized.\n");
         } else
@@ -236,6 +237,12 @@ void mongodb_terminate_backend(backend_t *backend)
     if (backend->user_data != NULL)
     {
         mongodb_backend = (mongodb_backend_t *) backend->user_data;
+        if (mongodb_backend != NULL && mongodb_backend->indexed_collections != NULL)
+        {
+            g_hash_table_destroy(mongodb_backend->indexed_collections);
+            mongodb_backend->indexed_collections = NULL;
+        }
+
         if (mongodb_backend != NULL && mongodb_backend->client != NULL)
         {
             // Destroy client
@@ -393,6 +400,120 @@ void init_meta_bson(bson_t *document, server_meta_data_t *smeta)
 }
 
 
+/**
+ * Creates (once per collection) the indexes used to maintain and to
+ * query the validity intervals of the versions of the files.
+ * @param backend is the mongodb backend structure
+ * @param collection is the collection of the host
+ * @param collection_name is the name of that collection
+ */
+static void create_validity_indexes(mongodb_backend_t *backend, mongoc_collection_t *collection, char *collection_name)
+{
+    bson_t *path_keys;
+    bson_t *validity_keys;
+    bson_t *command;
+    bson_t reply;
+    bson_error_t error;
+    char *path_index_name;
+    char *validity_index_name;
+
+    if (backend->indexed_collections != NULL && !g_hash_table_contains(backend->indexed_collections, collection_name))
+    {
+        path_keys = BCON_NEW(LABEL_NAME, BCON_INT32(1), LABEL_VALID_FROM, BCON_INT32(1));
+        validity_keys = BCON_NEW(LABEL_VALID_TO, BCON_INT32(1), LABEL_VALID_FROM, BCON_INT32(1));
+        path_index_name = mongoc_collection_keys_to_index_string(path_keys);
+        validity_index_name = mongoc_collection_keys_to_index_string(validity_keys);
+
+        command = BCON_NEW("createIndexes", BCON_UTF8(collection_name),
+                           "indexes", "[",
+                           "{", "key", BCON_DOCUMENT(path_keys), "name", BCON_UTF8(path_index_name), "}",
+                           "{", "key", BCON_DOCUMENT(validity_keys), "name", BCON_UTF8(validity_index_name), "}",
+                           "]");
+
+        if (mongoc_collection_write_command_with_opts(collection, command, NULL, &reply, &error))
+        {
+            g_hash_table_add(backend->indexed_collections, g_strdup(collection_name));
+        } else
+        {
+            mongodb_print_error("Error while creating validity indexes on %s: %s\n", collection_name, error.message);
+        }
+
+        bson_destroy(&reply);
+        bson_destroy(command);
+        bson_free(validity_index_name);
+        bson_free(path_index_name);
+        bson_destroy(validity_keys);
+        bson_destroy(path_keys);
+    }
+}
+
+
+/**
+ * Finds when the version of a file that is being inserted stops being
+ * valid: at the modification time of the following version of that file
+ * if a client sent it before this one.
+ * @param collection is the collection of the host
+ * @param meta is the meta data of the version being inserted
+ * @return the valid_from of the following version or BACKEND_VALID_FOREVER
+ */
+static gint64 get_valid_to(mongoc_collection_t *collection, meta_data_t *meta)
+{
+    bson_t *filter;
+    bson_t *opts;
+    mongoc_cursor_t *cursor;
+    const bson_t *doc;
+    bson_iter_t iter;
+    gint64 valid_to = BACKEND_VALID_FOREVER;
+
+    filter = BCON_NEW(LABEL_NAME, BCON_UTF8(meta->name),
+                      LABEL_VALID_FROM, "{", MONGOC_OWN_GREATER_THAN, BCON_INT64((gint64) meta->mtime), "}");
+    opts = BCON_NEW("projection", "{", LABEL_VALID_FROM, BCON_INT32(1), "}",
+                    "sort", "{", LABEL_VALID_FROM, BCON_INT32(1), "}",
+                    "limit", BCON_INT64(1));
+
+    cursor = mongoc_collection_find_with_opts(collection, filter, opts, NULL);
+
+    if (mongoc_cursor_next(cursor, &doc) && bson_iter_init_find(&iter, doc, LABEL_VALID_FROM) &&
+        BSON_ITER_HOLDS_INT64(&iter))
+    {
+        valid_to = bson_iter_int64(&iter);
+    }
+
+    mongoc_cursor_destroy(cursor);
+    bson_destroy(opts);
+    bson_destroy(filter);
+
+    return valid_to;
+}
+
+
+/**
+ * Ends the validity of the version of the file that was valid at the
+ * modification time of the version being inserted.
+ * @param collection is the collection of the host
+ * @param meta is the meta data of the version being inserted
+ */
+static void close_previous_version(mongoc_collection_t *collection, meta_data_t *meta)
+{
+    bson_t *selector;
+    bson_t *update;
+    bson_error_t error;
+
+    selector = BCON_NEW(LABEL_NAME, BCON_UTF8(meta->name),
+                        LABEL_VALID_FROM, "{", MONGOC_OWN_LESS_THAN_EQUAL, BCON_INT64((gint64) meta->mtime), "}",
+                        LABEL_VALID_TO, "{", MONGOC_OWN_GREATER_THAN, BCON_INT64((gint64) meta->mtime), "}");
+    update = BCON_NEW("$set", "{", LABEL_VALID_TO, BCON_INT64((gint64) meta->mtime), "}");
+
+    if (!mongoc_collection_update_many(collection, selector, update, NULL, NULL, &error))
+    {
+        mongodb_print_error("Error while closing previous version of %s: %s\n", meta->name, error.message);
+    }
+
+    bson_destroy(update);
+    bson_destroy(selector);
+}
+
+
 /** Prefix for logging in mongodb_store_smeta-Method */
 #define LOGGING_METHOD_PREFIX_MONGODB_STORE_SMETA ("StoreSMeta")
 
@@ -410,6 +531,7 @@ void mongodb_store_smeta(server_struct_t *server_struct, server_meta_data_t *ser
     bson_oid_t oid;
     mongodb_backend_t *backend;
     char *collection_name;
+    gint64 valid_to;
 
 
     mongodb_print_debug("[%s] Insert data...\n", LOGGING_METHOD_PREFIX_MONGODB_STORE_SMETA);
@@ -427,9 +549,16 @@ void mongodb_store_smeta(server_struct_t *server_struct, server_meta_data_t *ser
                 mongodb_print_verbose("[%s] Using collection:\t%s\n", collection_name,
                                       LOGGING_METHOD_PREFIX_MONGODB_STORE_SMETA);
 
+                // Each version is valid from its mtime until the next version of the same file
+                create_validity_indexes(backend, collection, collection_name);
+                valid_to = get_valid_to(collection, server_meta->meta);
+                close_previous_version(collection, server_meta->meta);
+
                 // Init meta
                 metadata = bson_new();
                 init_meta_bson(metadata, server_meta);
+                BSON_APPEND_INT64(metadata, LABEL_VALID_FROM, (gint64) server_meta->meta->mtime);
+                BSON_APPEND_INT64(metadata, LABEL_VALID_TO, valid_to);
 
                 if (!mongoc_collection_insert_one(collection, metadata, NULL, reply, &error))
                 {
@@ -531,6 +660,47 @@ static void init_search_property_bson(bson_t *out, query_t *query)
             mongodb_print_verbose("- AFTERDATE: %s (UNIX: %d)\n", query->afterdate, afterdate_unix);
         }
 
+        // asof: versions valid at that time. Versions stored without validity interval are
+        // kept when older and filtered afterwards by keep_latests_meta_data_t_in_list()
+        if (query->asof != NULL)
+        {
+            GDateTime *asof_dt;
+            gint64 asof_unix = 0;
+            bson_t *asof_bson;
+
+            asof_dt = convert_gchar_date_to_gdatetime(query->asof);
+            if (asof_dt != NULL)
+            {
+                asof_unix = g_date_time_to_unix(asof_dt);
+                g_date_time_unref(asof_dt);
+            }
+
+            asof_bson = BCON_NEW("$or", "[",
+                                 "{", LABEL_VALID_FROM, "{", MONGOC_OWN_LESS_THAN_EQUAL, BCON_INT64(asof_unix), "}",
+                                 LABEL_VALID_TO, "{", MONGOC_OWN_GREATER_THAN, BCON_INT64(asof_unix), "}", "}",
+                                 "{", LABEL_VALID_TO, "{", "$exists", BCON_BOOL(false), "}",
+                                 LABEL_MTIME, "{", MONGOC_OWN_LESS_THAN_EQUAL, BCON_INT64(asof_unix), "}", "}",
+                                 "]");
+            bson_concat(out, asof_bson);
+            bson_destroy(asof_bson);
+
+            mongodb_print_verbose("- ASOF: %s (UNIX: %" G_GINT64_FORMAT ")\n", query->asof, asof_unix);
+        }
+        else if (latest_are_valid_versions(query))
+        {
+            bson_t *latest_bson;
+
+            // latest: versions still valid (or stored without validity interval)
+            latest_bson = BCON_NEW("$or", "[",
+                                   "{", LABEL_VALID_TO, BCON_INT64(BACKEND_VALID_FOREVER), "}",
+                                   "{", LABEL_VALID_TO, "{", "$exists", BCON_BOOL(false), "}", "}",
+                                   "]");
+            bson_concat(out, latest_bson);
+            bson_destroy(latest_bson);
+
+            mongodb_print_verbose("- LATEST: valid versions\n");
+        }
+
         // owner
         if (query->owner != NULL)
         {
@@ -678,26 +848,213 @@ static meta_data_t *init_meta_data()
 /** Prefix for logging in mongodb_get_list_of_files-Method */
 #define LOGGING_METHOD_PREFIX_MONGODB_GET_LIST_OF_FILES ("GetListOfFiles")
 
+
 /**
- * Searches for files with properties, specified in query_t
+ * Finds the sort key (name, mtime and _id) of the document a cursor
+ * points to. The cursor is the hexadecimal _id of the last document of
+ * the previous page.
+ * @param collection is the collection of the host
+ * @param cursor is the cursor given back by the previous page
+ * @param name is filled with the name of that document (to be freed)
+ * @param mtime is filled with the mtime of that document
+ * @param oid is filled with the _id of that document
+ * @return TRUE if the document has been found, FALSE otherwise
+ */
+static gboolean get_cursor_key(mongoc_collection_t *collection, gchar *cursor, gchar **name, gint64 *mtime, bson_oid_t *oid)
+{
+    mongoc_cursor_t *found;
+    const bson_t *doc;
+    bson_t *filter;
+    bson_t *opts;
+    bson_iter_t iter;
+    gboolean ok = FALSE;
+
+    if (cursor != NULL && bson_oid_is_valid(cursor, strlen(cursor)))
+    {
+        bson_oid_init_from_string(oid, cursor);
+
+        filter = BCON_NEW("_id", BCON_OID(oid));
+        opts = BCON_NEW("projection", "{", LABEL_NAME, BCON_INT32(1), LABEL_MTIME, BCON_INT32(1), "}",
+                        "limit", BCON_INT64(1));
+        found = mongoc_collection_find_with_opts(collection, filter, opts, NULL);
+
+        if (mongoc_cursor_next(found, &doc) &&
+            bson_iter_init_find(&iter, doc, LABEL_NAME) && BSON_ITER_HOLDS_UTF8(&iter))
+        {
+            *name = bson_iter_dup_utf8(&iter, 0);
+            *mtime = 0;
+
+            if (bson_iter_init_find(&iter, doc, LABEL_MTIME) && BSON_ITER_HOLDS_INT64(&iter))
+            {
+                *mtime = bson_iter_int64(&iter);
+            }
+
+            ok = TRUE;
+        }
+
+        mongoc_cursor_destroy(found);
+        bson_destroy(opts);
+        bson_destroy(filter);
+    }
+
+    return ok;
+}
+
+
+/**
+ * Appends to a filter the condition that keeps only the documents sorted
+ * after a key (keyset paging). The condition goes into an "$and" because
+ * the filter may already contain "$or" or name conditions.
+ * @param out is the filter to complete
+ * @param name is the name of the key
+ * @param mtime is the mtime of the key
+ * @param oid is the _id of the key
+ * @param next_name is TRUE to skip every version of that name (used when
+ *        only the latest version of each file is wanted)
+ */
+static void append_after_key_bson(bson_t *out, gchar *name, gint64 mtime, bson_oid_t *oid, gboolean next_name)
+{
+    bson_t *after;
+
+    if (next_name == TRUE)
+    {
+        after = BCON_NEW("$and", "[",
+                         "{", LABEL_NAME, "{", MONGOC_OWN_GREATER_THAN, BCON_UTF8(name), "}", "}",
+                         "]");
+    } else
+    {
+        after = BCON_NEW("$and", "[", "{", "$or", "[",
+                         "{", LABEL_NAME, "{", MONGOC_OWN_GREATER_THAN, BCON_UTF8(name), "}", "}",
+                         "{", LABEL_NAME, BCON_UTF8(name), LABEL_MTIME, "{", MONGOC_OWN_GREATER_THAN, BCON_INT64(mtime), "}", "}",
+                         "{", LABEL_NAME, BCON_UTF8(name), LABEL_MTIME, BCON_INT64(mtime), "_id", "{", MONGOC_OWN_GREATER_THAN, BCON_OID(oid), "}", "}",
+                         "]", "}", "]");
+    }
+
+    bson_concat(out, after);
+    bson_destroy(after);
+}
+
+
+/**
+ * Builds the options of a listing: documents are sorted by name, mtime
+ * and _id and the hash list is left out when not wanted.
+ * @param query the query specification
+ * @param count is the maximum number of documents to read (0 means no limit)
+ * @return a newly allocated bson_t * to be destroyed with bson_destroy()
+ */
+static bson_t *new_list_opts(query_t *query, guint64 count)
+{
+    bson_t *opts;
+    bson_t projection;
+
+    opts = BCON_NEW("sort", "{", LABEL_NAME, BCON_INT32(1), LABEL_MTIME, BCON_INT32(1), "_id", BCON_INT32(1), "}");
+
+    if (count > 0)
+    {
+        BSON_APPEND_INT64(opts, "limit", (gint64) count);
+    }
+
+    if (query->without_hashs == TRUE)
+    {
+        BSON_APPEND_DOCUMENT_BEGIN(opts, "projection", &projection);
+        BSON_APPEND_INT32(&projection, LABEL_HASHLIST, 0);
+        bson_append_document_end(opts, &projection);
+    }
+
+    return opts;
+}
+
+
+/**
+ * Reads the documents matching a filter and prepends them to a list.
+ * @param collection is the collection of the host
+ * @param filter is the search filter
+ * @param opts are the options (sort, limit and projection) of the search
+ * @param stop_name when not NULL, reading stops at the first document
+ *        whose name is not stop_name
+ * @param file_list is the list where the read meta_data_t are prepended
+ * @param last_name is filled with the name of the last document read
+ *        (the previous value is freed)
+ * @param last_mtime is filled with the mtime of the last document read
+ * @param last_oid is filled with the _id of the last document read
+ * @return the number of documents read
+ */
+static guint64 read_documents(mongoc_collection_t *collection, bson_t *filter, bson_t *opts, gchar *stop_name, GList **file_list, gchar **last_name, gint64 *last_mtime, bson_oid_t *last_oid)
+{
+    mongoc_cursor_t *cursor;
+    const bson_t *doc;
+    bson_iter_t iter;
+    meta_data_t *meta_data = NULL;
+    guint64 read = 0;
+
+    cursor = mongoc_collection_find_with_opts(collection, filter, opts, NULL);
+
+    // look at for more information: http://mongoc.org/libbson/current/parsing.html#recursing-into-sub-documents
+    // Iterate over found documents and add the meta_data_t to list
+    mongodb_print_verbose("\nFound Documents for search_properties:\n");
+    while (mongoc_cursor_next(cursor, &doc))
+    {
+        mongodb_print_verbose("%s\n", bson_as_canonical_extended_json(doc, NULL));
+
+        // Get meta data and add it to file list
+        meta_data = init_meta_data();
+        init_meta_data_from_bson(meta_data, doc);
+
+        if (stop_name != NULL && g_strcmp0(meta_data->name, stop_name) != 0)
+        {
+            free_meta_data_t(meta_data, TRUE);
+            break;
+        }
+
+        if (bson_iter_init_find(&iter, doc, "_id") && BSON_ITER_HOLDS_OID(&iter))
+        {
+            bson_oid_copy(bson_iter_oid(&iter), last_oid);
+        }
+
+        free_variable(*last_name);
+        *last_name = g_strdup(meta_data->name);
+        *last_mtime = (gint64) meta_data->mtime;
+
+        *file_list = g_list_prepend(*file_list, meta_data);
+        read = read + 1;
+    }
+
+    mongoc_cursor_destroy(cursor);
+
+    return read;
+}
+
+
+/**
+ * Searches for a page of files with properties, specified in query_t.
+ * Documents are sorted by name, mtime and _id and the page begins after
+ * the document whose _id is the cursor (keyset paging). When only the
+ * latest versions are wanted a page never ends in the middle of the
+ * versions of a file: the remaining versions of the last name are read
+ * too (the page may then hold more than count documents) and the next
+ * page begins with the following name.
  * @param server_struct contains all needed information about the main server structure
- * @param query the query specification, the data is searched with
- * @return The found hash_data_t, encoded in a JSON string
+ * @param query the query specification, the data is searched with (query->cursor is updated)
+ * @param count is the maximum number of documents to read (0 means no limit)
+ * @return The found meta_data_t in a GList, sorted by name and mtime
  */
-gchar *mongodb_get_list_of_files(server_struct_t *server_struct, query_t *query)
+GList *mongodb_get_list_of_files(server_struct_t *server_struct, query_t *query, guint64 count)
 {
     mongodb_backend_t *backend;
     char *collection_name;
     mongoc_collection_t *collection;
-    mongoc_cursor_t *cursor;
-    const bson_t *doc;
 
     bson_t *search_properties;
-    meta_data_t *meta_data = NULL;
+    bson_t *opts;
     GList *file_list = NULL;
-    json_t *root = NULL;
-    json_t *file_list_json = NULL;
-    gchar *json_string = NULL;
+    guint64 read = 0;
+    gboolean group_by_name = FALSE;
+    gboolean cursor_ok = TRUE;
+    gchar *key_name = NULL;
+    gchar *last_name = NULL;
+    gint64 key_mtime = 0;
+    bson_oid_t key_oid;
+    gchar oid_string[25];
 
 
     // Generate name of collection to use
@@ -718,54 +1075,68 @@ gchar *mongodb_get_list_of_files(server_struct_t *server_struct, query_t *query)
                     collection = mongoc_client_get_collection(backend->client, backend->dbname, collection_name);
                     mongodb_print_verbose("Using collection:\t%s\n", collection_name);
 
+                    /* Only keep latest if specified (as of queries may get old versions without validity interval) */
+                    group_by_name = (query->latest == TRUE || query->asof != NULL);
+
                     // Init search_properties
                     search_properties = bson_new();
                     init_search_property_bson(search_properties, query);
 
-                    cursor = mongoc_collection_find_with_opts(collection, search_properties, NULL, NULL);
-
-                    // look at for more information: http://mongoc.org/libbson/current/parsing.html#recursing-into-sub-documents
-                    // Iterate over found documents and add the meta_data_t to list
-                    mongodb_print_verbose("\nFound Documents for search_properties:\n");
-                    while (mongoc_cursor_next(cursor, &doc))
+                    // Paging: begins after the last document of the previous page
+                    if (query->cursor != NULL)
                     {
-                        mongodb_print_verbose("%s\n", bson_as_canonical_extended_json(doc, NULL));
-
-                        // Get meta data and add it to file list
-                        meta_data = init_meta_data();
-                        init_meta_data_from_bson(meta_data, doc);
+                        cursor_ok = get_cursor_key(collection, query->cursor, &key_name, &key_mtime, &key_oid);
+
+                        if (cursor_ok == TRUE)
+                        {
+                            append_after_key_bson(search_properties, key_name, key_mtime, &key_oid, group_by_name);
+                        } else
+                        {
+                            mongodb_print_error("[%s] Unknown cursor: %s\n",
+                                                LOGGING_METHOD_PREFIX_MONGODB_GET_LIST_OF_FILES, query->cursor);
+                        }
+                    }
 
-                        file_list = g_list_prepend(file_list, meta_data);
+                    if (cursor_ok == TRUE)
+                    {
+                        opts = new_list_opts(query, count);
+                        read = read_documents(collection, search_properties, opts, NULL, &file_list, &key_name, &key_mtime, &key_oid);
+                        bson_destroy(opts);
+
+                        if (group_by_name == TRUE && count > 0 && read == count)
+                        {
+                            /* The remaining versions of the last name belong to this page */
+                            bson_destroy(search_properties);
+                            search_properties = bson_new();
+                            init_search_property_bson(search_properties, query);
+                            append_after_key_bson(search_properties, key_name, key_mtime, &key_oid, FALSE);
+
+                            opts = new_list_opts(query, 0);
+                            last_name = g_strdup(key_name);
+                            read = read + read_documents(collection, search_properties, opts, last_name, &file_list, &key_name, &key_mtime, &key_oid);
+                            free_variable(last_name);
+                            bson_destroy(opts);
+                        }
                     }
 
+                    if (read > 0)
+                    {
+                        bson_oid_to_string(&key_oid, oid_string);
+                        free_variable(query->cursor);
+                        query->cursor = g_strdup(oid_string);
+                    }
 
-                    // Sort found documents by mdate
-                    file_list = g_list_sort(file_list, compare_meta_data_t);
+                    // Documents are already sorted by the server
+                    file_list = g_list_reverse(file_list);
 
-                    /* Only keep latest if specified */
-                    if (query->latest == TRUE)
+                    if (group_by_name == TRUE)
                     {
                         file_list = keep_latests_meta_data_t_in_list(file_list);
                     }
 
-                    /* Converting list into JSON array */
-                    file_list_json = convert_meta_data_list_to_json_array(file_list, query->hostname, FALSE);
-
-                    /* Freeing memory */
-                    g_list_free_full(file_list, free_glist_meta_data_t);
-
-
-                    root = json_object();
-                    insert_json_value_into_json_root(root, "file_list", file_list_json);
-                    json_string = json_dumps(root, 0);
-
-
                     // Clean up
-                    json_decref(file_list_json);
-                    json_decref(root);
-
+                    free_variable(key_name);
                     bson_destroy(search_properties);
-                    mongoc_cursor_destroy(cursor);
                     mongoc_collection_destroy(collection);
                 } else
                 {
@@ -788,6 +1159,6 @@ gchar *mongodb_get_list_of_files(server_struct_t *server_struct, query_t *query)
         mongodb_print_error("[%s] No query passed!\n", LOGGING_METHOD_PREFIX_MONGODB_GET_LIST_OF_FILES);
     }
 
-    return json_string;
+    return file_list;
 }
 
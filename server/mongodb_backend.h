@@ -37,6 +37,8 @@
 #define LABEL_NAME ("name")
 #define LABEL_LINK ("link")
 #define LABEL_HASHLIST ("hashlist")
+#define LABEL_VALID_FROM ("valid_from")
+#define LABEL_VALID_TO ("valid_to")
 
 /**
  * TODO PRODUCTIVE: add to configuration.h, delete here
@@ -66,6 +68,7 @@ typedef struct
     const char *connection_string;
     const char *dbname;
     mongoc_client_t *client;
+    GHashTable *indexed_collections;    /**< names of the collections whose validity indexes have already been created */
 //    gboolean initialized;
 //    gboolean corrupted;
 } mongodb_backend_t;
@@ -96,12 +99,19 @@ extern void mongodb_store_smeta(server_struct_t *server_struct, server_meta_data
 
 
 /**
- * Searches for files with properties, specified in query_t
+ * Searches for a page of files with properties, specified in query_t.
+ * Documents are sorted by name, mtime and _id and the page begins after
+ * the document whose _id is the cursor (keyset paging). When only the
+ * latest versions are wanted a page never ends in the middle of the
+ * versions of a file: the remaining versions of the last name are read
+ * too (the page may then hold more than count documents) and the next
+ * page begins with the following name.
  * @param server_struct contains all needed information about the main server structure
- * @param query the query specification, the data is searched with
- * @return The found hash_data_t, encoded in a JSON string
+ * @param query the query specification, the data is searched with (query->cursor is updated)
+ * @param count is the maximum number of documents to read (0 means no limit)
+ * @return The found meta_data_t in a GList, sorted by name and mtime
  */
-extern gchar *mongodb_get_list_of_files(server_struct_t *server_struct, query_t *query);
+extern GList *mongodb_get_list_of_files(server_struct_t *server_struct, query_t *query, guint64 count);
 
 
 
@@ -40,6 +40,7 @@ void free_options_t(options_t *opt)
 
     if (opt != NULL)
         {
+            free_variable(opt->dictionary_dir);
             free_variable(opt);
         }
 
@@ -63,6 +64,9 @@ static void print_selected_options(options_t *opt)
                 {
                     fprintf(stdout, _("Port number: %d\n"), opt->port);
                 }
+
+            fprintf(stdout, _("Dictionary size: %" G_GINT64_FORMAT "\n"), opt->dictionary_size);
+            print_string_option(_("Dictionary directory: %s\n"), opt->dictionary_dir);
         }
 }
 
@@ -112,6 +116,7 @@ static void read_from_configuration_file(options_t *opt, gchar *filename)
     GKeyFile *keyfile = NULL;      /** Configuration file parser */
     GError *error = NULL;          /** Glib error handling       */
     srv_conf_t *srv_conf = NULL;
+    gchar *dictionary_dir = NULL;  /** Directory of the dictionaries */
 
     if (filename != NULL)
         {
@@ -132,6 +137,12 @@ static void read_from_configuration_file(options_t *opt, gchar *filename)
                     opt->port = srv_conf ->port;
                     opt->backend_meta = get_backend_number_from_label(srv_conf->backend_meta_label);
                     opt->backend_data = get_backend_number_from_label(srv_conf->backend_data_label);
+                    opt->hash_filter_bits = read_int64_from_file(keyfile, filename, GN_SERVER, KN_HASH_FILTER_BITS, _("Could not load hash filter size from file."), opt->hash_filter_bits);
+                    opt->block_cache_size = read_int64_from_file(keyfile, filename, GN_SERVER, KN_BLOCK_CACHE_SIZE, _("Could not load block cache size from file."), opt->block_cache_size);
+                    opt->dictionary_size = read_int64_from_file(keyfile, filename, GN_SERVER, KN_DICTIONARY_SIZE, _("Could not load dictionary size from file."), opt->dictionary_size);
+                    dictionary_dir = read_string_from_file(keyfile, filename, GN_SERVER, KN_DICTIONARY_DIR, _("Could not load dictionary directory from file."));
+                    opt->dictionary_dir = set_option_str(dictionary_dir, opt->dictionary_dir);
+                    free_variable(dictionary_dir);
                     read_debug_mode_from_file(keyfile, filename);
                 }
             else if (error != NULL)
@@ -165,6 +176,7 @@ options_t *manage_command_line_options(int argc, char **argv)
     gint cmdl_debug = -4;           /** debug mode as specified on the command line                                        */
     gchar *configfile = NULL;       /** Filename for the configuration file if any                                         */
     gint port = 0;                  /** Port number on which to listen                                                     */
+    gboolean train = FALSE;         /** True if -t was selected on the command line                                        */
 
     GOptionEntry entries[] =
     {
@@ -172,6 +184,7 @@ options_t *manage_command_line_options(int argc, char **argv)
         { "debug", 'd', 0,  G_OPTION_ARG_INT, &cmdl_debug, N_("Activates (1) or deactivates (0) debug mode."), N_("BOOLEAN")},
         { "configuration", 'c', 0, G_OPTION_ARG_STRING, &configfile, N_("Specify an alternative configuration file."), N_("FILENAME")},
         { "port", 'p', 0, G_OPTION_ARG_INT, &port, N_("Port NUMBER on which to listen."), N_("NUMBER")},
+        { "train-dictionary", 't', 0, G_OPTION_ARG_NONE, &train, N_("Trains a new compression dictionary from stored blocks."), NULL},
         { NULL }
     };
 
@@ -202,6 +215,10 @@ options_t *manage_command_line_options(int argc, char **argv)
 
     opt->configfile = NULL;
     opt->port = SERVER_PORT;
+    opt->hash_filter_bits = BLOOM_DEFAULT_BITS;
+    opt->block_cache_size = BLOCK_CACHE_DEFAULT_SIZE;
+    opt->dictionary_size = DICTIONARY_STORE_DEFAULT_SIZE;
+    opt->dictionary_dir = g_strdup("/var/tmp/cdpfgl/server/dictionaries");
 
 
     /* 1) Reading options from default configuration file */
@@ -210,6 +227,7 @@ options_t *manage_command_line_options(int argc, char **argv)
     free_variable(defaultconfigfilename);
 
     opt->version = version; /* only TRUE if -v or --version was invoked */
+    opt->train_dictionary = train; /* only TRUE if -t or --train-dictionary was invoked */
 
 
     /* 2) Reading the configuration from the configuration file specified
@@ -44,6 +44,11 @@ typedef struct
     gint port;          /**< port number on which the cdpfglserver program will listen for connexions */
     gint backend_meta;  /**< Number of backend to use for meta data                                   */
     gint backend_data;  /**< Number of backend to use for data                                        */
+    gint64 hash_filter_bits; /**< Size in bits of the filter of stored hashs (0 disables it)      */
+    gint64 block_cache_size; /**< Size in bytes of the cache of retrieved blocks (0 disables it)  */
+    gint64 dictionary_size;  /**< Maximum size in bytes of trained dictionaries (0 disables them) */
+    gchar *dictionary_dir;   /**< Directory where trained dictionaries are kept                   */
+    gboolean train_dictionary; /**< TRUE to train a new dictionary at startup                     */
 } options_t;
 
 
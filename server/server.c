@@ -29,8 +29,16 @@
 
 #include "server.h"
 
+/**
+ * Pushed at the end of the meta and data queues to tell their threads to
+ * end once everything queued before it has been stored.
+ */
+static gchar queue_end_marker = 0;
+
 static void free_server_struct_t(server_struct_t *server_struct);
 
+static void stop_storing_threads(server_struct_t *server_struct);
+
 static gboolean int_signal_handler(gpointer user_data);
 
 static server_struct_t *init_server_main_structure(int argc, char **argv);
@@ -41,20 +49,26 @@ static gchar *get_argument_value_from_key(struct MHD_Connection *connection, gch
 
 static gboolean get_boolean_argument_value_from_key(struct MHD_Connection *connection, gchar *key);
 
-static gchar *get_a_list_of_files(server_struct_t *server_struct, struct MHD_Connection *connection);
+static int answer_file_list_request(server_struct_t *server_struct, struct MHD_Connection *connection);
+
+static int answer_hash_array_request(server_struct_t *server_struct, struct MHD_Connection *connection);
 
-static gchar *get_data_from_a_list_of_hashs(server_struct_t *server_struct, struct MHD_Connection *connection);
+static gchar *get_hash_filter(server_struct_t *server_struct, struct MHD_Connection *connection);
 
-static json_t *fills_json_with_get_stats(json_t *get, req_get_t *get_stats);
+static gchar *get_dictionary(server_struct_t *server_struct, struct MHD_Connection *connection);
 
-static json_t *fills_json_with_post_stats(json_t *post, req_post_t *post_stats);
+static json_t *fills_json_with_get_stats(json_t *get, stats_t *stats);
 
-static gchar *get_json_answer(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url);
+static json_t *fills_json_with_post_stats(json_t *post, stats_t *stats);
 
-static gchar *get_unformatted_answer(server_struct_t *server_struct, const char *url);
+static gchar *get_json_answer(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url, stats_latency_t *latency);
+
+static gchar *get_unformatted_answer(server_struct_t *server_struct, const char *url, stats_latency_t *latency);
 
 static int create_MHD_response(struct MHD_Connection *connection, gchar *answer, gchar *content_type);
 
+static a_clock_t *new_request_clock(struct MHD_Connection *connection);
+
 static int
 process_get_request(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url, void **con_cls);
 
@@ -67,6 +81,9 @@ answer_meta_json_post_request(server_struct_t *server_struct, struct MHD_Connect
 static int answer_hash_array_post_request(server_struct_t *server_struct, struct MHD_Connection *connection,
                                           guchar *received_data);
 
+static int answer_data_hash_array_post_request(server_struct_t *server_struct, struct MHD_Connection *connection,
+                                               guchar *received_data);
+
 static void print_received_data_for_hash(guint8 *hash, gssize read);
 
 static int process_received_data(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url,
@@ -89,9 +106,45 @@ static gpointer meta_data_thread(gpointer user_data);
 
 static gpointer data_thread(gpointer user_data);
 
+static void add_stored_hash_to_filter(gpointer data, gpointer user_data);
+
+static gpointer hash_filter_thread(gpointer user_data);
+
+static void sample_stored_blocks(server_struct_t *server_struct, dictionary_sample_t *sample);
+
+static void train_dictionary(server_struct_t *server_struct);
+
+static gpointer dictionary_thread(gpointer user_data);
+
 static void install_server_signal_traps(server_struct_t *server_struct);
 
 
+/**
+ * Stops the meta and data threads once they have stored everything
+ * already queued and waits for them. Nothing may be queued anymore (the
+ * MHD daemon must be stopped).
+ * @param server_struct is the main structure for the server.
+ */
+static void stop_storing_threads(server_struct_t *server_struct)
+{
+    if (server_struct->meta_thread != NULL)
+    {
+        g_async_queue_push(server_struct->meta_queue, &queue_end_marker);
+        g_thread_join(server_struct->meta_thread);
+        server_struct->meta_thread = NULL;
+        print_debug(_("\tmeta thread joined.\n"));
+    }
+
+    if (server_struct->data_thread != NULL)
+    {
+        g_async_queue_push(server_struct->data_queue, &queue_end_marker);
+        g_thread_join(server_struct->data_thread);
+        server_struct->data_thread = NULL;
+        print_debug(_("\tdata thread joined.\n"));
+    }
+}
+
+
 /**
  * Frees server's structure
  * @param server_struct is the structure to be freed
@@ -104,6 +157,24 @@ void free_server_struct_t(server_struct_t *server_struct)
         MHD_stop_daemon(server_struct->d);
         print_debug(_("\tMHD daemon stopped.\n"));
 
+        // backends (and what they own, like the compressors) must not be used while being terminated
+        stop_storing_threads(server_struct);
+
+        // the filter thread walks the data backend: it must end before the backend does
+        if (server_struct->filter_thread != NULL)
+        {
+            g_thread_join(server_struct->filter_thread);
+            print_debug(_("\thash filter thread joined.\n"));
+        }
+
+        // the dictionary thread samples the data backend too
+        if (server_struct->dictionary_thread != NULL)
+        {
+            dictionary_store_stop(server_struct->dictionary_store);
+            g_thread_join(server_struct->dictionary_thread);
+            print_debug(_("\tdictionary thread joined.\n"));
+        }
+
         // terminate data backend if necessary
         if (server_struct->backend_data != NULL && server_struct->backend_data->terminate_backend != NULL)
         {
@@ -112,21 +183,30 @@ void free_server_struct_t(server_struct_t *server_struct)
         free_backend(server_struct->backend_data);
         print_debug(_("\tdata backend variable freed.\n"));
 
-        // terminate meta backend if necessary
-        if (server_struct->backend_meta != NULL && server_struct->backend_meta->terminate_backend != NULL)
+        // terminate meta backend if necessary (it may be the same than the data backend)
+        if (server_struct->backend_meta != server_struct->backend_data)
         {
-            server_struct->backend_meta->terminate_backend(server_struct->backend_meta);
+            if (server_struct->backend_meta != NULL && server_struct->backend_meta->terminate_backend != NULL)
+            {
+                server_struct->backend_meta->terminate_backend(server_struct->backend_meta);
+            }
+            if (server_struct->backend_meta == NULL)
+            {
+                print_debug(_("\tmeta backend already freed.\n"));
+            }
+            else
+            {
+                free_backend(server_struct->backend_meta);
+            }
         }
-        if (server_struct->backend_meta == NULL)
-            g_printerr("META already freed!\n");
-        else
-            free_backend(server_struct->backend_meta);
 
         print_debug(_("\tmeta backend variable freed.\n"));
-        g_thread_unref(server_struct->data_thread);
-        print_debug(_("\tdata thread unreferenced.\n"));
-        g_thread_unref(server_struct->meta_thread);
-        print_debug(_("\tmeta thread unreferenced.\n"));
+        free_hash_filter_t(server_struct->hash_filter);
+        print_debug(_("\thash filter freed.\n"));
+        free_block_cache_t(server_struct->block_cache);
+        print_debug(_("\tblock cache freed.\n"));
+        free_dictionary_store_t(server_struct->dictionary_store);
+        print_debug(_("\tdictionary store freed.\n"));
         free_options_t(server_struct->opt);
         print_debug(_("\toption structure freed.\n"));
         free_variable(server_struct);
@@ -175,6 +255,11 @@ static server_struct_t *init_server_main_structure(int argc, char **argv)
 
     server_struct->data_thread = NULL;
     server_struct->meta_thread = NULL;
+    server_struct->filter_thread = NULL;
+    server_struct->hash_filter = NULL;
+    server_struct->block_cache = NULL;
+    server_struct->dictionary_store = NULL;
+    server_struct->dictionary_thread = NULL;
     server_struct->opt = do_what_is_needed_from_command_line_options(argc, argv);
     server_struct->d = NULL;            /* libmicrohttpd daemon pointer */
     server_struct->meta_queue = g_async_queue_new();
@@ -201,15 +286,22 @@ static server_struct_t *init_server_main_structure(int argc, char **argv)
             // use the default file backend
             g_print("Meta Backend: %s\n", BACKEND_FILE_LABEL);
             server_struct->backend_meta = init_backend_structure(file_store_smeta, file_store_data, file_init_backend,
-                                                                 NULL,
+                                                                 file_terminate_backend,
                                                                  file_build_needed_hash_list, file_get_list_of_files,
-                                                                 file_retrieve_data);
+                                                                 file_retrieve_data, file_foreach_stored_hash);
         } else if (server_struct->opt->backend_meta == BACKEND_MONGODB_NUM)
         {
             g_print("Meta Backend: %s\n", BACKEND_MONGODB_LABEL);
             server_struct->backend_meta = init_backend_structure(mongodb_store_smeta, NULL, mongodb_init_backend,
                                                                  mongodb_terminate_backend, NULL,
-                                                                 mongodb_get_list_of_files, NULL);
+                                                                 mongodb_get_list_of_files, NULL, NULL);
+        } else if (server_struct->opt->backend_meta == BACKEND_MEMORY_NUM)
+        {
+            g_print("Meta Backend: %s\n", BACKEND_MEMORY_LABEL);
+            server_struct->backend_meta = init_backend_structure(memory_store_smeta, memory_store_data, memory_init_backend,
+                                                                 memory_terminate_backend,
+                                                                 memory_build_needed_hash_list, memory_get_list_of_files,
+                                                                 memory_retrieve_data, memory_foreach_stored_hash);
         } else
         {
             print_error(__FILE__, __LINE__, "(Internal error) Number of backend to use not handled: %d\n",
@@ -237,10 +329,11 @@ static server_struct_t *init_server_main_structure(int argc, char **argv)
                 server_struct->backend_data = init_backend_structure(file_store_smeta,
                                                                      file_store_data,
                                                                      file_init_backend,
-                                                                     NULL,
+                                                                     file_terminate_backend,
                                                                      file_build_needed_hash_list,
                                                                      file_get_list_of_files,
-                                                                     file_retrieve_data);
+                                                                     file_retrieve_data,
+                                                                     file_foreach_stored_hash);
             } else if (server_struct->opt->backend_data == BACKEND_MINIO_NUM)
             {
                 // MinIO Backend
@@ -251,9 +344,21 @@ static server_struct_t *init_server_main_structure(int argc, char **argv)
                                                                      minio_terminate_backend,
                                                                      minio_build_needed_hash_list,
                                                                      NULL,
-                                                                     minio_retrieve_data);
+                                                                     minio_retrieve_data,
+                                                                     minio_foreach_stored_hash);
 
 
+            } else if (server_struct->opt->backend_data == BACKEND_MEMORY_NUM)
+            {
+                g_print("Data Backend: %s\n", BACKEND_MEMORY_LABEL);
+                server_struct->backend_data = init_backend_structure(NULL,
+                                                                     memory_store_data,
+                                                                     memory_init_backend,
+                                                                     memory_terminate_backend,
+                                                                     memory_build_needed_hash_list,
+                                                                     NULL,
+                                                                     memory_retrieve_data,
+                                                                     memory_foreach_stored_hash);
             } else
             {
                 print_error(__FILE__, __LINE__, "(Internal error) Number of backend to use not handled: %d\n",
@@ -273,6 +378,20 @@ static server_struct_t *init_server_main_structure(int argc, char **argv)
             exit(EXIT_FAILURE);
         }
 
+        /* The filter of stored hashs needs a backend able to list them */
+        if (server_struct->backend_data->foreach_stored_hash != NULL)
+        {
+            server_struct->hash_filter = new_hash_filter_t(server_struct->opt->hash_filter_bits);
+        }
+
+        server_struct->block_cache = new_block_cache_t(server_struct->opt->block_cache_size);
+
+        /* Dictionaries are registered now: stored blocks may need them */
+        if (server_struct->opt->dictionary_size > 0)
+        {
+            server_struct->dictionary_store = new_dictionary_store_t(server_struct->opt->dictionary_dir);
+        }
+
     } else
     {
         print_error(__FILE__, __LINE__, "Server options missing. Exit.\n");
@@ -302,7 +421,7 @@ static gchar *get_data_from_a_specific_hash(server_struct_t *server_struct, gcha
 
     if (backend->retrieve_data != NULL)
     {
-        hash_data = backend->retrieve_data(server_struct, hash);
+        hash_data = block_cache_retrieve_data(server_struct->block_cache, backend, server_struct, hash);
         answer = convert_hash_data_t_to_string(hash_data);
         free_hash_data_t(hash_data);
 
@@ -384,16 +503,22 @@ static gboolean get_boolean_argument_value_from_key(struct MHD_Connection *conne
 
 
 /**
- * Function to get a list of saved files.
+ * Answers a /File/List.json request. The answer is streamed from the
+ * backend page after page (see file_list.c). The client may limit the
+ * number of versions in the answer with "limit" and get the next ones
+ * with the "cursor" that is then returned in the answer.
  * @param server_struct is the main structure for the server.
  * @param connection is the connection in MHD
- * @param url is the requested url
- * @returns a json formatted string or NULL
+ * @returns an int that is either MHD_NO or MHD_YES upon failure or not.
  */
-static gchar *get_a_list_of_files(server_struct_t *server_struct, struct MHD_Connection *connection)
+static int answer_file_list_request(server_struct_t *server_struct, struct MHD_Connection *connection)
 {
+    struct MHD_Response *response = NULL;
+    file_list_stream_t *stream = NULL;
+    int success = MHD_NO;
     gchar *answer = NULL;
     gchar *message = NULL;
+    gchar *limit = NULL;
     backend_t *backend = NULL;
     query_t *query = NULL;
 
@@ -416,25 +541,37 @@ static gchar *get_a_list_of_files(server_struct_t *server_struct, struct MHD_Con
         query->date = get_argument_value_from_key(connection, "date", TRUE);
         query->afterdate = get_argument_value_from_key(connection, "afterdate", TRUE);
         query->beforedate = get_argument_value_from_key(connection, "beforedate", TRUE);
+        query->asof = get_argument_value_from_key(connection, "asof", TRUE);
         query->latest = get_boolean_argument_value_from_key(connection, "latest");
+        query->cursor = get_argument_value_from_key(connection, "cursor", FALSE);
+        query->without_hashs = get_boolean_argument_value_from_key(connection, "without_hashs");
+
+        limit = get_argument_value_from_key(connection, "limit", FALSE);
+        query->limit = get_guint64_from_string(limit);
+        free_variable(limit);
 
-        print_debug(_("hostname: %s, uid: %s, gid: %s, owner: %s, group: %s, filter: %s && %s && %s && %s && %d\n"), \
+        print_debug(_("hostname: %s, uid: %s, gid: %s, owner: %s, group: %s, filter: %s && %s && %s && %s && %s && %d, cursor: %s, limit: %" G_GUINT64_FORMAT "\n"), \
                            query->hostname, query->uid, query->gid, query->owner, query->group, \
-                           query->filename, query->date, query->afterdate, query->beforedate, query->latest);
+                           query->filename, query->date, query->afterdate, query->beforedate, query->asof, query->latest, \
+                           query->cursor, query->limit);
 
         if (query->hostname != NULL && query->uid != NULL && query->gid != NULL && query->owner != NULL &&
             query->group != NULL)
         {
-            answer = backend->get_list_of_files(server_struct, query);
+            /* The stream owns the query from now on and frees it when the answer has been sent */
+            stream = new_file_list_stream(server_struct, backend, query);
+            response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 32768, &file_list_stream_reader, stream, &free_file_list_stream);
+            MHD_add_response_header(response, "Content-Type", CT_JSON);
+            success = MHD_queue_response(connection, MHD_HTTP_OK, response);
+            MHD_destroy_response(response);
         } else
         {
             message = g_strdup_printf(_("Malformed request: hostname: %s, uid: %s, gid: %s, owner: %s, group: %s"), \
                                                 query->hostname, query->uid, query->gid, query->owner, query->group);
             answer = answer_json_error_string(MHD_HTTP_BAD_REQUEST, message);
             free_variable(message);
+            free_query_t(query); /** All variables hostname, uid... are freed there ! */
         }
-
-        free_query_t(query); /** All variables hostname, uid... are freed there ! */
     } else
     {
         message = g_strdup_printf(_("Error: no backend defined to get a list of files from it.\n"));
@@ -443,94 +580,129 @@ static gchar *get_a_list_of_files(server_struct_t *server_struct, struct MHD_Con
         free_variable(message);
     }
 
-    return answer;
+    if (answer != NULL)
+    {
+        /* Do not free answer variable as MHD will do it for us ! */
+        success = create_MHD_response(connection, answer, CT_JSON);
+    }
+
+    return success;
 }
 
 
 /**
- * Gets all data from a list of hash obtained from X-Get-Hash-Array HTTP
- * header.
+ * Answers a /Data/Hash_Array.json request: gets all data from a list of
+ * hash obtained from X-Get-Hash-Array HTTP header. The answer is streamed
+ * while blocks are retrieved (see hash_array.c).
  * @param server_struct is the main structure for the server.
  * @param connection is the connection in MHD
- * @returns a newlly allocated gchar * string that contains the anwser to be
- *          sent back to the client (hopefully a json string containing
- *          a hash (that is a fake one here), data and size of the data.
+ * @returns an int that is either MHD_NO or MHD_YES upon failure or not.
  */
-static gchar *get_data_from_a_list_of_hashs(server_struct_t *server_struct, struct MHD_Connection *connection)
+static int answer_hash_array_request(server_struct_t *server_struct, struct MHD_Connection *connection)
 {
+    struct MHD_Response *response = NULL;
+    hash_array_stream_t *stream = NULL;
     const char *header = NULL;
+    gchar *message = NULL;
     gchar *answer = NULL;
-    gchar *hash = NULL;
-    GList *head = NULL;
     GList *header_hdl = NULL;
-    hash_data_t *header_hd = NULL;
-    hash_data_t *hash_data = NULL;
-    backend_t *backend = server_struct->backend_data;
-    guint size = 0;
-    guint buffer_len = 0;
-    guchar *concat = NULL;
-    guchar *final_buffer = NULL;
-    a_clock_t *a_clock = NULL;
-    compress_t *compress = NULL;
-    guint8 *a_hash = NULL;
-
+    gboolean compressed = FALSE;
+    int success = MHD_NO;
 
-    a_clock = new_clock_t();
-    header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, X_GET_HASH_ARRAY);
-    header_hdl = make_hash_data_list_from_string((gchar *) header);
-    end_clock(a_clock, "X-Get-Hash-Array retrieved in");
+    g_assert_nonnull(server_struct);
+    g_assert_nonnull(server_struct->backend_data);
 
-    a_clock = new_clock_t();
-    head = header_hdl;
-    while (header_hdl != NULL)
+    if (server_struct->backend_data->retrieve_data != NULL)
     {
-        header_hd = header_hdl->data;
-        hash = hash_to_string(header_hd->hash);
-        hash_data = backend->retrieve_data(server_struct, hash);
-        free_variable(hash);
+        header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, X_GET_HASH_ARRAY);
+        header_hdl = make_hash_data_list_from_string((gchar *) header);
+        compressed = get_boolean_argument_value_from_key(connection, "compressed");
+
+        /* The stream owns header_hdl from now on and frees it when the answer has been sent */
+        stream = new_hash_array_stream(server_struct, header_hdl, compressed);
+        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 65536, &hash_array_stream_reader, stream, &free_hash_array_stream);
+        MHD_add_response_header(response, "Content-Type", CT_JSON);
+        success = MHD_queue_response(connection, MHD_HTTP_OK, response);
+        MHD_destroy_response(response);
+    } else
+    {
+        message = g_strdup(_("This backend's missing a retrieve_data function!"));
+        answer = answer_json_error_string(MHD_HTTP_NOT_IMPLEMENTED, message);
+        free_variable(message);
 
-        if (hash_data != NULL)
-        {
+        /* Do not free answer variable as MHD will do it for us ! */
+        success = create_MHD_response(connection, answer, CT_JSON);
+    }
 
-            if (hash_data->cmptype == COMPRESS_NONE_TYPE)
-            {
-                concat = concat_buffer(final_buffer, size, hash_data->data, hash_data->read);
-                buffer_len = hash_data->read;
-            } else
-            {
-                compress = uncompress_buffer(hash_data->data, hash_data->read, hash_data->uncmplen, hash_data->cmptype);
+    return success;
+}
 
-                if (compress != NULL)
-                {
-                    concat = concat_buffer(final_buffer, size, compress->text, compress->len);
-                    buffer_len = compress->len;
-                    free_compress_t(compress);
-                } else
-                {
-                    print_error(__FILE__, __LINE__, _("Error while uncompressing one block.\n"));
-                }
-            }
 
-            size = size + buffer_len;
+/**
+ * Gets the filter of stored hashs. Arguments "id" and "version" of the
+ * url are the ones of the filter the client already has if any. In that
+ * case only the hashs added since that version are sent back.
+ * @param server_struct is the main structure for the server.
+ * @param connection is the connection in MHD
+ * @returns a newly allocated json string containing the filter, a delta
+ *          or an error if the filter is not available.
+ */
+static gchar *get_hash_filter(server_struct_t *server_struct, struct MHD_Connection *connection)
+{
+    gchar *answer = NULL;
+    gchar *message = NULL;
+    gchar *id = NULL;
+    gchar *version = NULL;
+
+    g_assert_nonnull(server_struct);
 
-            free_variable(final_buffer);
-            final_buffer = concat;
-            free_hash_data_t(hash_data);
-        }
+    id = get_argument_value_from_key(connection, "id", FALSE);
+    version = get_argument_value_from_key(connection, "version", FALSE);
+
+    answer = hash_filter_answer(server_struct->hash_filter, get_uint_from_string(id), get_guint64_from_string(version));
 
-        header_hdl = g_list_next(header_hdl);
+    if (answer == NULL)
+    {
+        message = g_strdup(_("Hash filter is disabled or not ready yet"));
+        answer = answer_json_error_string(MHD_HTTP_SERVICE_UNAVAILABLE, message);
+        free_variable(message);
     }
-    g_list_free_full(head, free_hdt_struct);
-    end_clock(a_clock, "Read all files");
 
-    a_clock = new_clock_t();
+    free_variable(id);
+    free_variable(version);
+
+    return answer;
+}
+
 
-    a_hash = calculate_hash_for_string(final_buffer, size);
-    hash_data = new_hash_data_t_as_is((guchar *) final_buffer, size, a_hash, COMPRESS_NONE_TYPE, size);
-    answer = convert_hash_data_t_to_string(hash_data);
-    free_hash_data_t(hash_data);
+/**
+ * Gets a trained dictionary. Argument "id" of the url selects the
+ * version of the dictionary (the latest one is sent without it).
+ * @param server_struct is the main structure for the server.
+ * @param connection is the connection in MHD
+ * @returns a newly allocated json string containing the dictionary or an
+ *          error if there is no such dictionary.
+ */
+static gchar *get_dictionary(server_struct_t *server_struct, struct MHD_Connection *connection)
+{
+    gchar *answer = NULL;
+    gchar *message = NULL;
+    gchar *id = NULL;
 
-    end_clock(a_clock, "Transformed into a JSON string");
+    g_assert_nonnull(server_struct);
+
+    id = get_argument_value_from_key(connection, "id", FALSE);
+
+    answer = dictionary_store_answer(server_struct->dictionary_store, get_uint_from_string(id));
+
+    if (answer == NULL)
+    {
+        message = g_strdup(_("Dictionaries are disabled or no such dictionary"));
+        answer = answer_json_error_string(MHD_HTTP_NOT_FOUND, message);
+        free_variable(message);
+    }
+
+    free_variable(id);
 
     return answer;
 }
@@ -539,22 +711,24 @@ static gchar *get_data_from_a_list_of_hashs(server_struct_t *server_struct, stru
 /**
  * Fills a json structure from GET statistics
  * @param get is the json structure to be filled with get statistics.
- * @param get_stats is the structure (req_get_t *) that contains all statistics
- *                  for GET http requests
+ * @param stats is the structure (stats_t *) that contains all statistics
  * @returns a json_t * filled with GET statistics.
  */
-json_t *fills_json_with_get_stats(json_t *get, req_get_t *get_stats)
+json_t *fills_json_with_get_stats(json_t *get, stats_t *stats)
 {
-    if (get != NULL && get_stats != NULL)
-    {
-        insert_integer_value_into_json_root(get, "/Stats.json", get_stats->stats);
-        insert_integer_value_into_json_root(get, "/Version.json", get_stats->version);
-        insert_integer_value_into_json_root(get, "/Version", get_stats->verstxt);
-        insert_integer_value_into_json_root(get, "/File/List.json", get_stats->file_list);
-        insert_integer_value_into_json_root(get, "/Data/0xxxx.json", get_stats->data_hash);
-        insert_integer_value_into_json_root(get, "/Data/Hash_Array.json", get_stats->data_hash_array);
-        insert_integer_value_into_json_root(get, "/unknown.json", get_stats->unk);
-        insert_integer_value_into_json_root(get, "/unknown", get_stats->unktxt);
+    if (get != NULL && stats != NULL)
+    {
+        insert_integer_value_into_json_root(get, "/Stats.json", get_stats_counter(stats, STATS_GET_STATS));
+        insert_integer_value_into_json_root(get, METRICS_URL, get_stats_counter(stats, STATS_GET_METRICS));
+        insert_integer_value_into_json_root(get, "/Version.json", get_stats_counter(stats, STATS_GET_VERSION));
+        insert_integer_value_into_json_root(get, "/Version", get_stats_counter(stats, STATS_GET_VERSTXT));
+        insert_integer_value_into_json_root(get, "/File/List.json", get_stats_counter(stats, STATS_GET_FILE_LIST));
+        insert_integer_value_into_json_root(get, "/Data/0xxxx.json", get_stats_counter(stats, STATS_GET_DATA_HASH));
+        insert_integer_value_into_json_root(get, "/Data/Hash_Array.json", get_stats_counter(stats, STATS_GET_DATA_HASH_ARRAY));
+        insert_integer_value_into_json_root(get, "/Hash_Filter.json", get_stats_counter(stats, STATS_GET_HASH_FILTER));
+        insert_integer_value_into_json_root(get, "/Dictionary.json", get_stats_counter(stats, STATS_GET_DICTIONARY));
+        insert_integer_value_into_json_root(get, "/unknown.json", get_stats_counter(stats, STATS_GET_UNK));
+        insert_integer_value_into_json_root(get, "/unknown", get_stats_counter(stats, STATS_GET_UNKTXT));
     }
 
     return get;
@@ -564,19 +738,19 @@ json_t *fills_json_with_get_stats(json_t *get, req_get_t *get_stats)
 /**
  * Fills a json structure from  POST statistics
  * @param post is the json structure to be filled with post statistics.
- * @param post_stats is the structure (req_post_t *) that contains all statistics
- *                  for POST http requests
+ * @param stats is the structure (stats_t *) that contains all statistics
  * @returns a json_t * filled with POST statistics.
  */
-json_t *fills_json_with_post_stats(json_t *post, req_post_t *post_stats)
+json_t *fills_json_with_post_stats(json_t *post, stats_t *stats)
 {
-    if (post != NULL && post_stats != NULL)
+    if (post != NULL && stats != NULL)
     {
-        insert_integer_value_into_json_root(post, "/Meta.json", post_stats->meta);
-        insert_integer_value_into_json_root(post, "/Data.json", post_stats->data);
-        insert_integer_value_into_json_root(post, "/Data_Array.json", post_stats->data_array);
-        insert_integer_value_into_json_root(post, "/Hash_Array.json", post_stats->hash_array);
-        insert_integer_value_into_json_root(post, "/unknown.json", post_stats->unk);
+        insert_integer_value_into_json_root(post, "/Meta.json", get_stats_counter(stats, STATS_POST_META));
+        insert_integer_value_into_json_root(post, "/Data.json", get_stats_counter(stats, STATS_POST_DATA));
+        insert_integer_value_into_json_root(post, "/Data_Array.json", get_stats_counter(stats, STATS_POST_DATA_ARRAY));
+        insert_integer_value_into_json_root(post, "/Hash_Array.json", get_stats_counter(stats, STATS_POST_HASH_ARRAY));
+        insert_integer_value_into_json_root(post, "/Data/Hash_Array.json", get_stats_counter(stats, STATS_POST_DATA_HASH_ARRAY));
+        insert_integer_value_into_json_root(post, "/unknown.json", get_stats_counter(stats, STATS_POST_UNK));
     }
 
     return post;
@@ -590,37 +764,46 @@ json_t *fills_json_with_post_stats(json_t *post, req_post_t *post_stats)
  *        to be returned.
  * @todo Needs a refactoring
  */
-static gchar *answer_global_stats(stats_t *stats)
+static gchar *answer_global_stats(stats_t *stats, block_cache_t *block_cache)
 {
     json_t *root = NULL;
     json_t *get = NULL;
     json_t *post = NULL;
     json_t *unk = NULL;
     json_t *req = NULL;
+    json_t *cache = NULL;
+    json_t *latency = NULL;
     gchar *answer = NULL;
 
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL && stats->requests->post != NULL &&
-        stats->requests->unknown != NULL)
+    if (stats != NULL)
     {
         root = json_object();
 
-        get = make_json_from_stats("Total requests", stats->requests->get->nb_request);
-        get = fills_json_with_get_stats(get, stats->requests->get);
+        get = make_json_from_stats("Total requests", get_stats_counter(stats, STATS_GET));
+        get = fills_json_with_get_stats(get, stats);
 
-        post = make_json_from_stats("Total requests", stats->requests->post->nb_request);
-        fills_json_with_post_stats(post, stats->requests->post);
+        post = make_json_from_stats("Total requests", get_stats_counter(stats, STATS_POST));
+        fills_json_with_post_stats(post, stats);
 
-        unk = make_json_from_stats("Total requests", stats->requests->unknown->nb_request);
-        req = make_json_from_stats("Total requests", stats->requests->nb_request);
+        unk = make_json_from_stats("Total requests", get_stats_counter(stats, STATS_UNKNOWN));
+        req = make_json_from_stats("Total requests", get_stats_counter(stats, STATS_REQUESTS));
         insert_json_value_into_json_root(req, "GET", get);
         insert_json_value_into_json_root(req, "POST", post);
         insert_json_value_into_json_root(req, "Unknown", unk);
         insert_json_value_into_json_root(root, "Requests", req);
 
-        insert_integer_value_into_json_root(root, "files", stats->nb_files);
-        insert_integer_value_into_json_root(root, "total size", stats->nb_total_bytes);
-        insert_integer_value_into_json_root(root, "dedup size", stats->nb_dedup_bytes);
-        insert_integer_value_into_json_root(root, "meta data size", stats->nb_meta_bytes);
+        insert_integer_value_into_json_root(root, "files", get_stats_counter(stats, STATS_FILES));
+        insert_integer_value_into_json_root(root, "total size", get_stats_counter(stats, STATS_TOTAL_BYTES));
+        insert_integer_value_into_json_root(root, "dedup size", get_stats_counter(stats, STATS_DEDUP_BYTES));
+        insert_integer_value_into_json_root(root, "meta data size", get_stats_counter(stats, STATS_META_BYTES));
+
+        cache = json_object();
+        insert_block_cache_stats_into_json_root(cache, block_cache);
+        insert_json_value_into_json_root(root, "block cache", cache);
+
+        latency = json_object();
+        insert_latency_stats_into_json_root(latency, stats);
+        insert_json_value_into_json_root(root, "latency (us)", latency);
 
         answer = json_dumps(root, 0);
     }
@@ -635,12 +818,14 @@ static gchar *answer_global_stats(stats_t *stats)
  * @param server_struct is the main structure for the server.
  * @param connection is the connection in MHD
  * @param url is the requested url
+ * @param[out] latency is set to the histogram where the latency of the
+ *             answer has to be recorded.
  * @note to translators all json requests MUST NOT be translated because
  *       it is the protocol itself !
  * @returns a newlly allocated gchar * string that contains the anwser to be
  *          sent back to the client.
  */
-static gchar *get_json_answer(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url)
+static gchar *get_json_answer(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url, stats_latency_t *latency)
 {
     gchar *answer = NULL;
     gchar *message = NULL;
@@ -652,23 +837,29 @@ static gchar *get_json_answer(server_struct_t *server_struct, struct MHD_Connect
     if (g_str_has_prefix(url, "/Version.json"))
     {
         add_one_to_get_url_version(server_struct->stats, FALSE);
+        *latency = STATS_LATENCY_GET_VERSION;
         answer = convert_version_to_json(PROGRAM_NAME, SERVER_DATE, SERVER_VERSION, SERVER_AUTHORS, SERVER_LICENSE);
     } else if (g_str_has_prefix(url, "/Stats.json"))
     {
         /* Answer a json string with stats on server's usage */
         add_one_to_get_url_stats(server_struct->stats);
-        answer = answer_global_stats(server_struct->stats);
-    } else if (g_str_has_prefix(url, "/File/List.json"))
+        *latency = STATS_LATENCY_GET_STATS;
+        answer = answer_global_stats(server_struct->stats, server_struct->block_cache);
+    } else if (g_str_has_prefix(url, BLOOM_URL))
     {
-        add_one_to_get_url_file_list(server_struct->stats);
-        answer = get_a_list_of_files(server_struct, connection);
-    } else if (g_str_has_prefix(url, "/Data/Hash_Array.json"))
+        add_one_to_get_url_hash_filter(server_struct->stats);
+        *latency = STATS_LATENCY_GET_HASH_FILTER;
+        answer = get_hash_filter(server_struct, connection);
+
+    } else if (g_str_has_prefix(url, DICTIONARY_URL))
     {
-        add_one_to_get_url_data_hash_array(server_struct->stats);
-        answer = get_data_from_a_list_of_hashs(server_struct, connection);
+        add_one_to_get_url_dictionary(server_struct->stats);
+        *latency = STATS_LATENCY_GET_DICTIONARY;
+        answer = get_dictionary(server_struct, connection);
     } else if (g_str_has_prefix(url, "/Data/"))
     {
         add_one_to_get_url_data_hash(server_struct->stats);
+        *latency = STATS_LATENCY_GET_DATA_HASH;
         hash = g_strndup((const gchar *) url + 6,
                          HASH_LEN * 2);  /* HASH_LEN is expressed when hash is in binary form  */
         hash = g_strcanon(hash, "abcdef0123456789", '\0');      /* replace anything not in hexadecimal format with \0 */
@@ -690,6 +881,7 @@ static gchar *get_json_answer(server_struct_t *server_struct, struct MHD_Connect
     } else
     { /* Some sort of echo to the invalid request */
         add_one_to_get_url_unknown(server_struct->stats, FALSE);
+        *latency = STATS_LATENCY_GET_UNK;
         message = g_strdup_printf(_("URL not found: %s"), url);
         answer = answer_json_error_string(MHD_HTTP_NOT_FOUND, message);
         free_variable(message);
@@ -705,10 +897,12 @@ static gchar *get_json_answer(server_struct_t *server_struct, struct MHD_Connect
  * mode
  * @param server_struct is the main structure for the server.
  * @param url is the requested url
+ * @param[out] latency is set to the histogram where the latency of the
+ *             answer has to be recorded.
  * @returns a newlly allocated gchar * string that contains the anwser to be
  *          sent back to the client.
  */
-static gchar *get_unformatted_answer(server_struct_t *server_struct, const char *url)
+static gchar *get_unformatted_answer(server_struct_t *server_struct, const char *url, stats_latency_t *latency)
 {
     gchar *answer = NULL;
     gchar *buf1 = NULL;
@@ -720,6 +914,7 @@ static gchar *get_unformatted_answer(server_struct_t *server_struct, const char
     if (g_strcmp0(url, "/Version") == 0)
     {
         add_one_to_get_url_version(server_struct->stats, TRUE);
+        *latency = STATS_LATENCY_GET_VERSION;
         buf1 = buffer_program_version(PROGRAM_NAME, SERVER_DATE, SERVER_VERSION, SERVER_AUTHORS, SERVER_LICENSE);
         buf2 = buffer_libraries_versions(PROGRAM_NAME);
         buf3 = buffer_selected_option(server_struct->opt);
@@ -729,9 +924,15 @@ static gchar *get_unformatted_answer(server_struct_t *server_struct, const char
         free_variable(buf1);
         free_variable(buf2);
         free_variable(buf3);
+    } else if (g_strcmp0(url, METRICS_URL) == 0)
+    { /* Prometheus' text exposition format */
+        add_one_to_get_url_metrics(server_struct->stats);
+        *latency = STATS_LATENCY_GET_METRICS;
+        answer = convert_stats_to_prometheus(server_struct->stats);
     } else
     { /* Some sort of echo to the invalid request */
         add_one_to_get_url_unknown(server_struct->stats, TRUE);
+        *latency = STATS_LATENCY_GET_UNK;
         answer = g_strdup_printf(_("Error: invalid url: %s\n"), url);
     }
 
@@ -768,6 +969,34 @@ static int create_MHD_response(struct MHD_Connection *connection, gchar *answer,
 }
 
 
+/**
+ * Starts measuring a request when tracing is enabled. The span of the
+ * request is linked to the client's span sent in TRACE_SPAN_HEADER.
+ * @param connection is the connection in MHD
+ * @returns a a_clock_t * clock to be ended with end_clock() or NULL when
+ *          tracing is not enabled.
+ */
+static a_clock_t *new_request_clock(struct MHD_Connection *connection)
+{
+    const char *span = NULL;
+    guint64 parent = 0;
+
+    if (is_trace_enabled() == FALSE)
+    {
+        return NULL;
+    }
+
+    span = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, TRACE_SPAN_HEADER);
+
+    if (span != NULL)
+    {
+        parent = g_ascii_strtoull(span, NULL, 16);
+    }
+
+    return new_clock_t_from_span(parent);
+}
+
+
 /**
  * Function to process get requests received from clients.
  * @param server_struct is the main structure for the server.
@@ -784,6 +1013,9 @@ process_get_request(server_struct_t *server_struct, struct MHD_Connection *conne
     gchar *answer = NULL;
     gchar *content_type = NULL;
     gchar *message = NULL;
+    gint64 start = 0;
+    stats_latency_t latency = STATS_LATENCY_GET_UNK;
+    a_clock_t *request_clock = NULL;
 
     g_assert_nonnull(server_struct);
 
@@ -795,6 +1027,8 @@ process_get_request(server_struct_t *server_struct, struct MHD_Connection *conne
         success = MHD_YES;
     } else
     {
+        start = g_get_monotonic_time();
+        request_clock = new_request_clock(connection);
         add_one_get_request(server_struct->stats);
 
         if (get_debug_mode() == TRUE)
@@ -803,29 +1037,47 @@ process_get_request(server_struct_t *server_struct, struct MHD_Connection *conne
             print_headers(connection);
         }
 
-        if (g_str_has_suffix(url, ".json"))
-        { /* A json format answer was requested */
-            answer = get_json_answer(server_struct, connection, url);
-            content_type = CT_JSON;
+        if (g_str_has_prefix(url, "/File/List.json"))
+        { /* This answer is streamed as it may be huge: the response is queued there */
+            add_one_to_get_url_file_list(server_struct->stats);
+            latency = STATS_LATENCY_GET_FILE_LIST;
+            success = answer_file_list_request(server_struct, connection);
+            *con_cls = NULL;
+        } else if (g_str_has_prefix(url, "/Data/Hash_Array.json"))
+        { /* Streamed too: blocks are sent while the next ones are retrieved */
+            add_one_to_get_url_data_hash_array(server_struct->stats);
+            latency = STATS_LATENCY_GET_DATA_HASH_ARRAY;
+            success = answer_hash_array_request(server_struct, connection);
+            *con_cls = NULL;
         } else
-        { /* An "unformatted" answer was requested */
-            answer = get_unformatted_answer(server_struct, url);
-            content_type = CT_PLAIN;
-        }
+        {
+            if (g_str_has_suffix(url, ".json"))
+            { /* A json format answer was requested */
+                answer = get_json_answer(server_struct, connection, url, &latency);
+                content_type = CT_JSON;
+            } else
+            { /* An "unformatted" answer was requested */
+                answer = get_unformatted_answer(server_struct, url, &latency);
+                content_type = CT_PLAIN;
+            }
 
-        /* reset when done */
-        *con_cls = NULL;
+            /* reset when done */
+            *con_cls = NULL;
 
-        if (answer == NULL)
-        {
-            message = g_strdup_printf(_("Error: could not process GET request for url: %s\n"), url);
-            answer = answer_json_error_string(MHD_HTTP_INTERNAL_SERVER_ERROR, message);
-            free_variable(message);
-        }
+            if (answer == NULL)
+            {
+                message = g_strdup_printf(_("Error: could not process GET request for url: %s\n"), url);
+                answer = answer_json_error_string(MHD_HTTP_INTERNAL_SERVER_ERROR, message);
+                free_variable(message);
+            }
 
-        /* Do not free answer variable as MHD will do it for us ! */
-        success = create_MHD_response(connection, answer, content_type);
+            /* Do not free answer variable as MHD will do it for us ! */
+            success = create_MHD_response(connection, answer, content_type);
+        }
 
+        /* Streamed answers are only measured until they are queued */
+        add_latency_to_stats(server_struct->stats, latency, start);
+        end_clock(request_clock, (gchar *) url);
 
     }
 
@@ -846,6 +1098,7 @@ static json_t *find_needed_hashs(server_struct_t *server_struct, GList *hash_dat
 {
     json_t *array = NULL;   /** json_t *array is the array that will receive base64 encoded needed hashs */
     GList *needed = NULL;   /** GList that contains needed hashs as answered by the backend if any       */
+    gint64 start = 0;
 
     /**
      * Creating a json_t * array with the hashs that are needed. If
@@ -857,7 +1110,9 @@ static json_t *find_needed_hashs(server_struct_t *server_struct, GList *hash_dat
 
     if (server_struct->backend_data->build_needed_hash_list != NULL)
     {
+        start = g_get_monotonic_time();
         needed = server_struct->backend_data->build_needed_hash_list(server_struct, hash_data_list);
+        add_latency_to_stats(server_struct->stats, STATS_LATENCY_BUILD_NEEDED_HASH_LIST, start);
         array = convert_hash_list_to_json(needed);
         g_list_free_full(needed, free_hdt_struct);
     } else
@@ -1095,6 +1350,54 @@ answer_data_array_post_request(server_struct_t *server_struct, struct MHD_Connec
 }
 
 
+/**
+ * Answers /Data/Hash_Array.json POST request: same answer as the GET
+ * request but the hash list is the "hash_list" array of the received
+ * json string instead of the size limited X-Get-Hash-Array HTTP header.
+ * The answer is streamed while blocks are retrieved (see hash_array.c).
+ * @param server_struct is the main structure for the server.
+ * @param connection is the connection in MHD
+ * @param received_data is a guchar * string to the data that was received
+ *        by the POST request.
+ * @returns an int that is either MHD_NO or MHD_YES upon failure or not.
+ */
+static int
+answer_data_hash_array_post_request(server_struct_t *server_struct, struct MHD_Connection *connection, guchar *received_data)
+{
+    struct MHD_Response *response = NULL;
+    hash_array_stream_t *stream = NULL;
+    gchar *answer = NULL;         /** gchar *answer : Do not free answer variable as MHD will do it for us !  */
+    json_t *root = NULL;
+    GList *hash_data_list = NULL;
+    gboolean compressed = FALSE;
+    int success = MHD_NO;
+
+    g_assert_nonnull(server_struct);
+    g_assert_nonnull(server_struct->backend_data);
+
+    if (server_struct->backend_data->retrieve_data != NULL)
+    {
+        root = load_json((gchar *) received_data);
+        hash_data_list = extract_glist_from_array(root, "hash_list", TRUE);
+        json_decref(root);
+        compressed = get_boolean_argument_value_from_key(connection, "compressed");
+
+        /* The stream owns hash_data_list from now on and frees it when the answer has been sent */
+        stream = new_hash_array_stream(server_struct, hash_data_list, compressed);
+        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 65536, &hash_array_stream_reader, stream, &free_hash_array_stream);
+        MHD_add_response_header(response, "Content-Type", CT_JSON);
+        success = MHD_queue_response(connection, MHD_HTTP_OK, response);
+        MHD_destroy_response(response);
+    } else
+    {
+        answer = answer_json_error_string(MHD_HTTP_NOT_IMPLEMENTED, _("This backend's missing a retrieve_data function!"));
+        success = create_MHD_response(connection, answer, CT_JSON);
+    }
+
+    return success;
+}
+
+
 /**
  * Function that process the received data from the POST command and
  * answers to the client.
@@ -1113,24 +1416,36 @@ static int process_received_data(server_struct_t *server_struct, struct MHD_Conn
 {
     gchar *answer = NULL;                   /** gchar *answer : Do not free answer variable as MHD will do it for us ! */
     int success = MHD_NO;
+    gint64 start = g_get_monotonic_time();
+    stats_latency_t latency = STATS_LATENCY_POST_UNK;
+    a_clock_t *request_clock = new_request_clock(connection);
 
     add_one_post_request(server_struct->stats);
 
     if (g_str_has_prefix(url, "/Meta.json") && received_data != NULL)
     {
         add_length_and_one_to_post_url_meta(server_struct->stats, length);
+        latency = STATS_LATENCY_POST_META;
         success = answer_meta_json_post_request(server_struct, connection, received_data, length);
     } else if (g_str_has_prefix(url, "/Hash_Array.json") && received_data != NULL)
     {
         add_one_to_post_url_hash_array(server_struct->stats);
+        latency = STATS_LATENCY_POST_HASH_ARRAY;
         success = answer_hash_array_post_request(server_struct, connection, received_data);
+    } else if (g_str_has_prefix(url, "/Data/Hash_Array.json") && received_data != NULL)
+    {
+        add_one_to_post_url_data_hash_array(server_struct->stats);
+        latency = STATS_LATENCY_POST_DATA_HASH_ARRAY;
+        success = answer_data_hash_array_post_request(server_struct, connection, received_data);
     } else if (g_str_has_prefix(url, "/Data.json") && received_data != NULL)
     {
         add_one_to_post_url_data(server_struct->stats);
+        latency = STATS_LATENCY_POST_DATA;
         success = answer_data_post_request(server_struct, connection, received_data);
     } else if (g_str_has_prefix(url, "/Data_Array.json") && received_data != NULL)
     {
         add_one_to_post_url_data_array(server_struct->stats);
+        latency = STATS_LATENCY_POST_DATA_ARRAY;
         success = answer_data_array_post_request(server_struct, connection, received_data);
     } else
     {
@@ -1141,6 +1456,8 @@ static int process_received_data(server_struct_t *server_struct, struct MHD_Conn
         success = create_MHD_response(connection, answer, CT_PLAIN);
     }
 
+    add_latency_to_stats(server_struct->stats, latency, start);
+    end_clock(request_clock, (gchar *) url);
 
     return success;
 }
@@ -1314,6 +1631,7 @@ static gpointer meta_data_thread(gpointer user_data)
 {
     server_struct_t *server_struct = user_data;
     server_meta_data_t *smeta = NULL;
+    gint64 start = 0;
 
     g_assert_nonnull(server_struct);
     g_assert_nonnull(server_struct->backend_meta);
@@ -1323,20 +1641,24 @@ static gpointer meta_data_thread(gpointer user_data)
         if (server_struct->backend_meta->store_smeta != NULL)
         {
 
-            while (TRUE)
-            {
-                smeta = g_async_queue_pop(server_struct->meta_queue);
+            smeta = g_async_queue_pop(server_struct->meta_queue);
 
+            while (smeta != (gpointer) &queue_end_marker)
+            {
                 if (smeta != NULL && smeta->meta != NULL)
                 {
                     print_debug(_("meta_data_thread: received from %s meta for file %s\n"), smeta->hostname,
                                 smeta->meta->name);
+                    start = g_get_monotonic_time();
                     server_struct->backend_meta->store_smeta(server_struct, smeta);
+                    add_latency_to_stats(server_struct->stats, STATS_LATENCY_STORE_SMETA, start);
                     free_smeta_data_t(smeta);
                 } else
                 {
                     print_error(__FILE__, __LINE__, _("Error: received a NULL pointer.\n"));
                 }
+
+                smeta = g_async_queue_pop(server_struct->meta_queue);
             }
         } else
         {
@@ -1361,6 +1683,8 @@ static gpointer data_thread(gpointer user_data)
 {
     server_struct_t *dt_server_struct = user_data;
     hash_data_t *hash_data = NULL;
+    guint8 *hash = NULL;
+    gint64 start = 0;
 
     g_assert_nonnull(dt_server_struct);
     g_assert_nonnull(dt_server_struct->backend_data);
@@ -1371,14 +1695,30 @@ static gpointer data_thread(gpointer user_data)
         if (dt_server_struct->backend_data->store_data != NULL)
         {
 
-            while (TRUE)
-            {
-                hash_data = g_async_queue_pop(dt_server_struct->data_queue);
+            hash_data = g_async_queue_pop(dt_server_struct->data_queue);
 
+            while (hash_data != (gpointer) &queue_end_marker)
+            {
                 if (hash_data != NULL)
                 {
-                    dt_server_struct->backend_data->store_data(dt_server_struct, hash_data);
+                    /* store_data frees hash_data: the filter gets a copy of the hash
+                     * and only once the block is stored, otherwise clients would
+                     * never send it again.
+                     */
+                    hash = g_memdup(hash_data->hash, HASH_LEN);
+                    start = g_get_monotonic_time();
+
+                    if (dt_server_struct->backend_data->store_data(dt_server_struct, hash_data) == TRUE)
+                    {
+                        hash_filter_add_hash(dt_server_struct->hash_filter, hash);
+                        dictionary_store_block_stored(dt_server_struct->dictionary_store);
+                    }
+
+                    add_latency_to_stats(dt_server_struct->stats, STATS_LATENCY_STORE_DATA, start);
+                    free_variable(hash);
                 }
+
+                hash_data = g_async_queue_pop(dt_server_struct->data_queue);
             }
         } else
         {
@@ -1394,6 +1734,145 @@ static gpointer data_thread(gpointer user_data)
 }
 
 
+/**
+ * Adds one stored hash to the filter. Used as a GFunc by the backend's
+ * foreach_stored_hash function.
+ * @param data is the binary hash (guint8 *).
+ * @param user_data is the hash_filter_t * filter.
+ */
+static void add_stored_hash_to_filter(gpointer data, gpointer user_data)
+{
+    hash_filter_add_hash((hash_filter_t *) user_data, (guint8 *) data);
+}
+
+
+/**
+ * Thread whose aim is to load every hash already stored by the data
+ * backend into the filter. The filter is sent to clients only when
+ * this is done.
+ * @param data : server_struct_t * structure.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer hash_filter_thread(gpointer user_data)
+{
+    server_struct_t *hf_server_struct = user_data;
+    a_clock_t *elapsed = NULL;
+
+    g_assert_nonnull(hf_server_struct);
+    g_assert_nonnull(hf_server_struct->backend_data);
+
+    if (hf_server_struct->hash_filter != NULL && hf_server_struct->backend_data->foreach_stored_hash != NULL)
+    {
+        elapsed = new_clock_t();
+        hf_server_struct->backend_data->foreach_stored_hash(hf_server_struct, add_stored_hash_to_filter, hf_server_struct->hash_filter);
+        hash_filter_set_ready(hf_server_struct->hash_filter);
+        end_clock(elapsed, "hash filter loaded");
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Fills the sample with the beginning of randomly chosen stored blocks
+ * (uncompressed).
+ * @param server_struct is the main structure for the server.
+ * @param sample is the sample to be filled.
+ */
+static void sample_stored_blocks(server_struct_t *server_struct, dictionary_sample_t *sample)
+{
+    backend_t *backend = server_struct->backend_data;
+    hash_data_t *hash_data = NULL;
+    compress_t *compress = NULL;
+    gchar *hash = NULL;
+    guint i = 0;
+
+    backend->foreach_stored_hash(server_struct, dictionary_sample_hash, sample);
+
+    for (i = 0; i < sample->hashs->len; i++)
+    {
+        hash = hash_to_string(g_ptr_array_index(sample->hashs, i));
+        hash_data = backend->retrieve_data(server_struct, hash);
+
+        if (hash_data != NULL && hash_data->cmptype == COMPRESS_NONE_TYPE)
+        {
+            dictionary_sample_add_block(sample, hash_data->data, hash_data->read);
+        }
+        else if (hash_data != NULL)
+        {
+            compress = uncompress_buffer(hash_data->data, hash_data->read, hash_data->uncmplen, hash_data->cmptype);
+
+            if (compress != NULL)
+            {
+                dictionary_sample_add_block(sample, compress->text, compress->len);
+                free_compress_t(compress);
+            }
+        }
+
+        free_hash_data_t(hash_data);
+        free_variable(hash);
+    }
+}
+
+
+/**
+ * Trains a new dictionary from a sample of the stored blocks.
+ * @param server_struct is the main structure for the server.
+ */
+static void train_dictionary(server_struct_t *server_struct)
+{
+    dictionary_sample_t *sample = NULL;
+    a_clock_t *elapsed = NULL;
+    guint id = 0;
+
+    elapsed = new_clock_t();
+    sample = new_dictionary_sample_t();
+
+    sample_stored_blocks(server_struct, sample);
+    id = dictionary_store_train(server_struct->dictionary_store, sample, server_struct->opt->dictionary_size);
+
+    if (id > 0)
+    {
+        print_debug(_("Dictionary %u trained from %u blocks\n"), id, sample->sizes->len);
+    }
+
+    free_dictionary_sample_t(sample);
+    end_clock(elapsed, "dictionary trained");
+}
+
+
+/**
+ * Thread that trains a new dictionary from a sample of the stored blocks
+ * when there is none yet or when asked to on the command line. While
+ * there is still no dictionary a new training is tried each time enough
+ * blocks have been stored. Ends when dictionary_store_stop() is called.
+ * @param data : server_struct_t * structure.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer dictionary_thread(gpointer user_data)
+{
+    server_struct_t *dt_server_struct = user_data;
+
+    g_assert_nonnull(dt_server_struct);
+    g_assert_nonnull(dt_server_struct->backend_data);
+
+    if (dt_server_struct->backend_data->foreach_stored_hash != NULL && dt_server_struct->backend_data->retrieve_data != NULL)
+    {
+        if (dt_server_struct->dictionary_store->latest == 0 || dt_server_struct->opt->train_dictionary == TRUE)
+        {
+            train_dictionary(dt_server_struct);
+        }
+
+        while (dictionary_store_wait_for_training(dt_server_struct->dictionary_store) == TRUE)
+        {
+            train_dictionary(dt_server_struct);
+        }
+    }
+
+    return NULL;
+}
+
+
 /**
  * Installs signals traps in order to be able to close the program as
  * as cleanly as we can.
@@ -1490,6 +1969,16 @@ int main(int argc, char **argv)
         server_struct->meta_thread = g_thread_new("meta-data", meta_data_thread, server_struct);
         server_struct->data_thread = g_thread_new("data", data_thread, server_struct);
 
+        if (server_struct->hash_filter != NULL)
+        {
+            server_struct->filter_thread = g_thread_new("hash-filter", hash_filter_thread, server_struct);
+        }
+
+        if (server_struct->dictionary_store != NULL)
+        {
+            server_struct->dictionary_thread = g_thread_new("dictionary", dictionary_thread, server_struct);
+        }
+
         /* Starting the libmicrohttpd daemon */
         server_struct->d = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION | MHD_USE_DEBUG, server_struct->opt->port,
                                             NULL, NULL, &ahc, server_struct, MHD_OPTION_CONNECTION_MEMORY_LIMIT,
@@ -1516,5 +2005,7 @@ int main(int argc, char **argv)
         print_error(__FILE__, __LINE__, _("Error: initialization failed.\n"));
     }
 
+    terminate_clock_t();
+
     return 0;
 }
@@ -46,6 +46,7 @@
 #include <gio/gio.h>
 #include <glib/gi18n-lib.h>
 #include <glib-unix.h>
+#include <glib/gstdio.h>
 #include <sys/inotify.h>
 #include <errno.h>
 #include <math.h>
@@ -79,6 +80,10 @@
 #include "options.h"
 #include "backend.h"
 #include "stats.h"
+#include "hash_filter.h"
+#include "dictionary_store.h"
+#include "catalog.h"
+#include "block_cache.h"
 
 /**
  * @def DEFAULT_SERVER_BUFFER_SIZE
@@ -108,6 +113,11 @@ typedef struct
     GThread *meta_thread;     /**< Thread that will take care of storing meta data */
     GMainLoop* loop;          /**< Main loop in glib                               */
     stats_t *stats;           /**< Keeps some stats about server usage             */
+    hash_filter_t *hash_filter; /**< Filter of stored hashs sent to clients (may be NULL) */
+    GThread *filter_thread;   /**< Thread that loads already stored hashs into the filter */
+    block_cache_t *block_cache; /**< Cache of recently retrieved blocks (may be NULL)  */
+    dictionary_store_t *dictionary_store; /**< Trained zstd dictionaries (may be NULL)  */
+    GThread *dictionary_thread; /**< Thread that trains a dictionary from stored blocks */
 } server_struct_t;
 
 
@@ -125,8 +135,13 @@ typedef struct
 
 
 #include "file_backend.h"
+#include "memory_backend.h"
 #include "mongodb_backend.h"
+#include "minio_index.h"
+#include "minio_pack.h"
 #include "minio_backend.h"
+#include "file_list.h"
+#include "hash_array.h"
 #include "stats.h"
 
 #endif /* #ifndef _SERVER_H_ */
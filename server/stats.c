@@ -24,160 +24,102 @@
  *
  * This file contains all functions and structures that are used by
  * 'cdpfglserver' Sauvegarde's server for its statistics.
+ *
+ * Counters and latency histograms are sharded: each thread is given a
+ * shard the first time it updates the statistics and always uses it
+ * afterwards. Updates are relaxed atomic additions and shards are summed
+ * up when statistics are read. Histograms are log-linear (HDR-like):
+ * each power of two of microseconds is split into STATS_LATENCY_SUB_BUCKETS
+ * buckets.
  */
 
 #include "server.h"
 
-static req_get_t *new_req_get_t(void);
-static void free_req_get_t(req_get_t *req_get);
-static req_post_t *new_req_post_t(void);
-static void free_req_post_t(req_post_t *req_post);
-static req_unk_t *new_req_unk_t(void);
-static void free_req_unk_t(req_unk_t *req_unk);
-static requests_t *new_requests_t(void);
-static void free_requests_t(requests_t *requests);
-static void add_bytes_to_metadata_bytes(stats_t *stats, size_t nb_bytes);
-
 /**
- * Creates a new req_get_t structure initialized with zeros
- * @return a newly allocated req_get_t structure that can
- *         be freed with free_req_get_t() function when no
- *         longer needed.
+ * @struct stats_latency_name_t
+ * @brief Names used when exposing one latency histogram.
  */
-static req_get_t *new_req_get_t(void)
+typedef struct
 {
-    req_get_t *req_get = NULL;
-
-    req_get = (req_get_t *) g_malloc0(sizeof(req_get_t));
+    const gchar *method;  /**< HTTP method of the endpoint or NULL for a backend operation */
+    const gchar *name;    /**< url of the endpoint or name of the backend operation        */
+} stats_latency_name_t;
 
-    req_get->nb_request = 0;
-    req_get->stats = 0;
-    req_get->version = 0;
-    req_get->verstxt = 0;
-    req_get->file_list = 0;
-    req_get->data_hash = 0;
-    req_get->data_hash_array = 0;
-    req_get->unktxt = 0;
-    req_get->unk = 0;
-
-    return req_get;
-}
 
-
-/**
- * Frees an allocated req_get_t structure
- * @param req_get is an allocated req_get_t structure to be freed.
- */
-static void free_req_get_t(req_get_t *req_get)
+/* Indexed by stats_latency_t */
+static const stats_latency_name_t latency_names[STATS_LATENCIES] =
 {
-    if (req_get != NULL)
-        {
-            g_free(req_get);
-        }
-}
+    {"GET", "/Stats.json"},
+    {"GET", METRICS_URL},
+    {"GET", "/Version.json"},
+    {"GET", "/File/List.json"},
+    {"GET", "/Data/0xxxx.json"},
+    {"GET", "/Data/Hash_Array.json"},
+    {"GET", "/Hash_Filter.json"},
+    {"GET", "/Dictionary.json"},
+    {"GET", "unknown"},
+    {"POST", "/Meta.json"},
+    {"POST", "/Data.json"},
+    {"POST", "/Data_Array.json"},
+    {"POST", "/Hash_Array.json"},
+    {"POST", "/Data/Hash_Array.json"},
+    {"POST", "unknown"},
+    {NULL, "store_smeta"},
+    {NULL, "store_data"},
+    {NULL, "build_needed_hash_list"},
+    {NULL, "get_list_of_files"},
+    {NULL, "retrieve_data"},
+};
+
+
+/* Shard number (plus one) of each thread */
+static GPrivate stats_shard_key = G_PRIVATE_INIT(NULL);
+static gint stats_next_shard = 0;
+
+static stats_shard_t *get_stats_shard(stats_t *stats);
+static void add_to_stats_counter(stats_t *stats, stats_counter_t counter, guint64 value);
+static guint get_latency_bucket(guint64 value);
+static guint64 get_latency_bucket_upper_bound(guint bucket);
+static guint64 get_latency_histogram(stats_t *stats, stats_latency_t latency, guint64 *histogram);
+static guint64 get_latency_percentile(guint64 *histogram, guint64 count, gdouble percentile);
+static void append_latency_to_prometheus(GString *metrics, stats_t *stats, stats_latency_t latency);
 
 
 /**
- * Creates a new req_post_t structure initialized with zeros
- * @return a newly allocated req_post_t structure that can
- *         be freed with free_req_post_t() function when no
- *         longer needed.
+ * Gets the shard of the calling thread.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @returns the stats_shard_t * shard to be updated by the calling thread.
  */
-static req_post_t *new_req_post_t(void)
+static stats_shard_t *get_stats_shard(stats_t *stats)
 {
-    req_post_t *req_post = NULL;
-
-    req_post = (req_post_t *) g_malloc0(sizeof(req_post_t));
+    gint shard = 0;
 
-    req_post->nb_request = 0;
-    req_post->meta = 0;
-    req_post->data = 0;
-    req_post->data_array = 0;
-    req_post->hash_array = 0;
-    req_post->unk = 0;
+    shard = GPOINTER_TO_INT(g_private_get(&stats_shard_key));
 
-    return req_post;
-}
-
-
-/**
- * Frees an allocated req_post_t structure
- * @param req_post is an allocated req_post_t structure to be freed.
- */
-static void free_req_post_t(req_post_t *req_post)
-{
-    if (req_post != NULL)
+    if (shard == 0)
         {
-            g_free(req_post);
+            shard = ((guint) g_atomic_int_add(&stats_next_shard, 1) % STATS_SHARDS) + 1;
+            g_private_set(&stats_shard_key, GINT_TO_POINTER(shard));
         }
-}
-
-
-/**
- * Creates a new req_unk_t structure initialized with zeros
- * @return a newly allocated req_ink_t structure that can
- *         be freed with free_req_unk_t() function when no
- *         longer needed.
- */
-static req_unk_t *new_req_unk_t(void)
-{
-    req_unk_t *req_unk = NULL;
 
-    req_unk = (req_unk_t *) g_malloc0(sizeof(req_unk_t));
-
-    req_unk->nb_request = 0;
-
-    return req_unk;
-}
-
-
-/**
- * Frees an allocated req_get_t structure
- * @param req_unk is an allocated req_unk_t structure to be freed.
- */
-static void free_req_unk_t(req_unk_t *req_unk)
-{
-    if (req_unk != NULL)
-        {
-            g_free(req_unk);
-        }
+    return &stats->shards[shard - 1];
 }
 
 
 /**
- * Creates a new req_requests_t structure initialized with zeros
- * @return a newly allocated requests_t structure that can
- *         be freed with free_requests_t() function when no
- *         longer needed.
+ * Adds value to a counter in the shard of the calling thread.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param counter is the counter to be updated.
+ * @param value is the value to be added to the counter.
  */
-static requests_t *new_requests_t(void)
+static void add_to_stats_counter(stats_t *stats, stats_counter_t counter, guint64 value)
 {
-    requests_t *requests = NULL;
-
-
-    requests = (requests_t *) g_malloc0(sizeof(requests_t));
-
-    requests->get = new_req_get_t();
-    requests->post = new_req_post_t();
-    requests->unknown = new_req_unk_t();
-    requests->nb_request = 0;
-
-    return requests;
-}
-
+    stats_shard_t *shard = NULL;
 
-/**
- * Frees an allocated request_t structure
- * @param requests is an allocated requests_t structure to be freed.
- */
-static void free_requests_t(requests_t *requests)
-{
-    if (requests != NULL)
+    if (stats != NULL)
         {
-            free_req_get_t(requests->get);
-            free_req_post_t(requests->post);
-            free_req_unk_t(requests->unknown);
-            g_free(requests);
+            shard = get_stats_shard(stats);
+            __atomic_fetch_add(&shard->counters[counter], value, __ATOMIC_RELAXED);
         }
 }
 
@@ -194,12 +136,6 @@ stats_t *new_stats_t(void)
 
     stats = (stats_t *) g_malloc0(sizeof(stats_t));
 
-    stats->requests = new_requests_t();
-    stats->nb_files = 0;
-    stats->nb_dedup_bytes = 0;
-    stats->nb_total_bytes = 0;
-    stats->nb_meta_bytes = 0;
-
     return stats;
 }
 
@@ -212,7 +148,6 @@ void free_stats_t(stats_t *stats)
 {
     if (stats != NULL)
         {
-            free_requests_t(stats->requests);
             g_free(stats);
         }
 }
@@ -225,11 +160,8 @@ void free_stats_t(stats_t *stats)
  */
 void add_one_get_request(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
-        {
-            stats->requests->nb_request += 1;
-            stats->requests->get->nb_request +=1;
-        }
+    add_to_stats_counter(stats, STATS_REQUESTS, 1);
+    add_to_stats_counter(stats, STATS_GET, 1);
 }
 
 
@@ -240,11 +172,8 @@ void add_one_get_request(stats_t *stats)
  */
 void add_one_post_request(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
-        {
-            stats->requests->nb_request += 1;
-            stats->requests->post->nb_request += 1;
-        }
+    add_to_stats_counter(stats, STATS_REQUESTS, 1);
+    add_to_stats_counter(stats, STATS_POST, 1);
 }
 
 
@@ -255,11 +184,8 @@ void add_one_post_request(stats_t *stats)
  */
 void add_one_unknown_request(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->unknown != NULL)
-        {
-            stats->requests->nb_request += 1;
-            stats->requests->unknown->nb_request += 1;
-        }
+    add_to_stats_counter(stats, STATS_REQUESTS, 1);
+    add_to_stats_counter(stats, STATS_UNKNOWN, 1);
 }
 
 
@@ -269,25 +195,7 @@ void add_one_unknown_request(stats_t *stats)
  */
 void add_one_saved_file(stats_t *stats)
 {
-    if (stats != NULL)
-        {
-            stats->nb_files += 1;
-        }
-}
-
-
-/**
- * Adds meta data bytes to the stats structure
- * @param stats is a stats_t structure to keep some stats about server runs
- * @param nb_bytes is a size_t number representing the number of bytes to
- *        add to the stats
- */
-static void add_bytes_to_metadata_bytes(stats_t *stats, size_t nb_bytes)
-{
-    if (stats != NULL)
-        {
-            stats->nb_meta_bytes += (guint64) nb_bytes;
-        }
+    add_to_stats_counter(stats, STATS_FILES, 1);
 }
 
 
@@ -299,10 +207,7 @@ static void add_bytes_to_metadata_bytes(stats_t *stats, size_t nb_bytes)
  */
 void add_file_size_to_total_size(stats_t *stats, guint64 size)
 {
-    if (stats != NULL)
-        {
-            stats->nb_total_bytes += size;
-        }
+    add_to_stats_counter(stats, STATS_TOTAL_BYTES, size);
 }
 
 
@@ -314,9 +219,9 @@ void add_file_size_to_total_size(stats_t *stats, guint64 size)
  */
 void add_hash_size_to_dedup_bytes(stats_t *stats, hash_data_t *hash_data)
 {
-    if (stats != NULL && hash_data != NULL)
+    if (hash_data != NULL)
         {
-            stats->nb_dedup_bytes += hash_data->read;
+            add_to_stats_counter(stats, STATS_DEDUP_BYTES, hash_data->read);
         }
 }
 
@@ -327,31 +232,35 @@ void add_hash_size_to_dedup_bytes(stats_t *stats, hash_data_t *hash_data)
  */
 void add_one_to_get_url_stats(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
-        {
-            stats->requests->get->stats += 1;
-        }
+    add_to_stats_counter(stats, STATS_GET_STATS, 1);
+}
+
+
+/**
+ * Adds one to the number of visits of /Metrics url
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+void add_one_to_get_url_metrics(stats_t *stats)
+{
+    add_to_stats_counter(stats, STATS_GET_METRICS, 1);
 }
 
 
 /**
  * Adds one to the number of visits of /Version.json or /Version url
  * @param stats is a stats_t structure to keep some stats about server's usage.
- * @param txt is a boolean set to TRUE if the URL is a text one (not ending with
+ * @param txt is a boolean set to TRUE if the URL is a text one (not ending with
  *            .json
  */
 void add_one_to_get_url_version(stats_t *stats, gboolean txt)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
+    if (txt == TRUE)
         {
-            if (txt == TRUE)
-                {
-                    stats->requests->get->verstxt += 1;
-                }
-            else
-                {
-                    stats->requests->get->version += 1;
-                }
+            add_to_stats_counter(stats, STATS_GET_VERSTXT, 1);
+        }
+    else
+        {
+            add_to_stats_counter(stats, STATS_GET_VERSION, 1);
         }
 }
 
@@ -362,10 +271,7 @@ void add_one_to_get_url_version(stats_t *stats, gboolean txt)
  */
 void add_one_to_get_url_file_list(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
-        {
-            stats->requests->get->file_list += 1;
-        }
+    add_to_stats_counter(stats, STATS_GET_FILE_LIST, 1);
 }
 
 
@@ -375,10 +281,7 @@ void add_one_to_get_url_file_list(stats_t *stats)
  */
 void add_one_to_get_url_data_hash(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
-        {
-            stats->requests->get->data_hash += 1;
-        }
+    add_to_stats_counter(stats, STATS_GET_DATA_HASH, 1);
 }
 
 
@@ -388,10 +291,27 @@ void add_one_to_get_url_data_hash(stats_t *stats)
  */
 void add_one_to_get_url_data_hash_array(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
-        {
-            stats->requests->get->data_hash_array += 1;
-        }
+    add_to_stats_counter(stats, STATS_GET_DATA_HASH_ARRAY, 1);
+}
+
+
+/**
+ * Adds one to the number of visits of /Hash_Filter.json url
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+void add_one_to_get_url_hash_filter(stats_t *stats)
+{
+    add_to_stats_counter(stats, STATS_GET_HASH_FILTER, 1);
+}
+
+
+/**
+ * Adds one to the number of visits of /Dictionary.json url
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+void add_one_to_get_url_dictionary(stats_t *stats)
+{
+    add_to_stats_counter(stats, STATS_GET_DICTIONARY, 1);
 }
 
 
@@ -399,21 +319,18 @@ void add_one_to_get_url_data_hash_array(stats_t *stats)
  * Adds one to the number of visits of unknown URL (if txt is FALSE then the
  * unknown URL ends with .json
  * @param stats is a stats_t structure to keep some stats about server's usage.
- * @param txt is a boolean set to TRUE if the URL is a text one (not ending with
+ * @param txt is a boolean set to TRUE if the URL is a text one (not ending with
  *            .json
  */
 void add_one_to_get_url_unknown(stats_t *stats, gboolean txt)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
+    if (txt == TRUE)
         {
-            if (txt == TRUE)
-                {
-                    stats->requests->get->unktxt += 1;
-                }
-            else
-                {
-                    stats->requests->get->unk += 1;
-                }
+            add_to_stats_counter(stats, STATS_GET_UNKTXT, 1);
+        }
+    else
+        {
+            add_to_stats_counter(stats, STATS_GET_UNK, 1);
         }
 }
 
@@ -426,11 +343,8 @@ void add_one_to_get_url_unknown(stats_t *stats, gboolean txt)
  */
 void add_length_and_one_to_post_url_meta(stats_t *stats, guint64 length)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
-        {
-            stats->requests->post->meta += 1;
-            add_bytes_to_metadata_bytes(stats, length);
-        }
+    add_to_stats_counter(stats, STATS_POST_META, 1);
+    add_to_stats_counter(stats, STATS_META_BYTES, length);
 }
 
 
@@ -440,10 +354,7 @@ void add_length_and_one_to_post_url_meta(stats_t *stats, guint64 length)
  */
 void add_one_to_post_url_hash_array(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
-        {
-            stats->requests->post->hash_array += 1;
-        }
+    add_to_stats_counter(stats, STATS_POST_HASH_ARRAY, 1);
 }
 
 
@@ -453,10 +364,7 @@ void add_one_to_post_url_hash_array(stats_t *stats)
  */
 void add_one_to_post_url_data(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
-        {
-            stats->requests->post->data += 1;
-        }
+    add_to_stats_counter(stats, STATS_POST_DATA, 1);
 }
 
 
@@ -466,10 +374,17 @@ void add_one_to_post_url_data(stats_t *stats)
  */
 void add_one_to_post_url_data_array(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
-        {
-            stats->requests->post->data_array += 1;
-        }
+    add_to_stats_counter(stats, STATS_POST_DATA_ARRAY, 1);
+}
+
+
+/**
+ * Adds one to the number of visits of /Data/Hash_Array.json (POST)
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+void add_one_to_post_url_data_hash_array(stats_t *stats)
+{
+    add_to_stats_counter(stats, STATS_POST_DATA_HASH_ARRAY, 1);
 }
 
 
@@ -479,8 +394,332 @@ void add_one_to_post_url_data_array(stats_t *stats)
  */
 void add_one_to_post_url_unknown(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
+    add_to_stats_counter(stats, STATS_POST_UNK, 1);
+}
+
+
+/*** Latencies ***/
+/**
+ * Gets the bucket of the histograms where a latency is counted.
+ * @param value is the latency in µs.
+ * @returns the index of the bucket.
+ */
+static guint get_latency_bucket(guint64 value)
+{
+    guint msb = 0;
+    guint bucket = 0;
+
+    if (value < STATS_LATENCY_SUB_BUCKETS)
+        {
+            bucket = (guint) value;
+        }
+    else if (value >= ((guint64) 1 << STATS_LATENCY_MAX_BITS))
+        {
+            bucket = STATS_LATENCY_BUCKETS - 1;
+        }
+    else
+        {
+            msb = g_bit_storage((gulong) value) - 1;
+            bucket = STATS_LATENCY_SUB_BUCKETS + (msb - STATS_LATENCY_SUB_BITS) * STATS_LATENCY_SUB_BUCKETS;
+            bucket = bucket + ((value >> (msb - STATS_LATENCY_SUB_BITS)) & (STATS_LATENCY_SUB_BUCKETS - 1));
+        }
+
+    return bucket;
+}
+
+
+/**
+ * Gets the upper bound of a bucket of the histograms.
+ * @param bucket is the index of the bucket.
+ * @returns the smallest latency (in µs) that is counted in the next
+ *          bucket.
+ */
+static guint64 get_latency_bucket_upper_bound(guint bucket)
+{
+    guint msb = 0;
+    guint sub = 0;
+
+    if (bucket < STATS_LATENCY_SUB_BUCKETS)
+        {
+            return bucket + 1;
+        }
+    else
+        {
+            msb = STATS_LATENCY_SUB_BITS + (bucket - STATS_LATENCY_SUB_BUCKETS) / STATS_LATENCY_SUB_BUCKETS;
+            sub = (bucket - STATS_LATENCY_SUB_BUCKETS) % STATS_LATENCY_SUB_BUCKETS;
+
+            return ((guint64) STATS_LATENCY_SUB_BUCKETS + sub + 1) << (msb - STATS_LATENCY_SUB_BITS);
+        }
+}
+
+
+/**
+ * Records one latency into its histogram.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param latency is the endpoint or backend operation that was measured.
+ * @param start is the time (from g_get_monotonic_time()) at which the
+ *        measured operation started.
+ */
+void add_latency_to_stats(stats_t *stats, stats_latency_t latency, gint64 start)
+{
+    stats_shard_t *shard = NULL;
+    gint64 elapsed = 0;
+
+    if (stats != NULL && latency < STATS_LATENCIES)
+        {
+            elapsed = g_get_monotonic_time() - start;
+
+            if (elapsed < 0)
+                {
+                    elapsed = 0;
+                }
+
+            shard = get_stats_shard(stats);
+            __atomic_fetch_add(&shard->histograms[latency][get_latency_bucket(elapsed)], 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&shard->sums[latency], (guint64) elapsed, __ATOMIC_RELAXED);
+        }
+}
+
+
+/**
+ * Gets the value of a counter summed up over all the shards.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param counter is the counter to be read.
+ * @returns the value of the counter.
+ */
+guint64 get_stats_counter(stats_t *stats, stats_counter_t counter)
+{
+    guint64 value = 0;
+    guint i = 0;
+
+    if (stats != NULL && counter < STATS_COUNTERS)
         {
-            stats->requests->post->unk += 1;
+            for (i = 0; i < STATS_SHARDS; i++)
+                {
+                    value = value + __atomic_load_n(&stats->shards[i].counters[counter], __ATOMIC_RELAXED);
+                }
         }
+
+    return value;
+}
+
+
+/**
+ * Sums up the histogram of one latency over all the shards.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param latency is the histogram to be read.
+ * @param[out] histogram is an array of STATS_LATENCY_BUCKETS guint64
+ *             filled with the summed up histogram.
+ * @returns the number of latencies recorded in the histogram.
+ */
+static guint64 get_latency_histogram(stats_t *stats, stats_latency_t latency, guint64 *histogram)
+{
+    guint64 count = 0;
+    guint i = 0;
+    guint b = 0;
+
+    for (b = 0; b < STATS_LATENCY_BUCKETS; b++)
+        {
+            histogram[b] = 0;
+
+            for (i = 0; i < STATS_SHARDS; i++)
+                {
+                    histogram[b] = histogram[b] + __atomic_load_n(&stats->shards[i].histograms[latency][b], __ATOMIC_RELAXED);
+                }
+
+            count = count + histogram[b];
+        }
+
+    return count;
+}
+
+
+/**
+ * Gets a percentile from a histogram.
+ * @param histogram is an array of STATS_LATENCY_BUCKETS guint64.
+ * @param count is the number of latencies recorded in histogram.
+ * @param percentile is the percentile to get (between 0 and 1).
+ * @returns the upper bound (in µs) of the bucket where the percentile
+ *          lies.
+ */
+static guint64 get_latency_percentile(guint64 *histogram, guint64 count, gdouble percentile)
+{
+    guint64 rank = 0;
+    guint64 seen = 0;
+    guint b = 0;
+
+    rank = (guint64) ceil(count * percentile);
+
+    for (b = 0; b < STATS_LATENCY_BUCKETS - 1; b++)
+        {
+            seen = seen + histogram[b];
+
+            if (seen >= rank)
+                {
+                    break;
+                }
+        }
+
+    return get_latency_bucket_upper_bound(b);
+}
+
+
+/**
+ * Inserts the 50th and 99th percentiles (in µs) of each latency that has
+ * been recorded at least once into a json object.
+ * @param root is the json object where to insert statistics.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+void insert_latency_stats_into_json_root(json_t *root, stats_t *stats)
+{
+    guint64 histogram[STATS_LATENCY_BUCKETS];
+    guint64 count = 0;
+    json_t *percentiles = NULL;
+    gchar *name = NULL;
+    guint l = 0;
+
+    if (root != NULL && stats != NULL)
+        {
+            for (l = 0; l < STATS_LATENCIES; l++)
+                {
+                    count = get_latency_histogram(stats, l, histogram);
+
+                    if (count > 0)
+                        {
+                            percentiles = json_object();
+                            insert_integer_value_into_json_root(percentiles, "count", count);
+                            insert_integer_value_into_json_root(percentiles, "p50", get_latency_percentile(histogram, count, 0.50));
+                            insert_integer_value_into_json_root(percentiles, "p99", get_latency_percentile(histogram, count, 0.99));
+
+                            if (latency_names[l].method != NULL)
+                                {
+                                    name = g_strdup_printf("%s %s", latency_names[l].method, latency_names[l].name);
+                                }
+                            else
+                                {
+                                    name = g_strdup_printf("backend %s", latency_names[l].name);
+                                }
+
+                            json_object_set_new(root, name, percentiles);
+                            free_variable(name);
+                        }
+                }
+        }
+}
+
+
+/**
+ * Appends one latency histogram to Prometheus' metrics. Only buckets
+ * ending on a power of two are exposed to keep the answer small.
+ * @param metrics is the GString where to append the histogram.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param latency is the histogram to be appended.
+ */
+static void append_latency_to_prometheus(GString *metrics, stats_t *stats, stats_latency_t latency)
+{
+    guint64 histogram[STATS_LATENCY_BUCKETS];
+    guint64 count = 0;
+    guint64 cumulative = 0;
+    guint64 bound = 0;
+    guint64 sum = 0;
+    gchar *metric = NULL;
+    gchar *labels = NULL;
+    gchar seconds[G_ASCII_DTOSTR_BUF_SIZE];   /* Prometheus needs a '.' whatever the locale is */
+    guint b = 0;
+    guint i = 0;
+
+    count = get_latency_histogram(stats, latency, histogram);
+
+    if (count > 0)
+        {
+            if (latency_names[latency].method != NULL)
+                {
+                    metric = "cdpfgl_request_duration_seconds";
+                    labels = g_strdup_printf("method=\"%s\",url=\"%s\"", latency_names[latency].method, latency_names[latency].name);
+                }
+            else
+                {
+                    metric = "cdpfgl_backend_duration_seconds";
+                    labels = g_strdup_printf("operation=\"%s\"", latency_names[latency].name);
+                }
+
+            for (b = 0; b < STATS_LATENCY_BUCKETS - 1; b++)
+                {
+                    cumulative = cumulative + histogram[b];
+                    bound = get_latency_bucket_upper_bound(b);
+
+                    if ((bound & (bound - 1)) == 0)
+                        {
+                            g_ascii_formatd(seconds, G_ASCII_DTOSTR_BUF_SIZE, "%.6f", bound / 1000000.0);
+                            g_string_append_printf(metrics, "%s_bucket{%s,le=\"%s\"} %"G_GUINT64_FORMAT"\n", metric, labels, seconds, cumulative);
+                        }
+                }
+
+            for (i = 0; i < STATS_SHARDS; i++)
+                {
+                    sum = sum + __atomic_load_n(&stats->shards[i].sums[latency], __ATOMIC_RELAXED);
+                }
+
+            g_string_append_printf(metrics, "%s_bucket{%s,le=\"+Inf\"} %"G_GUINT64_FORMAT"\n", metric, labels, count);
+            g_ascii_formatd(seconds, G_ASCII_DTOSTR_BUF_SIZE, "%.6f", sum / 1000000.0);
+            g_string_append_printf(metrics, "%s_sum{%s} %s\n", metric, labels, seconds);
+            g_string_append_printf(metrics, "%s_count{%s} %"G_GUINT64_FORMAT"\n", metric, labels, count);
+
+            free_variable(labels);
+        }
+}
+
+
+/**
+ * Converts the statistics to Prometheus' text exposition format.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @returns a newly allocated gchar * string that may be freed when no
+ *          longer needed.
+ */
+gchar *convert_stats_to_prometheus(stats_t *stats)
+{
+    GString *metrics = NULL;
+    guint l = 0;
+
+    metrics = g_string_new("");
+
+    g_string_append(metrics, "# HELP cdpfgl_requests_total Number of requests received by the server.\n");
+    g_string_append(metrics, "# TYPE cdpfgl_requests_total counter\n");
+    g_string_append_printf(metrics, "cdpfgl_requests_total{method=\"GET\"} %"G_GUINT64_FORMAT"\n", get_stats_counter(stats, STATS_GET));
+    g_string_append_printf(metrics, "cdpfgl_requests_total{method=\"POST\"} %"G_GUINT64_FORMAT"\n", get_stats_counter(stats, STATS_POST));
+    g_string_append_printf(metrics, "cdpfgl_requests_total{method=\"unknown\"} %"G_GUINT64_FORMAT"\n", get_stats_counter(stats, STATS_UNKNOWN));
+
+    g_string_append(metrics, "# HELP cdpfgl_saved_files_total Number of versions of files saved.\n");
+    g_string_append(metrics, "# TYPE cdpfgl_saved_files_total counter\n");
+    g_string_append_printf(metrics, "cdpfgl_saved_files_total %"G_GUINT64_FORMAT"\n", get_stats_counter(stats, STATS_FILES));
+
+    g_string_append(metrics, "# HELP cdpfgl_saved_bytes_total Size of the files saved (before deduplication).\n");
+    g_string_append(metrics, "# TYPE cdpfgl_saved_bytes_total counter\n");
+    g_string_append_printf(metrics, "cdpfgl_saved_bytes_total %"G_GUINT64_FORMAT"\n", get_stats_counter(stats, STATS_TOTAL_BYTES));
+
+    g_string_append(metrics, "# HELP cdpfgl_dedup_bytes_total Size of the blocks received (after deduplication).\n");
+    g_string_append(metrics, "# TYPE cdpfgl_dedup_bytes_total counter\n");
+    g_string_append_printf(metrics, "cdpfgl_dedup_bytes_total %"G_GUINT64_FORMAT"\n", get_stats_counter(stats, STATS_DEDUP_BYTES));
+
+    g_string_append(metrics, "# HELP cdpfgl_meta_bytes_total Size of the meta data received.\n");
+    g_string_append(metrics, "# TYPE cdpfgl_meta_bytes_total counter\n");
+    g_string_append_printf(metrics, "cdpfgl_meta_bytes_total %"G_GUINT64_FORMAT"\n", get_stats_counter(stats, STATS_META_BYTES));
+
+    g_string_append(metrics, "# HELP cdpfgl_request_duration_seconds Time spent answering requests.\n");
+    g_string_append(metrics, "# TYPE cdpfgl_request_duration_seconds histogram\n");
+
+    for (l = 0; l <= STATS_LATENCY_POST_UNK; l++)
+        {
+            append_latency_to_prometheus(metrics, stats, l);
+        }
+
+    g_string_append(metrics, "# HELP cdpfgl_backend_duration_seconds Time spent in backend operations.\n");
+    g_string_append(metrics, "# TYPE cdpfgl_backend_duration_seconds histogram\n");
+
+    for (l = STATS_LATENCY_STORE_SMETA; l < STATS_LATENCIES; l++)
+        {
+            append_latency_to_prometheus(metrics, stats, l);
+        }
+
+    return g_string_free(metrics, FALSE);
 }
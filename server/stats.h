@@ -31,64 +31,126 @@
 #include "../config.h"
 
 /**
- * @struct req_get_t
- * @brief structure to keep stats about 'GET' requests
+ * @def STATS_SHARDS
+ * Number of shards of the statistics. Each thread always updates the same
+ * shard and shards are summed up when read.
  */
-typedef struct
-{
-    guint64 nb_request;       /** total number of 'GET' requests          */
-    guint64 stats;            /** number of GET /Stats.json URL           */
-    guint64 version;          /** number of GET /Version.json URL         */
-    guint64 verstxt;          /** number of GET /Version URL              */
-    guint64 file_list;        /** number of GET /File/List.json URL       */
-    guint64 data_hash;        /** number of GET /Data/0xxxx.json URL      */
-    guint64 data_hash_array;  /** number of GET /Data/Hash_Array.json URL */
-    guint64 unktxt;           /** number of GET to unknown text URL       */
-    guint64 unk;              /** number of GET to unknown json URL       */
-} req_get_t;
+#define STATS_SHARDS (8)
 
 
-typedef struct
+/**
+ * @def STATS_LATENCY_SUB_BITS
+ * Each power of two of the latency histograms is divided into
+ * 2^STATS_LATENCY_SUB_BITS buckets (giving a relative error of at most
+ * 12.5%).
+ */
+#define STATS_LATENCY_SUB_BITS (3)
+#define STATS_LATENCY_SUB_BUCKETS (1 << STATS_LATENCY_SUB_BITS)
+
+
+/**
+ * @def STATS_LATENCY_MAX_BITS
+ * Latencies are in microseconds and are recorded up to
+ * 2^STATS_LATENCY_MAX_BITS µs (more than one hour). Longer ones are
+ * counted in the last bucket.
+ */
+#define STATS_LATENCY_MAX_BITS (32)
+#define STATS_LATENCY_BUCKETS (STATS_LATENCY_SUB_BUCKETS + (STATS_LATENCY_MAX_BITS - STATS_LATENCY_SUB_BITS) * STATS_LATENCY_SUB_BUCKETS)
+
+
+/**
+ * @def METRICS_URL
+ * URL that answers statistics in Prometheus' text format.
+ */
+#define METRICS_URL ("/Metrics")
+
+
+/**
+ * @enum stats_counter_t
+ * @brief Counters kept about the server's usage.
+ */
+typedef enum
 {
-    guint64 nb_request; /** total number of 'POST' requests                 */
-    guint64 meta;       /** Counts usage of 'POST' for /Meta.json URL       */
-    guint64 data;       /** Counts usage of 'POST' for /Data.json URL       */
-    guint64 data_array; /** Counts usage of 'POST' for /Data_Array.json URL */
-    guint64 hash_array; /** Counts usage of 'POST' for /Hash_Array.json URL */
-    guint64 unk;        /** Counts wrong usages (unknown urls)              */
-} req_post_t;
+    STATS_REQUESTS = 0,          /**< total number of requests                            */
+    STATS_GET,                   /**< total number of 'GET' requests                      */
+    STATS_GET_STATS,             /**< number of GET /Stats.json URL                       */
+    STATS_GET_METRICS,           /**< number of GET /Metrics URL                          */
+    STATS_GET_VERSION,           /**< number of GET /Version.json URL                     */
+    STATS_GET_VERSTXT,           /**< number of GET /Version URL                          */
+    STATS_GET_FILE_LIST,         /**< number of GET /File/List.json URL                   */
+    STATS_GET_DATA_HASH,         /**< number of GET /Data/0xxxx.json URL                  */
+    STATS_GET_DATA_HASH_ARRAY,   /**< number of GET /Data/Hash_Array.json URL             */
+    STATS_GET_HASH_FILTER,       /**< number of GET /Hash_Filter.json URL                 */
+    STATS_GET_DICTIONARY,        /**< number of GET /Dictionary.json URL                  */
+    STATS_GET_UNKTXT,            /**< number of GET to unknown text URL                   */
+    STATS_GET_UNK,               /**< number of GET to unknown json URL                   */
+    STATS_POST,                  /**< total number of 'POST' requests                     */
+    STATS_POST_META,             /**< Counts usage of 'POST' for /Meta.json URL            */
+    STATS_POST_DATA,             /**< Counts usage of 'POST' for /Data.json URL            */
+    STATS_POST_DATA_ARRAY,       /**< Counts usage of 'POST' for /Data_Array.json URL      */
+    STATS_POST_HASH_ARRAY,       /**< Counts usage of 'POST' for /Hash_Array.json URL      */
+    STATS_POST_DATA_HASH_ARRAY,  /**< Counts usage of 'POST' for /Data/Hash_Array.json URL */
+    STATS_POST_UNK,              /**< Counts wrong usages (unknown urls)                  */
+    STATS_UNKNOWN,               /**< total number of 'unknown' requests                  */
+    STATS_FILES,                 /**< number of version of files saved                    */
+    STATS_DEDUP_BYTES,           /**< number of bytes saved by the server (the dedup ones) */
+    STATS_TOTAL_BYTES,           /**< number of bytes of saved files (before dedup)       */
+    STATS_META_BYTES,            /**< number of bytes of all the meta data saved          */
+    STATS_COUNTERS               /**< number of counters (not a counter)                  */
+} stats_counter_t;
 
 
-typedef struct
+/**
+ * @enum stats_latency_t
+ * @brief Endpoints and backend operations whose latencies are recorded.
+ */
+typedef enum
 {
-    guint64 nb_request; /** total number of 'unknown requests */
-} req_unk_t;
+    STATS_LATENCY_GET_STATS = 0,
+    STATS_LATENCY_GET_METRICS,
+    STATS_LATENCY_GET_VERSION,
+    STATS_LATENCY_GET_FILE_LIST,
+    STATS_LATENCY_GET_DATA_HASH,
+    STATS_LATENCY_GET_DATA_HASH_ARRAY,
+    STATS_LATENCY_GET_HASH_FILTER,
+    STATS_LATENCY_GET_DICTIONARY,
+    STATS_LATENCY_GET_UNK,
+    STATS_LATENCY_POST_META,
+    STATS_LATENCY_POST_DATA,
+    STATS_LATENCY_POST_DATA_ARRAY,
+    STATS_LATENCY_POST_HASH_ARRAY,
+    STATS_LATENCY_POST_DATA_HASH_ARRAY,
+    STATS_LATENCY_POST_UNK,
+    STATS_LATENCY_STORE_SMETA,            /**< backend's store_smeta            */
+    STATS_LATENCY_STORE_DATA,             /**< backend's store_data             */
+    STATS_LATENCY_BUILD_NEEDED_HASH_LIST, /**< backend's build_needed_hash_list */
+    STATS_LATENCY_GET_LIST_OF_FILES,      /**< backend's get_list_of_files      */
+    STATS_LATENCY_RETRIEVE_DATA,          /**< backend's retrieve_data          */
+    STATS_LATENCIES                       /**< number of latency histograms     */
+} stats_latency_t;
 
 
 /**
- * @struct requests_t
- * @brief structure to keep track of request usages
+ * @struct stats_shard_t
+ * @brief One shard of the statistics. Values are only updated with
+ *        atomic operations.
  */
 typedef struct
 {
-    req_get_t *get;      /** keeps stats about 'GET' requests     */
-    req_post_t *post;    /** keeps stats about 'POST' requests    */
-    req_unk_t *unknown;  /** keeps stats about 'unknown' requests */
-    guint64 nb_request;  /** total number of requests             */
-} requests_t;
+    guint64 counters[STATS_COUNTERS];                               /**< counters indexed by stats_counter_t                */
+    guint64 histograms[STATS_LATENCIES][STATS_LATENCY_BUCKETS];    /**< latency histograms indexed by stats_latency_t      */
+    guint64 sums[STATS_LATENCIES];                                  /**< sum of the latencies (µs) recorded in histograms   */
+} stats_shard_t;
 
 
 /**
  * @struct stats_t
- * @brief Structure that will contain some statistics.
+ * @brief Structure that will contain some statistics. Counters are
+ *        sharded so that threads do not fight over the same cache lines.
  */
 typedef struct
 {
-    requests_t *requests;
-    guint64 nb_files;        /**< nb_files is the number of version of files saved                                              */
-    guint64 nb_dedup_bytes;  /**< nb_dedup_bytes is the number of bytes saved by the server (the dedup ones)                    */
-    guint64 nb_total_bytes;  /**< nb_total_bytes is the number of bytes represented by file sizes of saved files (before dedup) */
-    guint64 nb_meta_bytes;   /**< nb_meta_bytes is the number of bytes of all the meta data saved                               */
+    stats_shard_t shards[STATS_SHARDS];  /**< shards of the statistics */
 } stats_t;
 
 
@@ -164,6 +226,13 @@ extern void add_hash_size_to_dedup_bytes(stats_t *stats, hash_data_t *hash_data)
 extern void add_one_to_get_url_stats(stats_t *stats);
 
 
+/**
+ * Adds one to the number of visits of /Metrics url
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+extern void add_one_to_get_url_metrics(stats_t *stats);
+
+
 /**
  * Adds one to the number of visits of /Version.json or /Version url
  * @param stats is a stats_t structure to keep some stats about server's usage.
@@ -194,6 +263,20 @@ extern void add_one_to_get_url_data_hash(stats_t *stats);
 extern void add_one_to_get_url_data_hash_array(stats_t *stats);
 
 
+/**
+ * Adds one to the number of visits of /Hash_Filter.json url
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+extern void add_one_to_get_url_hash_filter(stats_t *stats);
+
+
+/**
+ * Adds one to the number of visits of /Dictionary.json url
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+extern void add_one_to_get_url_dictionary(stats_t *stats);
+
+
 /**
  * Adds one to the number of visits of unknown URL (if txt is FALSE then the
  * unknown URL ends with .json
@@ -233,6 +316,13 @@ extern void add_one_to_post_url_data(stats_t *stats);
 extern void add_one_to_post_url_data_array(stats_t *stats);
 
 
+/**
+ * Adds one to the number of visits of /Data/Hash_Array.json (POST)
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+extern void add_one_to_post_url_data_hash_array(stats_t *stats);
+
+
 /**
  * Adds one to the number of visits of an unknown url (wrong usages)
  * @param stats is a stats_t structure to keep some stats about server's usage.
@@ -240,4 +330,41 @@ extern void add_one_to_post_url_data_array(stats_t *stats);
 extern void add_one_to_post_url_unknown(stats_t *stats);
 
 
+/**
+ * Records one latency into its histogram.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param latency is the endpoint or backend operation that was measured.
+ * @param start is the time (from g_get_monotonic_time()) at which the
+ *        measured operation started.
+ */
+extern void add_latency_to_stats(stats_t *stats, stats_latency_t latency, gint64 start);
+
+
+/**
+ * Gets the value of a counter summed up over all the shards.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param counter is the counter to be read.
+ * @returns the value of the counter.
+ */
+extern guint64 get_stats_counter(stats_t *stats, stats_counter_t counter);
+
+
+/**
+ * Inserts the 50th and 99th percentiles (in µs) of each latency that has
+ * been recorded at least once into a json object.
+ * @param root is the json object where to insert statistics.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+extern void insert_latency_stats_into_json_root(json_t *root, stats_t *stats);
+
+
+/**
+ * Converts the statistics to Prometheus' text exposition format.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @returns a newly allocated gchar * string that may be freed when no
+ *          longer needed.
+ */
+extern gchar *convert_stats_to_prometheus(stats_t *stats);
+
+
 #endif /* #ifndef _STATS_H_ */
@@ -0,0 +1,357 @@
+#!/bin/bash
+#
+#  benchmark.bash
+#  Runs the client against a local server (file backend) on generated
+#  datasets and reports throughput figures as json lines.
+#
+#  This file is part of "Sauvegarde" project.
+#
+#  (C) Copyright 2019 Olivier Delhomme
+#   e-mail : olivier.delhomme@free.fr
+#
+#  "Sauvegarde" is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  "Sauvegarde" is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+
+# Usage: benchmark.bash [BUILD_DIR] [SCENARIO...]
+#
+# BUILD_DIR is where cdpfglserver and cdpfglclient were built (default is
+# the parent directory of this script). SCENARIO is one or more of small,
+# huge, versioned, zero and incompressible (default is all of them).
+#
+# Every value below may be overridden from the environment, for instance:
+#   BLOCKSIZE=65536 CMPTYPE=2 ./tests/benchmark.bash . small huge
+#
+# Each pass prints one json line (and appends it to $RESULTS) with:
+# the scenario, the pass, the client options, the number of files and
+# bytes, the elapsed seconds, MB/s, files/s, CPU seconds (client and
+# server) per GB, the peak RSS in KB of both programs, the dedup ratio
+# (size of the files / size of the blocks received) and the size of
+# the server's data directory.
+#
+# Datasets are generated from fixed seeds so that two runs (or two
+# machines) save exactly the same bytes. openssl and curl are needed.
+# The client runs until the server has received no new file for
+# $STABLE seconds: the elapsed time stops at the last received file.
+# For stable figures you may want to fix the CPU frequency first, for
+# instance with: cpupower frequency-set -g performance
+
+# Client options to be benchmarked
+BLOCKSIZE=${BLOCKSIZE:-16384}
+ADAPTIVE=${ADAPTIVE:-0}
+CMPTYPE=${CMPTYPE:-0}
+BUFFERSIZE=${BUFFERSIZE:-1048576}
+
+# Server options
+PORT=${PORT:-15468}
+DIR_LEVEL=${DIR_LEVEL:-2}
+
+# Datasets sizes
+SMALL_FILES=${SMALL_FILES:-20000}    # Number of small files (text, up to 16 KB each)
+HUGE_SIZE_MB=${HUGE_SIZE_MB:-1024}   # Size of the huge file (a quarter of its 4 MB segments are repeated)
+ZERO_SIZE_MB=${ZERO_SIZE_MB:-256}    # Size of the zero-heavy file (1 MB of data every 16 MB)
+RANDOM_SIZE_MB=${RANDOM_SIZE_MB:-256}    # Size of the incompressible file
+VERSIONED_EDITS=${VERSIONED_EDITS:-10}   # One file out of VERSIONED_EDITS is edited between two passes
+
+# Where everything is generated (it is removed at the beginning)
+BENCH_DIR=${BENCH_DIR:-/tmp/cdpfgl-benchmark}
+RESULTS=${RESULTS:-${BENCH_DIR}/results.json}
+
+# Seconds without any new file on the server before ending a pass
+STABLE=${STABLE:-5}
+
+###### It should not be necessary for you to change anything below #####
+
+BUILD_DIR=${1:-$(dirname "$0")/..}
+shift
+SCENARIOS=${*:-small huge versioned zero incompressible}
+
+SERVER="${BUILD_DIR}/server/cdpfglserver"
+CLIENT="${BUILD_DIR}/client/cdpfglclient"
+URL="http://127.0.0.1:${PORT}"
+CLK_TCK=$(getconf CLK_TCK)
+
+for program in openssl curl "${SERVER}" "${CLIENT}"; do
+    if ! command -v "${program}" >/dev/null; then
+        echo "${program} is needed to run the benchmark" >&2
+        exit 1
+    fi
+done
+
+
+# Writes $2 pseudo random bytes generated from seed $1 to stdout.
+random_bytes() {
+    openssl enc -aes-128-ctr -nosalt -pass "pass:$1" -md sha256 </dev/zero 2>/dev/null | head -c "$2"
+}
+
+
+# Generates $2 small text files in directory $1. Sizes and contents only
+# depend on the file number.
+make_small_files() {
+    mkdir -p "$1"
+    awk -v dir="$1" -v count="$2" 'BEGIN {
+        for (i = 0; i < count; i++) {
+            sub_dir = sprintf("%s/%03d", dir, i % 100);
+            if (i < 100) {
+                system("mkdir -p " sub_dir);
+            }
+            file = sprintf("%s/file_%06d.txt", sub_dir, i);
+            lines = (i * 7919) % 256 + 1;
+            for (j = 0; j < lines; j++) {
+                printf("%08d %08d the quick brown fox jumps over the lazy dog %d\n", i, j, (i * j) % 9973) > file;
+            }
+            close(file);
+        }
+    }'
+}
+
+
+# Generates a huge file $1 of $2 MB of 4 MB random segments where every
+# fourth segment repeats the first one.
+make_huge_file() {
+    local segment=0
+
+    : >"$1"
+    while [ ${segment} -lt $(($2 / 4)) ]; do
+        if [ $((segment % 4)) -eq 3 ]; then
+            random_bytes "huge-0" 4194304 >>"$1"
+        else
+            random_bytes "huge-${segment}" 4194304 >>"$1"
+        fi
+        segment=$((segment + 1))
+    done
+}
+
+
+# Generates a zero-heavy file $1 of $2 MB: one MB of random data every
+# 16 MB, the rest are zeros.
+make_zero_file() {
+    local mb=0
+
+    truncate -s "$2M" "$1"
+    while [ ${mb} -lt "$2" ]; do
+        random_bytes "zero-${mb}" 1048576 | dd of="$1" bs=1M seek=${mb} conv=notrunc status=none
+        mb=$((mb + 16))
+    done
+}
+
+
+# Generates a directory $1 for the versioned scenario: some small text
+# files and some 8 MB random files.
+make_versioned_files() {
+    local i=0
+
+    make_small_files "$1/small" $((SMALL_FILES / 10))
+    mkdir -p "$1/big"
+    while [ ${i} -lt 16 ]; do
+        random_bytes "versioned-${i}" 8388608 >"$1/big/file_${i}.bin"
+        i=$((i + 1))
+    done
+}
+
+
+# Edits one file out of VERSIONED_EDITS in directory $1: a line is
+# appended to small files and 4 KB are overwritten in big ones.
+edit_versioned_files() {
+    local i=0
+    local file=""
+
+    find "$1" -type f | sort | while read -r file; do
+        if [ $((i % VERSIONED_EDITS)) -eq 0 ]; then
+            case "${file}" in
+                *.bin) random_bytes "edit-${i}" 4096 | dd of="${file}" bs=4096 seek=256 conv=notrunc status=none ;;
+                *)     echo "edited line ${i}" >>"${file}" ;;
+            esac
+        fi
+        i=$((i + 1))
+    done
+}
+
+
+# Prints the integer value of key $1 in the server's /Stats.json answer.
+server_stat() {
+    curl -s "${URL}/Stats.json" | sed -n "s/.*\"$1\": *\([0-9]*\).*/\1/p"
+}
+
+
+# Prints utime + stime (in clock ticks) of process $1.
+cpu_ticks() {
+    awk '{ print $14 + $15 }' "/proc/$1/stat" 2>/dev/null || echo 0
+}
+
+
+# Prints the peak RSS (in KB) of process $1.
+peak_rss() {
+    awk '/^VmHWM:/ { print $2 }' "/proc/$1/status" 2>/dev/null || echo 0
+}
+
+
+# Starts a server whose data goes to $1 and waits until it answers.
+start_server() {
+    cat >"$1.conf" <<EOF
+[All]
+debug-mode=false
+
+[Server]
+server-port=${PORT}
+server-backend-meta=FILE
+server-backend-data=FILE
+dictionary-dir=$1/dictionaries
+
+[File_Backend]
+file-directory=$1
+dir-level=${DIR_LEVEL}
+EOF
+
+    "${SERVER}" -c "$1.conf" >"$1.log" 2>&1 &
+    SERVER_PID=$!
+
+    until curl -s "${URL}/Version.json" >/dev/null; do
+        sleep 1
+    done
+}
+
+
+# Stops the server.
+stop_server() {
+    kill "${SERVER_PID}" 2>/dev/null
+    wait "${SERVER_PID}" 2>/dev/null
+}
+
+
+# Runs one pass of the client on directory $3 with its cache in $4 and
+# prints its results for scenario $1 and pass $2.
+run_pass() {
+    local scenario="$1"
+    local pass="$2"
+    local data="$3"
+    local cache="$4"
+    local files=0
+    local bytes=0
+    local begin=0
+    local last=0
+    local now=0
+    local received=0
+    local previous=0
+    local total_before=0
+    local dedup_before=0
+    local server_ticks=0
+    local client_ticks=0
+    local client_rss=0
+    local server_rss=0
+    local stored=0
+
+    files=$(find "${data}" -type f | wc -l)
+    bytes=$(find "${data}" -type f -printf '%s\n' | awk '{ s += $1 } END { print s + 0 }')
+
+    mkdir -p "${cache}"
+    cat >"${cache}.conf" <<EOF
+[All]
+debug-mode=false
+
+[Client]
+directory-list=${data}
+cache-directory=${cache}
+cache-db-name=filecache.db
+
+[Server]
+server-ip=127.0.0.1
+server-port=${PORT}
+EOF
+
+    previous=$(server_stat files)
+    total_before=$(server_stat "total size")
+    dedup_before=$(server_stat "dedup size")
+    server_ticks=$(cpu_ticks "${SERVER_PID}")
+
+    begin=$(date +%s.%N)
+    last=${begin}
+    "${CLIENT}" -c "${cache}.conf" -b "${BLOCKSIZE}" -a "${ADAPTIVE}" -z "${CMPTYPE}" -s "${BUFFERSIZE}" >"${cache}.log" 2>&1 &
+    CLIENT_PID=$!
+
+    # Waiting until the server receives no more files
+    now=${begin}
+    while awk -v now="${now}" -v last="${last}" -v stable="${STABLE}" 'BEGIN { exit !(now - last < stable) }'; do
+        sleep 0.2
+        now=$(date +%s.%N)
+        received=$(server_stat files)
+        if [ "${received}" != "${previous}" ]; then
+            previous=${received}
+            last=${now}
+        fi
+    done
+
+    client_ticks=$(cpu_ticks "${CLIENT_PID}")
+    client_rss=$(peak_rss "${CLIENT_PID}")
+    server_ticks=$(($(cpu_ticks "${SERVER_PID}") - server_ticks))
+    server_rss=$(peak_rss "${SERVER_PID}")
+
+    kill "${CLIENT_PID}" 2>/dev/null
+    wait "${CLIENT_PID}" 2>/dev/null
+
+    stored=$(du -sb "${BENCH_DIR}/server/data" | awk '{ print $1 }')
+
+    awk -v scenario="${scenario}" -v pass="${pass}" -v files="${files}" -v bytes="${bytes}" \
+        -v begin="${begin}" -v last="${last}" -v ticks=$((client_ticks + server_ticks)) -v clk="${CLK_TCK}" \
+        -v client_rss="${client_rss}" -v server_rss="${server_rss}" -v stored="${stored}" \
+        -v total=$(($(server_stat "total size") - total_before)) -v dedup=$(($(server_stat "dedup size") - dedup_before)) \
+        -v blocksize="${BLOCKSIZE}" -v adaptive="${ADAPTIVE}" -v cmptype="${CMPTYPE}" -v buffersize="${BUFFERSIZE}" \
+        'BEGIN {
+            seconds = last - begin;
+            if (seconds <= 0) { seconds = 0.001; }
+            gb = bytes / 1073741824;
+            printf("{\"scenario\": \"%s\", \"pass\": %d, \"blocksize\": %d, \"adaptive\": %d, \"cmptype\": %d, \"buffersize\": %d, ", scenario, pass, blocksize, adaptive, cmptype, buffersize);
+            printf("\"files\": %d, \"bytes\": %d, \"seconds\": %.3f, \"mb_per_s\": %.3f, \"files_per_s\": %.3f, ", files, bytes, seconds, bytes / 1048576 / seconds, files / seconds);
+            printf("\"cpu_s_per_gb\": %.3f, \"client_peak_rss_kb\": %d, \"server_peak_rss_kb\": %d, ", (gb > 0 ? ticks / clk / gb : 0), client_rss, server_rss);
+            printf("\"dedup_ratio\": %.3f, \"stored_bytes\": %d}\n", (dedup > 0 ? total / dedup : 0), stored);
+        }' | tee -a "${RESULTS}"
+}
+
+
+# Runs scenario $1 on the dataset generated by function $2 (with
+# arguments $3...). The versioned scenario runs a second pass after
+# editing files.
+run_scenario() {
+    local scenario="$1"
+    local data="${BENCH_DIR}/data/${scenario}"
+
+    shift
+    rm -rf "${BENCH_DIR}/server" "${BENCH_DIR}/client"
+    mkdir -p "${data}"
+    "$@"
+
+    start_server "${BENCH_DIR}/server"
+    run_pass "${scenario}" 1 "${data}" "${BENCH_DIR}/client"
+
+    if [ "${scenario}" = "versioned" ]; then
+        edit_versioned_files "${data}"
+        run_pass "${scenario}" 2 "${data}" "${BENCH_DIR}/client"
+    fi
+
+    stop_server
+}
+
+
+rm -rf "${BENCH_DIR}"
+mkdir -p "${BENCH_DIR}"
+
+for scenario in ${SCENARIOS}; do
+    data="${BENCH_DIR}/data/${scenario}"
+    case "${scenario}" in
+        small)          run_scenario small make_small_files "${data}" "${SMALL_FILES}" ;;
+        huge)           run_scenario huge make_huge_file "${data}/huge_file" "${HUGE_SIZE_MB}" ;;
+        versioned)      run_scenario versioned make_versioned_files "${data}" ;;
+        zero)           run_scenario zero make_zero_file "${data}/zero_file" "${ZERO_SIZE_MB}" ;;
+        incompressible) run_scenario incompressible eval 'random_bytes incompressible $((RANDOM_SIZE_MB * 1048576)) >"${data}/random_file"' ;;
+        *)              echo "Unknown scenario: ${scenario}" >&2 ;;
+    esac
+done
@@ -0,0 +1,924 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    loadgen.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file loadgen.c
+ * This file contains 'cdpfglload', a program that loads a server with
+ * many simulated hosts. Each host is a thread with its own connection
+ * that saves files the way cdpfglclient does (/Hash_Array.json,
+ * /Data_Array.json and /Meta.json) and reads some of them back the way
+ * cdpfglrestore does (/File/List.json and /Data/Hash_Array.json).
+ * Blocks are either taken from a pool shared by all hosts (duplicated
+ * blocks) or unique to a host, so the dedup ratio can be chosen. At the
+ * end the latency percentiles of each url and the throughput seen by
+ * the server (from /Stats.json) are printed.
+ */
+
+#include "libcdpfgl.h"
+
+/**
+ * @def LOAD_POOL_SIZE
+ * Number of blocks in the pool of duplicated blocks shared by all
+ * simulated hosts.
+ */
+#define LOAD_POOL_SIZE (4096)
+
+/**
+ * @def LOAD_KEPT_FILES
+ * Number of saved files each simulated host remembers to read them
+ * back.
+ */
+#define LOAD_KEPT_FILES (16)
+
+
+/**
+ * @enum load_url_t
+ * Urls of the protocol used by the simulated hosts.
+ */
+typedef enum
+{
+    LOAD_HASH_ARRAY,       /**< POST /Hash_Array.json      */
+    LOAD_DATA_ARRAY,       /**< POST /Data_Array.json      */
+    LOAD_META,             /**< POST /Meta.json            */
+    LOAD_FILE_LIST,        /**< GET /File/List.json        */
+    LOAD_DATA_HASH_ARRAY,  /**< POST /Data/Hash_Array.json */
+    LOAD_URLS              /**< Number of urls             */
+} load_url_t;
+
+static const gchar *load_url_names[LOAD_URLS] = {"/Hash_Array.json", "/Data_Array.json", "/Meta.json", "/File/List.json", "/Data/Hash_Array.json"};
+
+
+/**
+ * @struct load_t
+ * @brief Parameters of the load shared by all simulated hosts.
+ */
+typedef struct
+{
+    gchar *conn;        /**< Connexion string to the server (http://ip:port)         */
+    gint hosts;         /**< Number of simulated hosts                               */
+    gint duration;      /**< Duration of the load in seconds                         */
+    gint64 blocksize;   /**< Size of blocks                                          */
+    gint blocks;        /**< Number of blocks of each saved file                     */
+    gint dedup;         /**< Percentage of blocks taken from the pool of duplicates  */
+    gint writes;        /**< Percentage of operations that save a file (others read) */
+    gshort cmptype;     /**< Compression type of blocks                              */
+    gint seed;          /**< Seed of the pseudo random number generators             */
+    gint64 deadline;    /**< Monotonic time at which hosts stop                      */
+} load_t;
+
+
+/**
+ * @struct kept_file_t
+ * @brief A file saved by a simulated host that it may read back.
+ */
+typedef struct
+{
+    gchar *name;        /**< Name of the file                     */
+    GList *hash_list;   /**< hash_data_t list (only hashs) of the file */
+} kept_file_t;
+
+
+/**
+ * @struct host_t
+ * @brief A simulated host with its own connection and measures.
+ */
+typedef struct
+{
+    load_t *load;                     /**< Parameters of the load                             */
+    guint id;                         /**< Number of the host                                 */
+    gchar *hostname;                  /**< Hostname sent to the server                        */
+    comm_t *comm;                     /**< Connection of this host                            */
+    GRand *rand;                      /**< Pseudo random number generator of this host        */
+    GChecksum *checksum;              /**< Used to compute hashs of blocks                    */
+    guint64 counter;                  /**< Number of unique blocks generated                  */
+    guint nb_files;                   /**< Number of files saved                              */
+    kept_file_t kept[LOAD_KEPT_FILES];/**< Last saved files                                   */
+    GArray *latencies[LOAD_URLS];     /**< Latencies (in µs) of each request for each url     */
+    guint64 errors[LOAD_URLS];        /**< Number of failed requests for each url             */
+    guint64 bytes_sent;               /**< Bytes of blocks sent                               */
+    guint64 bytes_received;           /**< Bytes of answers of /Data/Hash_Array.json          */
+    guint64 files_read;               /**< Number of files read back                          */
+} host_t;
+
+
+static void fill_block(guchar *block, gsize size, guint64 id);
+static hash_data_t *new_load_block(host_t *host);
+static gint check_response_code(host_t *host, load_url_t url, gint success);
+static gint timed_post(host_t *host, load_url_t url, gchar *request);
+static gint timed_get(host_t *host, load_url_t url, gchar *request);
+static gchar *make_hash_list_body(GList *hash_list);
+static GList *post_hash_array(host_t *host, GList *hash_data_list);
+static void post_data_array(host_t *host, GList *hash_data_list, GList *needed);
+static void post_meta(host_t *host, gchar *name, GList *hash_data_list);
+static void keep_file(host_t *host, gchar *name, GList *hash_data_list);
+static void save_one_file(host_t *host);
+static void read_one_file(host_t *host);
+static gpointer run_host(gpointer data);
+static host_t *new_host_t(load_t *load, guint id);
+static void free_host_t(host_t *host);
+static gint compare_hash_data(gconstpointer a, gconstpointer b);
+static gint compare_latencies(gconstpointer a, gconstpointer b);
+static gdouble get_percentile(GArray *latencies, gdouble percentile);
+static json_t *get_server_stats(comm_t *comm);
+static guint64 get_stats_value(json_t *stats, gchar *keyname);
+static void print_latencies(host_t **hosts, guint nb_hosts);
+static void print_throughputs(load_t *load, host_t **hosts, json_t *before, json_t *after, gdouble seconds);
+
+
+/**
+ * Fills a block with pseudo random bytes that only depend on id
+ * (xorshift64 generator).
+ * @param block is the block to fill.
+ * @param size is the size of the block.
+ * @param id identifies the content of the block.
+ */
+static void fill_block(guchar *block, gsize size, guint64 id)
+{
+    guint64 x = id * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15) + 1;
+    gsize i = 0;
+    gsize len = 0;
+
+    while (i < size)
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            len = MIN(sizeof(x), size - i);
+            memcpy(block + i, &x, len);
+            i = i + len;
+        }
+}
+
+
+/**
+ * Makes a new block for a file of host. With a probability of
+ * load->dedup percent the block is one of the LOAD_POOL_SIZE blocks
+ * shared by all hosts, otherwise it is unique.
+ * @param host is the simulated host saving a file.
+ * @returns a newly allocated hash_data_t (compressed as stated by
+ *          load->cmptype).
+ */
+static hash_data_t *new_load_block(host_t *host)
+{
+    hash_data_t *hash_data = NULL;
+    guchar *block = NULL;
+    guint8 *hash = NULL;
+    gsize digest_len = HASH_LEN;
+    guint64 id = 0;
+    gssize size = host->load->blocksize;
+
+    if (g_rand_int_range(host->rand, 0, 100) < host->load->dedup)
+        {
+            id = g_rand_int_range(host->rand, 0, LOAD_POOL_SIZE);
+        }
+    else
+        {
+            id = ((guint64) (host->id + 1) << 40) | host->counter;
+            host->counter = host->counter + 1;
+        }
+
+    block = (guchar *) g_malloc(size);
+    hash = (guint8 *) g_malloc(HASH_LEN);
+    fill_block(block, size, id);
+
+    g_checksum_reset(host->checksum);
+    g_checksum_update(host->checksum, block, size);
+    g_checksum_get_digest(host->checksum, hash, &digest_len);
+
+    hash_data = new_hash_data_t(block, size, hash, host->load->cmptype);
+
+    if (hash_data->data != block)
+        {
+            free_variable(block);
+        }
+
+    return hash_data;
+}
+
+
+/**
+ * Counts an error for url when the request failed or when the server
+ * answered with an HTTP error (4xx or 5xx) that libcurl does not report.
+ * @param host is the simulated host.
+ * @param url tells what url has been requested.
+ * @param success is the CURLcode of the request.
+ * @returns success or CURLE_HTTP_RETURNED_ERROR when the server
+ *          answered with an HTTP error.
+ */
+static gint check_response_code(host_t *host, load_url_t url, gint success)
+{
+    glong code = 0;
+
+    if (success == CURLE_OK)
+        {
+            curl_easy_getinfo(host->comm->curl_handle, CURLINFO_RESPONSE_CODE, &code);
+
+            if (code >= 400)
+                {
+                    success = CURLE_HTTP_RETURNED_ERROR;
+                }
+        }
+
+    if (success != CURLE_OK)
+        {
+            host->errors[url] = host->errors[url] + 1;
+        }
+
+    return success;
+}
+
+
+/**
+ * POSTs host->comm->readbuffer to request and records the latency of
+ * the request for url. readbuffer is freed.
+ * @param host is the simulated host.
+ * @param url tells what url is requested.
+ * @param request is the request (url and its parameters).
+ * @returns a CURLcode (CURLE_OK upon success, an HTTP error is an error).
+ */
+static gint timed_post(host_t *host, load_url_t url, gchar *request)
+{
+    gint success = CURLE_FAILED_INIT;
+    gint64 begin = 0;
+    gint64 latency = 0;
+
+    begin = g_get_monotonic_time();
+    success = post_url(host->comm, request);
+    latency = g_get_monotonic_time() - begin;
+
+    g_array_append_val(host->latencies[url], latency);
+    success = check_response_code(host, url, success);
+
+    free_variable(host->comm->readbuffer);
+    host->comm->readbuffer = NULL;
+
+    return success;
+}
+
+
+/**
+ * GETs request and records the latency of the request for url.
+ * @param host is the simulated host.
+ * @param url tells what url is requested.
+ * @param request is the request (url and its parameters).
+ * @returns a CURLcode (CURLE_OK upon success, an HTTP error is an error).
+ */
+static gint timed_get(host_t *host, load_url_t url, gchar *request)
+{
+    gint success = CURLE_FAILED_INIT;
+    gint64 begin = 0;
+    gint64 latency = 0;
+
+    begin = g_get_monotonic_time();
+    success = get_url(host->comm, request, NULL);
+    latency = g_get_monotonic_time() - begin;
+
+    g_array_append_val(host->latencies[url], latency);
+    success = check_response_code(host, url, success);
+
+    return success;
+}
+
+
+/**
+ * Makes a {"hash_list":[...]} json string with the base64 encoded hashs
+ * of the list.
+ * @param hash_list is a list of hash_data_t.
+ * @returns a newly allocated json string.
+ */
+static gchar *make_hash_list_body(GList *hash_list)
+{
+    json_t *root = NULL;
+    gchar *body = NULL;
+
+    root = json_object();
+    insert_json_value_into_json_root(root, "hash_list", convert_hash_list_to_json(hash_list));
+    body = json_dumps(root, 0);
+    json_decref(root);
+
+    return body;
+}
+
+
+/**
+ * Asks the server which hashs of the list it needs.
+ * @param host is the simulated host.
+ * @param hash_data_list is the list of blocks of the file being saved.
+ * @returns the list of needed hashs (hash_data_t without data) as
+ *          answered by the server or NULL.
+ */
+static GList *post_hash_array(host_t *host, GList *hash_data_list)
+{
+    json_t *root = NULL;
+    GList *needed = NULL;
+
+    host->comm->readbuffer = make_hash_list_body(hash_data_list);
+
+    if (timed_post(host, LOAD_HASH_ARRAY, "/Hash_Array.json") == CURLE_OK && host->comm->buffer != NULL)
+        {
+            root = load_json(host->comm->buffer);
+
+            if (root != NULL)
+                {
+                    needed = extract_glist_from_array(root, "hash_list", TRUE);
+                    json_decref(root);
+                }
+        }
+
+    free_variable(host->comm->buffer);
+    host->comm->buffer = NULL;
+
+    return needed;
+}
+
+
+/**
+ * Sends the needed blocks of the list to the server in one
+ * /Data_Array.json request.
+ * @param host is the simulated host.
+ * @param hash_data_list is the list of blocks of the file being saved.
+ * @param needed is the list of hashs needed by the server.
+ */
+static void post_data_array(host_t *host, GList *hash_data_list, GList *needed)
+{
+    json_t *root = NULL;
+    json_t *array = NULL;
+    GList *iter = NULL;
+    hash_data_t *hash_data = NULL;
+
+    if (needed != NULL)
+        {
+            array = json_array();
+
+            while (hash_data_list != NULL)
+                {
+                    hash_data = hash_data_list->data;
+                    iter = g_list_find_custom(needed, hash_data, compare_hash_data);
+
+                    if (iter != NULL)
+                        {
+                            json_array_append_new(array, convert_hash_data_t_to_json(hash_data));
+                            host->bytes_sent = host->bytes_sent + hash_data->read;
+                            /* A block present twice in the file is sent once */
+                            needed = g_list_delete_link(needed, iter);
+                        }
+
+                    hash_data_list = g_list_next(hash_data_list);
+                }
+
+            root = json_object();
+            insert_json_value_into_json_root(root, "data_array", array);
+            host->comm->readbuffer = json_dumps(root, 0);
+            json_decref(root);
+
+            timed_post(host, LOAD_DATA_ARRAY, "/Data_Array.json");
+            free_variable(host->comm->buffer);
+            host->comm->buffer = NULL;
+
+            g_list_free_full(needed, free_hdt_struct);
+        }
+}
+
+
+/**
+ * Sends the meta data of a file whose data has been sent.
+ * @param host is the simulated host.
+ * @param name is the name of the file.
+ * @param hash_data_list is the list of blocks (only hashs) of the file.
+ */
+static void post_meta(host_t *host, gchar *name, GList *hash_data_list)
+{
+    meta_data_t *meta = NULL;
+    guint64 now = 0;
+
+    now = g_get_real_time() / G_USEC_PER_SEC;
+
+    meta = new_meta_data_t();
+    meta->file_type = G_FILE_TYPE_REGULAR;
+    meta->inode = host->nb_files;
+    meta->mode = 0644;
+    meta->atime = now;
+    meta->ctime = now;
+    meta->mtime = now;
+    meta->size = host->load->blocksize * host->load->blocks;
+    meta->owner = g_strdup("cdpfglload");
+    meta->group = g_strdup("cdpfglload");
+    meta->name = g_strdup(name);
+    meta->blocksize = host->load->blocksize;
+    meta->hash_data_list = hash_data_list;
+
+    host->comm->readbuffer = convert_meta_data_to_json_string(meta, host->hostname, TRUE);
+    timed_post(host, LOAD_META, "/Meta.json");
+    free_variable(host->comm->buffer);
+    host->comm->buffer = NULL;
+
+    meta->hash_data_list = NULL; /* the list belongs to the caller */
+    free_meta_data_t(meta, TRUE);
+}
+
+
+/**
+ * Remembers a saved file in order to read it back later. The oldest
+ * file kept is forgotten.
+ * @param host is the simulated host.
+ * @param name is the name of the file (it now belongs to host).
+ * @param hash_data_list is the list of blocks (only hashs) of the file
+ *        (it now belongs to host).
+ */
+static void keep_file(host_t *host, gchar *name, GList *hash_data_list)
+{
+    kept_file_t *kept = NULL;
+
+    kept = &host->kept[host->nb_files % LOAD_KEPT_FILES];
+
+    free_variable(kept->name);
+    g_list_free_full(kept->hash_list, free_hdt_struct);
+
+    kept->name = name;
+    kept->hash_list = hash_data_list;
+    host->nb_files = host->nb_files + 1;
+}
+
+
+/**
+ * Saves a new file of load->blocks blocks as cdpfglclient does.
+ * @param host is the simulated host.
+ */
+static void save_one_file(host_t *host)
+{
+    GList *hash_data_list = NULL;
+    GList *needed = NULL;
+    GList *iter = NULL;
+    hash_data_t *hash_data = NULL;
+    gchar *name = NULL;
+    gint i = 0;
+
+    for (i = 0; i < host->load->blocks; i++)
+        {
+            hash_data_list = g_list_prepend(hash_data_list, new_load_block(host));
+        }
+
+    hash_data_list = g_list_reverse(hash_data_list);
+
+    needed = post_hash_array(host, hash_data_list);
+    post_data_array(host, hash_data_list, needed);
+
+    /* Only hashs are needed from now on */
+    for (iter = hash_data_list; iter != NULL; iter = g_list_next(iter))
+        {
+            hash_data = iter->data;
+            free_variable(hash_data->data);
+            hash_data->data = NULL;
+        }
+
+    name = g_strdup_printf("/cdpfglload/%s/file_%08u", host->hostname, host->nb_files);
+    post_meta(host, name, hash_data_list);
+    keep_file(host, name, hash_data_list);
+}
+
+
+/**
+ * Reads back a file saved by host as cdpfglrestore does: its meta data
+ * first and then all its blocks in one /Data/Hash_Array.json request.
+ * Saves a file if none has been saved yet.
+ * @param host is the simulated host.
+ */
+static void read_one_file(host_t *host)
+{
+    kept_file_t *kept = NULL;
+    gchar *request = NULL;
+    guint nb_kept = 0;
+
+    nb_kept = MIN(host->nb_files, LOAD_KEPT_FILES);
+
+    if (nb_kept == 0)
+        {
+            save_one_file(host);
+        }
+    else
+        {
+            kept = &host->kept[g_rand_int_range(host->rand, 0, nb_kept)];
+
+            request = g_strdup_printf("/File/List.json?hostname=%s&filename=%s", host->hostname, kept->name);
+            timed_get(host, LOAD_FILE_LIST, request);
+            free_variable(request);
+            free_variable(host->comm->buffer);
+            host->comm->buffer = NULL;
+
+            host->comm->readbuffer = make_hash_list_body(kept->hash_list);
+
+            if (timed_post(host, LOAD_DATA_HASH_ARRAY, "/Data/Hash_Array.json?compressed=True") == CURLE_OK && host->comm->buffer != NULL)
+                {
+                    host->bytes_received = host->bytes_received + strlen(host->comm->buffer);
+                    host->files_read = host->files_read + 1;
+                }
+
+            free_variable(host->comm->buffer);
+            host->comm->buffer = NULL;
+        }
+}
+
+
+/**
+ * Thread of a simulated host: saves or reads files until the deadline.
+ * @param data is the host_t structure of the host.
+ * @returns NULL
+ */
+static gpointer run_host(gpointer data)
+{
+    host_t *host = (host_t *) data;
+
+    while (g_get_monotonic_time() < host->load->deadline)
+        {
+            if (g_rand_int_range(host->rand, 0, 100) < host->load->writes)
+                {
+                    save_one_file(host);
+                }
+            else
+                {
+                    read_one_file(host);
+                }
+        }
+
+    return NULL;
+}
+
+
+/**
+ * Creates a new simulated host.
+ * @param load is the load shared by all hosts.
+ * @param id is the number of this host.
+ * @returns a newly allocated host_t structure.
+ */
+static host_t *new_host_t(load_t *load, guint id)
+{
+    host_t *host = NULL;
+    guint i = 0;
+
+    host = (host_t *) g_malloc0(sizeof(host_t));
+    g_assert_nonnull(host);
+
+    host->load = load;
+    host->id = id;
+    host->hostname = g_strdup_printf("cdpfglload-%04u", id);
+    host->comm = init_comm_struct(load->conn, load->cmptype);
+    host->rand = g_rand_new_with_seed((guint32) load->seed + id);
+    host->checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+    for (i = 0; i < LOAD_URLS; i++)
+        {
+            host->latencies[i] = g_array_new(FALSE, FALSE, sizeof(gint64));
+        }
+
+    return host;
+}
+
+
+/**
+ * Frees a simulated host.
+ * @param host is the host_t structure to be freed.
+ */
+static void free_host_t(host_t *host)
+{
+    guint i = 0;
+
+    if (host != NULL)
+        {
+            for (i = 0; i < LOAD_KEPT_FILES; i++)
+                {
+                    free_variable(host->kept[i].name);
+                    g_list_free_full(host->kept[i].hash_list, free_hdt_struct);
+                }
+
+            for (i = 0; i < LOAD_URLS; i++)
+                {
+                    g_array_free(host->latencies[i], TRUE);
+                }
+
+            g_checksum_free(host->checksum);
+            g_rand_free(host->rand);
+            free_comm_t(host->comm);
+            free_variable(host->hostname);
+            free_variable(host);
+        }
+}
+
+
+/**
+ * Compares the hashs of two hash_data_t for g_list_find_custom().
+ * @param a is a hash_data_t structure.
+ * @param b is a hash_data_t structure.
+ * @returns 0 if both hashs are equal.
+ */
+static gint compare_hash_data(gconstpointer a, gconstpointer b)
+{
+    return compare_two_hashs(((const hash_data_t *) a)->hash, ((const hash_data_t *) b)->hash);
+}
+
+
+/**
+ * Compares two latencies for g_array_sort().
+ * @param a is a pointer to a gint64 latency.
+ * @param b is a pointer to a gint64 latency.
+ * @returns a negative value if a < b, zero if a = b and a positive
+ *          value if a > b.
+ */
+static gint compare_latencies(gconstpointer a, gconstpointer b)
+{
+    gint64 la = *(const gint64 *) a;
+    gint64 lb = *(const gint64 *) b;
+
+    return (la > lb) - (la < lb);
+}
+
+
+/**
+ * Gets a percentile (nearest rank) of sorted latencies.
+ * @param latencies is a sorted array of gint64 latencies in µs.
+ * @param percentile is the percentile wanted (between 0 and 100).
+ * @returns the percentile in milliseconds (0 if there is no latency).
+ */
+static gdouble get_percentile(GArray *latencies, gdouble percentile)
+{
+    guint rank = 0;
+
+    if (latencies->len == 0)
+        {
+            return 0.0;
+        }
+
+    rank = (guint) ((percentile * latencies->len + 99.0) / 100.0);
+    rank = CLAMP(rank, 1, latencies->len);
+
+    return g_array_index(latencies, gint64, rank - 1) / 1000.0;
+}
+
+
+/**
+ * Gets the statistics of the server.
+ * @param comm is a connection to the server.
+ * @returns the json root of /Stats.json answer or NULL.
+ */
+static json_t *get_server_stats(comm_t *comm)
+{
+    json_t *stats = NULL;
+
+    if (get_url(comm, "/Stats.json", NULL) == CURLE_OK && comm->buffer != NULL)
+        {
+            stats = load_json(comm->buffer);
+        }
+
+    free_variable(comm->buffer);
+    comm->buffer = NULL;
+
+    return stats;
+}
+
+
+/**
+ * Gets an integer value from the statistics of the server.
+ * @param stats is the json root of /Stats.json answer (may be NULL).
+ * @param keyname is the name of the value.
+ * @returns the value or 0 if it does not exist.
+ */
+static guint64 get_stats_value(json_t *stats, gchar *keyname)
+{
+    if (stats != NULL)
+        {
+            return (guint64) json_integer_value(get_json_value_from_json_root(stats, keyname));
+        }
+    else
+        {
+            return 0;
+        }
+}
+
+
+/**
+ * Prints, for each url, the number of requests and errors and the
+ * latency percentiles over all simulated hosts.
+ * @param hosts is the array of simulated hosts.
+ * @param nb_hosts is the number of simulated hosts.
+ */
+static void print_latencies(host_t **hosts, guint nb_hosts)
+{
+    GArray *latencies = NULL;
+    guint64 errors = 0;
+    guint url = 0;
+    guint i = 0;
+
+    fprintf(stdout, _("%-24s %10s %8s %10s %10s %10s %10s %10s\n"), _("url"), _("requests"), _("errors"), _("p50 ms"), _("p90 ms"), _("p99 ms"), _("p99.9 ms"), _("max ms"));
+
+    for (url = 0; url < LOAD_URLS; url++)
+        {
+            latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+            errors = 0;
+
+            for (i = 0; i < nb_hosts; i++)
+                {
+                    g_array_append_vals(latencies, hosts[i]->latencies[url]->data, hosts[i]->latencies[url]->len);
+                    errors = errors + hosts[i]->errors[url];
+                }
+
+            g_array_sort(latencies, compare_latencies);
+
+            fprintf(stdout, "%-24s %10u %8" G_GUINT64_FORMAT " %10.3f %10.3f %10.3f %10.3f %10.3f\n", load_url_names[url], latencies->len, errors,
+                    get_percentile(latencies, 50.0), get_percentile(latencies, 90.0), get_percentile(latencies, 99.0),
+                    get_percentile(latencies, 99.9), get_percentile(latencies, 100.0));
+
+            g_array_free(latencies, TRUE);
+        }
+}
+
+
+/**
+ * Prints the throughputs seen by the simulated hosts and by the server.
+ * @param load is the load shared by all hosts.
+ * @param hosts is the array of simulated hosts.
+ * @param before is /Stats.json answer before the load (may be NULL).
+ * @param after is /Stats.json answer after the load (may be NULL).
+ * @param seconds is the duration of the load in seconds.
+ */
+static void print_throughputs(load_t *load, host_t **hosts, json_t *before, json_t *after, gdouble seconds)
+{
+    guint64 files = 0;
+    guint64 files_read = 0;
+    guint64 bytes_sent = 0;
+    guint64 bytes_received = 0;
+    guint64 requests = 0;
+    json_t *req_before = NULL;
+    json_t *req_after = NULL;
+    gint i = 0;
+
+    for (i = 0; i < load->hosts; i++)
+        {
+            files = files + hosts[i]->nb_files;
+            files_read = files_read + hosts[i]->files_read;
+            bytes_sent = bytes_sent + hosts[i]->bytes_sent;
+            bytes_received = bytes_received + hosts[i]->bytes_received;
+        }
+
+    fprintf(stdout, _("\nHosts: %" G_GUINT64_FORMAT " files saved (%.1f/s), %.2f MB/s of blocks sent, %" G_GUINT64_FORMAT " files read (%.1f/s), %.2f MB/s received\n"),
+            files, files / seconds, bytes_sent / seconds / 1048576.0, files_read, files_read / seconds, bytes_received / seconds / 1048576.0);
+
+    if (before != NULL && after != NULL)
+        {
+            req_before = get_json_value_from_json_root(before, "Requests");
+            req_after = get_json_value_from_json_root(after, "Requests");
+            requests = get_stats_value(req_after, "Total requests") - get_stats_value(req_before, "Total requests");
+
+            fprintf(stdout, _("Server: %.1f requests/s, %.1f files/s, %.2f MB/s saved, %.2f MB/s stored after deduplication\n"),
+                    requests / seconds,
+                    (get_stats_value(after, "files") - get_stats_value(before, "files")) / seconds,
+                    (get_stats_value(after, "total size") - get_stats_value(before, "total size")) / seconds / 1048576.0,
+                    (get_stats_value(after, "dedup size") - get_stats_value(before, "dedup size")) / seconds / 1048576.0);
+        }
+    else
+        {
+            fprintf(stdout, _("Server: statistics are not available.\n"));
+        }
+}
+
+
+/**
+ * Main function
+ * @param argc : number of arguments given on the command line.
+ * @param argv : an array of strings that contains command line arguments.
+ * @returns EXIT_SUCCESS or EXIT_FAILURE if the server is not alive.
+ */
+int main(int argc, char **argv)
+{
+    load_t load;
+    host_t **hosts = NULL;
+    GThread **threads = NULL;
+    comm_t *comm = NULL;
+    json_t *before = NULL;
+    json_t *after = NULL;
+    gchar *ip = NULL;
+    gint port = SERVER_PORT;
+    gint cmptype = COMPRESS_NONE_TYPE;
+    gint64 begin = 0;
+    gdouble seconds = 0.0;
+    gchar *summary = NULL;
+    gint i = 0;
+
+    GOptionEntry entries[] =
+    {
+        { "ip", 'i', 0, G_OPTION_ARG_STRING, &ip, N_("IP address where server program is."), "IP"},
+        { "port", 'p', 0, G_OPTION_ARG_INT, &port, N_("Port NUMBER on which server program is listening."), N_("NUMBER")},
+        { "hosts", 'n', 0, G_OPTION_ARG_INT, &load.hosts, N_("NUMBER of simulated hosts (one thread each)."), N_("NUMBER")},
+        { "duration", 'd', 0, G_OPTION_ARG_INT, &load.duration, N_("Duration of the load in SECONDS."), N_("SECONDS")},
+        { "blocksize", 'b', 0, G_OPTION_ARG_INT64, &load.blocksize, N_("SIZE of blocks."), N_("SIZE")},
+        { "blocks", 'f', 0, G_OPTION_ARG_INT, &load.blocks, N_("NUMBER of blocks of each saved file."), N_("NUMBER")},
+        { "dedup", 'D', 0, G_OPTION_ARG_INT, &load.dedup, N_("PERCENTAGE of blocks shared by all hosts."), N_("PERCENTAGE")},
+        { "writes", 'w', 0, G_OPTION_ARG_INT, &load.writes, N_("PERCENTAGE of operations that save a file (others read one back)."), N_("PERCENTAGE")},
+        { "compression", 'z', 0, G_OPTION_ARG_INT, &cmptype, N_("Compression type to use: 0 is NONE, 1 is ZLIB, 2 is ZSTD, 3 is LZ4"), N_("NUMBER")},
+        { "seed", 's', 0, G_OPTION_ARG_INT, &load.seed, N_("SEED of the pseudo random number generators."), N_("SEED")},
+        { NULL }
+    };
+
+    #if !GLIB_CHECK_VERSION(2, 36, 0)
+        g_type_init();  /** g_type_init() is deprecated since glib 2.36 */
+    #endif
+
+    init_international_languages();
+
+    load.hosts = 10;
+    load.duration = 30;
+    load.blocksize = 16384;
+    load.blocks = 64;
+    load.dedup = 50;
+    load.writes = 80;
+    load.seed = 5468;
+
+    summary = g_strdup(_("This program loads a server with many simulated hosts that save and read back files."));
+    parse_command_line(argc, argv, entries, summary);
+    free_variable(summary);
+
+    if (ip == NULL)
+        {
+            ip = g_strdup("127.0.0.1");
+        }
+
+    load.hosts = MAX(load.hosts, 1);
+    load.blocksize = MAX(load.blocksize, 1);
+    load.blocks = MAX(load.blocks, 1);
+    load.cmptype = is_compress_type_allowed(cmptype) == TRUE ? cmptype : COMPRESS_NONE_TYPE;
+    load.conn = g_strdup_printf("http://%s:%d", ip, port);
+    comm = init_comm_struct(load.conn, COMPRESS_NONE_TYPE);
+
+    if (is_server_alive(comm) == FALSE)
+        {
+            print_error(__FILE__, __LINE__, _("Server at %s is not alive.\n"), load.conn);
+            free_comm_t(comm);
+            free_variable(load.conn);
+            free_variable(ip);
+
+            return EXIT_FAILURE;
+        }
+
+    fprintf(stdout, _("%d hosts during %d s on %s: %d blocks of %" G_GINT64_FORMAT " bytes per file, %d%% of shared blocks, %d%% of writes\n\n"),
+            load.hosts, load.duration, load.conn, load.blocks, load.blocksize, load.dedup, load.writes);
+
+    hosts = (host_t **) g_malloc0(load.hosts * sizeof(host_t *));
+    threads = (GThread **) g_malloc0(load.hosts * sizeof(GThread *));
+
+    for (i = 0; i < load.hosts; i++)
+        {
+            hosts[i] = new_host_t(&load, i);
+        }
+
+    before = get_server_stats(comm);
+    begin = g_get_monotonic_time();
+    load.deadline = begin + (gint64) load.duration * G_USEC_PER_SEC;
+
+    for (i = 0; i < load.hosts; i++)
+        {
+            threads[i] = g_thread_new("host", run_host, hosts[i]);
+        }
+
+    for (i = 0; i < load.hosts; i++)
+        {
+            g_thread_join(threads[i]);
+        }
+
+    seconds = (g_get_monotonic_time() - begin) / (gdouble) G_USEC_PER_SEC;
+    after = get_server_stats(comm);
+
+    print_latencies(hosts, load.hosts);
+    print_throughputs(&load, hosts, before, after, seconds);
+
+    for (i = 0; i < load.hosts; i++)
+        {
+            free_host_t(hosts[i]);
+        }
+
+    json_decref(before);
+    json_decref(after);
+    free_variable(hosts);
+    free_variable(threads);
+    free_comm_t(comm);
+    free_variable(load.conn);
+    free_variable(ip);
+
+    return EXIT_SUCCESS;
+}
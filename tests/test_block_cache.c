@@ -0,0 +1,258 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_block_cache.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_block_cache.c
+ * Tests of the cache of retrieved blocks: copies are returned, least
+ * recently used blocks are evicted first and the data backend is only
+ * called on misses.
+ */
+
+#include "server.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_BLOCK_SIZE
+ * Size of the blocks put into the caches of the tests.
+ */
+#define TEST_BLOCK_SIZE (400)
+
+
+/**
+ * Number of times fake_retrieve_data() has been called.
+ */
+static guint retrieved = 0;
+
+
+/**
+ * Makes a block whose bytes are all @param value.
+ * @param value is the value of every byte of the block.
+ * @returns a newly allocated block of TEST_BLOCK_SIZE bytes.
+ */
+static hash_data_t *make_block(guchar value)
+{
+    guchar *data = NULL;
+
+    data = (guchar *) g_malloc(TEST_BLOCK_SIZE);
+    memset(data, value, TEST_BLOCK_SIZE);
+
+    return new_hash_data_t_as_is(data, TEST_BLOCK_SIZE, make_test_hash(value), COMPRESS_NONE_TYPE, TEST_BLOCK_SIZE);
+}
+
+
+/**
+ * Finds hexadecimal hashs that are in the first shard of the cache.
+ * @param count is the number of hashs wanted.
+ * @returns a newly allocated NULL terminated array of hashs that may be
+ *          freed with g_strfreev().
+ */
+static gchar **get_first_shard_hashs(guint count)
+{
+    gchar **hex_hashs = NULL;
+    gchar *hex_hash = NULL;
+    guint found = 0;
+    guint i = 0;
+
+    hex_hashs = (gchar **) g_malloc0((count + 1) * sizeof(gchar *));
+
+    while (found < count)
+        {
+            hex_hash = g_strdup_printf("%064x", i);
+
+            if (g_str_hash(hex_hash) % BLOCK_CACHE_SHARDS == 0)
+                {
+                    hex_hashs[found] = hex_hash;
+                    found++;
+                }
+            else
+                {
+                    free_variable(hex_hash);
+                }
+
+            i++;
+        }
+
+    return hex_hashs;
+}
+
+
+/**
+ * Data backend's retrieve_data that counts its calls.
+ * @param server_struct is not used.
+ * @param hex_hash is not used.
+ * @returns a newly allocated block.
+ */
+static hash_data_t *fake_retrieve_data(void *server_struct, gchar *hex_hash)
+{
+    retrieved++;
+
+    return make_block(0x5a);
+}
+
+
+/**
+ * A cached block is returned as a copy and a disabled cache keeps
+ * nothing.
+ */
+static void test_block_cache_get(void)
+{
+    block_cache_t *block_cache = NULL;
+    hash_data_t *hash_data = NULL;
+    hash_data_t *copy = NULL;
+    json_t *root = NULL;
+
+    g_assert_null(new_block_cache_t(0));
+    g_assert_null(block_cache_get(NULL, "00"));
+
+    block_cache = new_block_cache_t(BLOCK_CACHE_DEFAULT_SIZE);
+    hash_data = make_block(1);
+
+    g_assert_null(block_cache_get(block_cache, "01"));
+    block_cache_put(block_cache, "01", hash_data);
+
+    copy = block_cache_get(block_cache, "01");
+    g_assert_nonnull(copy);
+    g_assert_true(copy->data != hash_data->data);
+    g_assert_cmpmem(copy->data, copy->read, hash_data->data, hash_data->read);
+    g_assert_cmpmem(copy->hash, HASH_LEN, hash_data->hash, HASH_LEN);
+    g_assert_cmpint(copy->cmptype, ==, hash_data->cmptype);
+    g_assert_cmpint(copy->uncmplen, ==, hash_data->uncmplen);
+
+    root = json_object();
+    insert_block_cache_stats_into_json_root(root, block_cache);
+    g_assert_cmpint(json_integer_value(json_object_get(root, "hits")), ==, 1);
+    g_assert_cmpint(json_integer_value(json_object_get(root, "misses")), ==, 1);
+    g_assert_cmpint(json_integer_value(json_object_get(root, "blocks")), ==, 1);
+    g_assert_cmpint(json_integer_value(json_object_get(root, "size")), ==, TEST_BLOCK_SIZE);
+    json_decref(root);
+
+    free_hash_data_t(copy);
+    free_hash_data_t(hash_data);
+    free_block_cache_t(block_cache);
+}
+
+
+/**
+ * A shard keeps its most recently used blocks and never gets bigger than
+ * its share of the cache.
+ */
+static void test_block_cache_lru(void)
+{
+    block_cache_t *block_cache = NULL;
+    hash_data_t *hash_data = NULL;
+    gchar **hex_hashs = NULL;
+    guint i = 0;
+
+    /* each shard holds two blocks */
+    block_cache = new_block_cache_t(BLOCK_CACHE_SHARDS * 2 * TEST_BLOCK_SIZE);
+    hex_hashs = get_first_shard_hashs(3);
+
+    for (i = 0; i < 2; i++)
+        {
+            hash_data = make_block(i);
+            block_cache_put(block_cache, hex_hashs[i], hash_data);
+            free_hash_data_t(hash_data);
+        }
+
+    /* the first block becomes the most recently used one */
+    hash_data = block_cache_get(block_cache, hex_hashs[0]);
+    g_assert_nonnull(hash_data);
+    free_hash_data_t(hash_data);
+
+    hash_data = make_block(2);
+    block_cache_put(block_cache, hex_hashs[2], hash_data);
+    free_hash_data_t(hash_data);
+
+    g_assert_cmpuint(block_cache->shards[0].size, <=, block_cache->shard_max_size);
+
+    hash_data = block_cache_get(block_cache, hex_hashs[1]);
+    g_assert_null(hash_data);
+
+    for (i = 0; i < 3; i = i + 2)
+        {
+            hash_data = block_cache_get(block_cache, hex_hashs[i]);
+            g_assert_nonnull(hash_data);
+            g_assert_cmpint(hash_data->data[0], ==, i);
+            free_hash_data_t(hash_data);
+        }
+
+    /* a block bigger than a shard is not kept */
+    free_block_cache_t(block_cache);
+    block_cache = new_block_cache_t(BLOCK_CACHE_SHARDS * TEST_BLOCK_SIZE / 2);
+    hash_data = make_block(3);
+    block_cache_put(block_cache, hex_hashs[0], hash_data);
+    free_hash_data_t(hash_data);
+    g_assert_null(block_cache_get(block_cache, hex_hashs[0]));
+
+    g_strfreev(hex_hashs);
+    free_block_cache_t(block_cache);
+}
+
+
+/**
+ * The data backend is only asked for blocks that are not in the cache.
+ */
+static void test_block_cache_retrieve(void)
+{
+    block_cache_t *block_cache = NULL;
+    server_struct_t server_struct;
+    backend_t backend;
+    hash_data_t *hash_data = NULL;
+    guint i = 0;
+
+    memset(&server_struct, 0, sizeof(server_struct_t));
+    memset(&backend, 0, sizeof(backend_t));
+    server_struct.stats = new_stats_t();
+    backend.retrieve_data = fake_retrieve_data;
+    block_cache = new_block_cache_t(BLOCK_CACHE_DEFAULT_SIZE);
+    retrieved = 0;
+
+    for (i = 0; i < 3; i++)
+        {
+            hash_data = block_cache_retrieve_data(block_cache, &backend, &server_struct, "5a");
+            g_assert_nonnull(hash_data);
+            g_assert_cmpint(hash_data->read, ==, TEST_BLOCK_SIZE);
+            free_hash_data_t(hash_data);
+        }
+
+    g_assert_cmpuint(retrieved, ==, 1);
+
+    /* without a cache every retrieval goes to the backend */
+    hash_data = block_cache_retrieve_data(NULL, &backend, &server_struct, "5a");
+    free_hash_data_t(hash_data);
+    g_assert_cmpuint(retrieved, ==, 2);
+
+    free_block_cache_t(block_cache);
+    free_stats_t(server_struct.stats);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/block_cache/get", test_block_cache_get);
+    g_test_add_func("/block_cache/lru", test_block_cache_lru);
+    g_test_add_func("/block_cache/retrieve", test_block_cache_retrieve);
+
+    return g_test_run();
+}
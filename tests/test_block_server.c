@@ -0,0 +1,483 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_block_server.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_block_server.c
+ * A small HTTP server that answers POST /Data/Hash_Array.json requests
+ * as cdpfglserver does: the body lists base64 hashs and the answer is a
+ * "blocks" array with each known block as stored. Unknown hashs are
+ * skipped. Any other request gets a 404 answer.
+ */
+
+#include "libcdpfgl.h"
+#include "test_block_server.h"
+
+static gchar *read_request_headers(GDataInputStream *input, gboolean *chunked, gsize *length, gboolean *expect);
+static GString *read_request_body(GDataInputStream *input, gboolean chunked, gsize length);
+static gchar *make_hash_array_answer(block_server_t *server, gchar *body);
+static void write_answer(GOutputStream *output, const gchar *status, gchar *answer);
+static void answer_request(block_server_t *server, GSocketConnection *connexion);
+static gpointer connexion_thread(gpointer user_data);
+static gpointer accept_thread(gpointer user_data);
+
+
+/**
+ * @struct block_connexion_t
+ * @brief A connexion to be answered by its own thread.
+ */
+typedef struct
+{
+    block_server_t *server;         /**< the block server           */
+    GSocketConnection *connexion;   /**< the connexion to be answered */
+} block_connexion_t;
+
+
+/**
+ * Reads the request line and the headers of a request.
+ * @param input is the input stream of the connexion.
+ * @param[out] chunked is set to TRUE when the body is sent in chunks.
+ * @param[out] length is set to the Content-Length of the body (if any).
+ * @param[out] expect is set to TRUE when the client waits for a
+ *             "100 Continue" answer before sending the body.
+ * @returns the newly allocated "METHOD url" of the request or NULL if
+ *          the request could not be read.
+ */
+static gchar *read_request_headers(GDataInputStream *input, gboolean *chunked, gsize *length, gboolean *expect)
+{
+    gchar *request = NULL;
+    gchar *line = NULL;
+    gchar **words = NULL;
+
+    line = g_data_input_stream_read_line(input, NULL, NULL, NULL);
+
+    if (line != NULL)
+        {
+            words = g_strsplit(line, " ", 3);
+
+            if (g_strv_length(words) == 3)
+                {
+                    request = g_strdup_printf("%s %s", words[0], words[1]);
+                }
+
+            g_strfreev(words);
+            free_variable(line);
+        }
+
+    while (request != NULL && (line = g_data_input_stream_read_line(input, NULL, NULL, NULL)) != NULL && line[0] != '\0')
+        {
+            if (g_ascii_strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line, "chunked") != NULL)
+                {
+                    *chunked = TRUE;
+                }
+            else if (g_ascii_strncasecmp(line, "Content-Length:", 15) == 0)
+                {
+                    *length = g_ascii_strtoull(line + 15, NULL, 10);
+                }
+            else if (g_ascii_strncasecmp(line, "Expect:", 7) == 0)
+                {
+                    *expect = TRUE;
+                }
+
+            free_variable(line);
+        }
+
+    free_variable(line);
+
+    return request;
+}
+
+
+/**
+ * Reads the body of a request.
+ * @param input is the input stream of the connexion.
+ * @param chunked is TRUE when the body is sent in chunks (it then
+ *        prevails over length).
+ * @param length is the Content-Length of the body.
+ * @returns the body of the request or NULL if it could not be read.
+ */
+static GString *read_request_body(GDataInputStream *input, gboolean chunked, gsize length)
+{
+    GString *body = NULL;
+    gchar *line = NULL;
+    gsize chunk_len = 0;
+    gsize nb_read = 0;
+    gsize pos = 0;
+    gboolean ok = TRUE;
+
+    body = g_string_new("");
+
+    do
+        {
+            if (chunked == TRUE)
+                {
+                    line = g_data_input_stream_read_line(input, NULL, NULL, NULL);
+                    ok = (line != NULL);
+                    chunk_len = (line != NULL) ? g_ascii_strtoull(line, NULL, 16) : 0;
+                    free_variable(line);
+                }
+            else
+                {
+                    chunk_len = length;
+                }
+
+            if (ok == TRUE && chunk_len > 0)
+                {
+                    pos = body->len;
+                    g_string_set_size(body, pos + chunk_len);
+                    ok = g_input_stream_read_all(G_INPUT_STREAM(input), body->str + pos, chunk_len, &nb_read, NULL, NULL) == TRUE && nb_read == chunk_len;
+                }
+
+            if (ok == TRUE && chunked == TRUE)
+                {
+                    /* CRLF at the end of each chunk and empty trailer after the last one */
+                    line = g_data_input_stream_read_line(input, NULL, NULL, NULL);
+                    ok = (line != NULL);
+                    free_variable(line);
+                }
+        }
+    while (ok == TRUE && chunked == TRUE && chunk_len > 0);
+
+    if (ok == FALSE)
+        {
+            g_string_free(body, TRUE);
+            body = NULL;
+        }
+
+    return body;
+}
+
+
+/**
+ * Makes the answer to a POST /Data/Hash_Array.json request.
+ * @param server is the block server.
+ * @param body is the body of the request: {"hash_list":[...]}.
+ * @returns the newly allocated json answer: {"blocks":[...]}.
+ */
+static gchar *make_hash_array_answer(block_server_t *server, gchar *body)
+{
+    json_t *root = NULL;
+    json_t *hash_list = NULL;
+    json_t *value = NULL;
+    json_t *blocks = NULL;
+    json_t *answer_root = NULL;
+    hash_data_t *block = NULL;
+    gchar *answer = NULL;
+    size_t index = 0;
+
+    root = load_json(body);
+    hash_list = get_json_value_from_json_root(root, "hash_list");
+    blocks = json_array();
+
+    g_mutex_lock(&server->mutex);
+
+    json_array_foreach(hash_list, index, value)
+        {
+            block = g_hash_table_lookup(server->blocks, json_string_value(value));
+
+            if (block != NULL)
+                {
+                    json_array_append_new(blocks, convert_hash_data_t_to_json(block));
+                }
+
+            server->nb_hashs = server->nb_hashs + 1;
+        }
+
+    server->nb_requests = server->nb_requests + 1;
+
+    g_mutex_unlock(&server->mutex);
+
+    answer_root = json_object();
+    insert_json_value_into_json_root(answer_root, "blocks", blocks);
+    answer = json_dumps(answer_root, 0);
+
+    json_decref(answer_root);
+    json_decref(root);
+
+    return answer;
+}
+
+
+/**
+ * Writes an answer and its headers.
+ * @param output is the output stream of the connexion.
+ * @param status is the status line of the answer (ie "200 OK").
+ * @param answer is the body of the answer.
+ */
+static void write_answer(GOutputStream *output, const gchar *status, gchar *answer)
+{
+    gchar *headers = NULL;
+
+    headers = g_strdup_printf("HTTP/1.1 %s\r\nContent-Type: application/json; charset=utf-8\r\nContent-Length: %" G_GSIZE_FORMAT "\r\nConnection: close\r\n\r\n", status, strlen(answer));
+
+    g_output_stream_write_all(output, headers, strlen(headers), NULL, NULL, NULL);
+    g_output_stream_write_all(output, answer, strlen(answer), NULL, NULL, NULL);
+    g_output_stream_flush(output, NULL, NULL);
+
+    free_variable(headers);
+}
+
+
+/**
+ * Reads one request and answers it.
+ * @param server is the block server.
+ * @param connexion is the connexion of the client.
+ */
+static void answer_request(block_server_t *server, GSocketConnection *connexion)
+{
+    GDataInputStream *input = NULL;
+    GOutputStream *output = NULL;
+    GString *body = NULL;
+    gchar *request = NULL;
+    gchar *answer = NULL;
+    gboolean chunked = FALSE;
+    gboolean expect = FALSE;
+    gsize length = 0;
+
+    input = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connexion)));
+    g_data_input_stream_set_newline_type(input, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+    output = g_io_stream_get_output_stream(G_IO_STREAM(connexion));
+
+    request = read_request_headers(input, &chunked, &length, &expect);
+
+    if (request != NULL && g_str_has_prefix(request, "POST /Data/Hash_Array.json") == TRUE)
+        {
+            if (expect == TRUE)
+                {
+                    g_output_stream_write_all(output, "HTTP/1.1 100 Continue\r\n\r\n", 25, NULL, NULL, NULL);
+                }
+
+            body = read_request_body(input, chunked, length);
+
+            if (body != NULL)
+                {
+                    answer = make_hash_array_answer(server, body->str);
+                    write_answer(output, "200 OK", answer);
+                    g_string_free(body, TRUE);
+                }
+        }
+    else if (request != NULL)
+        {
+            answer = g_strdup("{}");
+            write_answer(output, "404 Not Found", answer);
+        }
+
+    free_variable(answer);
+    free_variable(request);
+    g_object_unref(input);
+}
+
+
+/**
+ * Thread that answers one connexion and closes it.
+ * @param user_data is the block_connexion_t * connexion to be answered.
+ * @returns NULL
+ */
+static gpointer connexion_thread(gpointer user_data)
+{
+    block_connexion_t *block_connexion = (block_connexion_t *) user_data;
+    block_server_t *server = block_connexion->server;
+
+    answer_request(server, block_connexion->connexion);
+
+    g_io_stream_close(G_IO_STREAM(block_connexion->connexion), NULL, NULL);
+    g_object_unref(block_connexion->connexion);
+    free_variable(block_connexion);
+
+    g_mutex_lock(&server->mutex);
+    server->nb_connexions = server->nb_connexions - 1;
+    g_cond_broadcast(&server->cond);
+    g_mutex_unlock(&server->mutex);
+
+    return NULL;
+}
+
+
+/**
+ * Thread that accepts connexions until the server is stopped.
+ * @param user_data is the block_server_t * server.
+ * @returns NULL
+ */
+static gpointer accept_thread(gpointer user_data)
+{
+    block_server_t *server = (block_server_t *) user_data;
+    block_connexion_t *block_connexion = NULL;
+    GSocketConnection *connexion = NULL;
+
+    while ((connexion = g_socket_listener_accept(server->listener, NULL, server->cancellable, NULL)) != NULL)
+        {
+            block_connexion = (block_connexion_t *) g_malloc0(sizeof(block_connexion_t));
+            block_connexion->server = server;
+            block_connexion->connexion = connexion;
+
+            g_mutex_lock(&server->mutex);
+            server->nb_connexions = server->nb_connexions + 1;
+            g_mutex_unlock(&server->mutex);
+
+            g_thread_unref(g_thread_new("block-connexion", connexion_thread, block_connexion));
+        }
+
+    return NULL;
+}
+
+
+/**
+ * Starts a block server listening on a free port of the loopback.
+ * @returns a newly allocated block_server_t * structure that may be
+ *          stopped and freed with stop_block_server().
+ */
+block_server_t *start_block_server(void)
+{
+    block_server_t *server = NULL;
+    GInetAddress *loopback = NULL;
+    GSocketAddress *address = NULL;
+    GSocketAddress *effective = NULL;
+    gboolean listening = FALSE;
+
+    server = (block_server_t *) g_malloc0(sizeof(block_server_t));
+
+    server->listener = g_socket_listener_new();
+    server->cancellable = g_cancellable_new();
+    server->blocks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_hdt_struct);
+    server->nb_connexions = 0;
+    server->nb_requests = 0;
+    server->nb_hashs = 0;
+    g_mutex_init(&server->mutex);
+    g_cond_init(&server->cond);
+
+    /* port 0: the system chooses a free port */
+    loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+    address = g_inet_socket_address_new(loopback, 0);
+    listening = g_socket_listener_add_address(server->listener, address, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, NULL, &effective, NULL);
+    g_assert_true(listening);
+
+    server->conn = g_strdup_printf("http://127.0.0.1:%d", g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(effective)));
+    server->thread = g_thread_new("block-server", accept_thread, server);
+
+    g_object_unref(effective);
+    g_object_unref(address);
+    g_object_unref(loopback);
+
+    return server;
+}
+
+
+/**
+ * Adds a block to the blocks that the server knows.
+ * @param server is the block server.
+ * @param data is the (uncompressed) data of the block.
+ * @param len is the length of data.
+ * @param cmptype is the compression type the block is stored and sent
+ *        with.
+ * @returns the newly allocated binary hash of the block.
+ */
+guint8 *add_block_to_server(block_server_t *server, guchar *data, gsize len, gshort cmptype)
+{
+    compress_t *compress = NULL;
+    hash_data_t *block = NULL;
+    guint8 *hash = NULL;
+    gchar *encoded_hash = NULL;
+
+    hash = calculate_hash_for_string(data, len);
+
+    if (cmptype != COMPRESS_NONE_TYPE)
+        {
+            compress = compress_buffer(data, len, cmptype);
+            g_assert_nonnull(compress);
+            block = new_hash_data_t_as_is(compress->text, compress->len, g_memdup(hash, HASH_LEN), cmptype, len);
+            compress->text = NULL;
+            free_compress_t(compress);
+        }
+    else
+        {
+            block = new_hash_data_t_as_is(g_memdup(data, len), len, g_memdup(hash, HASH_LEN), COMPRESS_NONE_TYPE, len);
+        }
+
+    encoded_hash = g_base64_encode(hash, HASH_LEN);
+
+    g_mutex_lock(&server->mutex);
+    g_hash_table_replace(server->blocks, encoded_hash, block);
+    g_mutex_unlock(&server->mutex);
+
+    return hash;
+}
+
+
+/**
+ * @param server is the block server.
+ * @returns the number of requests answered so far.
+ */
+guint get_block_server_nb_requests(block_server_t *server)
+{
+    guint nb_requests = 0;
+
+    g_mutex_lock(&server->mutex);
+    nb_requests = server->nb_requests;
+    g_mutex_unlock(&server->mutex);
+
+    return nb_requests;
+}
+
+
+/**
+ * @param server is the block server.
+ * @returns the number of hashs asked to the server so far.
+ */
+guint get_block_server_nb_hashs(block_server_t *server)
+{
+    guint nb_hashs = 0;
+
+    g_mutex_lock(&server->mutex);
+    nb_hashs = server->nb_hashs;
+    g_mutex_unlock(&server->mutex);
+
+    return nb_hashs;
+}
+
+
+/**
+ * Stops the block server, waits for the connexions being answered and
+ * frees it.
+ * @param server is the block server to be stopped.
+ */
+void stop_block_server(block_server_t *server)
+{
+    g_cancellable_cancel(server->cancellable);
+    g_thread_join(server->thread);
+
+    g_mutex_lock(&server->mutex);
+
+    while (server->nb_connexions > 0)
+        {
+            g_cond_wait(&server->cond, &server->mutex);
+        }
+
+    g_mutex_unlock(&server->mutex);
+
+    g_socket_listener_close(server->listener);
+    g_object_unref(server->listener);
+    g_object_unref(server->cancellable);
+    g_hash_table_destroy(server->blocks);
+    g_mutex_clear(&server->mutex);
+    g_cond_clear(&server->cond);
+    free_variable(server->conn);
+    free_variable(server);
+}
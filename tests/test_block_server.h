@@ -0,0 +1,94 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_block_server.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_block_server.h
+ * A small HTTP server that answers POST /Data/Hash_Array.json requests
+ * as cdpfglserver does. It is used by the tests of cdpfglrestore.
+ */
+#ifndef _TESTS_TEST_BLOCK_SERVER_H_
+#define _TESTS_TEST_BLOCK_SERVER_H_
+
+
+/**
+ * @struct block_server_t
+ * @brief State of a test block server. Each connexion is answered by
+ *        its own thread and closed after one request.
+ */
+typedef struct
+{
+    GSocketListener *listener;  /**< listening socket                                           */
+    GCancellable *cancellable;  /**< cancelled to stop accepting connexions                     */
+    GThread *thread;            /**< thread that accepts connexions                             */
+    gchar *conn;                /**< connexion string of the server (http://127.0.0.1:port)     */
+    GHashTable *blocks;         /**< hash_data_t * blocks as stored indexed by their base64 hash */
+    guint nb_connexions;        /**< number of connexions being answered                        */
+    guint nb_requests;          /**< number of requests answered                                */
+    guint nb_hashs;             /**< number of hashs asked                                      */
+    GMutex mutex;               /**< protects blocks and the counters                           */
+    GCond cond;                 /**< signaled when a connexion has been answered                */
+} block_server_t;
+
+
+/**
+ * Starts a block server listening on a free port of the loopback.
+ * @returns a newly allocated block_server_t * structure that may be
+ *          stopped and freed with stop_block_server().
+ */
+extern block_server_t *start_block_server(void);
+
+
+/**
+ * Adds a block to the blocks that the server knows.
+ * @param server is the block server.
+ * @param data is the (uncompressed) data of the block.
+ * @param len is the length of data.
+ * @param cmptype is the compression type the block is stored and sent
+ *        with.
+ * @returns the newly allocated binary hash of the block.
+ */
+extern guint8 *add_block_to_server(block_server_t *server, guchar *data, gsize len, gshort cmptype);
+
+
+/**
+ * @param server is the block server.
+ * @returns the number of requests answered so far.
+ */
+extern guint get_block_server_nb_requests(block_server_t *server);
+
+
+/**
+ * @param server is the block server.
+ * @returns the number of hashs asked to the server so far.
+ */
+extern guint get_block_server_nb_hashs(block_server_t *server);
+
+
+/**
+ * Stops the block server, waits for the connexions being answered and
+ * frees it.
+ * @param server is the block server to be stopped.
+ */
+extern void stop_block_server(block_server_t *server);
+
+
+#endif /* #ifndef _TESTS_TEST_BLOCK_SERVER_H_ */
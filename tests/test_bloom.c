@@ -0,0 +1,442 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_bloom.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_bloom.c
+ * Tests of the Bloom filter of stored hashs: no false negative, a false
+ * positive rate close to the expected one, the json whole filter and
+ * delta answers understood by clients and the server side filter that
+ * makes them.
+ */
+
+#include "libcdpfgl.h"
+#include "server.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_BLOOM_HASHS
+ * Number of hashs added to the filters of the tests.
+ */
+#define TEST_BLOOM_HASHS (10000)
+
+
+/**
+ * Every added hash is found and only a few others are.
+ */
+static void test_bloom_membership(void)
+{
+    bloom_t *bloom = NULL;
+    guint8 *hash = NULL;
+    guint positives = 0;
+    guint i = 0;
+
+    bloom = new_bloom_t(BLOOM_DEFAULT_BITS, BLOOM_DEFAULT_HASHS, 1);
+    g_assert_nonnull(bloom);
+
+    for (i = 0; i < TEST_BLOOM_HASHS; i++)
+        {
+            hash = make_test_hash(i);
+            g_assert_true(bloom_add_hash(bloom, hash));
+            g_assert_false(bloom_add_hash(bloom, hash));
+            free_variable(hash);
+        }
+
+    for (i = 0; i < TEST_BLOOM_HASHS; i++)
+        {
+            hash = make_test_hash(i);
+            g_assert_true(bloom_may_contain_hash(bloom, hash));
+            free_variable(hash);
+        }
+
+    for (i = TEST_BLOOM_HASHS; i < 2 * TEST_BLOOM_HASHS; i++)
+        {
+            hash = make_test_hash(i);
+
+            if (bloom_may_contain_hash(bloom, hash) == TRUE)
+                {
+                    positives++;
+                }
+
+            free_variable(hash);
+        }
+
+    /* 10000 hashs in 2 MB: false positives are very unlikely */
+    g_assert_cmpuint(positives, <, TEST_BLOOM_HASHS / 100);
+
+    free_bloom_t(bloom);
+}
+
+
+/**
+ * A small filter gives false positives but never false negatives and
+ * bloom_split_hash_list() sorts hashs accordingly.
+ */
+static void test_bloom_split(void)
+{
+    bloom_t *bloom = NULL;
+    GList *hash_list = NULL;
+    GList *unknown = NULL;
+    GList *probable = NULL;
+    GList *iter = NULL;
+    hash_data_t *hash_data = NULL;
+    guint8 *hash = NULL;
+    guint i = 0;
+
+    bloom = new_bloom_t(8192, 3, 2);
+
+    for (i = 0; i < 1000; i++)
+        {
+            hash = make_test_hash(i);
+
+            if (i % 2 == 0)
+                {
+                    bloom_add_hash(bloom, hash);
+                }
+
+            hash_list = g_list_prepend(hash_list, new_hash_data_t(NULL, 0, hash, COMPRESS_NONE_TYPE));
+        }
+
+    unknown = bloom_split_hash_list(bloom, hash_list, &probable);
+
+    g_assert_cmpuint(g_list_length(unknown) + g_list_length(probable), ==, 1000);
+    g_assert_cmpuint(g_list_length(probable), >=, 500);
+
+    for (iter = unknown; iter != NULL; iter = g_list_next(iter))
+        {
+            hash_data = iter->data;
+            g_assert_false(bloom_may_contain_hash(bloom, hash_data->hash));
+        }
+
+    g_list_free_full(hash_list, free_hdt_struct);
+    g_list_free_full(unknown, free_hdt_struct);
+    g_list_free_full(probable, free_hdt_struct);
+    free_bloom_t(bloom);
+}
+
+
+/**
+ * A whole filter converted to json is read back as is and a delta adds
+ * its hashs to the filter of the same id only.
+ */
+static void test_bloom_json(void)
+{
+    bloom_t *bloom = NULL;
+    bloom_t *copy = NULL;
+    json_t *root = NULL;
+    json_t *delta = NULL;
+    gchar *json_str = NULL;
+    gchar *encoded = NULL;
+    guint8 *hash = NULL;
+    guint i = 0;
+
+    bloom = new_bloom_t(65536, BLOOM_DEFAULT_HASHS, 42);
+    bloom->version = 7;
+
+    for (i = 0; i < 100; i++)
+        {
+            hash = make_test_hash(i);
+            bloom_add_hash(bloom, hash);
+            free_variable(hash);
+        }
+
+    root = convert_bloom_t_to_json(bloom);
+    json_str = json_dumps(root, 0);
+    json_decref(root);
+
+    copy = update_bloom_from_json_string(NULL, json_str);
+    free_variable(json_str);
+
+    g_assert_nonnull(copy);
+    g_assert_cmpuint(copy->id, ==, 42);
+    g_assert_cmpuint(copy->version, ==, 7);
+    g_assert_cmpuint(copy->nbits, ==, bloom->nbits);
+    g_assert_cmpuint(copy->nhashs, ==, bloom->nhashs);
+    g_assert_cmpmem(copy->bits, copy->nbits / 8, bloom->bits, bloom->nbits / 8);
+
+    /* a delta of one hash */
+    hash = make_test_hash(1000);
+    encoded = g_base64_encode(hash, HASH_LEN);
+    delta = json_array();
+    json_array_append_new(delta, json_string(encoded));
+    root = json_object();
+    json_object_set_new(root, "id", json_integer(42));
+    json_object_set_new(root, "version", json_integer(8));
+    json_object_set_new(root, "delta", delta);
+    json_str = json_dumps(root, 0);
+    json_decref(root);
+
+    copy = update_bloom_from_json_string(copy, json_str);
+    free_variable(json_str);
+
+    g_assert_cmpuint(copy->version, ==, 8);
+    g_assert_true(bloom_may_contain_hash(copy, hash));
+
+    /* a delta of another filter is ignored */
+    root = json_object();
+    json_object_set_new(root, "id", json_integer(43));
+    json_object_set_new(root, "version", json_integer(9));
+    json_object_set_new(root, "delta", json_array());
+    json_str = json_dumps(root, 0);
+    json_decref(root);
+
+    copy = update_bloom_from_json_string(copy, json_str);
+    free_variable(json_str);
+
+    g_assert_cmpuint(copy->id, ==, 42);
+    g_assert_cmpuint(copy->version, ==, 8);
+
+    free_variable(encoded);
+    free_variable(hash);
+    free_bloom_t(copy);
+    free_bloom_t(bloom);
+}
+
+
+/**
+ * Adds hashs to a server hash filter.
+ * @param hash_filter is the filter.
+ * @param first is the number of the first hash to be added.
+ * @param nb is the number of hashs to be added.
+ */
+static void add_test_hashs_to_filter(hash_filter_t *hash_filter, guint first, guint nb)
+{
+    guint8 *hash = NULL;
+    guint i = 0;
+
+    for (i = first; i < first + nb; i++)
+        {
+            hash = make_test_hash(i);
+            hash_filter_add_hash(hash_filter, hash);
+            free_variable(hash);
+        }
+}
+
+
+/**
+ * Asks a server hash filter for its answer to a client.
+ * @param hash_filter is the filter.
+ * @param id is the id of the filter the client has.
+ * @param version is the version of the filter the client has.
+ * @param nb_delta is filled with the number of hashs of the delta or
+ *        -1 if the answer is the whole filter.
+ * @returns the answer as a newly allocated json string.
+ */
+static gchar *get_filter_answer(hash_filter_t *hash_filter, guint32 id, guint64 version, gint *nb_delta)
+{
+    gchar *answer = NULL;
+    json_t *root = NULL;
+    json_t *delta = NULL;
+
+    answer = hash_filter_answer(hash_filter, id, version);
+    g_assert_nonnull(answer);
+
+    root = json_loads(answer, 0, NULL);
+    g_assert_nonnull(root);
+    g_assert_cmpuint(json_integer_value(json_object_get(root, "id")), ==, hash_filter->bloom->id);
+    g_assert_cmpuint(json_integer_value(json_object_get(root, "version")), ==, hash_filter->bloom->version);
+
+    delta = json_object_get(root, "delta");
+
+    if (delta != NULL)
+        {
+            *nb_delta = (gint) json_array_size(delta);
+            g_assert_null(json_object_get(root, "filter"));
+        }
+    else
+        {
+            *nb_delta = -1;
+            g_assert_nonnull(json_object_get(root, "filter"));
+        }
+
+    json_decref(root);
+
+    return answer;
+}
+
+
+/**
+ * A disabled filter does nothing and a filter answers nothing until
+ * every stored hash has been loaded.
+ */
+static void test_bloom_filter_ready(void)
+{
+    hash_filter_t *hash_filter = NULL;
+    guint8 *hash = NULL;
+    gchar *answer = NULL;
+    gint nb_delta = 0;
+
+    g_assert_null(new_hash_filter_t(0));
+    hash = make_test_hash(0);
+    hash_filter_add_hash(NULL, hash);
+    hash_filter_set_ready(NULL);
+    g_assert_null(hash_filter_answer(NULL, 0, 0));
+    free_variable(hash);
+
+    hash_filter = new_hash_filter_t(65536);
+    g_assert_nonnull(hash_filter);
+    g_assert_cmpuint(hash_filter->bloom->id, >, 0);
+
+    add_test_hashs_to_filter(hash_filter, 0, 10);
+    g_assert_null(hash_filter_answer(hash_filter, 0, 0));
+
+    hash_filter_set_ready(hash_filter);
+    answer = get_filter_answer(hash_filter, 0, 0, &nb_delta);
+    g_assert_cmpint(nb_delta, ==, -1);
+    g_assert_cmpuint(hash_filter->bloom->version, ==, 10);
+
+    free_variable(answer);
+    free_hash_filter_t(hash_filter);
+}
+
+
+/**
+ * A client that has the filter only gets the hashs added since its
+ * version and catches up with the server filter. A client with another
+ * filter or an impossible version gets the whole filter.
+ */
+static void test_bloom_filter_delta(void)
+{
+    hash_filter_t *hash_filter = NULL;
+    bloom_t *client = NULL;
+    gchar *answer = NULL;
+    guint8 *hash = NULL;
+    guint64 version = 0;
+    gint nb_delta = 0;
+    guint i = 0;
+
+    hash_filter = new_hash_filter_t(1 << 20);
+    add_test_hashs_to_filter(hash_filter, 0, 100);
+    hash_filter_set_ready(hash_filter);
+
+    answer = get_filter_answer(hash_filter, 0, 0, &nb_delta);
+    g_assert_cmpint(nb_delta, ==, -1);
+    client = update_bloom_from_json_string(NULL, answer);
+    free_variable(answer);
+    g_assert_nonnull(client);
+    g_assert_cmpuint(client->version, ==, 100);
+
+    /* Hashs already in the filter do not change its version */
+    add_test_hashs_to_filter(hash_filter, 50, 100);
+    g_assert_cmpuint(hash_filter->bloom->version, ==, 150);
+
+    answer = get_filter_answer(hash_filter, client->id, client->version, &nb_delta);
+    g_assert_cmpint(nb_delta, ==, 50);
+    client = update_bloom_from_json_string(client, answer);
+    free_variable(answer);
+
+    g_assert_cmpuint(client->version, ==, 150);
+    g_assert_cmpmem(client->bits, client->nbits / 8, hash_filter->bloom->bits, hash_filter->bloom->nbits / 8);
+
+    for (i = 0; i < 150; i++)
+        {
+            hash = make_test_hash(i);
+            g_assert_true(bloom_may_contain_hash(client, hash));
+            free_variable(hash);
+        }
+
+    /* Up to date */
+    answer = get_filter_answer(hash_filter, client->id, client->version, &nb_delta);
+    g_assert_cmpint(nb_delta, ==, 0);
+    free_variable(answer);
+
+    /* Another filter (the server restarted) or a version from the future */
+    version = hash_filter->bloom->version;
+    answer = get_filter_answer(hash_filter, client->id + 1, version, &nb_delta);
+    g_assert_cmpint(nb_delta, ==, -1);
+    free_variable(answer);
+    answer = get_filter_answer(hash_filter, client->id, version + 1, &nb_delta);
+    g_assert_cmpint(nb_delta, ==, -1);
+    free_variable(answer);
+
+    free_bloom_t(client);
+    free_hash_filter_t(hash_filter);
+}
+
+
+/**
+ * When the delta grows above HASH_FILTER_MAX_DELTA hashs its oldest half
+ * is forgotten: older clients get the whole filter and newer ones still
+ * get a delta.
+ */
+static void test_bloom_filter_rollover(void)
+{
+    hash_filter_t *hash_filter = NULL;
+    gchar *answer = NULL;
+    guint64 version = 0;
+    guint64 base = 0;
+    gint nb_delta = 0;
+
+    hash_filter = new_hash_filter_t(1 << 24);
+    hash_filter_set_ready(hash_filter);
+
+    add_test_hashs_to_filter(hash_filter, 0, HASH_FILTER_MAX_DELTA);
+    version = hash_filter->bloom->version;
+    g_assert_cmpuint(hash_filter->delta_base, ==, 0);
+    g_assert_cmpuint(hash_filter->delta->len, ==, version * HASH_LEN);
+
+    answer = get_filter_answer(hash_filter, hash_filter->bloom->id, 0, &nb_delta);
+    g_assert_cmpint(nb_delta, ==, version);
+    free_variable(answer);
+
+    /* Twice as many hashs again: the delta rolls over */
+    add_test_hashs_to_filter(hash_filter, HASH_FILTER_MAX_DELTA, 2 * HASH_FILTER_MAX_DELTA);
+    g_assert_cmpuint(hash_filter->bloom->version, >, HASH_FILTER_MAX_DELTA);
+
+    version = hash_filter->bloom->version;
+    base = hash_filter->delta_base;
+    g_assert_cmpuint(base, >, 0);
+    g_assert_cmpuint(hash_filter->delta->len, ==, (version - base) * HASH_LEN);
+    g_assert_cmpuint(version - base, <=, HASH_FILTER_MAX_DELTA);
+
+    answer = get_filter_answer(hash_filter, hash_filter->bloom->id, 0, &nb_delta);
+    g_assert_cmpint(nb_delta, ==, -1);
+    free_variable(answer);
+
+    answer = get_filter_answer(hash_filter, hash_filter->bloom->id, base - 1, &nb_delta);
+    g_assert_cmpint(nb_delta, ==, -1);
+    free_variable(answer);
+
+    answer = get_filter_answer(hash_filter, hash_filter->bloom->id, base, &nb_delta);
+    g_assert_cmpint(nb_delta, ==, version - base);
+    free_variable(answer);
+
+    answer = get_filter_answer(hash_filter, hash_filter->bloom->id, version - 1, &nb_delta);
+    g_assert_cmpint(nb_delta, ==, 1);
+    free_variable(answer);
+
+    free_hash_filter_t(hash_filter);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/bloom/membership", test_bloom_membership);
+    g_test_add_func("/bloom/split", test_bloom_split);
+    g_test_add_func("/bloom/json", test_bloom_json);
+    g_test_add_func("/bloom/filter_ready", test_bloom_filter_ready);
+    g_test_add_func("/bloom/filter_delta", test_bloom_filter_delta);
+    g_test_add_func("/bloom/filter_rollover", test_bloom_filter_rollover);
+
+    return g_test_run();
+}
@@ -0,0 +1,613 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_catalog.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_catalog.c
+ * Tests of the catalogs of the file backend: a flat meta data file left
+ * by a former version is imported once into the catalog of its host and
+ * renamed (or kept when the import fails), versions stored afterwards are listed with it and listings
+ * are filtered, restricted to latest or as of versions and paged.
+ */
+
+#include <glib/gstdio.h>
+#include "server.h"
+#include "test_common.h"
+#include "test_file_backend.h"
+
+/**
+ * @def TEST_CATALOG_HOST
+ * Host whose flat meta data file is imported.
+ */
+#define TEST_CATALOG_HOST "flathost"
+
+
+/**
+ * Makes a query on the files of a host that belong to an owner.
+ * @param hostname is the name of the host.
+ * @param owner is the name of the owner (and of its group). "root" has
+ *        uid and gid 0 and any other owner 1000.
+ * @returns a newly allocated query_t * structure.
+ */
+static query_t *make_test_query(const gchar *hostname, const gchar *owner)
+{
+    const gchar *id = NULL;
+
+    id = g_strcmp0(owner, "root") == 0 ? "0" : "1000";
+
+    return init_query_t(g_strdup(hostname), g_strdup(id), g_strdup(id), g_strdup(owner), g_strdup(owner), NULL, NULL, NULL, NULL, FALSE);
+}
+
+
+/**
+ * Converts a unix time into a date as written in queries.
+ * @param mtime is the unix time.
+ * @returns a newly allocated YYYY-MM-DD HH:MM:SS local date.
+ */
+static gchar *make_test_date(guint64 mtime)
+{
+    GDateTime *la_date = NULL;
+    gchar *date = NULL;
+
+    la_date = g_date_time_new_from_unix_local(mtime);
+    date = g_date_time_format(la_date, "%F %T");
+    g_date_time_unref(la_date);
+
+    return date;
+}
+
+
+/**
+ * Describes a list of versions.
+ * @param file_list is a GList * of meta_data_t * versions.
+ * @returns a newly allocated string with the name and modification time
+ *          of each version ("name@mtime name@mtime").
+ */
+static gchar *describe_file_list(GList *file_list)
+{
+    GString *description = NULL;
+    meta_data_t *meta = NULL;
+
+    description = g_string_new("");
+
+    while (file_list != NULL)
+        {
+            meta = file_list->data;
+            g_string_append_printf(description, "%s%s@%" G_GUINT64_FORMAT, description->len > 0 ? " " : "", meta->name, meta->mtime);
+            file_list = g_list_next(file_list);
+        }
+
+    return g_string_free(description, FALSE);
+}
+
+
+/**
+ * Lists the versions of a catalog that match a query and checks them.
+ * @param catalog is the catalog.
+ * @param query is the query.
+ * @param expected is the expected description of the list (as made by
+ *        describe_file_list()).
+ */
+static void assert_catalog_list(catalog_t *catalog, query_t *query, const gchar *expected)
+{
+    GList *file_list = NULL;
+    gchar *description = NULL;
+
+    file_list = catalog_get_file_list(catalog, query, 0);
+    description = describe_file_list(file_list);
+    g_assert_cmpstr(description, ==, expected);
+
+    free_variable(description);
+    g_list_free_full(file_list, free_glist_meta_data_t);
+}
+
+
+/**
+ * Lists every saved version of the files of a host that belong to root.
+ * @param server_struct is the server structure of the file backend.
+ * @param hostname is the name of the host.
+ * @returns the GList * of meta_data_t * versions sorted by filename and
+ *          modification time.
+ */
+static GList *list_host_files(server_struct_t *server_struct, const gchar *hostname)
+{
+    query_t *query = NULL;
+    GList *file_list = NULL;
+
+    query = make_test_query(hostname, "root");
+    file_list = file_get_list_of_files(server_struct, query, 0);
+    free_query_t(query);
+
+    return file_list;
+}
+
+
+/**
+ * Inserts a version of a file into a catalog.
+ * @param catalog is the catalog.
+ * @param name is the name of the file.
+ * @param mtime is the modification time of the version.
+ * @param owner is the owner of the file (see make_test_query()).
+ * @param nb_hashs is the number of hashs of the version.
+ */
+static void insert_test_version(catalog_t *catalog, const gchar *name, guint64 mtime, const gchar *owner, guint nb_hashs)
+{
+    meta_data_t *meta = NULL;
+    guint i = 0;
+
+    meta = new_meta_data_t();
+    meta->file_type = 1;
+    meta->mode = 0100644;
+    meta->inode = mtime;
+    meta->atime = mtime;
+    meta->ctime = mtime;
+    meta->mtime = mtime;
+    meta->size = nb_hashs * 1024;
+    meta->name = g_strdup(name);
+    meta->link = g_strdup("");
+    meta->owner = g_strdup(owner);
+    meta->group = g_strdup(owner);
+    meta->uid = g_strcmp0(owner, "root") == 0 ? 0 : 1000;
+    meta->gid = meta->uid;
+
+    for (i = 0; i < nb_hashs; i++)
+        {
+            meta->hash_data_list = g_list_append(meta->hash_data_list, new_hash_data_t_as_is(NULL, 0, make_test_hash(mtime + i), COMPRESS_NONE_TYPE, 0));
+        }
+
+    catalog_insert_meta_data(catalog, meta);
+    free_meta_data_t(meta, TRUE);
+}
+
+
+/**
+ * Opens a new catalog with versions of a few files (the versions of
+ * /home/user/a are not inserted in order).
+ * @param prefix is the directory where the catalog is made.
+ * @returns the newly opened catalog.
+ */
+static catalog_t *open_test_catalog(const gchar *prefix)
+{
+    catalog_t *catalog = NULL;
+    gchar *filename = NULL;
+
+    filename = g_build_filename(prefix, "test.db", NULL);
+    catalog = open_catalog(filename);
+    g_assert_nonnull(catalog);
+    g_assert_true(catalog->created);
+
+    catalog_begin(catalog);
+    insert_test_version(catalog, "/home/user/a", 1400000000, "root", 2);
+    insert_test_version(catalog, "/home/user/b", 1500000000, "root", 0);
+    insert_test_version(catalog, "/home/user/a", 1300000000, "root", 1);
+    insert_test_version(catalog, "/etc/hosts", 1450000000, "root", 1);
+    insert_test_version(catalog, "/home/alice/c", 1350000000, "alice", 1);
+    catalog_commit(catalog);
+
+    free_variable(filename);
+
+    return catalog;
+}
+
+
+/**
+ * Writes a line of a flat meta data file as former versions of the file
+ * backend did.
+ * @param stream is the flat meta data file.
+ * @param name is the name of the saved file.
+ * @param mtime is its modification time.
+ */
+static void write_flat_line(FILE *stream, const gchar *name, guint64 mtime)
+{
+    gchar *name64 = NULL;
+
+    name64 = g_base64_encode((guchar *) name, strlen(name));
+    fprintf(stream, "2, 12, 16877, %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", 4096, \"root\", \"root\", 0, 0, \"%s\", \"\"\n", mtime, mtime, mtime, name64);
+    free_variable(name64);
+}
+
+
+/**
+ * A flat meta data file is imported at the first use of the catalog of
+ * its host, renamed and never imported again.
+ */
+static void test_catalog_import(void)
+{
+    server_struct_t *server_struct = NULL;
+    meta_data_t *meta = NULL;
+    GList *file_list = NULL;
+    gchar *prefix = NULL;
+    gchar *flat_filename = NULL;
+    gchar *imported_filename = NULL;
+    gchar *catalog_filename = NULL;
+    gchar *unknown_filename = NULL;
+    FILE *stream = NULL;
+
+    prefix = make_test_directory();
+    flat_filename = g_build_filename(prefix, "meta", TEST_CATALOG_HOST, NULL);
+    imported_filename = g_strconcat(flat_filename, FLAT_IMPORTED_SUFFIX, NULL);
+    catalog_filename = g_strconcat(flat_filename, CATALOG_SUFFIX, NULL);
+    unknown_filename = g_strconcat(prefix, G_DIR_SEPARATOR_S, "meta", G_DIR_SEPARATOR_S, "unknownhost", CATALOG_SUFFIX, NULL);
+
+    server_struct = start_file_backend(prefix, NULL);
+
+    stream = fopen(flat_filename, "w");
+    g_assert_nonnull(stream);
+    write_flat_line(stream, "/home/b", 1500000000);
+    write_flat_line(stream, "/home/a", 1400000000);
+    write_flat_line(stream, "/home/a", 1300000000);
+    fclose(stream);
+
+    /* an unknown host has no catalog */
+    g_assert_null(list_host_files(server_struct, "unknownhost"));
+    g_assert_false(file_exists(unknown_filename));
+
+    file_list = list_host_files(server_struct, TEST_CATALOG_HOST);
+
+    g_assert_cmpuint(g_list_length(file_list), ==, 3);
+    meta = g_list_nth_data(file_list, 0);
+    g_assert_cmpstr(meta->name, ==, "/home/a");
+    g_assert_cmpuint(meta->mtime, ==, 1300000000);
+    meta = g_list_nth_data(file_list, 2);
+    g_assert_cmpstr(meta->name, ==, "/home/b");
+    g_list_free_full(file_list, free_glist_meta_data_t);
+
+    g_assert_false(file_exists(flat_filename));
+    g_assert_true(file_exists(imported_filename));
+    g_assert_true(file_exists(catalog_filename));
+
+    stop_file_backend(server_struct);
+
+    /* the catalog is reopened as is: nothing is imported twice */
+    server_struct = start_file_backend(prefix, NULL);
+    file_list = list_host_files(server_struct, TEST_CATALOG_HOST);
+    g_assert_cmpuint(g_list_length(file_list), ==, 3);
+    g_list_free_full(file_list, free_glist_meta_data_t);
+    stop_file_backend(server_struct);
+
+    remove_test_directory(prefix);
+    free_variable(unknown_filename);
+    free_variable(catalog_filename);
+    free_variable(imported_filename);
+    free_variable(flat_filename);
+    free_variable(prefix);
+}
+
+
+/**
+ * A flat meta data file that can not be read leaves no catalog behind:
+ * it is kept and imported at the next use of the catalog of its host.
+ */
+static void test_catalog_import_failure(void)
+{
+    server_struct_t *server_struct = NULL;
+    GList *file_list = NULL;
+    gchar *prefix = NULL;
+    gchar *flat_filename = NULL;
+    gchar *catalog_filename = NULL;
+    FILE *stream = NULL;
+
+    prefix = make_test_directory();
+    flat_filename = g_build_filename(prefix, "meta", TEST_CATALOG_HOST, NULL);
+    catalog_filename = g_strconcat(flat_filename, CATALOG_SUFFIX, NULL);
+
+    server_struct = start_file_backend(prefix, NULL);
+
+    /* a directory can not be read as a flat meta data file */
+    g_assert_cmpint(g_mkdir(flat_filename, 0700), ==, 0);
+
+    g_assert_null(list_host_files(server_struct, TEST_CATALOG_HOST));
+    g_assert_false(file_exists(catalog_filename));
+    g_assert_true(file_exists(flat_filename));
+
+    g_assert_cmpint(g_rmdir(flat_filename), ==, 0);
+    stream = fopen(flat_filename, "w");
+    g_assert_nonnull(stream);
+    write_flat_line(stream, "/home/a", 1400000000);
+    fclose(stream);
+
+    /* the import is retried */
+    file_list = list_host_files(server_struct, TEST_CATALOG_HOST);
+    g_assert_cmpuint(g_list_length(file_list), ==, 1);
+    g_list_free_full(file_list, free_glist_meta_data_t);
+    g_assert_true(file_exists(catalog_filename));
+    g_assert_false(file_exists(flat_filename));
+
+    stop_file_backend(server_struct);
+
+    remove_test_directory(prefix);
+    free_variable(catalog_filename);
+    free_variable(flat_filename);
+    free_variable(prefix);
+}
+
+
+/**
+ * Versions stored through file_store_smeta() go into the catalog of
+ * their host, created at the first one.
+ */
+static void test_catalog_store(void)
+{
+    server_struct_t *server_struct = NULL;
+    server_meta_data_t *smeta = NULL;
+    GList *file_list = NULL;
+    gchar *prefix = NULL;
+
+    prefix = make_test_directory();
+    server_struct = start_file_backend(prefix, NULL);
+
+    smeta = new_smeta_data_t();
+    smeta->hostname = g_strdup("storehost");
+    smeta->meta = new_meta_data_t();
+    smeta->meta->file_type = 1;
+    smeta->meta->name = g_strdup("/etc/hosts");
+    smeta->meta->link = g_strdup("");
+    smeta->meta->owner = g_strdup("root");
+    smeta->meta->group = g_strdup("root");
+    smeta->meta->mtime = 1600000000;
+
+    file_store_smeta(server_struct, smeta);
+    free_smeta_data_t(smeta);
+
+    file_list = list_host_files(server_struct, "storehost");
+    g_assert_cmpuint(g_list_length(file_list), ==, 1);
+    g_assert_cmpstr(((meta_data_t *) file_list->data)->name, ==, "/etc/hosts");
+    g_list_free_full(file_list, free_glist_meta_data_t);
+
+    stop_file_backend(server_struct);
+    remove_test_directory(prefix);
+    free_variable(prefix);
+}
+
+
+/**
+ * Listings are filtered by owner, filename and dates and keep only the
+ * latest version of each file when asked to. Hash lists are kept.
+ */
+static void test_catalog_query(void)
+{
+    catalog_t *catalog = NULL;
+    query_t *query = NULL;
+    GList *file_list = NULL;
+    meta_data_t *meta = NULL;
+    guint8 *hash = NULL;
+    gchar *prefix = NULL;
+
+    prefix = make_test_directory();
+    catalog = open_test_catalog(prefix);
+
+    query = make_test_query("host", "root");
+    assert_catalog_list(catalog, query, "/etc/hosts@1450000000 /home/user/a@1300000000 /home/user/a@1400000000 /home/user/b@1500000000");
+
+    file_list = catalog_get_file_list(catalog, query, 0);
+    meta = g_list_nth_data(file_list, 2);
+    g_assert_cmpuint(g_list_length(meta->hash_data_list), ==, 2);
+    hash = make_test_hash(1400000000);
+    g_assert_cmpmem(((hash_data_t *) meta->hash_data_list->data)->hash, HASH_LEN, hash, HASH_LEN);
+    free_variable(hash);
+    meta = g_list_nth_data(file_list, 3);
+    g_assert_null(meta->hash_data_list);
+    g_list_free_full(file_list, free_glist_meta_data_t);
+
+    query->latest = TRUE;
+    assert_catalog_list(catalog, query, "/etc/hosts@1450000000 /home/user/a@1400000000 /home/user/b@1500000000");
+
+    /* Filenames are case insensitive regular expressions */
+    query->latest = FALSE;
+    query->filename = g_strdup("^/HOME/user/");
+    assert_catalog_list(catalog, query, "/home/user/a@1300000000 /home/user/a@1400000000 /home/user/b@1500000000");
+    free_variable(query->filename);
+    query->filename = NULL;
+    query->filename = g_strdup("hosts$");
+    assert_catalog_list(catalog, query, "/etc/hosts@1450000000");
+    free_variable(query->filename);
+    query->filename = NULL;
+
+    query->afterdate = make_test_date(1400000000);
+    query->beforedate = make_test_date(1500000000);
+    assert_catalog_list(catalog, query, "/etc/hosts@1450000000 /home/user/a@1400000000");
+    free_variable(query->afterdate);
+    query->afterdate = NULL;
+    free_variable(query->beforedate);
+    query->beforedate = NULL;
+
+    query->date = make_test_date(1300000000);
+    assert_catalog_list(catalog, query, "/home/user/a@1300000000");
+    free_query_t(query);
+
+    query = make_test_query("host", "alice");
+    assert_catalog_list(catalog, query, "/home/alice/c@1350000000");
+    free_query_t(query);
+
+    close_catalog(catalog);
+    remove_test_directory(prefix);
+    free_variable(prefix);
+}
+
+
+/**
+ * As of listings give the version of each file that was the current one
+ * at that date, whatever the order in which versions were inserted, and
+ * latest listings restricted to a date range keep the latest version in
+ * that range.
+ */
+static void test_catalog_asof(void)
+{
+    catalog_t *catalog = NULL;
+    query_t *query = NULL;
+    gchar *prefix = NULL;
+
+    prefix = make_test_directory();
+    catalog = open_test_catalog(prefix);
+
+    query = make_test_query("host", "root");
+
+    query->asof = make_test_date(1250000000);
+    assert_catalog_list(catalog, query, "");
+    free_variable(query->asof);
+    query->asof = NULL;
+
+    query->asof = make_test_date(1350000000);
+    assert_catalog_list(catalog, query, "/home/user/a@1300000000");
+    free_variable(query->asof);
+    query->asof = NULL;
+
+    query->asof = make_test_date(1450000000);
+    assert_catalog_list(catalog, query, "/etc/hosts@1450000000 /home/user/a@1400000000");
+    free_variable(query->asof);
+    query->asof = NULL;
+
+    /* A version inserted later in the history closes the one before */
+    insert_test_version(catalog, "/home/user/a", 1420000000, "root", 1);
+    query->asof = make_test_date(1450000000);
+    assert_catalog_list(catalog, query, "/etc/hosts@1450000000 /home/user/a@1420000000");
+    free_variable(query->asof);
+    query->asof = NULL;
+
+    query->latest = TRUE;
+    assert_catalog_list(catalog, query, "/etc/hosts@1450000000 /home/user/a@1420000000 /home/user/b@1500000000");
+    query->beforedate = make_test_date(1410000000);
+    assert_catalog_list(catalog, query, "/home/user/a@1400000000");
+
+    free_query_t(query);
+    close_catalog(catalog);
+    remove_test_directory(prefix);
+    free_variable(prefix);
+}
+
+
+/**
+ * Pages of a listing follow each other through the cursor and together
+ * give the whole listing.
+ */
+static void test_catalog_paging(void)
+{
+    catalog_t *catalog = NULL;
+    query_t *query = NULL;
+    GList *file_list = NULL;
+    GList *page = NULL;
+    gchar *description = NULL;
+    gboolean latest = FALSE;
+    guint nb_pages = 0;
+    gchar *prefix = NULL;
+
+    prefix = make_test_directory();
+    catalog = open_test_catalog(prefix);
+
+    /* Two versions with the same name and mtime are both listed */
+    insert_test_version(catalog, "/home/user/b", 1500000000, "root", 3);
+
+    query = make_test_query("host", "root");
+
+    for (latest = FALSE; latest <= TRUE; latest++)
+        {
+            query->latest = latest;
+            nb_pages = 0;
+
+            while ((page = catalog_get_file_list(catalog, query, 2)) != NULL)
+                {
+                    g_assert_cmpuint(g_list_length(page), <=, 2);
+                    g_assert_nonnull(query->cursor);
+                    file_list = g_list_concat(file_list, page);
+                    nb_pages++;
+                }
+
+            description = describe_file_list(file_list);
+
+            if (latest == FALSE)
+                {
+                    g_assert_cmpuint(nb_pages, ==, 3);
+                    g_assert_cmpstr(description, ==, "/etc/hosts@1450000000 /home/user/a@1300000000 /home/user/a@1400000000 /home/user/b@1500000000 /home/user/b@1500000000");
+                    g_assert_cmpuint(g_list_length(((meta_data_t *) g_list_last(file_list)->data)->hash_data_list), ==, 3);
+                }
+            else
+                {
+                    g_assert_cmpuint(nb_pages, ==, 2);
+                    g_assert_cmpstr(description, ==, "/etc/hosts@1450000000 /home/user/a@1400000000 /home/user/b@1500000000");
+                }
+
+            free_variable(description);
+            g_list_free_full(file_list, free_glist_meta_data_t);
+            file_list = NULL;
+            free_variable(query->cursor);
+            query->cursor = NULL;
+        }
+
+    /* Names only */
+    query->latest = FALSE;
+    query->without_hashs = TRUE;
+    file_list = catalog_get_file_list(catalog, query, 0);
+    g_assert_cmpuint(g_list_length(file_list), ==, 5);
+    g_assert_null(((meta_data_t *) file_list->data)->hash_data_list);
+    g_list_free_full(file_list, free_glist_meta_data_t);
+
+    free_query_t(query);
+    close_catalog(catalog);
+    remove_test_directory(prefix);
+    free_variable(prefix);
+}
+
+
+/**
+ * A catalog reopened keeps its versions.
+ */
+static void test_catalog_reopen(void)
+{
+    catalog_t *catalog = NULL;
+    query_t *query = NULL;
+    gchar *filename = NULL;
+    gchar *prefix = NULL;
+
+    prefix = make_test_directory();
+    catalog = open_test_catalog(prefix);
+    close_catalog(catalog);
+
+    filename = g_build_filename(prefix, "test.db", NULL);
+    catalog = open_catalog(filename);
+    g_assert_nonnull(catalog);
+    g_assert_false(catalog->created);
+
+    query = make_test_query("host", "root");
+    query->latest = TRUE;
+    assert_catalog_list(catalog, query, "/etc/hosts@1450000000 /home/user/a@1400000000 /home/user/b@1500000000");
+    free_query_t(query);
+
+    close_catalog(catalog);
+    remove_test_directory(prefix);
+    free_variable(filename);
+    free_variable(prefix);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/catalog/import", test_catalog_import);
+    g_test_add_func("/catalog/import_failure", test_catalog_import_failure);
+    g_test_add_func("/catalog/store", test_catalog_store);
+    g_test_add_func("/catalog/query", test_catalog_query);
+    g_test_add_func("/catalog/asof", test_catalog_asof);
+    g_test_add_func("/catalog/paging", test_catalog_paging);
+    g_test_add_func("/catalog/reopen", test_catalog_reopen);
+
+    return g_test_run();
+}
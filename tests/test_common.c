@@ -0,0 +1,103 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_common.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_common.c
+ * Helpers shared by the unit tests.
+ */
+
+#include <glib/gstdio.h>
+#include "libcdpfgl.h"
+#include "test_common.h"
+
+
+/**
+ * Makes the binary hash of a number.
+ * @param i is the number to be hashed.
+ * @returns a newly allocated binary hash (HASH_LEN bytes).
+ */
+guint8 *make_test_hash(guint i)
+{
+    GChecksum *checksum = NULL;
+    guint8 *hash = NULL;
+    gsize len = HASH_LEN;
+
+    hash = (guint8 *) g_malloc0(HASH_LEN);
+    checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(checksum, (guchar *) &i, sizeof(i));
+    g_checksum_get_digest(checksum, hash, &len);
+    g_checksum_free(checksum);
+
+    return hash;
+}
+
+
+/**
+ * Creates a new temporary directory.
+ * @returns the newly allocated name of the directory.
+ */
+gchar *make_test_directory(void)
+{
+    gchar *path = NULL;
+
+    path = g_dir_make_tmp("cdpfgl-test-XXXXXX", NULL);
+    g_assert_nonnull(path);
+
+    return path;
+}
+
+
+/**
+ * Removes a directory and everything in it.
+ * @param path is the directory to be removed.
+ */
+void remove_test_directory(const gchar *path)
+{
+    GDir *dir = NULL;
+    const gchar *name = NULL;
+    gchar *child = NULL;
+
+    dir = g_dir_open(path, 0, NULL);
+
+    if (dir != NULL)
+        {
+            while ((name = g_dir_read_name(dir)) != NULL)
+                {
+                    child = g_build_filename(path, name, NULL);
+
+                    if (g_file_test(child, G_FILE_TEST_IS_DIR) == TRUE && g_file_test(child, G_FILE_TEST_IS_SYMLINK) == FALSE)
+                        {
+                            remove_test_directory(child);
+                        }
+                    else
+                        {
+                            g_unlink(child);
+                        }
+
+                    free_variable(child);
+                }
+
+            g_dir_close(dir);
+        }
+
+    g_rmdir(path);
+}
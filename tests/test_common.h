@@ -0,0 +1,53 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_common.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_common.h
+ * Helpers shared by the unit tests.
+ */
+#ifndef _TESTS_TEST_COMMON_H_
+#define _TESTS_TEST_COMMON_H_
+
+
+/**
+ * Makes the binary hash of a number.
+ * @param i is the number to be hashed.
+ * @returns a newly allocated binary hash (HASH_LEN bytes).
+ */
+extern guint8 *make_test_hash(guint i);
+
+
+/**
+ * Creates a new temporary directory.
+ * @returns the newly allocated name of the directory.
+ */
+extern gchar *make_test_directory(void);
+
+
+/**
+ * Removes a directory and everything in it.
+ * @param path is the directory to be removed.
+ */
+extern void remove_test_directory(const gchar *path);
+
+
+#endif /* #ifndef _TESTS_TEST_COMMON_H_ */
@@ -0,0 +1,373 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_compress.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_compress.c
+ * Tests of zlib, zstd and lz4 compression, of the raw fallback for
+ * buffers that are not worth compressing and of zstd dictionaries.
+ */
+
+#include "libcdpfgl.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_NB_SAMPLES
+ * Number of samples used to train a dictionary.
+ */
+#define TEST_NB_SAMPLES (1000)
+
+/**
+ * @def TEST_SAMPLE_SIZE
+ * Size of each sample used to train a dictionary.
+ */
+#define TEST_SAMPLE_SIZE (512)
+
+/**
+ * @def TEST_DICT_ID
+ * Id of the dictionary registered by the tests.
+ */
+#define TEST_DICT_ID (1)
+
+
+/**
+ * Makes a buffer that compresses well (lines of text).
+ * @param size is the size of the buffer.
+ * @param seed changes the numbers written in the text.
+ * @returns a newly allocated buffer of size bytes.
+ */
+static guchar *make_text_buffer(guint size, guint seed)
+{
+    GString *text = NULL;
+    guint i = 0;
+
+    text = g_string_new("");
+
+    while (text->len < size)
+        {
+            g_string_append_printf(text, "{\"name\": \"file_%u\", \"inode\": %u, \"mode\": %o},\n", seed + i, (seed + i) * 7919, 0100644);
+            i++;
+        }
+
+    g_string_truncate(text, size);
+
+    return (guchar *) g_string_free(text, FALSE);
+}
+
+
+/**
+ * Makes a buffer of pseudo random bytes (that does not compress).
+ * @param size is the size of the buffer.
+ * @returns a newly allocated buffer of size bytes.
+ */
+static guchar *make_random_buffer(guint size)
+{
+    GRand *rand = NULL;
+    guchar *buffer = NULL;
+    guint i = 0;
+
+    rand = g_rand_new_with_seed(42);
+    buffer = (guchar *) g_malloc(size);
+
+    for (i = 0; i < size; i++)
+        {
+            buffer[i] = (guchar) g_rand_int_range(rand, 0, 256);
+        }
+
+    g_rand_free(rand);
+
+    return buffer;
+}
+
+
+/**
+ * Compresses and uncompresses a buffer and checks that the result is
+ * the buffer.
+ * @param buffer is the buffer to be compressed.
+ * @param size is the size of the buffer.
+ * @param type is the compression type to use.
+ * @returns the length of the compressed buffer.
+ */
+static guint64 assert_round_trip(guchar *buffer, guint size, gint type)
+{
+    compress_t *comp = NULL;
+    compress_t *uncomp = NULL;
+    guint64 cmplen = 0;
+
+    comp = compress_buffer(buffer, size, type);
+    g_assert_nonnull(comp);
+    g_assert_true(comp->comp);
+    cmplen = comp->len;
+
+    uncomp = uncompress_buffer(comp->text, comp->len, size, type);
+    g_assert_nonnull(uncomp);
+    g_assert_false(uncomp->comp);
+    g_assert_cmpmem(uncomp->text, uncomp->len, buffer, size);
+
+    free_compress_t(uncomp);
+    free_compress_t(comp);
+
+    return cmplen;
+}
+
+
+/**
+ * Every compression type gives back the buffer it compressed, whatever
+ * its size and the compression level, and text shrinks.
+ */
+static void test_compress_round_trip(void)
+{
+    gint types[] = {COMPRESS_ZLIB_TYPE, COMPRESS_ZSTD_TYPE, COMPRESS_LZ4_TYPE};
+    guint sizes[] = {1, 100, 4096, 65536};
+    gint levels[] = {COMPRESS_DEFAULT_LEVEL, 1, 9};
+    guchar *buffer = NULL;
+    guint64 cmplen = 0;
+    guint i = 0;
+    guint j = 0;
+    guint k = 0;
+
+    for (k = 0; k < G_N_ELEMENTS(levels); k++)
+        {
+            set_compression_level(levels[k]);
+
+            for (j = 0; j < G_N_ELEMENTS(sizes); j++)
+                {
+                    buffer = make_text_buffer(sizes[j], j);
+
+                    for (i = 0; i < G_N_ELEMENTS(types); i++)
+                        {
+                            cmplen = assert_round_trip(buffer, sizes[j], types[i]);
+
+                            if (sizes[j] >= 4096)
+                                {
+                                    g_assert_cmpuint(cmplen, <, sizes[j] / 2);
+                                }
+                        }
+
+                    free_variable(buffer);
+                }
+        }
+
+    set_compression_level(COMPRESS_DEFAULT_LEVEL);
+
+    buffer = make_random_buffer(65536);
+
+    for (i = 0; i < G_N_ELEMENTS(types); i++)
+        {
+            assert_round_trip(buffer, 65536, types[i]);
+        }
+
+    free_variable(buffer);
+}
+
+
+/**
+ * Uncompressing fails (without freeing the buffer) with an unknown
+ * compression type or when the uncompressed length is not the one
+ * given.
+ */
+static void test_compress_uncompress_errors(void)
+{
+    guchar *buffer = NULL;
+    compress_t *comp = NULL;
+    gint types[] = {COMPRESS_ZSTD_TYPE, COMPRESS_LZ4_TYPE};
+    guint i = 0;
+
+    buffer = make_text_buffer(4096, 0);
+
+    g_assert_null(uncompress_buffer(buffer, 4096, 4096, 42));
+
+    for (i = 0; i < G_N_ELEMENTS(types); i++)
+        {
+            comp = compress_buffer(buffer, 4096, types[i]);
+            g_assert_nonnull(comp);
+            g_assert_null(uncompress_buffer(comp->text, comp->len, 4000, types[i]));
+            g_assert_null(uncompress_buffer(comp->text, comp->len, 5000, types[i]));
+            free_compress_t(comp);
+        }
+
+    free_variable(buffer);
+}
+
+
+/**
+ * Random data is not worth compressing while text and zeros are, as
+ * are small buffers.
+ */
+static void test_compress_is_worth_compressing(void)
+{
+    guchar *buffer = NULL;
+
+    buffer = make_random_buffer(65536);
+    g_assert_false(is_worth_compressing(buffer, 65536));
+    g_assert_false(is_worth_compressing(buffer, 1024));
+    g_assert_true(is_worth_compressing(buffer, 100));
+    free_variable(buffer);
+
+    buffer = make_text_buffer(65536, 0);
+    g_assert_true(is_worth_compressing(buffer, 65536));
+    free_variable(buffer);
+
+    buffer = (guchar *) g_malloc0(65536);
+    g_assert_true(is_worth_compressing(buffer, 65536));
+    free_variable(buffer);
+}
+
+
+/**
+ * new_hash_data_t() keeps data that does not compress as is and
+ * compresses the rest.
+ */
+static void test_compress_raw_fallback(void)
+{
+    gint types[] = {COMPRESS_ZLIB_TYPE, COMPRESS_ZSTD_TYPE, COMPRESS_LZ4_TYPE};
+    hash_data_t *hash_data = NULL;
+    guchar *buffer = NULL;
+    compress_t *uncomp = NULL;
+    guint i = 0;
+
+    for (i = 0; i < G_N_ELEMENTS(types); i++)
+        {
+            buffer = make_random_buffer(16384);
+            hash_data = new_hash_data_t(buffer, 16384, NULL, types[i]);
+            g_assert_cmpint(hash_data->cmptype, ==, COMPRESS_NONE_TYPE);
+            g_assert_true(hash_data->data == buffer);
+            g_assert_cmpint(hash_data->read, ==, 16384);
+            g_assert_cmpint(hash_data->uncmplen, ==, 16384);
+            free_hash_data_t(hash_data);
+
+            buffer = make_text_buffer(16384, i);
+            hash_data = new_hash_data_t(buffer, 16384, NULL, types[i]);
+            g_assert_cmpint(hash_data->cmptype, ==, types[i]);
+            g_assert_cmpint(hash_data->read, <, 16384);
+            g_assert_cmpint(hash_data->uncmplen, ==, 16384);
+
+            uncomp = uncompress_buffer(hash_data->data, hash_data->read, hash_data->uncmplen, hash_data->cmptype);
+            g_assert_nonnull(uncomp);
+            g_assert_cmpmem(uncomp->text, uncomp->len, buffer, 16384);
+            free_compress_t(uncomp);
+            free_variable(buffer);
+            free_hash_data_t(hash_data);
+        }
+}
+
+
+/**
+ * Only the known compression types are allowed.
+ */
+static void test_compress_type_allowed(void)
+{
+    gchar *types = NULL;
+
+    g_assert_true(is_compress_type_allowed(COMPRESS_NONE_TYPE));
+    g_assert_true(is_compress_type_allowed(COMPRESS_ZLIB_TYPE));
+    g_assert_true(is_compress_type_allowed(COMPRESS_ZSTD_TYPE));
+    g_assert_true(is_compress_type_allowed(COMPRESS_LZ4_TYPE));
+    g_assert_false(is_compress_type_allowed(4));
+    g_assert_false(is_compress_type_allowed(-1));
+
+    types = get_compress_type_string();
+    g_assert_cmpstr(types, ==, "0, 1, 2, 3");
+    free_variable(types);
+}
+
+
+/**
+ * A dictionary trained on samples is used for zstd once registered and
+ * selected and blocks compressed with it can only be uncompressed once
+ * it is registered.
+ */
+static void test_compress_dictionary(void)
+{
+    guchar *samples = NULL;
+    gsize *sizes = NULL;
+    guchar *sample = NULL;
+    guchar *dict = NULL;
+    gsize len = 0;
+    guchar *buffer = NULL;
+    compress_t *plain = NULL;
+    guint64 cmplen = 0;
+    guint i = 0;
+
+    samples = (guchar *) g_malloc(TEST_NB_SAMPLES * TEST_SAMPLE_SIZE);
+    sizes = (gsize *) g_malloc(TEST_NB_SAMPLES * sizeof(gsize));
+
+    for (i = 0; i < TEST_NB_SAMPLES; i++)
+        {
+            sample = make_text_buffer(TEST_SAMPLE_SIZE, i * 13);
+            memcpy(samples + i * TEST_SAMPLE_SIZE, sample, TEST_SAMPLE_SIZE);
+            sizes[i] = TEST_SAMPLE_SIZE;
+            free_variable(sample);
+        }
+
+    g_assert_null(train_compress_dictionary(samples, sizes, 1, 16384, &len));
+
+    dict = train_compress_dictionary(samples, sizes, TEST_NB_SAMPLES, 16384, &len);
+    g_assert_nonnull(dict);
+    g_assert_cmpuint(len, >, 0);
+    g_assert_cmpuint(len, <=, 16384);
+
+    buffer = make_text_buffer(TEST_SAMPLE_SIZE, 123457);
+
+    /* Not registered yet: compressing and uncompressing fail */
+    g_assert_false(has_compress_dictionary(TEST_DICT_ID));
+    g_assert_null(compress_buffer(buffer, TEST_SAMPLE_SIZE, COMPRESS_ZSTD_DICT_TYPE + TEST_DICT_ID));
+    g_assert_null(uncompress_buffer(buffer, TEST_SAMPLE_SIZE, TEST_SAMPLE_SIZE, COMPRESS_ZSTD_DICT_TYPE + TEST_DICT_ID));
+
+    g_assert_true(add_compress_dictionary(TEST_DICT_ID, dict, len));
+    g_assert_true(add_compress_dictionary(TEST_DICT_ID, dict, len));
+    g_assert_true(has_compress_dictionary(TEST_DICT_ID));
+    g_assert_true(is_compress_type_allowed(COMPRESS_ZSTD_DICT_TYPE + TEST_DICT_ID));
+
+    g_assert_cmpint(get_compress_type_to_use(COMPRESS_ZSTD_TYPE), ==, COMPRESS_ZSTD_TYPE);
+    use_compress_dictionary(TEST_DICT_ID);
+    g_assert_cmpint(get_compress_type_to_use(COMPRESS_ZSTD_TYPE), ==, COMPRESS_ZSTD_DICT_TYPE + TEST_DICT_ID);
+    g_assert_cmpint(get_compress_type_to_use(COMPRESS_LZ4_TYPE), ==, COMPRESS_LZ4_TYPE);
+
+    /* Small blocks shrink more with the dictionary than without */
+    cmplen = assert_round_trip(buffer, TEST_SAMPLE_SIZE, COMPRESS_ZSTD_DICT_TYPE + TEST_DICT_ID);
+    plain = compress_buffer(buffer, TEST_SAMPLE_SIZE, COMPRESS_ZSTD_TYPE);
+    g_assert_cmpuint(cmplen, <, plain->len);
+    free_compress_t(plain);
+
+    use_compress_dictionary(0);
+    g_assert_cmpint(get_compress_type_to_use(COMPRESS_ZSTD_TYPE), ==, COMPRESS_ZSTD_TYPE);
+
+    free_variable(buffer);
+    free_variable(dict);
+    free_variable(sizes);
+    free_variable(samples);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/compress/round_trip", test_compress_round_trip);
+    g_test_add_func("/compress/uncompress_errors", test_compress_uncompress_errors);
+    g_test_add_func("/compress/is_worth_compressing", test_compress_is_worth_compressing);
+    g_test_add_func("/compress/raw_fallback", test_compress_raw_fallback);
+    g_test_add_func("/compress/type_allowed", test_compress_type_allowed);
+    g_test_add_func("/compress/dictionary", test_compress_dictionary);
+
+    return g_test_run();
+}
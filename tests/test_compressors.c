@@ -0,0 +1,344 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_compressors.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_compressors.c
+ * Tests of the compressors thread pool of the file backend: blocks stored
+ * uncompressed are compressed at rest in the background, others are left
+ * as is, and retrieved blocks uncompress to what was stored, even when
+ * a compression was interrupted.
+ */
+
+#include "server.h"
+#include "test_common.h"
+#include "test_file_backend.h"
+
+/**
+ * @def TEST_BLOCK_SIZE
+ * Size of the blocks stored by the tests.
+ */
+#define TEST_BLOCK_SIZE (16384)
+
+
+/**
+ * Stores a block into the file backend.
+ * @param server_struct is the server structure of the file backend.
+ * @param i is the number whose hash is the hash of the block.
+ * @param data is the content of the block (it is copied).
+ * @param read is the length of data.
+ * @param cmptype is the compression type of data.
+ * @param uncmplen is the uncompressed length of data.
+ * @returns the newly allocated hexadecimal hash of the block.
+ */
+static gchar *store_block(server_struct_t *server_struct, guint i, guchar *data, gssize read, gshort cmptype, gssize uncmplen)
+{
+    file_backend_t *file_backend = server_struct->backend_data->user_data;
+    hash_data_t *hash_data = NULL;
+    guint8 *hash = NULL;
+    gchar *prefix = NULL;
+    gchar *path = NULL;
+    gchar *hex_hash = NULL;
+
+    hash = make_test_hash(i);
+    hex_hash = hash_to_string(hash);
+
+    prefix = g_build_filename(file_backend->prefix, "data", NULL);
+    path = make_path_from_hash(prefix, hash, file_backend->level);
+    g_mkdir_with_parents(path, 0700);
+
+    hash_data = new_hash_data_t_as_is(g_memdup(data, read), read, hash, cmptype, uncmplen);
+    g_assert_true(file_store_data(server_struct, hash_data));
+
+    free_variable(path);
+    free_variable(prefix);
+
+    return hex_hash;
+}
+
+
+/**
+ * Gets the filename of a block stored into the file backend.
+ * @param server_struct is the server structure of the file backend.
+ * @param i is the number whose hash is the hash of the block.
+ * @returns the newly allocated filename of the block.
+ */
+static gchar *get_block_filename(server_struct_t *server_struct, guint i)
+{
+    file_backend_t *file_backend = server_struct->backend_data->user_data;
+    guint8 *hash = NULL;
+    gchar *hex_hash = NULL;
+    gchar *prefix = NULL;
+    gchar *path = NULL;
+    gchar *filename = NULL;
+
+    hash = make_test_hash(i);
+    hex_hash = hash_to_string(hash);
+    prefix = g_build_filename(file_backend->prefix, "data", NULL);
+    path = make_path_from_hash(prefix, hash, file_backend->level);
+    filename = g_build_filename(path, hex_hash + file_backend->level * 2, NULL);
+
+    free_variable(path);
+    free_variable(prefix);
+    free_variable(hex_hash);
+    free_variable(hash);
+
+    return filename;
+}
+
+
+/**
+ * Writes a meta file as the file backend does.
+ * @param filename_meta is the filename of the meta file.
+ * @param uncmplen is the uncompressed length of the block.
+ * @param cmptype is the compression type of the block.
+ */
+static void write_meta_file(gchar *filename_meta, gssize uncmplen, gshort cmptype)
+{
+    GKeyFile *keyfile = NULL;
+
+    keyfile = g_key_file_new();
+    g_key_file_set_int64(keyfile, GN_META, KN_UNCMPLEN, uncmplen);
+    g_key_file_set_integer(keyfile, GN_META, KN_CMPTYPE, cmptype);
+    g_assert_true(g_key_file_save_to_file(keyfile, filename_meta, NULL));
+    g_key_file_free(keyfile);
+}
+
+
+/**
+ * Uncompresses a retrieved block.
+ * @param hash_data is the retrieved block.
+ * @returns the newly allocated uncompressed content of the block.
+ */
+static guchar *uncompress_block(hash_data_t *hash_data)
+{
+    compress_t *compress = NULL;
+    guchar *text = NULL;
+
+    if (hash_data->cmptype == COMPRESS_NONE_TYPE)
+        {
+            return g_memdup(hash_data->data, hash_data->read);
+        }
+
+    compress = uncompress_buffer(hash_data->data, hash_data->read, hash_data->uncmplen, hash_data->cmptype);
+    g_assert_nonnull(compress);
+    g_assert_cmpuint(compress->len, ==, hash_data->uncmplen);
+
+    text = compress->text;
+    compress->text = NULL;
+    free_compress_t(compress);
+
+    return text;
+}
+
+
+/**
+ * Compressible blocks stored uncompressed are compressed at rest once the
+ * compressors have run, random ones and blocks compressed by the client
+ * are kept as they were sent.
+ */
+static void test_compressors_at_rest(void)
+{
+    server_struct_t *server_struct = NULL;
+    hash_data_t *hash_data = NULL;
+    compress_t *compress = NULL;
+    gchar *prefix = NULL;
+    gchar *config = NULL;
+    gchar *text_hash = NULL;
+    gchar *random_hash = NULL;
+    gchar *client_hash = NULL;
+    guchar text[TEST_BLOCK_SIZE];
+    guchar random[TEST_BLOCK_SIZE];
+    guchar *data = NULL;
+    guint i = 0;
+
+    for (i = 0; i < TEST_BLOCK_SIZE; i++)
+        {
+            text[i] = "sauvegarde "[i % 11];
+            random[i] = (guchar) g_random_int();
+        }
+
+    prefix = make_test_directory();
+    config = g_strdup_printf("%s=%d", KN_COMPRESSION_TYPE, COMPRESS_ZLIB_TYPE);
+    server_struct = start_file_backend(prefix, config);
+
+    text_hash = store_block(server_struct, 1, text, TEST_BLOCK_SIZE, COMPRESS_NONE_TYPE, TEST_BLOCK_SIZE);
+    random_hash = store_block(server_struct, 2, random, TEST_BLOCK_SIZE, COMPRESS_NONE_TYPE, TEST_BLOCK_SIZE);
+
+    compress = compress_buffer(text, TEST_BLOCK_SIZE, COMPRESS_LZ4_TYPE);
+    g_assert_nonnull(compress);
+    client_hash = store_block(server_struct, 3, compress->text, compress->len, COMPRESS_LZ4_TYPE, TEST_BLOCK_SIZE);
+
+    /* terminating the backend waits for the compressors */
+    stop_file_backend(server_struct);
+    server_struct = start_file_backend(prefix, config);
+
+    hash_data = file_retrieve_data(server_struct, text_hash);
+    g_assert_nonnull(hash_data);
+    g_assert_cmpint(hash_data->cmptype, ==, COMPRESS_ZLIB_TYPE);
+    g_assert_cmpint(hash_data->uncmplen, ==, TEST_BLOCK_SIZE);
+    g_assert_cmpint(hash_data->read, <, TEST_BLOCK_SIZE);
+    data = uncompress_block(hash_data);
+    g_assert_cmpmem(data, TEST_BLOCK_SIZE, text, TEST_BLOCK_SIZE);
+    free_variable(data);
+    free_hash_data_t(hash_data);
+
+    hash_data = file_retrieve_data(server_struct, random_hash);
+    g_assert_nonnull(hash_data);
+    g_assert_cmpint(hash_data->cmptype, ==, COMPRESS_NONE_TYPE);
+    g_assert_cmpmem(hash_data->data, hash_data->read, random, TEST_BLOCK_SIZE);
+    free_hash_data_t(hash_data);
+
+    hash_data = file_retrieve_data(server_struct, client_hash);
+    g_assert_nonnull(hash_data);
+    g_assert_cmpint(hash_data->cmptype, ==, COMPRESS_LZ4_TYPE);
+    g_assert_cmpmem(hash_data->data, hash_data->read, compress->text, compress->len);
+    free_hash_data_t(hash_data);
+
+    stop_file_backend(server_struct);
+    remove_test_directory(prefix);
+
+    free_compress_t(compress);
+    free_variable(client_hash);
+    free_variable(random_hash);
+    free_variable(text_hash);
+    free_variable(config);
+    free_variable(prefix);
+}
+
+
+/**
+ * Without a compression type no compressor runs and blocks are kept as
+ * they were sent.
+ */
+static void test_compressors_disabled(void)
+{
+    server_struct_t *server_struct = NULL;
+    file_backend_t *file_backend = NULL;
+    hash_data_t *hash_data = NULL;
+    gchar *prefix = NULL;
+    gchar *hex_hash = NULL;
+    guchar text[TEST_BLOCK_SIZE];
+
+    memset(text, 'a', TEST_BLOCK_SIZE);
+
+    prefix = make_test_directory();
+    server_struct = start_file_backend(prefix, NULL);
+    file_backend = server_struct->backend_data->user_data;
+    g_assert_null(file_backend->compressors);
+
+    hex_hash = store_block(server_struct, 1, text, TEST_BLOCK_SIZE, COMPRESS_NONE_TYPE, TEST_BLOCK_SIZE);
+
+    hash_data = file_retrieve_data(server_struct, hex_hash);
+    g_assert_nonnull(hash_data);
+    g_assert_cmpint(hash_data->cmptype, ==, COMPRESS_NONE_TYPE);
+    g_assert_cmpint(hash_data->read, ==, TEST_BLOCK_SIZE);
+    free_hash_data_t(hash_data);
+
+    stop_file_backend(server_struct);
+    remove_test_directory(prefix);
+
+    free_variable(hex_hash);
+    free_variable(prefix);
+}
+
+
+/**
+ * A block whose compression at rest was interrupted between the rename
+ * of the block and the one of its .meta file is retrieved with the meta
+ * data that matches its size, whatever the order of the renames.
+ */
+static void test_compressors_interrupted(void)
+{
+    server_struct_t *server_struct = NULL;
+    hash_data_t *hash_data = NULL;
+    compress_t *compress = NULL;
+    gchar *prefix = NULL;
+    gchar *hex_hashs[2];
+    gchar *filename = NULL;
+    gchar *filename_meta = NULL;
+    guchar text[TEST_BLOCK_SIZE];
+    guchar *data = NULL;
+    guint i = 0;
+
+    for (i = 0; i < TEST_BLOCK_SIZE; i++)
+        {
+            text[i] = "sauvegarde "[i % 11];
+        }
+
+    compress = compress_buffer(text, TEST_BLOCK_SIZE, COMPRESS_ZLIB_TYPE);
+    g_assert_nonnull(compress);
+
+    prefix = make_test_directory();
+    server_struct = start_file_backend(prefix, NULL);
+
+    /* block renamed: its .meta file still says it is uncompressed */
+    hex_hashs[0] = store_block(server_struct, 1, text, TEST_BLOCK_SIZE, COMPRESS_NONE_TYPE, TEST_BLOCK_SIZE);
+    filename = get_block_filename(server_struct, 1);
+    filename_meta = g_strdup_printf("%s.meta.tmp", filename);
+    g_assert_true(g_file_set_contents(filename, (gchar *) compress->text, compress->len, NULL));
+    write_meta_file(filename_meta, TEST_BLOCK_SIZE, COMPRESS_ZLIB_TYPE);
+    free_variable(filename_meta);
+    free_variable(filename);
+
+    hash_data = file_retrieve_data(server_struct, hex_hashs[0]);
+    g_assert_nonnull(hash_data);
+    g_assert_cmpint(hash_data->cmptype, ==, COMPRESS_ZLIB_TYPE);
+    g_assert_cmpint(hash_data->uncmplen, ==, TEST_BLOCK_SIZE);
+    data = uncompress_block(hash_data);
+    g_assert_cmpmem(data, TEST_BLOCK_SIZE, text, TEST_BLOCK_SIZE);
+    free_variable(data);
+    free_hash_data_t(hash_data);
+
+    /* .meta file renamed: the block is still the uncompressed one */
+    hex_hashs[1] = store_block(server_struct, 2, text, TEST_BLOCK_SIZE, COMPRESS_NONE_TYPE, TEST_BLOCK_SIZE);
+    filename = get_block_filename(server_struct, 2);
+    filename_meta = g_strdup_printf("%s.meta", filename);
+    write_meta_file(filename_meta, TEST_BLOCK_SIZE, COMPRESS_ZLIB_TYPE);
+    free_variable(filename_meta);
+    free_variable(filename);
+
+    hash_data = file_retrieve_data(server_struct, hex_hashs[1]);
+    g_assert_nonnull(hash_data);
+    g_assert_cmpint(hash_data->cmptype, ==, COMPRESS_NONE_TYPE);
+    g_assert_cmpmem(hash_data->data, hash_data->read, text, TEST_BLOCK_SIZE);
+    free_hash_data_t(hash_data);
+
+    stop_file_backend(server_struct);
+    remove_test_directory(prefix);
+
+    free_compress_t(compress);
+    free_variable(hex_hashs[1]);
+    free_variable(hex_hashs[0]);
+    free_variable(prefix);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/compressors/at_rest", test_compressors_at_rest);
+    g_test_add_func("/compressors/disabled", test_compressors_disabled);
+    g_test_add_func("/compressors/interrupted", test_compressors_interrupted);
+
+    return g_test_run();
+}
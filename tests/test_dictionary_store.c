@@ -0,0 +1,259 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_dictionary_store.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_dictionary_store.c
+ * Tests of the store of zstd dictionaries: a dictionary trained from a
+ * sample of blocks is kept in its own file, compresses and uncompresses
+ * blocks, is sent to clients and is found again when the store is
+ * reopened.
+ */
+
+#include "server.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_DICTIONARY_BLOCKS
+ * Number of blocks the dictionaries of the tests are trained from.
+ *
+ * @def TEST_DICTIONARY_SIZE
+ * Maximum size of the dictionaries of the tests.
+ */
+#define TEST_DICTIONARY_BLOCKS (2000)
+#define TEST_DICTIONARY_SIZE (8192)
+
+
+/**
+ * Makes a small block that looks like the others (as small files of a
+ * same kind do).
+ * @param i is the number of the block.
+ * @returns a newly allocated \0 terminated block.
+ */
+static gchar *make_block(guint i)
+{
+    return g_strdup_printf("{\"name\": \"/home/user%u/documents/report-%u.txt\", \"owner\": \"user%u\", \"group\": \"users\", \"mode\": %u, \"size\": %u, \"mtime\": %u}\n", i % 17, i, i % 17, 0644 + i % 3, i * 37, 1500000000 + i * 61);
+}
+
+
+/**
+ * Makes a sample of TEST_DICTIONARY_BLOCKS blocks.
+ * @returns a newly allocated sample.
+ */
+static dictionary_sample_t *make_sample(void)
+{
+    dictionary_sample_t *sample = NULL;
+    gchar *block = NULL;
+    guint i = 0;
+
+    sample = new_dictionary_sample_t();
+
+    for (i = 0; i < TEST_DICTIONARY_BLOCKS; i++)
+        {
+            block = make_block(i);
+            dictionary_sample_add_block(sample, (guchar *) block, strlen(block));
+            free_variable(block);
+        }
+
+    return sample;
+}
+
+
+/**
+ * The reservoir keeps at most DICTIONARY_STORE_SAMPLES hashs and only
+ * the beginning of big blocks is sampled.
+ */
+static void test_dictionary_store_sample(void)
+{
+    dictionary_sample_t *sample = NULL;
+    guchar *data = NULL;
+    guint8 *hash = NULL;
+    guint i = 0;
+
+    sample = new_dictionary_sample_t();
+
+    for (i = 0; i < 2 * DICTIONARY_STORE_SAMPLES; i++)
+        {
+            hash = make_test_hash(i);
+            dictionary_sample_hash(hash, sample);
+            free_variable(hash);
+        }
+
+    g_assert_cmpuint(sample->hashs->len, ==, DICTIONARY_STORE_SAMPLES);
+    g_assert_cmpuint(sample->seen, ==, 2 * DICTIONARY_STORE_SAMPLES);
+
+    data = (guchar *) g_malloc0(2 * DICTIONARY_STORE_SAMPLE_SIZE);
+    dictionary_sample_add_block(sample, data, 2 * DICTIONARY_STORE_SAMPLE_SIZE);
+    dictionary_sample_add_block(sample, data, 10);
+    dictionary_sample_add_block(sample, NULL, 10);
+
+    g_assert_cmpuint(sample->sizes->len, ==, 2);
+    g_assert_cmpuint(g_array_index(sample->sizes, gsize, 0), ==, DICTIONARY_STORE_SAMPLE_SIZE);
+    g_assert_cmpuint(sample->samples->len, ==, DICTIONARY_STORE_SAMPLE_SIZE + 10);
+
+    free_variable(data);
+    free_dictionary_sample_t(sample);
+}
+
+
+/**
+ * A trained dictionary is saved, registered, used to compress blocks
+ * with zstd and sent to clients. Reopening the store finds it again and
+ * new ids go after every dictionary file.
+ */
+static void test_dictionary_store_train(void)
+{
+    dictionary_store_t *store = NULL;
+    dictionary_sample_t *sample = NULL;
+    compress_t *compress = NULL;
+    compress_t *uncompress = NULL;
+    json_t *root = NULL;
+    gchar *dirname = NULL;
+    gchar *filename = NULL;
+    gchar *copy = NULL;
+    gchar *answer = NULL;
+    gchar *block = NULL;
+    gchar *data = NULL;
+    gsize len = 0;
+    gshort cmptype = 0;
+    guint id = 0;
+
+    dirname = make_test_directory();
+    store = new_dictionary_store_t(dirname);
+    g_assert_cmpuint(store->latest, ==, 0);
+    g_assert_null(dictionary_store_answer(store, 0));
+
+    sample = make_sample();
+    id = dictionary_store_train(store, sample, TEST_DICTIONARY_SIZE);
+    free_dictionary_sample_t(sample);
+
+    g_assert_cmpuint(id, ==, 1);
+    g_assert_cmpuint(store->latest, ==, 1);
+    g_assert_cmpuint(store->next_id, ==, 2);
+    g_assert_true(has_compress_dictionary(id));
+
+    filename = g_strdup_printf("%s%s1%s", dirname, G_DIR_SEPARATOR_S, DICTIONARY_STORE_EXTENSION);
+    g_assert_true(g_file_get_contents(filename, &data, &len, NULL));
+    g_assert_cmpuint(len, >, 0);
+    g_assert_cmpuint(len, <=, TEST_DICTIONARY_SIZE);
+
+    /* the dictionary compresses and uncompresses blocks */
+    use_compress_dictionary(id);
+    cmptype = get_compress_type_to_use(COMPRESS_ZSTD_TYPE);
+    g_assert_true(IS_COMPRESS_DICT_TYPE(cmptype));
+    g_assert_cmpuint(COMPRESS_DICT_ID(cmptype), ==, id);
+
+    block = make_block(TEST_DICTIONARY_BLOCKS + 1);
+    compress = compress_buffer((guchar *) block, strlen(block), cmptype);
+    g_assert_nonnull(compress);
+    uncompress = uncompress_buffer(compress->text, compress->len, strlen(block), cmptype);
+    g_assert_nonnull(uncompress);
+    g_assert_cmpmem(uncompress->text, uncompress->len, block, strlen(block));
+    free_compress_t(uncompress);
+    free_compress_t(compress);
+    use_compress_dictionary(0);
+
+    /* the answer sent to clients */
+    answer = dictionary_store_answer(store, 0);
+    g_assert_nonnull(answer);
+    root = load_json(answer);
+    g_assert_cmpint(json_integer_value(json_object_get(root, "id")), ==, 1);
+    g_assert_cmpint(json_integer_value(json_object_get(root, "latest")), ==, 1);
+    g_assert_nonnull(json_string_value(json_object_get(root, "dictionary")));
+    json_decref(root);
+    free_variable(answer);
+    g_assert_null(dictionary_store_answer(store, 2));
+
+    free_dictionary_store_t(store);
+
+    /* a copy kept under another id and a file that is not a dictionary */
+    copy = g_strdup_printf("%s%s4%s", dirname, G_DIR_SEPARATOR_S, DICTIONARY_STORE_EXTENSION);
+    g_assert_true(g_file_set_contents(copy, data, len, NULL));
+    free_variable(filename);
+    filename = g_build_filename(dirname, "notes.txt", NULL);
+    g_assert_true(g_file_set_contents(filename, "12", -1, NULL));
+
+    store = new_dictionary_store_t(dirname);
+    g_assert_cmpuint(store->latest, ==, 4);
+    g_assert_cmpuint(store->next_id, ==, 5);
+
+    sample = make_sample();
+    g_assert_cmpuint(dictionary_store_train(store, sample, TEST_DICTIONARY_SIZE), ==, 5);
+    free_dictionary_sample_t(sample);
+
+    /* an empty sample trains nothing */
+    sample = new_dictionary_sample_t();
+    g_assert_cmpuint(dictionary_store_train(store, sample, TEST_DICTIONARY_SIZE), ==, 0);
+    free_dictionary_sample_t(sample);
+
+    free_dictionary_store_t(store);
+    remove_test_directory(dirname);
+
+    free_variable(block);
+    free_variable(data);
+    free_variable(copy);
+    free_variable(filename);
+    free_variable(dirname);
+}
+
+
+/**
+ * A training is asked for once enough blocks have been stored while
+ * there is no dictionary and the training thread is told to end when
+ * the store stops.
+ */
+static void test_dictionary_store_wait(void)
+{
+    dictionary_store_t *store = NULL;
+    gchar *dirname = NULL;
+    guint i = 0;
+
+    dirname = make_test_directory();
+    store = new_dictionary_store_t(dirname);
+
+    for (i = 0; i < DICTIONARY_STORE_TRAIN_BLOCKS; i++)
+        {
+            dictionary_store_block_stored(store);
+        }
+
+    g_assert_true(dictionary_store_wait_for_training(store));
+    g_assert_cmpuint(store->new_blocks, ==, 0);
+
+    dictionary_store_block_stored(NULL);
+    dictionary_store_stop(store);
+    g_assert_false(dictionary_store_wait_for_training(store));
+
+    free_dictionary_store_t(store);
+    remove_test_directory(dirname);
+    free_variable(dirname);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/dictionary_store/sample", test_dictionary_store_sample);
+    g_test_add_func("/dictionary_store/train", test_dictionary_store_train);
+    g_test_add_func("/dictionary_store/wait", test_dictionary_store_wait);
+
+    return g_test_run();
+}
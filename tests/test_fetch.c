@@ -0,0 +1,315 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_fetch.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_fetch.c
+ * Tests of the restore fetch module: batches of blocks are asked with
+ * POST /Data/Hash_Array.json, checked and uncompressed and written with
+ * pwrite() at their offset by several workers.
+ */
+
+#include <glib/gstdio.h>
+#include "restore.h"
+#include "test_common.h"
+#include "test_block_server.h"
+
+/**
+ * @def TEST_NB_BLOCKS
+ * Number of blocks of the file restored in parallel: more batches than
+ * workers, the last one being incomplete.
+ */
+#define TEST_NB_BLOCKS (FETCH_WORKERS * FETCH_BATCH_SIZE + 100)
+
+
+/**
+ * Makes the data of a block. Blocks do not all have the same size so
+ * that offsets of the batches depend on the previous ones.
+ * @param i is the number of the block.
+ * @param[out] len is the length of the block.
+ * @returns the newly allocated data of the block.
+ */
+static guchar *make_test_block(guint i, gsize *len)
+{
+    guchar *data = NULL;
+    gsize j = 0;
+
+    *len = 100 * ((i % 7) + 1);
+    data = (guchar *) g_malloc(*len);
+
+    for (j = 0; j < *len; j++)
+        {
+            data[j] = (guchar) ((i * 31 + j / 8) & 0xff);
+        }
+
+    return data;
+}
+
+
+/**
+ * Adds blocks to the server and makes the list of their hashs.
+ * @param server is the block server.
+ * @param nb_blocks is the number of blocks.
+ * @param[out] expected is the concatenation of the data of the blocks.
+ * @returns the list of the hashs (hash_data_t *) of the blocks.
+ */
+static GList *add_test_blocks(block_server_t *server, guint nb_blocks, GByteArray *expected)
+{
+    GList *hash_list = NULL;
+    guchar *data = NULL;
+    guint8 *hash = NULL;
+    gsize len = 0;
+    guint i = 0;
+
+    for (i = 0; i < nb_blocks; i++)
+        {
+            data = make_test_block(i, &len);
+            hash = add_block_to_server(server, data, len, (i % 2 == 0) ? COMPRESS_ZLIB_TYPE : COMPRESS_NONE_TYPE);
+            hash_list = g_list_prepend(hash_list, new_hash_data_t_as_is(NULL, 0, hash, COMPRESS_NONE_TYPE, 0));
+            g_byte_array_append(expected, data, len);
+            free_variable(data);
+        }
+
+    return g_list_reverse(hash_list);
+}
+
+
+/**
+ * Checks that a file contains exactly the expected bytes.
+ * @param filename is the name of the file.
+ * @param expected is the expected content.
+ */
+static void assert_file_content(const gchar *filename, GByteArray *expected)
+{
+    gchar *contents = NULL;
+    gsize len = 0;
+
+    g_assert_true(g_file_get_contents(filename, &contents, &len, NULL));
+    g_assert_cmpmem(contents, len, expected->data, expected->len);
+    free_variable(contents);
+}
+
+
+/**
+ * Blocks are written at their offset whatever the order of the writes.
+ */
+static void test_fetch_write_at_offset(void)
+{
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+    gchar *contents = NULL;
+    gsize len = 0;
+    gint fd = -1;
+
+    prefix = make_test_directory();
+    filename = g_build_filename(prefix, "restored", NULL);
+    fd = g_open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    g_assert_cmpint(fd, >=, 0);
+
+    g_assert_true(fetch_write_at_offset(fd, (guchar *) "world", 5, 6));
+    g_assert_true(fetch_write_at_offset(fd, (guchar *) "hello ", 6, 0));
+    g_assert_true(fetch_write_at_offset(fd, (guchar *) "", 0, 11));
+    close(fd);
+
+    g_assert_true(g_file_get_contents(filename, &contents, &len, NULL));
+    g_assert_cmpmem(contents, len, "hello world", 11);
+
+    free_variable(contents);
+    remove_test_directory(prefix);
+    free_variable(filename);
+    free_variable(prefix);
+}
+
+
+/**
+ * A batch comes back uncompressed in the order of the asked hashs and
+ * is rejected as a whole when one block is missing.
+ */
+static void test_fetch_batch(void)
+{
+    block_server_t *server = NULL;
+    comm_t *comm = NULL;
+    GByteArray *expected = NULL;
+    GList *hash_list = NULL;
+    GList *batch = NULL;
+    GList *iter = NULL;
+    hash_data_t *hash_data = NULL;
+    guint64 pos = 0;
+
+    server = start_block_server();
+    comm = init_comm_struct(server->conn, COMPRESS_NONE_TYPE);
+    expected = g_byte_array_new();
+    hash_list = add_test_blocks(server, 10, expected);
+
+    batch = fetch_batch_from_server(comm, hash_list, FETCH_BATCH_SIZE);
+    g_assert_cmpuint(g_list_length(batch), ==, 10);
+
+    for (iter = batch; iter != NULL; iter = g_list_next(iter))
+        {
+            hash_data = iter->data;
+            g_assert_cmpint(hash_data->cmptype, ==, COMPRESS_NONE_TYPE);
+            g_assert_cmpmem(hash_data->data, hash_data->read, expected->data + pos, hash_data->read);
+            pos = pos + hash_data->read;
+        }
+
+    g_assert_cmpuint(pos, ==, expected->len);
+    g_list_free_full(batch, free_hdt_struct);
+
+    /* only nb_hashs hashs are asked */
+    batch = fetch_batch_from_server(comm, hash_list, 3);
+    g_assert_cmpuint(g_list_length(batch), ==, 3);
+    g_list_free_full(batch, free_hdt_struct);
+    g_assert_cmpuint(get_block_server_nb_hashs(server), ==, 13);
+
+    /* a block unknown to the server */
+    hash_list = g_list_append(hash_list, new_hash_data_t_as_is(NULL, 0, make_test_hash(0), COMPRESS_NONE_TYPE, 0));
+    batch = fetch_batch_from_server(comm, hash_list, FETCH_BATCH_SIZE);
+    g_assert_null(batch);
+
+    g_list_free_full(hash_list, free_hdt_struct);
+    g_byte_array_free(expected, TRUE);
+    free_comm_t(comm);
+    stop_block_server(server);
+}
+
+
+/**
+ * A file of several batches is restored by the workers with one request
+ * per batch.
+ */
+static void test_fetch_parallel(void)
+{
+    block_server_t *server = NULL;
+    comm_t *comm = NULL;
+    GByteArray *expected = NULL;
+    GList *hash_list = NULL;
+    GFile *file = NULL;
+    GFileOutputStream *stream = NULL;
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+
+    server = start_block_server();
+    comm = init_comm_struct(server->conn, COMPRESS_NONE_TYPE);
+    expected = g_byte_array_new();
+    hash_list = add_test_blocks(server, TEST_NB_BLOCKS, expected);
+
+    prefix = make_test_directory();
+    filename = g_build_filename(prefix, "restored", NULL);
+    file = g_file_new_for_path(filename);
+    stream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL);
+    g_assert_nonnull(stream);
+
+    fetch_hash_list_to_stream(comm, stream, hash_list, expected->len);
+    g_output_stream_close(G_OUTPUT_STREAM(stream), NULL, NULL);
+
+    assert_file_content(filename, expected);
+    g_assert_cmpuint(get_block_server_nb_requests(server), ==, (TEST_NB_BLOCKS + FETCH_BATCH_SIZE - 1) / FETCH_BATCH_SIZE);
+    g_assert_cmpuint(get_block_server_nb_hashs(server), ==, TEST_NB_BLOCKS);
+
+    g_object_unref(stream);
+    g_object_unref(file);
+    remove_test_directory(prefix);
+    free_variable(filename);
+    free_variable(prefix);
+    g_list_free_full(hash_list, free_hdt_struct);
+    g_byte_array_free(expected, TRUE);
+    free_comm_t(comm);
+    stop_block_server(server);
+}
+
+
+/**
+ * Blocks are written at their own offset, leaving holes between them as
+ * when only the blocks missing from a local copy are fetched.
+ */
+static void test_fetch_at_offsets(void)
+{
+    block_server_t *server = NULL;
+    comm_t *comm = NULL;
+    GByteArray *expected = NULL;
+    GByteArray *blocks = NULL;
+    GList *hash_list = NULL;
+    GArray *offsets = NULL;
+    GFile *file = NULL;
+    GFileOutputStream *stream = NULL;
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+    guchar *data = NULL;
+    gsize len = 0;
+    guint64 offset = 0;
+    guint i = 0;
+
+    server = start_block_server();
+    comm = init_comm_struct(server->conn, COMPRESS_NONE_TYPE);
+    blocks = g_byte_array_new();
+    hash_list = add_test_blocks(server, FETCH_BATCH_SIZE + 10, blocks);
+
+    /* every block goes after a hole of 50 bytes */
+    expected = g_byte_array_new();
+    offsets = g_array_new(FALSE, FALSE, sizeof(guint64));
+
+    for (i = 0; i < FETCH_BATCH_SIZE + 10; i++)
+        {
+            g_byte_array_set_size(expected, expected->len + 50);
+            memset(expected->data + expected->len - 50, 0, 50);
+            offset = expected->len;
+            g_array_append_val(offsets, offset);
+            data = make_test_block(i, &len);
+            g_byte_array_append(expected, data, len);
+            free_variable(data);
+        }
+
+    prefix = make_test_directory();
+    filename = g_build_filename(prefix, "restored", NULL);
+    file = g_file_new_for_path(filename);
+    stream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL);
+    g_assert_nonnull(stream);
+
+    g_assert_true(fetch_hash_list_at_offsets(comm, stream, hash_list, offsets));
+    g_output_stream_close(G_OUTPUT_STREAM(stream), NULL, NULL);
+
+    assert_file_content(filename, expected);
+
+    g_object_unref(stream);
+    g_object_unref(file);
+    remove_test_directory(prefix);
+    free_variable(filename);
+    free_variable(prefix);
+    g_array_free(offsets, TRUE);
+    g_list_free_full(hash_list, free_hdt_struct);
+    g_byte_array_free(blocks, TRUE);
+    g_byte_array_free(expected, TRUE);
+    free_comm_t(comm);
+    stop_block_server(server);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/fetch/write_at_offset", test_fetch_write_at_offset);
+    g_test_add_func("/fetch/batch", test_fetch_batch);
+    g_test_add_func("/fetch/parallel", test_fetch_parallel);
+    g_test_add_func("/fetch/at_offsets", test_fetch_at_offsets);
+
+    return g_test_run();
+}
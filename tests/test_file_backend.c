@@ -0,0 +1,82 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_file_backend.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_file_backend.c
+ * Helpers of the tests that use the file backend.
+ */
+
+#include "server.h"
+#include "test_file_backend.h"
+
+
+/**
+ * Starts a file backend whose files are in @param prefix (with only one
+ * level of data directories).
+ * @param prefix is the directory of the backend.
+ * @param config is appended to the [File_Backend] group of the
+ *        configuration file (may be NULL).
+ * @returns a server structure whose backend_data is the started file
+ *          backend.
+ */
+server_struct_t *start_file_backend(const gchar *prefix, const gchar *config)
+{
+    server_struct_t *server_struct = NULL;
+    gchar *configfile = NULL;
+    gchar *contents = NULL;
+    gchar *done = NULL;
+
+    configfile = g_build_filename(prefix, "server.conf", NULL);
+    contents = g_strdup_printf("[%s]\n%s=%s\n%s=1\n%s\n", GN_FILE_BACKEND, KN_FILE_DIRECTORY, prefix, KN_DIR_LEVEL, config != NULL ? config : "");
+    g_assert_true(g_file_set_contents(configfile, contents, -1, NULL));
+
+    /* data subdirectories are made by the tests that store blocks */
+    done = g_build_filename(prefix, "data", ".done", NULL);
+    g_mkdir_with_parents(done, 0700);
+
+    server_struct = (server_struct_t *) g_malloc0(sizeof(server_struct_t));
+    server_struct->opt = (options_t *) g_malloc0(sizeof(options_t));
+    server_struct->opt->configfile = configfile;
+    server_struct->backend_data = init_backend_structure(file_store_smeta, file_store_data, file_init_backend, file_terminate_backend, file_build_needed_hash_list, file_get_list_of_files, file_retrieve_data, file_foreach_stored_hash);
+
+    file_init_backend(server_struct);
+    g_assert_nonnull(server_struct->backend_data->user_data);
+
+    free_variable(contents);
+    free_variable(done);
+
+    return server_struct;
+}
+
+
+/**
+ * Terminates the file backend started by start_file_backend().
+ * @param server_struct is the server structure to be freed.
+ */
+void stop_file_backend(server_struct_t *server_struct)
+{
+    file_terminate_backend(server_struct->backend_data);
+    free_backend(server_struct->backend_data);
+    free_variable(server_struct->opt->configfile);
+    g_free(server_struct->opt);
+    g_free(server_struct);
+}
@@ -0,0 +1,50 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_file_backend.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_file_backend.h
+ * Helpers of the tests that use the file backend.
+ */
+#ifndef _TESTS_TEST_FILE_BACKEND_H_
+#define _TESTS_TEST_FILE_BACKEND_H_
+
+
+/**
+ * Starts a file backend whose files are in @param prefix (with only one
+ * level of data directories).
+ * @param prefix is the directory of the backend.
+ * @param config is appended to the [File_Backend] group of the
+ *        configuration file (may be NULL).
+ * @returns a server structure whose backend_data is the started file
+ *          backend.
+ */
+extern server_struct_t *start_file_backend(const gchar *prefix, const gchar *config);
+
+
+/**
+ * Terminates the file backend started by start_file_backend().
+ * @param server_struct is the server structure to be freed.
+ */
+extern void stop_file_backend(server_struct_t *server_struct);
+
+
+#endif /* #ifndef _TESTS_TEST_FILE_BACKEND_H_ */
@@ -0,0 +1,362 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_hash_array.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_hash_array.c
+ * Tests of the streamed answers of /Data/Hash_Array.json: blocks are
+ * retrieved ahead by the prefetch thread (never more than
+ * HASH_ARRAY_PREFETCH of them waiting) and sent either uncompressed and
+ * concatenated or as stored, one json object each.
+ */
+
+#include "server.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_NB_BLOCKS
+ * Number of blocks known by the test backend.
+ */
+#define TEST_NB_BLOCKS (40)
+
+/**
+ * Blocks (hash_data_t *) known by the test backend indexed by their
+ * hexadecimal hash.
+ */
+static GHashTable *test_blocks = NULL;
+
+/**
+ * Number of blocks retrieved from the test backend.
+ */
+static gint test_nb_retrieved = 0;
+
+
+/**
+ * Retrieves a copy of a block of the test backend.
+ * @param server_struct is the server structure (unused).
+ * @param hex_hash is the hexadecimal hash of the block.
+ * @returns a newly allocated copy of the block or NULL.
+ */
+static hash_data_t *test_retrieve_data(void *server_struct, gchar *hex_hash)
+{
+    hash_data_t *block = NULL;
+
+    g_atomic_int_inc(&test_nb_retrieved);
+    block = g_hash_table_lookup(test_blocks, hex_hash);
+
+    if (block != NULL)
+        {
+            return new_hash_data_t_as_is(g_memdup(block->data, block->read), block->read, g_memdup(block->hash, HASH_LEN), block->cmptype, block->uncmplen);
+        }
+    else
+        {
+            return NULL;
+        }
+}
+
+
+/**
+ * Makes the data of a block.
+ * @param i is the number of the block.
+ * @param[out] len is the length of the block.
+ * @returns the newly allocated data of the block.
+ */
+static guchar *make_test_block(guint i, gsize *len)
+{
+    guchar *data = NULL;
+    gsize j = 0;
+
+    *len = 1000 + 37 * i;
+    data = (guchar *) g_malloc(*len);
+
+    for (j = 0; j < *len; j++)
+        {
+            data[j] = (guchar) ((i + j / 16) & 0xff);
+        }
+
+    return data;
+}
+
+
+/**
+ * Starts a server structure whose data backend is the test backend and
+ * fills it with TEST_NB_BLOCKS blocks. Even blocks are stored compressed.
+ * @param[out] expected is the concatenation of the data of the blocks.
+ * @returns a newly allocated server structure.
+ */
+static server_struct_t *start_test_backend(GByteArray *expected)
+{
+    server_struct_t *server_struct = NULL;
+    hash_data_t *block = NULL;
+    compress_t *compress = NULL;
+    guchar *data = NULL;
+    guint8 *hash = NULL;
+    gsize len = 0;
+    guint i = 0;
+
+    test_blocks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_hdt_struct);
+    test_nb_retrieved = 0;
+
+    for (i = 0; i < TEST_NB_BLOCKS; i++)
+        {
+            data = make_test_block(i, &len);
+            hash = calculate_hash_for_string(data, len);
+            g_byte_array_append(expected, data, len);
+
+            if (i % 2 == 0)
+                {
+                    compress = compress_buffer(data, len, COMPRESS_ZLIB_TYPE);
+                    block = new_hash_data_t_as_is(compress->text, compress->len, hash, COMPRESS_ZLIB_TYPE, len);
+                    compress->text = NULL;
+                    free_compress_t(compress);
+                    free_variable(data);
+                }
+            else
+                {
+                    block = new_hash_data_t_as_is(data, len, hash, COMPRESS_NONE_TYPE, len);
+                }
+
+            g_hash_table_insert(test_blocks, hash_to_string(hash), block);
+        }
+
+    server_struct = (server_struct_t *) g_malloc0(sizeof(server_struct_t));
+    server_struct->backend_data = init_backend_structure(NULL, NULL, NULL, NULL, NULL, NULL, test_retrieve_data, NULL);
+
+    return server_struct;
+}
+
+
+/**
+ * Frees the server structure made by start_test_backend().
+ * @param server_struct is the server structure to be freed.
+ */
+static void stop_test_backend(server_struct_t *server_struct)
+{
+    free_backend(server_struct->backend_data);
+    g_free(server_struct);
+    g_hash_table_destroy(test_blocks);
+    test_blocks = NULL;
+}
+
+
+/**
+ * Makes the list of the hashs of the blocks in the order they were
+ * added followed by a hash unknown to the backend.
+ * @returns a hash_data_t * list of hashs.
+ */
+static GList *make_test_hash_list(void)
+{
+    GList *hash_list = NULL;
+    guchar *data = NULL;
+    gsize len = 0;
+    guint i = 0;
+
+    for (i = 0; i < TEST_NB_BLOCKS; i++)
+        {
+            data = make_test_block(i, &len);
+            hash_list = g_list_prepend(hash_list, new_hash_data_t_as_is(NULL, 0, calculate_hash_for_string(data, len), COMPRESS_NONE_TYPE, 0));
+            free_variable(data);
+        }
+
+    hash_list = g_list_prepend(hash_list, new_hash_data_t_as_is(NULL, 0, make_test_hash(0), COMPRESS_NONE_TYPE, 0));
+
+    return g_list_reverse(hash_list);
+}
+
+
+/**
+ * Reads a whole answer with the content reader callback, a few bytes at
+ * a time as MHD may do.
+ * @param stream is the stream of the answer (freed here).
+ * @returns the newly allocated json answer.
+ */
+static gchar *read_answer(hash_array_stream_t *stream)
+{
+    GString *answer = NULL;
+    gchar buf[13];
+    ssize_t read = 0;
+
+    answer = g_string_new("");
+
+    while ((read = hash_array_stream_reader(stream, answer->len, buf, sizeof(buf))) != MHD_CONTENT_READER_END_OF_STREAM)
+        {
+            g_assert_cmpint(read, >, 0);
+            g_assert_cmpint(read, <=, sizeof(buf));
+            g_string_append_len(answer, buf, read);
+        }
+
+    free_hash_array_stream(stream);
+
+    return g_string_free(answer, FALSE);
+}
+
+
+/**
+ * Uncompressed answers are the concatenation of the known blocks in the
+ * order of the request with the SHA256 of the whole data.
+ */
+static void test_hash_array_uncompressed(void)
+{
+    server_struct_t *server_struct = NULL;
+    GByteArray *expected = NULL;
+    hash_data_t *hash_data = NULL;
+    json_t *root = NULL;
+    guint8 *hash = NULL;
+    gchar *answer = NULL;
+
+    expected = g_byte_array_new();
+    server_struct = start_test_backend(expected);
+
+    answer = read_answer(new_hash_array_stream(server_struct, make_test_hash_list(), FALSE));
+    g_assert_cmpint(test_nb_retrieved, ==, TEST_NB_BLOCKS + 1);
+
+    root = load_json(answer);
+    hash_data = convert_json_t_to_hash_data(root);
+    g_assert_nonnull(hash_data);
+    g_assert_cmpint(hash_data->cmptype, ==, COMPRESS_NONE_TYPE);
+    g_assert_cmpint(hash_data->uncmplen, ==, expected->len);
+    g_assert_cmpmem(hash_data->data, hash_data->read, expected->data, expected->len);
+
+    hash = calculate_hash_for_string(expected->data, expected->len);
+    g_assert_cmpmem(hash_data->hash, HASH_LEN, hash, HASH_LEN);
+
+    free_variable(hash);
+    free_hash_data_t(hash_data);
+    json_decref(root);
+    free_variable(answer);
+    stop_test_backend(server_struct);
+    g_byte_array_free(expected, TRUE);
+}
+
+
+/**
+ * Compressed answers frame each known block as stored with its own
+ * compression type and hash.
+ */
+static void test_hash_array_compressed(void)
+{
+    server_struct_t *server_struct = NULL;
+    GByteArray *expected = NULL;
+    hash_data_t *hash_data = NULL;
+    compress_t *compress = NULL;
+    json_t *root = NULL;
+    json_t *blocks = NULL;
+    json_t *value = NULL;
+    guint8 *hash = NULL;
+    gchar *answer = NULL;
+    size_t index = 0;
+    gsize pos = 0;
+
+    expected = g_byte_array_new();
+    server_struct = start_test_backend(expected);
+
+    answer = read_answer(new_hash_array_stream(server_struct, make_test_hash_list(), TRUE));
+
+    root = load_json(answer);
+    blocks = get_json_value_from_json_root(root, "blocks");
+    g_assert_true(json_is_array(blocks));
+    g_assert_cmpuint(json_array_size(blocks), ==, TEST_NB_BLOCKS);
+
+    json_array_foreach(blocks, index, value)
+        {
+            hash_data = convert_json_t_to_hash_data(value);
+            g_assert_nonnull(hash_data);
+            g_assert_cmpint(hash_data->cmptype, ==, (index % 2 == 0) ? COMPRESS_ZLIB_TYPE : COMPRESS_NONE_TYPE);
+
+            compress = uncompress_buffer(hash_data->data, hash_data->read, hash_data->uncmplen, hash_data->cmptype);
+            g_assert_nonnull(compress);
+            g_assert_cmpmem(compress->text, compress->len, expected->data + pos, hash_data->uncmplen);
+
+            hash = calculate_hash_for_string(compress->text, compress->len);
+            g_assert_cmpmem(hash_data->hash, HASH_LEN, hash, HASH_LEN);
+
+            pos = pos + compress->len;
+            free_variable(hash);
+            free_compress_t(compress);
+            free_hash_data_t(hash_data);
+        }
+
+    g_assert_cmpuint(pos, ==, expected->len);
+
+    json_decref(root);
+    free_variable(answer);
+    stop_test_backend(server_struct);
+    g_byte_array_free(expected, TRUE);
+}
+
+
+/**
+ * The prefetch thread does not retrieve more than HASH_ARRAY_PREFETCH
+ * blocks (plus the one waiting for room) ahead of the reader and stops
+ * when the answer is freed before being completely sent.
+ */
+static void test_hash_array_prefetch(void)
+{
+    server_struct_t *server_struct = NULL;
+    hash_array_stream_t *stream = NULL;
+    GByteArray *expected = NULL;
+    gchar buf[64];
+    guint i = 0;
+
+    expected = g_byte_array_new();
+    server_struct = start_test_backend(expected);
+
+    stream = new_hash_array_stream(server_struct, make_test_hash_list(), FALSE);
+
+    for (i = 0; i < 100 && g_atomic_int_get(&test_nb_retrieved) < HASH_ARRAY_PREFETCH + 1; i++)
+        {
+            g_usleep(10000);
+        }
+
+    /* the thread would have retrieved more blocks by now */
+    g_usleep(100000);
+    g_assert_cmpint(g_atomic_int_get(&test_nb_retrieved), ==, HASH_ARRAY_PREFETCH + 1);
+
+    /* sending the first block makes room for one more */
+    g_assert_cmpint(hash_array_stream_reader(stream, 0, buf, sizeof(buf)), >, 0);
+
+    for (i = 0; i < 100 && g_atomic_int_get(&test_nb_retrieved) < HASH_ARRAY_PREFETCH + 2; i++)
+        {
+            g_assert_cmpint(hash_array_stream_reader(stream, 0, buf, sizeof(buf)), >, 0);
+            g_usleep(10000);
+        }
+
+    g_assert_cmpint(g_atomic_int_get(&test_nb_retrieved), <, TEST_NB_BLOCKS);
+
+    /* the client goes away */
+    free_hash_array_stream(stream);
+    g_assert_cmpint(g_atomic_int_get(&test_nb_retrieved), <, TEST_NB_BLOCKS);
+
+    stop_test_backend(server_struct);
+    g_byte_array_free(expected, TRUE);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/hash_array/uncompressed", test_hash_array_uncompressed);
+    g_test_add_func("/hash_array/compressed", test_hash_array_compressed);
+    g_test_add_func("/hash_array/prefetch", test_hash_array_prefetch);
+
+    return g_test_run();
+}
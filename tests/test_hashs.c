@@ -0,0 +1,154 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_hashs.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_hashs.c
+ * Tests of the detection of blocks full of zeros and of the hashs of
+ * such blocks.
+ */
+
+#include "libcdpfgl.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_NB_THREADS
+ * Number of threads asking for the same zero block hash at once.
+ */
+#define TEST_NB_THREADS (8)
+
+
+/**
+ * A block is a zero block only when every one of its bytes is 0,
+ * whether the other byte is among the first ones checked one by one or
+ * after them.
+ */
+static void test_hashs_is_zero_block(void)
+{
+    guchar *buffer = NULL;
+    gsize lens[] = {1, 15, 16, 17, 4096, 65536};
+    gsize len = 0;
+    gsize positions[3];
+    guint i = 0;
+    guint j = 0;
+
+    g_assert_false(is_zero_block(NULL, 10));
+
+    buffer = (guchar *) g_malloc0(65536);
+    g_assert_false(is_zero_block(buffer, 0));
+
+    for (i = 0; i < G_N_ELEMENTS(lens); i++)
+        {
+            len = lens[i];
+            g_assert_true(is_zero_block(buffer, len));
+
+            positions[0] = 0;
+            positions[1] = len / 2;
+            positions[2] = len - 1;
+
+            for (j = 0; j < G_N_ELEMENTS(positions); j++)
+                {
+                    buffer[positions[j]] = 1;
+                    g_assert_false(is_zero_block(buffer, len));
+                    buffer[positions[j]] = 0;
+                }
+        }
+
+    free_variable(buffer);
+}
+
+
+/**
+ * Zero block hashs are the hashs of len zeros, precomputed for the
+ * block sizes of cdpfglclient only, and only match a zero block of the
+ * same length.
+ */
+static void test_hashs_zero_block_hash(void)
+{
+    guchar *zeros = NULL;
+    guint8 *a_hash = NULL;
+    guint8 *other = NULL;
+
+    zeros = (guchar *) g_malloc0(8192);
+
+    a_hash = calculate_hash_for_string(zeros, 8192);
+    g_assert_cmpmem(get_zero_block_hash(8192), HASH_LEN, a_hash, HASH_LEN);
+    g_assert_true(get_zero_block_hash(8192) == get_zero_block_hash(8192));
+    g_assert_true(is_zero_block_hash(a_hash, 8192));
+    g_assert_false(is_zero_block_hash(a_hash, 8191));
+    g_assert_null(get_zero_block_hash(12345));
+    g_assert_false(is_zero_block_hash(a_hash, 12345));
+
+    zeros[100] = 1;
+    other = calculate_hash_for_string(zeros, 8192);
+    g_assert_false(is_zero_block_hash(other, 8192));
+
+    free_variable(other);
+    free_variable(a_hash);
+    free_variable(zeros);
+}
+
+
+/**
+ * Asks for the hash of a zero block (used as a GThreadFunc).
+ * @param data is unused.
+ * @returns the hash of a block of 16384 zeros.
+ */
+static gpointer get_zero_block_hash_thread(gpointer data)
+{
+    return get_zero_block_hash(16384);
+}
+
+
+/**
+ * Threads asking for the same zero block hash at once get the same one.
+ */
+static void test_hashs_zero_block_hash_threads(void)
+{
+    GThread *threads[TEST_NB_THREADS];
+    gpointer hashs[TEST_NB_THREADS];
+    guint i = 0;
+
+    for (i = 0; i < TEST_NB_THREADS; i++)
+        {
+            threads[i] = g_thread_new("zero", get_zero_block_hash_thread, NULL);
+        }
+
+    for (i = 0; i < TEST_NB_THREADS; i++)
+        {
+            hashs[i] = g_thread_join(threads[i]);
+            g_assert_true(hashs[i] == hashs[0]);
+        }
+
+    g_assert_true(is_zero_block_hash(hashs[0], 16384));
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/hashs/is_zero_block", test_hashs_is_zero_block);
+    g_test_add_func("/hashs/zero_block_hash", test_hashs_zero_block_hash);
+    g_test_add_func("/hashs/zero_block_hash_threads", test_hashs_zero_block_hash_threads);
+
+    return g_test_run();
+}
@@ -0,0 +1,334 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_memory_backend.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_memory_backend.c
+ * Tests of the memory backend: stored blocks are retrieved as copies,
+ * meta data go to in memory catalogs and, when max-size is set, blocks
+ * over it are rejected unless evict is set.
+ */
+
+#include "server.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_BLOCK_SIZE
+ * Size of the blocks stored by the tests.
+ *
+ * @def TEST_STORED_SIZE
+ * Bytes accounted for each block stored by the memory backend.
+ */
+#define TEST_BLOCK_SIZE (1000)
+#define TEST_STORED_SIZE (TEST_BLOCK_SIZE + HASH_LEN + sizeof(hash_data_t))
+
+
+/**
+ * Starts a memory backend that serves both meta data and data.
+ * @param prefix is the directory where its configuration file is
+ *        written.
+ * @param config is the content of its [Memory_Backend] group (may be
+ *        NULL to start it without any configuration file).
+ * @returns a server structure whose backends are the started memory
+ *          backend.
+ */
+static server_struct_t *start_memory_backend(const gchar *prefix, const gchar *config)
+{
+    server_struct_t *server_struct = NULL;
+    gchar *contents = NULL;
+
+    server_struct = (server_struct_t *) g_malloc0(sizeof(server_struct_t));
+    server_struct->opt = (options_t *) g_malloc0(sizeof(options_t));
+
+    if (config != NULL)
+        {
+            server_struct->opt->configfile = g_build_filename(prefix, "server.conf", NULL);
+            contents = g_strdup_printf("[%s]\n%s\n", GN_MEMORY_BACKEND, config);
+            g_assert_true(g_file_set_contents(server_struct->opt->configfile, contents, -1, NULL));
+            free_variable(contents);
+        }
+
+    server_struct->backend_meta = init_backend_structure(memory_store_smeta, memory_store_data, memory_init_backend, memory_terminate_backend, memory_build_needed_hash_list, memory_get_list_of_files, memory_retrieve_data, memory_foreach_stored_hash);
+    server_struct->backend_data = server_struct->backend_meta;
+
+    memory_init_backend(server_struct);
+    g_assert_nonnull(server_struct->backend_data->user_data);
+
+    return server_struct;
+}
+
+
+/**
+ * Terminates the memory backend started by start_memory_backend().
+ * @param server_struct is the server structure to be freed.
+ */
+static void stop_memory_backend(server_struct_t *server_struct)
+{
+    memory_terminate_backend(server_struct->backend_data);
+    free_backend(server_struct->backend_data);
+    free_variable(server_struct->opt->configfile);
+    g_free(server_struct->opt);
+    g_free(server_struct);
+}
+
+
+/**
+ * Stores a block whose bytes are all the same.
+ * @param server_struct is the server structure of the memory backend.
+ * @param i is the number whose hash is the hash of the block and the
+ *        value of its bytes.
+ * @param stored is what memory_store_data() is expected to return.
+ * @returns the newly allocated hexadecimal hash of the block.
+ */
+static gchar *store_block(server_struct_t *server_struct, guint i, gboolean stored)
+{
+    guchar *data = NULL;
+    guint8 *hash = NULL;
+    gchar *hex_hash = NULL;
+
+    data = (guchar *) g_malloc(TEST_BLOCK_SIZE);
+    memset(data, i, TEST_BLOCK_SIZE);
+    hash = make_test_hash(i);
+    hex_hash = hash_to_string(hash);
+
+    g_assert_cmpint(memory_store_data(server_struct, new_hash_data_t_as_is(data, TEST_BLOCK_SIZE, hash, COMPRESS_NONE_TYPE, TEST_BLOCK_SIZE)), ==, stored);
+
+    return hex_hash;
+}
+
+
+/**
+ * Tells whether a block is stored by the memory backend.
+ * @param server_struct is the server structure of the memory backend.
+ * @param hex_hash is the hexadecimal hash of the block.
+ * @returns TRUE if the block can be retrieved.
+ */
+static gboolean is_stored(server_struct_t *server_struct, gchar *hex_hash)
+{
+    hash_data_t *hash_data = NULL;
+
+    hash_data = memory_retrieve_data(server_struct, hex_hash);
+
+    if (hash_data != NULL)
+        {
+            free_hash_data_t(hash_data);
+            return TRUE;
+        }
+    else
+        {
+            return FALSE;
+        }
+}
+
+
+/**
+ * Counts the stored hashs (used as a GFunc).
+ * @param data is a binary hash.
+ * @param user_data is the guint * counter.
+ */
+static void count_hash(gpointer data, gpointer user_data)
+{
+    guint *count = (guint *) user_data;
+
+    *count = *count + 1;
+}
+
+
+/**
+ * A stored block is retrieved as a copy, is stored only once, is not
+ * asked for anymore and meta data are listed from the catalog of their
+ * host.
+ */
+static void test_memory_backend_store(void)
+{
+    server_struct_t *server_struct = NULL;
+    memory_backend_t *memory_backend = NULL;
+    server_meta_data_t *smeta = NULL;
+    hash_data_t *hash_data = NULL;
+    query_t *query = NULL;
+    GList *hash_list = NULL;
+    GList *needed = NULL;
+    GList *file_list = NULL;
+    gchar *hex_hash = NULL;
+    gchar *copy_hash = NULL;
+    guint count = 0;
+
+    server_struct = start_memory_backend(NULL, NULL);
+    memory_backend = server_struct->backend_data->user_data;
+
+    g_assert_cmpuint(memory_backend->max_size, ==, 0);
+    g_assert_false(memory_backend->evict);
+
+    hex_hash = store_block(server_struct, 1, TRUE);
+    copy_hash = store_block(server_struct, 1, TRUE);
+    g_assert_cmpuint(memory_backend->size, ==, TEST_STORED_SIZE);
+
+    hash_data = memory_retrieve_data(server_struct, hex_hash);
+    g_assert_nonnull(hash_data);
+    g_assert_cmpint(hash_data->read, ==, TEST_BLOCK_SIZE);
+    g_assert_cmpint(hash_data->data[0], ==, 1);
+    g_assert_cmpint(hash_data->data[TEST_BLOCK_SIZE - 1], ==, 1);
+    free_hash_data_t(hash_data);
+
+    hash_data = memory_retrieve_data(server_struct, hex_hash);
+    hash_data->data[0] = 2;
+    free_hash_data_t(hash_data);
+    hash_data = memory_retrieve_data(server_struct, hex_hash);
+    g_assert_cmpint(hash_data->data[0], ==, 1);
+    free_hash_data_t(hash_data);
+
+    /* only the unknown block is needed */
+    hash_list = g_list_append(hash_list, new_hash_data_t(NULL, 0, make_test_hash(1), COMPRESS_NONE_TYPE));
+    hash_list = g_list_append(hash_list, new_hash_data_t(NULL, 0, make_test_hash(2), COMPRESS_NONE_TYPE));
+    needed = memory_build_needed_hash_list(server_struct, hash_list);
+    g_assert_cmpuint(g_list_length(needed), ==, 1);
+    g_assert_cmpmem(((hash_data_t *) needed->data)->hash, HASH_LEN, ((hash_data_t *) hash_list->next->data)->hash, HASH_LEN);
+    g_list_free_full(needed, free_hdt_struct);
+    g_list_free_full(hash_list, free_hdt_struct);
+
+    memory_foreach_stored_hash(server_struct, count_hash, &count);
+    g_assert_cmpuint(count, ==, 1);
+
+    /* meta data */
+    smeta = new_smeta_data_t();
+    smeta->hostname = g_strdup("memoryhost");
+    smeta->meta = new_meta_data_t();
+    smeta->meta->file_type = 1;
+    smeta->meta->name = g_strdup("/etc/fstab");
+    smeta->meta->link = g_strdup("");
+    smeta->meta->owner = g_strdup("root");
+    smeta->meta->group = g_strdup("root");
+    smeta->meta->mtime = 1600000000;
+    memory_store_smeta(server_struct, smeta);
+    free_smeta_data_t(smeta);
+
+    query = init_query_t(g_strdup("memoryhost"), g_strdup("0"), g_strdup("0"), g_strdup("root"), g_strdup("root"), NULL, NULL, NULL, NULL, FALSE);
+    file_list = memory_get_list_of_files(server_struct, query, 0);
+    free_query_t(query);
+    g_assert_cmpuint(g_list_length(file_list), ==, 1);
+    g_assert_cmpstr(((meta_data_t *) file_list->data)->name, ==, "/etc/fstab");
+    g_list_free_full(file_list, free_glist_meta_data_t);
+
+    stop_memory_backend(server_struct);
+
+    free_variable(copy_hash);
+    free_variable(hex_hash);
+}
+
+
+/**
+ * With max-size set and evict left to its default, blocks that do not
+ * fit anymore are rejected and the stored ones are kept.
+ */
+static void test_memory_backend_reject(void)
+{
+    server_struct_t *server_struct = NULL;
+    memory_backend_t *memory_backend = NULL;
+    gchar *prefix = NULL;
+    gchar *config = NULL;
+    gchar *hex_hashs[3];
+    guint i = 0;
+
+    prefix = make_test_directory();
+    config = g_strdup_printf("%s=%" G_GUINT64_FORMAT, KN_MEMORY_MAX_SIZE, (guint64) (2 * TEST_STORED_SIZE));
+    server_struct = start_memory_backend(prefix, config);
+    memory_backend = server_struct->backend_data->user_data;
+
+    g_assert_cmpuint(memory_backend->max_size, ==, 2 * TEST_STORED_SIZE);
+    g_assert_false(memory_backend->evict);
+
+    for (i = 0; i < 3; i++)
+        {
+            hex_hashs[i] = store_block(server_struct, i, i < 2);
+        }
+
+    g_assert_true(is_stored(server_struct, hex_hashs[0]));
+    g_assert_true(is_stored(server_struct, hex_hashs[1]));
+    g_assert_false(is_stored(server_struct, hex_hashs[2]));
+    g_assert_cmpuint(memory_backend->rejected, ==, 1);
+    g_assert_cmpuint(memory_backend->size, ==, 2 * TEST_STORED_SIZE);
+
+    stop_memory_backend(server_struct);
+    remove_test_directory(prefix);
+
+    for (i = 0; i < 3; i++)
+        {
+            free_variable(hex_hashs[i]);
+        }
+
+    free_variable(config);
+    free_variable(prefix);
+}
+
+
+/**
+ * With evict set the oldest blocks make room for the new ones.
+ */
+static void test_memory_backend_evict(void)
+{
+    server_struct_t *server_struct = NULL;
+    memory_backend_t *memory_backend = NULL;
+    gchar *prefix = NULL;
+    gchar *config = NULL;
+    gchar *hex_hashs[3];
+    guint i = 0;
+
+    prefix = make_test_directory();
+    config = g_strdup_printf("%s=%" G_GUINT64_FORMAT "\n%s=true", KN_MEMORY_MAX_SIZE, (guint64) (2 * TEST_STORED_SIZE), KN_MEMORY_EVICT);
+    server_struct = start_memory_backend(prefix, config);
+    memory_backend = server_struct->backend_data->user_data;
+
+    g_assert_true(memory_backend->evict);
+
+    for (i = 0; i < 3; i++)
+        {
+            hex_hashs[i] = store_block(server_struct, i, TRUE);
+        }
+
+    g_assert_false(is_stored(server_struct, hex_hashs[0]));
+    g_assert_true(is_stored(server_struct, hex_hashs[1]));
+    g_assert_true(is_stored(server_struct, hex_hashs[2]));
+    g_assert_cmpuint(memory_backend->rejected, ==, 0);
+    g_assert_cmpuint(memory_backend->size, ==, 2 * TEST_STORED_SIZE);
+
+    stop_memory_backend(server_struct);
+    remove_test_directory(prefix);
+
+    for (i = 0; i < 3; i++)
+        {
+            free_variable(hex_hashs[i]);
+        }
+
+    free_variable(config);
+    free_variable(prefix);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/memory_backend/store", test_memory_backend_store);
+    g_test_add_func("/memory_backend/reject", test_memory_backend_reject);
+    g_test_add_func("/memory_backend/evict", test_memory_backend_evict);
+
+    return g_test_run();
+}
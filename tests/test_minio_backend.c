@@ -0,0 +1,607 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_minio_backend.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_minio_backend.c
+ * Tests of the upload pool of the MinIO backend without any MinIO
+ * server: libs3 completions are simulated by calling upload_done(). The
+ * static functions of the backend are reached by including its source.
+ * Block meta data go in the headers of the data objects, stored
+ * blocks go in the local index of the data bucket and blocks whose
+ * upload failed go in the spool directory.
+ */
+
+#include "server.h"
+#include "test_common.h"
+#include "minio_backend.c"
+
+/**
+ * @def TEST_BUCKET
+ * Data bucket of the tests (never accessed).
+ *
+ * @def TEST_MAX_IN_FLIGHT
+ * Maximum number of uploads queued or running in the tests.
+ */
+#define TEST_BUCKET "test-data"
+#define TEST_MAX_IN_FLIGHT (4)
+
+
+/**
+ * Creates a backend whose upload pool has no thread: uploads stay in its
+ * queue until a test pops them. Its data bucket is already validated and
+ * its index, saved in a test directory, is empty as is its spool
+ * directory (no spooler thread runs).
+ * @returns a newly allocated backend to be freed with free_test_backend().
+ */
+static minio_backend_t *new_test_backend(void)
+{
+    minio_backend_t *backend = NULL;
+    minio_upload_pool_t *pool = NULL;
+    gchar *prefix = NULL;
+
+    backend = (minio_backend_t *) g_malloc0(sizeof(minio_backend_t));
+    backend->bucketname_data = TEST_BUCKET;
+    g_mutex_init(&backend->buckets_mutex);
+    backend->active_bucket_data = backend->bucketname_data;
+
+    /* an existing index file is loaded: nothing is listed */
+    prefix = make_test_directory();
+    backend->index_file = g_build_filename(prefix, "index", NULL);
+    g_assert_true(g_file_set_contents(backend->index_file, "", 0, NULL));
+    backend->index = new_minio_index_t(backend->index_file, backend->bucketname_data);
+    g_assert_true(minio_index_is_complete(backend->index));
+    backend->spool_dir = g_build_filename(prefix, "spool", NULL);
+    g_assert_cmpint(g_mkdir_with_parents(backend->spool_dir, 0700), ==, 0);
+    g_mutex_init(&backend->spooler_mutex);
+    free_variable(prefix);
+
+    pool = (minio_upload_pool_t *) g_malloc0(sizeof(minio_upload_pool_t));
+    pool->queue = g_async_queue_new();
+    pool->delayed = g_queue_new();
+    pool->max_in_flight = TEST_MAX_IN_FLIGHT;
+    pool->pending_keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_mutex_init(&pool->mutex);
+    g_cond_init(&pool->cond);
+    backend->upload_pool = pool;
+
+    return backend;
+}
+
+
+/**
+ * Frees a backend created by new_test_backend(). Every upload must have
+ * completed.
+ * @param backend is the backend to be freed.
+ */
+static void free_test_backend(minio_backend_t *backend)
+{
+    gchar *prefix = NULL;
+
+    g_assert_cmpuint(backend->upload_pool->pending, ==, 0);
+    g_assert_cmpint(g_async_queue_length(backend->upload_pool->queue), ==, 0);
+    g_assert_true(g_queue_is_empty(backend->upload_pool->delayed));
+
+    free_upload_pool(backend);
+    free_minio_index_t(backend->index);
+    g_mutex_clear(&backend->buckets_mutex);
+    g_mutex_clear(&backend->spooler_mutex);
+
+    prefix = g_path_get_dirname(backend->index_file);
+    remove_test_directory(prefix);
+    free_variable(prefix);
+    g_free((gchar *) backend->index_file);
+    g_free((gchar *) backend->spool_dir);
+    g_free(backend);
+}
+
+
+/**
+ * Queues the upload of a small object named after a test hash.
+ * @param backend is the backend.
+ * @param i is the number of the test hash (see make_test_hash()).
+ */
+static void queue_test_upload(minio_backend_t *backend, guint i)
+{
+    minio_upload_t *upload = NULL;
+    guint8 *hash = NULL;
+
+    hash = make_test_hash(i);
+
+    upload = (minio_upload_t *) g_malloc0(sizeof(minio_upload_t));
+    upload->bucket = backend->bucketname_data;
+    upload->key = hash_to_string(hash);
+    upload->pending_key = g_strdup(upload->key);
+    upload->buffer = g_strdup("test object");
+    upload->data = upload->buffer;
+    upload->length = strlen(upload->buffer);
+
+    enqueue_upload(backend, upload);
+
+    free_variable(hash);
+}
+
+
+/**
+ * Gets the next upload to issue as an upload thread does.
+ * @param backend is the backend.
+ * @param in_flight is the in flight counter of the simulated thread.
+ * @returns the upload (never NULL).
+ */
+static minio_upload_t *issue_test_upload(minio_backend_t *backend, guint *in_flight)
+{
+    minio_upload_t *upload = NULL;
+
+    upload = next_upload(backend->upload_pool, FALSE);
+    g_assert_nonnull(upload);
+
+    upload->in_flight = in_flight;
+    (*in_flight)++;
+
+    return upload;
+}
+
+
+/**
+ * Tells whether the object of a test hash is being uploaded.
+ * @param backend is the backend.
+ * @param i is the number of the test hash.
+ * @returns TRUE if an upload of this hash is queued or running.
+ */
+static gboolean is_test_hash_being_uploaded(minio_backend_t *backend, guint i)
+{
+    guint8 *hash = NULL;
+    gchar *hash_string = NULL;
+    gboolean uploading = FALSE;
+
+    hash = make_test_hash(i);
+    hash_string = hash_to_string(hash);
+    uploading = is_hash_being_uploaded(backend->upload_pool, hash_string);
+
+    free_variable(hash_string);
+    free_variable(hash);
+
+    return uploading;
+}
+
+
+/**
+ * A hash stays pending until every upload of its objects has completed.
+ */
+static void test_minio_backend_upload_done(void)
+{
+    minio_backend_t *backend = NULL;
+    minio_upload_t *upload = NULL;
+    guint in_flight = 0;
+
+    backend = new_test_backend();
+
+    queue_test_upload(backend, 1);
+    queue_test_upload(backend, 1);
+    g_assert_cmpuint(backend->upload_pool->pending, ==, 2);
+    g_assert_true(is_test_hash_being_uploaded(backend, 1));
+    g_assert_false(is_test_hash_being_uploaded(backend, 2));
+
+    upload = issue_test_upload(backend, &in_flight);
+    upload_done(S3StatusOK, upload);
+    g_assert_cmpuint(in_flight, ==, 0);
+    g_assert_cmpuint(backend->upload_pool->pending, ==, 1);
+    g_assert_true(is_test_hash_being_uploaded(backend, 1));
+
+    upload = issue_test_upload(backend, &in_flight);
+    upload_done(S3StatusOK, upload);
+    g_assert_cmpuint(backend->upload_pool->pending, ==, 0);
+    g_assert_false(is_test_hash_being_uploaded(backend, 1));
+
+    /* returns at once: nothing is pending */
+    wait_for_hash_upload(backend->upload_pool, "unknown");
+    g_assert_true(backend->active_bucket_data == backend->bucketname_data);
+
+    free_test_backend(backend);
+}
+
+
+/**
+ * Makes a retryable failure of an upload and checks that it is delayed
+ * twice as long as the previous time.
+ * @param backend is the backend.
+ * @param upload is the upload that failed.
+ * @param retries is the number of retries of the upload after this one.
+ */
+static void fail_test_upload(minio_backend_t *backend, minio_upload_t *upload, guint retries)
+{
+    gint64 delay = ((gint64) MINIO_UPLOAD_RETRY_DELAY_MS << (retries - 1)) * 1000;
+    gint64 before = g_get_monotonic_time();
+
+    upload_done(S3StatusConnectionFailed, upload);
+
+    g_assert_cmpuint(upload->retries, ==, retries);
+    g_assert_cmpint(upload->retry_at, >=, before + delay);
+    g_assert_cmpint(upload->retry_at, <=, g_get_monotonic_time() + delay);
+    g_assert_true(g_queue_peek_head(backend->upload_pool->delayed) == upload);
+
+    /* not issued before its retry time */
+    g_assert_null(next_upload(backend->upload_pool, FALSE));
+    upload->retry_at = g_get_monotonic_time();
+}
+
+
+/**
+ * A retryable failure retries the upload MINIO_UPLOAD_RETRIES times,
+ * each time after twice the previous delay. The upload is then given up
+ * and its bucket invalidated. Other failures are not retried and no
+ * retry is made MINIO_UPLOAD_RETRY_TIMEOUT_MS after the first try.
+ */
+static void test_minio_backend_retry(void)
+{
+    minio_backend_t *backend = NULL;
+    minio_upload_t *upload = NULL;
+    guint in_flight = 0;
+    guint i = 0;
+
+    backend = new_test_backend();
+    queue_test_upload(backend, 1);
+
+    for (i = 1; i <= MINIO_UPLOAD_RETRIES; i++)
+        {
+            upload = issue_test_upload(backend, &in_flight);
+            fail_test_upload(backend, upload, i);
+            g_assert_cmpuint(in_flight, ==, 0);
+            g_assert_cmpuint(backend->upload_pool->pending, ==, 1);
+            g_assert_true(is_test_hash_being_uploaded(backend, 1));
+        }
+
+    g_assert_true(backend->active_bucket_data == backend->bucketname_data);
+
+    upload = issue_test_upload(backend, &in_flight);
+    upload_done(S3StatusConnectionFailed, upload);
+    g_assert_cmpuint(backend->upload_pool->pending, ==, 0);
+    g_assert_false(is_test_hash_being_uploaded(backend, 1));
+    g_assert_null(backend->active_bucket_data);
+
+    backend->active_bucket_data = backend->bucketname_data;
+    queue_test_upload(backend, 2);
+    upload = issue_test_upload(backend, &in_flight);
+    upload_done(S3StatusErrorAccessDenied, upload);
+    g_assert_cmpuint(backend->upload_pool->pending, ==, 0);
+    g_assert_false(is_test_hash_being_uploaded(backend, 2));
+    g_assert_null(backend->active_bucket_data);
+
+    backend->active_bucket_data = backend->bucketname_data;
+    queue_test_upload(backend, 3);
+    upload = issue_test_upload(backend, &in_flight);
+    upload->started = g_get_monotonic_time() - (gint64) MINIO_UPLOAD_RETRY_TIMEOUT_MS * 1000;
+    upload_done(S3StatusConnectionFailed, upload);
+    g_assert_cmpuint(backend->upload_pool->pending, ==, 0);
+    g_assert_false(is_test_hash_being_uploaded(backend, 3));
+    g_assert_true(g_queue_is_empty(backend->upload_pool->delayed));
+
+    free_test_backend(backend);
+}
+
+
+/**
+ * Delayed uploads are issued by retry time order and before the queued
+ * ones.
+ */
+static void test_minio_backend_delayed(void)
+{
+    minio_backend_t *backend = NULL;
+    minio_upload_t *upload = NULL;
+    minio_upload_t *delayed[3];
+    gint64 now = g_get_monotonic_time();
+    guint in_flight = 0;
+    guint i = 0;
+
+    backend = new_test_backend();
+
+    for (i = 0; i < 3; i++)
+        {
+            queue_test_upload(backend, i + 1);
+            delayed[i] = next_upload(backend->upload_pool, FALSE);
+        }
+
+    delayed[0]->retry_at = now - 1000;
+    delayed[1]->retry_at = now - 3000;
+    delayed[2]->retry_at = now - 2000;
+
+    for (i = 0; i < 3; i++)
+        {
+            delay_upload(backend->upload_pool, delayed[i]);
+        }
+
+    queue_test_upload(backend, 4);
+
+    g_assert_true(issue_test_upload(backend, &in_flight) == delayed[1]);
+    g_assert_true(issue_test_upload(backend, &in_flight) == delayed[2]);
+    g_assert_true(issue_test_upload(backend, &in_flight) == delayed[0]);
+
+    upload = issue_test_upload(backend, &in_flight);
+    g_assert_true(is_test_hash_being_uploaded(backend, 4));
+    upload_done(S3StatusOK, upload);
+
+    for (i = 0; i < 3; i++)
+        {
+            upload_done(S3StatusOK, delayed[i]);
+        }
+
+    g_assert_cmpuint(in_flight, ==, 0);
+    g_assert_null(next_upload(backend->upload_pool, FALSE));
+
+    free_test_backend(backend);
+}
+
+
+/**
+ * A block is uploaded with its compression type and uncompressed length
+ * in its headers, which are read back when it is retrieved.
+ */
+static void test_minio_backend_block_meta(void)
+{
+    minio_backend_t *backend = NULL;
+    minio_upload_t *upload = NULL;
+    minio_block_meta_t block_meta;
+    hash_data_t *hash_data = NULL;
+    gchar *hash_string = NULL;
+    guint in_flight = 0;
+    gint i = 0;
+
+    backend = new_test_backend();
+
+    hash_data = new_hash_data_t_as_is((guchar *) g_strdup("compressed"), 10, make_test_hash(1), COMPRESS_ZLIB_TYPE, 4096);
+    hash_string = hash_to_string(hash_data->hash);
+    g_assert_true(save_data_to_bucket(backend, backend->bucketname_data, hash_string, hash_data, FALSE));
+
+    upload = issue_test_upload(backend, &in_flight);
+    g_assert_cmpstr(upload->key, ==, hash_string);
+    g_assert_true(upload->data == (const char *) hash_data->data);
+    g_assert_cmpuint(upload->length, ==, 10);
+    g_assert_cmpint(upload->meta_count, ==, MINIO_META_COUNT);
+
+    block_meta.cmptype = COMPRESS_NONE_TYPE;
+    block_meta.uncmplen = -1;
+    block_meta.found = 0;
+
+    for (i = 0; i < upload->meta_count; i++)
+        {
+            read_block_meta(upload->meta[i].name, upload->meta[i].value, &block_meta);
+        }
+
+    g_assert_cmpuint(block_meta.found, ==, MINIO_META_COUNT);
+    g_assert_cmpint(block_meta.cmptype, ==, COMPRESS_ZLIB_TYPE);
+    g_assert_cmpint(block_meta.uncmplen, ==, 4096);
+
+    upload_done(S3StatusOK, upload);
+    free_variable(hash_string);
+
+    /* header names are case insensitive and other headers are ignored */
+    block_meta.found = 0;
+    read_block_meta("CmpType", "0", &block_meta);
+    read_block_meta("owner", "1", &block_meta);
+    read_block_meta(KN_UNCMPLEN, NULL, &block_meta);
+    g_assert_cmpuint(block_meta.found, ==, 1);
+    g_assert_cmpint(block_meta.cmptype, ==, COMPRESS_NONE_TYPE);
+
+    /* an unknown compression type is stored as no compression */
+    hash_data = new_hash_data_t_as_is((guchar *) g_strdup("raw"), 3, make_test_hash(2), 42, 3);
+    hash_string = hash_to_string(hash_data->hash);
+    save_data_to_bucket(backend, backend->bucketname_data, hash_string, hash_data, FALSE);
+    upload = issue_test_upload(backend, &in_flight);
+    g_assert_cmpstr(upload->meta[0].name, ==, KN_CMPTYPE);
+    g_assert_cmpint(g_ascii_strtoll(upload->meta[0].value, NULL, 10), ==, COMPRESS_NONE_TYPE);
+    upload_done(S3StatusOK, upload);
+    free_variable(hash_string);
+
+    free_test_backend(backend);
+}
+
+
+/**
+ * Blocks stored in the data bucket are added to the index, blocks stored
+ * in the fallback bucket or not stored are not.
+ */
+static void test_minio_backend_index(void)
+{
+    minio_backend_t *backend = NULL;
+    minio_upload_t *upload = NULL;
+    hash_data_t *hash_data = NULL;
+    gchar *hash_string = NULL;
+    guint8 *hash = NULL;
+    guint in_flight = 0;
+    guint i = 0;
+
+    backend = new_test_backend();
+
+    for (i = 1; i <= 3; i++)
+        {
+            hash_data = new_hash_data_t_as_is((guchar *) g_strdup("block"), 5, make_test_hash(i), COMPRESS_NONE_TYPE, 5);
+            hash_string = hash_to_string(hash_data->hash);
+            save_data_to_bucket(backend, (i == 2) ? MINIO_FALLBACK_BUCKET : backend->bucketname_data, hash_string, hash_data, FALSE);
+            free_variable(hash_string);
+        }
+
+    upload = issue_test_upload(backend, &in_flight);
+    upload_done(S3StatusOK, upload);
+    upload = issue_test_upload(backend, &in_flight);
+    upload_done(S3StatusOK, upload);
+    upload = issue_test_upload(backend, &in_flight);
+    upload_done(S3StatusErrorAccessDenied, upload);
+
+    hash = make_test_hash(1);
+    g_assert_true(minio_index_contains(backend->index, hash));
+    free_variable(hash);
+
+    hash = make_test_hash(2);
+    g_assert_false(minio_index_contains(backend->index, hash));
+    free_variable(hash);
+
+    hash = make_test_hash(3);
+    g_assert_false(minio_index_contains(backend->index, hash));
+    free_variable(hash);
+
+    /* an object that is not a block is not indexed */
+    queue_test_upload(backend, 4);
+    upload = issue_test_upload(backend, &in_flight);
+    upload_done(S3StatusOK, upload);
+
+    hash = make_test_hash(4);
+    g_assert_false(minio_index_contains(backend->index, hash));
+    free_variable(hash);
+
+    free_test_backend(backend);
+}
+
+
+/**
+ * A block whose upload finally failed is spooled, readable from its
+ * spool file and uploaded again by the spooler until it is stored. Its
+ * spool file is then removed.
+ */
+static void test_minio_backend_spool(void)
+{
+    minio_backend_t *backend = NULL;
+    minio_upload_t *upload = NULL;
+    hash_data_t *hash_data = NULL;
+    gchar *hash_string = NULL;
+    gchar *filename = NULL;
+    guint8 *hash = NULL;
+    guint in_flight = 0;
+
+    backend = new_test_backend();
+
+    hash = make_test_hash(1);
+    hash_data = new_hash_data_t_as_is((guchar *) g_strdup("compressed"), 10, g_memdup(hash, HASH_LEN), COMPRESS_ZLIB_TYPE, 4096);
+    hash_string = hash_to_string(hash);
+    filename = g_build_filename(backend->spool_dir, hash_string, NULL);
+    save_data_to_bucket(backend, backend->bucketname_data, hash_string, hash_data, FALSE);
+
+    upload = issue_test_upload(backend, &in_flight);
+    upload_done(S3StatusErrorAccessDenied, upload);
+    g_assert_false(is_test_hash_being_uploaded(backend, 1));
+    g_assert_false(minio_index_contains(backend->index, hash));
+    g_assert_true(file_exists(filename));
+
+    hash_data = read_spooled_block(backend, hash_string);
+    g_assert_nonnull(hash_data);
+    g_assert_cmpint(hash_data->read, ==, 10);
+    g_assert_cmpint(memcmp(hash_data->data, "compressed", 10), ==, 0);
+    g_assert_cmpint(memcmp(hash_data->hash, hash, HASH_LEN), ==, 0);
+    g_assert_cmpint(hash_data->cmptype, ==, COMPRESS_ZLIB_TYPE);
+    g_assert_cmpint(hash_data->uncmplen, ==, 4096);
+    free_hash_data_t(hash_data);
+
+    /* uploaded again once, even if the spooler runs twice meanwhile */
+    backend->active_bucket_data = backend->bucketname_data;
+    upload_spooled_blocks(backend);
+    upload_spooled_blocks(backend);
+    g_assert_cmpuint(backend->upload_pool->pending, ==, 1);
+
+    upload = issue_test_upload(backend, &in_flight);
+    g_assert_true(upload->spooled);
+    g_assert_cmpint(upload->length, ==, 10);
+    upload_done(S3StatusErrorAccessDenied, upload);
+    g_assert_true(file_exists(filename));
+
+    backend->active_bucket_data = backend->bucketname_data;
+    upload_spooled_blocks(backend);
+    upload = issue_test_upload(backend, &in_flight);
+    upload_done(S3StatusOK, upload);
+    g_assert_false(file_exists(filename));
+    g_assert_true(minio_index_contains(backend->index, hash));
+    g_assert_null(read_spooled_block(backend, hash_string));
+
+    free_variable(filename);
+    free_variable(hash_string);
+    free_variable(hash);
+    free_test_backend(backend);
+}
+
+
+/**
+ * Queues one upload from another thread.
+ * @param user_data is the minio_backend_t * backend.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer queue_upload_thread(gpointer user_data)
+{
+    queue_test_upload(user_data, TEST_MAX_IN_FLIGHT + 1);
+
+    return NULL;
+}
+
+
+/**
+ * Queuing waits while max_in_flight uploads are queued or running.
+ */
+static void test_minio_backend_max_in_flight(void)
+{
+    minio_backend_t *backend = NULL;
+    minio_upload_t *upload = NULL;
+    GThread *thread = NULL;
+    guint in_flight = 0;
+    guint i = 0;
+
+    backend = new_test_backend();
+
+    for (i = 1; i <= TEST_MAX_IN_FLIGHT; i++)
+        {
+            queue_test_upload(backend, i);
+        }
+
+    thread = g_thread_new("test-queue", queue_upload_thread, backend);
+    g_usleep(50 * 1000);
+
+    g_mutex_lock(&backend->upload_pool->mutex);
+    g_assert_cmpuint(backend->upload_pool->pending, ==, TEST_MAX_IN_FLIGHT);
+    g_mutex_unlock(&backend->upload_pool->mutex);
+    g_assert_false(is_test_hash_being_uploaded(backend, TEST_MAX_IN_FLIGHT + 1));
+
+    upload = issue_test_upload(backend, &in_flight);
+    upload_done(S3StatusOK, upload);
+    g_thread_join(thread);
+
+    g_assert_cmpuint(backend->upload_pool->pending, ==, TEST_MAX_IN_FLIGHT);
+    g_assert_true(is_test_hash_being_uploaded(backend, TEST_MAX_IN_FLIGHT + 1));
+
+    for (i = 0; i < TEST_MAX_IN_FLIGHT; i++)
+        {
+            upload = issue_test_upload(backend, &in_flight);
+            upload_done(S3StatusOK, upload);
+        }
+
+    free_test_backend(backend);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/minio_backend/upload_done", test_minio_backend_upload_done);
+    g_test_add_func("/minio_backend/retry", test_minio_backend_retry);
+    g_test_add_func("/minio_backend/delayed", test_minio_backend_delayed);
+    g_test_add_func("/minio_backend/max_in_flight", test_minio_backend_max_in_flight);
+    g_test_add_func("/minio_backend/block_meta", test_minio_backend_block_meta);
+    g_test_add_func("/minio_backend/index", test_minio_backend_index);
+    g_test_add_func("/minio_backend/spool", test_minio_backend_spool);
+
+    return g_test_run();
+}
@@ -0,0 +1,229 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_minio_index.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_minio_index.c
+ * Tests of the local index of the data bucket of the MinIO backend when
+ * it is loaded from its file (no MinIO server is needed) and of the
+ * recognition of the keys of blocks.
+ */
+
+#include <glib/gstdio.h>
+#include "server.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_BUCKET
+ * Bucket of the tests (never listed as index files exist).
+ */
+#define TEST_BUCKET "test-data"
+
+
+/**
+ * Writes an index file made of test hashs.
+ * @param filename is the index file.
+ * @param first is the number of the first test hash.
+ * @param count is the number of hashs.
+ * @param tail is the number of bytes of one more hash written as if a
+ *        crash occured while appending it.
+ */
+static void write_test_index_file(const gchar *filename, guint first, guint count, gsize tail)
+{
+    GByteArray *contents = NULL;
+    guint8 *hash = NULL;
+    guint i = 0;
+
+    contents = g_byte_array_new();
+
+    for (i = first; i < first + count + (tail > 0 ? 1 : 0); i++)
+        {
+            hash = make_test_hash(i);
+            g_byte_array_append(contents, hash, (i < first + count) ? HASH_LEN : tail);
+            free_variable(hash);
+        }
+
+    g_assert_true(g_file_set_contents(filename, (gchar *) contents->data, contents->len, NULL));
+    g_byte_array_free(contents, TRUE);
+}
+
+
+/**
+ * Tells whether a test hash is in the index.
+ * @param index is the index.
+ * @param i is the number of the test hash.
+ * @returns TRUE if the hash is in the index.
+ */
+static gboolean index_contains(minio_index_t *index, guint i)
+{
+    guint8 *hash = NULL;
+    gboolean found = FALSE;
+
+    hash = make_test_hash(i);
+    found = minio_index_contains(index, hash);
+    free_variable(hash);
+
+    return found;
+}
+
+
+/**
+ * Gets the size of a file.
+ * @param filename is the file.
+ * @returns its size in bytes.
+ */
+static goffset get_index_file_size(const gchar *filename)
+{
+    GStatBuf buf;
+
+    g_assert_cmpint(g_stat(filename, &buf), ==, 0);
+
+    return buf.st_size;
+}
+
+
+/**
+ * A saved index is complete and knows every hash of its file but the
+ * truncated last one, which is removed from the file: hashs added then
+ * are found again when it is loaded.
+ */
+static void test_minio_index_load(void)
+{
+    minio_index_t *index = NULL;
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+    guint8 *hash = NULL;
+
+    prefix = make_test_directory();
+    filename = g_build_filename(prefix, "index", NULL);
+    write_test_index_file(filename, 1, 3, HASH_LEN / 2);
+
+    index = new_minio_index_t(filename, TEST_BUCKET);
+    g_assert_true(minio_index_is_complete(index));
+    g_assert_true(index_contains(index, 1));
+    g_assert_true(index_contains(index, 2));
+    g_assert_true(index_contains(index, 3));
+    g_assert_false(index_contains(index, 4));
+    g_assert_false(minio_index_contains(index, NULL));
+    g_assert_cmpint(get_index_file_size(filename), ==, 3 * HASH_LEN);
+
+    hash = make_test_hash(5);
+    minio_index_add(index, hash);
+    free_variable(hash);
+    free_minio_index_t(index);
+
+    index = new_minio_index_t(filename, TEST_BUCKET);
+    g_assert_true(index_contains(index, 3));
+    g_assert_true(index_contains(index, 5));
+    g_assert_cmpuint(g_hash_table_size(index->keys), ==, 4);
+    free_minio_index_t(index);
+
+    g_assert_false(minio_index_is_complete(NULL));
+    g_assert_false(minio_index_contains(NULL, NULL));
+
+    remove_test_directory(prefix);
+    free_variable(filename);
+    free_variable(prefix);
+}
+
+
+/**
+ * Added hashs are appended once to the index file and found again when
+ * it is loaded.
+ */
+static void test_minio_index_add(void)
+{
+    minio_index_t *index = NULL;
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+    guint8 *hash = NULL;
+
+    prefix = make_test_directory();
+    filename = g_build_filename(prefix, "index", NULL);
+    write_test_index_file(filename, 1, 2, 0);
+
+    index = new_minio_index_t(filename, TEST_BUCKET);
+
+    hash = make_test_hash(3);
+    minio_index_add(index, hash);
+    minio_index_add(index, hash);
+    free_variable(hash);
+
+    /* already known */
+    hash = make_test_hash(1);
+    minio_index_add(index, hash);
+    free_variable(hash);
+
+    g_assert_true(index_contains(index, 3));
+    g_assert_cmpint(get_index_file_size(filename), ==, 3 * HASH_LEN);
+    free_minio_index_t(index);
+
+    index = new_minio_index_t(filename, TEST_BUCKET);
+    g_assert_true(index_contains(index, 1));
+    g_assert_true(index_contains(index, 2));
+    g_assert_true(index_contains(index, 3));
+    g_assert_cmpuint(g_hash_table_size(index->keys), ==, 3);
+    free_minio_index_t(index);
+
+    remove_test_directory(prefix);
+    free_variable(filename);
+    free_variable(prefix);
+}
+
+
+/**
+ * Only hashs in hexadecimal format are keys of blocks.
+ */
+static void test_minio_index_hash_key(void)
+{
+    guint8 *hash = NULL;
+    gchar *key = NULL;
+
+    hash = make_test_hash(1);
+    key = hash_to_string(hash);
+    g_assert_true(minio_is_hash_key(key));
+
+    key[0] = 'g';
+    g_assert_false(minio_is_hash_key(key));
+
+    key[HASH_LEN] = '\0';
+    g_assert_false(minio_is_hash_key(key));
+    free_variable(key);
+
+    key = g_strdup_printf("%s%016x%s", MINIO_PACK_PREFIX, 1, MINIO_PACK_INDEX_SUFFIX);
+    g_assert_false(minio_is_hash_key(key));
+    g_assert_false(minio_is_hash_key(NULL));
+
+    free_variable(key);
+    free_variable(hash);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/minio_index/load", test_minio_index_load);
+    g_test_add_func("/minio_index/add", test_minio_index_add);
+    g_test_add_func("/minio_index/hash_key", test_minio_index_hash_key);
+
+    return g_test_run();
+}
@@ -0,0 +1,411 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_minio_pack.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_minio_pack.c
+ * Tests of the packing mode of the MinIO backend without any MinIO
+ * server: blocks are gathered into packs, a pack is only indexed once it
+ * and its index object are uploaded, a failed pack is read from its
+ * staging file until it is uploaded again and staging files and local
+ * pack index files left by a crash are recovered.
+ */
+
+#include <glib/gstdio.h>
+#include "server.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_BLOCK_SIZE
+ * Size of the blocks packed by the tests.
+ *
+ * @def TEST_PACK_SIZE
+ * Size from which the packs of the tests are sealed: two blocks.
+ */
+#define TEST_BLOCK_SIZE (1000)
+#define TEST_PACK_SIZE (2 * (MINIO_PACK_ENTRY_LEN + TEST_BLOCK_SIZE))
+
+
+/**
+ * Opens the packer of a test directory. An empty local pack index file
+ * is created first, as a rebuild from an empty bucket does.
+ * @param prefix is the test directory.
+ * @param pack_size is the size from which packs are sealed.
+ * @returns a newly allocated packer.
+ */
+static minio_packer_t *open_packer(const gchar *prefix, guint64 pack_size)
+{
+    minio_packer_t *packer = NULL;
+    gchar *staging_dir = NULL;
+    gchar *index_filename = NULL;
+
+    staging_dir = g_build_filename(prefix, "staging", NULL);
+    index_filename = g_build_filename(prefix, "pack.idx", NULL);
+
+    if (file_exists(index_filename) == FALSE)
+        {
+            g_assert_true(g_file_set_contents(index_filename, "", 0, NULL));
+        }
+
+    packer = new_minio_packer_t(pack_size, staging_dir, index_filename);
+    g_assert_nonnull(packer);
+    g_assert_true(minio_packer_has_index_file(packer));
+
+    free_variable(index_filename);
+    free_variable(staging_dir);
+
+    return packer;
+}
+
+
+/**
+ * Adds a block whose bytes are all the same to the packer.
+ * @param packer is the packer.
+ * @param i is the number whose hash is the hash of the block and the
+ *        value of its bytes.
+ * @returns the sealed pack to upload or NULL.
+ */
+static minio_pack_t *add_block(minio_packer_t *packer, guint i)
+{
+    hash_data_t *hash_data = NULL;
+    minio_pack_t *pack = NULL;
+    guchar *data = NULL;
+
+    data = (guchar *) g_malloc(TEST_BLOCK_SIZE);
+    memset(data, i, TEST_BLOCK_SIZE);
+    hash_data = new_hash_data_t_as_is(data, TEST_BLOCK_SIZE, make_test_hash(i), COMPRESS_ZLIB_TYPE, 2 * TEST_BLOCK_SIZE);
+
+    pack = minio_packer_add(packer, hash_data);
+    free_hash_data_t(hash_data);
+
+    return pack;
+}
+
+
+/**
+ * Looks a block up and checks its entry.
+ * @param packer is the packer.
+ * @param i is the number of the block (see add_block()).
+ * @param pack is the id of the pack that must contain the block.
+ * @param staged tells whether the data of the block has to be returned
+ *        (its pack is not uploaded) or not.
+ */
+static void check_block(minio_packer_t *packer, guint i, guint64 pack, gboolean staged)
+{
+    minio_pack_entry_t entry;
+    guchar *data = NULL;
+    guint8 *hash = NULL;
+
+    hash = make_test_hash(i);
+
+    g_assert_true(minio_packer_contains(packer, hash));
+    g_assert_true(minio_packer_lookup(packer, hash, &entry, &data));
+    g_assert_cmpmem(entry.hash, HASH_LEN, hash, HASH_LEN);
+    g_assert_cmpuint(entry.pack, ==, pack);
+    g_assert_cmpuint(entry.length, ==, TEST_BLOCK_SIZE);
+    g_assert_cmpint(entry.uncmplen, ==, 2 * TEST_BLOCK_SIZE);
+    g_assert_cmpint(entry.cmptype, ==, COMPRESS_ZLIB_TYPE);
+
+    if (staged == TRUE)
+        {
+            g_assert_nonnull(data);
+            g_assert_cmpint(data[0], ==, i);
+            g_assert_cmpint(data[TEST_BLOCK_SIZE - 1], ==, i);
+        }
+    else
+        {
+            g_assert_null(data);
+        }
+
+    free_variable(data);
+    free_variable(hash);
+}
+
+
+/**
+ * Uploads a sealed pack and its index object.
+ * @param packer is the packer.
+ * @param pack is the sealed pack.
+ * @param success tells whether the upload of the index object succeeds.
+ */
+static void upload_pack(minio_packer_t *packer, minio_pack_t *pack, gboolean success)
+{
+    minio_packer_uploading(packer, pack, 2);
+    minio_packer_uploaded(packer, pack, TRUE);
+    minio_packer_uploaded(packer, pack, success);
+}
+
+
+/**
+ * Blocks are served from their pack until it and its index object are
+ * uploaded, then from the local pack index that is found again when the
+ * packer is reopened.
+ */
+static void test_minio_pack_round_trip(void)
+{
+    minio_packer_t *packer = NULL;
+    minio_pack_t *pack = NULL;
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+    gchar *content = NULL;
+    gsize len = 0;
+    guint64 first = 0;
+    guint64 second = 0;
+    minio_pack_entry_t entry;
+    guchar *data = NULL;
+    guint8 *hash = NULL;
+
+    prefix = make_test_directory();
+    packer = open_packer(prefix, TEST_PACK_SIZE);
+
+    g_assert_null(add_block(packer, 1));
+    g_assert_null(add_block(packer, 1));
+    pack = add_block(packer, 2);
+    g_assert_nonnull(pack);
+    g_assert_cmpuint(pack->entries->len, ==, 2);
+    g_assert_cmpuint(pack->length, ==, TEST_PACK_SIZE);
+    g_assert_cmpuint(packer->uploading, ==, 1);
+
+    first = pack->id;
+    filename = g_strdup(pack->filename);
+    check_block(packer, 1, first, TRUE);
+    check_block(packer, 2, first, TRUE);
+
+    hash = make_test_hash(2);
+    minio_packer_lookup(packer, hash, &entry, &data);
+    g_assert_cmpuint(entry.offset, ==, 2 * MINIO_PACK_ENTRY_LEN + TEST_BLOCK_SIZE);
+    free_variable(data);
+    free_variable(hash);
+
+    content = minio_pack_index_content(pack, &len);
+    g_assert_cmpuint(len, ==, 2 * MINIO_PACK_ENTRY_LEN);
+    free_variable(content);
+
+    /* the pack is kept until its index object is uploaded too */
+    minio_packer_uploading(packer, pack, 2);
+    minio_packer_uploaded(packer, pack, TRUE);
+    g_assert_true(file_exists(filename));
+    check_block(packer, 1, first, TRUE);
+    minio_packer_uploaded(packer, pack, TRUE);
+
+    g_assert_false(file_exists(filename));
+    g_assert_cmpuint(packer->uploading, ==, 0);
+    check_block(packer, 1, first, FALSE);
+    check_block(packer, 2, first, FALSE);
+
+    /* a pack smaller than pack_size is sealed on demand */
+    g_assert_null(add_block(packer, 3));
+    pack = minio_packer_seal(packer, 0);
+    g_assert_nonnull(pack);
+    g_assert_null(minio_packer_seal(packer, 0));
+    second = pack->id;
+    upload_pack(packer, pack, TRUE);
+
+    free_minio_packer_t(packer);
+
+    packer = open_packer(prefix, TEST_PACK_SIZE);
+    check_block(packer, 1, first, FALSE);
+    check_block(packer, 2, first, FALSE);
+    check_block(packer, 3, second, FALSE);
+    g_assert_null(minio_packer_recover(packer));
+    free_minio_packer_t(packer);
+
+    remove_test_directory(prefix);
+    free_variable(filename);
+    free_variable(prefix);
+}
+
+
+/**
+ * A pack whose index object could not be uploaded is not indexed: its
+ * blocks are read from its staging file until it is uploaded again.
+ */
+static void test_minio_pack_failure(void)
+{
+    minio_packer_t *packer = NULL;
+    minio_pack_t *pack = NULL;
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+    guint64 id = 0;
+
+    prefix = make_test_directory();
+    packer = open_packer(prefix, TEST_PACK_SIZE);
+
+    add_block(packer, 1);
+    pack = add_block(packer, 2);
+    g_assert_nonnull(pack);
+    id = pack->id;
+    filename = g_strdup(pack->filename);
+
+    upload_pack(packer, pack, FALSE);
+
+    g_assert_true(file_exists(filename));
+    g_assert_cmpuint(pack->data->len, ==, 0);
+    g_assert_cmpint(pack->retry_at, >, 0);
+    g_assert_cmpuint(packer->uploading, ==, 0);
+    check_block(packer, 1, id, TRUE);
+    check_block(packer, 2, id, TRUE);
+
+    /* not before MINIO_PACK_RETRY_DELAY seconds */
+    g_assert_null(minio_packer_retry(packer));
+    pack->retry_at = g_get_monotonic_time();
+    g_assert_true(minio_packer_retry(packer) == pack);
+    g_assert_cmpuint(pack->data->len, ==, TEST_PACK_SIZE);
+    g_assert_cmpuint(packer->uploading, ==, 1);
+    check_block(packer, 2, id, TRUE);
+
+    upload_pack(packer, pack, TRUE);
+    g_assert_false(file_exists(filename));
+    check_block(packer, 1, id, FALSE);
+    check_block(packer, 2, id, FALSE);
+    free_minio_packer_t(packer);
+
+    remove_test_directory(prefix);
+    free_variable(filename);
+    free_variable(prefix);
+}
+
+
+/**
+ * A staging file left by a crash is read back (without its truncated
+ * last record) and its pack has to be uploaded.
+ */
+static void test_minio_pack_recover(void)
+{
+    minio_packer_t *packer = NULL;
+    minio_pack_t *pack = NULL;
+    GList *packs = NULL;
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+    guint8 *hash = NULL;
+    guint64 id = 0;
+    FILE *stream = NULL;
+
+    prefix = make_test_directory();
+    packer = open_packer(prefix, 10 * TEST_PACK_SIZE);
+
+    add_block(packer, 1);
+    add_block(packer, 2);
+    id = packer->current->id;
+    filename = g_strdup(packer->current->filename);
+    free_minio_packer_t(packer);
+
+    /* a record whose writing did not end */
+    stream = fopen(filename, "ab");
+    g_assert_nonnull(stream);
+    fwrite("truncated", 1, 9, stream);
+    fclose(stream);
+
+    /* staged blocks are not in the local pack index */
+    packer = open_packer(prefix, 10 * TEST_PACK_SIZE);
+    hash = make_test_hash(1);
+    g_assert_false(minio_packer_contains(packer, hash));
+    free_variable(hash);
+
+    packs = minio_packer_recover(packer);
+    g_assert_cmpuint(g_list_length(packs), ==, 1);
+    pack = packs->data;
+    g_list_free(packs);
+
+    g_assert_cmpuint(pack->id, ==, id);
+    g_assert_cmpuint(pack->entries->len, ==, 2);
+    g_assert_cmpuint(pack->length, ==, TEST_PACK_SIZE);
+    g_assert_cmpuint(packer->uploading, ==, 1);
+    check_block(packer, 1, id, TRUE);
+    check_block(packer, 2, id, TRUE);
+
+    upload_pack(packer, pack, TRUE);
+    free_minio_packer_t(packer);
+
+    packer = open_packer(prefix, 10 * TEST_PACK_SIZE);
+    g_assert_null(minio_packer_recover(packer));
+    check_block(packer, 2, id, FALSE);
+    free_minio_packer_t(packer);
+
+    remove_test_directory(prefix);
+    free_variable(filename);
+    free_variable(prefix);
+}
+
+
+/**
+ * A truncated last entry of the local pack index file (crash while
+ * appending) is removed: entries appended afterwards are found again
+ * when the packer is reopened.
+ */
+static void test_minio_pack_truncated_index(void)
+{
+    minio_packer_t *packer = NULL;
+    minio_pack_t *pack = NULL;
+    gchar *prefix = NULL;
+    gchar *index_filename = NULL;
+    guint64 first = 0;
+    guint64 second = 0;
+    FILE *stream = NULL;
+
+    prefix = make_test_directory();
+    index_filename = g_build_filename(prefix, "pack.idx", NULL);
+    packer = open_packer(prefix, TEST_PACK_SIZE);
+
+    add_block(packer, 1);
+    pack = minio_packer_seal(packer, 0);
+    first = pack->id;
+    upload_pack(packer, pack, TRUE);
+    free_minio_packer_t(packer);
+
+    /* an entry whose writing did not end */
+    stream = fopen(index_filename, "ab");
+    g_assert_nonnull(stream);
+    fwrite("truncated", 1, 9, stream);
+    fclose(stream);
+
+    packer = open_packer(prefix, TEST_PACK_SIZE);
+    check_block(packer, 1, first, FALSE);
+
+    add_block(packer, 2);
+    pack = minio_packer_seal(packer, 0);
+    second = pack->id;
+    upload_pack(packer, pack, TRUE);
+    free_minio_packer_t(packer);
+
+    packer = open_packer(prefix, TEST_PACK_SIZE);
+    check_block(packer, 1, first, FALSE);
+    check_block(packer, 2, second, FALSE);
+    g_assert_cmpuint(g_hash_table_size(packer->entries), ==, 2);
+    free_minio_packer_t(packer);
+
+    remove_test_directory(prefix);
+    free_variable(index_filename);
+    free_variable(prefix);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/minio_pack/round_trip", test_minio_pack_round_trip);
+    g_test_add_func("/minio_pack/failure", test_minio_pack_failure);
+    g_test_add_func("/minio_pack/recover", test_minio_pack_recover);
+    g_test_add_func("/minio_pack/truncated_index", test_minio_pack_truncated_index);
+
+    return g_test_run();
+}
@@ -0,0 +1,367 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_reuse.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_reuse.c
+ * Tests of the reuse of local copies when restoring: a local copy is
+ * looked for with --reuse and --seed, its unchanged blocks are copied
+ * and only the other ones are fetched from the server. Blocks full of
+ * zeros are not fetched at all and left as holes.
+ */
+
+#include <glib/gstdio.h>
+#include "restore.h"
+#include "test_common.h"
+#include "test_block_server.h"
+
+/**
+ * @def TEST_BLOCKSIZE
+ * Block size the test files are cut with (only this known block size
+ * gives TEST_NB_BLOCKS blocks for their size).
+ *
+ * @def TEST_NB_BLOCKS
+ * Number of blocks of the test files.
+ */
+#define TEST_BLOCKSIZE (2048)
+#define TEST_NB_BLOCKS (8)
+
+
+/**
+ * Makes the content of a test file. Version 1 differs from version 0 in
+ * its blocks 2 and 5.
+ * @param version is the version of the file (0 or 1).
+ * @param with_zero is TRUE to make block 3 a block full of zeros.
+ * @returns a newly allocated GByteArray with the content.
+ */
+static GByteArray *make_test_content(guint version, gboolean with_zero)
+{
+    GByteArray *content = NULL;
+    guint8 *data = NULL;
+    guint k = 0;
+    guint j = 0;
+
+    content = g_byte_array_sized_new(TEST_BLOCKSIZE * TEST_NB_BLOCKS);
+    g_byte_array_set_size(content, TEST_BLOCKSIZE * TEST_NB_BLOCKS);
+
+    for (k = 0; k < TEST_NB_BLOCKS; k++)
+        {
+            data = content->data + k * TEST_BLOCKSIZE;
+
+            for (j = 0; j < TEST_BLOCKSIZE; j++)
+                {
+                    data[j] = ((k * 13 + j + ((version == 1 && (k == 2 || k == 5)) ? 7 : 0)) % 251) + 1;
+                }
+
+            if (with_zero == TRUE && k == 3)
+                {
+                    memset(data, 0, TEST_BLOCKSIZE);
+                }
+        }
+
+    return content;
+}
+
+
+/**
+ * Makes the meta data of a saved file and adds its blocks (except zero
+ * blocks that are never saved) to the server.
+ * @param server is the block server.
+ * @param name is the name of the saved file.
+ * @param content is the content of the saved file.
+ * @returns a newly allocated meta_data_t * structure.
+ */
+static meta_data_t *make_test_meta(block_server_t *server, const gchar *name, GByteArray *content)
+{
+    meta_data_t *meta = NULL;
+    guint8 *hash = NULL;
+    guint k = 0;
+
+    meta = new_meta_data_t();
+    meta->file_type = G_FILE_TYPE_REGULAR;
+    meta->mode = 0100644;
+    meta->name = g_strdup(name);
+    meta->link = g_strdup("");
+    meta->size = content->len;
+
+    for (k = 0; k < content->len / TEST_BLOCKSIZE; k++)
+        {
+            if (server != NULL && content->data[k * TEST_BLOCKSIZE] != 0)
+                {
+                    hash = add_block_to_server(server, content->data + k * TEST_BLOCKSIZE, TEST_BLOCKSIZE, COMPRESS_ZLIB_TYPE);
+                }
+            else
+                {
+                    hash = calculate_hash_for_string(content->data + k * TEST_BLOCKSIZE, TEST_BLOCKSIZE);
+                }
+
+            meta->hash_data_list = g_list_append(meta->hash_data_list, new_hash_data_t_as_is(NULL, 0, hash, COMPRESS_NONE_TYPE, 0));
+        }
+
+    return meta;
+}
+
+
+/**
+ * Restores a file reusing the blocks of a local copy and checks its
+ * content.
+ * @param comm is the communication structure to the block server.
+ * @param meta is the meta data of the saved file.
+ * @param seed is the local copy (may be NULL).
+ * @param expected is the expected content of the restored file.
+ * @returns the result of fetch_reusing_local_blocks().
+ */
+static gboolean restore_test_file(comm_t *comm, meta_data_t *meta, gchar *seed, GByteArray *expected)
+{
+    GFile *file = NULL;
+    GFileOutputStream *stream = NULL;
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+    gchar *contents = NULL;
+    gsize len = 0;
+    gboolean reused = FALSE;
+
+    prefix = make_test_directory();
+    filename = g_build_filename(prefix, "restored", NULL);
+    file = g_file_new_for_path(filename);
+    stream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL);
+    g_assert_nonnull(stream);
+
+    reused = fetch_reusing_local_blocks(comm, stream, meta, seed);
+    g_output_stream_close(G_OUTPUT_STREAM(stream), NULL, NULL);
+
+    g_assert_true(g_file_get_contents(filename, &contents, &len, NULL));
+    g_assert_cmpmem(contents, len, expected->data, expected->len);
+
+    free_variable(contents);
+    g_object_unref(stream);
+    g_object_unref(file);
+    remove_test_directory(prefix);
+    free_variable(filename);
+    free_variable(prefix);
+
+    return reused;
+}
+
+
+/**
+ * Local copies are looked for at the restore place with --reuse and in
+ * the seed directory (same path or same name) with --seed.
+ */
+static void test_reuse_seed_filename(void)
+{
+    options_t *opt = NULL;
+    meta_data_t *meta = NULL;
+    gchar *where = NULL;
+    gchar *seed_dir = NULL;
+    gchar *local = NULL;
+    gchar *same_path = NULL;
+    gchar *same_name = NULL;
+    gchar *seed = NULL;
+    gchar *dirname = NULL;
+    gboolean replace = TRUE;
+
+    where = make_test_directory();
+    seed_dir = make_test_directory();
+    opt = (options_t *) g_malloc0(sizeof(options_t));
+    opt->where = where;
+
+    meta = new_meta_data_t();
+    meta->name = g_strdup("/home/user/notes.txt");
+    meta->link = g_strdup("");
+
+    /* nothing to reuse */
+    seed = get_seed_filename(opt, meta, &replace);
+    g_assert_null(seed);
+    g_assert_false(replace);
+
+    opt->reuse = TRUE;
+    opt->seed = seed_dir;
+    seed = get_seed_filename(opt, meta, &replace);
+    g_assert_null(seed);
+
+    /* same name in the seed directory */
+    same_name = g_build_filename(seed_dir, "notes.txt", NULL);
+    g_assert_true(g_file_set_contents(same_name, "notes", -1, NULL));
+    seed = get_seed_filename(opt, meta, &replace);
+    g_assert_cmpstr(seed, ==, same_name);
+    g_assert_false(replace);
+    free_variable(seed);
+
+    /* same path in the seed directory is preferred */
+    same_path = g_build_filename(seed_dir, meta->name, NULL);
+    dirname = g_path_get_dirname(same_path);
+    g_mkdir_with_parents(dirname, 0700);
+    g_assert_true(g_file_set_contents(same_path, "notes", -1, NULL));
+    seed = get_seed_filename(opt, meta, &replace);
+    g_assert_cmpstr(seed, ==, same_path);
+    g_assert_false(replace);
+    free_variable(seed);
+
+    /* the file at the restore place is preferred and is to be replaced */
+    local = g_build_filename(where, "notes.txt", NULL);
+    g_assert_true(g_file_set_contents(local, "notes", -1, NULL));
+    seed = get_seed_filename(opt, meta, &replace);
+    g_assert_cmpstr(seed, ==, local);
+    g_assert_true(replace);
+    free_variable(seed);
+
+    free_variable(dirname);
+    free_variable(local);
+    free_variable(same_path);
+    free_variable(same_name);
+    free_meta_data_t(meta, TRUE);
+    g_free(opt);
+    remove_test_directory(seed_dir);
+    remove_test_directory(where);
+    free_variable(seed_dir);
+    free_variable(where);
+}
+
+
+/**
+ * Only the blocks that changed since the local copy are fetched and,
+ * when no block of the local copy matches, every block is fetched.
+ */
+static void test_reuse_local_blocks(void)
+{
+    block_server_t *server = NULL;
+    comm_t *comm = NULL;
+    meta_data_t *meta = NULL;
+    GByteArray *old = NULL;
+    GByteArray *saved = NULL;
+    gchar *prefix = NULL;
+    gchar *seed = NULL;
+
+    server = start_block_server();
+    comm = init_comm_struct(server->conn, COMPRESS_NONE_TYPE);
+    prefix = make_test_directory();
+
+    old = make_test_content(0, FALSE);
+    saved = make_test_content(1, FALSE);
+    meta = make_test_meta(server, "/data/file", saved);
+
+    seed = g_build_filename(prefix, "file", NULL);
+    g_assert_true(g_file_set_contents(seed, (gchar *) old->data, old->len, NULL));
+
+    g_assert_true(restore_test_file(comm, meta, seed, saved));
+    g_assert_cmpuint(get_block_server_nb_hashs(server), ==, 2);
+
+    /* a local copy with nothing in common */
+    g_assert_true(g_file_set_contents(seed, "something else", -1, NULL));
+    g_assert_false(restore_test_file(comm, meta, seed, saved));
+    g_assert_cmpuint(get_block_server_nb_hashs(server), ==, 2 + TEST_NB_BLOCKS);
+
+    free_meta_data_t(meta, TRUE);
+    g_byte_array_free(saved, TRUE);
+    g_byte_array_free(old, TRUE);
+    free_variable(seed);
+    remove_test_directory(prefix);
+    free_variable(prefix);
+    free_comm_t(comm);
+    stop_block_server(server);
+}
+
+
+/**
+ * Blocks full of zeros are found out from their hash, left as holes and
+ * never asked to the server, even without a local copy. A short last
+ * block full of zeros is not a zero block.
+ */
+static void test_reuse_zero_blocks(void)
+{
+    block_server_t *server = NULL;
+    comm_t *comm = NULL;
+    meta_data_t *meta = NULL;
+    meta_data_t *no_zero = NULL;
+    GByteArray *saved = NULL;
+    GByteArray *other = NULL;
+    guchar *tail = NULL;
+
+    server = start_block_server();
+    comm = init_comm_struct(server->conn, COMPRESS_NONE_TYPE);
+
+    saved = make_test_content(0, TRUE);
+    meta = make_test_meta(server, "/data/sparse", saved);
+    other = make_test_content(0, FALSE);
+    no_zero = make_test_meta(NULL, "/data/file", other);
+
+    g_assert_true(has_zero_blocks(meta));
+    g_assert_false(has_zero_blocks(no_zero));
+
+    tail = (guchar *) g_malloc0(100);
+    no_zero->hash_data_list = g_list_append(no_zero->hash_data_list, new_hash_data_t_as_is(NULL, 0, calculate_hash_for_string(tail, 100), COMPRESS_NONE_TYPE, 0));
+    no_zero->size = no_zero->size + 100;
+    g_assert_false(has_zero_blocks(no_zero));
+    free_variable(tail);
+
+    g_assert_true(restore_test_file(comm, meta, NULL, saved));
+    g_assert_cmpuint(get_block_server_nb_hashs(server), ==, TEST_NB_BLOCKS - 1);
+
+    free_meta_data_t(no_zero, TRUE);
+    free_meta_data_t(meta, TRUE);
+    g_byte_array_free(other, TRUE);
+    g_byte_array_free(saved, TRUE);
+    free_comm_t(comm);
+    stop_block_server(server);
+}
+
+
+/**
+ * The restored file takes the place of the local copy.
+ */
+static void test_reuse_replace(void)
+{
+    gchar *prefix = NULL;
+    gchar *restored = NULL;
+    gchar *seed = NULL;
+    gchar *contents = NULL;
+
+    prefix = make_test_directory();
+    restored = g_build_filename(prefix, "notes.txt.1", NULL);
+    seed = g_build_filename(prefix, "notes.txt", NULL);
+    g_assert_true(g_file_set_contents(restored, "new", -1, NULL));
+    g_assert_true(g_file_set_contents(seed, "old", -1, NULL));
+
+    g_assert_true(replace_seed_with_restored_file(restored, seed));
+    g_assert_false(g_file_test(restored, G_FILE_TEST_EXISTS));
+    g_assert_true(g_file_get_contents(seed, &contents, NULL, NULL));
+    g_assert_cmpstr(contents, ==, "new");
+
+    free_variable(contents);
+    free_variable(seed);
+    free_variable(restored);
+    remove_test_directory(prefix);
+    free_variable(prefix);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/reuse/seed_filename", test_reuse_seed_filename);
+    g_test_add_func("/reuse/local_blocks", test_reuse_local_blocks);
+    g_test_add_func("/reuse/zero_blocks", test_reuse_zero_blocks);
+    g_test_add_func("/reuse/replace", test_reuse_replace);
+
+    return g_test_run();
+}
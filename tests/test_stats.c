@@ -0,0 +1,275 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_stats.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_stats.c
+ * Tests of the server's statistics: sharded counters are summed up, and
+ * latency histograms give the expected percentiles in /Stats.json and
+ * the expected buckets in /Metrics.
+ */
+
+#include "server.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_STATS_THREADS
+ * Number of threads that update the counters at the same time.
+ *
+ * @def TEST_STATS_REQUESTS
+ * Number of requests counted by each thread.
+ */
+#define TEST_STATS_THREADS (2 * STATS_SHARDS)
+#define TEST_STATS_REQUESTS (10000)
+
+
+/**
+ * Counts TEST_STATS_REQUESTS GET requests.
+ * @param data is the stats_t * structure.
+ * @returns NULL.
+ */
+static gpointer count_requests(gpointer data)
+{
+    stats_t *stats = (stats_t *) data;
+    guint i = 0;
+
+    for (i = 0; i < TEST_STATS_REQUESTS; i++)
+        {
+            add_one_get_request(stats);
+        }
+
+    return NULL;
+}
+
+
+/**
+ * Records TEST_STATS_REQUESTS latencies of 100 µs.
+ * @param data is the stats_t * structure.
+ * @returns NULL.
+ */
+static gpointer record_latencies(gpointer data)
+{
+    stats_t *stats = (stats_t *) data;
+    guint i = 0;
+
+    for (i = 0; i < TEST_STATS_REQUESTS; i++)
+        {
+            add_latency_to_stats(stats, STATS_LATENCY_RETRIEVE_DATA, g_get_monotonic_time() - 100);
+        }
+
+    return NULL;
+}
+
+
+/**
+ * Records a latency as if the measured operation started latency µs
+ * ago.
+ * @param stats is the stats_t * structure.
+ * @param which is the endpoint or backend operation measured.
+ * @param latency is the latency to be recorded (in µs).
+ * @param times is the number of times it is recorded.
+ */
+static void record_latency(stats_t *stats, stats_latency_t which, gint64 latency, guint times)
+{
+    guint i = 0;
+
+    for (i = 0; i < times; i++)
+        {
+            add_latency_to_stats(stats, which, g_get_monotonic_time() - latency);
+        }
+}
+
+
+/**
+ * Counters updated by many threads (more than there are shards) are
+ * summed up without losing any update.
+ */
+static void test_stats_counters(void)
+{
+    stats_t *stats = NULL;
+    GThread *threads[TEST_STATS_THREADS];
+    hash_data_t *hash_data = NULL;
+    guint i = 0;
+
+    stats = new_stats_t();
+
+    for (i = 0; i < TEST_STATS_THREADS; i++)
+        {
+            threads[i] = g_thread_new("stats", count_requests, stats);
+        }
+
+    for (i = 0; i < TEST_STATS_THREADS; i++)
+        {
+            g_thread_join(threads[i]);
+        }
+
+    add_one_post_request(stats);
+    add_file_size_to_total_size(stats, 1000);
+    hash_data = new_hash_data_t_as_is(NULL, 400, NULL, COMPRESS_NONE_TYPE, 400);
+    add_hash_size_to_dedup_bytes(stats, hash_data);
+    add_hash_size_to_dedup_bytes(stats, NULL);
+    free_hash_data_t(hash_data);
+
+    g_assert_cmpuint(get_stats_counter(stats, STATS_GET), ==, TEST_STATS_THREADS * TEST_STATS_REQUESTS);
+    g_assert_cmpuint(get_stats_counter(stats, STATS_POST), ==, 1);
+    g_assert_cmpuint(get_stats_counter(stats, STATS_REQUESTS), ==, TEST_STATS_THREADS * TEST_STATS_REQUESTS + 1);
+    g_assert_cmpuint(get_stats_counter(stats, STATS_TOTAL_BYTES), ==, 1000);
+    g_assert_cmpuint(get_stats_counter(stats, STATS_DEDUP_BYTES), ==, 400);
+    g_assert_cmpuint(get_stats_counter(stats, STATS_UNKNOWN), ==, 0);
+    g_assert_cmpuint(get_stats_counter(NULL, STATS_GET), ==, 0);
+
+    free_stats_t(stats);
+}
+
+
+/**
+ * Latencies recorded by many threads at once are all counted.
+ */
+static void test_stats_latency_threads(void)
+{
+    stats_t *stats = NULL;
+    GThread *threads[TEST_STATS_THREADS];
+    json_t *root = NULL;
+    json_t *percentiles = NULL;
+    guint i = 0;
+
+    stats = new_stats_t();
+
+    for (i = 0; i < TEST_STATS_THREADS; i++)
+        {
+            threads[i] = g_thread_new("latency", record_latencies, stats);
+        }
+
+    for (i = 0; i < TEST_STATS_THREADS; i++)
+        {
+            g_thread_join(threads[i]);
+        }
+
+    root = json_object();
+    insert_latency_stats_into_json_root(root, stats);
+    percentiles = json_object_get(root, "backend retrieve_data");
+    g_assert_nonnull(percentiles);
+    g_assert_cmpint(json_integer_value(json_object_get(percentiles, "count")), ==, TEST_STATS_THREADS * TEST_STATS_REQUESTS);
+    g_assert_cmpint(json_integer_value(json_object_get(percentiles, "p50")), >=, 100);
+
+    json_decref(root);
+    free_stats_t(stats);
+}
+
+
+/**
+ * Percentiles are the upper bounds of the buckets where they lie (at
+ * most 12.5% above the recorded latency) and only recorded latencies
+ * are inserted.
+ */
+static void test_stats_percentiles(void)
+{
+    stats_t *stats = NULL;
+    json_t *root = NULL;
+    json_t *percentiles = NULL;
+    json_int_t p50 = 0;
+    json_int_t p99 = 0;
+
+    stats = new_stats_t();
+
+    /* 98 fast requests and 2 slow ones */
+    record_latency(stats, STATS_LATENCY_GET_STATS, 10000, 98);
+    record_latency(stats, STATS_LATENCY_GET_STATS, 1000000, 2);
+    record_latency(stats, STATS_LATENCY_STORE_DATA, 5, 1);
+
+    root = json_object();
+    insert_latency_stats_into_json_root(root, stats);
+
+    percentiles = json_object_get(root, "GET /Stats.json");
+    g_assert_nonnull(percentiles);
+    g_assert_cmpint(json_integer_value(json_object_get(percentiles, "count")), ==, 100);
+
+    p50 = json_integer_value(json_object_get(percentiles, "p50"));
+    g_assert_cmpint(p50, >, 10000);
+    g_assert_cmpint(p50, <=, 10000 + 10000 / 8 + 1024);
+
+    p99 = json_integer_value(json_object_get(percentiles, "p99"));
+    g_assert_cmpint(p99, >, 1000000);
+    g_assert_cmpint(p99, <=, 1000000 + 1000000 / 8 + 65536);
+
+    /* small latencies have a bucket of their own */
+    percentiles = json_object_get(root, "backend store_data");
+    g_assert_nonnull(percentiles);
+    g_assert_cmpint(json_integer_value(json_object_get(percentiles, "p99")), >=, 6);
+
+    g_assert_null(json_object_get(root, "GET /Version.json"));
+    g_assert_cmpuint(json_object_size(root), ==, 2);
+
+    json_decref(root);
+    free_stats_t(stats);
+}
+
+
+/**
+ * Prometheus' histograms have cumulative buckets ending on powers of two
+ * and the sum and count of the recorded latencies.
+ */
+static void test_stats_prometheus(void)
+{
+    stats_t *stats = NULL;
+    gchar *metrics = NULL;
+
+    stats = new_stats_t();
+
+    add_one_get_request(stats);
+    add_one_get_request(stats);
+    record_latency(stats, STATS_LATENCY_GET_STATS, 10000, 98);
+    record_latency(stats, STATS_LATENCY_GET_STATS, 1000000, 2);
+    record_latency(stats, STATS_LATENCY_RETRIEVE_DATA, 100, 1);
+
+    metrics = convert_stats_to_prometheus(stats);
+
+    g_assert_nonnull(strstr(metrics, "cdpfgl_requests_total{method=\"GET\"} 2\n"));
+    g_assert_nonnull(strstr(metrics, "cdpfgl_requests_total{method=\"POST\"} 0\n"));
+    g_assert_nonnull(strstr(metrics, "# TYPE cdpfgl_request_duration_seconds histogram\n"));
+
+    /* 10 ms latencies are below 16384 µs, 1 s ones below 2^20 µs */
+    g_assert_nonnull(strstr(metrics, "cdpfgl_request_duration_seconds_bucket{method=\"GET\",url=\"/Stats.json\",le=\"0.008192\"} 0\n"));
+    g_assert_nonnull(strstr(metrics, "cdpfgl_request_duration_seconds_bucket{method=\"GET\",url=\"/Stats.json\",le=\"0.016384\"} 98\n"));
+    g_assert_nonnull(strstr(metrics, "cdpfgl_request_duration_seconds_bucket{method=\"GET\",url=\"/Stats.json\",le=\"1.048576\"} 100\n"));
+    g_assert_nonnull(strstr(metrics, "cdpfgl_request_duration_seconds_bucket{method=\"GET\",url=\"/Stats.json\",le=\"+Inf\"} 100\n"));
+    g_assert_nonnull(strstr(metrics, "cdpfgl_request_duration_seconds_count{method=\"GET\",url=\"/Stats.json\"} 100\n"));
+    g_assert_nonnull(strstr(metrics, "cdpfgl_request_duration_seconds_sum{method=\"GET\",url=\"/Stats.json\"} 2.98"));
+
+    g_assert_nonnull(strstr(metrics, "cdpfgl_backend_duration_seconds_count{operation=\"retrieve_data\"} 1\n"));
+    g_assert_null(strstr(metrics, "url=\"/Version.json\""));
+
+    free_variable(metrics);
+    free_stats_t(stats);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/stats/counters", test_stats_counters);
+    g_test_add_func("/stats/latency_threads", test_stats_latency_threads);
+    g_test_add_func("/stats/percentiles", test_stats_percentiles);
+    g_test_add_func("/stats/prometheus", test_stats_prometheus);
+
+    return g_test_run();
+}
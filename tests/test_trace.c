@@ -0,0 +1,271 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_trace.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_trace.c
+ * Tests of tracing: clocks are spans whose parent is the span their
+ * thread was in, events of every thread are written by the flusher in
+ * Chrome's trace event format and events that do not fit in a ring are
+ * counted as dropped.
+ */
+
+#include "libcdpfgl.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_TRACE_FILL
+ * Number of events recorded at once by the thread that fills its ring.
+ */
+#define TEST_TRACE_FILL (3 * TRACE_RING_SIZE)
+
+
+/**
+ * Loads a trace file. The file is a json array whose closing ']' is
+ * missing (as Chrome's trace event format allows).
+ * @param filename is the name of the trace file.
+ * @returns the json array of events.
+ */
+static json_t *load_trace(const gchar *filename)
+{
+    gchar *contents = NULL;
+    gchar *json_str = NULL;
+    json_t *events = NULL;
+
+    g_assert_true(g_file_get_contents(filename, &contents, NULL, NULL));
+    g_strchomp(contents);
+
+    if (g_str_has_suffix(contents, ","))
+        {
+            contents[strlen(contents) - 1] = '\0';
+        }
+
+    json_str = g_strconcat(contents, "]", NULL);
+    events = json_loads(json_str, 0, NULL);
+    g_assert_nonnull(events);
+    g_assert_true(json_is_array(events));
+
+    free_variable(json_str);
+    free_variable(contents);
+
+    return events;
+}
+
+
+/**
+ * Finds an event by its name.
+ * @param events is the json array of events.
+ * @param name is the name of the event.
+ * @returns the event (a borrowed reference).
+ */
+static json_t *find_event(json_t *events, const gchar *name)
+{
+    json_t *event = NULL;
+    size_t index = 0;
+
+    json_array_foreach(events, index, event)
+        {
+            if (g_strcmp0(json_string_value(json_object_get(event, "name")), name) == 0)
+                {
+                    return event;
+                }
+        }
+
+    g_assert_not_reached();
+
+    return NULL;
+}
+
+
+/**
+ * Gets a span id of an event.
+ * @param event is the event.
+ * @param key is "span" or "parent".
+ * @returns the span id.
+ */
+static guint64 get_event_span(json_t *event, const gchar *key)
+{
+    const gchar *hex = NULL;
+
+    hex = json_string_value(json_object_get(json_object_get(event, "args"), key));
+    g_assert_nonnull(hex);
+
+    return g_ascii_strtoull(hex, NULL, 16);
+}
+
+
+/**
+ * Measures a span whose parent is given (used as a GThreadFunc).
+ * @param data is a pointer to the parent span.
+ * @returns NULL.
+ */
+static gpointer child_span_thread(gpointer data)
+{
+    guint64 *parent = (guint64 *) data;
+    a_clock_t *my_clock = NULL;
+
+    my_clock = new_clock_t_from_span(*parent);
+    g_assert_cmpuint(get_trace_current_span(), ==, my_clock->span);
+    end_clock(my_clock, "thread");
+    g_assert_cmpuint(get_trace_current_span(), ==, 0);
+
+    return NULL;
+}
+
+
+/**
+ * Records more events than the ring of the thread may keep (used as a
+ * GThreadFunc).
+ * @param data is not used.
+ * @returns NULL.
+ */
+static gpointer fill_ring_thread(gpointer data)
+{
+    guint i = 0;
+
+    for (i = 0; i < TEST_TRACE_FILL; i++)
+        {
+            add_trace_event("fill", g_get_monotonic_time(), 1, new_trace_span_id(), 0);
+        }
+
+    return NULL;
+}
+
+
+/**
+ * Without tracing clocks are no spans and nothing is recorded.
+ */
+static void test_trace_disabled(void)
+{
+    a_clock_t *my_clock = NULL;
+
+    g_assert_false(is_trace_enabled());
+
+    my_clock = new_clock_t();
+    g_assert_nonnull(my_clock);
+    g_assert_cmpuint(my_clock->span, ==, 0);
+    g_assert_cmpuint(get_trace_current_span(), ==, 0);
+    set_trace_current_span(42);
+    g_assert_cmpuint(get_trace_current_span(), ==, 0);
+    add_trace_event("nothing", 0, 0, 1, 0);
+    end_clock(my_clock, "nothing");
+
+    init_trace(NULL);
+    g_assert_false(is_trace_enabled());
+    terminate_trace();
+}
+
+
+/**
+ * Nested clocks and clocks of other threads are linked to their parent,
+ * names are escaped and events that do not fit in a ring are counted.
+ */
+static void test_trace_spans(void)
+{
+    a_clock_t *outer = NULL;
+    a_clock_t *inner = NULL;
+    GThread *thread = NULL;
+    json_t *events = NULL;
+    json_t *event = NULL;
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+    guint64 outer_span = 0;
+    guint64 fill = 0;
+    guint64 dropped = 0;
+    size_t index = 0;
+
+    prefix = make_test_directory();
+    filename = g_build_filename(prefix, "trace.json", NULL);
+
+    init_clock_t(filename);
+    g_assert_true(is_trace_enabled());
+
+    outer = new_clock_t();
+    outer_span = outer->span;
+    g_assert_cmpuint(outer_span, !=, 0);
+    g_assert_cmpuint(outer->parent, ==, 0);
+    g_assert_cmpuint(get_trace_current_span(), ==, outer_span);
+
+    inner = new_clock_t();
+    g_assert_cmpuint(inner->parent, ==, outer_span);
+    g_assert_cmpuint(inner->span, !=, outer_span);
+    end_clock(inner, "inner \"quoted\"\n");
+    g_assert_cmpuint(get_trace_current_span(), ==, outer_span);
+
+    thread = g_thread_new("child", child_span_thread, &outer_span);
+    g_thread_join(thread);
+
+    end_clock(outer, "outer");
+    g_assert_cmpuint(get_trace_current_span(), ==, 0);
+
+    thread = g_thread_new("fill", fill_ring_thread, NULL);
+    g_thread_join(thread);
+
+    /* Writes every remaining event */
+    terminate_clock_t();
+    g_assert_false(is_trace_enabled());
+
+    events = load_trace(filename);
+
+    event = find_event(events, "outer");
+    g_assert_cmpstr(json_string_value(json_object_get(event, "ph")), ==, "X");
+    g_assert_cmpuint(get_event_span(event, "span"), ==, outer_span);
+    g_assert_cmpuint(get_event_span(event, "parent"), ==, 0);
+
+    event = find_event(events, "inner \"quoted\"\n");
+    g_assert_cmpuint(get_event_span(event, "parent"), ==, outer_span);
+
+    event = find_event(events, "thread");
+    g_assert_cmpuint(get_event_span(event, "parent"), ==, outer_span);
+    g_assert_cmpint(json_integer_value(json_object_get(event, "tid")), !=, json_integer_value(json_object_get(find_event(events, "outer"), "tid")));
+
+    json_array_foreach(events, index, event)
+        {
+            if (g_strcmp0(json_string_value(json_object_get(event, "name")), "fill") == 0)
+                {
+                    fill++;
+                }
+            else if (g_strcmp0(json_string_value(json_object_get(event, "name")), "dropped events") == 0)
+                {
+                    dropped = dropped + json_integer_value(json_object_get(json_object_get(event, "args"), "dropped"));
+                }
+        }
+
+    g_assert_cmpuint(fill, >=, TRACE_RING_SIZE);
+    g_assert_cmpuint(dropped, >, 0);
+    g_assert_cmpuint(fill + dropped, ==, TEST_TRACE_FILL);
+
+    json_decref(events);
+    remove_test_directory(prefix);
+    free_variable(filename);
+    free_variable(prefix);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/trace/disabled", test_trace_disabled);
+    g_test_add_func("/trace/spans", test_trace_spans);
+
+    return g_test_run();
+}
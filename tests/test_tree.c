@@ -0,0 +1,270 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_tree.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_tree.c
+ * Tests of the restoration of lists of files: names follow --where and
+ * --parents, the blocks of small files are asked together in shared
+ * batches and big files are restored on their own.
+ */
+
+#include <glib/gstdio.h>
+#include "restore.h"
+#include "test_common.h"
+#include "test_block_server.h"
+
+/**
+ * @def TEST_MTIME
+ * Modification time of every restored entry.
+ */
+#define TEST_MTIME (1500000000)
+
+
+/**
+ * Makes the meta data of a file whose blocks are added to the server.
+ * @param server is the block server.
+ * @param name is the name of the saved file.
+ * @param nb_blocks is the number of blocks of the file.
+ * @param[out] expected is the content of the file.
+ * @returns a newly allocated server_meta_data_t * structure.
+ */
+static server_meta_data_t *make_test_file(block_server_t *server, const gchar *name, guint nb_blocks, GByteArray *expected)
+{
+    server_meta_data_t *smeta = NULL;
+    guchar data[300];
+    guint8 *hash = NULL;
+    guint i = 0;
+    guint j = 0;
+
+    smeta = new_smeta_data_t();
+    smeta->hostname = g_strdup("treehost");
+    smeta->meta = new_meta_data_t();
+    smeta->meta->file_type = G_FILE_TYPE_REGULAR;
+    smeta->meta->mode = 0100644;
+    smeta->meta->mtime = TEST_MTIME;
+    smeta->meta->atime = TEST_MTIME;
+    smeta->meta->name = g_strdup(name);
+    smeta->meta->link = g_strdup("");
+    smeta->meta->owner = g_strdup("root");
+    smeta->meta->group = g_strdup("root");
+
+    for (i = 0; i < nb_blocks; i++)
+        {
+            for (j = 0; j < sizeof(data); j++)
+                {
+                    data[j] = (guchar) (strlen(name) + i * 7 + j);
+                }
+
+            hash = add_block_to_server(server, data, sizeof(data), COMPRESS_ZLIB_TYPE);
+            smeta->meta->hash_data_list = g_list_append(smeta->meta->hash_data_list, new_hash_data_t_as_is(NULL, 0, hash, COMPRESS_NONE_TYPE, 0));
+            g_byte_array_append(expected, data, sizeof(data));
+        }
+
+    smeta->meta->size = (guint64) nb_blocks * sizeof(data);
+
+    return smeta;
+}
+
+
+/**
+ * Makes the meta data of a directory or of a symbolic link.
+ * @param name is the name of the saved entry.
+ * @param link is the target of the link or NULL for a directory.
+ * @returns a newly allocated server_meta_data_t * structure.
+ */
+static server_meta_data_t *make_test_entry(const gchar *name, const gchar *link)
+{
+    server_meta_data_t *smeta = NULL;
+
+    smeta = new_smeta_data_t();
+    smeta->hostname = g_strdup("treehost");
+    smeta->meta = new_meta_data_t();
+    smeta->meta->file_type = (link == NULL) ? G_FILE_TYPE_DIRECTORY : G_FILE_TYPE_SYMBOLIC_LINK;
+    smeta->meta->mode = (link == NULL) ? 040755 : 0120777;
+    smeta->meta->mtime = TEST_MTIME;
+    smeta->meta->atime = TEST_MTIME;
+    smeta->meta->name = g_strdup(name);
+    smeta->meta->link = g_strdup(link == NULL ? "" : link);
+    smeta->meta->owner = g_strdup("root");
+    smeta->meta->group = g_strdup("root");
+
+    return smeta;
+}
+
+
+/**
+ * Checks that a restored file has the expected content and date.
+ * @param where is the directory where files are restored.
+ * @param name is the name of the saved file.
+ * @param expected is the expected content.
+ */
+static void assert_restored_file(const gchar *where, const gchar *name, GByteArray *expected)
+{
+    GStatBuf buf;
+    gchar *filename = NULL;
+    gchar *contents = NULL;
+    gsize len = 0;
+
+    filename = g_build_filename(where, name, NULL);
+
+    g_assert_true(g_file_get_contents(filename, &contents, &len, NULL));
+    g_assert_cmpmem(contents, len, expected->data, expected->len);
+    g_assert_cmpint(g_stat(filename, &buf), ==, 0);
+    g_assert_cmpint(buf.st_mtime, ==, TEST_MTIME);
+
+    free_variable(contents);
+    free_variable(filename);
+}
+
+
+/**
+ * Names follow --where, --parents and --all-versions.
+ */
+static void test_tree_filenames(void)
+{
+    options_t *opt = NULL;
+    meta_data_t *meta = NULL;
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+    gchar *expected = NULL;
+    gchar *the_date = NULL;
+
+    prefix = make_test_directory();
+    opt = (options_t *) g_malloc0(sizeof(options_t));
+    opt->where = prefix;
+
+    meta = new_meta_data_t();
+    meta->name = g_strdup("/home/user/notes.txt");
+    meta->mtime = TEST_MTIME;
+
+    filename = get_filename_to_restore(opt, meta);
+    expected = g_build_filename(prefix, "notes.txt", NULL);
+    g_assert_cmpstr(filename, ==, expected);
+    free_variable(expected);
+    free_variable(filename);
+
+    opt->parents = TRUE;
+    filename = get_filename_to_restore(opt, meta);
+    expected = g_build_filename(prefix, "home", "user", "notes.txt", NULL);
+    g_assert_cmpstr(filename, ==, expected);
+    free_variable(expected);
+    free_variable(filename);
+
+    /* --parents makes the directories of the file */
+    expected = g_build_filename(prefix, "home", "user", NULL);
+    g_assert_true(g_file_test(expected, G_FILE_TEST_IS_DIR));
+    free_variable(expected);
+
+    opt->parents = FALSE;
+    opt->all_versions = TRUE;
+    filename = get_filename_to_restore(opt, meta);
+    the_date = transform_date_to_string(meta->mtime, TRUE);
+    expected = g_strdup_printf("%s%s%s_notes.txt", prefix, G_DIR_SEPARATOR_S, the_date);
+    g_assert_cmpstr(filename, ==, expected);
+    free_variable(expected);
+    free_variable(filename);
+
+    free_variable(the_date);
+    free_meta_data_t(meta, TRUE);
+    g_free(opt);
+    remove_test_directory(prefix);
+    free_variable(prefix);
+}
+
+
+/**
+ * A directory with small files, an empty one, a big one and a link is
+ * restored with one request for all the small files and parallel
+ * requests for the big one.
+ */
+static void test_tree_restore(void)
+{
+    block_server_t *server = NULL;
+    comm_t *comm = NULL;
+    options_t *opt = NULL;
+    GSList *list = NULL;
+    GByteArray *small = NULL;
+    GByteArray *tiny = NULL;
+    GByteArray *empty = NULL;
+    GByteArray *big = NULL;
+    gchar *prefix = NULL;
+    gchar *filename = NULL;
+    gchar *target = NULL;
+
+    server = start_block_server();
+    comm = init_comm_struct(server->conn, COMPRESS_NONE_TYPE);
+    prefix = make_test_directory();
+    opt = (options_t *) g_malloc0(sizeof(options_t));
+    opt->where = prefix;
+    opt->parents = TRUE;
+
+    small = g_byte_array_new();
+    tiny = g_byte_array_new();
+    empty = g_byte_array_new();
+    big = g_byte_array_new();
+
+    list = g_slist_append(list, make_test_entry("/data", NULL));
+    list = g_slist_append(list, make_test_file(server, "/data/big", FETCH_BATCH_SIZE + 10, big));
+    list = g_slist_append(list, make_test_file(server, "/data/empty", 0, empty));
+    list = g_slist_append(list, make_test_entry("/data/link", "small"));
+    list = g_slist_append(list, make_test_file(server, "/data/small", 3, small));
+    list = g_slist_append(list, make_test_file(server, "/data/tiny", 1, tiny));
+
+    restore_tree(comm, opt, list);
+
+    assert_restored_file(prefix, "/data/big", big);
+    assert_restored_file(prefix, "/data/empty", empty);
+    assert_restored_file(prefix, "/data/small", small);
+    assert_restored_file(prefix, "/data/tiny", tiny);
+
+    filename = g_build_filename(prefix, "data", "link", NULL);
+    target = g_file_read_link(filename, NULL);
+    g_assert_cmpstr(target, ==, "small");
+    free_variable(target);
+    free_variable(filename);
+
+    /* one batch for the small files and two for the big one */
+    g_assert_cmpuint(get_block_server_nb_requests(server), ==, 3);
+    g_assert_cmpuint(get_block_server_nb_hashs(server), ==, FETCH_BATCH_SIZE + 14);
+
+    g_slist_free_full(list, free_gslist_smeta);
+    g_byte_array_free(big, TRUE);
+    g_byte_array_free(empty, TRUE);
+    g_byte_array_free(tiny, TRUE);
+    g_byte_array_free(small, TRUE);
+    g_free(opt);
+    remove_test_directory(prefix);
+    free_variable(prefix);
+    free_comm_t(comm);
+    stop_block_server(server);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/tree/filenames", test_tree_filenames);
+    g_test_add_func("/tree/restore", test_tree_restore);
+
+    return g_test_run();
+}
@@ -0,0 +1,265 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    test_verify.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file test_verify.c
+ * Tests of the comparison of local files with saved ones: local files
+ * are cut with the known block sizes and compared to the saved hashs
+ * without fetching any block.
+ */
+
+#include <glib/gstdio.h>
+#include "restore.h"
+#include "test_common.h"
+
+/**
+ * @def TEST_BLOCKSIZE
+ * Block size the test files are saved with.
+ *
+ * @def TEST_SIZE
+ * Size of the test files (only TEST_BLOCKSIZE among the known block
+ * sizes gives 3 blocks for this size).
+ */
+#define TEST_BLOCKSIZE (2048)
+#define TEST_SIZE (5000)
+
+
+/**
+ * Makes the content of a test file.
+ * @param changed is TRUE to change the content of its last block.
+ * @returns a newly allocated GByteArray with the content.
+ */
+static GByteArray *make_test_content(gboolean changed)
+{
+    GByteArray *content = NULL;
+    guint j = 0;
+
+    content = g_byte_array_sized_new(TEST_SIZE);
+    g_byte_array_set_size(content, TEST_SIZE);
+
+    for (j = 0; j < TEST_SIZE; j++)
+        {
+            content->data[j] = (j % 251) + 1;
+        }
+
+    if (changed == TRUE)
+        {
+            content->data[TEST_SIZE - 1] = 0;
+        }
+
+    return content;
+}
+
+
+/**
+ * Makes the meta data of a file saved with some block size.
+ * @param name is the name of the saved file.
+ * @param content is the content of the saved file.
+ * @param blocksize is the block size the file was cut with.
+ * @returns a newly allocated server_meta_data_t * structure.
+ */
+static server_meta_data_t *make_test_file(const gchar *name, GByteArray *content, gsize blocksize)
+{
+    server_meta_data_t *smeta = NULL;
+    guint8 *hash = NULL;
+    gsize offset = 0;
+
+    smeta = new_smeta_data_t();
+    smeta->hostname = g_strdup("verifyhost");
+    smeta->meta = new_meta_data_t();
+    smeta->meta->file_type = G_FILE_TYPE_REGULAR;
+    smeta->meta->name = g_strdup(name);
+    smeta->meta->link = g_strdup("");
+    smeta->meta->size = content->len;
+
+    for (offset = 0; offset < content->len; offset = offset + blocksize)
+        {
+            hash = calculate_hash_for_string(content->data + offset, MIN(blocksize, content->len - offset));
+            smeta->meta->hash_data_list = g_list_append(smeta->meta->hash_data_list, new_hash_data_t_as_is(NULL, 0, hash, COMPRESS_NONE_TYPE, 0));
+        }
+
+    return smeta;
+}
+
+
+/**
+ * Makes the meta data of a directory or of a symbolic link.
+ * @param name is the name of the saved entry.
+ * @param link is the target of the link or NULL for a directory.
+ * @returns a newly allocated server_meta_data_t * structure.
+ */
+static server_meta_data_t *make_test_entry(const gchar *name, const gchar *link)
+{
+    server_meta_data_t *smeta = NULL;
+
+    smeta = new_smeta_data_t();
+    smeta->hostname = g_strdup("verifyhost");
+    smeta->meta = new_meta_data_t();
+    smeta->meta->file_type = (link == NULL) ? G_FILE_TYPE_DIRECTORY : G_FILE_TYPE_SYMBOLIC_LINK;
+    smeta->meta->name = g_strdup(name);
+    smeta->meta->link = g_strdup(link == NULL ? "" : link);
+
+    return smeta;
+}
+
+
+/**
+ * Writes a local file under the test directory.
+ * @param prefix is the test directory.
+ * @param name is the name of the file in the test directory.
+ * @param content is the content of the file.
+ * @returns the newly allocated name of the written file.
+ */
+static gchar *write_local_file(const gchar *prefix, const gchar *name, GByteArray *content)
+{
+    gchar *filename = NULL;
+
+    filename = g_build_filename(prefix, name, NULL);
+    g_assert_true(g_file_set_contents(filename, (gchar *) content->data, content->len, NULL));
+
+    return filename;
+}
+
+
+/**
+ * A local copy is identical, different or, when the saved file was cut
+ * with a block size that is not a known one, can not be compared.
+ */
+static void test_verify_compare(void)
+{
+    server_meta_data_t *saved = NULL;
+    server_meta_data_t *custom = NULL;
+    GByteArray *content = NULL;
+    GByteArray *changed = NULL;
+    gchar *prefix = NULL;
+    gchar *same = NULL;
+    gchar *other = NULL;
+
+    prefix = make_test_directory();
+    content = make_test_content(FALSE);
+    changed = make_test_content(TRUE);
+    same = write_local_file(prefix, "same", content);
+    other = write_local_file(prefix, "other", changed);
+
+    saved = make_test_file("/same", content, TEST_BLOCKSIZE);
+    g_assert_cmpint(compare_local_copy(same, saved->meta), ==, REUSE_IDENTICAL);
+    g_assert_cmpint(compare_local_copy(other, saved->meta), ==, REUSE_DIFFERENT);
+
+    /* saved with -b 1000: 5 blocks that no known block size gives */
+    custom = make_test_file("/same", content, 1000);
+    g_assert_cmpint(compare_local_copy(same, custom->meta), ==, REUSE_UNKNOWN_BLOCKSIZE);
+    g_assert_cmpint(compare_local_copy(other, custom->meta), ==, REUSE_UNKNOWN_BLOCKSIZE);
+
+    free_smeta_data_t(custom);
+    free_smeta_data_t(saved);
+    free_variable(other);
+    free_variable(same);
+    g_byte_array_free(changed, TRUE);
+    g_byte_array_free(content, TRUE);
+    remove_test_directory(prefix);
+    free_variable(prefix);
+}
+
+
+/**
+ * Only the latest version of each file is compared and the verification
+ * fails as soon as one file is changed, missing or can not be compared.
+ */
+static void test_verify_tree(void)
+{
+    options_t *opt = NULL;
+    GSList *list = NULL;
+    GSList *matching = NULL;
+    GByteArray *content = NULL;
+    GByteArray *changed = NULL;
+    gchar *prefix = NULL;
+    gchar *dirname = NULL;
+    gchar *filename = NULL;
+
+    prefix = make_test_directory();
+    opt = (options_t *) g_malloc0(sizeof(options_t));
+    opt->where = prefix;
+
+    content = make_test_content(FALSE);
+    changed = make_test_content(TRUE);
+
+    dirname = g_build_filename(prefix, "data", NULL);
+    g_mkdir(dirname, 0700);
+    filename = write_local_file(dirname, "same", content);
+    free_variable(filename);
+    filename = write_local_file(dirname, "versioned", content);
+    free_variable(filename);
+    filename = g_build_filename(dirname, "link", NULL);
+    g_assert_cmpint(symlink("same", filename), ==, 0);
+    free_variable(filename);
+
+    /* every local entry matches */
+    matching = g_slist_append(matching, make_test_entry("/data", NULL));
+    matching = g_slist_append(matching, make_test_entry("/data/link", "same"));
+    matching = g_slist_append(matching, make_test_file("/data/same", content, TEST_BLOCKSIZE));
+    matching = g_slist_append(matching, make_test_file("/data/versioned", changed, TEST_BLOCKSIZE));
+    matching = g_slist_append(matching, make_test_file("/data/versioned", content, TEST_BLOCKSIZE));
+    g_assert_true(verify_tree(opt, matching));
+
+    /* the latest version changed */
+    list = g_slist_append(list, make_test_file("/data/versioned", content, TEST_BLOCKSIZE));
+    list = g_slist_append(list, make_test_file("/data/versioned", changed, TEST_BLOCKSIZE));
+    g_assert_false(verify_tree(opt, list));
+    g_slist_free_full(list, free_gslist_smeta);
+    list = NULL;
+
+    /* a missing file */
+    list = g_slist_append(list, make_test_file("/data/missing", content, TEST_BLOCKSIZE));
+    g_assert_false(verify_tree(opt, list));
+    g_slist_free_full(list, free_gslist_smeta);
+    list = NULL;
+
+    /* a link pointing elsewhere */
+    list = g_slist_append(list, make_test_entry("/data/link", "versioned"));
+    g_assert_false(verify_tree(opt, list));
+    g_slist_free_full(list, free_gslist_smeta);
+    list = NULL;
+
+    /* a file that can not be compared */
+    list = g_slist_append(list, make_test_file("/data/same", content, 1000));
+    g_assert_false(verify_tree(opt, list));
+    g_slist_free_full(list, free_gslist_smeta);
+
+    g_slist_free_full(matching, free_gslist_smeta);
+    g_byte_array_free(changed, TRUE);
+    g_byte_array_free(content, TRUE);
+    free_variable(dirname);
+    g_free(opt);
+    remove_test_directory(prefix);
+    free_variable(prefix);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/verify/compare", test_verify_compare);
+    g_test_add_func("/verify/tree", test_verify_tree);
+
+    return g_test_run();
+}